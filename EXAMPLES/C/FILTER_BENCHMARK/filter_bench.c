@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pigpio_kernels.h"
+
+/*
+2026-10-17
+
+gcc -Wall -O2 -I../../.. -o filter_bench filter_bench.c
+$ ./filter_bench
+
+This program checks that the bit-parallel glitch and noise filters
+used by the pigpio alert thread give the same results as the
+original per GPIO filters, and compares their speed.
+
+The per GPIO filters are copies of the original code.  The
+bit-parallel filters are those pigpio.c runs (alertGlitchFilter and
+alertNoiseFilter in pigpio_kernels.h).  Both are run over the same
+sample buffers, in blocks of -b samples as the alert thread does.
+The filtered levels and the filter state are compared after every
+block.
+
+The samples are either read from a file (-f) of raw gpioSample_t,
+e.g. as saved by a gpioSetGetSamplesFunc callback, or generated:
+1 us samples in which each of -n GPIO toggles at random with
+occasional glitches shorter than the filter steady time.
+
+EXAMPLES
+
+Check and time both filters on 32 filtered GPIO
+./filter_bench -n 32
+
+The same on recorded samples
+./filter_bench -f samples.bin
+*/
+
+#define OPT_B_MIN 1
+#define OPT_B_MAX 100000
+#define OPT_B_DEF 1000
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 32
+#define OPT_N_DEF 32
+
+#define OPT_S_MIN 1000
+#define OPT_S_MAX 100000000
+#define OPT_S_DEF 10000000
+
+static int   g_opt_b = OPT_B_DEF;
+static int   g_opt_n = OPT_N_DEF;
+static int   g_opt_s = OPT_S_DEF;
+static char *g_opt_f = NULL;
+
+/* the parts of the pigpio.c state the filters use */
+
+static alertFilter_t *gpioAlert;
+
+static uint32_t monitorBits;
+static uint32_t gFilterBits;
+static uint32_t nFilterBits;
+
+/* original per GPIO filters */
+
+static void alertGlitchFilterScalar(gpioSample_t *sample, int numSamples)
+{
+   int i, j, diff;
+   uint32_t steadyUs, changedTick, RBitV, LBitV, initialised;
+   uint32_t bit, bitV;
+
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   {
+      bit = (1<<i);
+
+      if (monitorBits & bit & gFilterBits)
+      {
+         initialised = gpioAlert[i].gfInitialised;
+         if (!initialised && numSamples > 0)
+         {
+           /* Initialise filter with first sample */
+           bitV = sample[0].level & bit;
+           gpioAlert[i].gfRBitV = bitV;
+           gpioAlert[i].gfLBitV = bitV;
+           gpioAlert[i].gfTick = sample[0].tick;
+           gpioAlert[i].gfInitialised = 1;
+         }
+
+         steadyUs    = gpioAlert[i].gfSteadyUs;
+         RBitV       = gpioAlert[i].gfRBitV;
+         LBitV       = gpioAlert[i].gfLBitV;
+         changedTick = gpioAlert[i].gfTick;
+
+         for (j=0; j<numSamples; j++)
+         {
+            bitV = sample[j].level & bit;
+
+            if (bitV != LBitV)
+            {
+               /* Difference between level and last level.
+                  Restart steady timer. */
+
+               changedTick = sample[j].tick;
+               LBitV = bitV;
+            }
+
+            if (bitV != RBitV)
+            {
+               /* Difference between level and reported level. */
+
+               diff = sample[j].tick - changedTick;
+
+               if (diff >= steadyUs)
+               {
+                  /* Level stable for steady period. */
+                  RBitV = bitV;
+               }
+               else
+               {
+                  /* Keep reporting old level. */
+
+                  sample[j].level ^= bit;
+               }
+            }
+
+         }
+
+         gpioAlert[i].gfRBitV = RBitV;
+         gpioAlert[i].gfLBitV = LBitV;
+         gpioAlert[i].gfTick  = changedTick;
+      }
+   }
+}
+
+static void alertNoiseFilterScalar(gpioSample_t *sample, int numSamples)
+{
+   int i, j, diff;
+   uint32_t LBitV;
+   uint32_t bit, bitV;
+   uint32_t nowTick;
+
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   {
+      bit = (1<<i);
+
+      if (monitorBits & bit & nFilterBits)
+      {
+         LBitV = gpioAlert[i].nfLBitV;
+
+         for (j=0; j<numSamples; j++)
+         {
+            bitV = sample[j].level & bit;
+            nowTick = sample[j].tick;
+
+            if (gpioAlert[i].nfActive) /* reporting events */
+            {
+               diff = nowTick - gpioAlert[i].nfTick2;
+
+               if (diff >= 0)
+               {
+                  /* Stop reporting gpio changes */
+
+                  gpioAlert[i].nfActive = 0;
+                  gpioAlert[i].nfTick1 = nowTick;
+               }
+            }
+            else /* waiting for steady us */
+            {
+               if (bitV != LBitV)
+               {
+                  diff = nowTick - gpioAlert[i].nfTick1;
+                  gpioAlert[i].nfTick1 = nowTick;
+
+                  if (diff >= gpioAlert[i].nfSteadyUs)
+                  {
+                     /* Start reporting gpio changes */
+
+                     gpioAlert[i].nfRBitV = LBitV;
+                     gpioAlert[i].nfActive = 1;
+                     gpioAlert[i].nfTick2 =
+                        nowTick + gpioAlert[i].nfActiveUs;
+                  }
+               }
+            }
+
+            if (!gpioAlert[i].nfActive)
+            {
+               if (bitV != gpioAlert[i].nfRBitV)
+                  sample[j].level ^= bit;
+            }
+
+            LBitV = bitV;
+         }
+
+         gpioAlert[i].nfLBitV = LBitV;
+
+      }
+   }
+}
+
+/* the bit-parallel filters pigpio.c runs */
+
+static void glitchKernel(gpioSample_t *sample, int numSamples)
+{
+   alertGlitchFilter(
+      gpioAlert, monitorBits & gFilterBits, sample, numSamples);
+}
+
+static void noiseKernel(gpioSample_t *sample, int numSamples)
+{
+   alertNoiseFilter(
+      gpioAlert, monitorBits & nFilterBits, sample, numSamples);
+}
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./filter_bench [OPTION] ...\n" \
+      "   -b value, samples per block, %d-%d, default %d\n" \
+      "   -f file,  raw gpioSample_t file,   default generated\n" \
+      "   -n value, filtered GPIO, %d-%d,        default %d\n" \
+      "   -s value, generated samples,        default %d\n" \
+      "\nEXAMPLE\n" \
+      "./filter_bench -n 8 -b 200\n" \
+      "Filter 8 GPIO in blocks of 200 samples.\n" \
+      "\n",
+      OPT_B_MIN, OPT_B_MAX, OPT_B_DEF,
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF,
+      OPT_S_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "b:f:n:s:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_B_MIN) && (i <= OPT_B_MAX)) g_opt_b = i;
+            else
+            {
+               fprintf(stderr, "invalid -b option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'f':
+            g_opt_f = optarg;
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else
+            {
+               fprintf(stderr, "invalid -n option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 's':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_S_MIN) && (i <= OPT_S_MAX)) g_opt_s = i;
+            else
+            {
+               fprintf(stderr, "invalid -s option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static double seconds(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static gpioSample_t *loadSamples(char *file, int *numSamples)
+{
+   gpioSample_t *s;
+   FILE *f;
+   long size;
+
+   f = fopen(file, "rb");
+
+   if (f == NULL) return NULL;
+
+   fseek(f, 0, SEEK_END);
+   size = ftell(f) / sizeof(gpioSample_t);
+   fseek(f, 0, SEEK_SET);
+
+   s = malloc(size * sizeof(gpioSample_t));
+
+   if (s) *numSamples = fread(s, sizeof(gpioSample_t), size, f);
+
+   fclose(f);
+
+   return s;
+}
+
+static gpioSample_t *makeSamples(int numSamples)
+{
+   gpioSample_t *s;
+   uint32_t level, glitch, tick;
+   int i, b;
+
+   s = malloc(numSamples * sizeof(gpioSample_t));
+
+   if (s == NULL) return NULL;
+
+   srand(1);
+
+   level  = 0;
+   glitch = 0;
+   tick   = 0xFFFF0000; /* exercise tick wrap */
+
+   for (i=0; i<numSamples; i++)
+   {
+      /* undo last sample's glitches, start new ones and edges */
+
+      level ^= glitch;
+      glitch = 0;
+
+      for (b=0; b<g_opt_n; b++)
+      {
+         switch (rand() % 2000)
+         {
+            case 0:  level  ^= (1<<b); break;
+            case 1:  glitch |= (1<<b); break;
+         }
+      }
+
+      level ^= glitch;
+
+      s[i].tick  = tick;
+      s[i].level = level;
+
+      tick += 1 + (rand() % 4 == 0);
+   }
+
+   return s;
+}
+
+static void initAlert(alertFilter_t *a)
+{
+   int i;
+
+   memset(a, 0, sizeof(alertFilter_t) * 32);
+
+   for (i=0; i<32; i++)
+   {
+      a[i].gfSteadyUs = 5 + (i % 7);
+      a[i].nfSteadyUs = 20 + (i % 5);
+      a[i].nfActiveUs = 500 + (i * 10);
+   }
+}
+
+static double run(
+   void (*glitch)(gpioSample_t *, int),
+   void (*noise)(gpioSample_t *, int),
+   alertFilter_t *state, gpioSample_t *s, int numSamples, int pos, int len)
+{
+   double t0;
+
+   gpioAlert = state;
+
+   t0 = seconds();
+
+   if (gFilterBits) glitch(s+pos, len);
+   if (nFilterBits) noise(s+pos, len);
+
+   return seconds() - t0;
+}
+
+static int test(
+   char *name, gpioSample_t *samples, int numSamples,
+   uint32_t gBits, uint32_t nBits)
+{
+   alertFilter_t a1[32], a2[32];
+   gpioSample_t *s1, *s2;
+   double t1, t2;
+   int pos, len, i;
+
+   s1 = malloc(numSamples * sizeof(gpioSample_t));
+   s2 = malloc(numSamples * sizeof(gpioSample_t));
+
+   memcpy(s1, samples, numSamples * sizeof(gpioSample_t));
+   memcpy(s2, samples, numSamples * sizeof(gpioSample_t));
+
+   initAlert(a1);
+   initAlert(a2);
+
+   gFilterBits = gBits;
+   nFilterBits = nBits;
+
+   t1 = 0;
+   t2 = 0;
+
+   for (pos=0; pos<numSamples; pos+=len)
+   {
+      len = numSamples - pos;
+      if (len > g_opt_b) len = g_opt_b;
+
+      t1 += run(alertGlitchFilterScalar, alertNoiseFilterScalar,
+               a1, s1, numSamples, pos, len);
+
+      t2 += run(glitchKernel, noiseKernel,
+               a2, s2, numSamples, pos, len);
+
+      if (memcmp(s1+pos, s2+pos, len * sizeof(gpioSample_t)))
+      {
+         for (i=pos; i<pos+len; i++) if (s1[i].level != s2[i].level) break;
+
+         printf("%-14s FAILED levels differ at sample %d (%08X %08X)\n",
+            name, i, s1[i].level, s2[i].level);
+
+         return 1;
+      }
+
+      if (memcmp(a1, a2, sizeof(a1)))
+      {
+         printf("%-14s FAILED state differs after sample %d\n",
+            name, pos+len);
+
+         return 1;
+      }
+   }
+
+   printf("%-14s ok  per GPIO %7.2f ns/sample  bit-parallel %7.2f ns/sample"
+          "  x%.1f\n",
+      name, (t1 * 1e9) / numSamples, (t2 * 1e9) / numSamples, t1 / t2);
+
+   free(s1);
+   free(s2);
+
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   gpioSample_t *samples;
+   int numSamples, errors;
+   uint32_t bits;
+
+   initOpts(argc, argv);
+
+   if (g_opt_f)
+   {
+      samples = loadSamples(g_opt_f, &numSamples);
+
+      if (samples == NULL)
+      {
+         fprintf(stderr, "can't read %s\n", g_opt_f);
+         return 1;
+      }
+   }
+   else
+   {
+      numSamples = g_opt_s;
+      samples = makeSamples(numSamples);
+
+      if (samples == NULL)
+      {
+         fprintf(stderr, "out of memory\n");
+         return 1;
+      }
+   }
+
+   if (g_opt_n == 32) bits = 0xFFFFFFFF;
+   else               bits = (1U << g_opt_n) - 1;
+
+   monitorBits = 0xFFFFFFFF;
+
+   printf("%d samples, %d filtered GPIO, blocks of %d\n",
+      numSamples, g_opt_n, g_opt_b);
+
+   errors = 0;
+
+   errors += test("glitch", samples, numSamples, bits, 0);
+   errors += test("noise", samples, numSamples, 0, bits);
+   errors += test("glitch+noise", samples, numSamples, bits, bits);
+
+   free(samples);
+
+   return errors ? 1 : 0;
+}
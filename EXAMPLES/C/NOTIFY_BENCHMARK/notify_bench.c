@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+#include <pigpiod_if2.h>
+
+/*
+2026-10-17
+
+gcc -Wall -pthread -o notify_bench notify_bench.c -lpigpiod_if2 -lrt
+$ ./notify_bench -g 4 -s 5
+
+This program compares the bytes per edge of the two notification
+report formats, PI_NOTIFY_FORMAT_V1 (12 byte gpioReport_t) and
+PI_NOTIFY_FORMAT_V2 (varint delta encoded).
+
+For each of a range of toggle rates GPIO -g is driven with a 50%
+PWM signal for -s seconds while a pipe of each format is read.
+The edges seen and the bytes read per edge are reported.
+
+The daemon must be on the same host (pipes are local only).
+Nothing else should be connected to GPIO -g.
+
+EXAMPLES
+
+Bytes per edge on GPIO 4, 5 seconds per rate
+./notify_bench -g 4 -s 5
+
+The same for a GPIO above 7, whose level XOR needs a wider varint
+./notify_bench -g 21
+*/
+
+#define OPT_G_MIN 0
+#define OPT_G_MAX 31
+#define OPT_G_DEF 4
+
+#define OPT_S_MIN 1
+#define OPT_S_MAX 60
+#define OPT_S_DEF 2
+
+static char *g_opt_a = NULL;
+static char *g_opt_p = NULL;
+static int   g_opt_g = OPT_G_DEF;
+static int   g_opt_s = OPT_S_DEF;
+
+static unsigned rates[] = {10, 100, 500, 1000, 2000, 4000, 8000};
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./notify_bench [OPTION] ...\n" \
+      "   -a host,  daemon address,  default $PIGPIO_ADDR or localhost\n" \
+      "   -g value, GPIO to toggle, %d-%d, default %d\n" \
+      "   -p port,  daemon port,     default $PIGPIO_PORT or 8888\n" \
+      "   -s value, seconds per rate, %d-%d, default %d\n" \
+      "\nEXAMPLE\n" \
+      "./notify_bench -g 17 -s 5\n" \
+      "Toggle GPIO 17 for 5 seconds at each rate.\n" \
+      "\n",
+      OPT_G_MIN, OPT_G_MAX, OPT_G_DEF,
+      OPT_S_MIN, OPT_S_MAX, OPT_S_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "a:g:p:s:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+            g_opt_a = optarg;
+            break;
+
+         case 'g':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_G_MIN) && (i <= OPT_G_MAX)) g_opt_g = i;
+            else
+            {
+               fprintf(stderr, "invalid -g option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'p':
+            g_opt_p = optarg;
+            break;
+
+         case 's':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_S_MIN) && (i <= OPT_S_MAX)) g_opt_s = i;
+            else
+            {
+               fprintf(stderr, "invalid -s option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static int openPipe(int pi, unsigned format, int *fd)
+{
+   char name[32];
+   int h;
+
+   h = notify_open_with_format(pi, format);
+
+   if (h < 0) return h;
+
+   sprintf(name, "/dev/pigpio%d", h);
+
+   *fd = open(name, O_RDONLY|O_NONBLOCK);
+
+   if (*fd < 0)
+   {
+      notify_close(pi, h);
+      return -1;
+   }
+
+   return h;
+}
+
+static long drain(int fd)
+{
+   char buf[65536];
+   long total = 0;
+   int r;
+
+   while ((r = read(fd, buf, sizeof(buf))) > 0) total += r;
+
+   return total;
+}
+
+static void run(int pi, unsigned rate)
+{
+   struct pollfd pfd[2];
+   struct timespec ts;
+   int h1, h2, fd1, fd2;
+   long b1, b2, edges;
+   double end;
+
+   if ((h1 = openPipe(pi, PI_NOTIFY_FORMAT_V1, &fd1)) < 0)
+   {
+      fprintf(stderr, "can't open v1 notification (%s)\n", pigpio_error(h1));
+      exit(EXIT_FAILURE);
+   }
+
+   if ((h2 = openPipe(pi, PI_NOTIFY_FORMAT_V2, &fd2)) < 0)
+   {
+      fprintf(stderr, "can't open v2 notification (%s)\n", pigpio_error(h2));
+      exit(EXIT_FAILURE);
+   }
+
+   set_PWM_frequency(pi, g_opt_g, rate);
+   set_PWM_dutycycle(pi, g_opt_g, 128);
+
+   notify_begin(pi, h1, 1<<g_opt_g);
+   notify_begin(pi, h2, 1<<g_opt_g);
+
+   b1 = 0;
+   b2 = 0;
+
+   pfd[0].fd = fd1;
+   pfd[0].events = POLLIN;
+   pfd[1].fd = fd2;
+   pfd[1].events = POLLIN;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   end = ts.tv_sec + ts.tv_nsec / 1e9 + g_opt_s;
+
+   while (1)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      if ((ts.tv_sec + ts.tv_nsec / 1e9) >= end) break;
+
+      poll(pfd, 2, 100);
+
+      b1 += drain(fd1);
+      b2 += drain(fd2);
+   }
+
+   notify_pause(pi, h1);
+   notify_pause(pi, h2);
+
+   set_PWM_dutycycle(pi, g_opt_g, 0);
+
+   time_sleep(0.1);
+
+   b1 += drain(fd1);
+   b2 += drain(fd2);
+
+   /* v1 reports are a fixed size so give the edge count */
+
+   edges = b1 / sizeof(gpioReport_t);
+
+   printf("%5u Hz (%5d actual) edges %8ld  "
+          "v1 %6.2f  v2 %5.2f bytes/edge  dropped v1 %d v2 %d\n",
+      rate, get_PWM_frequency(pi, g_opt_g), edges,
+      edges ? (double)b1 / edges : 0.0,
+      edges ? (double)b2 / edges : 0.0,
+      notify_get_dropped(pi, h1), notify_get_dropped(pi, h2));
+
+   notify_close(pi, h1);
+   notify_close(pi, h2);
+
+   close(fd1);
+   close(fd2);
+}
+
+int main(int argc, char *argv[])
+{
+   int pi, i;
+
+   initOpts(argc, argv);
+
+   pi = pigpio_start(g_opt_a, g_opt_p);
+
+   if (pi < 0)
+   {
+      fprintf(stderr, "can't connect to pigpio daemon (%s)\n",
+         pigpio_error(pi));
+      return 1;
+   }
+
+   for (i=0; i<sizeof(rates)/sizeof(rates[0]); i++) run(pi, rates[i]);
+
+   pigpio_stop(pi);
+
+   return 0;
+}
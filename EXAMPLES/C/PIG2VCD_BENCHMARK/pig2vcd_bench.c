@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <pigpio.h>
+
+/*
+2026-10-17
+
+gcc -Wall -o pig2vcd_bench pig2vcd_bench.c
+$ ./pig2vcd_bench -n 5000000
+
+This program times pig2vcd converting a long capture.
+
+A file of n notification reports (gpioReport_t) is written in
+which b GPIO toggle at random, with a gap flag now and then.  The
+given pig2vcd is then run with the file as its standard input and
+its output is read and counted.
+
+The input and output rates in MB/s and the reports per second are
+printed.
+
+EXAMPLES
+
+5 million reports through the installed pig2vcd
+./pig2vcd_bench -n 5000000
+
+The same through a pig2vcd built elsewhere, e.g. an older version
+./pig2vcd_bench -n 5000000 -p ./pig2vcd.old
+*/
+
+#define OPT_B_MIN 1
+#define OPT_B_MAX 32
+#define OPT_B_DEF 8
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 100000000
+#define OPT_N_DEF 5000000
+
+static int   g_opt_b = OPT_B_DEF;
+static int   g_opt_n = OPT_N_DEF;
+static char *g_opt_f = "/tmp/pig2vcd_bench.bin";
+static char *g_opt_p = "pig2vcd";
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./pig2vcd_bench [OPTION] ...\n" \
+      "   -b value, GPIO which toggle, %d-%d,      default %d\n" \
+      "   -f file,  the capture file to write,    default %s\n" \
+      "   -n value, reports, %d-%d,  default %d\n" \
+      "   -p path,  the pig2vcd to run,           default %s\n" \
+      "\nEXAMPLE\n" \
+      "./pig2vcd_bench -n 1000000 -b 4\n" \
+      "Convert 1 million reports with 4 GPIO toggling.\n" \
+      "\n",
+      OPT_B_MIN, OPT_B_MAX, OPT_B_DEF,
+      g_opt_f,
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF,
+      g_opt_p
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "b:f:n:p:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_B_MIN) && (i <= OPT_B_MAX)) g_opt_b = i;
+            else
+            {
+               fprintf(stderr, "invalid -b option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'f':
+            g_opt_f = optarg;
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else
+            {
+               fprintf(stderr, "invalid -n option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'p':
+            g_opt_p = optarg;
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int writeCapture(void)
+{
+   FILE *f;
+   int i;
+   uint32_t level, tick;
+   gpioReport_t r;
+
+   f = fopen(g_opt_f, "wb");
+
+   if (f == NULL)
+   {
+      fprintf(stderr, "can't create %s\n", g_opt_f);
+      return -1;
+   }
+
+   srand(1);
+
+   level = 0;
+   tick = 0xFFF00000; /* the tick wraps during the capture */
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      tick += 1 + (rand() % 20);
+
+      level ^= 1U << (rand() % g_opt_b);
+
+      r.seqno = i;
+      r.flags = ((rand() % 10000) == 0) ? PI_NTFY_FLAGS_GAP : 0;
+      r.tick  = tick;
+      r.level = level;
+
+      fwrite(&r, sizeof(r), 1, f);
+   }
+
+   fclose(f);
+
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   int in, fd[2], status, r;
+   pid_t pid;
+   double t0, t1;
+   uint64_t outBytes;
+   static char buf[65536];
+
+   initOpts(argc, argv);
+
+   if (writeCapture() < 0) return 1;
+
+   in = open(g_opt_f, O_RDONLY);
+
+   if ((in < 0) || pipe(fd))
+   {
+      fprintf(stderr, "can't open %s\n", g_opt_f);
+      return 1;
+   }
+
+   t0 = now();
+
+   pid = fork();
+
+   if (pid == 0)
+   {
+      dup2(in, STDIN_FILENO);
+      dup2(fd[1], STDOUT_FILENO);
+      close(fd[0]);
+      execlp(g_opt_p, g_opt_p, (char *)NULL);
+      fprintf(stderr, "can't run %s\n", g_opt_p);
+      exit(EXIT_FAILURE);
+   }
+
+   close(fd[1]);
+   close(in);
+
+   outBytes = 0;
+
+   while ((r = read(fd[0], buf, sizeof(buf))) > 0) outBytes += r;
+
+   waitpid(pid, &status, 0);
+
+   t1 = now() - t0;
+
+   if (!WIFEXITED(status) || WEXITSTATUS(status))
+   {
+      fprintf(stderr, "%s failed\n", g_opt_p);
+      return 1;
+   }
+
+   printf("%s: %d reports in %.3f s, %.0f reports/s\n",
+      g_opt_p, g_opt_n, t1, g_opt_n / t1);
+
+   printf("in %.1f MB (%.1f MB/s), out %.1f MB (%.1f MB/s)\n",
+      (g_opt_n * sizeof(gpioReport_t)) / 1e6,
+      (g_opt_n * sizeof(gpioReport_t)) / 1e6 / t1,
+      outBytes / 1e6,
+      outBytes / 1e6 / t1);
+
+   unlink(g_opt_f);
+
+   return 0;
+}
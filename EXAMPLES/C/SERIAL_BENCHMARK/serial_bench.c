@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pigpio_kernels.h"
+
+/*
+2026-10-17
+
+gcc -Wall -O2 -I../../.. -o serial_bench serial_bench.c
+$ ./serial_bench
+
+This program checks and times the bit bang serial read decoder used
+by the pigpio alert thread (gpioSerialReadOpen) against the original
+per edge decoder it replaced.
+
+The batch decoder is included from pigpio_kernels.h, so it is the
+code pigpio.c runs; the per edge decoder is a copy of the old
+waveRxSerial.  Both are run over the same sample trace, in blocks of -b samples as the alert thread does.
+The characters each decodes are compared with those sent.
+
+The trace is generated: -n GPIO each receive -c random characters
+at -r baud with random gaps between them, sampled every -s
+microseconds.  As in the alert thread only samples in which a level
+changes are kept.  -e percent of the characters are sent with a
+low stop bit, i.e. a framing error.
+
+EXAMPLES
+
+Check and time 8 GPIO at 115200 baud sampled every microsecond
+./serial_bench -n 8 -r 115200 -s 1
+
+The same with 1% framing errors
+./serial_bench -n 8 -r 115200 -s 1 -e 1
+*/
+
+#define OPT_B_MIN 1
+#define OPT_B_MAX 100000
+#define OPT_B_DEF 1000
+
+#define OPT_C_MIN 1
+#define OPT_C_MAX 1000000
+#define OPT_C_DEF 20000
+
+#define OPT_D_MIN 1
+#define OPT_D_MAX 32
+#define OPT_D_DEF 8
+
+#define OPT_E_MIN 0
+#define OPT_E_MAX 100
+#define OPT_E_DEF 0
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 32
+#define OPT_N_DEF 8
+
+#define OPT_R_MIN 50
+#define OPT_R_MAX 333333
+#define OPT_R_DEF 115200
+
+#define OPT_S_MIN 1
+#define OPT_S_MAX 10
+#define OPT_S_DEF 1
+
+static int g_opt_b = OPT_B_DEF;
+static int g_opt_c = OPT_C_DEF;
+static int g_opt_d = OPT_D_DEF;
+static int g_opt_e = OPT_E_DEF;
+static int g_opt_n = OPT_N_DEF;
+static int g_opt_r = OPT_R_DEF;
+static int g_opt_s = OPT_S_DEF;
+
+#define MILLION 1000000
+
+/* the parts of the pigpio.c state the decoders use */
+
+typedef struct
+{
+   int      gpio;
+   int      level; /* per edge decoder only */
+   wfRxSerial_t s;
+} wfRx_t;
+
+static wfRx_t wfRx[32];
+
+static uint32_t serialBits;
+static uint32_t serialLevel;
+
+/* the original per edge decoder, the watchdog calls are left out */
+
+static void waveRxSerial(wfRx_t *w, int level, uint32_t tick)
+{
+   int diffTicks, lastLevel;
+   int newWritePos;
+
+   level = level ^ w->s.invert;
+
+   if (w->s.bit >= 0)
+   {
+      diffTicks = tick - w->s.startBitTick;
+
+      if (level != PI_TIMEOUT)
+      {
+         w->level = level;
+         lastLevel = !level;
+      }
+      else lastLevel = w->level;
+
+      while ((w->s.bit <= w->s.dataBits) &&
+             (diffTicks > (w->s.nextBitDiff/1000)))
+      {
+         if (w->s.bit)
+         {
+            if (lastLevel) w->s.data |= (1<<(w->s.bit-1));
+         }
+         else w->s.data = 0;
+
+         ++(w->s.bit);
+
+         w->s.nextBitDiff += w->s.fullBit;
+      }
+
+      if (w->s.bit > w->s.dataBits)
+      {
+         memcpy(w->s.buf + w->s.writePos, &w->s.data, w->s.bytes);
+
+         /* don't let writePos catch readPos */
+
+         newWritePos = (w->s.writePos + w->s.bytes) % (w->s.bufSize);
+
+         if (newWritePos != w->s.readPos) w->s.writePos = newWritePos;
+
+         if (level == 0)
+         {
+            w->s.bit          = 0;
+            w->s.startBitTick = tick;
+            w->s.nextBitDiff  = w->s.halfBit;
+         }
+         else
+         {
+            w->s.bit = -1;
+         }
+      }
+   }
+   else
+   {
+      /* start bit if high->low */
+
+      if (level == 0)
+      {
+         w->level        = 0;
+         w->s.bit          = 0;
+         w->s.startBitTick = tick;
+         w->s.nextBitDiff  = w->s.halfBit;
+      }
+   }
+}
+
+/* the alert thread called it for each GPIO which changed in a sample */
+
+static void perEdge(gpioSample_t *sample, int numSamples, uint32_t eTick)
+{
+   int b, d;
+   uint32_t changed, levels;
+
+   levels = serialLevel;
+
+   for (d=0; d<numSamples; d++)
+   {
+      changed = (sample[d].level ^ levels) & serialBits;
+
+      levels = sample[d].level;
+
+      for (b=0; b<32; b++)
+      {
+         if (changed & (1<<b))
+            waveRxSerial(&wfRx[b], (levels >> b) & 1, sample[d].tick);
+      }
+   }
+
+   serialLevel = levels;
+}
+
+/* the batch decoder pigpio.c runs, without the mutex */
+
+static void alertSerial(gpioSample_t *sample, int numSamples, uint32_t eTick)
+{
+   alertSerialDecode(&wfRx[0].s, sizeof(wfRx_t), serialBits, &serialLevel,
+      sample, numSamples, eTick);
+}
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./serial_bench [OPTION] ...\n" \
+      "   -b value, samples per block, %d-%d, default %d\n" \
+      "   -c value, characters per GPIO, %d-%d, default %d\n" \
+      "   -d value, data bits, %d-%d,             default %d\n" \
+      "   -e value, %% framing errors, %d-%d,     default %d\n" \
+      "   -n value, serial GPIO, %d-%d,          default %d\n" \
+      "   -r value, baud, %d-%d,             default %d\n" \
+      "   -s value, sample micros, %d-%d,        default %d\n" \
+      "\nEXAMPLE\n" \
+      "./serial_bench -n 16 -r 230400 -s 1\n" \
+      "Decode 16 GPIO at 230400 baud.\n" \
+      "\n",
+      OPT_B_MIN, OPT_B_MAX, OPT_B_DEF,
+      OPT_C_MIN, OPT_C_MAX, OPT_C_DEF,
+      OPT_D_MIN, OPT_D_MAX, OPT_D_DEF,
+      OPT_E_MIN, OPT_E_MAX, OPT_E_DEF,
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF,
+      OPT_R_MIN, OPT_R_MAX, OPT_R_DEF,
+      OPT_S_MIN, OPT_S_MAX, OPT_S_DEF
+   );
+}
+
+static int getOpt(int opt, int min, int max)
+{
+   long i;
+
+   i = strtol(optarg, NULL, 0);
+
+   if ((i < min) || (i > max))
+   {
+      fprintf(stderr, "invalid -%c option (%ld)\n", opt, i);
+      usage();
+      exit(EXIT_FAILURE);
+   }
+
+   return i;
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:c:d:e:n:r:s:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b':
+            g_opt_b = getOpt(opt, OPT_B_MIN, OPT_B_MAX);
+            break;
+
+         case 'c':
+            g_opt_c = getOpt(opt, OPT_C_MIN, OPT_C_MAX);
+            break;
+
+         case 'd':
+            g_opt_d = getOpt(opt, OPT_D_MIN, OPT_D_MAX);
+            break;
+
+         case 'e':
+            g_opt_e = getOpt(opt, OPT_E_MIN, OPT_E_MAX);
+            break;
+
+         case 'n':
+            g_opt_n = getOpt(opt, OPT_N_MIN, OPT_N_MAX);
+            break;
+
+         case 'r':
+            g_opt_r = getOpt(opt, OPT_R_MIN, OPT_R_MAX);
+            break;
+
+         case 's':
+            g_opt_s = getOpt(opt, OPT_S_MIN, OPT_S_MAX);
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static double seconds(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* the sent characters and the trace */
+
+typedef struct
+{
+   uint64_t micros; /* sample the edge is first seen in */
+   uint32_t seq;
+   uint8_t  gpio;
+   uint8_t  level;
+} edge_t;
+
+static uint32_t *sent[32];
+static int       badStops[32];
+
+static edge_t *edges;
+static int     numEdges;
+static int     maxEdges;
+
+static uint64_t endMicros;
+
+static void addEdge(int gpio, int level, double nanos)
+{
+   uint64_t sampleNanos = g_opt_s * 1000;
+   edge_t *e;
+
+   if (numEdges == maxEdges)
+   {
+      maxEdges = maxEdges ? maxEdges * 2 : 1024;
+      edges = realloc(edges, maxEdges * sizeof(edge_t));
+
+      if (edges == NULL)
+      {
+         fprintf(stderr, "out of memory\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   e = &edges[numEdges];
+
+   /* an edge is seen at the first sample at or after it */
+
+   e->micros = (((uint64_t)nanos + sampleNanos - 1) / sampleNanos) * g_opt_s;
+   e->seq    = numEdges++;
+   e->gpio   = gpio;
+   e->level  = level;
+}
+
+static int cmpEdge(const void *a, const void *b)
+{
+   const edge_t *x = a, *y = b;
+
+   if (x->micros != y->micros) return (x->micros > y->micros) ? 1 : -1;
+
+   return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static void makeGPIO(int gpio)
+{
+   double bitNanos, t;
+   uint32_t data, mask;
+   int c, b, level, bit, stop;
+
+   bitNanos = 1e9 / g_opt_r;
+
+   if (g_opt_d == 32) mask = 0xFFFFFFFF;
+   else               mask = (1U << g_opt_d) - 1;
+
+   t = 1000.0 + (rand() % 1000) * bitNanos / 100.0;
+
+   level = 1;
+
+   for (c=0; c<g_opt_c; c++)
+   {
+      data = (((uint32_t)rand() << 16) ^ rand()) & mask;
+
+      stop = ((rand() % 100) >= g_opt_e);
+
+      if (!stop) badStops[gpio]++;
+
+      sent[gpio][c] = data;
+
+      /* start bit, data bits lsb first, stop bit */
+
+      for (b=0; b<(g_opt_d+2); b++)
+      {
+         if      (b == 0)         bit = 0;
+         else if (b <= g_opt_d)   bit = (data >> (b-1)) & 1;
+         else                     bit = stop;
+
+         if (bit != level)
+         {
+            addEdge(gpio, bit, t);
+            level = bit;
+         }
+
+         t += bitNanos;
+      }
+
+      /* idle for 0-2 bits, and after a low stop bit at least 1 */
+
+      if (!stop)
+      {
+         addEdge(gpio, 1, t);
+         level = 1;
+         t += bitNanos;
+      }
+
+      t += (rand() % 200) * bitNanos / 100.0;
+   }
+
+   /* a few idle bits after the last character */
+
+   t += 4 * bitNanos;
+
+   if ((uint64_t)(t / 1000) > endMicros) endMicros = t / 1000;
+}
+
+static gpioSample_t *makeSamples(int *numSamples)
+{
+   gpioSample_t *s;
+   uint32_t level, tick;
+   int i, n;
+
+   numEdges = 0;
+
+   for (i=0; i<g_opt_n; i++) makeGPIO(i);
+
+   qsort(edges, numEdges, sizeof(edge_t), cmpEdge);
+
+   s = malloc(numEdges * sizeof(gpioSample_t));
+
+   if (s == NULL) return NULL;
+
+   tick  = 0xFF000000; /* exercise tick wrap */
+   level = 0xFFFFFFFF;
+   n     = 0;
+
+   for (i=0; i<numEdges; i++)
+   {
+      if (edges[i].level) level |=  (1<<edges[i].gpio);
+      else                level &= ~(1<<edges[i].gpio);
+
+      if ((i+1 < numEdges) && (edges[i+1].micros == edges[i].micros))
+         continue;
+
+      s[n].tick  = tick + (uint32_t)edges[i].micros;
+      s[n].level = level;
+      n++;
+   }
+
+   *numSamples = n;
+
+   return s;
+}
+
+static void initSerial(void)
+{
+   int i, bitTime;
+
+   bitTime = (1000 * MILLION) / g_opt_r; /* nanos */
+
+   for (i=0; i<32; i++)
+   {
+      free(wfRx[i].s.buf);
+
+      memset(&wfRx[i], 0, sizeof(wfRx_t));
+
+      wfRx[i].gpio       = i;
+      wfRx[i].s.bufSize  = (g_opt_c + 1) * 4;
+      wfRx[i].s.buf      = calloc(wfRx[i].s.bufSize, 1);
+      wfRx[i].s.fullBit  = bitTime;
+      wfRx[i].s.halfBit  = (bitTime/2)+500;
+      wfRx[i].s.bit      = -1;
+      wfRx[i].s.dataBits = g_opt_d;
+
+      if      (g_opt_d <  9) wfRx[i].s.bytes = 1;
+      else if (g_opt_d < 17) wfRx[i].s.bytes = 2;
+      else                   wfRx[i].s.bytes = 4;
+   }
+
+   if (g_opt_n == 32) serialBits = 0xFFFFFFFF;
+   else               serialBits = (1U << g_opt_n) - 1;
+
+   serialLevel = 0xFFFFFFFF;
+}
+
+static int check(int *wrong)
+{
+   int i, c, n, got;
+   uint32_t data;
+   wfRxSerial_t *s;
+
+   got = 0;
+
+   *wrong = 0;
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      s = &wfRx[i].s;
+
+      n = s->writePos / s->bytes;
+
+      got += n;
+
+      for (c=0; c<g_opt_c; c++)
+      {
+         data = 0;
+
+         if (c < n) memcpy(&data, s->buf + (c * s->bytes), s->bytes);
+
+         if ((c >= n) || (data != sent[i][c])) (*wrong)++;
+      }
+   }
+
+   return got;
+}
+
+static double run(
+   void (*decode)(gpioSample_t *, int, uint32_t),
+   gpioSample_t *s, int numSamples, uint32_t endTick)
+{
+   double t0;
+   int pos, len;
+
+   initSerial();
+
+   t0 = seconds();
+
+   for (pos=0; pos<numSamples; pos+=len)
+   {
+      len = numSamples - pos;
+      if (len > g_opt_b) len = g_opt_b;
+
+      decode(s+pos, len, s[pos+len-1].tick);
+   }
+
+   /* the trailing idle, the watchdog timeout for the per edge decoder */
+
+   if (decode == perEdge)
+   {
+      for (pos=0; pos<g_opt_n; pos++)
+      {
+         if (wfRx[pos].s.bit >= 0)
+            waveRxSerial(&wfRx[pos], PI_TIMEOUT, endTick);
+      }
+   }
+   else decode(s, 0, endTick);
+
+   return seconds() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+   gpioSample_t *samples;
+   int numSamples, i, got, wrong, errors, sentErrors, status;
+   uint32_t endTick;
+   double t, chars;
+
+   initOpts(argc, argv);
+
+   srand(1);
+
+   sentErrors = 0;
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      sent[i] = malloc(g_opt_c * sizeof(uint32_t));
+
+      if (sent[i] == NULL)
+      {
+         fprintf(stderr, "out of memory\n");
+         return 1;
+      }
+   }
+
+   samples = makeSamples(&numSamples);
+
+   if (samples == NULL)
+   {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+   }
+
+   for (i=0; i<g_opt_n; i++) sentErrors += badStops[i];
+
+   endTick = 0xFF000000 + (uint32_t)endMicros;
+
+   chars = (double)g_opt_n * g_opt_c;
+
+   printf("%d GPIO at %d baud, %d samples (%.2f s), %.0f characters, "
+          "%d framing errors\n",
+      g_opt_n, g_opt_r, numSamples, endMicros / 1e6, chars, sentErrors);
+
+   status = 0;
+
+   t = run(perEdge, samples, numSamples, endTick);
+
+   got = check(&wrong);
+
+   printf("per edge  %7.2f ns/sample %7.2f ns/char %8.0fx real time  "
+          "%d chars, %d wrong\n",
+      (t * 1e9) / numSamples, (t * 1e9) / chars, (endMicros / 1e6) / t,
+      got, wrong);
+
+   t = run(alertSerial, samples, numSamples, endTick);
+
+   got = check(&wrong);
+
+   errors = 0;
+
+   for (i=0; i<g_opt_n; i++) errors += wfRx[i].s.errors;
+
+   printf("batch     %7.2f ns/sample %7.2f ns/char %8.0fx real time  "
+          "%d chars, %d wrong, %d framing errors\n",
+      (t * 1e9) / numSamples, (t * 1e9) / chars, (endMicros / 1e6) / t,
+      got, wrong, errors);
+
+   if (wrong || (errors != sentErrors))
+   {
+      printf("batch decoder FAILED\n");
+      status = 1;
+   }
+
+   free(samples);
+
+   return status;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pigpiod_if2.h>
+
+/*
+2026-10-17
+
+gcc -Wall -pthread -o async_bench async_bench.c -lpigpiod_if2 -lrt
+$ ./async_bench -n 100000
+
+This program compares the synchronous and asynchronous (pipelined)
+command paths of pigpiod_if2.
+
+The same read-only command (TICK) is sent n times, first with
+get_current_tick, which waits for each response, and then with
+async_command, which keeps up to PIGIF_ASYNC_PENDING commands
+in flight before waiting for them all with async_flush.
+
+EXAMPLES
+
+100000 commands to the local daemon
+./async_bench -n 100000
+
+10000 commands to the daemon on host pi4
+./async_bench -a pi4 -n 10000
+*/
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 10000000
+#define OPT_N_DEF 100000
+
+static char *g_opt_a = NULL;
+static char *g_opt_p = NULL;
+static int   g_opt_n = OPT_N_DEF;
+
+static int g_async_errors = 0;
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./async_bench [OPTION] ...\n" \
+      "   -a host,  daemon address,          default $PIGPIO_ADDR or localhost\n" \
+      "   -n value, commands, %d-%d, default %d\n" \
+      "   -p port,  daemon port,             default $PIGPIO_PORT or 8888\n" \
+      "\nEXAMPLE\n" \
+      "./async_bench -n 10000\n" \
+      "Send 10000 commands each way.\n" \
+      "\n",
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "a:n:p:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+            g_opt_a = optarg;
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else
+            {
+               fprintf(stderr, "invalid -n option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'p':
+            g_opt_p = optarg;
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void done(int pi, int token, int result, char *ext, void *userdata)
+{
+   if (result < 0) g_async_errors++;
+}
+
+static void report(char *name, int count, double secs)
+{
+   printf("%-6s %9d commands %8.3fs %9.0f commands/sec %7.2f us/command\n",
+      name, count, secs, count / secs, (secs * 1e6) / count);
+}
+
+int main(int argc, char *argv[])
+{
+   int pi, i, errors;
+   double t0, t1, sync_secs, async_secs;
+
+   initOpts(argc, argv);
+
+   pi = pigpio_start(g_opt_a, g_opt_p);
+
+   if (pi < 0)
+   {
+      fprintf(stderr, "can't connect to pigpio daemon (%s)\n",
+         pigpio_error(pi));
+      return 1;
+   }
+
+   /* open the asynchronous connection before timing */
+
+   async_command(pi, PI_CMD_TICK, 0, 0, 0, NULL, NULL, NULL);
+   async_flush(pi);
+
+   errors = 0;
+
+   t0 = time_time();
+
+   for (i=0; i<g_opt_n; i++) get_current_tick(pi);
+
+   t1 = time_time();
+
+   sync_secs = t1 - t0;
+
+   t0 = time_time();
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      if (async_command(pi, PI_CMD_TICK, 0, 0, 0, NULL, done, NULL) < 0)
+         errors++;
+   }
+
+   async_flush(pi);
+
+   t1 = time_time();
+
+   async_secs = t1 - t0;
+
+   report("sync", g_opt_n, sync_secs);
+   report("async", g_opt_n, async_secs);
+
+   printf("speedup %.2fx, errors %d\n",
+      sync_secs / async_secs, errors + g_async_errors);
+
+   pigpio_stop(pi);
+
+   return 0;
+}
+
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pigpiod_if2.h>
+
+/*
+2026-10-17
+
+gcc -Wall -pthread -o ring_bench ring_bench.c -lpigpiod_if2 -lrt
+$ ./ring_bench -n 100000
+
+This program compares the round trip latency of commands sent
+on the daemon socket with those sent on a shared memory command
+ring (ring_open).
+
+The same command (READ of GPIO -g) is sent n times each way, one
+at a time, and the mean and latency percentiles are reported.
+
+The daemon must be on the same host.
+
+EXAMPLES
+
+100000 commands to the local daemon
+./ring_bench -n 100000
+
+The same via the daemon's Unix domain socket
+./ring_bench -n 100000 -a unix:/var/run/pigpio.sock
+*/
+
+#define OPT_G_MIN 0
+#define OPT_G_MAX 53
+#define OPT_G_DEF 4
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 10000000
+#define OPT_N_DEF 100000
+
+static char *g_opt_a = NULL;
+static char *g_opt_p = NULL;
+static int   g_opt_g = OPT_G_DEF;
+static int   g_opt_n = OPT_N_DEF;
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./ring_bench [OPTION] ...\n" \
+      "   -a host,  daemon address or unix:path, default $PIGPIO_ADDR or localhost\n" \
+      "   -g value, GPIO to read, %d-%d,          default %d\n" \
+      "   -n value, commands, %d-%d,       default %d\n" \
+      "   -p port,  daemon port,                 default $PIGPIO_PORT or 8888\n" \
+      "\nEXAMPLE\n" \
+      "./ring_bench -n 10000\n" \
+      "Send 10000 commands each way.\n" \
+      "\n",
+      OPT_G_MIN, OPT_G_MAX, OPT_G_DEF,
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "a:g:n:p:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+            g_opt_a = optarg;
+            break;
+
+         case 'g':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_G_MIN) && (i <= OPT_G_MAX)) g_opt_g = i;
+            else
+            {
+               fprintf(stderr, "invalid -g option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else
+            {
+               fprintf(stderr, "invalid -n option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'p':
+            g_opt_p = optarg;
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static uint64_t nanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a;
+   uint32_t y = *(const uint32_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+static int run(char *name, int pi, uint32_t *lat)
+{
+   int i, errors;
+   uint64_t t0, total;
+
+   errors = 0;
+   total = 0;
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      t0 = nanos();
+
+      if (gpio_read(pi, g_opt_g) < 0) errors++;
+
+      lat[i] = nanos() - t0;
+
+      total += lat[i];
+   }
+
+   qsort(lat, g_opt_n, sizeof(uint32_t), cmp_u32);
+
+   printf("%-6s mean=%.2f p50=%.2f p99=%.2f max=%.2f us, errors %d\n",
+      name,
+      (total / 1e3) / g_opt_n,
+      lat[g_opt_n*50/100] / 1e3,
+      lat[g_opt_n*99/100] / 1e3,
+      lat[g_opt_n-1] / 1e3,
+      errors);
+
+   return errors;
+}
+
+int main(int argc, char *argv[])
+{
+   int pi, err;
+   uint32_t *lat;
+
+   initOpts(argc, argv);
+
+   lat = malloc(g_opt_n * sizeof(uint32_t));
+
+   if (lat == NULL)
+   {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+   }
+
+   pi = pigpio_start(g_opt_a, g_opt_p);
+
+   if (pi < 0)
+   {
+      fprintf(stderr, "can't connect to pigpio daemon (%s)\n",
+         pigpio_error(pi));
+      return 1;
+   }
+
+   run("socket", pi, lat);
+
+   err = ring_open(pi);
+
+   if (err < 0)
+   {
+      fprintf(stderr, "can't open command ring (%s)\n", pigpio_error(err));
+      pigpio_stop(pi);
+      return 1;
+   }
+
+   run("ring", pi, lat);
+
+   ring_close(pi);
+
+   pigpio_stop(pi);
+
+   free(lat);
+
+   return 0;
+}
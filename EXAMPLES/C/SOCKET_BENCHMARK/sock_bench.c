@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <pigpio.h>
+
+/*
+2026-10-17
+
+gcc -Wall -pthread -o sock_bench sock_bench.c
+$ ./sock_bench -c 200 -n 1000
+
+This program measures the throughput and latency of the pigpio
+daemon socket interface under load.
+
+Each client opens its own connection to the daemon and then sends
+commands (BR1, read bank 1) one at a time, timing each round trip.
+When all clients have finished the aggregate commands per second
+and the latency percentiles are reported.
+
+Run it against daemons built before and after a server change (or
+with different pigpiod -w worker counts) to compare the models.
+
+EXAMPLES
+
+200 clients, 1000 commands each, local daemon
+./sock_bench
+
+500 clients, 200 commands each, daemon on host pi4
+./sock_bench -a pi4 -c 500 -n 200
+
+Compare the TCP loopback and Unix domain socket latency of a local
+daemon started with sudo pigpiod -u /var/run/pigpio.sock
+./sock_bench -c 1 -n 100000
+./sock_bench -c 1 -n 100000 -a unix:/var/run/pigpio.sock
+*/
+
+#define OPT_C_MIN 1
+#define OPT_C_MAX 2000
+#define OPT_C_DEF 200
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 1000000
+#define OPT_N_DEF 1000
+
+typedef struct
+{
+   pthread_t thread;
+   int       sock;
+   int       errors;
+   uint32_t *lat; /* round trip times in nanoseconds */
+} client_t;
+
+static char *g_opt_a = NULL;
+static char *g_opt_p = NULL;
+static int   g_opt_c = OPT_C_DEF;
+static int   g_opt_n = OPT_N_DEF;
+
+static pthread_barrier_t g_start;
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./sock_bench [OPTION] ...\n" \
+      "   -a host,  daemon address or unix:path,      default $PIGPIO_ADDR or localhost\n" \
+      "   -c value, number of clients, %d-%d,        default %d\n" \
+      "   -n value, commands per client, %d-%d,  default %d\n" \
+      "   -p port,  daemon port,                      default $PIGPIO_PORT or 8888\n" \
+      "\nEXAMPLE\n" \
+      "./sock_bench -c 500 -n 200\n" \
+      "500 clients each sending 200 commands.\n" \
+      "\n",
+      OPT_C_MIN, OPT_C_MAX, OPT_C_DEF,
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF
+   );
+}
+
+static void fatal(int show_usage, char *fmt, ...)
+{
+   char buf[128];
+   va_list ap;
+
+   va_start(ap, fmt);
+   vsnprintf(buf, sizeof(buf), fmt, ap);
+   va_end(ap);
+
+   fprintf(stderr, "%s\n", buf);
+
+   if (show_usage) usage();
+
+   fflush(stderr);
+
+   exit(EXIT_FAILURE);
+}
+
+static int initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "a:c:n:p:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+            g_opt_a = optarg;
+            break;
+
+         case 'c':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_C_MIN) && (i <= OPT_C_MAX)) g_opt_c = i;
+            else fatal(1, "invalid -c option (%ld)", i);
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else fatal(1, "invalid -n option (%ld)", i);
+            break;
+
+         case 'p':
+            g_opt_p = optarg;
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+   return optind;
+}
+
+static int openUnixSocket(const char *path)
+{
+   int sock;
+   struct sockaddr_un addr;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+   memset(&addr, 0, sizeof(addr));
+
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (sock == -1) return -1;
+
+   if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+   {
+      close(sock);
+      return -1;
+   }
+
+   return sock;
+}
+
+static int openSocket(void)
+{
+   int sock, opt, err;
+   struct addrinfo hints, *res, *rp;
+   const char *addrStr, *portStr;
+
+   addrStr = g_opt_a;
+   if (!addrStr) addrStr = getenv(PI_ENVADDR);
+   if (!addrStr) addrStr = PI_DEFAULT_SOCKET_ADDR_STR;
+
+   if (!strncmp(addrStr, PI_UNIX_ADDR_PREFIX, strlen(PI_UNIX_ADDR_PREFIX)))
+      return openUnixSocket(addrStr + strlen(PI_UNIX_ADDR_PREFIX));
+
+   portStr = g_opt_p;
+   if (!portStr) portStr = getenv(PI_ENVPORT);
+   if (!portStr) portStr = PI_DEFAULT_SOCKET_PORT_STR;
+
+   memset(&hints, 0, sizeof(hints));
+
+   hints.ai_family   = PF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   err = getaddrinfo(addrStr, portStr, &hints, &res);
+
+   if (err) return -1;
+
+   for (rp=res; rp!=NULL; rp=rp->ai_next)
+   {
+      sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+
+      if (sock == -1) continue;
+
+      if (connect(sock, rp->ai_addr, rp->ai_addrlen) != -1) break;
+
+      close(sock);
+   }
+
+   freeaddrinfo(res);
+
+   if (rp == NULL) return -1;
+
+   opt = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(opt));
+
+   return sock;
+}
+
+static uint64_t nanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void *client_thread(void *x)
+{
+   client_t *c = x;
+   uint32_t cmd[4], res[4];
+   uint64_t t0;
+   int i;
+
+   cmd[0] = PI_CMD_BR1;
+   cmd[1] = 0;
+   cmd[2] = 0;
+   cmd[3] = 0;
+
+   pthread_barrier_wait(&g_start);
+
+   for (i=0; i<g_opt_n; i++)
+   {
+      t0 = nanos();
+
+      if ((send(c->sock, cmd, 16, 0) != 16) ||
+          (recv(c->sock, res, 16, MSG_WAITALL) != 16))
+      {
+         c->errors = g_opt_n - i;
+         break;
+      }
+
+      c->lat[i] = nanos() - t0;
+   }
+
+   return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a;
+   uint32_t y = *(const uint32_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+   client_t *client;
+   uint32_t *all;
+   uint64_t t0, t1;
+   size_t count;
+   int i, j, errors;
+   double secs;
+
+   initOpts(argc, argv);
+
+   client = calloc(g_opt_c, sizeof(client_t));
+   all = malloc((size_t)g_opt_c * g_opt_n * sizeof(uint32_t));
+
+   if ((client == NULL) || (all == NULL)) fatal(0, "out of memory");
+
+   pthread_barrier_init(&g_start, NULL, g_opt_c + 1);
+
+   for (i=0; i<g_opt_c; i++)
+   {
+      client[i].sock = openSocket();
+
+      if (client[i].sock < 0)
+         fatal(0, "can't connect client %d (of %d)", i, g_opt_c);
+
+      client[i].lat = all + ((size_t)i * g_opt_n);
+
+      if (pthread_create(&client[i].thread, NULL, client_thread, &client[i]))
+         fatal(0, "can't create client thread %d", i);
+   }
+
+   pthread_barrier_wait(&g_start);
+
+   t0 = nanos();
+
+   for (i=0; i<g_opt_c; i++) pthread_join(client[i].thread, NULL);
+
+   t1 = nanos();
+
+   /* compact the latencies of completed commands */
+
+   count = 0;
+   errors = 0;
+
+   for (i=0; i<g_opt_c; i++)
+   {
+      errors += client[i].errors;
+
+      for (j=0; j<(g_opt_n-client[i].errors); j++)
+         all[count++] = client[i].lat[j];
+
+      close(client[i].sock);
+   }
+
+   if (!count) fatal(0, "no commands completed");
+
+   qsort(all, count, sizeof(uint32_t), cmp_u32);
+
+   secs = (t1 - t0) / 1e9;
+
+   printf("clients=%d commands=%zu errors=%d time=%.3fs\n",
+      g_opt_c, count, errors, secs);
+
+   printf("commands/sec=%.0f\n", count / secs);
+
+   printf("latency us: p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+      all[count*50/100] / 1e3,
+      all[count*90/100] / 1e3,
+      all[count*99/100] / 1e3,
+      all[count-1] / 1e3);
+
+   free(all);
+   free(client);
+
+   return 0;
+}
+
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pigpio_kernels.h"
+
+/*
+2026-10-17
+
+gcc -Wall -O2 -I../../.. -o wdog_bench wdog_bench.c
+$ ./wdog_bench
+
+This program times the alert thread's watchdog work (the tracking of
+each watched GPIO's last edge in alertWdogCheck and the timeout check
+in alertEmit) for 1 to 32 active watchdogs.
+
+The current code, which follows the changed bits and only checks
+the watchdogs once the earliest deadline is reached, is included from
+pigpio_kernels.h.  A copy of the original code, which visits every
+GPIO on every pass, is kept here for comparison.  Both are run over the same generated passes of samples.  Half the
+watched GPIO toggle now and then, the others are quiet so their
+watchdogs fire.  The timeouts each version reports are compared and
+the program exits with status 1 if they differ.
+
+The time per alert pass of each is printed.
+
+EXAMPLES
+
+1000 passes of 64 samples (the default)
+./wdog_bench
+
+5000 passes of 256 samples
+./wdog_bench -p 5000 -s 256
+*/
+
+#define OPT_P_MIN 1
+#define OPT_P_MAX 1000000
+#define OPT_P_DEF 1000
+
+#define OPT_S_MIN 1
+#define OPT_S_MAX 4096
+#define OPT_S_DEF 64
+
+typedef struct
+{
+   int      wdSteadyUs;
+   uint32_t wdTick;
+   uint32_t wdLBitV;
+} alert_t; /* the original per GPIO state */
+
+static int g_opt_p = OPT_P_DEF;
+static int g_opt_s = OPT_S_DEF;
+
+/* the state of each version */
+
+static alert_t      oldAlert[PI_MAX_USER_GPIO+1];
+static alertWdog_t  newAlert[PI_MAX_USER_GPIO+1];
+static uint32_t wdogBits;
+static uint32_t monitorBits;
+static uint32_t wdogRescan;
+static uint32_t wdogNext;
+static uint32_t wdogLevel;
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./wdog_bench [OPTION] ...\n" \
+      "   -p value, alert passes, %d-%d,    default %d\n" \
+      "   -s value, samples per pass, %d-%d,   default %d\n" \
+      "\nEXAMPLE\n" \
+      "./wdog_bench -p 5000 -s 256\n" \
+      "Time 5000 passes of 256 samples.\n" \
+      "\n",
+      OPT_P_MIN, OPT_P_MAX, OPT_P_DEF,
+      OPT_S_MIN, OPT_S_MAX, OPT_S_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "p:s:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'p':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_P_MIN) && (i <= OPT_P_MAX)) g_opt_p = i;
+            else
+            {
+               fprintf(stderr, "invalid -p option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 's':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_S_MIN) && (i <= OPT_S_MAX)) g_opt_s = i;
+            else
+            {
+               fprintf(stderr, "invalid -s option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static uint64_t nanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the original code */
+
+static void oldWdogCheck(gpioSample_t *sample, int numSamples)
+{
+   int i, j;
+   uint32_t LBitV;
+   uint32_t bit;
+
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   {
+      bit = (1<<i);
+
+      if (monitorBits & bit & wdogBits)
+      {
+         LBitV = oldAlert[i].wdLBitV;
+
+         for (j=0; j<numSamples; j++)
+         {
+            if ((sample[j].level & bit) != LBitV)
+            {
+               LBitV = sample[j].level & bit;
+               oldAlert[i].wdTick = sample[j].tick;
+            }
+         }
+
+         oldAlert[i].wdLBitV = LBitV;
+      }
+   }
+}
+
+static uint32_t oldTimeouts(uint32_t eTick)
+{
+   int b;
+   int32_t diff;
+   uint32_t timeoutBits;
+
+   timeoutBits = 0;
+
+   if (wdogBits)
+   {
+      for (b=0; b<=PI_MAX_USER_GPIO; b++)
+      {
+         if (oldAlert[b].wdSteadyUs)
+         {
+            diff = eTick - oldAlert[b].wdTick;
+
+            if (diff >= oldAlert[b].wdSteadyUs)
+            {
+               timeoutBits |= (1<<b);
+
+               oldAlert[b].wdTick = eTick;
+            }
+         }
+      }
+   }
+
+   return timeoutBits;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the current code, as pigpio.c calls it */
+
+static void newWdogCheck(gpioSample_t *sample, int numSamples)
+{
+   alertWdogCheck(newAlert, monitorBits & wdogBits, &wdogLevel,
+      sample, numSamples);
+}
+
+static uint32_t newTimeouts(uint32_t eTick)
+{
+   return alertWdogTimeouts(newAlert, wdogBits, &wdogRescan, &wdogNext, eTick);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static gpioSample_t *makePasses(int watched)
+{
+   gpioSample_t *s;
+   uint32_t tick, level, active;
+   int i;
+
+   /*
+   A sample every 10 micros, so a pass of 64 samples is about
+   the alert thread's 1 millisecond.  The even watched GPIO
+   toggle now and then, the odd ones are quiet.
+   */
+
+   s = malloc(g_opt_p * g_opt_s * sizeof(gpioSample_t));
+
+   if (s == NULL) return NULL;
+
+   srand(watched);
+
+   active = 0;
+
+   for (i=0; i<watched; i+=2) active |= (1U<<i);
+
+   tick = 0xFFFF0000; /* the tick wraps during the run */
+   level = 0;
+
+   for (i=0; i<(g_opt_p * g_opt_s); i++)
+   {
+      tick += 10;
+
+      if ((rand() % 8) == 0) level ^= (1U << (rand() % 32)) & active;
+
+      s[i].tick  = tick;
+      s[i].level = level;
+   }
+
+   return s;
+}
+
+static int run(int watched)
+{
+   gpioSample_t *s;
+   int p, b, errors;
+   uint32_t eTick, oldBits, newBits, fired;
+   uint64_t t0, oldNanos, newNanos;
+
+   s = makePasses(watched);
+
+   if (s == NULL)
+   {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+   }
+
+   memset(oldAlert, 0, sizeof(oldAlert));
+   memset(newAlert, 0, sizeof(newAlert));
+
+   wdogBits = 0;
+
+   for (b=0; b<watched; b++)
+   {
+      /* 2-9 milliseconds */
+
+      oldAlert[b].wdSteadyUs = 2000 + (1000 * (b % 8));
+      oldAlert[b].wdTick = s[0].tick;
+      newAlert[b].wdSteadyUs = oldAlert[b].wdSteadyUs;
+      newAlert[b].wdTick = oldAlert[b].wdTick;
+      wdogBits |= (1U<<b);
+   }
+
+   monitorBits = 0xFFFFFFFF;
+   wdogRescan = 1;
+   wdogLevel = 0;
+
+   errors = 0;
+   fired = 0;
+   oldNanos = 0;
+   newNanos = 0;
+
+   for (p=0; p<g_opt_p; p++)
+   {
+      eTick = s[(p * g_opt_s) + g_opt_s - 1].tick;
+
+      t0 = nanos();
+      oldWdogCheck(s + (p * g_opt_s), g_opt_s);
+      oldBits = oldTimeouts(eTick);
+      oldNanos += nanos() - t0;
+
+      t0 = nanos();
+      newWdogCheck(s + (p * g_opt_s), g_opt_s);
+      newBits = newTimeouts(eTick);
+      newNanos += nanos() - t0;
+
+      if (oldBits != newBits) errors++;
+
+      fired += __builtin_popcount(newBits);
+   }
+
+   printf("%2d %8u %10.1f %10.1f %8d\n",
+      watched, fired,
+      (double)oldNanos / g_opt_p, (double)newNanos / g_opt_p,
+      errors);
+
+   free(s);
+
+   return errors;
+}
+
+int main(int argc, char *argv[])
+{
+   int w, errors;
+   static int watched[] = {1, 2, 4, 8, 16, 24, 32};
+
+   initOpts(argc, argv);
+
+   printf("%d passes of %d samples\n\n", g_opt_p, g_opt_s);
+
+   printf("wd  timeouts  old ns/pass new ns/pass  differ\n");
+
+   errors = 0;
+
+   for (w=0; w<(sizeof(watched)/sizeof(watched[0])); w++)
+      errors += run(watched[w]);
+
+   if (errors) printf("\ntimeouts differ\n");
+
+   return errors ? 1 : 0;
+}
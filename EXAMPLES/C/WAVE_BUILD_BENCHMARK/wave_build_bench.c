@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+/*
+2026-10-17
+
+gcc -Wall -O2 -I../../.. -o wave_build_bench wave_build_bench.c
+$ ./wave_build_bench
+
+This program times building a pending waveform from 1 to 500 adds
+(rawWaveAddGeneric, which gpioWaveAddGeneric, gpioWaveAddSerial and
+the SPI adds all call) up to the point the wave is created.
+
+The current code, which keeps each add as a sorted run and merges
+all the runs once, is included from pigpio_kernels.h.  A copy of the
+original code, which merges each add with the whole pending
+waveform, is kept here for comparison.  Each wave
+has about n pulses in total, spread over the adds, each add
+toggling its own GPIO.  Some pulses have a zero delay and, with -a,
+the adds share their timing so that many pulses coincide.
+
+The value each add returns and the merged waveforms are compared
+and the program exits with status 1 if they differ.  The time to
+build each wave is printed.
+
+EXAMPLES
+
+waves of about 11000 pulses (the default)
+./wave_build_bench
+
+waves of about 6000 pulses whose adds all share their timing
+./wave_build_bench -n 6000 -a
+*/
+
+#define OPT_N_MIN 1
+#define OPT_N_MAX 11900
+#define OPT_N_DEF 11000
+
+/* as in pigpio.c */
+
+#define DMA_LITE_MAX 0xfffc
+#define BPD 4
+
+#define NUM_WAVE_OOL (53 * 4 * 79)
+
+#include "pigpio_kernels.h"
+
+static int g_opt_a = 0;
+static int g_opt_n = OPT_N_DEF;
+
+/* the state of the original code */
+
+static rawWave_t oldWf[3][PI_WAVE_MAX_PULSES];
+static int oldWfc[3];
+static int oldWfcur;
+static wfStats_t oldStats;
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: ./wave_build_bench [OPTION] ...\n" \
+      "   -a,       the adds share their timing\n" \
+      "   -n value, pulses a wave, %d-%d,  default %d\n" \
+      "\nEXAMPLE\n" \
+      "./wave_build_bench -n 6000 -a\n" \
+      "Build waves of about 6000 pulses from adds which coincide.\n" \
+      "\n",
+      OPT_N_MIN, OPT_N_MAX, OPT_N_DEF
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt;
+   long i;
+
+   while ((opt = getopt(argc, argv, "an:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+            g_opt_a = 1;
+            break;
+
+         case 'n':
+            i = strtol(optarg, NULL, 0);
+            if ((i >= OPT_N_MIN) && (i <= OPT_N_MAX)) g_opt_n = i;
+            else
+            {
+               fprintf(stderr, "invalid -n option (%ld)\n", i);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static uint64_t nanos(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* the CBs a delay needs, the wave build in pigpio_kernels.h calls it */
+
+static int waveDelayCBs(uint32_t delay)
+{
+   uint32_t cbs;
+
+   if (!delay) return 0;
+   cbs = BPD * delay / DMA_LITE_MAX;
+   if  ((BPD * delay) % DMA_LITE_MAX) cbs++;
+   return cbs;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* the original code */
+
+static int oldAddGeneric(unsigned numIn1, rawWave_t *in1)
+{
+   unsigned inPos1=0, inPos2=0, outPos=0, level = NUM_WAVE_OOL;
+
+   unsigned cbs=0;
+
+   unsigned numIn2, numOut;
+
+   uint32_t tNow, tNext1, tNext2, tDelay, tMax;
+
+   rawWave_t *in2, *out;
+
+   numIn2 = oldWfc[oldWfcur];
+   in2    = oldWf[oldWfcur];
+
+   numOut = PI_WAVE_MAX_PULSES;
+   out   = oldWf[1-oldWfcur];
+
+   tNow = 0;
+   tMax = 0;
+
+   if (!numIn1) tNext1 = -1; else tNext1 = 0;
+   if (!numIn2) tNext2 = -1; else tNext2 = 0;
+
+   while (((inPos1<numIn1) || (inPos2<numIn2)) && (outPos<numOut))
+   {
+      if (tNext1 < tNext2)
+      {
+         /* pulse 1 due */
+
+         if (tNow < tNext1)
+         {
+            /* extend previous delay */
+            out[outPos-1].usDelay += (tNext1 - tNow);
+            tNow = tNext1;
+         }
+
+         out[outPos].gpioOn  = in1[inPos1].gpioOn;
+         out[outPos].gpioOff = in1[inPos1].gpioOff;
+         out[outPos].flags   = in1[inPos1].flags;
+
+         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
+         if (tMax < tNext1) tMax = tNext1;
+      }
+      else if (tNext2 < tNext1)
+      {
+         /* pulse 2 due */
+
+         if (tNow < tNext2)
+         {
+            /* extend previous delay */
+            out[outPos-1].usDelay += (tNext2 - tNow);
+            tNow = tNext2;
+         }
+
+         out[outPos].gpioOn  = in2[inPos2].gpioOn;
+         out[outPos].gpioOff = in2[inPos2].gpioOff;
+         out[outPos].flags   = in2[inPos2].flags;
+
+         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
+         if (tMax < tNext2) tMax = tNext2;
+      }
+      else
+      {
+         /* pulse 1 and 2 both due */
+
+         if (tNow < tNext1)
+         {
+            /* extend previous delay */
+            out[outPos-1].usDelay += (tNext1 - tNow);
+            tNow = tNext1;
+         }
+
+         out[outPos].gpioOn  = in1[inPos1].gpioOn  | in2[inPos2].gpioOn;
+         out[outPos].gpioOff = in1[inPos1].gpioOff | in2[inPos2].gpioOff;
+         out[outPos].flags   = in1[inPos1].flags   | in2[inPos2].flags;
+
+         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
+         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
+         if (tMax < tNext1) tMax = tNext1;
+         if (tMax < tNext2) tMax = tNext2;
+      }
+
+      if (tNext1 <= tNext2) { tDelay = tNext1 - tNow; tNow = tNext1; }
+      else                  { tDelay = tNext2 - tNow; tNow = tNext2; }
+
+      out[outPos].usDelay = tDelay;
+
+      cbs += waveDelayCBs(tDelay);
+
+      if (out[outPos].gpioOn || out[outPos].gpioOff) cbs++;
+
+      if (out[outPos].flags & WAVE_FLAG_READ)
+      {
+         cbs++; /* one cb if read */
+         --level;
+      }
+
+      if (out[outPos].flags & WAVE_FLAG_TICK)
+      {
+         cbs++; /* one cb if tick */
+         --level;
+      }
+
+      outPos++;
+
+      if (inPos1 >= numIn1) tNext1 = -1;
+      if (inPos2 >= numIn2) tNext2 = -1;
+
+   }
+
+   if (tNow < tMax)
+   {
+      /* extend previous delay */
+      out[outPos-1].usDelay += (tMax - tNow);
+      tNow = tMax;
+   }
+
+   if ((outPos < numOut) && (outPos < level))
+   {
+      oldStats.micros = tNow;
+
+      if (tNow > oldStats.highMicros) oldStats.highMicros = tNow;
+
+      oldStats.pulses = outPos;
+
+      if (outPos > oldStats.highPulses) oldStats.highPulses = outPos;
+
+      oldStats.cbs    = cbs;
+
+      if (cbs > oldStats.highCbs) oldStats.highCbs = cbs;
+
+      oldWfc[1-oldWfcur] = outPos;
+      oldWfcur = 1 - oldWfcur;
+
+      return outPos;
+   }
+   else return PI_TOO_MANY_PULSES;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------------- */
+
+static rawWave_t *makeAdd(int add, int adds, int pulses)
+{
+   static rawWave_t in[PI_WAVE_MAX_PULSES];
+   int i;
+
+   /*
+   Each add toggles its own GPIO and every 16th pulse has a zero
+   delay.  With -a every add has the same delays.  Otherwise an
+   add's pulses start at times which are add modulo adds, so no
+   two adds have a pulse at the same time.
+   */
+
+   srand(g_opt_a ? 1 : (add + 1));
+
+   for (i=0; i<pulses; i++)
+   {
+      in[i].gpioOn  = (i & 1) ? 0 : (1U << (add % 32));
+      in[i].gpioOff = (i & 1) ? (1U << (add % 32)) : 0;
+      in[i].flags   = 0;
+
+      if ((i % 16) == 15) in[i].usDelay = 0;
+      else if (g_opt_a)   in[i].usDelay = 1 + (rand() % 200);
+      else                in[i].usDelay = adds * (1 + (rand() % 8));
+   }
+
+   if (!g_opt_a && pulses)
+   {
+      /* the first pulse sets nothing, it offsets the add */
+
+      in[0].gpioOn  = 0;
+      in[0].gpioOff = 0;
+      in[0].usDelay = adds + add;
+   }
+
+   return in;
+}
+
+static void clearWaves(void)
+{
+   oldWfc[0] = 0;
+   oldWfc[1] = 0;
+   oldWfc[2] = 0;
+   oldWfcur = 0;
+   memset(&oldStats, 0, sizeof(oldStats));
+
+   waveBuildReset();
+   memset(&wfStats, 0, sizeof(wfStats));
+}
+
+static int run(int adds)
+{
+   int a, i, pulses, oldRet, newRet, errors;
+   rawWave_t *in;
+   uint64_t t0, oldNanos, newNanos;
+
+   clearWaves();
+
+   pulses = g_opt_n / adds;
+
+   errors = 0;
+   oldNanos = 0;
+   newNanos = 0;
+
+   for (a=0; a<adds; a++)
+   {
+      in = makeAdd(a, adds, pulses);
+
+      t0 = nanos();
+      oldRet = oldAddGeneric(pulses, in);
+      oldNanos += nanos() - t0;
+
+      t0 = nanos();
+      newRet = waveAddGeneric(pulses, in);
+      newNanos += nanos() - t0;
+
+      if (oldRet != newRet) errors++;
+   }
+
+   /* gpioWaveCreate merges the runs */
+
+   t0 = nanos();
+   waveMergePending();
+   newNanos += nanos() - t0;
+
+   if (oldWfc[oldWfcur] != wfc[wfcur]) errors++;
+   else
+   {
+      for (i=0; i<wfc[wfcur]; i++)
+      {
+         if (memcmp(&oldWf[oldWfcur][i], &wf[wfcur][i], sizeof(rawWave_t)))
+         {
+            errors++;
+            break;
+         }
+      }
+   }
+
+   if (oldStats.micros != wfStats.micros) errors++;
+
+   printf("%4d %6d %6d %10.3f %10.3f %8d\n",
+      adds, pulses * adds, wfc[wfcur],
+      oldNanos / 1e6, newNanos / 1e6, errors);
+
+   return errors;
+}
+
+int main(int argc, char *argv[])
+{
+   int i, errors;
+   static int adds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+   initOpts(argc, argv);
+
+   /* touch the buffers so their page faults aren't timed */
+
+   memset(oldWf, 0, sizeof(oldWf));
+   memset(wf, 0, sizeof(wf));
+   memset(waveTime, 0, sizeof(waveTime));
+
+   printf("waves of about %d pulses%s\n\n",
+      g_opt_n, g_opt_a ? ", the adds share their timing" : "");
+
+   printf("adds  added merged     old ms     new ms  differ\n");
+
+   errors = 0;
+
+   for (i=0; i<(sizeof(adds)/sizeof(adds[0])); i++)
+      errors += run(adds[i]);
+
+   if (errors) printf("\nwaveforms differ\n");
+
+   return errors ? 1 : 0;
+}
@@ -62,12 +62,26 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_BSPIO, "BSPIO", 134, 0, 0}, // bbSPIOpen
    {PI_CMD_BSPIX, "BSPIX", 193, 6, 0}, // bbSPIXfer
 
+   {PI_CMD_CAPC,  "CAPC",  101, 0, 1}, // gpioCaptureStop
+   {PI_CMD_CAPG,  "CAPG",  101, 9, 0}, // gpioCaptureStatus
+   {PI_CMD_CAPR,  "CAPR",  121, 12, 0}, // gpioCaptureRead
+   {PI_CMD_CAPS,  "CAPS",  135, 0, 0}, // gpioCaptureStart
+   {PI_CMD_CAPW,  "CAPW",  116, 2, 0}, // gpioCaptureSave
+
    {PI_CMD_CF1,   "CF1",   195, 2, 0}, // gpioCustom1
    {PI_CMD_CF2,   "CF2",   195, 6, 0}, // gpioCustom2
 
    {PI_CMD_CGI,   "CGI",   101, 4, 1}, // gpioCfgGetInternals
    {PI_CMD_CSI,   "CSI",   111, 1, 1}, // gpioCfgSetInternals
 
+   {PI_CMD_DCDC,  "DCDC",  112, 0, 1}, // gpioDecodeReadClose
+   {PI_CMD_DCDR,  "DCDR",  121, 11, 0}, // gpioDecodeRead
+
+   {PI_CMD_ENCC,  "ENCC",  112, 0, 1}, // gpioEncoderClose
+   {PI_CMD_ENCE,  "ENCE",  131, 0, 1}, // gpioEncoderSetEvent
+   {PI_CMD_ENCG,  "ENCG",  112, 10, 0}, // gpioEncoderGet
+   {PI_CMD_ENCO,  "ENCO",  131, 2, 1}, // gpioEncoderOpen
+
    {PI_CMD_EVM,   "EVM",   122, 1, 1}, // eventMonitor
    {PI_CMD_EVT,   "EVT",   112, 0, 1}, // eventTrigger
 
@@ -95,6 +109,8 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_HWVER, "HWVER", 101, 4, 1}, // gpioHardwareRevision
 
+   {PI_CMD_IRRO,  "IRRO",  121, 0, 1}, // gpioIRReadOpen
+
    {PI_CMD_I2CC,  "I2CC",  112, 0, 1}, // i2cClose
    {PI_CMD_I2CO,  "I2CO",  131, 2, 1}, // i2cOpen
 
@@ -127,10 +143,17 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_MODES, "M",     125, 0, 1}, // gpioSetMode
    {PI_CMD_MODES, "MODES", 125, 0, 1}, // gpioSetMode
 
+   {PI_CMD_MTRG,  "MTRG",  112, 9, 0}, // gpioGetMeter
+   {PI_CMD_MTRS,  "MTRS",  121, 0, 1}, // gpioSetMeter
+
    {PI_CMD_NB,    "NB",    122, 0, 1}, // gpioNotifyBegin
    {PI_CMD_NC,    "NC",    112, 0, 1}, // gpioNotifyClose
    {PI_CMD_NO,    "NO",    101, 2, 1}, // gpioNotifyOpen
+   {PI_CMD_NOF,   "NOF",   112, 2, 1}, // gpioNotifyOpenWithFormat
+   {PI_CMD_NOR,   "NOR",   112, 2, 1}, // gpioNotifyOpenShared
    {PI_CMD_NP,    "NP",    112, 0, 1}, // gpioNotifyPause
+   {PI_CMD_NQD,   "NQD",   112, 2, 1}, // gpioNotifyGetDropped
+   {PI_CMD_NQL,   "NQL",   112, 2, 1}, // gpioNotifyGetQueued
 
    {PI_CMD_PADG,  "PADG",  112, 2, 1}, // gpioGetPad
    {PI_CMD_PADS,  "PADS",  121, 0, 1}, // gpioSetPad
@@ -177,9 +200,12 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_SLR,   "SLR",   121, 6, 0}, // gpioSerialRead
    {PI_CMD_SLRC,  "SLRC",  112, 0, 1}, // gpioSerialReadClose
+   {PI_CMD_SLRE,  "SLRE",  112, 2, 1}, // gpioSerialReadErrors
    {PI_CMD_SLRO,  "SLRO",  131, 0, 1}, // gpioSerialReadOpen
    {PI_CMD_SLRI,  "SLRI",  121, 0, 1}, // gpioSerialReadInvert
 
+   {PI_CMD_SNIFF, "SNIFF", 121, 0, 1}, // gpioI2CSniffOpen
+
    {PI_CMD_SPIC,  "SPIC",  112, 0, 1}, // spiClose
    {PI_CMD_SPIO,  "SPIO",  131, 2, 1}, // spiOpen
    {PI_CMD_SPIR,  "SPIR",  121, 6, 0}, // spiRead
@@ -193,6 +219,8 @@ cmdInfo_t cmdInfo[]=
 
    {PI_CMD_WDOG,  "WDOG",  121, 0, 1}, // gpioSetWatchdog
 
+   {PI_CMD_WGRO,  "WGRO",  121, 0, 1}, // gpioWiegandReadOpen
+
    {PI_CMD_WRITE, "W",     121, 0, 1}, // gpioWrite
    {PI_CMD_WRITE, "WRITE", 121, 0, 1}, // gpioWrite
 
@@ -203,14 +231,22 @@ cmdInfo_t cmdInfo[]=
    {PI_CMD_WVCLR, "WVCLR", 101, 0, 1}, // gpioWaveClear
    {PI_CMD_WVCRE, "WVCRE", 101, 2, 1}, // gpioWaveCreate 
    {PI_CMD_WVCAP, "WVCAP", 112, 2, 1}, // gpioWaveCreatePad
+   {PI_CMD_WVCRS, "WVCRS", 101, 2, 1}, // gpioWaveCreateShared
+   {PI_CMD_WVCST, "WVCST", 101, 9, 0}, // gpioWaveGetCacheStats
    {PI_CMD_WVDEL, "WVDEL", 112, 0, 1}, // gpioWaveDelete
+   {PI_CMD_WVFRG, "WVFRG", 101, 9, 0}, // gpioWaveFragmentation
    {PI_CMD_WVGO,  "WVGO" , 101, 2, 0}, // gpioWaveTxStart
    {PI_CMD_WVGOR, "WVGOR", 101, 2, 0}, // gpioWaveTxStart
    {PI_CMD_WVHLT, "WVHLT", 101, 0, 1}, // gpioWaveTxStop
    {PI_CMD_WVNEW, "WVNEW", 101, 0, 1}, // gpioWaveAddNew
    {PI_CMD_WVSC,  "WVSC",  112, 2, 1}, // gpioWaveGet*Cbs
+   {PI_CMD_WVSCL, "WVSCL", 101, 0, 1}, // gpioWaveStreamClose
+   {PI_CMD_WVSEV, "WVSEV", 121, 0, 1}, // gpioWaveStreamSetEvent
    {PI_CMD_WVSM,  "WVSM",  112, 2, 1}, // gpioWaveGet*Micros
+   {PI_CMD_WVSOP, "WVSOP", 121, 0, 1}, // gpioWaveStreamOpen
    {PI_CMD_WVSP,  "WVSP",  112, 2, 1}, // gpioWaveGet*Pulses
+   {PI_CMD_WVSST, "WVSST", 101, 9, 0}, // gpioWaveStreamStatus
+   {PI_CMD_WVSWR, "WVSWR", 192, 0, 0}, // gpioWaveStreamWrite
    {PI_CMD_WVTAT, "WVTAT", 101, 2, 1}, // gpioWaveTxAt
    {PI_CMD_WVTX,  "WVTX",  112, 2, 1}, // gpioWaveTxSend
    {PI_CMD_WVTXM, "WVTXM", 121, 2, 1}, // gpioWaveTxSend
@@ -282,15 +318,29 @@ BS2 bits         Set GPIO in bank 2\n\
 \n\
 BSCX bctl bvs    BSC I2C/SPI transfer\n\
 \n\
+CAPC             Stop capture\n\
+CAPG             Get capture state, samples, trigger, tick, gaps\n\
+CAPR i n         Read up to n capture samples from sample i\n\
+CAPS bits mode tbits tlevels pre post | Start capture\n\
+CAPW file        Save capture to file\n\
+\n\
 CF1 ...          Custom function 1\n\
 CF2 ...          Custom function 2\n\
 \n\
 CGI              Configuration get internals\n\
 CSI v            Configuration set internals\n\
 \n\
+DCDC g           Close GPIO for Wiegand, IR, or I2C sniffer reads\n\
+DCDR g n         Read up to n decoded frames from GPIO\n\
+\n\
 EVM h bits       Set events to monitor\n\
 EVT n            Trigger event\n\
 \n\
+ENCC h           Close encoder handle\n\
+ENCE h ev ms     Trigger event ev when encoder moves, at most every ms\n\
+ENCG h           Get encoder position and velocity\n\
+ENCO a b i       Open quadrature encoder on GPIO a and b, index i (32 none)\n\
+\n\
 FC h             Close file handle\n\
 FG g steady      Set glitch filter on GPIO\n\
 FL pat n         List files which match pattern\n\
@@ -308,6 +358,8 @@ HC g f           Set hardware clock frequency\n\
 HP g f dc        Set hardware PWM frequency and dutycycle\n\
 HWVER            Get hardware version\n\
 \n\
+IRRO g p         Open GPIO for IR reads, protocol p (1 NEC, 2 RC5)\n\
+\n\
 I2CC h           Close I2C handle\n\
 I2CO bus device flags | Open I2C bus and device with flags\n\
 I2CPC h r word   SMBus Process Call: exchange register with word\n\
@@ -331,11 +383,17 @@ M/MODES g mode   Set GPIO mode\n\
 MG/MODEG g       Get GPIO mode\n\
 MICS n           Delay for microseconds\n\
 MILS n           Delay for milliseconds\n\
+MTRG g           Get GPIO edge meter results\n\
+MTRS g ms        Start GPIO edge meter, ms window (0 to stop)\n\
 \n\
 NB h bits        Start notification\n\
 NC h             Close notification\n\
 NO               Request a notification\n\
+NOF format       Request a notification with a report format\n\
+NOR reports      Request a shared memory notification\n\
 NP h             Pause notification\n\
+NQD h            Get notification reports dropped\n\
+NQL h            Get notification reports queued\n\
 \n\
 P/PWM g v        Set GPIO PWM value\n\
 PADG pad         Get pad drive strength\n\
@@ -368,8 +426,10 @@ SERWB h byte     Write byte to serial handle\n\
 SHELL name str   Execute a shell command\n\
 SLR g v          Read bit bang serial data from GPIO\n\
 SLRC g           Close GPIO for bit bang serial data\n\
+SLRE g           Get bit bang serial framing errors\n\
 SLRO g baud bitlen | Open GPIO for bit bang serial data\n\
 SLRI g invert    Invert serial logic (1 invert, 0 normal)\n\
+SNIFF sda scl    Open GPIO sda and scl to sniff an I2C bus\n\
 SPIC h           SPI close handle\n\
 SPIO channel baud flags | SPI open channel at baud with flags\n\
 SPIR h v         SPI read bytes from handle\n\
@@ -381,20 +441,29 @@ TRIG g micros l  Trigger level for micros on GPIO\n\
 \n\
 W/WRITE g l      Write level to GPIO\n\
 WDOG g millis    Set millisecond watchdog on GPIO\n\
+WGRO d0 d1       Open GPIO d0 and d1 for Wiegand reads\n\
 WVAG triplets    Wave add generic pulses\n\
 WVAS g baud bitlen stopbits offset ... | Wave add serial data\n\
 WVBSY            Check if wave busy\n\
 WVCHA            Transmit a chain of waves\n\
 WVCLR            Wave clear\n\
 WVCRE            Create wave from added pulses\n\
-WVDEL wid        Delete waves w and higher\n\
+WVCRS            Create wave which may be shared\n\
+WVCST            Wave get cache statistics\n\
+WVDEL wid        Delete wave w\n\
+WVFRG            Wave get free CB and OOL space\n\
 WVGO             Wave transmit (DEPRECATED)\n\
 WVGOR            Wave transmit repeatedly (DEPRECATED)\n\
 WVHLT            Wave stop\n\
 WVNEW            Start a new empty wave\n\
 WVSC 0,1,2       Wave get DMA control block stats\n\
+WVSCL            Wave stream close\n\
+WVSEV ev low     Wave stream trigger event ev at low segments\n\
 WVSM 0,1,2       Wave get micros stats\n\
+WVSOP segs sp    Wave stream open\n\
 WVSP 0,1,2       Wave get pulses stats\n\
+WVSST            Wave stream status\n\
+WVSWR triplets   Wave stream write a segment of pulses\n\
 WVTAT            Returns the current transmitting wave\n\
 WVTX wid         Transmit wave as one-shot\n\
 WVTXM wid wmde   Transmit wave using mode\n\
@@ -455,7 +524,7 @@ static errInfo_t errInfo[]=
    {PI_INITIALISED      , "function called after gpioInitialise"},
    {PI_BAD_WAVE_MODE    , "waveform mode not 0-1"},
    {PI_BAD_CFG_INTERNAL , "bad parameter in gpioCfgInternals call"},
-   {PI_BAD_WAVE_BAUD    , "baud rate not 50-250K(RX)/50-1M(TX)"},
+   {PI_BAD_WAVE_BAUD    , "baud rate not 50-333333(RX)/50-1M(TX)"},
    {PI_TOO_MANY_PULSES  , "waveform has too many pulses"},
    {PI_TOO_MANY_CHARS   , "waveform has too many chars"},
    {PI_NOT_SERIAL_GPIO  , "no bit bang serial read in progress on GPIO"},
@@ -567,6 +636,30 @@ static errInfo_t errInfo[]=
    {PI_CMD_INTERRUPTED  , "command interrupted, Python"},
    {PI_NOT_ON_BCM2711   , "not available on BCM2711"},
    {PI_ONLY_ON_BCM2711  , "only available on BCM2711"},
+   {PI_BAD_SOCK_WORKERS , "socket workers not 1-64"},
+   {PI_BAD_BATCH_LEN    , "batch truncated or too long"},
+   {PI_BAD_BATCH_CMD    , "command not allowed in batch"},
+   {PI_BAD_SOCKET_PATH  , "socket path too long"},
+   {PI_BAD_RING_CMD     , "command not allowed on a ring"},
+   {PI_RING_FAILED      , "can't create command ring"},
+   {PI_BAD_NOTIFY_RING  , "notify ring not power of 2 16-65536"},
+   {PI_BAD_NOTIFY_FORMAT, "unknown notification format"},
+   {PI_BAD_CB_WORKERS   , "callback workers not 0-16"},
+   {PI_BAD_ALERT_POLL   , "alert poll not 0 or 50-50000"},
+   {PI_BAD_METER_WINDOW , "meter window not 0 or 10-60000"},
+   {PI_NOT_METERED      , "GPIO has no meter"},
+   {PI_BAD_ENCODER_EVENT, "encoder event millis not 0-60000"},
+   {PI_BAD_IR_PROTOCOL  , "IR protocol not NEC or RC5"},
+   {PI_NOT_DECODE_GPIO  , "no Wiegand or IR read on GPIO"},
+   {PI_BAD_CAPTURE_DEPTH, "capture pre plus post samples > 1000000"},
+   {PI_BAD_CAPTURE_TRIG , "bad capture GPIO or trigger"},
+   {PI_NO_CAPTURE       , "no capture started"},
+   {PI_CAPTURE_NOT_DONE , "capture not complete"},
+   {PI_BAD_TIMER_MICROS , "timer micros not 100-60000000"},
+   {PI_BAD_TIMER_WORKERS, "timer workers not 0-10"},
+   {PI_BAD_WAVE_STREAM  , "stream segments not 2-64, or bad pulses or low water"},
+   {PI_NO_WAVE_STREAM   , "no wave stream open"},
+   {PI_WAVE_STREAM_FULL , "no free wave stream segment"},
 
 };
 
@@ -631,6 +724,43 @@ char *cmdStr(void)
    return intCmdStr;
 }
 
+int cmdReturnsExt(int cmd)
+{
+   /* a positive result is followed by that many bytes of extension */
+
+   switch (cmd)
+   {
+      case PI_CMD_BATCH:
+      case PI_CMD_BI2CZ:
+      case PI_CMD_BSCX:
+      case PI_CMD_BSPIX:
+      case PI_CMD_CAPG:
+      case PI_CMD_CAPR:
+      case PI_CMD_CF2:
+      case PI_CMD_DCDR:
+      case PI_CMD_ENCG:
+      case PI_CMD_FL:
+      case PI_CMD_FR:
+      case PI_CMD_I2CPK:
+      case PI_CMD_I2CRD:
+      case PI_CMD_I2CRI:
+      case PI_CMD_I2CRK:
+      case PI_CMD_I2CZ:
+      case PI_CMD_MTRG:
+      case PI_CMD_PROCP:
+      case PI_CMD_SERR:
+      case PI_CMD_SLR:
+      case PI_CMD_SPIX:
+      case PI_CMD_SPIR:
+      case PI_CMD_WVCST:
+      case PI_CMD_WVFRG:
+      case PI_CMD_WVSST:
+         return 1;
+   }
+
+   return 0;
+}
+
 int cmdParse(
    char *buf, uintptr_t *p, unsigned ext_len, char *ext, cmdCtlParse_t *ctl)
 {
@@ -668,10 +798,11 @@ int cmdParse(
 
    switch (cmdInfo[idx].vt)
    {
-      case 101: /* BR1  BR2  CGI  H  HELP  HWVER
+      case 101: /* BR1  BR2  CAPC  CAPG  CGI  H  HELP  HWVER
                    DCRA  HALT  INRA  NO
                    PIGPV  POPA  PUSHA  RET  T  TICK  WVBSY  WVCLR
-                   WVCRE  WVGO  WVGOR  WVHLT  WVNEW
+                   WVCRE  WVCRS  WVCST  WVFRG  WVGO  WVGOR  WVHLT  WVNEW  WVSCL
+                   WVSST
 
                    No parameters, always valid.
                 */
@@ -691,9 +822,10 @@ int cmdParse(
 
          break;
 
-      case 112: /* BI2CC FC  GDC  GPW  I2CC  I2CRB
-                   MG  MICS  MILS  MODEG  NC  NP  PADG PFG  PRG
-                   PROCD  PROCP  PROCS  PRRG  R  READ  SLRC  SPIC
+      case 112: /* BI2CC DCDC  ENCC  ENCG  FC  GDC  GPW  I2CC  I2CRB
+                   MG  MICS  MILS  MODEG  MTRG  NC  NOF  NP  NQD  NQL  PADG
+                   PFG  PRG
+                   PROCD  PROCP  PROCS  PRRG  R  READ  SLRC  SLRE  SPIC
                    WVCAP WVDEL  WVSC  WVSM  WVSP  WVTX  WVTXR  BSPIC
 
                    One positive parameter.
@@ -734,7 +866,7 @@ int cmdParse(
 
          break;
 
-      case 116: /* SYS
+      case 116: /* CAPW  SYS
 
                    One parameter, a string.
                 */
@@ -750,9 +882,9 @@ int cmdParse(
 
          break;
 
-      case 121: /* HC  FR  I2CRD  I2CRR  I2CRW  I2CWB I2CWQ  P
-                   PADS  PFS  PRS  PWM  S  SERVO  SLR  SLRI  W
-                   WDOG  WRITE  WVTXM
+      case 121: /* CAPR  DCDR  HC  FR  I2CRD  I2CRR  I2CRW  I2CWB I2CWQ  IRRO  MTRS
+                   P  PADS  PFS  PRS  PWM  S  SERVO  SLR  SLRI  SNIFF  W
+                   WDOG  WGRO  WRITE  WVSEV  WVSOP  WVTXM
 
                    Two positive parameters.
                 */
@@ -893,7 +1025,7 @@ int cmdParse(
 
          break;
 
-      case 131: /* BI2CO  HP  I2CO  I2CPC  I2CRI  I2CWB  I2CWW
+      case 131: /* BI2CO  ENCE  ENCO  HP  I2CO  I2CPC  I2CRI  I2CWB  I2CWW
                    SLRO  SPIO  TRIG
 
                    Three positive parameters.
@@ -985,6 +1117,35 @@ int cmdParse(
 
          break;
 
+      case 135: /* CAPS
+
+                   Six parameters.  Second, fifth, and sixth positive.
+                   The others are bit masks, any value.
+                */
+         ctl->eaten += getNum(buf+ctl->eaten, &p[1], &ctl->opt[1]);
+         ctl->eaten += getNum(buf+ctl->eaten, &p[2], &ctl->opt[2]);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp1, &to1);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp2, &to2);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp3, &to3);
+         ctl->eaten += getNum(buf+ctl->eaten, &tp4, &to4);
+
+         if ((ctl->opt[1] == CMD_NUMERIC) &&
+             (ctl->opt[2] == CMD_NUMERIC) && ((int)p[2] >= 0) &&
+             (to1 == CMD_NUMERIC) &&
+             (to2 == CMD_NUMERIC) &&
+             (to3 == CMD_NUMERIC) && ((int)tp3 >= 0) &&
+             (to4 == CMD_NUMERIC) && ((int)tp4 >= 0))
+         {
+            p[3] = 4 * 4;
+            memcpy(ext+ 0, &tp1, 4);
+            memcpy(ext+ 4, &tp2, 4);
+            memcpy(ext+ 8, &tp3, 4);
+            memcpy(ext+12, &tp4, 4);
+            valid = 1;
+         }
+
+         break;
+
       case 191: /* PROCR PROCU
 
                    One to 11 parameters, first positive,
@@ -1015,7 +1176,7 @@ int cmdParse(
 
          break;
 
-      case 192: /* WVAG
+      case 192: /* WVAG  WVSWR
 
                    One or more triplets (gpios on, gpios off, delay),
                    any value.
@@ -1420,3 +1581,190 @@ int cmdParseScript(char *script, cmdScript_t *s, int diags)
    return status;
 }
 
+
+/*
+   PI_NOTIFY_FORMAT_V2 notification stream.
+
+   The stream starts with PI_NOTIFY_V2_MAGIC (4 bytes, little endian)
+   followed by one record per report.  A record is
+
+      head   varint (tick delta << PI_NOTIFY_V2_SHIFT) | kind
+      seqno  varint, only if kind & PI_NOTIFY_V2_SEQNO
+      flags  varint, only if kind & PI_NOTIFY_V2_FLAGS
+      level  one byte bit number if kind & PI_NOTIFY_V2_BIT
+             (a single GPIO changed), otherwise varint level XOR
+
+   The tick delta and level XOR are relative to the previous report
+   (zero before the first).  The seqno is only sent when it is not
+   one more than the previous report's, i.e. after dropped reports.
+
+   Varints are little endian base 128, the top bit of each byte
+   set if another byte follows.
+*/
+
+static int cmdVarintPut(uint8_t *buf, uint64_t v)
+{
+   int n = 0;
+
+   while (v >= 0x80)
+   {
+      buf[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+
+   buf[n++] = v;
+
+   return n;
+}
+
+static int cmdVarintGet(uint8_t *buf, int len, uint64_t *v)
+{
+   int n, shift;
+
+   /* returns bytes used, 0 if incomplete, -1 if corrupt */
+
+   *v = 0;
+
+   for (n=0, shift=0; n<len; n++, shift+=7)
+   {
+      if (shift > 63) return -1;
+
+      *v |= (uint64_t)(buf[n] & 0x7F) << shift;
+
+      if (!(buf[n] & 0x80)) return n+1;
+   }
+
+   return 0;
+}
+
+int cmdNotifyEncode(cmdNotifyCodec_t *c, gpioReport_t *r, char *buf)
+{
+   uint8_t *b = (uint8_t *)buf;
+   uint32_t diff;
+   uint64_t head;
+   int kind, len;
+
+   /* buf must hold PI_NOTIFY_V2_MAX_RECORD + 4 bytes */
+
+   len = 0;
+
+   if (!c->started)
+   {
+      b[len++] = PI_NOTIFY_V2_MAGIC & 0xFF;
+      b[len++] = (PI_NOTIFY_V2_MAGIC >> 8) & 0xFF;
+      b[len++] = (PI_NOTIFY_V2_MAGIC >> 16) & 0xFF;
+      b[len++] = (PI_NOTIFY_V2_MAGIC >> 24) & 0xFF;
+      c->started = 1;
+   }
+
+   diff = r->level ^ c->level;
+
+   kind = 0;
+
+   if (r->seqno != c->seqno)      kind |= PI_NOTIFY_V2_SEQNO;
+   if (r->flags)                  kind |= PI_NOTIFY_V2_FLAGS;
+   if (diff && !(diff & (diff-1))) kind |= PI_NOTIFY_V2_BIT;
+
+   head = ((uint64_t)(uint32_t)(r->tick - c->tick) << PI_NOTIFY_V2_SHIFT);
+
+   len += cmdVarintPut(b+len, head | kind);
+
+   if (kind & PI_NOTIFY_V2_SEQNO) len += cmdVarintPut(b+len, r->seqno);
+
+   if (kind & PI_NOTIFY_V2_FLAGS) len += cmdVarintPut(b+len, r->flags);
+
+   if (kind & PI_NOTIFY_V2_BIT) b[len++] = __builtin_ctz(diff);
+   else                         len += cmdVarintPut(b+len, diff);
+
+   c->tick  = r->tick;
+   c->level = r->level;
+   c->seqno = r->seqno + 1;
+
+   return len;
+}
+
+int cmdNotifyDecode(cmdNotifyCodec_t *c, char *buf, int len,
+   gpioReport_t *r, int maxReports, int *used)
+{
+   uint8_t *b = (uint8_t *)buf;
+   uint64_t head, v;
+   uint32_t magic;
+   int n, pos, p, k;
+
+   /*
+      Decodes complete records from buf.  Returns the number of
+      reports decoded (setting *used to the bytes consumed) or -1
+      if the stream is not a valid v2 stream.
+   */
+
+   pos = 0;
+   k = 0;
+
+   *used = 0;
+
+   if (!c->started)
+   {
+      if (len < 4) return 0;
+
+      magic = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+
+      if (magic != PI_NOTIFY_V2_MAGIC) return -1;
+
+      c->started = 1;
+      pos = 4;
+   }
+
+   for (n=0; n<maxReports; n++)
+   {
+      p = pos;
+
+      if ((k = cmdVarintGet(b+p, len-p, &head)) <= 0) break;
+      p += k;
+
+      r[n].tick  = c->tick + (uint32_t)(head >> PI_NOTIFY_V2_SHIFT);
+      r[n].seqno = c->seqno;
+      r[n].flags = 0;
+
+      if (head & PI_NOTIFY_V2_SEQNO)
+      {
+         if ((k = cmdVarintGet(b+p, len-p, &v)) <= 0) break;
+         p += k;
+         r[n].seqno = v;
+      }
+
+      if (head & PI_NOTIFY_V2_FLAGS)
+      {
+         if ((k = cmdVarintGet(b+p, len-p, &v)) <= 0) break;
+         p += k;
+         r[n].flags = v;
+      }
+
+      if (head & PI_NOTIFY_V2_BIT)
+      {
+         if (p >= len) break;
+         if (b[p] > 31) return -1;
+         v = 1U << b[p++];
+      }
+      else
+      {
+         if ((k = cmdVarintGet(b+p, len-p, &v)) <= 0) break;
+         p += k;
+      }
+
+      r[n].level = c->level ^ (uint32_t)v;
+
+      c->tick  = r[n].tick;
+      c->level = r[n].level;
+      c->seqno = r[n].seqno + 1;
+
+      pos = p;
+   }
+
+   /* a corrupt varint stops the loop with k < 0 */
+
+   if ((n < maxReports) && (k < 0)) return -1;
+
+   *used = pos;
+
+   return n;
+}
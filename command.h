@@ -65,6 +65,61 @@ typedef struct
    };
 } cmdCmd_t;
 
+/*
+   A command ring is a shared memory request/response ring used by
+   local clients in place of the socket.  The client writes a
+   request into slot[head % CMD_RING_SLOTS] and advances head.
+   The daemon claims the request by advancing taken, executes it,
+   writes the result to cmd.res of the same slot and advances tail.
+   Either side may park on a futex on the index it is waiting for,
+   setting the matching waiting flag first so the other side knows
+   to wake it.
+
+   If the daemon closes the ring the client claims back a request
+   not yet taken by advancing taken itself, then sends it on the
+   socket.  Both sides claim with a compare and swap so a request
+   is executed exactly once.
+*/
+
+#define CMD_RING_NAME    "/pigpio-ring%d"
+#define CMD_RING_MAGIC   0x52495047 /* "GPIR" */
+#define CMD_RING_SLOTS   16
+#define CMD_RING_EXT_LEN 112
+
+typedef struct
+{
+   cmdCmd_t cmd;
+   char     ext[CMD_RING_EXT_LEN];
+} cmdRingSlot_t;
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t closing;     /* set by the daemon when the ring closes */
+   uint32_t pad0[14];
+   uint32_t head;        /* requests submitted, written by client  */
+   uint32_t headWaiting; /* daemon parked on head                  */
+   uint32_t pad1[14];
+   uint32_t tail;        /* requests completed, written by daemon  */
+   uint32_t tailWaiting; /* client parked on tail                  */
+   uint32_t taken;       /* requests claimed, see above            */
+   uint32_t pad2[13];
+   cmdRingSlot_t slot[CMD_RING_SLOTS];
+} cmdRing_t;
+
+/*
+   Running state of a PI_NOTIFY_FORMAT_V2 encoder or decoder.  Zero
+   it before the first report of a stream.
+*/
+
+typedef struct
+{
+   uint32_t tick;    /* tick of the previous report       */
+   uint32_t level;   /* level of the previous report      */
+   uint16_t seqno;   /* expected seqno of the next report */
+   uint16_t started; /* stream header sent or seen        */
+} cmdNotifyCodec_t;
+
 typedef struct
 {
    int    eaten;
@@ -120,5 +175,12 @@ char *cmdErrStr(int error);
 
 char *cmdStr(void);
 
+int cmdReturnsExt(int cmd);
+
+int cmdNotifyEncode(cmdNotifyCodec_t *c, gpioReport_t *r, char *buf);
+
+int cmdNotifyDecode(cmdNotifyCodec_t *c, char *buf, int len,
+   gpioReport_t *r, int maxReports, int *used);
+
 #endif
 
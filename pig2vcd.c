@@ -32,6 +32,7 @@ This version is for pigpio version 3+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <sys/types.h>
@@ -40,14 +41,98 @@ This version is for pigpio version 3+
 #include <fcntl.h>
 
 #include "pigpio.h"
+#include "command.h"
 
 /*
 This software converts pigpio notification reports
 into a VCD format understood by GTKWave.
+
+Both PI_NOTIFY_FORMAT_V1 and PI_NOTIFY_FORMAT_V2 streams are
+accepted, the format is detected from the first 4 bytes.
+
+The input is read and the output written in large blocks and
+the output is formatted by hand, so a capture of millions of
+reports is converted at close to the speed of the disk.
 */
 
 #define RS (sizeof(gpioReport_t))
 
+#define IN_BUF_SIZE  (1<<20)
+#define OUT_BUF_SIZE (1<<20)
+
+/* the most a report may add to the output: a time and 32 changes */
+
+#define OUT_MAX_REPORT 160
+
+#define MAX_REPORTS 4096
+
+#define MAX_NAME 64
+
+static char inBuf[IN_BUF_SIZE];
+static int  inPos = 0;
+static int  inLen = 0;
+
+static char outBuf[OUT_BUF_SIZE];
+static int  outLen = 0;
+
+static int  v2 = 0;
+static cmdNotifyCodec_t codec;
+
+static uint32_t g_opt_g = 0xFFFFFFFF;
+static char     g_name[32][MAX_NAME];
+
+void usage()
+{
+   fprintf
+   (stderr,
+      "\n" \
+      "Usage: pig2vcd [OPTION] ... <notifications >file.vcd\n" \
+      "   -g bits,    the GPIO to output, default 0xFFFFFFFF\n" \
+      "   -n g=name,  name GPIO g in the output, may be repeated\n" \
+      "\nEXAMPLE\n" \
+      "pig2vcd -g 0x30 -n 4=CLK -n 5=DATA </dev/pigpio0 >bus.vcd\n" \
+      "Output GPIO 4 and 5 named CLK and DATA.\n" \
+      "\n"
+   );
+}
+
+static void initOpts(int argc, char *argv[])
+{
+   int opt, b;
+   char *eq;
+
+   for (b=0; b<32; b++) sprintf(g_name[b], "%d", b);
+
+   while ((opt = getopt(argc, argv, "g:n:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'g':
+            g_opt_g = strtoul(optarg, NULL, 0);
+            break;
+
+         case 'n':
+            b = strtol(optarg, &eq, 0);
+
+            if ((eq == optarg) || (*eq != '=') || (b < 0) || (b > 31) ||
+                (eq[1] == 0) || (strlen(eq+1) >= MAX_NAME) ||
+                strpbrk(eq+1, " \t\n"))
+            {
+               fprintf(stderr, "invalid -n option (%s)\n", optarg);
+               usage();
+               exit(EXIT_FAILURE);
+            }
+
+            strcpy(g_name[b], eq+1);
+            break;
+
+        default: /* '?' */
+           usage();
+           exit(EXIT_FAILURE);
+        }
+    }
+}
+
 static char * timeStamp()
 {
    static char buf[32];
@@ -63,6 +148,111 @@ static char * timeStamp()
    return buf;
 }
 
+static int fill(void)
+{
+   int r;
+
+   /* move any part report to the start of the buffer */
+
+   if (inPos)
+   {
+      inLen -= inPos;
+      memmove(inBuf, inBuf+inPos, inLen);
+      inPos = 0;
+   }
+
+   r = read(STDIN_FILENO, inBuf+inLen, sizeof(inBuf)-inLen);
+
+   if (r > 0) inLen += r;
+
+   return r;
+}
+
+static int getReports(gpioReport_t *report, int maxReports)
+{
+   int n, used;
+
+   /* returns the number of reports read, 0 at the end of the input */
+
+   while (1)
+   {
+      if (v2)
+      {
+         n = cmdNotifyDecode(
+            &codec, inBuf+inPos, inLen-inPos, report, maxReports, &used);
+
+         if (n < 0) return 0;
+
+         inPos += used;
+      }
+      else
+      {
+         n = (inLen - inPos) / RS;
+
+         if (n > maxReports) n = maxReports;
+
+         memcpy(report, inBuf+inPos, n*RS);
+
+         inPos += n*RS;
+      }
+
+      if (n) return n;
+
+      if (fill() <= 0) return 0;
+   }
+}
+
+static void flush(void)
+{
+   int w, pos;
+
+   for (pos=0; pos<outLen; pos+=w)
+   {
+      w = write(STDOUT_FILENO, outBuf+pos, outLen-pos);
+
+      if (w <= 0) exit(-1);
+   }
+
+   outLen = 0;
+}
+
+static void putStr(char *str)
+{
+   int len;
+
+   len = strlen(str);
+
+   if ((outLen + len) > OUT_BUF_SIZE) flush();
+
+   memcpy(outBuf+outLen, str, len);
+   outLen += len;
+}
+
+static char * putTime(char *out, uint64_t t)
+{
+   char digits[24];
+   int n;
+
+   /* #t\n */
+
+   n = 0;
+
+   do
+   {
+      digits[n++] = '0' + (t % 10);
+      t /= 10;
+   }
+   while (t);
+
+   *out++ = '#';
+
+   while (n) *out++ = digits[--n];
+
+   *out++ = '\n';
+
+   return out;
+}
+
 int symbol(int bit)
 {
    if (bit < 26) return ('A' + bit);
@@ -71,51 +261,114 @@ int symbol(int bit)
 
 int main(int argc, char * argv[])
 {
-   int b, r, v;
-   uint32_t t0;
-   uint32_t lastLevel, changed;
+   int b, i, n, timed;
+   uint32_t lastTick, lastLevel, changed;
+   uint64_t t, lastTime;
+   char line[128];
+   char *out;
 
-   gpioReport_t report;
+   static gpioReport_t report[MAX_REPORTS];
 
-   r=read(STDIN_FILENO, &report, RS);
+   initOpts(argc, argv);
 
-   if (r != RS) exit(-1);
+   while (inLen < 4) if (fill() <= 0) exit(-1);
 
-   printf("$date %s $end\n", timeStamp());
-   printf("$version pig2vcd V1 $end\n");
-   printf("$timescale 1 us $end\n");
-   printf("$scope module top $end\n");
+   if ((inBuf[0] == (char)(PI_NOTIFY_V2_MAGIC & 0xFF)) &&
+       (inBuf[1] == (char)((PI_NOTIFY_V2_MAGIC >> 8) & 0xFF)) &&
+       (inBuf[2] == (char)((PI_NOTIFY_V2_MAGIC >> 16) & 0xFF)) &&
+       (inBuf[3] == (char)((PI_NOTIFY_V2_MAGIC >> 24) & 0xFF))) v2 = 1;
+
+   n = getReports(report, MAX_REPORTS);
+
+   if (!n) exit(-1);
+
+   snprintf(line, sizeof(line), "$date %s $end\n", timeStamp());
+   putStr(line);
+   putStr("$version pig2vcd V2 $end\n");
+   putStr("$timescale 1 us $end\n");
+   putStr("$scope module top $end\n");
 
    for (b=0; b<32; b++)
-      printf("$var wire 1 %c %d $end\n", symbol(b), b);
-        
-   printf("$upscope $end\n");
-   printf("$enddefinitions $end\n");
-         
-   t0 = report.tick;
-   lastLevel =0;
-
-   while ((r=read(STDIN_FILENO, &report, RS)) == RS)
    {
-      if (report.level != lastLevel)
+      if (g_opt_g & (1U<<b))
+      {
+         sprintf(line, "$var wire 1 %c ", symbol(b));
+         putStr(line);
+         putStr(g_name[b]);
+         putStr(" $end\n");
+      }
+   }
+
+   putStr("$var event 1 ! gap $end\n");
+
+   putStr("$upscope $end\n");
+   putStr("$enddefinitions $end\n");
+
+   /*
+   The time is kept in 64 bits from the tick differences so that
+   captures longer than the 72 minute tick wrap stay in order.
+   */
+
+   lastTick = report[0].tick;
+   lastLevel = 0;
+   lastTime = 0;
+   t = 0;
+   timed = 0;
+
+   while (n)
+   {
+      for (i=0; i<n; i++)
       {
-         printf("#%u\n", report.tick - t0);
+         t += (uint32_t)(report[i].tick - lastTick);
+         lastTick = report[i].tick;
 
-         changed = report.level ^ lastLevel;
+         if (outLen > (OUT_BUF_SIZE - OUT_MAX_REPORT)) flush();
 
-         lastLevel = report.level;
+         out = outBuf + outLen;
 
-         for (b=0; b<32; b++)
+         if (report[i].flags & PI_NTFY_FLAGS_GAP)
          {
-            if (changed & (1<<b))
+            /* samples were lost before this tick */
+
+            if (!timed || (t != lastTime)) out = putTime(out, t);
+
+            *out++ = '1';
+            *out++ = '!';
+            *out++ = '\n';
+
+            lastTime = t;
+            timed = 1;
+         }
+
+         changed = (report[i].level ^ lastLevel) & g_opt_g;
+
+         lastLevel = report[i].level;
+
+         if (changed)
+         {
+            if (!timed || (t != lastTime)) out = putTime(out, t);
+
+            lastTime = t;
+            timed = 1;
+
+            while (changed)
             {
-               if (report.level & (1<<b)) v='1'; else v='0';
+               b = __builtin_ctz(changed);
+               changed &= (changed - 1);
 
-               printf("%c%c\n", v, symbol(b));
+               *out++ = (lastLevel & (1U<<b)) ? '1' : '0';
+               *out++ = symbol(b);
+               *out++ = '\n';
             }
          }
+
+         outLen = out - outBuf;
       }
+
+      n = getReports(report, MAX_REPORTS);
    }
+
+   flush();
+
    return 0;
 }
-
@@ -56,7 +56,13 @@ For more information, please refer to <http://unlicense.org/>
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
@@ -776,6 +782,13 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 #define PI_NOTIFY_RUNNING  4
 #define PI_NOTIFY_PAUSED   5
 
+#define PI_RING_CLOSED   0
+#define PI_RING_RESERVED 1
+#define PI_RING_OPENED   2
+
+#define PI_ENCODER_CLOSED 0
+#define PI_ENCODER_OPENED 1
+
 #define PI_WFRX_NONE     0
 #define PI_WFRX_SERIAL   1
 #define PI_WFRX_I2C_SDA  2
@@ -784,6 +797,11 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 #define PI_WFRX_SPI_MISO 5
 #define PI_WFRX_SPI_MOSI 6
 #define PI_WFRX_SPI_CS   7
+#define PI_WFRX_WIEGAND_D0 8
+#define PI_WFRX_WIEGAND_D1 9
+#define PI_WFRX_IR       10
+#define PI_WFRX_I2C_SNIFF_SDA 11
+#define PI_WFRX_I2C_SNIFF_SCL 12
 
 #define PI_WF_MICROS   1
 
@@ -794,10 +812,44 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 
 #define DEFAULT_PWM_IDX 5
 
-#define MAX_EMITS (PIPE_BUF / sizeof(gpioReport_t))
+/* reports queued per notification for the writer thread, a power of 2 */
+#define NOTIFY_QUEUE_LEN 2048
+
+/* bytes of encoded reports buffered per v2 notification */
+#define NOTIFY_V2_BUF 4096
+
+/* callbacks queued per callback worker, a power of 2 */
+#define CB_QUEUE_LEN 4096
+
+/* samples callbacks queued, each slot holds MAX_REPORT samples, a power of 2 */
+#define CB_SAMPLE_SLOTS 64
+
+#define CB_ALERT   0
+#define CB_EVENT   1
+#define CB_SAMPLES 2
 
 #define SRX_BUF_SIZE 8192
 
+/* decoded frames buffered per decoder GPIO */
+#define DRX_BUF_FRAMES 256
+
+/* a Wiegand frame ends when no bit arrives for this long */
+#define WIEGAND_TIMEOUT 25 /* milliseconds */
+
+#define DRX_IDLE   0
+#define DRX_LEADER 1
+#define DRX_DATA   2
+#define DRX_MID    3
+#define DRX_EDGE   4
+
+#define MAX_RINGS 16
+
+/* how long a ring thread spins for the next request before parking */
+#define RING_SPIN_MICROS 200
+
+/* parked ring waits are bounded so a closed ring is always noticed */
+#define RING_PARK_NANOS 100000000
+
 #define PI_I2C_RETRIES 0x0701
 #define PI_I2C_TIMEOUT 0x0702
 #define PI_I2C_SLAVE   0x0703
@@ -895,6 +947,10 @@ Assumes two counters per block.  Each counter 4 * 16 (16^4=65536)
 
 /* typedef ------------------------------------------------------- */
 
+/* the alert and wave build loops, shared with the EXAMPLES/C benchmarks */
+
+#include "pigpio_kernels.h"
+
 typedef void (*callbk_t) ();
 
 typedef struct
@@ -936,25 +992,6 @@ typedef struct
    callbk_t func;
    unsigned ex;
    void *userdata;
-
-   int      wdSteadyUs;
-   uint32_t wdTick;
-   uint32_t wdLBitV;
-
-   int      nfSteadyUs;
-   int      nfActiveUs;
-   int      nfActive;
-   uint32_t nfTick1;
-   uint32_t nfTick2;
-   uint32_t nfLBitV;
-   uint32_t nfRBitV;
-
-   uint32_t gfSteadyUs;
-   uint8_t  gfInitialised;
-   uint32_t gfTick;
-   uint32_t gfLBitV;
-   uint32_t gfRBitV;
-
 } gpioAlert_t;
 
 typedef struct
@@ -994,15 +1031,90 @@ typedef struct
    uint32_t bits;
 } gpioGetSamples_t;
 
+typedef struct
+{
+   uint32_t window;    /* micros */
+   uint32_t start;     /* tick the current window started */
+   uint32_t edgeTick;  /* tick of the last edge */
+   uint32_t firstRise; /* in the current window */
+   uint32_t lastRise;
+   uint32_t rises;
+   uint32_t falls;
+   uint32_t high;      /* micros high in the current window */
+   int      level;
+   gpioMeter_t result; /* the last complete window */
+} meterInfo_t;
+
+typedef struct
+{
+   int      state;     /* PI_ENCODER_CLOSED or PI_ENCODER_OPENED */
+   unsigned gpioA;
+   unsigned gpioB;
+   unsigned gpioI;     /* PI_ENCODER_NO_INDEX if none */
+   int      levels;    /* (A<<1) | B */
+   int      levelI;
+   uint32_t start;     /* tick the encoder was opened */
+   uint32_t velTick;   /* start of the velocity window */
+   int32_t  velPosition;
+   unsigned event;
+   uint32_t eventMicros; /* 0 if no event */
+   uint32_t eventTick;
+   int32_t  eventPosition;
+   int      sock;      /* socket which opened it, -1 if none */
+   gpioEncoder_t enc;
+} encoderInfo_t;
+
+typedef struct
+{
+   gpioSample_t *buf;  /* pre ring, then the trigger and post samples */
+   unsigned pre;       /* size of the pre ring */
+   unsigned post;
+   unsigned mode;      /* PI_CAPTURE_NOW etc. */
+   uint32_t bits;
+   uint32_t trigBits;
+   uint32_t trigLevels;
+   uint32_t level;     /* bits and trigBits levels at the last sample */
+   uint32_t start;     /* tick the capture was started */
+   unsigned preHead;   /* next pre ring slot */
+   unsigned preCount;  /* samples in the pre ring */
+   unsigned postCount; /* trigger and post samples */
+   uint32_t laps;      /* gpioStats.dmaLaps at the start */
+   gpioCapture_t status;
+} captureInfo_t;
+
+typedef struct
+{
+   uint8_t  type;   /* CB_ALERT, CB_EVENT, or CB_SAMPLES */
+   uint8_t  gpio;   /* GPIO or event */
+   uint8_t  level;  /* 0, 1, or PI_TIMEOUT */
+   uint32_t tick;
+   uint32_t queued; /* when queued, for the latency */
+   gpioSample_t *samples; /* cbSamples slot, released by the worker */
+   int numSamples;
+} cbJob_t;
+
+typedef struct
+{
+   uint32_t head;    /* jobs queued, by the alert thread */
+   uint32_t waiting; /* worker parked on head            */
+   uint32_t tail;    /* jobs run, by the worker          */
+   cbJob_t  job[CB_QUEUE_LEN];
+} cbQueue_t;
+
 typedef struct
 {
    callbk_t func;
    unsigned ex;
    void *userdata;
    unsigned id;
-   unsigned running;
-   unsigned millis;
-   pthread_t pthId;
+   unsigned micros;      /* period */
+   unsigned busy;        /* queued or running */
+   unsigned running;     /* in the function */
+   pthread_t runner;     /* thread in the function */
+   uint64_t due;         /* next due time, CLOCK_MONOTONIC nanos */
+   uint64_t queued;      /* due time of the call queued or running */
+   uint64_t totalJitter; /* nanos */
+   gpioTimerStats_t stats;
 } gpioTimer_t;
 
 typedef struct
@@ -1034,11 +1146,40 @@ typedef struct
    uint32_t bits;
    uint32_t eventBits;
    uint32_t lastReportTick;
+   int      gapPending; /* samples lost, not yet reported (e.g. paused) */
+   uint32_t gapTick;
    int      fd;
    int      pipe;
-   int      max_emits;
+   int      failed;
+   uint32_t qHead;   /* reports queued, by the alert thread */
+   uint32_t qTail;   /* reports written, by the writer thread */
+   uint32_t qOffset; /* bytes of the tail report written */
+   uint32_t qDrops;  /* reports dropped as the queue was full */
+   unsigned format;  /* PI_NOTIFY_FORMAT_V1/V2 */
+   cmdNotifyCodec_t codec;
+   uint32_t v2Len;    /* bytes of encoded reports buffered */
+   uint32_t v2Offset; /* bytes of those already written */
+   gpioNotifyRing_t *ring;
+   uint32_t ringSize;
 } gpioNotify_t;
 
+typedef struct
+{
+   int        state;
+   int        sock;
+   int        closing;
+   cmdRing_t *ring;
+   pthread_t  pthId;
+} gpioRing_t;
+
+typedef struct
+{
+   int       sock;
+   unsigned  got;      /* bytes of the current command received */
+   uint32_t  hdr[4];   /* cmd, p1, p2, p3 of the current command */
+   char     *ext;      /* extension, allocated on first use */
+} sockConn_t;
+
 typedef struct
 {
    uint16_t state;
@@ -1078,7 +1219,7 @@ typedef struct
    uint32_t cbTicks;
    uint32_t cbCalls;
    uint32_t maxEmit;
-   uint32_t emitFrags;
+   uint32_t notifyDrops;
    uint32_t maxSamples;
    uint32_t numSamples;
    uint32_t DMARestarts;
@@ -1086,6 +1227,17 @@ typedef struct
    uint32_t goodPipeWrite;
    uint32_t shortPipeWrite;
    uint32_t wouldBlockPipeWrite;
+   uint32_t ringOverruns;
+   uint32_t dmaLaps;       /* DMA overwrote unread samples */
+   uint32_t lostCycles;
+   uint32_t alertPasses;
+   uint64_t alertPassMicros;
+   uint64_t alertPassSamples;
+   uint32_t cbRun;         /* alert, event and samples callbacks */
+   uint32_t cbDropped;
+   uint32_t cbMaxLatency;
+   uint32_t cbMaxDuration;
+   uint64_t cbTotalLatency;
 } gpioStats_t;
 
 typedef struct
@@ -1105,40 +1257,13 @@ typedef struct
       0-3: dbgLevel
       4-7: alertFreq
       */
+   unsigned socketWorkers;
+   unsigned callbackWorkers;
+   unsigned alertPollMin;
+   unsigned alertPollMax;
+   unsigned timerWorkers;
 } gpioCfg_t;
 
-typedef struct
-{
-   uint32_t micros;
-   uint32_t highMicros;
-   uint32_t maxMicros;
-   uint32_t pulses;
-   uint32_t highPulses;
-   uint32_t maxPulses;
-   uint32_t cbs;
-   uint32_t highCbs;
-   uint32_t maxCbs;
-} wfStats_t;
-
-typedef struct
-{
-   char    *buf;
-   uint32_t bufSize;
-   int      readPos;
-   int      writePos;
-   uint32_t fullBit; /* nanoseconds */
-   uint32_t halfBit; /* nanoseconds */
-   int      timeout; /* millisconds */
-   uint32_t startBitTick; /* microseconds */
-   uint32_t nextBitDiff; /* nanoseconds */
-   int      bit;
-   uint32_t data;
-   int      bytes; /* 1, 2, 4 */
-   int      level;
-   int      dataBits; /* 1-32 */
-   int      invert; /* 0, 1 */
-} wfRxSerial_t;
-
 typedef struct
 {
    int SDA;
@@ -1164,6 +1289,25 @@ typedef struct
    int SCLKMode;
 } wfRxSPI_t;
 
+typedef struct
+{
+   gpioFrame_t *buf;
+   int      bufSize; /* frames */
+   int      readPos;
+   int      writePos;
+   int      protocol; /* PI_DECODE_* */
+   int      other; /* Wiegand, the other data GPIO */
+   int      state; /* DRX_* */
+   int      bits;
+   uint64_t data;
+   uint32_t startTick; /* microseconds */
+   uint32_t edgeTick; /* microseconds */
+   uint32_t lastCode; /* NEC, repeated by a repeat frame */
+   uint32_t lastTick; /* NEC, when lastCode was received */
+   int      lastValid; /* NEC, lastCode may be repeated */
+   int      levels; /* I2C sniffer, last SCL (bit 1) and SDA (bit 0) */
+} wfRxDecode_t;
+
 typedef struct
 {
    int      mode;
@@ -1175,6 +1319,7 @@ typedef struct
       wfRxSerial_t s;
       wfRxI2C_t    I;
       wfRxSPI_t    S;
+      wfRxDecode_t D;
    };
 } wfRx_t;
 
@@ -1214,6 +1359,46 @@ typedef struct
    unsigned  size;          /* in bytes */
 } DMAMem_t;
 
+typedef struct
+{
+   int start;
+   int count;
+} waveExtent_t;
+
+typedef struct
+{
+   int base;   /* first slot of the region */
+   int num;    /* free extents, in address order */
+   waveExtent_t ext[(2*PI_MAX_WAVES)+2]; /* waves, a stream, one more */
+} waveFree_t;
+
+typedef struct
+{
+   uint64_t   hash;   /* of the pulses the wave was created from */
+   uint32_t   refs;   /* creates not yet matched by a delete */
+   int        numPulses;
+   rawWave_t *pulses; /* a copy of the pulses if the wave may be shared */
+} waveCache_t;
+
+typedef struct
+{
+   int      open;
+   int      running;   /* the DMA was started on the stream */
+   unsigned segs;
+   unsigned segPulses;
+   int      segCBs;    /* CBs per segment */
+   int      segOOLs;   /* OOL per segment */
+   int      botCB;     /* first CB of segment 0 */
+   int      botOOL;    /* the played count, then the segments' OOL */
+   int      tailCB;    /* the last CB of the last segment written */
+   uint32_t written;   /* segments written */
+   uint32_t underruns;
+   unsigned event;
+   unsigned lowWater;
+   int      eventOn;
+   int      low;       /* queued segments are at or below lowWater */
+} waveStream_t;
+
 /* global -------------------------------------------------------- */
 
 /* initialise once then preserve */
@@ -1240,8 +1425,13 @@ static uint32_t sockNetAddr[MAX_CONNECT_ADDRESSES];
 
 static int numSockNetAddr = 0;
 
+static char sockUnixPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
 static uint32_t reportedLevel = 0;
 
+static int      alertGapPending = 0; /* samples lost, see pthAlertThread */
+static uint32_t alertGapTick    = 0;
+
 static int waveClockInited = 0;
 static int PWMClockInited = 0;
 
@@ -1253,26 +1443,20 @@ static int gpioMaskSet = 0;
 
 static uint64_t gpioMask;
 
-static rawWave_t wf[3][PI_WAVE_MAX_PULSES];
-
-static int wfc[3]={0, 0, 0};
+static rawWaveInfo_t waveInfo[PI_MAX_WAVES];
 
-static int wfcur=0;
+static wfRx_t wfRx[PI_MAX_USER_GPIO+1];
 
-static wfStats_t wfStats=
-{
-   0, 0, PI_WAVE_MAX_MICROS,
-   0, 0, PI_WAVE_MAX_PULSES,
-   0, 0, (DMAO_PAGES * CBS_PER_OPAGE)
-};
+static waveFree_t waveFreeCB;
+static waveFree_t waveFreeOOL;
 
-static rawWaveInfo_t waveInfo[PI_MAX_WAVES];
+static waveCache_t waveCache[PI_MAX_WAVES];
+static uint32_t waveCacheHits = 0;
+static uint32_t waveCacheMisses = 0;
 
-static wfRx_t wfRx[PI_MAX_USER_GPIO+1];
+static waveStream_t waveStream;
 
-static int waveOutBotCB  = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
-static int waveOutBotOOL = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
-static int waveOutTopOOL = NUM_WAVE_OOL;
+static pthread_mutex_t waveStreamMutex = PTHREAD_MUTEX_INITIALIZER;
 static int waveOutCount = 0;
 
 static uint32_t *waveEndPtr = NULL;
@@ -1284,6 +1468,35 @@ static volatile uint32_t scriptBits  = 0;
 static volatile uint32_t gFilterBits = 0;
 static volatile uint32_t nFilterBits = 0;
 static volatile uint32_t wdogBits    = 0;
+static volatile uint32_t wdogRescan  = 0; /* gpioSetWatchdog changed one */
+static uint32_t          wdogNext    = 0; /* earliest watchdog deadline */
+static uint32_t          wdogLevel   = 0; /* last levels of watched GPIO */
+static volatile uint32_t meterBits   = 0;
+
+static meterInfo_t meterInfo[PI_MAX_USER_GPIO+1];
+
+static pthread_mutex_t meterMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint32_t encoderBits = 0;
+
+static encoderInfo_t encoderInfo[PI_MAX_ENCODERS];
+
+static pthread_mutex_t encoderMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint32_t sniffBits = 0;
+
+static pthread_mutex_t sniffMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint32_t serialBits  = 0;
+static uint32_t          serialLevel = 0;
+
+static pthread_mutex_t serialMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint32_t captureBits = 0;
+
+static captureInfo_t captureInfo;
+
+static pthread_mutex_t captureMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static volatile uint32_t scriptEventBits  = 0;
 
@@ -1292,8 +1505,16 @@ static volatile int runState = PI_STARTING;
 static int pthAlertRunning  = PI_THREAD_NONE;
 static int pthFifoRunning   = PI_THREAD_NONE;
 static int pthSocketRunning = PI_THREAD_NONE;
+static int pthUnixSocketRunning = PI_THREAD_NONE;
+static int pthNotifyWriterRunning = PI_THREAD_NONE;
+static int pthSocketWorkersRunning = 0;
+static int pthCallbackWorkersRunning = 0;
+static int pthTimerRunning = PI_THREAD_NONE;
+static int pthTimerWorkersRunning = 0;
 
 static gpioAlert_t      gpioAlert  [PI_MAX_USER_GPIO+1];
+static alertFilter_t    gpioFilter [PI_MAX_USER_GPIO+1];
+static alertWdog_t      gpioWdog   [PI_MAX_USER_GPIO+1];
 
 static eventAlert_t     eventAlert [PI_MAX_EVENT+1];
 
@@ -1305,6 +1526,14 @@ static gpioInfo_t       gpioInfo   [PI_MAX_GPIO+1];
 
 static gpioNotify_t     gpioNotify [PI_NOTIFY_SLOTS];
 
+static gpioReport_t     notifyQueue[PI_NOTIFY_SLOTS][NOTIFY_QUEUE_LEN];
+
+static char             notifyV2Buf[PI_NOTIFY_SLOTS][NOTIFY_V2_BUF];
+
+static int notifyWriterWaiting = 0;
+
+static gpioRing_t       gpioRing   [MAX_RINGS];
+
 static fileInfo_t       fileInfo   [PI_FILE_SLOTS];
 static i2cInfo_t        i2cInfo    [PI_I2C_SLOTS];
 static serInfo_t        serInfo    [PI_SER_SLOTS];
@@ -1328,6 +1557,9 @@ static FILE * outFifo = NULL;
 static int fdLock       = -1;
 static int fdMem        = -1;
 static int fdSock       = -1;
+static int fdUnixSock   = -1;
+static int fdEpoll      = -1;
+static int fdNotifyWake = -1;
 static int fdPmap       = -1;
 static int fdMbox       = -1;
 
@@ -1374,6 +1606,11 @@ static volatile gpioCfg_t gpioCfg =
    0, /* dbgLevel */
    0, /* alertFreq */
    0, /* internals */
+   PI_DEFAULT_SOCKET_WORKERS,
+   PI_DEFAULT_CALLBACK_WORKERS,
+   0, /* alertPollMin */
+   0, /* alertPollMax, 0 for alertFreq */
+   PI_DEFAULT_TIMER_WORKERS,
 };
 
 /* no initialisation required */
@@ -1384,6 +1621,32 @@ static unsigned bufferCycles; /* number of cycles */
 static pthread_t pthAlert;
 static pthread_t pthFifo;
 static pthread_t pthSocket;
+static pthread_t pthUnixSocket;
+static pthread_t pthNotifyWriter;
+static pthread_t pthSocketWorker[PI_MAX_SOCKET_WORKERS];
+static pthread_t pthCallbackWorker[PI_MAX_CALLBACK_WORKERS];
+static pthread_t pthTimer;
+static pthread_t pthTimerWorker[PI_MAX_TIMER_WORKERS];
+
+/* timerMutex guards gpioTimer and the timer queue */
+
+static pthread_mutex_t timerMutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  timerCond;    /* timing thread, CLOCK_MONOTONIC */
+static pthread_cond_t  timerWorkCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  timerIdleCond = PTHREAD_COND_INITIALIZER;
+
+static int timerQueue[PI_MAX_TIMER+1];
+static int timerQueueHead;
+static int timerQueueLen;
+static int timerStop;
+
+static cbQueue_t *cbQueue = NULL;
+
+/* samples callbacks all run on worker 0 so their slots are freed in order */
+
+static gpioSample_t *cbSamples = NULL;
+static uint32_t cbSamplesHead = 0; /* slots used, by the alert thread */
+static uint32_t cbSamplesTail = 0; /* slots released, by worker 0 */
 
 static uint32_t spi_dummy;
 
@@ -1504,17 +1767,30 @@ static void intScriptBits(void);
 
 static void intScriptEventBits(void);
 
-static int  gpioNotifyOpenInBand(int fd);
+static int  gpioNotifyOpenInBand(int fd, unsigned format);
+
+static void ringWake(uint32_t *addr);
+
+static void ringPark(uint32_t *addr, uint32_t val);
 
 static void initHWClk
    (int clkCtl, int clkDiv, int clkSrc, int divI, int divF, int MASH);
 
 static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr);
 
+static void initKillDMA(volatile uint32_t *dmaAddr);
+
 int gpioWaveTxStart(unsigned wave_mode); /* deprecated */
 
 static void closeOrphanedNotifications(int slot, int fd);
 
+static int intEncoderOpen(
+   unsigned gpioA, unsigned gpioB, unsigned gpioIndex, int sock);
+
+static void closeOrphanedEncoders(int sock);
+
+static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf);
+
 
 /* ======================================================================= */
 
@@ -1861,6 +2137,80 @@ static void spinWhileStarting(void)
 
 /* ----------------------------------------------------------------------- */
 
+static int myDoBatch(uintptr_t *p, unsigned bufSize, char *buf)
+{
+   int res, count;
+   unsigned pos, len;
+   char saved;
+   cmdCmd_t cmd;
+   uintptr_t q[10];
+
+   /*
+      The extension holds a series of cmdCmd_t records, each
+      followed by its own ext_len bytes of extension.
+
+      The commands are executed in order and the result of
+      command n is written to buf[4*n].  Command n starts at
+      or beyond buf[16*n] so the results never overwrite a
+      command which has yet to be executed.
+   */
+
+   if (p[3] > PI_MAX_BATCH_LEN) return PI_BAD_BATCH_LEN;
+
+   pos = 0;
+   count = 0;
+
+   while (pos < p[3])
+   {
+      if ((p[3] - pos) < sizeof(cmdCmd_t)) return PI_BAD_BATCH_LEN;
+
+      memcpy(&cmd, buf+pos, sizeof(cmdCmd_t));
+
+      pos += sizeof(cmdCmd_t);
+
+      len = cmd.ext_len;
+
+      if (len > (p[3] - pos)) return PI_BAD_BATCH_LEN;
+
+      if (cmdReturnsExt(cmd.cmd) ||
+          (cmd.cmd == PI_CMD_NOIB) || (cmd.cmd == PI_CMD_NOIBF))
+      {
+         /* commands which nest, need the socket or return extensions */
+
+         res = PI_BAD_BATCH_CMD;
+      }
+      else
+      {
+         q[0] = cmd.cmd;
+         q[1] = cmd.p1;
+         q[2] = cmd.p2;
+         q[3] = len;
+
+         /* null terminate the extension in case it's a string */
+
+         saved = buf[pos+len];
+         buf[pos+len] = 0;
+
+         res = myDoCommand(q, len, buf+pos);
+
+         buf[pos+len] = saved;
+      }
+
+      DBG(DBG_USER, "batch %d: cmd=%d p1=%d p2=%d len=%d res=%d",
+         count, cmd.cmd, cmd.p1, cmd.p2, len, res);
+
+      memcpy(buf+(4*count), &res, 4);
+
+      pos += len;
+
+      count++;
+   }
+
+   return 4 * count;
+}
+
+/* ----------------------------------------------------------------------- */
+
 static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 {
    int res, i, j;
@@ -1873,6 +2223,10 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
    switch (p[0])
    {
+      case PI_CMD_BATCH:
+         res = myDoBatch(p, bufSize, buf);
+         break;
+
       case PI_CMD_BC1:
          mask = gpioMask;
 
@@ -2014,6 +2368,30 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
          }
          break;
 
+      case PI_CMD_CAPC: res = gpioCaptureStop(); break;
+
+      case PI_CMD_CAPG:
+         res = gpioCaptureStatus((gpioCapture_t *)buf);
+         if (res == 0) res = sizeof(gpioCapture_t);
+         break;
+
+      case PI_CMD_CAPR:
+         if (p[2] > (bufSize / sizeof(gpioSample_t)))
+            p[2] = bufSize / sizeof(gpioSample_t);
+         res = gpioCaptureRead(p[1], (gpioSample_t *)buf, p[2]);
+         if (res > 0) res *= sizeof(gpioSample_t);
+         break;
+
+      case PI_CMD_CAPS:
+         memcpy(&tmp1, buf+ 0, 4); // trigBits
+         memcpy(&tmp2, buf+ 4, 4); // trigLevels
+         memcpy(&tmp3, buf+ 8, 4); // preSamples
+         memcpy(&tmp4, buf+12, 4); // postSamples
+         res = gpioCaptureStart(p[1], p[2], tmp1, tmp2, tmp3, tmp4);
+         break;
+
+      case PI_CMD_CAPW: res = gpioCaptureSave(buf); break;
+
       case PI_CMD_CF1:
          res = gpioCustom1(p[1], p[2], buf, p[3]);
          break;
@@ -2029,6 +2407,32 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_CSI: res = gpioCfgSetInternals(p[1]); break;
 
+      case PI_CMD_DCDC: res = gpioDecodeReadClose(p[1]); break;
+
+      case PI_CMD_DCDR:
+         if (p[2] > (bufSize / sizeof(gpioFrame_t)))
+            p[2] = bufSize / sizeof(gpioFrame_t);
+         res = gpioDecodeRead(p[1], (gpioFrame_t *)buf, p[2]);
+         if (res > 0) res *= sizeof(gpioFrame_t);
+         break;
+
+      case PI_CMD_ENCC: res = gpioEncoderClose(p[1]); break;
+
+      case PI_CMD_ENCE:
+         memcpy(&p[4], buf, 4);
+         res = gpioEncoderSetEvent(p[1], p[2], p[4]);
+         break;
+
+      case PI_CMD_ENCG:
+         res = gpioEncoderGet(p[1], (gpioEncoder_t *)buf);
+         if (res == 0) res = sizeof(gpioEncoder_t);
+         break;
+
+      case PI_CMD_ENCO:
+         memcpy(&p[4], buf, 4);
+         res = gpioEncoderOpen(p[1], p[2], p[4]);
+         break;
+
       case PI_CMD_EVM: res = eventMonitor(p[1], p[2]); break;
 
       case PI_CMD_EVT: res = eventTrigger(p[1]); break;
@@ -2097,6 +2501,8 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_HWVER: res = gpioHardwareRevision(); break;
 
+      case PI_CMD_IRRO: res = gpioIRReadOpen(p[1], p[2]); break;
+
 
 
       case PI_CMD_I2CC: res = i2cClose(p[1]); break;
@@ -2193,12 +2599,27 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
          }
          break;
 
+      case PI_CMD_MTRG:
+         res = gpioGetMeter(p[1], (gpioMeter_t *)buf);
+         if (res == 0) res = sizeof(gpioMeter_t);
+         break;
+
+      case PI_CMD_MTRS: res = gpioSetMeter(p[1], p[2]); break;
+
       case PI_CMD_NB: res = gpioNotifyBegin(p[1], p[2]); break;
 
       case PI_CMD_NC: res = gpioNotifyClose(p[1]); break;
 
       case PI_CMD_NO: res = gpioNotifyOpen();  break;
 
+      case PI_CMD_NOF: res = gpioNotifyOpenWithFormat(p[1]); break;
+
+      case PI_CMD_NOR: res = gpioNotifyOpenShared(p[1]); break;
+
+      case PI_CMD_NQD: res = gpioNotifyGetDropped(p[1]); break;
+
+      case PI_CMD_NQL: res = gpioNotifyGetQueued(p[1]); break;
+
       case PI_CMD_NP: res = gpioNotifyPause(p[1]); break;
 
       case PI_CMD_PADG: res = gpioGetPad(p[1]); break;
@@ -2316,12 +2737,16 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_SLRC: res = gpioSerialReadClose(p[1]); break;
 
+      case PI_CMD_SLRE: res = gpioSerialReadErrors(p[1]); break;
+
       case PI_CMD_SLRO:
          memcpy(&p[4], buf, 4);
          res = gpioSerialReadOpen(p[1], p[2], p[4]); break;
 
       case PI_CMD_SLRI: res = gpioSerialReadInvert(p[1], p[2]); break;
 
+      case PI_CMD_SNIFF: res = gpioI2CSniffOpen(p[1], p[2]); break;
+
       case PI_CMD_SPIC:
          res = spiClose(p[1]);
          break;
@@ -2364,6 +2789,8 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_WDOG: res = gpioSetWatchdog(p[1], p[2]); break;
 
+      case PI_CMD_WGRO: res = gpioWiegandReadOpen(p[1], p[2]); break;
+
       case PI_CMD_WRITE:
          if (myPermit(p[1])) res = gpioWrite(p[1], p[2]);
          else
@@ -2376,6 +2803,7 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
 
       case PI_CMD_WVAG:
+      case PI_CMD_WVSWR:
 
          /* need to mask off any non permitted gpios */
 
@@ -2403,7 +2831,8 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
                pulse[i].gpioOn, pulse[i].gpioOff, pulse[i].usDelay);
          }
 
-         res = gpioWaveAddGeneric(j, pulse);
+         if (p[0] == PI_CMD_WVAG) res = gpioWaveAddGeneric(j, pulse);
+         else                     res = gpioWaveStreamWrite(j, pulse);
 
          /* report permission error unless another error occurred */
          if (masked && (res >= 0)) res = PI_SOME_PERMITTED;
@@ -2440,6 +2869,8 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_WVCRE: res = gpioWaveCreate(); break;
 
+      case PI_CMD_WVCRS: res = gpioWaveCreateShared(); break;
+
       case PI_CMD_WVCAP:
          /* Make WVCAP variadic */
          if (p[3] == 4)
@@ -2463,6 +2894,27 @@ static int myDoCommand(uintptr_t *p, unsigned bufSize, char *buf)
 
       case PI_CMD_WVDEL: res = gpioWaveDelete(p[1]); break;
 
+      case PI_CMD_WVFRG:
+         res = gpioWaveFragmentation((gpioWaveFrag_t *)buf);
+         if (res == 0) res = sizeof(gpioWaveFrag_t);
+         break;
+
+      case PI_CMD_WVCST:
+         res = gpioWaveGetCacheStats((gpioWaveCacheStats_t *)buf);
+         if (res == 0) res = sizeof(gpioWaveCacheStats_t);
+         break;
+
+      case PI_CMD_WVSCL: res = gpioWaveStreamClose(); break;
+
+      case PI_CMD_WVSEV: res = gpioWaveStreamSetEvent(p[1], p[2]); break;
+
+      case PI_CMD_WVSOP: res = gpioWaveStreamOpen(p[1], p[2]); break;
+
+      case PI_CMD_WVSST:
+         res = gpioWaveStreamStatus((gpioWaveStream_t *)buf);
+         if (res == 0) res = sizeof(gpioWaveStream_t);
+         break;
+
       case PI_CMD_WVGO:  res = gpioWaveTxStart(PI_WAVE_MODE_ONE_SHOT); break;
 
       case PI_CMD_WVGOR: res = gpioWaveTxStart(PI_WAVE_MODE_REPEAT); break;
@@ -2985,770 +3437,868 @@ static int waveDelayCBs(uint32_t delay)
 
 /* ----------------------------------------------------------------------- */
 
-static void waveCBsOOLs(int *numCBs, int *numBOOLs, int *numTOOLs)
+static void waveSpaceReset(void)
 {
-   int numCB=0, numBOOL=0, numTOOL=0;
-
-   unsigned i;
-
-   unsigned numWaves;
+   int i;
 
-   rawWave_t *waves;
+   /* any stream's segments are in the space being reset */
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+   pthread_mutex_lock(&waveStreamMutex);
 
-   /* delay cb at start of DMA */
+   memset(&waveStream, 0, sizeof(waveStream));
 
-   numCB++;
+   pthread_mutex_unlock(&waveStreamMutex);
 
-   for (i=0; i<numWaves; i++)
+   for (i=0; i<PI_MAX_WAVES; i++)
    {
-      if (waves[i].gpioOn)                 {numBOOL++;}
-      if (waves[i].gpioOff)                {numBOOL++;}
-      if (waves[i].gpioOn || waves[i].gpioOff) {numCB++;}
-      if (waves[i].flags & WAVE_FLAG_READ) {numCB++; numTOOL++;}
-      if (waves[i].flags & WAVE_FLAG_TICK) {numCB++; numTOOL++;}
+      free(waveCache[i].pulses);
 
-      numCB += waveDelayCBs(waves[i].usDelay);
+      waveCache[i].pulses = NULL;
+      waveCache[i].refs = 0;
    }
 
-   *numCBs   = numCB;
-   *numBOOLs = numBOOL;
-   *numTOOLs = numTOOL;
-}
-
-/* ----------------------------------------------------------------------- */
+   /* the pages before the wave area are used by the wave count code */
 
-static int wave2Cbs(unsigned wave_mode, int *CB, int *BOOL, int *TOOL,
-                    int numCB, int numBOOL, int numTOOL)
-{
-   int botCB=*CB, botOOL=*BOOL, topOOL=*TOOL;
+   waveFreeCB.base = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
+   waveFreeCB.num  = 1;
+   waveFreeCB.ext[0].start = waveFreeCB.base;
+   waveFreeCB.ext[0].count = NUM_WAVE_CBS - waveFreeCB.base;
 
-   int status, s_stride;
+   waveFreeOOL.base = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
+   waveFreeOOL.num  = 1;
+   waveFreeOOL.ext[0].start = waveFreeOOL.base;
+   waveFreeOOL.ext[0].count = NUM_WAVE_OOL - waveFreeOOL.base;
 
-   rawCbs_t *p=NULL;
+   waveOutCount = 0;
+}
 
-   unsigned i, repeatCB;
+static int waveExtentAlloc(waveFree_t *f, int count)
+{
+   int i, best, start;
 
-   unsigned numWaves;
+   if (count == 0) return f->base;
 
-   unsigned delayCBs, dcb;
+   /* best fit, the lowest extent of the smallest size which fits */
 
-   uint32_t delayLeft;
+   best = -1;
 
-   rawWave_t * waves;
+   for (i=0; i<f->num; i++)
+   {
+      if ((f->ext[i].count >= count) &&
+          ((best < 0) || (f->ext[i].count < f->ext[best].count)))
+      {
+         best = i;
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+         if (f->ext[i].count == count) break;
+      }
+   }
 
-   /* add delay cb at start of DMA */
+   if (best < 0) return -1;
 
-   p = rawWaveCBAdr(botCB++);
+   start = f->ext[best].start;
 
-   /* use the secondary clock */
+   f->ext[best].start += count;
+   f->ext[best].count -= count;
 
-   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+   if (f->ext[best].count == 0)
    {
-      p->info = NORMAL_DMA | TIMED_DMA(2);
-      p->dst  = PCM_TIMER;
-   }
-   else
-   {
-      p->info = NORMAL_DMA | TIMED_DMA(5);
-      p->dst  = PWM_TIMER;
+      f->num--;
+
+      memmove(f->ext+best, f->ext+best+1,
+         (f->num-best) * sizeof(waveExtent_t));
    }
 
-   //cast twice to suppress compiler warning, I belive this cast is ok
-   //because dmaOBus contains bus addresses, not virtual addresses.
-   p->src    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-   p->length = BPD * 20 / PI_WF_MICROS; /* 20 micros delay */
-   p->next   = waveCbPOadr(botCB);
+   return start;
+}
 
-   repeatCB = botCB;
+static void waveExtentFree(waveFree_t *f, int start, int count)
+{
+   int i, prev, next;
 
-   for (i=0; i<numWaves; i++)
-   {
-      if (waves[i].gpioOn && waves[i].gpioOff)
-      /* Use 2-beat burst */
-      {
-         p = rawWaveCBAdr(botCB++);
+   if (count == 0) return;
 
-         p->info   = TWO_BEAT_DMA;
-         p->src    = waveOOLPOadr(botOOL);
-         waveSetOOL(botOOL++, waves[i].gpioOn);
-         s_stride = waveOOLPOadr(botOOL) - p->src;
-         waveSetOOL(botOOL++, waves[i].gpioOff);
-         p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->length = (2<<16) + 4;         // 2 transfers of 4 bytes each
-         p->stride = (12<<16) + s_stride; // d_stride = (GPCLR0-GPSET0)*4 = 12
-         p->next   = waveCbPOadr(botCB);
-      }
-      if (waves[i].gpioOn && !waves[i].gpioOff)
-      {
-         waveSetOOL(botOOL, waves[i].gpioOn);
+   /* the first free extent above the one being freed */
 
-         p = rawWaveCBAdr(botCB++);
+   for (i=0; i<f->num; i++) if (f->ext[i].start > start) break;
 
-         p->info   = NORMAL_DMA;
-         p->src    = waveOOLPOadr(botOOL++);
-         p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
-      if (waves[i].gpioOff && !waves[i].gpioOn)
-      {
-         waveSetOOL(botOOL, waves[i].gpioOff);
-
-         p = rawWaveCBAdr(botCB++);
-
-         p->info   = NORMAL_DMA;
-         p->src    = waveOOLPOadr(botOOL++);
-         p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
-      if (waves[i].flags & WAVE_FLAG_READ)
-      {
-         p = rawWaveCBAdr(botCB++);
-
-         p->info   = NORMAL_DMA;
-         p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->dst    = waveOOLPOadr(--topOOL);
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
+   prev = (i > 0) && ((f->ext[i-1].start + f->ext[i-1].count) == start);
+   next = (i < f->num) && ((start + count) == f->ext[i].start);
 
-      if (waves[i].flags & WAVE_FLAG_TICK)
-      {
-         p = rawWaveCBAdr(botCB++);
+   if (prev && next)
+   {
+      f->ext[i-1].count += count + f->ext[i].count;
 
-         p->info   = NORMAL_DMA;
-         p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
-         p->dst    = waveOOLPOadr(--topOOL);
-         p->length = 4;
-         p->next   = waveCbPOadr(botCB);
-      }
+      f->num--;
 
-      if (waves[i].usDelay)
-      {
-         delayLeft = waves[i].usDelay;
+      memmove(f->ext+i, f->ext+i+1, (f->num-i) * sizeof(waveExtent_t));
+   }
+   else if (prev)
+   {
+      f->ext[i-1].count += count;
+   }
+   else if (next)
+   {
+      f->ext[i].start  = start;
+      f->ext[i].count += count;
+   }
+   else
+   {
+      memmove(f->ext+i+1, f->ext+i, (f->num-i) * sizeof(waveExtent_t));
 
-         delayCBs = waveDelayCBs(delayLeft);
+      f->ext[i].start = start;
+      f->ext[i].count = count;
 
-         for (dcb=0; dcb<delayCBs; dcb++)
-         {
-            p = rawWaveCBAdr(botCB++);
+      f->num++;
+   }
+}
 
-            /* use the secondary clock */
+static int waveAllocate(int numCB, int numBOOL, int numTOOL)
+{
+   int wid, CB, BOOL, TOOL;
 
-            if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
-            {
-               p->info = NORMAL_DMA | TIMED_DMA(2);
-               p->dst  = PCM_TIMER;
-            }
-            else
-            {
-               p->info = NORMAL_DMA | TIMED_DMA(5);
-               p->dst  = PWM_TIMER;
-            }
+   /* the lowest deleted wave id, else the next one */
 
-            //cast twice to suppress compiler warning, I belive this cast is ok
-            //because dmaOBus contains bus addresses, not virtual addresses.
-            p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+   for (wid=0; wid<waveOutCount; wid++) if (waveInfo[wid].deleted) break;
 
-            p->length = BPD * delayLeft / PI_WF_MICROS;
+   if (wid >= PI_MAX_WAVES) return PI_NO_WAVEFORM_ID;
 
-            if ((gpioCfg.DMAsecondaryChannel >= DMA_LITE_FIRST) &&
-                (p->length > DMA_LITE_MAX))
-            {
-               p->length = DMA_LITE_MAX;
-            }
+   CB = waveExtentAlloc(&waveFreeCB, numCB);
 
-            delayLeft -= (p->length / BPD);
+   if (CB < 0) return PI_TOO_MANY_CBS;
 
-            p->next = waveCbPOadr(botCB);
-         }
-      }
-   }
+   BOOL = waveExtentAlloc(&waveFreeOOL, numBOOL);
 
-   if (numCB)
+   if (BOOL < 0)
    {
-      /* Pad the wave */
-
-      botCB = *CB + numCB - 1;
-      botOOL = *BOOL + numBOOL - 1;
-      topOOL = *TOOL - numTOOL;
-
-      /* Link the last CB to end of wave */
-
-      p->next = waveCbPOadr(botCB);
-
-      /* Insert sentinel CB at end of DMA */
-
-      p = rawWaveCBAdr(botCB++);
-      p->info   = NORMAL_DMA | DMA_DEST_IGNORE;
-      p->src    = waveOOLPOadr(botOOL++);
-      p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
-      p->length = 4;
-      p->next   = 0;
+      waveExtentFree(&waveFreeCB, CB, numCB);
+      return PI_TOO_MANY_OOL;
    }
 
-   if (p != NULL)
+   TOOL = waveExtentAlloc(&waveFreeOOL, numTOOL);
+
+   if (TOOL < 0)
    {
-      if (wave_mode == PI_WAVE_MODE_ONE_SHOT)
-           p->next = 0;
-      else p->next = waveCbPOadr(repeatCB);
+      waveExtentFree(&waveFreeOOL, BOOL, numBOOL);
+      waveExtentFree(&waveFreeCB, CB, numCB);
+      return PI_TOO_MANY_OOL;
    }
 
-   status = botCB - *CB;
+   waveInfo[wid].botCB   = CB;
+   waveInfo[wid].topCB   = CB + numCB - 1;
+   waveInfo[wid].botOOL  = BOOL;
+   waveInfo[wid].topOOL  = TOOL + numTOOL; /* TOOL are filled downwards */
+   waveInfo[wid].deleted = 1;
+   waveInfo[wid].numCB   = numCB;
+   waveInfo[wid].numBOOL = numBOOL;
+   waveInfo[wid].numTOOL = numTOOL;
 
-   *CB   = botCB;
-   *BOOL = botOOL;
-   *TOOL = topOOL;
+   waveCache[wid].refs = 1;
 
-   return status;
+   if (wid == waveOutCount) waveOutCount++;
+
+   return wid;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void waveRxSerial(wfRx_t *w, int level, uint32_t tick)
+static int waveCacheKey(uint64_t *hash)
 {
-   int diffTicks, lastLevel;
-   int newWritePos;
-
-   level = level ^ w->s.invert;
-
-   if (w->s.bit >= 0)
-   {
-      diffTicks = tick - w->s.startBitTick;
+   int i;
+   uint64_t h;
+   rawWave_t *w;
 
-      if (level != PI_TIMEOUT)
-      {
-         w->s.level = level;
-         lastLevel = !level;
-      }
-      else lastLevel = w->s.level;
+   /*
+   FNV-1a of the pending pulses.  A wave which reads GPIO or ticks
+   into its TOOL is never shared, each create gets its own.
+   */
 
-      while ((w->s.bit <= w->s.dataBits) &&
-             (diffTicks > (w->s.nextBitDiff/1000)))
-      {
-         if (w->s.bit)
-         {
-            if (lastLevel) w->s.data |= (1<<(w->s.bit-1));
-         }
-         else w->s.data = 0;
+   w = wf[wfcur];
 
-         ++(w->s.bit);
+   h = 0xcbf29ce484222325ULL;
 
-         w->s.nextBitDiff += w->s.fullBit;
-      }
+   for (i=0; i<wfc[wfcur]; i++)
+   {
+      if (w[i].flags) return 0;
 
-      if (w->s.bit > w->s.dataBits)
-      {
-         memcpy(w->s.buf + w->s.writePos, &w->s.data, w->s.bytes);
+      h = (h ^ w[i].gpioOn)  * 0x100000001b3ULL;
+      h = (h ^ w[i].gpioOff) * 0x100000001b3ULL;
+      h = (h ^ w[i].usDelay) * 0x100000001b3ULL;
+   }
 
-         /* don't let writePos catch readPos */
+   *hash = h;
 
-         newWritePos = (w->s.writePos + w->s.bytes) % (w->s.bufSize);
+   return 1;
+}
 
-         if (newWritePos != w->s.readPos) w->s.writePos = newWritePos;
+static int waveCacheFind(uint64_t hash)
+{
+   int wid;
 
-         if (level == 0)
-         {
-            gpioSetWatchdog(w->gpio, w->s.timeout);
-            w->s.bit          = 0;
-            w->s.startBitTick = tick;
-            w->s.nextBitDiff  = w->s.halfBit;
-         }
-         else
-         {
-            w->s.bit = -1;
-            gpioSetWatchdog(w->gpio, 0);
-         }
-      }
-   }
-   else
+   for (wid=0; wid<waveOutCount; wid++)
    {
-      /* start bit if high->low */
-
-      if (level == 0)
+      if (!waveInfo[wid].deleted &&
+          waveCache[wid].pulses &&
+          (waveCache[wid].hash == hash) &&
+          (waveCache[wid].numPulses == wfc[wfcur]) &&
+          !memcmp(waveCache[wid].pulses, wf[wfcur],
+             wfc[wfcur] * sizeof(rawWave_t)))
       {
-         gpioSetWatchdog(w->gpio, w->s.timeout);
-         w->s.level        = 0;
-         w->s.bit          = 0;
-         w->s.startBitTick = tick;
-         w->s.nextBitDiff  = w->s.halfBit;
+         return wid;
       }
    }
+
+   return -1;
 }
 
+static void waveCacheAdd(int wid, uint64_t hash)
+{
+   /* if there's no memory for the copy the wave just isn't shared */
 
-/* ----------------------------------------------------------------------- */
+   waveCache[wid].pulses = malloc(wfc[wfcur] * sizeof(rawWave_t));
 
-static void waveRxBit(int gpio, int level, uint32_t tick)
-{
-   switch (wfRx[gpio].mode)
+   if (waveCache[wid].pulses)
    {
-      case PI_WFRX_SERIAL:
-         waveRxSerial(&wfRx[gpio], level, tick);
+      memcpy(waveCache[wid].pulses, wf[wfcur], wfc[wfcur] * sizeof(rawWave_t));
+
+      waveCache[wid].hash = hash;
+      waveCache[wid].numPulses = wfc[wfcur];
    }
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int rawWaveAddGeneric(unsigned numIn1, rawWave_t *in1)
+static uint32_t waveStreamPlayed(void)
 {
-   unsigned inPos1=0, inPos2=0, outPos=0, level = NUM_WAVE_OOL;
+   int page, slot;
+
+   /* the count of segments played, written by each segment's last CB */
 
-   unsigned cbs=0;
+   waveOOLPageSlot(waveStream.botOOL, &page, &slot);
 
-   unsigned numIn2, numOut;
+   return *(volatile uint32_t *)&dmaOVirt[page]->OOL[slot];
+}
 
-   uint32_t tNow, tNext1, tNext2, tDelay, tMax;
+static void waveStreamGo(uint32_t played)
+{
+   /* start at the lead delay of the first segment not played */
 
-   rawWave_t *in2, *out;
+   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(
+      waveStream.botCB + ((played % waveStream.segs) * waveStream.segCBs)));
 
-   numIn2 = wfc[wfcur];
-   in2    = wf[wfcur];
+   waveEndPtr = NULL;
 
-   numOut = PI_WAVE_MAX_PULSES;
-   out   = wf[1-wfcur];
+   waveStream.running = 1;
+}
 
-   tNow = 0;
-   tMax = 0;
+static void waveStreamHalt(void)
+{
+   /*
+   The DMA is being taken for something else, drop the queue.
 
-   if (!numIn1) tNext1 = -1; else tNext1 = 0;
-   if (!numIn2) tNext2 = -1; else tNext2 = 0;
+   Called with waveStreamMutex held, before the DMA is touched, and
+   the mutex is held until the new DMA state is set.  Otherwise the
+   alert thread may see the stream running with the DMA stopped and
+   restart the stream over the new output.
+   */
 
-   while (((inPos1<numIn1) || (inPos2<numIn2)) && (outPos<numOut))
+   if (waveStream.open)
    {
-      if (tNext1 < tNext2)
-      {
-         /* pulse 1 due */
+      waveSetOOL(waveStream.botOOL, waveStream.written);
 
-         if (tNow < tNext1)
-         {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext1 - tNow);
-            tNow = tNext1;
-         }
+      waveStream.running = 0;
+   }
+}
 
-         out[outPos].gpioOn  = in1[inPos1].gpioOn;
-         out[outPos].gpioOff = in1[inPos1].gpioOff;
-         out[outPos].flags   = in1[inPos1].flags;
+static void waveStreamCheck(void)
+{
+   uint32_t played, queued;
+   waveStream_t *s = &waveStream;
 
-         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
-         if (tMax < tNext1) tMax = tNext1;
-      }
-      else if (tNext2 < tNext1)
+   pthread_mutex_lock(&waveStreamMutex);
+
+   if (s->open && s->running)
+   {
+      /*
+      The DMA stops if it reaches the end of the last segment before
+      a write links the next.  If that happened after the write
+      looked, restart at the first segment not played.
+      */
+
+      if (!dmaOut[DMA_CONBLK_AD])
       {
-         /* pulse 2 due */
+         played = waveStreamPlayed();
 
-         if (tNow < tNext2)
+         if (played != s->written)
          {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext2 - tNow);
-            tNow = tNext2;
+            s->underruns++;
+            waveStreamGo(played);
          }
-
-         out[outPos].gpioOn  = in2[inPos2].gpioOn;
-         out[outPos].gpioOff = in2[inPos2].gpioOff;
-         out[outPos].flags   = in2[inPos2].flags;
-
-         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
-         if (tMax < tNext2) tMax = tNext2;
       }
-      else
+
+      if (s->eventOn)
       {
-         /* pulse 1 and 2 both due */
+         queued = s->written - waveStreamPlayed();
 
-         if (tNow < tNext1)
+         if (queued <= s->lowWater)
          {
-            /* extend previous delay */
-            out[outPos-1].usDelay += (tNext1 - tNow);
-            tNow = tNext1;
+            if (!s->low) eventAlert[s->event].fired = 1;
+            s->low = 1;
          }
+         else s->low = 0;
+      }
+   }
 
-         out[outPos].gpioOn  = in1[inPos1].gpioOn  | in2[inPos2].gpioOn;
-         out[outPos].gpioOff = in1[inPos1].gpioOff | in2[inPos2].gpioOff;
-         out[outPos].flags   = in1[inPos1].flags   | in2[inPos2].flags;
+   pthread_mutex_unlock(&waveStreamMutex);
+}
 
-         tNext1 = tNow + in1[inPos1].usDelay; ++inPos1;
-         tNext2 = tNow + in2[inPos2].usDelay; ++inPos2;
-         if (tMax < tNext1) tMax = tNext1;
-         if (tMax < tNext2) tMax = tNext2;
-      }
+static void waveStreamFree(void)
+{
+   waveStream_t *s = &waveStream;
 
-      if (tNext1 <= tNext2) { tDelay = tNext1 - tNow; tNow = tNext1; }
-      else                  { tDelay = tNext2 - tNow; tNow = tNext2; }
+   if (s->open)
+   {
+      if (s->running && dmaOut[DMA_CONBLK_AD]) initKillDMA(dmaOut);
 
-      out[outPos].usDelay = tDelay;
+      waveExtentFree(&waveFreeCB, s->botCB, s->segs * s->segCBs);
+      waveExtentFree(&waveFreeOOL, s->botOOL, 1 + (s->segs * s->segOOLs));
 
-      cbs += waveDelayCBs(tDelay);
+      s->open = 0;
+      s->running = 0;
+   }
+}
 
-      if (out[outPos].gpioOn || out[outPos].gpioOff) cbs++;
+/* ----------------------------------------------------------------------- */
 
-      if (out[outPos].flags & WAVE_FLAG_READ)
-      {
-         cbs++; /* one cb if read */
-         --level;
-      }
+static void waveCBsOOLs(int *numCBs, int *numBOOLs, int *numTOOLs)
+{
+   int numCB=0, numBOOL=0, numTOOL=0;
 
-      if (out[outPos].flags & WAVE_FLAG_TICK)
-      {
-         cbs++; /* one cb if tick */
-         --level;
-      }
+   unsigned i;
+
+   unsigned numWaves;
+
+   rawWave_t *waves;
 
-      outPos++;
+   numWaves = wfc[wfcur];
+   waves    = wf [wfcur];
 
-      if (inPos1 >= numIn1) tNext1 = -1;
-      if (inPos2 >= numIn2) tNext2 = -1;
+   /* delay cb at start of DMA */
 
-   }
+   numCB++;
 
-   if (tNow < tMax)
+   for (i=0; i<numWaves; i++)
    {
-      /* extend previous delay */
-      out[outPos-1].usDelay += (tMax - tNow);
-      tNow = tMax;
+      if (waves[i].gpioOn)                 {numBOOL++;}
+      if (waves[i].gpioOff)                {numBOOL++;}
+      if (waves[i].gpioOn || waves[i].gpioOff) {numCB++;}
+      if (waves[i].flags & WAVE_FLAG_READ) {numCB++; numTOOL++;}
+      if (waves[i].flags & WAVE_FLAG_TICK) {numCB++; numTOOL++;}
+
+      numCB += waveDelayCBs(waves[i].usDelay);
    }
 
-   if ((outPos < numOut) && (outPos < level))
-   {
-      wfStats.micros = tNow;
+   *numCBs   = numCB;
+   *numBOOLs = numBOOL;
+   *numTOOLs = numTOOL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static rawCbs_t *waveLevelCB(
+   rawCbs_t *p, int *CB, int *OOL, uint32_t gpioOn, uint32_t gpioOff)
+{
+   int s_stride;
 
-      if (tNow > wfStats.highMicros) wfStats.highMicros = tNow;
+   /* the CB which sets and clears the GPIO of a pulse, if any */
 
-      wfStats.pulses = outPos;
+   if (gpioOn && gpioOff)
+   /* Use 2-beat burst */
+   {
+      p = rawWaveCBAdr((*CB)++);
 
-      if (outPos > wfStats.highPulses) wfStats.highPulses = outPos;
+      p->info   = TWO_BEAT_DMA;
+      p->src    = waveOOLPOadr(*OOL);
+      waveSetOOL((*OOL)++, gpioOn);
+      s_stride = waveOOLPOadr(*OOL) - p->src;
+      waveSetOOL((*OOL)++, gpioOff);
+      p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
+      p->length = (2<<16) + 4;         // 2 transfers of 4 bytes each
+      p->stride = (12<<16) + s_stride; // d_stride = (GPCLR0-GPSET0)*4 = 12
+      p->next   = waveCbPOadr(*CB);
+   }
+   else if (gpioOn)
+   {
+      waveSetOOL(*OOL, gpioOn);
 
-      wfStats.cbs    = cbs;
+      p = rawWaveCBAdr((*CB)++);
 
-      if (cbs > wfStats.highCbs) wfStats.highCbs = cbs;
+      p->info   = NORMAL_DMA;
+      p->src    = waveOOLPOadr((*OOL)++);
+      p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
+      p->length = 4;
+      p->next   = waveCbPOadr(*CB);
+   }
+   else if (gpioOff)
+   {
+      waveSetOOL(*OOL, gpioOff);
 
-      wfc[1-wfcur] = outPos;
-      wfcur = 1 - wfcur;
+      p = rawWaveCBAdr((*CB)++);
 
-      return outPos;
+      p->info   = NORMAL_DMA;
+      p->src    = waveOOLPOadr((*OOL)++);
+      p->dst    = ((GPIO_BASE + (GPCLR0*4)) & 0x00ffffff) | PI_PERI_BUS;
+      p->length = 4;
+      p->next   = waveCbPOadr(*CB);
    }
-   else return PI_TOO_MANY_PULSES;
-}
 
-/* ======================================================================= */
+   return p;
+}
 
-int i2cWriteQuick(unsigned handle, unsigned bit)
+static rawCbs_t *waveDelayCB(rawCbs_t *p, int *CB, uint32_t delay)
 {
-   int status;
+   unsigned delayCBs, dcb;
 
-   DBG(DBG_USER, "handle=%d bit=%d", handle, bit);
+   /* the paced CBs which wait for delay micros, if any */
 
-   CHECK_INITED;
+   delayCBs = waveDelayCBs(delay);
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   for (dcb=0; dcb<delayCBs; dcb++)
+   {
+      p = rawWaveCBAdr((*CB)++);
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      /* use the secondary clock */
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_QUICK) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+      if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+      {
+         p->info = NORMAL_DMA | TIMED_DMA(2);
+         p->dst  = PCM_TIMER;
+      }
+      else
+      {
+         p->info = NORMAL_DMA | TIMED_DMA(5);
+         p->dst  = PWM_TIMER;
+      }
 
-   if (bit > 1)
-      SOFT_ERROR(PI_BAD_PARAM, "bad bit (%d)", bit);
+      //cast twice to suppress compiler warning, I belive this cast is ok
+      //because dmaOBus contains bus addresses, not virtual addresses.
+      p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
 
-   status = my_smbus_access(
-      i2cInfo[handle].fd, bit, 0, PI_I2C_SMBUS_QUICK, NULL);
+      p->length = BPD * delay / PI_WF_MICROS;
 
-   if (status < 0)
-   {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_WRITE_FAILED;
+      if ((gpioCfg.DMAsecondaryChannel >= DMA_LITE_FIRST) &&
+          (p->length > DMA_LITE_MAX))
+      {
+         p->length = DMA_LITE_MAX;
+      }
+
+      delay -= (p->length / BPD);
+
+      p->next = waveCbPOadr(*CB);
    }
 
-   return status;
+   return p;
 }
 
-int i2cReadByte(unsigned handle)
+static int wave2Cbs(unsigned wave_mode, int *CB, int *BOOL, int *TOOL,
+                    int numCB, int numBOOL, int numTOOL)
 {
-   union my_smbus_data data;
+   int botCB=*CB, botOOL=*BOOL, topOOL=*TOOL;
+
    int status;
 
-   DBG(DBG_USER, "handle=%d", handle);
+   rawCbs_t *p=NULL;
 
-   CHECK_INITED;
+   unsigned i, repeatCB;
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   unsigned numWaves;
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   rawWave_t * waves;
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BYTE) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+   numWaves = wfc[wfcur];
+   waves    = wf [wfcur];
 
-   status = my_smbus_access(
-      i2cInfo[handle].fd, PI_I2C_SMBUS_READ, 0, PI_I2C_SMBUS_BYTE, &data);
+   /* add delay cb at start of DMA */
 
-   if (status < 0)
+   p = waveDelayCB(p, &botCB, 20); /* 20 micros delay */
+
+   repeatCB = botCB;
+
+   for (i=0; i<numWaves; i++)
    {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_READ_FAILED;
-   }
+      p = waveLevelCB(p, &botCB, &botOOL, waves[i].gpioOn, waves[i].gpioOff);
 
-   return 0xFF & data.byte;
-}
+      if (waves[i].flags & WAVE_FLAG_READ)
+      {
+         p = rawWaveCBAdr(botCB++);
 
+         p->info   = NORMAL_DMA;
+         p->src    = ((GPIO_BASE + (GPLEV0*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->dst    = waveOOLPOadr(--topOOL);
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
+      }
 
-int i2cWriteByte(unsigned handle, unsigned bVal)
-{
-   int status;
+      if (waves[i].flags & WAVE_FLAG_TICK)
+      {
+         p = rawWaveCBAdr(botCB++);
 
-   DBG(DBG_USER, "handle=%d bVal=%d", handle, bVal);
+         p->info   = NORMAL_DMA;
+         p->src    = ((SYST_BASE + (SYST_CLO*4)) & 0x00ffffff) | PI_PERI_BUS;
+         p->dst    = waveOOLPOadr(--topOOL);
+         p->length = 4;
+         p->next   = waveCbPOadr(botCB);
+      }
 
-   CHECK_INITED;
+      p = waveDelayCB(p, &botCB, waves[i].usDelay);
+   }
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if (numCB)
+   {
+      /* Pad the wave */
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      botCB = *CB + numCB - 1;
+      botOOL = *BOOL + numBOOL - 1;
+      topOOL = *TOOL - numTOOL;
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BYTE) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+      /* Link the last CB to end of wave */
 
-   if (bVal > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad bVal (%d)", bVal);
+      p->next = waveCbPOadr(botCB);
 
-   status = my_smbus_access(
-            i2cInfo[handle].fd,
-            PI_I2C_SMBUS_WRITE,
-            bVal,
-            PI_I2C_SMBUS_BYTE,
-            NULL);
+      /* Insert sentinel CB at end of DMA */
 
-   if (status < 0)
+      p = rawWaveCBAdr(botCB++);
+      p->info   = NORMAL_DMA | DMA_DEST_IGNORE;
+      p->src    = waveOOLPOadr(botOOL++);
+      p->dst    = ((GPIO_BASE + (GPSET0*4)) & 0x00ffffff) | PI_PERI_BUS;
+      p->length = 4;
+      p->next   = 0;
+   }
+
+   if (p != NULL)
    {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_WRITE_FAILED;
+      if (wave_mode == PI_WAVE_MODE_ONE_SHOT)
+           p->next = 0;
+      else p->next = waveCbPOadr(repeatCB);
    }
 
+   status = botCB - *CB;
+
+   *CB   = botCB;
+   *BOOL = botOOL;
+   *TOOL = topOOL;
+
    return status;
 }
 
+/* ----------------------------------------------------------------------- */
 
-int i2cReadByteData(unsigned handle, unsigned reg)
+static void waveRxFrame(wfRx_t *w, uint32_t code, int bits, int flags)
 {
-   union my_smbus_data data;
-   int status;
+   gpioFrame_t *f;
+   int newWritePos;
 
-   DBG(DBG_USER, "handle=%d reg=%d", handle, reg);
+   f = &w->D.buf[w->D.writePos];
 
-   CHECK_INITED;
+   f->tick     = w->D.startTick;
+   f->code     = code;
+   f->bits     = bits;
+   f->protocol = w->D.protocol;
+   f->flags    = flags;
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   /* don't let writePos catch readPos */
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   newWritePos = (w->D.writePos + 1) % (w->D.bufSize);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BYTE_DATA) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+   if (newWritePos != w->D.readPos) w->D.writePos = newWritePos;
+}
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
+/* ----------------------------------------------------------------------- */
 
-   status = my_smbus_access(i2cInfo[handle].fd,
-            PI_I2C_SMBUS_READ, reg, PI_I2C_SMBUS_BYTE_DATA, &data);
+static void waveRxWiegandEnd(wfRx_t *w)
+{
+   int bits, half, flags;
+   uint64_t data, mask;
+   uint32_t code;
 
-   if (status < 0)
+   bits  = w->D.bits;
+   data  = w->D.data;
+   flags = 0;
+
+   if ((bits == 26) || (bits == 34))
    {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_READ_FAILED;
+      /*
+      A leading even parity bit covers the first half of the data
+      and a trailing odd parity bit covers the second half.
+      */
+
+      half = (bits - 2) / 2;
+
+      mask = (1ULL << (half + 1)) - 1;
+
+      if (__builtin_parityll((data >> (half + 1)) & mask) ||
+          !__builtin_parityll(data & mask)) flags |= PI_DECODE_BAD_CHECK;
+
+      code = (data >> 1) & ((1ULL << (bits - 2)) - 1);
    }
+   else code = data;
 
-   return 0xFF & data.byte;
+   waveRxFrame(w, code, bits, flags);
 }
 
+/* ----------------------------------------------------------------------- */
 
-int i2cWriteByteData(unsigned handle, unsigned reg, unsigned bVal)
+static void waveRxWiegand(wfRx_t *w, int bit, int level, uint32_t tick)
 {
-   union my_smbus_data data;
+   /* w is the D0 decoder, a data bit is a low pulse on D0 or D1 */
 
-   int status;
+   if (level == PI_TIMEOUT)
+   {
+      if (w->D.bits) waveRxWiegandEnd(w);
 
-   DBG(DBG_USER, "handle=%d reg=%d bVal=%d", handle, reg, bVal);
+      w->D.bits = 0;
 
-   CHECK_INITED;
+      gpioSetWatchdog(w->gpio, 0);
+   }
+   else if (level == 0)
+   {
+      if (w->D.bits == 0)
+      {
+         w->D.startTick = tick;
+         w->D.data      = 0;
+      }
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      if (w->D.bits < 64) w->D.data = (w->D.data << 1) | bit;
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      w->D.bits++;
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BYTE_DATA) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+      /* the watchdog on D0 ends the frame */
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
+      gpioSetWatchdog(w->gpio, WIEGAND_TIMEOUT);
+   }
+}
 
-   if (bVal > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad bVal (%d)", bVal);
+/* ----------------------------------------------------------------------- */
 
-   data.byte = bVal;
+static void waveRxNEC(wfRx_t *w, int level, uint32_t tick)
+{
+   /*
+   The receiver output is low during a mark.  A frame is a 9 ms
+   mark, a 4.5 ms space, then 32 bits LSB first.  Each bit is a
+   562 us mark followed by a 562 us (0) or 1687 us (1) space.
+   A repeat frame is a 9 ms mark and a 2.25 ms space.
+   */
 
-   status = my_smbus_access(
-            i2cInfo[handle].fd,
-            PI_I2C_SMBUS_WRITE,
-            reg,
-            PI_I2C_SMBUS_BYTE_DATA,
-            &data);
+   uint32_t micros;
+   int flags;
 
-   if (status < 0)
+   if (level == PI_TIMEOUT) return;
+
+   micros = tick - w->D.edgeTick;
+   w->D.edgeTick = tick;
+
+   if (level == 1) /* end of a mark */
    {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_WRITE_FAILED;
+      if ((micros > 7000) && (micros < 11000))
+      {
+         w->D.state     = DRX_LEADER;
+         w->D.startTick = tick - micros;
+      }
+      else if ((micros < 300) || (micros > 900)) w->D.state = DRX_IDLE;
    }
+   else if (level == 0) /* end of a space */
+   {
+      switch (w->D.state)
+      {
+         case DRX_LEADER:
 
-   return status;
-}
+            if ((micros > 3500) && (micros < 5500))
+            {
+               w->D.state = DRX_DATA;
+               w->D.bits  = 0;
+               w->D.data  = 0;
+               break;
+            }
 
+            if ((micros > 1750) && (micros < 2750) && w->D.lastValid &&
+                ((tick - w->D.lastTick) < 250000))
+            {
+               waveRxFrame(w, w->D.lastCode, 32, PI_DECODE_REPEAT);
+               w->D.lastTick = tick;
+            }
 
-int i2cReadWordData(unsigned handle, unsigned reg)
-{
-   union my_smbus_data data;
-   int status;
+            w->D.state = DRX_IDLE;
+            break;
 
-   DBG(DBG_USER, "handle=%d reg=%d", handle, reg);
+         case DRX_DATA:
 
-   CHECK_INITED;
+            if ((micros < 300) || (micros > 2300))
+            {
+               w->D.state = DRX_IDLE;
+               break;
+            }
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+            if (micros > 1125) w->D.data |= (1ULL << w->D.bits);
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+            if (++w->D.bits == 32)
+            {
+               flags = 0;
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_WORD_DATA) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+               /* the command is followed by its complement */
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
+               if ((((w->D.data >> 16) ^ (w->D.data >> 24)) & 0xFF) != 0xFF)
+                  flags |= PI_DECODE_BAD_CHECK;
 
-   status = (my_smbus_access(
-      i2cInfo[handle].fd,
-      PI_I2C_SMBUS_READ,
-      reg,
-      PI_I2C_SMBUS_WORD_DATA,
-      &data));
+               waveRxFrame(w, w->D.data, 32, flags);
 
-   if (status < 0)
-   {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_READ_FAILED;
+               w->D.lastCode  = w->D.data;
+               w->D.lastTick  = tick;
+               w->D.lastValid = !flags;
+               w->D.state     = DRX_IDLE;
+            }
+            break;
+      }
    }
-
-   return 0xFFFF & data.word;
 }
 
+/* ----------------------------------------------------------------------- */
 
-int i2cWriteWordData(unsigned handle, unsigned reg, unsigned wVal)
+static void waveRxRC5(wfRx_t *w, int level, uint32_t tick)
 {
-   union my_smbus_data data;
+   /*
+   The receiver output is low during a mark.  A frame is 14
+   Manchester bits of 1778 us, MSB first, a 1 being a space then
+   a mark.  So every bit has an edge in its middle, falling for a
+   1 and rising for a 0.  The first bit is always 1.
+   */
 
-   int status;
+   uint32_t micros, d;
+   int halves, toggle;
 
-   DBG(DBG_USER, "handle=%d reg=%d wVal=%d", handle, reg, wVal);
+   if (level == PI_TIMEOUT) return;
 
-   CHECK_INITED;
+   micros = tick - w->D.edgeTick;
+   w->D.edgeTick = tick;
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if      ((micros >  444) && (micros <= 1333)) halves = 1;
+   else if ((micros > 1333) && (micros <  2222)) halves = 2;
+   else                                          halves = 0;
 
-   if (i2cInfo[handle].state != PI_I2C_OPENED)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if ((w->D.state == DRX_MID) && (halves == 1))
+   {
+      /* an edge between bits */
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_WORD_DATA) == 0)
-      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+      w->D.state = DRX_EDGE;
+      return;
+   }
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
+   if (((w->D.state == DRX_MID)  && (halves == 2)) ||
+       ((w->D.state == DRX_EDGE) && (halves == 1)))
+   {
+      /* an edge in the middle of a bit */
 
-   if (wVal > 0xFFFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad wVal (%d)", wVal);
+      w->D.data = (w->D.data << 1) | (level == 0);
+      w->D.state = DRX_MID;
 
-   data.word = wVal;
+      if (++w->D.bits == 14)
+      {
+         d = w->D.data;
 
-   status = my_smbus_access(
-            i2cInfo[handle].fd,
-            PI_I2C_SMBUS_WRITE,
-            reg,
-            PI_I2C_SMBUS_WORD_DATA,
-            &data);
+         toggle = (d >> 11) & 1;
 
-   if (status < 0)
-   {
-      DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_WRITE_FAILED;
+         /* address 5 bits, command 7 bits (the inverted second bit) */
+
+         waveRxFrame(w,
+            (((d >> 6) & 0x1F) << 8) | (d & 0x3F) | ((~d >> 6) & 0x40),
+            14, toggle ? PI_DECODE_TOGGLE : 0);
+
+         w->D.state = DRX_IDLE;
+      }
+      return;
    }
 
-   return status;
+   /* anything else, a falling edge may be the middle of a start bit */
+
+   if (level == 0)
+   {
+      w->D.state     = DRX_MID;
+      w->D.bits      = 1;
+      w->D.data      = 1;
+      w->D.startTick = tick;
+   }
+   else w->D.state = DRX_IDLE;
 }
 
+/* ----------------------------------------------------------------------- */
 
-int i2cProcessCall(unsigned handle, unsigned reg, unsigned wVal)
+static void waveRxBit(int gpio, int level, uint32_t tick)
 {
-   union my_smbus_data data;
-   int status;
-
-   DBG(DBG_USER, "handle=%d reg=%d wVal=%d", handle, reg, wVal);
+   switch (wfRx[gpio].mode)
+   {
+      case PI_WFRX_WIEGAND_D0:
+         waveRxWiegand(&wfRx[gpio], 0, level, tick);
+         break;
 
-   CHECK_INITED;
+      case PI_WFRX_WIEGAND_D1:
+         waveRxWiegand(&wfRx[wfRx[gpio].D.other], 1, level, tick);
+         break;
 
-   if (handle >= PI_I2C_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+      case PI_WFRX_IR:
+         if (wfRx[gpio].D.protocol == PI_DECODE_NEC)
+            waveRxNEC(&wfRx[gpio], level, tick);
+         else
+            waveRxRC5(&wfRx[gpio], level, tick);
+         break;
+   }
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int rawWaveAddGeneric(unsigned numIn1, rawWave_t *in1)
+{
+   return waveAddGeneric(numIn1, in1);
+}
+
+/* ======================================================================= */
+
+int i2cWriteQuick(unsigned handle, unsigned bit)
+{
+   int status;
+
+   DBG(DBG_USER, "handle=%d bit=%d", handle, bit);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_PROC_CALL) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_QUICK) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
-
-   if (wVal > 0xFFFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad wVal (%d)", wVal);
-
-   data.word = wVal;
+   if (bit > 1)
+      SOFT_ERROR(PI_BAD_PARAM, "bad bit (%d)", bit);
 
-   status = (my_smbus_access(
-      i2cInfo[handle].fd,
-      PI_I2C_SMBUS_WRITE,
-      reg, PI_I2C_SMBUS_PROC_CALL,
-      &data));
+   status = my_smbus_access(
+      i2cInfo[handle].fd, bit, 0, PI_I2C_SMBUS_QUICK, NULL);
 
    if (status < 0)
    {
       DBG(DBG_USER, "error=%d (%m)", status);
-      return PI_I2C_READ_FAILED;
+      return PI_I2C_WRITE_FAILED;
    }
 
-   return 0xFFFF & data.word;
+   return status;
 }
 
-
-int i2cReadBlockData(unsigned handle, unsigned reg, char *buf)
+int i2cReadByte(unsigned handle)
 {
    union my_smbus_data data;
+   int status;
 
-   int i, status;
-
-   DBG(DBG_USER, "handle=%d reg=%d buf=%08"PRIXPTR, handle, reg, (uintptr_t)buf);
+   DBG(DBG_USER, "handle=%d", handle);
 
    CHECK_INITED;
 
@@ -3758,45 +4308,27 @@ int i2cReadBlockData(unsigned handle, unsigned reg, char *buf)
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BLOCK_DATA) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BYTE) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
-
-   status = (my_smbus_access(
-      i2cInfo[handle].fd,
-      PI_I2C_SMBUS_READ,
-      reg,
-      PI_I2C_SMBUS_BLOCK_DATA,
-      &data));
+   status = my_smbus_access(
+      i2cInfo[handle].fd, PI_I2C_SMBUS_READ, 0, PI_I2C_SMBUS_BYTE, &data);
 
    if (status < 0)
    {
       DBG(DBG_USER, "error=%d (%m)", status);
       return PI_I2C_READ_FAILED;
    }
-   else
-   {
-      if (data.block[0] <= PI_I2C_SMBUS_BLOCK_MAX)
-      {
-         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
-         return data.block[0];
-      }
-      else return PI_I2C_READ_FAILED;
-   }
+
+   return 0xFF & data.byte;
 }
 
 
-int i2cWriteBlockData(
-   unsigned handle, unsigned reg, char *buf, unsigned count)
+int i2cWriteByte(unsigned handle, unsigned bVal)
 {
-   union my_smbus_data data;
-
-   int i, status;
+   int status;
 
-   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
-      handle, reg, count, myBuf2Str(count, buf));
+   DBG(DBG_USER, "handle=%d bVal=%d", handle, bVal);
 
    CHECK_INITED;
 
@@ -3806,24 +4338,18 @@ int i2cWriteBlockData(
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BLOCK_DATA) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BYTE) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   if (reg > 0xFF)
-      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
-
-   if ((count < 1) || (count > 32))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
-
-   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
-   data.block[0] = count;
+   if (bVal > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad bVal (%d)", bVal);
 
    status = my_smbus_access(
             i2cInfo[handle].fd,
             PI_I2C_SMBUS_WRITE,
-            reg,
-            PI_I2C_SMBUS_BLOCK_DATA,
-            &data);
+            bVal,
+            PI_I2C_SMBUS_BYTE,
+            NULL);
 
    if (status < 0)
    {
@@ -3835,15 +4361,12 @@ int i2cWriteBlockData(
 }
 
 
-int i2cBlockProcessCall(
-   unsigned handle, unsigned reg, char *buf, unsigned count)
+int i2cReadByteData(unsigned handle, unsigned reg)
 {
    union my_smbus_data data;
+   int status;
 
-   int i, status;
-
-   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
-      handle, reg, count, myBuf2Str(count, buf));
+   DBG(DBG_USER, "handle=%d reg=%d", handle, reg);
 
    CHECK_INITED;
 
@@ -3853,49 +4376,32 @@ int i2cBlockProcessCall(
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_PROC_CALL) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BYTE_DATA) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
    if (reg > 0xFF)
       SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   if ((count < 1) || (count > 32))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
-
-   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
-   data.block[0] = count;
-
-   status = (my_smbus_access(
-      i2cInfo[handle].fd, PI_I2C_SMBUS_WRITE, reg,
-      PI_I2C_SMBUS_BLOCK_PROC_CALL, &data));
+   status = my_smbus_access(i2cInfo[handle].fd,
+            PI_I2C_SMBUS_READ, reg, PI_I2C_SMBUS_BYTE_DATA, &data);
 
    if (status < 0)
    {
       DBG(DBG_USER, "error=%d (%m)", status);
       return PI_I2C_READ_FAILED;
    }
-   else
-   {
-      if (data.block[0] <= PI_I2C_SMBUS_BLOCK_MAX)
-      {
-         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
-         return data.block[0];
-      }
-      else return PI_I2C_READ_FAILED;
-   }
+
+   return 0xFF & data.byte;
 }
 
 
-int i2cReadI2CBlockData(
-   unsigned handle, unsigned reg, char *buf, unsigned count)
+int i2cWriteByteData(unsigned handle, unsigned reg, unsigned bVal)
 {
    union my_smbus_data data;
 
-   int i, status;
-   uint32_t size;
+   int status;
 
-   DBG(DBG_USER, "handle=%d reg=%d count=%d buf=%08"PRIXPTR,
-      handle, reg, count, (uintptr_t)buf);
+   DBG(DBG_USER, "handle=%d reg=%d bVal=%d", handle, reg, bVal);
 
    CHECK_INITED;
 
@@ -3905,51 +4411,79 @@ int i2cReadI2CBlockData(
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_I2C_BLOCK) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BYTE_DATA) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
    if (reg > 0xFF)
       SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   if ((count < 1) || (count > 32))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+   if (bVal > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad bVal (%d)", bVal);
 
-   if (count == 32)
-      size = PI_I2C_SMBUS_I2C_BLOCK_BROKEN;
-   else
-      size = PI_I2C_SMBUS_I2C_BLOCK_DATA;
+   data.byte = bVal;
 
-   data.block[0] = count;
+   status = my_smbus_access(
+            i2cInfo[handle].fd,
+            PI_I2C_SMBUS_WRITE,
+            reg,
+            PI_I2C_SMBUS_BYTE_DATA,
+            &data);
+
+   if (status < 0)
+   {
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_WRITE_FAILED;
+   }
+
+   return status;
+}
+
+
+int i2cReadWordData(unsigned handle, unsigned reg)
+{
+   union my_smbus_data data;
+   int status;
+
+   DBG(DBG_USER, "handle=%d reg=%d", handle, reg);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_WORD_DATA) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
    status = (my_smbus_access(
-      i2cInfo[handle].fd, PI_I2C_SMBUS_READ, reg, size, &data));
+      i2cInfo[handle].fd,
+      PI_I2C_SMBUS_READ,
+      reg,
+      PI_I2C_SMBUS_WORD_DATA,
+      &data));
 
    if (status < 0)
    {
       DBG(DBG_USER, "error=%d (%m)", status);
       return PI_I2C_READ_FAILED;
    }
-   else
-   {
-      if (data.block[0] <= PI_I2C_SMBUS_I2C_BLOCK_MAX)
-      {
-         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
-         return data.block[0];
-      }
-      else return PI_I2C_READ_FAILED;
-   }
+
+   return 0xFFFF & data.word;
 }
 
 
-int i2cWriteI2CBlockData(
-   unsigned handle, unsigned reg, char *buf, unsigned count)
+int i2cWriteWordData(unsigned handle, unsigned reg, unsigned wVal)
 {
    union my_smbus_data data;
 
-   int i, status;
+   int status;
 
-   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
-      handle, reg, count, myBuf2Str(count, buf));
+   DBG(DBG_USER, "handle=%d reg=%d wVal=%d", handle, reg, wVal);
 
    CHECK_INITED;
 
@@ -3959,24 +4493,22 @@ int i2cWriteI2CBlockData(
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_I2C_BLOCK) == 0)
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_WORD_DATA) == 0)
       SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
    if (reg > 0xFF)
       SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   if ((count < 1) || (count > 32))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
-
-   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
+   if (wVal > 0xFFFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad wVal (%d)", wVal);
 
-   data.block[0] = count;
+   data.word = wVal;
 
    status = my_smbus_access(
             i2cInfo[handle].fd,
             PI_I2C_SMBUS_WRITE,
             reg,
-            PI_I2C_SMBUS_I2C_BLOCK_BROKEN,
+            PI_I2C_SMBUS_WORD_DATA,
             &data);
 
    if (status < 0)
@@ -3988,12 +4520,13 @@ int i2cWriteI2CBlockData(
    return status;
 }
 
-int i2cWriteDevice(unsigned handle, char *buf, unsigned count)
+
+int i2cProcessCall(unsigned handle, unsigned reg, unsigned wVal)
 {
-   int bytes;
+   union my_smbus_data data;
+   int status;
 
-   DBG(DBG_USER, "handle=%d count=%d [%s]",
-      handle, count, myBuf2Str(count, buf));
+   DBG(DBG_USER, "handle=%d reg=%d wVal=%d", handle, reg, wVal);
 
    CHECK_INITED;
 
@@ -4003,26 +4536,40 @@ int i2cWriteDevice(unsigned handle, char *buf, unsigned count)
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((count < 1) || (count > PI_MAX_I2C_DEVICE_COUNT))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
-
-   bytes = write(i2cInfo[handle].fd, buf, count);
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_PROC_CALL) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   if (bytes != count)
-   {
-      DBG(DBG_USER, "error=%d (%m)", bytes);
-      return PI_I2C_WRITE_FAILED;
-   }
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   return 0;
+   if (wVal > 0xFFFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad wVal (%d)", wVal);
+
+   data.word = wVal;
+
+   status = (my_smbus_access(
+      i2cInfo[handle].fd,
+      PI_I2C_SMBUS_WRITE,
+      reg, PI_I2C_SMBUS_PROC_CALL,
+      &data));
+
+   if (status < 0)
+   {
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_READ_FAILED;
+   }
+
+   return 0xFFFF & data.word;
 }
 
-int i2cReadDevice(unsigned handle, char *buf, unsigned count)
+
+int i2cReadBlockData(unsigned handle, unsigned reg, char *buf)
 {
-   int bytes;
+   union my_smbus_data data;
 
-   DBG(DBG_USER, "handle=%d count=%d buf=%08"PRIXPTR,
-      handle, count, (uintptr_t)buf);
+   int i, status;
+
+   DBG(DBG_USER, "handle=%d reg=%d buf=%08"PRIXPTR, handle, reg, (uintptr_t)buf);
 
    CHECK_INITED;
 
@@ -4032,98 +4579,144 @@ int i2cReadDevice(unsigned handle, char *buf, unsigned count)
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if ((count < 1) || (count > PI_MAX_I2C_DEVICE_COUNT))
-      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_BLOCK_DATA) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   bytes = read(i2cInfo[handle].fd, buf, count);
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   if (bytes != count)
+   status = (my_smbus_access(
+      i2cInfo[handle].fd,
+      PI_I2C_SMBUS_READ,
+      reg,
+      PI_I2C_SMBUS_BLOCK_DATA,
+      &data));
+
+   if (status < 0)
    {
-      DBG(DBG_USER, "error=%d (%m)", bytes);
+      DBG(DBG_USER, "error=%d (%m)", status);
       return PI_I2C_READ_FAILED;
    }
-
-   return bytes;
+   else
+   {
+      if (data.block[0] <= PI_I2C_SMBUS_BLOCK_MAX)
+      {
+         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
+         return data.block[0];
+      }
+      else return PI_I2C_READ_FAILED;
+   }
 }
 
-int i2cOpen(unsigned i2cBus, unsigned i2cAddr, unsigned i2cFlags)
+
+int i2cWriteBlockData(
+   unsigned handle, unsigned reg, char *buf, unsigned count)
 {
-   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-   char dev[32];
-   int i, slot, fd;
-   uint32_t funcs;
+   union my_smbus_data data;
 
-   DBG(DBG_USER, "i2cBus=%d i2cAddr=%d flags=0x%X",
-      i2cBus, i2cAddr, i2cFlags);
+   int i, status;
+
+   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
+      handle, reg, count, myBuf2Str(count, buf));
 
    CHECK_INITED;
 
-   if (i2cAddr > PI_MAX_I2C_ADDR)
-      SOFT_ERROR(PI_BAD_I2C_ADDR, "bad I2C address (%d)", i2cAddr);
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (i2cFlags)
-      SOFT_ERROR(PI_BAD_FLAGS, "bad flags (0x%X)", i2cFlags);
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   slot = -1;
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_BLOCK_DATA) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   pthread_mutex_lock(&mutex);
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   for (i=0; i<PI_I2C_SLOTS; i++)
+   if ((count < 1) || (count > 32))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
+   data.block[0] = count;
+
+   status = my_smbus_access(
+            i2cInfo[handle].fd,
+            PI_I2C_SMBUS_WRITE,
+            reg,
+            PI_I2C_SMBUS_BLOCK_DATA,
+            &data);
+
+   if (status < 0)
    {
-      if (i2cInfo[i].state == PI_I2C_CLOSED)
-      {
-         slot = i;
-         i2cInfo[slot].state = PI_I2C_RESERVED;
-         break;
-      }
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_WRITE_FAILED;
    }
 
-   pthread_mutex_unlock(&mutex);
+   return status;
+}
 
-   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no I2C handles");
 
-   sprintf(dev, "/dev/i2c-%d", i2cBus);
+int i2cBlockProcessCall(
+   unsigned handle, unsigned reg, char *buf, unsigned count)
+{
+   union my_smbus_data data;
 
-   if ((fd = open(dev, O_RDWR)) < 0)
-   {
-      /* try a modprobe */
+   int i, status;
 
-      if (system("/sbin/modprobe i2c_dev") == -1) { /* ignore errors */}
-      if (system("/sbin/modprobe i2c_bcm2835") == -1) { /* ignore errors */}
+   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
+      handle, reg, count, myBuf2Str(count, buf));
 
-      myGpioDelay(100000);
+   CHECK_INITED;
 
-      if ((fd = open(dev, O_RDWR)) < 0)
-      {
-         i2cInfo[slot].state = PI_I2C_CLOSED;
-         return PI_BAD_I2C_BUS;
-      }
-   }
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (ioctl(fd, PI_I2C_SLAVE, i2cAddr) < 0)
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_PROC_CALL) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
+
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
+
+   if ((count < 1) || (count > 32))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
+   data.block[0] = count;
+
+   status = (my_smbus_access(
+      i2cInfo[handle].fd, PI_I2C_SMBUS_WRITE, reg,
+      PI_I2C_SMBUS_BLOCK_PROC_CALL, &data));
+
+   if (status < 0)
    {
-      close(fd);
-      i2cInfo[slot].state = PI_I2C_CLOSED;
-      return PI_I2C_OPEN_FAILED;
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_READ_FAILED;
    }
-
-   if (ioctl(fd, PI_I2C_FUNCS, &funcs) < 0)
+   else
    {
-      funcs = -1; /* assume all smbus commands allowed */
+      if (data.block[0] <= PI_I2C_SMBUS_BLOCK_MAX)
+      {
+         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
+         return data.block[0];
+      }
+      else return PI_I2C_READ_FAILED;
    }
-
-   i2cInfo[slot].fd = fd;
-   i2cInfo[slot].addr = i2cAddr;
-   i2cInfo[slot].flags = i2cFlags;
-   i2cInfo[slot].funcs = funcs;
-   i2cInfo[slot].state = PI_I2C_OPENED;
-
-   return slot;
 }
 
-int i2cClose(unsigned handle)
+
+int i2cReadI2CBlockData(
+   unsigned handle, unsigned reg, char *buf, unsigned count)
 {
-   DBG(DBG_USER, "handle=%d", handle);
+   union my_smbus_data data;
+
+   int i, status;
+   uint32_t size;
+
+   DBG(DBG_USER, "handle=%d reg=%d count=%d buf=%08"PRIXPTR,
+      handle, reg, count, (uintptr_t)buf);
 
    CHECK_INITED;
 
@@ -4133,43 +4726,51 @@ int i2cClose(unsigned handle)
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (i2cInfo[handle].fd >= 0) close(i2cInfo[handle].fd);
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_READ_I2C_BLOCK) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   i2cInfo[handle].fd = -1;
-   i2cInfo[handle].state = PI_I2C_CLOSED;
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   return 0;
-}
+   if ((count < 1) || (count > 32))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
 
-void i2cSwitchCombined(int setting)
-{
-   int fd;
+   if (count == 32)
+      size = PI_I2C_SMBUS_I2C_BLOCK_BROKEN;
+   else
+      size = PI_I2C_SMBUS_I2C_BLOCK_DATA;
 
-   DBG(DBG_USER, "setting=%d", setting);
+   data.block[0] = count;
 
-   fd = open(PI_I2C_COMBINED, O_WRONLY);
+   status = (my_smbus_access(
+      i2cInfo[handle].fd, PI_I2C_SMBUS_READ, reg, size, &data));
 
-   if (fd >= 0)
+   if (status < 0)
    {
-      if (setting)
-      {
-         if (write(fd, "1\n", 2) == -1) { /* ignore errors */ }
-      }
-      else
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_READ_FAILED;
+   }
+   else
+   {
+      if (data.block[0] <= PI_I2C_SMBUS_I2C_BLOCK_MAX)
       {
-         if (write(fd, "0\n", 2) == -1) { /* ignore errors */ }
+         for (i=0; i<data.block[0]; i++) buf[i] = data.block[i+1];
+         return data.block[0];
       }
-
-      close(fd);
+      else return PI_I2C_READ_FAILED;
    }
 }
 
-int i2cSegments(unsigned handle, pi_i2c_msg_t *segs, unsigned numSegs)
+
+int i2cWriteI2CBlockData(
+   unsigned handle, unsigned reg, char *buf, unsigned count)
 {
-   int retval;
-   my_i2c_rdwr_ioctl_data_t rdwr;
+   union my_smbus_data data;
 
-   DBG(DBG_USER, "handle=%d", handle);
+   int i, status;
+
+   DBG(DBG_USER, "handle=%d reg=%d count=%d [%s]",
+      handle, reg, count, myBuf2Str(count, buf));
 
    CHECK_INITED;
 
@@ -4179,13 +4780,233 @@ int i2cSegments(unsigned handle, pi_i2c_msg_t *segs, unsigned numSegs)
    if (i2cInfo[handle].state != PI_I2C_OPENED)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (segs == NULL)
-      SOFT_ERROR(PI_BAD_POINTER, "null segments");
+   if ((i2cInfo[handle].funcs & PI_I2C_FUNC_SMBUS_WRITE_I2C_BLOCK) == 0)
+      SOFT_ERROR(PI_BAD_SMBUS_CMD, "SMBUS command not supported by driver");
 
-   if (numSegs > PI_I2C_RDRW_IOCTL_MAX_MSGS)
-      SOFT_ERROR(PI_TOO_MANY_SEGS, "too many segments (%d)", numSegs);
+   if (reg > 0xFF)
+      SOFT_ERROR(PI_BAD_PARAM, "bad reg (%d)", reg);
 
-   rdwr.msgs = segs;
+   if ((count < 1) || (count > 32))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   for (i=1; i<=count; i++) data.block[i] = buf[i-1];
+
+   data.block[0] = count;
+
+   status = my_smbus_access(
+            i2cInfo[handle].fd,
+            PI_I2C_SMBUS_WRITE,
+            reg,
+            PI_I2C_SMBUS_I2C_BLOCK_BROKEN,
+            &data);
+
+   if (status < 0)
+   {
+      DBG(DBG_USER, "error=%d (%m)", status);
+      return PI_I2C_WRITE_FAILED;
+   }
+
+   return status;
+}
+
+int i2cWriteDevice(unsigned handle, char *buf, unsigned count)
+{
+   int bytes;
+
+   DBG(DBG_USER, "handle=%d count=%d [%s]",
+      handle, count, myBuf2Str(count, buf));
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((count < 1) || (count > PI_MAX_I2C_DEVICE_COUNT))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   bytes = write(i2cInfo[handle].fd, buf, count);
+
+   if (bytes != count)
+   {
+      DBG(DBG_USER, "error=%d (%m)", bytes);
+      return PI_I2C_WRITE_FAILED;
+   }
+
+   return 0;
+}
+
+int i2cReadDevice(unsigned handle, char *buf, unsigned count)
+{
+   int bytes;
+
+   DBG(DBG_USER, "handle=%d count=%d buf=%08"PRIXPTR,
+      handle, count, (uintptr_t)buf);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if ((count < 1) || (count > PI_MAX_I2C_DEVICE_COUNT))
+      SOFT_ERROR(PI_BAD_PARAM, "bad count (%d)", count);
+
+   bytes = read(i2cInfo[handle].fd, buf, count);
+
+   if (bytes != count)
+   {
+      DBG(DBG_USER, "error=%d (%m)", bytes);
+      return PI_I2C_READ_FAILED;
+   }
+
+   return bytes;
+}
+
+int i2cOpen(unsigned i2cBus, unsigned i2cAddr, unsigned i2cFlags)
+{
+   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+   char dev[32];
+   int i, slot, fd;
+   uint32_t funcs;
+
+   DBG(DBG_USER, "i2cBus=%d i2cAddr=%d flags=0x%X",
+      i2cBus, i2cAddr, i2cFlags);
+
+   CHECK_INITED;
+
+   if (i2cAddr > PI_MAX_I2C_ADDR)
+      SOFT_ERROR(PI_BAD_I2C_ADDR, "bad I2C address (%d)", i2cAddr);
+
+   if (i2cFlags)
+      SOFT_ERROR(PI_BAD_FLAGS, "bad flags (0x%X)", i2cFlags);
+
+   slot = -1;
+
+   pthread_mutex_lock(&mutex);
+
+   for (i=0; i<PI_I2C_SLOTS; i++)
+   {
+      if (i2cInfo[i].state == PI_I2C_CLOSED)
+      {
+         slot = i;
+         i2cInfo[slot].state = PI_I2C_RESERVED;
+         break;
+      }
+   }
+
+   pthread_mutex_unlock(&mutex);
+
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no I2C handles");
+
+   sprintf(dev, "/dev/i2c-%d", i2cBus);
+
+   if ((fd = open(dev, O_RDWR)) < 0)
+   {
+      /* try a modprobe */
+
+      if (system("/sbin/modprobe i2c_dev") == -1) { /* ignore errors */}
+      if (system("/sbin/modprobe i2c_bcm2835") == -1) { /* ignore errors */}
+
+      myGpioDelay(100000);
+
+      if ((fd = open(dev, O_RDWR)) < 0)
+      {
+         i2cInfo[slot].state = PI_I2C_CLOSED;
+         return PI_BAD_I2C_BUS;
+      }
+   }
+
+   if (ioctl(fd, PI_I2C_SLAVE, i2cAddr) < 0)
+   {
+      close(fd);
+      i2cInfo[slot].state = PI_I2C_CLOSED;
+      return PI_I2C_OPEN_FAILED;
+   }
+
+   if (ioctl(fd, PI_I2C_FUNCS, &funcs) < 0)
+   {
+      funcs = -1; /* assume all smbus commands allowed */
+   }
+
+   i2cInfo[slot].fd = fd;
+   i2cInfo[slot].addr = i2cAddr;
+   i2cInfo[slot].flags = i2cFlags;
+   i2cInfo[slot].funcs = funcs;
+   i2cInfo[slot].state = PI_I2C_OPENED;
+
+   return slot;
+}
+
+int i2cClose(unsigned handle)
+{
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].fd >= 0) close(i2cInfo[handle].fd);
+
+   i2cInfo[handle].fd = -1;
+   i2cInfo[handle].state = PI_I2C_CLOSED;
+
+   return 0;
+}
+
+void i2cSwitchCombined(int setting)
+{
+   int fd;
+
+   DBG(DBG_USER, "setting=%d", setting);
+
+   fd = open(PI_I2C_COMBINED, O_WRONLY);
+
+   if (fd >= 0)
+   {
+      if (setting)
+      {
+         if (write(fd, "1\n", 2) == -1) { /* ignore errors */ }
+      }
+      else
+      {
+         if (write(fd, "0\n", 2) == -1) { /* ignore errors */ }
+      }
+
+      close(fd);
+   }
+}
+
+int i2cSegments(unsigned handle, pi_i2c_msg_t *segs, unsigned numSegs)
+{
+   int retval;
+   my_i2c_rdwr_ioctl_data_t rdwr;
+
+   DBG(DBG_USER, "handle=%d", handle);
+
+   CHECK_INITED;
+
+   if (handle >= PI_I2C_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (i2cInfo[handle].state != PI_I2C_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   if (segs == NULL)
+      SOFT_ERROR(PI_BAD_POINTER, "null segments");
+
+   if (numSegs > PI_I2C_RDRW_IOCTL_MAX_MSGS)
+      SOFT_ERROR(PI_TOO_MANY_SEGS, "too many segments (%d)", numSegs);
+
+   rdwr.msgs = segs;
    rdwr.nmsgs = numSegs;
 
    retval = ioctl(i2cInfo[handle].fd, PI_I2C_RDWR, &rdwr);
@@ -5684,2063 +6505,2055 @@ unsigned alert_delays[]=
    400000, 450000, 514285, 600000, 720000, 900000, 1200000, 1800000
 };
 
-/* ======================================================================= */
+/* ----------------------------------------------------------------------- */
 
-static void alertGlitchFilter(gpioSample_t *sample, int numSamples)
+static void alertUpdateMonitorBits(void)
 {
-   int i, j, diff;
-   uint32_t steadyUs, changedTick, RBitV, LBitV, initialised;
-   uint32_t bit, bitV;
-
-   for (i=0; i<=PI_MAX_USER_GPIO; i++)
-   {
-      bit = (1<<i);
-
-      if (monitorBits & bit & gFilterBits)
-      {
-         initialised = gpioAlert[i].gfInitialised;
-         if (!initialised && numSamples > 0)
-         {
-           /* Initialise filter with first sample */
-           bitV = sample[0].level & bit;
-           gpioAlert[i].gfRBitV = bitV;
-           gpioAlert[i].gfLBitV = bitV;
-           gpioAlert[i].gfTick = sample[0].tick;
-           gpioAlert[i].gfInitialised = 1;
-         }
+   /* call after changing any of the per feature GPIO masks */
 
-         steadyUs    = gpioAlert[i].gfSteadyUs;
-         RBitV       = gpioAlert[i].gfRBitV;
-         LBitV       = gpioAlert[i].gfLBitV;
-         changedTick = gpioAlert[i].gfTick;
+   monitorBits = alertBits | notifyBits | scriptBits | meterBits |
+                 encoderBits | sniffBits | serialBits | captureBits |
+                 gpioGetSamples.bits;
+}
 
-         for (j=0; j<numSamples; j++)
-         {
-            bitV = sample[j].level & bit;
+/* ======================================================================= */
 
-            if (bitV != LBitV)
-            {
-               /* Difference between level and last level.
-                  Restart steady timer. */
+static void notifyWriterMutex(int lock)
+{
+   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+   if (lock) pthread_mutex_lock(&mutex);
+   else      pthread_mutex_unlock(&mutex);
+}
 
-               changedTick = sample[j].tick;
-               LBitV = bitV;
-            }
+static void notifyQueueEmit(int n, gpioReport_t *report, int emit)
+{
+   gpioNotify_t *h = &gpioNotify[n];
+   uint32_t head, space;
+   int i;
 
-            if (bitV != RBitV)
-            {
-               /* Difference between level and reported level. */
+   head = h->qHead;
 
-               diff = sample[j].tick - changedTick;
+   space = NOTIFY_QUEUE_LEN -
+      (head - __atomic_load_n(&h->qTail, __ATOMIC_ACQUIRE));
 
-               if (diff >= steadyUs)
-               {
-                  /* Level stable for steady period. */
-                  RBitV = bitV;
-               }
-               else
-               {
-                  /* Keep reporting old level. */
+   /* never wait for the consumer, drop what doesn't fit */
 
-                  sample[j].level ^= bit;
-               }
-            }
+   if (emit > space)
+   {
+      h->qDrops += (emit - space);
+      gpioStats.notifyDrops += (emit - space);
+      emit = space;
+   }
 
-         }
+   for (i=0; i<emit; i++)
+      notifyQueue[n][(head+i) & (NOTIFY_QUEUE_LEN-1)] = report[i];
 
-         gpioAlert[i].gfRBitV = RBitV;
-         gpioAlert[i].gfLBitV = LBitV;
-         gpioAlert[i].gfTick  = changedTick;
-      }
-   }
+   __atomic_store_n(&h->qHead, head+emit, __ATOMIC_RELEASE);
 }
 
-static void alertNoiseFilter(gpioSample_t *sample, int numSamples)
+static void notifyWriterWake(void)
 {
-   int i, j, diff;
-   uint32_t LBitV;
-   uint32_t bit, bitV;
-   uint32_t nowTick;
+   uint64_t one = 1;
 
-   for (i=0; i<=PI_MAX_USER_GPIO; i++)
-   {
-      bit = (1<<i);
-
-      if (monitorBits & bit & nFilterBits)
-      {
-         LBitV = gpioAlert[i].nfLBitV;
+   /*
+   The queue heads were stored with release only.  Without a full
+   fence the load of the waiting flag may pass them and miss a writer
+   which is about to sleep.  Pairs with the fence in the writer.
+   */
 
-         for (j=0; j<numSamples; j++)
-         {
-            bitV = sample[j].level & bit;
-            nowTick = sample[j].tick;
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-            if (gpioAlert[i].nfActive) /* reporting events */
-            {
-               diff = nowTick - gpioAlert[i].nfTick2;
+   if (__atomic_load_n(&notifyWriterWaiting, __ATOMIC_SEQ_CST))
+   {
+      if (write(fdNotifyWake, &one, sizeof(one)) < 0) { /* ignore errors */ }
+   }
+}
 
-               if (diff >= 0)
-               {
-                  /* Stop reporting gpio changes */
+static uint32_t notifyEncode(int n)
+{
+   gpioNotify_t *h = &gpioNotify[n];
+   uint32_t head, tail, len;
 
-                  gpioAlert[i].nfActive = 0;
-                  gpioAlert[i].nfTick1 = nowTick;
-               }
-            }
-            else /* waiting for steady us */
-            {
-               if (bitV != LBitV)
-               {
-                  diff = nowTick - gpioAlert[i].nfTick1;
-                  gpioAlert[i].nfTick1 = nowTick;
+   /* encodes queued reports into the v2 buffer, returns bytes buffered */
 
-                  if (diff >= gpioAlert[i].nfSteadyUs)
-                  {
-                     /* Start reporting gpio changes */
+   if (h->v2Offset == h->v2Len) h->v2Offset = h->v2Len = 0;
 
-                     gpioAlert[i].nfRBitV = LBitV;
-                     gpioAlert[i].nfActive = 1;
-                     gpioAlert[i].nfTick2 =
-                        nowTick + gpioAlert[i].nfActiveUs;
-                  }
-               }
-            }
+   if (h->v2Offset)
+   {
+      memmove(notifyV2Buf[n],
+         notifyV2Buf[n] + h->v2Offset, h->v2Len - h->v2Offset);
 
-            if (!gpioAlert[i].nfActive)
-            {
-               if (bitV != gpioAlert[i].nfRBitV)
-                  sample[j].level ^= bit;
-            }
+      h->v2Len -= h->v2Offset;
+      h->v2Offset = 0;
+   }
 
-            LBitV = bitV;
-         }
+   head = __atomic_load_n(&h->qHead, __ATOMIC_ACQUIRE);
+   tail = h->qTail;
+   len  = h->v2Len;
 
-         gpioAlert[i].nfLBitV = LBitV;
+   while ((tail != head) &&
+          ((NOTIFY_V2_BUF - len) >= (PI_NOTIFY_V2_MAX_RECORD + 4)))
+   {
+      len += cmdNotifyEncode(&h->codec,
+         &notifyQueue[n][tail & (NOTIFY_QUEUE_LEN-1)], notifyV2Buf[n] + len);
 
-      }
+      tail++;
    }
+
+   __atomic_store_n(&h->qTail, tail, __ATOMIC_RELEASE);
+
+   h->v2Len = len;
+
+   return len;
 }
 
-static void alertEmit(
-   gpioSample_t *sample, int numSamples, uint32_t changedBits, uint32_t eTick)
+static int notifyWrite(int n)
 {
-   uint32_t oldLevel, newLevel;
-   int32_t diff;
-   int emit, seqno, emitted;
-   uint32_t changes, bits, timeoutBits, eventBits;
-   int d;
-   int b, n, v;
-   int err;
-   int max_emits;
-   char fifo[32];
-   /* ensure space for maximum number of watchdog and event notifications */
-   gpioReport_t report[MAX_REPORT+PI_MAX_USER_GPIO+1+PI_MAX_EVENT+1];
+   gpioNotify_t *h = &gpioNotify[n];
+   uint32_t head, tail, idx, count, first;
+   struct iovec iov[2];
+   struct msghdr msg;
+   int iovs;
+   ssize_t err;
+   size_t want, done;
 
-   if (changedBits)
+   /* returns 1 if the fd would block, -1 on error, otherwise 0 */
+
+   head = __atomic_load_n(&h->qHead, __ATOMIC_ACQUIRE);
+   tail = h->qTail;
+
+   if (h->format == PI_NOTIFY_FORMAT_V2)
    {
-      if (gpioGetSamples.func)
+      if (!notifyEncode(n)) return 0;
+
+      iov[0].iov_base = notifyV2Buf[n] + h->v2Offset;
+      iov[0].iov_len  = h->v2Len - h->v2Offset;
+      iovs = 1;
+   }
+   else
+   {
+      if (head == tail) return 0;
+
+      count = head - tail;
+      idx   = tail & (NOTIFY_QUEUE_LEN-1);
+      first = NOTIFY_QUEUE_LEN - idx;
+
+      if (first > count) first = count;
+
+      iov[0].iov_base = (char *)&notifyQueue[n][idx] + h->qOffset;
+      iov[0].iov_len  = (first * sizeof(gpioReport_t)) - h->qOffset;
+      iovs = 1;
+
+      if (count > first)
       {
-         if (gpioGetSamples.ex)
-         {
-            (gpioGetSamples.func)
-               (sample, numSamples, gpioGetSamples.userdata);
-         }
-         else
-         {
-            (gpioGetSamples.func)(sample, numSamples);
-         }
+         iov[1].iov_base = &notifyQueue[n][0];
+         iov[1].iov_len  = (count - first) * sizeof(gpioReport_t);
+         iovs = 2;
       }
    }
 
-   eventBits = 0;
+   want = iov[0].iov_len + ((iovs > 1) ? iov[1].iov_len : 0);
 
-   if (bscFR != (bscsReg[BSC_FR]&0xffff))
+   if (h->pipe) err = writev(h->fd, iov, iovs);
+   else
    {
-      bscFR = bscsReg[BSC_FR]&0xffff;
-      eventAlert[PI_EVENT_BSC].fired = 1;
+      /* the socket is shared with the command path so stays blocking */
+
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov    = iov;
+      msg.msg_iovlen = iovs;
+
+      err = sendmsg(h->fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
    }
 
-   for (b=0; b<=PI_MAX_EVENT; b++)
+   if (err < 0)
    {
-      if (eventAlert[b].fired && (!eventAlert[b].ignore))
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
       {
-         eventBits |= (1<<b);
-
-         if (eventAlert[b].func)
-         {
-            if (eventAlert[b].ex)
-            {
-               (eventAlert[b].func)(b, eTick, eventAlert[b].userdata);
-            }
-            else
-            {
-               (eventAlert[b].func)(b, eTick);
-            }
-         }
+         gpioStats.wouldBlockPipeWrite++;
+         return 1;
       }
 
-      eventAlert[b].fired = 0;
-   }
+      DBG(DBG_ALWAYS, "fd=%d err=%zd errno=%d", h->fd, err, errno);
 
-   /* call alert callbacks for each bit transition */
+      DBG(DBG_ALWAYS, "%s", strerror(errno));
 
-   if (changedBits & alertBits)
+      h->failed = 1;
+      return -1;
+   }
+
+   if (h->format == PI_NOTIFY_FORMAT_V2)
    {
-      oldLevel = (reportedLevel & alertBits);
+      h->v2Offset += err;
+   }
+   else
+   {
+      /* a short write may end part way through a report */
 
-      for (d=0; d<numSamples; d++)
-      {
-         newLevel = (sample[d].level & alertBits);
+      done = h->qOffset + err;
 
-         if (newLevel != oldLevel)
-         {
-            changes = (newLevel ^ oldLevel);
+      h->qOffset = done % sizeof(gpioReport_t);
 
-            for (b=0; b<=PI_MAX_USER_GPIO; b++)
-            {
-               if (changes & (1<<b))
-               {
-                  if (newLevel & (1<<b)) v = 1; else v = 0;
+      __atomic_store_n(
+         &h->qTail, tail + (done / sizeof(gpioReport_t)), __ATOMIC_RELEASE);
+   }
 
-                  if (gpioAlert[b].func)
-                  {
-                     if (gpioAlert[b].ex)
-                     {
-                        (gpioAlert[b].func)
-                           (b, v, sample[d].tick,
-                            gpioAlert[b].userdata);
-                     }
-                     else
-                     {
-                        (gpioAlert[b].func)(b, v, sample[d].tick);
-                     }
-                  }
-               }
-            }
-            oldLevel = newLevel;
-         }
-      }
+   if ((size_t)err < want)
+   {
+      gpioStats.shortPipeWrite++;
+      return 1;
    }
 
-   /* check for watchdog timeouts */
+   gpioStats.goodPipeWrite++;
 
-   timeoutBits = 0;
+   return 0;
+}
+
+static void *pthNotifyWriterThread(void *x)
+{
+   struct pollfd pfd[PI_NOTIFY_SLOTS+1];
+   uint32_t blocked;
+   uint64_t val;
+   int n, npfd, pending, cancelState;
 
-   if (wdogBits)
+   /*
+      Drains the notification queues filled by the alert thread.
+      Writes never block, a consumer which is not keeping up is
+      polled until writable while the others continue.
+   */
+
+   while (1)
    {
-      for (b=0; b<=PI_MAX_USER_GPIO; b++)
-      {
-         if (gpioAlert[b].wdSteadyUs)
-         {
-            diff = eTick - gpioAlert[b].wdTick;
+      pfd[0].fd = fdNotifyWake;
+      pfd[0].events = POLLIN;
+      npfd = 1;
 
-            if (diff >= gpioAlert[b].wdSteadyUs)
-            {
-               timeoutBits |= (1<<b);
+      blocked = 0;
 
-               gpioAlert[b].wdTick = eTick;
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
 
-               if (gpioAlert[b].func)
-               {
-                  if (gpioAlert[b].ex)
-                  {
-                     (gpioAlert[b].func)(b, PI_TIMEOUT, eTick,
-                                            gpioAlert[b].userdata);
-                  }
-                  else
-                  {
-                     (gpioAlert[b].func)(b, PI_TIMEOUT, eTick);
-                  }
-               }
+      notifyWriterMutex(1);
+
+      for (n=0; n<PI_NOTIFY_SLOTS; n++)
+      {
+         if ((gpioNotify[n].state >= PI_NOTIFY_OPENED) &&
+             (!gpioNotify[n].ring) && (!gpioNotify[n].failed))
+         {
+            if (notifyWrite(n) == 1)
+            {
+               blocked |= (1U<<n);
+               pfd[npfd].fd = gpioNotify[n].fd;
+               pfd[npfd].events = POLLOUT;
+               npfd++;
             }
          }
       }
-   }
 
-   for (n=0; n<PI_NOTIFY_SLOTS; n++)
-   {
-      if (gpioNotify[n].state == PI_NOTIFY_CLOSING)
-      {
-         if (gpioNotify[n].pipe)
-         {
-            DBG(DBG_INTERNAL, "close notify pipe %d", gpioNotify[n].fd);
-            close(gpioNotify[n].fd);
+      notifyWriterMutex(0);
 
-            sprintf(fifo, "/dev/pigpio%d", n);
+      pthread_setcancelstate(cancelState, NULL);
 
-            unlink(fifo);
-         }
+      /* sleep unless reports arrived for an unblocked consumer */
 
-         gpioNotify[n].state = PI_NOTIFY_CLOSED;
-      }
-      else if (gpioNotify[n].state >= PI_NOTIFY_OPENED)
-      {
-         bits = gpioNotify[n].bits;
+      __atomic_store_n(&notifyWriterWaiting, 1, __ATOMIC_SEQ_CST);
 
-         emit = 0;
+      /* pairs with the fence in notifyWriterWake */
 
-         seqno = gpioNotify[n].seqno;
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-         if (gpioNotify[n].state == PI_NOTIFY_RUNNING)
+      pending = 0;
+
+      for (n=0; n<PI_NOTIFY_SLOTS; n++)
+      {
+         if ((!(blocked & (1U<<n))) &&
+             (gpioNotify[n].state >= PI_NOTIFY_OPENED) &&
+             (!gpioNotify[n].ring) &&
+             (__atomic_load_n(&gpioNotify[n].qHead, __ATOMIC_SEQ_CST) !=
+                gpioNotify[n].qTail))
          {
-            /* check to see if any bits have changed for this
-               notification.
+            pending = 1;
+            break;
+         }
+      }
 
-               bits         is the set of notification bits
-               changedBits is the set of changed bits
-            */
+      if (!pending) poll(pfd, npfd, 1000);
 
-            if (changedBits & bits)
-            {
-               oldLevel = reportedLevel & bits;
+      __atomic_store_n(&notifyWriterWaiting, 0, __ATOMIC_SEQ_CST);
 
-               for (d=0; d<numSamples; d++)
-               {
-                  newLevel = sample[d].level & bits;
+      if (read(fdNotifyWake, &val, sizeof(val)) < 0) { /* ignore errors */ }
+   }
 
-                  if (newLevel != oldLevel)
-                  {
-                     report[emit].seqno = seqno;
-                     report[emit].flags = 0;
-                     report[emit].tick  = sample[d].tick;
-                     report[emit].level = sample[d].level;
+   return 0;
+}
 
-                     oldLevel = newLevel;
+static void notifyRingEmit(int n, gpioReport_t *report, int emit)
+{
+   gpioNotifyRing_t *ring = gpioNotify[n].ring;
+   gpioReport_t *entry = PI_NOTIFY_RING_REPORTS(ring);
+   uint32_t size, head, used, space;
+   int i;
 
-                     emit++;
-                     seqno++;
-                  }
-               }
-            }
+   /* the size is private, the reader can only corrupt its own view */
 
-            /* check to see if any watchdogs are due for this
-               notification.
+   size = gpioNotify[n].ringSize;
 
-               bits        is the set of notification bits
-               timeoutBits is the set of timed out bits
-            */
+   head = ring->head;
 
-            bits = gpioNotify[n].bits;
+   used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
 
-            if (timeoutBits & bits)
-            {
-               /* at least one watchdog has fired for this
-                  notification.
-               */
+   if (used < size) space = size - used; else space = 0;
 
-               for (b=0; b<=PI_MAX_USER_GPIO; b++)
-               {
-                  if (timeoutBits & bits & (1<<b))
-                  {
-                     if (numSamples)
-                        newLevel = sample[numSamples-1].level;
-                     else
-                        newLevel = reportedLevel;
+   /* never wait for the reader, drop what doesn't fit */
 
-                     report[emit].seqno = seqno;
-                     report[emit].flags =
-                        PI_NTFY_FLAGS_WDOG | PI_NTFY_FLAGS_BIT(b);
-                     report[emit].tick  = eTick;
-                     report[emit].level = newLevel;
+   if (emit > space)
+   {
+      ring->overruns += (emit - space);
+      gpioStats.ringOverruns += (emit - space);
+      emit = space;
+   }
 
-                     emit++;
-                     seqno++;
-                  }
-               }
-            }
-         }
+   for (i=0; i<emit; i++) entry[(head+i) & (size-1)] = report[i];
 
-         /* check to see if any events are due
+   __atomic_store_n(&ring->head, head+emit, __ATOMIC_SEQ_CST);
 
-            eventBits is the set of events
-         */
+   if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST))
+      syscall(SYS_futex, &ring->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
 
-         if (eventBits & gpioNotify[n].eventBits)
-         {
-            for (b=0; b<=PI_MAX_EVENT; b++)
-            {
-               if (eventBits & gpioNotify[n].eventBits & (1<<b))
-               {
-                  if (numSamples)
-                     newLevel = sample[numSamples-1].level;
-                  else
-                     newLevel = reportedLevel;
+static void notifyRingClose(int n)
+{
+   gpioNotifyRing_t *ring = gpioNotify[n].ring;
+   char name[32];
 
-                  report[emit].seqno = seqno;
-                  report[emit].flags = 
-                     PI_NTFY_FLAGS_EVENT | PI_NTFY_FLAGS_BIT(b);
-                  report[emit].tick  = eTick;
-                  report[emit].level = newLevel;
+   DBG(DBG_INTERNAL, "close notify ring %d", n);
 
-                  emit++;
-                  seqno++;
-               }
-            }
-         }
+   __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
 
-         if (!emit)
-         {
-            if ((int)(eTick - gpioNotify[n].lastReportTick) > 60000000)
-            {
-               if (numSamples)
-                  newLevel = sample[numSamples-1].level;
-               else
-                  newLevel = reportedLevel;
+   syscall(SYS_futex, &ring->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
 
-               report[emit].seqno = seqno;
-               report[emit].flags = PI_NTFY_FLAGS_ALIVE;
-               report[emit].tick  = eTick;
-               report[emit].level = newLevel;
+   munmap(ring, PI_NOTIFY_RING_BYTES(gpioNotify[n].ringSize));
 
-               emit++;
-               seqno++;
-            }
-         }
+   sprintf(name, PI_NOTIFY_RING_NAME, n);
 
-         if (emit)
-         {
-            DBG(DBG_FAST_TICK, "notification %d (%d reports, %x-%x)",
-               n, emit, report[0].seqno,  report[emit-1].seqno);
-            gpioNotify[n].lastReportTick = eTick;
-            max_emits = gpioNotify[n].max_emits;
+   shm_unlink(name);
 
-            if (emit > gpioStats.maxEmit) gpioStats.maxEmit = emit;
-
-            emitted = 0;
-
-            while (emit > 0)
-            {
-               if (emit > max_emits)
-               {
-                  gpioStats.emitFrags++;
+   gpioNotify[n].ring = NULL;
+}
 
-                  err = write(gpioNotify[n].fd,
-                           report+emitted,
-                           max_emits*sizeof(gpioReport_t));
+static void callbackStatMax(volatile uint32_t *stat, uint32_t val)
+{
+   uint32_t old;
 
-                  if (err != (max_emits*sizeof(gpioReport_t)))
-                  {
-                     if (err < 0)
-                     {
-                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                        {
-                           /* serious error, no point continuing */
+   old = __atomic_load_n(stat, __ATOMIC_RELAXED);
 
-                           DBG(DBG_ALWAYS, "fd=%d err=%d errno=%d",
-                              gpioNotify[n].fd, err, errno);
+   while ((val > old) &&
+          !__atomic_compare_exchange_n(
+             stat, &old, val, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
 
-                           DBG(DBG_ALWAYS, "%s", strerror(errno));
+static void callbackRun(cbJob_t *job)
+{
+   uint32_t startTick, latency;
+   int b = job->gpio;
 
-                           gpioNotify[n].bits  = 0;
-                           gpioNotify[n].state = PI_NOTIFY_CLOSING;
-                           intNotifyBits();
-                           break;
-                        }
-                        else gpioStats.wouldBlockPipeWrite++;
-                     }
-                     else
-                     {
-                        gpioStats.shortPipeWrite++;
-                        DBG(DBG_ALWAYS, "emitted %zd, asked for %d",
-                           err/sizeof(gpioReport_t), max_emits);
-                     }
-                  }
-                  else
-                  {
-                     gpioStats.goodPipeWrite++;
-                  }
+   startTick = systReg[SYST_CLO];
 
-                  emitted += max_emits;
-                  emit    -= max_emits;
-               }
-               else
-               {
-                  err = write(gpioNotify[n].fd,
-                           report+emitted,
-                           emit*sizeof(gpioReport_t));
+   latency = startTick - job->queued;
 
-                  if (err != (emit*sizeof(gpioReport_t)))
-                  {
-                     if (err < 0)
-                     {
-                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
-                        {
-                           DBG(DBG_ALWAYS, "fd=%d err=%d errno=%d",
-                              gpioNotify[n].fd, err, errno);
-
-                           DBG(DBG_ALWAYS, "%s", strerror(errno));
-
-                           /* serious error, no point continuing */
-                           gpioNotify[n].bits  = 0;
-                           gpioNotify[n].state = PI_NOTIFY_CLOSING;
-                           intNotifyBits();
-                           break;
-                        }
-                        else gpioStats.wouldBlockPipeWrite++;
-                     }
-                     else
-                     {
-                        gpioStats.shortPipeWrite++;
-                        DBG(DBG_ALWAYS, "emitted %zd, asked for %d",
-                           err/sizeof(gpioReport_t), emit);
-                     }
-                  }
-                  else
-                  {
-                     gpioStats.goodPipeWrite++;
-                  }
+   /* the function is looked up now so a cancelled callback isn't run */
 
-                  emitted += emit;
-                  emit = 0;
-               }
+   switch (job->type)
+   {
+      case CB_ALERT:
+         if (gpioAlert[b].func)
+         {
+            if (gpioAlert[b].ex)
+            {
+               (gpioAlert[b].func)
+                  (b, job->level, job->tick, gpioAlert[b].userdata);
+            }
+            else
+            {
+               (gpioAlert[b].func)(b, job->level, job->tick);
             }
-
-            gpioNotify[n].seqno = seqno;
          }
-      }
-   }
+         break;
 
-   if (changedBits & scriptBits)
-   {
-      for (n=0; n<PI_MAX_SCRIPTS; n++)
-      {
-         if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
-             (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
-             (gpioScript[n].waitBits & changedBits))
+      case CB_EVENT:
+         if (eventAlert[b].func)
          {
-            pthread_mutex_lock(&gpioScript[n].pthMutex);
-
-            if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
+            if (eventAlert[b].ex)
             {
-               gpioScript[n].changedBits =
-                  gpioScript[n].waitBits & changedBits;
-               pthread_cond_signal(&gpioScript[n].pthCond);
+               (eventAlert[b].func)(b, job->tick, eventAlert[b].userdata);
+            }
+            else
+            {
+               (eventAlert[b].func)(b, job->tick);
             }
-
-            pthread_mutex_unlock(&gpioScript[n].pthMutex);
          }
-      }
-   }
+         break;
 
-   if (eventBits & scriptEventBits)
-   {
-      for (n=0; n<PI_MAX_SCRIPTS; n++)
-      {
-         if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
-             (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
-             (gpioScript[n].eventBits & eventBits))
+      case CB_SAMPLES:
+         if (gpioGetSamples.func)
          {
-            pthread_mutex_lock(&gpioScript[n].pthMutex);
-
-            if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
+            if (gpioGetSamples.ex)
             {
-               gpioScript[n].changedBits =
-                  gpioScript[n].eventBits & eventBits;
-               pthread_cond_signal(&gpioScript[n].pthCond);
+               (gpioGetSamples.func)
+                  (job->samples, job->numSamples, gpioGetSamples.userdata);
+            }
+            else
+            {
+               (gpioGetSamples.func)(job->samples, job->numSamples);
             }
-
-            pthread_mutex_unlock(&gpioScript[n].pthMutex);
          }
-      }
+         break;
    }
 
-   if (numSamples) reportedLevel = sample[numSamples-1].level;
+   __atomic_add_fetch(&gpioStats.cbRun, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&gpioStats.cbTotalLatency, latency, __ATOMIC_RELAXED);
+
+   callbackStatMax(&gpioStats.cbMaxLatency, latency);
+   callbackStatMax(&gpioStats.cbMaxDuration, systReg[SYST_CLO] - startTick);
 }
 
-static void alertWdogCheck(gpioSample_t *sample, int numSamples)
+static void callbackQueue(cbJob_t *job, int *queued)
 {
+   cbQueue_t *q;
+   gpioSample_t *samples;
+   uint32_t head;
+   int w;
+
+   job->queued = systReg[SYST_CLO];
+
    /*
-   Go through and set the last time each GPIO with a watchdog changed state.
+      Run on the alert thread if there are no workers, or for the
+      library's own decoders (which share state with their API calls).
    */
 
-   int i, j;
-   uint32_t LBitV;
-   uint32_t bit;
+   if ((!pthCallbackWorkersRunning) ||
+       ((job->type == CB_ALERT) &&
+        (gpioAlert[job->gpio].func == (callbk_t)waveRxBit)))
+   {
+      callbackRun(job);
+      return;
+   }
+
+   /* a GPIO (or event) always uses the same worker to keep its order */
 
-   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   if (job->type == CB_SAMPLES) w = 0;
+   else w = job->gpio % pthCallbackWorkersRunning;
+
+   q = &cbQueue[w];
+
+   head = q->head;
+
+   if ((head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) >= CB_QUEUE_LEN)
+   {
+      gpioStats.cbDropped++;
+      return;
+   }
+
+   if (job->type == CB_SAMPLES)
    {
-      bit = (1<<i);
+      /* the sample buffer is reused by the alert thread, copy to a slot */
 
-      if (monitorBits & bit & wdogBits)
+      if ((job->numSamples > MAX_REPORT) ||
+          ((cbSamplesHead - __atomic_load_n(&cbSamplesTail, __ATOMIC_ACQUIRE))
+             >= CB_SAMPLE_SLOTS))
       {
-         LBitV = gpioAlert[i].wdLBitV;
+         gpioStats.cbDropped++;
+         return;
+      }
 
-         for (j=0; j<numSamples; j++)
-         {
-            if ((sample[j].level & bit) != LBitV)
-            {
-               LBitV = sample[j].level & bit;
-               gpioAlert[i].wdTick = sample[j].tick;
-            }
-         }
+      samples = job->samples;
 
-         gpioAlert[i].wdLBitV = LBitV;
-      }
+      job->samples =
+         cbSamples + ((cbSamplesHead++ & (CB_SAMPLE_SLOTS-1)) * MAX_REPORT);
+
+      memcpy(job->samples, samples, job->numSamples * sizeof(gpioSample_t));
    }
+
+   q->job[head & (CB_QUEUE_LEN-1)] = *job;
+
+   __atomic_store_n(&q->head, head+1, __ATOMIC_SEQ_CST);
+
+   *queued |= (1<<w);
 }
 
-static void * pthAlertThread(void *x)
+static void callbackWake(int queued)
 {
-   struct timespec req, rem;
-   uint32_t oldLevel, newLevel, level;
-   uint32_t oldSlot,  newSlot;
-   uint32_t expected, ft, sTick;
-   uint32_t changedBits;
-   int32_t diff, minDiff, stickInited;
-   int cycle, pulse;
-   int numSamples, ticks, i;
-   int rp, reports, totalSamples;
-   int stopped;
-   int moreToDo;
-   gpioSample_t sample[MAX_SAMPLE];
+   int w;
 
-   req.tv_sec = 0;
+   for (w=0; w<pthCallbackWorkersRunning; w++)
+   {
+      if ((queued & (1<<w)) &&
+          __atomic_load_n(&cbQueue[w].waiting, __ATOMIC_SEQ_CST))
+      {
+         ringWake(&cbQueue[w].head);
+      }
+   }
+}
 
-   /* don't start until DMA started */
+static void *pthCallbackWorkerThread(void *x)
+{
+   cbQueue_t *q = x;
+   cbJob_t *job;
+   uint32_t head, tail;
 
-   spinWhileStarting();
+   tail = q->tail;
 
-   reportedLevel = gpioReg[GPLEV0];
+   while (1)
+   {
+      pthread_testcancel();
 
-   oldLevel = reportedLevel;
+      head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
 
-   oldSlot = dmaCurrentSlot(dmaNowAtICB());
+      if (head == tail)
+      {
+         /* park until the alert thread queues more */
 
-   oldSlot = (oldSlot / PULSE_PER_CYCLE) * PULSE_PER_CYCLE;
+         __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
 
-   cycle = (oldSlot/PULSE_PER_CYCLE);
+         if (__atomic_load_n(&q->head, __ATOMIC_SEQ_CST) == tail)
+            ringPark(&q->head, tail);
 
-   pulse = 0;
+         __atomic_store_n(&q->waiting, 0, __ATOMIC_SEQ_CST);
 
-   stopped = 0;
+         continue;
+      }
 
-   moreToDo = 0;
+      job = &q->job[tail & (CB_QUEUE_LEN-1)];
 
-   stickInited = 0;
+      callbackRun(job);
 
-   sTick = 0;
+      if (job->type == CB_SAMPLES)
+         __atomic_add_fetch(&cbSamplesTail, 1, __ATOMIC_RELEASE);
 
-   minDiff = gpioCfg.clockMicros / 2;
+      __atomic_store_n(&q->tail, ++tail, __ATOMIC_RELEASE);
+   }
 
-   while (1)
-   {
-      /* Check that DMA is running okay */
+   return NULL;
+}
 
-      if (dmaIn[DMA_CONBLK_AD])
-      {
-         if (stopped)
-         {
-            DBG(DBG_STARTUP, "****** GOING ******");
-            stopped = 0;
-         }
-      }
-      else
-      {
-         stopped = 1;
+static uint32_t alertMeterNanos(uint64_t micros, uint32_t count)
+{
+   uint64_t nanos;
 
-         myGpioDelay(5000);
+   if (!count) return 0;
 
-         if (runState == PI_RUNNING)
-         {
-            /* should never be executed, leave code just in case */
+   nanos = (micros * 1000) / count;
 
-            gpioCfg.internals |= PI_CFG_STATS;
+   if (nanos > 0xFFFFFFFF) return 0xFFFFFFFF;
 
-            dmaInitCbs();
-            flushMemory();
-            //cast twice to suppress compiler warning, I belive this cast is ok
-            //because dmaIbus contains bus addresses, not user addresses. --plugwash
-            initDMAgo((uint32_t *)dmaIn, (uint32_t)(uintptr_t)dmaIBus[0]);
-            myGpioDelay(5000); /* let DMA run for a while */
-            oldSlot = dmaCurrentSlot(dmaNowAtICB());
-            gpioStats.DMARestarts++;
-         }
-      }
+   return nanos;
+}
 
-      newSlot = dmaCurrentSlot(dmaNowAtICB());
+static void alertMeterClose(meterInfo_t *m, uint32_t eTick)
+{
+   uint32_t window, span;
+   gpioMeter_t *r = &m->result;
 
-      newSlot = (newSlot / PULSE_PER_CYCLE) * PULSE_PER_CYCLE;
+   if (m->level) m->high += (eTick - m->edgeTick);
 
-      numSamples = 0;
+   window = eTick - m->start;
 
-      /*
-      Extract samples from DMA ring buffer.
-      */
+   if (m->rises > 1) span = m->lastRise - m->firstRise;
+   else              span = 0;
 
-      while ((oldSlot != newSlot) && (numSamples < MAX_SAMPLE))
-      {
-         level = myGetLevel(oldSlot++);
+   r->window = window;
+   r->edges  = m->rises;
 
-         sample[numSamples].tick  = sTick;
-         sample[numSamples].level = level;
+   /* frequency and period are from the first to the last rising edge */
 
-         numSamples++;
+   if (span)
+   {
+      r->frequency = ((uint64_t)(m->rises - 1) * 1000000000) / span;
+      r->period    = alertMeterNanos(span, m->rises - 1);
+   }
+   else
+   {
+      r->frequency = 0;
+      r->period    = 0;
+   }
 
-         sTick += gpioCfg.clockMicros;
+   r->pulse = alertMeterNanos(m->high, m->falls);
+   r->duty  = ((uint64_t)m->high * 1000000) / window;
 
-         if (++pulse >= PULSE_PER_CYCLE)
-         {
-            pulse = 0;
+   m->start    = eTick;
+   m->edgeTick = eTick;
+   m->rises    = 0;
+   m->falls    = 0;
+   m->high     = 0;
+}
 
-            if (++cycle >= bufferCycles)
-            {
-               cycle = 0;
-               oldSlot = 0;
-            }
+static void alertMeter(gpioSample_t *sample, int numSamples, uint32_t eTick)
+{
+   /*
+   Count the edges and the time high of each metered GPIO.  The
+   results are published at the end of each window.
+   */
 
-            expected = sTick;
+   int b, d, level;
+   uint32_t bit, tick;
+   meterInfo_t *m;
 
-            sTick = myGetTick(cycle);
+   pthread_mutex_lock(&meterMutex);
 
-            if (stickInited)
-            {
-               diff = sTick - expected;
+   for (b=0; b<=PI_MAX_USER_GPIO; b++)
+   {
+      bit = (1<<b);
 
-               if (abs(diff) > minDiff)
-               {
-                  ft = sample[numSamples-PULSE_PER_CYCLE].tick;
+      if (!(meterBits & bit)) continue;
 
-                  ticks = sTick - ft;
+      m = &meterInfo[b];
 
-                  for (i=1; i<PULSE_PER_CYCLE; i++)
-                  {
-                     sample[numSamples-PULSE_PER_CYCLE+i].tick =
-                        ((i*ticks)/PULSE_PER_CYCLE) + ft;
-                  }
-               }
+      for (d=0; d<numSamples; d++)
+      {
+         level = (sample[d].level & bit) ? 1 : 0;
 
-               diff += (TICKSLOTS/2);
+         if (level != m->level)
+         {
+            tick = sample[d].tick;
 
-               if (diff < 0)
-               {
-                  gpioStats.diffTick[0]++;
-               }
+            /* ignore samples from before the meter was started */
 
-               else if (diff >= TICKSLOTS)
-               {
-                  gpioStats.diffTick[TICKSLOTS-1]++;
-               }
+            if ((int32_t)(tick - m->start) < 0) continue;
 
-               else gpioStats.diffTick[diff]++;
+            if (m->level) m->high += (tick - m->edgeTick);
+
+            if (level)
+            {
+               if (!m->rises) m->firstRise = tick;
+               m->lastRise = tick;
+               m->rises++;
+               m->result.rising++;
             }
             else
             {
-               stickInited = 1;
-               numSamples = 0;
-               if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
-               {
-                  pthAlertRunning = PI_THREAD_RUNNING;
-               }
+               m->falls++;
+               m->result.falling++;
             }
+
+            m->level    = level;
+            m->edgeTick = tick;
          }
       }
 
-      if (oldSlot == newSlot) moreToDo = 0; else moreToDo = 1;
+      if ((int32_t)(eTick - m->start) >= (int32_t)m->window)
+         alertMeterClose(m, eTick);
+   }
 
-      /* Apply glitch filter */
+   pthread_mutex_unlock(&meterMutex);
+}
 
-      if (numSamples && gFilterBits) alertGlitchFilter(sample, numSamples);
+/*
+   Quadrature steps indexed by (old levels << 2) | new levels, where
+   levels is (A << 1) | B.  A leading B counts up.  Both A and B
+   changing between samples is an error (ENCODER_ERR).
+*/
 
-      /* Apply noise filter */
+#define ENCODER_ERR 2
 
-      if (numSamples && nFilterBits) alertNoiseFilter(sample, numSamples);
+#define ENCODER_VELOCITY_MICROS 100000
 
-      /* Compact samples */
+static const int8_t encoderStep[16]=
+{
+    0,          -1,           1, ENCODER_ERR,
+    1,           0, ENCODER_ERR,          -1,
+   -1, ENCODER_ERR,           0,           1,
+   ENCODER_ERR,  1,          -1,           0,
+};
 
-      changedBits = 0;
-      oldLevel &= monitorBits;
-      reports = 0;
-      totalSamples = 0;
+static void alertEncoder(
+   gpioSample_t *sample, int numSamples, uint32_t eTick)
+{
+   /*
+   Decode the quadrature encoders from the samples, then update
+   their velocity and trigger any position events which are due.
+   */
 
-      for (rp=0; rp<numSamples; rp++)
+   int h, d, levels, levelI, step;
+   uint32_t level, elapsed;
+   encoderInfo_t *e;
+
+   pthread_mutex_lock(&encoderMutex);
+
+   for (h=0; h<PI_MAX_ENCODERS; h++)
+   {
+      e = &encoderInfo[h];
+
+      if (e->state != PI_ENCODER_OPENED) continue;
+
+      for (d=0; d<numSamples; d++)
       {
-         newLevel = (sample[rp].level & monitorBits);
+         if ((int32_t)(sample[d].tick - e->start) < 0) continue;
 
-         if (newLevel != oldLevel)
-         {
-            sample[reports].tick  = sample[rp].tick;
-            sample[reports].level = sample[rp].level;
-            changedBits |= (newLevel ^ oldLevel);
-            oldLevel = newLevel;
+         level = sample[d].level;
 
-            reports++;
+         levels = (((level >> e->gpioA) & 1) << 1) |
+                   ((level >> e->gpioB) & 1);
 
-            if (reports >= MAX_REPORT)
-            {
-               totalSamples += reports;
+         if (levels != e->levels)
+         {
+            step = encoderStep[(e->levels << 2) | levels];
 
-               /* Rebase watchdog timeouts */
-               if (wdogBits) alertWdogCheck(sample, reports);
+            if (step == ENCODER_ERR) e->enc.errors++;
+            else                     e->enc.position += step;
 
-               gpioStats.numSamples += reports;
+            e->enc.tick = sample[d].tick;
+            e->levels = levels;
+         }
 
-               alertEmit(sample, reports, changedBits, sample[rp].tick);
+         if (e->gpioI != PI_ENCODER_NO_INDEX)
+         {
+            levelI = (level >> e->gpioI) & 1;
 
-               changedBits = 0;
-               reports = 0;
+            if (levelI && !e->levelI)
+            {
+               e->enc.indexes++;
+               e->enc.indexPosition = e->enc.position;
             }
+
+            e->levelI = levelI;
          }
       }
 
-      if (reports)
+      elapsed = eTick - e->velTick;
+
+      if ((int32_t)elapsed >= ENCODER_VELOCITY_MICROS)
       {
-         totalSamples += reports;
+         e->enc.velocity = ((int64_t)(e->enc.position - e->velPosition) *
+            1000000) / (int32_t)elapsed;
 
-         /* Rebase watchdog timeouts */
-         if (wdogBits) alertWdogCheck(sample, reports);
+         e->velTick = eTick;
+         e->velPosition = e->enc.position;
+      }
 
-         gpioStats.numSamples += reports;
+      if (e->eventMicros &&
+          (e->enc.position != e->eventPosition) &&
+          ((eTick - e->eventTick) >= e->eventMicros))
+      {
+         eventAlert[e->event].fired = 1;
+
+         e->eventTick = eTick;
+         e->eventPosition = e->enc.position;
       }
+   }
 
-      alertEmit(sample, reports, changedBits, sTick);
-      reportedLevel = sample[numSamples -1].level;
+   pthread_mutex_unlock(&encoderMutex);
+}
 
-      if (totalSamples > gpioStats.maxSamples)
-         gpioStats.maxSamples = numSamples;
+static void alertI2CSniff(gpioSample_t *sample, int numSamples)
+{
+   /*
+   Decode the sniffed I2C buses from the samples.  SDA falling while
+   SCL is high is a START, SDA rising while SCL is high a STOP.  Data
+   and ACK bits are read as SCL rises.
+   */
 
-      req.tv_sec = 0;
-      req.tv_nsec = alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+   int b, d, levels, old;
+   uint32_t bits;
+   wfRx_t *w;
 
-      if (moreToDo)
-      {
-         gpioStats.moreToDo++;
-      }
-      else
+   pthread_mutex_lock(&sniffMutex);
+
+   for (bits=sniffBits; bits; bits&=(bits-1))
+   {
+      b = __builtin_ctz(bits);
+
+      if (wfRx[b].mode != PI_WFRX_I2C_SNIFF_SDA) continue;
+
+      w = &wfRx[b];
+
+      for (d=0; d<numSamples; d++)
       {
-         gpioStats.alertTicks++;
+         levels = (((sample[d].level >> w->D.other) & 1) << 1) |
+                   ((sample[d].level >> b) & 1);
 
-         while (nanosleep(&req, &rem))
+         old = w->D.levels;
+
+         if (levels == old) continue;
+
+         w->D.levels = levels;
+
+         if ((old & 2) && (levels & 2))
          {
-            req.tv_sec  = rem.tv_sec;
-            req.tv_nsec = rem.tv_nsec;
+            /* SDA changed while SCL high */
+
+            if (levels & 1)
+            {
+               if (w->D.state != DRX_IDLE)
+               {
+                  w->D.startTick = sample[d].tick;
+                  waveRxFrame(w, 0, 0, PI_DECODE_STOP);
+               }
+
+               w->D.state = DRX_IDLE;
+            }
+            else
+            {
+               w->D.state     = DRX_LEADER; /* the address is next */
+               w->D.bits      = 0;
+               w->D.data      = 0;
+               w->D.startTick = sample[d].tick;
+            }
+         }
+         else if ((levels & 2) && !(old & 2) && (w->D.state != DRX_IDLE))
+         {
+            /* SCL rising, eight data bits then the ACK */
+
+            if (w->D.bits < 8)
+            {
+               if ((w->D.bits == 0) && (w->D.state == DRX_DATA))
+                  w->D.startTick = sample[d].tick;
+
+               w->D.data = (w->D.data << 1) | (levels & 1);
+               w->D.bits++;
+            }
+            else
+            {
+               waveRxFrame(w, w->D.data, 8,
+                  ((w->D.state == DRX_LEADER) ? PI_DECODE_START : 0) |
+                  ((levels & 1) ? PI_DECODE_NACK : 0));
+
+               w->D.state = DRX_DATA;
+               w->D.bits  = 0;
+               w->D.data  = 0;
+            }
          }
       }
    }
 
-   return 0;
+   pthread_mutex_unlock(&sniffMutex);
 }
 
-/* ======================================================================= */
-
-static int scrPop(gpioScript_t *s, int *SP, int *S)
+static void alertSerial(gpioSample_t *sample, int numSamples, uint32_t eTick)
 {
-   if ((*SP) > 0)
-   {
-      return S[--(*SP)];
-   }
-   else
-   {
-      s->run_state = PI_SCRIPT_FAILED;
-      DBG(DBG_ALWAYS, "script %d too many pops", s->id);
-      return 0;
-   }
-}
+   pthread_mutex_lock(&serialMutex);
 
-/* ----------------------------------------------------------------------- */
+   alertSerialDecode(&wfRx[0].s, sizeof(wfRx_t), serialBits, &serialLevel,
+      sample, numSamples, eTick);
 
-static void scrPush(gpioScript_t *s, int *SP, int *S, int val)
+   pthread_mutex_unlock(&serialMutex);
+}
+
+static void alertCaptureKeep(captureInfo_t *c, uint32_t tick, uint32_t level)
 {
-   if ((*SP) < PI_SCRIPT_STACK_SIZE)
+   gpioSample_t *s;
+
+   if (c->status.state == PI_CAPTURE_ARMED)
    {
-      S[(*SP)++] = val;
+      /* keep the latest pre samples in a ring */
+
+      if (c->pre == 0) return;
+
+      s = &c->buf[c->preHead];
+
+      if (++c->preHead >= c->pre) c->preHead = 0;
+
+      if (c->preCount < c->pre) c->preCount++;
    }
    else
    {
-      s->run_state = PI_SCRIPT_FAILED;
-      DBG(DBG_ALWAYS, "script %d too many pushes", s->id);
-   }
-}
+      s = &c->buf[c->pre + c->postCount];
 
-/* ----------------------------------------------------------------------- */
+      if (++c->postCount > c->post) c->status.state = PI_CAPTURE_DONE;
+   }
 
-static void scrSwap(int *v1, int *v2)
-{
-   int t;
+   s->tick  = tick;
+   s->level = level & c->bits;
 
-   t=*v1; *v1=*v2; *v2= t;
+   c->status.samples = c->preCount + c->postCount;
 }
 
-/* ----------------------------------------------------------------------- */
-
-static int scrEvtWait(gpioScript_t *s, uint32_t bits)
+static int alertCaptureTrigger(captureInfo_t *c, uint32_t level)
 {
-   pthread_mutex_lock(&s->pthMutex);
+   uint32_t changed;
 
-   if (s->request == PI_SCRIPT_RUN)
+   changed = (level ^ c->level) & c->trigBits;
+
+   switch (c->mode)
    {
-      s->run_state = PI_SCRIPT_WAITING;
-      s->eventBits = bits;
-      intScriptEventBits();
+      case PI_CAPTURE_LEVEL:
+         return (((level ^ c->trigLevels) & c->trigBits) == 0);
 
-      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+      case PI_CAPTURE_EDGE:
+         return ((changed & ~(level ^ c->trigLevels)) != 0);
 
-      s->waitBits = 0;
-      intScriptEventBits();
-      s->run_state = PI_SCRIPT_RUNNING;
+      case PI_CAPTURE_CHANGE:
+         return (changed != 0);
    }
 
-   pthread_mutex_unlock(&s->pthMutex);
-
-   return s->changedBits;
+   return 1; /* PI_CAPTURE_NOW */
 }
 
-/* ----------------------------------------------------------------------- */
-
-static int scrWait(gpioScript_t *s, uint32_t bits)
+static void alertCapture(gpioSample_t *sample, int numSamples)
 {
-   pthread_mutex_lock(&s->pthMutex);
+   /*
+   Keep the samples in which a captured GPIO changed, the latest
+   pre in a ring until the trigger, then the trigger sample and the
+   next post.
+   */
 
-   if (s->request == PI_SCRIPT_RUN)
+   int d;
+   uint32_t level;
+   captureInfo_t *c = &captureInfo;
+
+   pthread_mutex_lock(&captureMutex);
+
+   for (d=0; d<numSamples; d++)
    {
-      s->run_state = PI_SCRIPT_WAITING;
-      s->waitBits = bits;
-      intScriptBits();
+      if ((c->status.state == PI_CAPTURE_DONE) || (c->buf == NULL)) break;
 
-      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+      /* ignore samples from before the capture was started */
 
-      s->waitBits = 0;
-      intScriptBits();
-      s->run_state = PI_SCRIPT_RUNNING;
+      if ((int32_t)(sample[d].tick - c->start) < 0) continue;
+
+      level = sample[d].level & (c->bits | c->trigBits);
+
+      if (level == c->level) continue;
+
+      if ((c->status.state == PI_CAPTURE_ARMED) &&
+          alertCaptureTrigger(c, level))
+      {
+         c->status.state   = PI_CAPTURE_TRIGGERED;
+         c->status.trigger = c->preCount;
+         c->status.tick    = sample[d].tick;
+
+         alertCaptureKeep(c, sample[d].tick, level);
+      }
+      else if ((level ^ c->level) & c->bits)
+      {
+         alertCaptureKeep(c, sample[d].tick, level);
+      }
+
+      c->level = level;
    }
 
-   pthread_mutex_unlock(&s->pthMutex);
+   if (c->buf && (c->status.state != PI_CAPTURE_DONE))
+      c->status.gaps = gpioStats.dmaLaps - c->laps;
 
-   return s->changedBits;
-}
+   if (c->status.state == PI_CAPTURE_DONE)
+   {
+      captureBits = 0;
 
-/* ----------------------------------------------------------------------- */
+      alertUpdateMonitorBits();
+   }
 
-static int scrSys(char *cmd, uint32_t p1, uint32_t p2)
+   pthread_mutex_unlock(&captureMutex);
+}
+
+static void alertEmit(
+   gpioSample_t *sample, int numSamples, uint32_t changedBits, uint32_t eTick)
 {
-   char buf[1024];
-   int status;
+   uint32_t oldLevel, newLevel;
+   int emit, seqno;
+   uint32_t changes, bits, timeoutBits, eventBits, wdBits;
+   int d;
+   int b, n, v;
+   int queued, cbQueued;
+   cbJob_t job;
+   char fifo[32];
+   /* ensure space for maximum number of watchdog and event notifications */
+   gpioReport_t report[MAX_REPORT+PI_MAX_USER_GPIO+1+PI_MAX_EVENT+1+1];
 
-   if (!myScriptNameValid(cmd))
-      SOFT_ERROR(PI_BAD_SCRIPT_NAME, "bad script name (%s)", cmd);
+   cbQueued = 0;
 
-   snprintf(buf, sizeof(buf), "/opt/pigpio/cgi/%s %u %u", cmd, p1, p2);
+   /* decode the quadrature encoders, they may trigger events */
 
-   DBG(DBG_USER, "%s", buf);
+   if (encoderBits) alertEncoder(sample, numSamples, eTick);
 
-   status = system(buf);
+   /* decode any sniffed I2C buses */
 
-   if (status < 0) status = PI_BAD_SHELL_STATUS;
+   if (sniffBits) alertI2CSniff(sample, numSamples);
 
-   return status;
-}
+   /* decode any bit bang serial reads */
 
-/* ----------------------------------------------------------------------- */
+   if (serialBits) alertSerial(sample, numSamples, eTick);
 
-static void *pthScript(void *x)
-{
-   gpioScript_t *s;
-   cmdInstr_t instr;
-   int p1, p2, p1o, p2o, p3o, *t1, *t2;
-   int PC, A, F, SP;
-   int S[PI_SCRIPT_STACK_SIZE];
-   char buf[CMD_MAX_EXTENSION];
+   /* keep the samples of any logic analyser capture */
 
+   if (captureBits) alertCapture(sample, numSamples);
 
-   S[0] = 0; /* to prevent compiler warning */
+   if (changedBits)
+   {
+      if (gpioGetSamples.func)
+      {
+         job.type       = CB_SAMPLES;
+         job.gpio       = 0;
+         job.samples    = sample;
+         job.numSamples = numSamples;
+         callbackQueue(&job, &cbQueued);
+      }
+   }
 
-   s = x;
+   eventBits = 0;
 
-   while ((volatile int)s->request != PI_SCRIPT_DELETE)
+   if (bscFR != (bscsReg[BSC_FR]&0xffff))
    {
-      pthread_mutex_lock(&s->pthMutex);
-      s->run_state = PI_SCRIPT_HALTED;
-      pthread_cond_wait(&s->pthCond, &s->pthMutex);
-      pthread_mutex_unlock(&s->pthMutex);
+      bscFR = bscsReg[BSC_FR]&0xffff;
+      eventAlert[PI_EVENT_BSC].fired = 1;
+   }
 
-      s->run_state = PI_SCRIPT_RUNNING;
+   /* restart a stalled wave stream, trigger its low water event */
 
-      A  = 0;
-      F  = 0;
-      PC = 0;
-      SP = 0;
+   if (waveStream.open) waveStreamCheck();
 
-      while (((volatile int)s->request   == PI_SCRIPT_RUN    ) &&
-                           (s->run_state == PI_SCRIPT_RUNNING))
+   for (b=0; b<=PI_MAX_EVENT; b++)
+   {
+      if (eventAlert[b].fired && (!eventAlert[b].ignore))
       {
-         instr = s->script.instr[PC];
+         eventBits |= (1<<b);
 
-         p1o = instr.p[1];
-         p2o = instr.p[2];
+         if (eventAlert[b].func)
+         {
+            job.type = CB_EVENT;
+            job.gpio = b;
+            job.tick = eTick;
+            callbackQueue(&job, &cbQueued);
+         }
+      }
 
-         if      (instr.opt[1] == CMD_VAR) instr.p[1] = s->script.var[p1o];
-         else if (instr.opt[1] == CMD_PAR) instr.p[1] = s->script.par[p1o];
+      eventAlert[b].fired = 0;
+   }
 
-         if      (instr.opt[2] == CMD_VAR) instr.p[2] = s->script.var[p2o];
-         else if (instr.opt[2] == CMD_PAR) instr.p[2] = s->script.par[p2o];
-/*
-         fprintf(stderr, "PC=%d cmd=%d p1o=%d p1=%d p2o=%d p2=%d\n",
-            PC, instr.p[0], p1o, instr.p[1], p2o, instr.p[2]);
-         fflush(stderr);
-*/
-         if (instr.p[0] < PI_CMD_SCRIPT)
-         {
-            if (instr.p[3])
-            {
-               if ((instr.p[3] == sizeof(int)) && ((instr.opt[3] == CMD_VAR) || (instr.opt[3] == CMD_PAR)))
-               {
-                  /* Hack to allow register use in 3rd parameter */
-                  memcpy((char*)&p3o, (char *)instr.p[4], sizeof(int));
-                  if (instr.opt[3] == CMD_VAR) memcpy(buf, (char *)&(s->script.var[p3o]), sizeof(int));
-                  else                         memcpy(buf, (char *)&(s->script.par[p3o]), sizeof(int));
-               }
-               else
-               {
-                  memcpy(buf, (char *)instr.p[4], instr.p[3]);
-               }
-            }
+   /* update the edge meters */
 
-            A = myDoCommand(instr.p, sizeof(buf)-1, buf);
+   if (meterBits) alertMeter(sample, numSamples, eTick);
 
-            F = A;
+   /* call alert callbacks for each bit transition */
 
-            PC++;
-         }
-         else
+   if (changedBits & alertBits)
+   {
+      oldLevel = (reportedLevel & alertBits);
+
+      for (d=0; d<numSamples; d++)
+      {
+         newLevel = (sample[d].level & alertBits);
+
+         if (newLevel != oldLevel)
          {
-            p1 = instr.p[1];
-            p2 = instr.p[2];
+            changes = (newLevel ^ oldLevel);
 
-            switch (instr.p[0])
+            for (b=0; b<=PI_MAX_USER_GPIO; b++)
             {
-               case PI_CMD_ADD:   A+=p1; F=A;                     PC++; break;
-
-               case PI_CMD_AND:   A&=p1; F=A;                     PC++; break;
+               if (changes & (1<<b))
+               {
+                  if (newLevel & (1<<b)) v = 1; else v = 0;
 
-               case PI_CMD_CALL:  scrPush(s, &SP, S, PC+1);    PC = p1; break;
+                  if (gpioAlert[b].func)
+                  {
+                     job.type  = CB_ALERT;
+                     job.gpio  = b;
+                     job.level = v;
+                     job.tick  = sample[d].tick;
+                     callbackQueue(&job, &cbQueued);
+                  }
+               }
+            }
+            oldLevel = newLevel;
+         }
+      }
+   }
 
-               case PI_CMD_CMP:   F=A-p1;                         PC++; break;
+   /* check for watchdog timeouts */
 
-               case PI_CMD_DCR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {--s->script.par[p1o]; F=s->script.par[p1o];}
-                  else
-                     {--s->script.var[p1o]; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+   timeoutBits = alertWdogTimeouts(
+      gpioWdog, wdogBits, &wdogRescan, &wdogNext, eTick);
 
-               case PI_CMD_DCRA:  --A; F=A;                       PC++; break;
+   for (wdBits=timeoutBits; wdBits; wdBits&=(wdBits-1))
+   {
+      b = __builtin_ctz(wdBits);
 
-               case PI_CMD_DIV:   A/=p1; F=A;                     PC++; break;
+      if (gpioAlert[b].func)
+      {
+         job.type  = CB_ALERT;
+         job.gpio  = b;
+         job.level = PI_TIMEOUT;
+         job.tick  = eTick;
+         callbackQueue(&job, &cbQueued);
+      }
+   }
 
-               case PI_CMD_HALT:  s->run_state = PI_SCRIPT_HALTED;      break;
+   if (cbQueued) callbackWake(cbQueued);
 
-               case PI_CMD_EVTWT: A=scrEvtWait(s, p1); F=A;       PC++; break;
+   queued = 0;
 
-               case PI_CMD_INR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {++s->script.par[p1o]; F=s->script.par[p1o];}
-                  else
-                     {++s->script.var[p1o]; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+   for (n=0; n<PI_NOTIFY_SLOTS; n++)
+   {
+      if (gpioNotify[n].state == PI_NOTIFY_CLOSING)
+      {
+         /* the writer thread may be using the pipe */
 
-               case PI_CMD_INRA:  ++A; F=A;                       PC++; break;
+         notifyWriterMutex(1);
 
-               case PI_CMD_JM:    if (F<0)  PC=p1; else PC++;           break;
+         if (gpioNotify[n].pipe)
+         {
+            DBG(DBG_INTERNAL, "close notify pipe %d", gpioNotify[n].fd);
+            close(gpioNotify[n].fd);
 
-               case PI_CMD_JMP:   PC=p1;                                break;
+            sprintf(fifo, "/dev/pigpio%d", n);
 
-               case PI_CMD_JNZ:   if (F)    PC=p1; else PC++;           break;
+            unlink(fifo);
+         }
+         else if (gpioNotify[n].ring) notifyRingClose(n);
 
-               case PI_CMD_JP:    if (F>=0) PC=p1; else PC++;           break;
+         gpioNotify[n].state = PI_NOTIFY_CLOSED;
 
-               case PI_CMD_JZ:    if (!F)   PC=p1; else PC++;           break;
+         notifyWriterMutex(0);
+      }
+      else if ((gpioNotify[n].state >= PI_NOTIFY_OPENED) &&
+               gpioNotify[n].failed)
+      {
+         /* the writer thread had a serious error, no point continuing */
 
-               case PI_CMD_LD:
-                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=p2;
-                  else                         s->script.var[p1o]=p2;
-                  PC++;
-                  break;
+         gpioNotify[n].bits  = 0;
+         gpioNotify[n].state = PI_NOTIFY_CLOSING;
+         intNotifyBits();
+      }
+      else if (gpioNotify[n].state >= PI_NOTIFY_OPENED)
+      {
+         bits = gpioNotify[n].bits;
 
-               case PI_CMD_LDA:   A=p1;                           PC++; break;
+         emit = 0;
 
-               case PI_CMD_LDAB:
-                  if ((p1 >= 0) && (p1 < sizeof(buf))) A = buf[p1];
-                  PC++;
-                  break;
+         seqno = gpioNotify[n].seqno;
 
-               case PI_CMD_MLT:   A*=p1; F=A;                     PC++; break;
+         /* a paused notification is told of the gap when it resumes */
 
-               case PI_CMD_MOD:   A%=p1; F=A;                     PC++; break;
+         if (alertGapPending && !gpioNotify[n].gapPending)
+         {
+            gpioNotify[n].gapPending = 1;
+            gpioNotify[n].gapTick = alertGapTick;
+         }
 
-               case PI_CMD_OR:    A|=p1; F=A;                     PC++; break;
+         if (gpioNotify[n].state == PI_NOTIFY_RUNNING)
+         {
+            /* tell the notification samples were lost before the
+               reports which follow.
+            */
 
-               case PI_CMD_POP:
-                  if (instr.opt[1] == CMD_PAR)
-                     s->script.par[p1o]=scrPop(s, &SP, S);
-                  else
-                     s->script.var[p1o]=scrPop(s, &SP, S);
-                  PC++;
-                  break;
+            if (gpioNotify[n].gapPending && bits)
+            {
+               report[emit].seqno = seqno;
+               report[emit].flags = PI_NTFY_FLAGS_GAP;
+               report[emit].tick  = gpioNotify[n].gapTick;
+               report[emit].level = reportedLevel;
 
-               case PI_CMD_POPA:  A=scrPop(s, &SP, S);            PC++; break;
+               emit++;
+               seqno++;
+            }
 
-               case PI_CMD_PUSH:
-                  if (instr.opt[1] == CMD_PAR)
-                     scrPush(s, &SP, S, s->script.par[p1o]);
-                  else
-                     scrPush(s, &SP, S, s->script.var[p1o]);
-                  PC++;
-                  break;
+            gpioNotify[n].gapPending = 0;
 
-               case PI_CMD_PUSHA: scrPush(s, &SP, S, A);          PC++; break;
+            /* check to see if any bits have changed for this
+               notification.
 
-               case PI_CMD_RET:   PC=scrPop(s, &SP, S);                 break;
+               bits         is the set of notification bits
+               changedBits is the set of changed bits
+            */
 
-               case PI_CMD_RL:
-                  if (instr.opt[1] == CMD_PAR)
-                     {s->script.par[p1o]<<=p2; F=s->script.par[p1o];}
-                  else
-                     {s->script.var[p1o]<<=p2; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+            if (changedBits & bits)
+            {
+               oldLevel = reportedLevel & bits;
 
-               case PI_CMD_RLA:   A<<=p1; F=A;                    PC++; break;
+               for (d=0; d<numSamples; d++)
+               {
+                  newLevel = sample[d].level & bits;
 
-               case PI_CMD_RR:
-                  if (instr.opt[1] == CMD_PAR)
-                     {s->script.par[p1o]>>=p2; F=s->script.par[p1o];}
-                  else
-                     {s->script.var[p1o]>>=p2; F=s->script.var[p1o];}
-                  PC++;
-                  break;
+                  if (newLevel != oldLevel)
+                  {
+                     report[emit].seqno = seqno;
+                     report[emit].flags = 0;
+                     report[emit].tick  = sample[d].tick;
+                     report[emit].level = sample[d].level;
 
-               case PI_CMD_RRA:   A>>=p1; F=A;                    PC++; break;
+                     oldLevel = newLevel;
 
-               case PI_CMD_STA:
-                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=A;
-                  else                         s->script.var[p1o]=A;
-                  PC++;
-                  break;
+                     emit++;
+                     seqno++;
+                  }
+               }
+            }
 
-               case PI_CMD_STAB:
-                  if ((p1 >= 0) && (p1 < sizeof(buf))) buf[p1] = A;
-                  PC++;
-                  break;
+            /* check to see if any watchdogs are due for this
+               notification.
 
-               case PI_CMD_SUB:   A-=p1; F=A;                     PC++; break;
+               bits        is the set of notification bits
+               timeoutBits is the set of timed out bits
+            */
 
-               case PI_CMD_SYS:
-                  A=scrSys((char*)instr.p[4], A, *(gpioReg + GPLEV0));
-                  F=A;
-                  PC++;
-                  break;
+            bits = gpioNotify[n].bits;
 
-               case PI_CMD_WAIT:  A=scrWait(s, p1); F=A;          PC++; break;
+            if (timeoutBits & bits)
+            {
+               /* at least one watchdog has fired for this
+                  notification.
+               */
 
-               case PI_CMD_X:
-                  if (instr.opt[1] == CMD_PAR) t1 = &s->script.par[p1o];
-                  else                         t1 = &s->script.var[p1o];
+               if (numSamples)
+                  newLevel = sample[numSamples-1].level;
+               else
+                  newLevel = reportedLevel;
 
-                  if (instr.opt[2] == CMD_PAR) t2 = &s->script.par[p2o];
-                  else                         t2 = &s->script.var[p2o];
+               wdBits = timeoutBits & bits;
 
-                  scrSwap(t1, t2);
-                  PC++;
-                  break;
+               while (wdBits)
+               {
+                  b = __builtin_ctz(wdBits);
 
-               case PI_CMD_XA:
-                  if (instr.opt[1] == CMD_PAR)
-                     scrSwap(&s->script.par[p1o], &A);
-                  else
-                     scrSwap(&s->script.var[p1o], &A);
-                  PC++;
-                  break;
+                  wdBits &= (wdBits - 1);
 
-               case PI_CMD_XOR:   A^=p1; F=A;                     PC++; break;
+                  report[emit].seqno = seqno;
+                  report[emit].flags =
+                     PI_NTFY_FLAGS_WDOG | PI_NTFY_FLAGS_BIT(b);
+                  report[emit].tick  = eTick;
+                  report[emit].level = newLevel;
 
+                  emit++;
+                  seqno++;
+               }
             }
          }
 
-         if (PC >= s->script.instrs) s->run_state = PI_SCRIPT_HALTED;
-
-      }
-
-      if ((volatile int)s->request == PI_SCRIPT_HALT)
-         s->run_state = PI_SCRIPT_HALTED;
-
-   }
-
-   return 0;
-}
+         /* check to see if any events are due
 
-/* ----------------------------------------------------------------------- */
+            eventBits is the set of events
+         */
 
-static void * pthTimerTick(void *x)
-{
-   gpioTimer_t *tp;
-   struct timespec req, rem;
-
-   tp = x;
-
-   while (1)
-   {
-      req.tv_sec  = tp->millis / THOUSAND;
-      req.tv_nsec = (tp->millis % THOUSAND) * THOUSAND * THOUSAND;
-
-      while (nanosleep(&req, &rem))
-      {
-         req.tv_sec  = rem.tv_sec;
-         req.tv_nsec = rem.tv_nsec;
-      }
-
-      if (tp->ex) (tp->func)(tp->userdata);
-      else        (tp->func)();
-   }
-
-   return 0;
-}
+         if (eventBits & gpioNotify[n].eventBits)
+         {
+            for (b=0; b<=PI_MAX_EVENT; b++)
+            {
+               if (eventBits & gpioNotify[n].eventBits & (1<<b))
+               {
+                  if (numSamples)
+                     newLevel = sample[numSamples-1].level;
+                  else
+                     newLevel = reportedLevel;
 
-/* ----------------------------------------------------------------------- */
+                  report[emit].seqno = seqno;
+                  report[emit].flags = 
+                     PI_NTFY_FLAGS_EVENT | PI_NTFY_FLAGS_BIT(b);
+                  report[emit].tick  = eTick;
+                  report[emit].level = newLevel;
 
+                  emit++;
+                  seqno++;
+               }
+            }
+         }
 
-static void * pthFifoThread(void *x)
-{
-   char buf[CMD_MAX_EXTENSION];
-   int idx, flags, len, res, i;
-   uintptr_t p[CMD_P_ARR];
-   cmdCtlParse_t ctl;
-   uint32_t *param;
-   char v[CMD_MAX_EXTENSION];
+         if (!emit)
+         {
+            if ((int)(eTick - gpioNotify[n].lastReportTick) > 60000000)
+            {
+               if (numSamples)
+                  newLevel = sample[numSamples-1].level;
+               else
+                  newLevel = reportedLevel;
 
-   myCreatePipe(PI_INPFIFO, 0662);
+               report[emit].seqno = seqno;
+               report[emit].flags = PI_NTFY_FLAGS_ALIVE;
+               report[emit].tick  = eTick;
+               report[emit].level = newLevel;
 
-   if ((inpFifo = fopen(PI_INPFIFO, "r+")) == NULL)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed(%m)", PI_INPFIFO);
+               emit++;
+               seqno++;
+            }
+         }
 
-   myCreatePipe(PI_OUTFIFO, 0664);
+         if (emit)
+         {
+            DBG(DBG_FAST_TICK, "notification %d (%d reports, %x-%x)",
+               n, emit, report[0].seqno,  report[emit-1].seqno);
+            gpioNotify[n].lastReportTick = eTick;
 
-   if ((outFifo = fopen(PI_OUTFIFO, "w+")) == NULL)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed (%m)", PI_OUTFIFO);
+            if (emit > gpioStats.maxEmit) gpioStats.maxEmit = emit;
 
-   /* set outFifo non-blocking */
+            if (gpioNotify[n].ring) notifyRingEmit(n, report, emit);
+            else
+            {
+               notifyQueueEmit(n, report, emit);
+               queued = 1;
+            }
 
-   flags = fcntl(fileno(outFifo), F_GETFL, 0);
-   fcntl(fileno(outFifo), F_SETFL, flags | O_NONBLOCK);
+            gpioNotify[n].seqno = seqno;
+         }
+      }
+   }
 
-   /* don't start until DMA started */
+   if (queued) notifyWriterWake();
 
-   spinWhileStarting();
+   alertGapPending = 0;
 
-   while (1)
+   if (changedBits & scriptBits)
    {
-      if (fgets(buf, sizeof(buf), inpFifo) == NULL)
-         SOFT_ERROR((void*)PI_INIT_FAILED, "fifo fgets failed (%m)");
+      for (n=0; n<PI_MAX_SCRIPTS; n++)
+      {
+         if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
+             (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
+             (gpioScript[n].waitBits & changedBits))
+         {
+            pthread_mutex_lock(&gpioScript[n].pthMutex);
 
-      len = strlen(buf);
+            if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
+            {
+               gpioScript[n].changedBits =
+                  gpioScript[n].waitBits & changedBits;
+               pthread_cond_signal(&gpioScript[n].pthCond);
+            }
 
-      if (len)
-      {
-        --len;
-        buf[len] = 0; /* replace terminating */
+            pthread_mutex_unlock(&gpioScript[n].pthMutex);
+         }
       }
+   }
 
-      ctl.eaten = 0;
-      idx = 0;
-
-      while (((ctl.eaten)<len) && (idx >= 0))
+   if (eventBits & scriptEventBits)
+   {
+      for (n=0; n<PI_MAX_SCRIPTS; n++)
       {
-         if ((idx=cmdParse(buf, p, CMD_MAX_EXTENSION, v, &ctl)) >= 0)
+         if ((gpioScript[n].state     == PI_SCRIPT_IN_USE)  &&
+             (gpioScript[n].run_state == PI_SCRIPT_WAITING) &&
+             (gpioScript[n].eventBits & eventBits))
          {
-            /* make sure extensions are null terminated */
-
-            v[p[3]] = 0;
-
-            res = myDoCommand(p, sizeof(v)-1, v);
+            pthread_mutex_lock(&gpioScript[n].pthMutex);
 
-            switch (cmdInfo[idx].rv)
+            if (gpioScript[n].run_state == PI_SCRIPT_WAITING)
             {
-               case 0:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
-
-               case 1:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
-
-               case 2:
-                  fprintf(outFifo, "%d\n", res);
-                  break;
-
-               case 3:
-                  fprintf(outFifo, "%08X\n", res);
-                  break;
-
-               case 4:
-                  fprintf(outFifo, "%u\n", res);
-                  break;
-
-               case 5:
-                  fprintf(outFifo, "%s", cmdUsage);
-                  break;
-
-               case 6:
-                  fprintf(outFifo, "%d", res);
-                  if (res > 0)
-                  {
-                     for (i=0; i<res; i++)
-                     {
-                        fprintf(outFifo, " %d", v[i]);
-                     }
-                  }
-                  fprintf(outFifo, "\n");
-                  break;
-
-               case 7:
-                  if (res < 0) fprintf(outFifo, "%d\n", res);
-                  else
-                  {
-                     fprintf(outFifo, "%d", res);
-                     param = (uint32_t *)v;
-                     for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
-                     {
-                        fprintf(outFifo, " %d", param[i]);
-                     }
-                     fprintf(outFifo, "\n");
-                  }
-                  break;
+               gpioScript[n].changedBits =
+                  gpioScript[n].eventBits & eventBits;
+               pthread_cond_signal(&gpioScript[n].pthCond);
             }
+
+            pthread_mutex_unlock(&gpioScript[n].pthMutex);
          }
-         else fprintf(outFifo, "%d\n", PI_BAD_FIFO_COMMAND);
       }
-
-      fflush(outFifo);
    }
 
-   return 0;
+   if (numSamples) reportedLevel = sample[numSamples-1].level;
 }
 
-/* ----------------------------------------------------------------------- */
-
-static void *pthSocketThreadHandler(void *fdC)
+static void * pthAlertThread(void *x)
 {
-   int sock = *(int*)fdC;
-   uintptr_t p[10];
-   uint32_t tmp, response[4];
-   int i;
-   int opt;
-   char buf[CMD_MAX_EXTENSION];
+   struct timespec req, rem;
+   uint32_t oldLevel, newLevel, level;
+   uint32_t oldSlot,  newSlot;
+   uint32_t expected, ft, sTick;
+   uint32_t cycleMicros, lapMicros, lost, lapTick;
+   uint32_t pollMin, pollMax, pollMicros, passTick, lastPassTick;
+   uint32_t changedBits;
+   int32_t diff, minDiff, stickInited;
+   int cycle, pulse;
+   int numSamples, ticks, i;
+   int rp, reports, totalSamples;
+   int stopped;
+   int moreToDo;
+   int lapped;
+   gpioSample_t sample[MAX_SAMPLE];
 
-   free(fdC);
+   req.tv_sec = 0;
 
-   /* Disable the Nagle algorithm. */
-   opt = 1;
-   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+   /* don't start until DMA started */
 
-   while (1)
-   {
-      if (sizeof(uintptr_t) == 8)
-      {
-         if (recv(sock, &tmp, 4, MSG_WAITALL) != 4) break;
-         p[0] = (uintptr_t)tmp;
-         if (recv(sock, &tmp, 4, MSG_WAITALL) != 4) break;
-         p[1] = (uintptr_t)tmp;
-         if (recv(sock, &tmp, 4, MSG_WAITALL) != 4) break;
-         p[2] = (uintptr_t)tmp;
-         if (recv(sock, &tmp, 4, MSG_WAITALL) != 4) break;
-         p[3] = (uintptr_t)tmp;
-      }
-      else
-      {
-         if (recv(sock, p, 16, MSG_WAITALL) != 16) break;
-      }
+   spinWhileStarting();
 
-      if (p[3])
-      {
-         if (p[3] < sizeof(buf))
-         {
-            /* read extension into buf */
-            if (recv(sock, buf, p[3], MSG_WAITALL) != p[3])
-            {
-               /* Serious error.  No point continuing. */
-               DBG(DBG_ALWAYS,
-                  "recv failed for %"PRIdPTR" bytes, sock=%d", p[3], sock);
+   reportedLevel = gpioReg[GPLEV0];
 
-               closeOrphanedNotifications(-1, sock);
+   oldLevel = reportedLevel;
 
-               close(sock);
+   oldSlot = dmaCurrentSlot(dmaNowAtICB());
 
-               return 0;
-            }
-         }
-         else
-         {
-            /* Serious error.  No point continuing. */
-            DBG(DBG_ALWAYS, "ext too large %"PRIdPTR"(%zd), sock=%d",
-               p[3], sizeof(buf), sock);
+   oldSlot = (oldSlot / PULSE_PER_CYCLE) * PULSE_PER_CYCLE;
 
-            closeOrphanedNotifications(-1, sock);
+   cycle = (oldSlot/PULSE_PER_CYCLE);
 
-            close(sock);
+   pulse = 0;
 
-            return 0;
-         }
-      }
+   stopped = 0;
 
-      /* add null terminator in case it's a string */
+   moreToDo = 0;
 
-      buf[p[3]] = 0;
+   lapped = 0;
 
-      switch (p[0])
-      {
-         case PI_CMD_NOIB:
+   lapTick = 0;
 
-            p[3] = gpioNotifyOpenInBand(sock);
+   stickInited = 0;
 
-           /* Enable the Nagle algorithm. */
-            opt = 0;
-            setsockopt(
-               sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+   sTick = 0;
 
-            break;
+   minDiff = gpioCfg.clockMicros / 2;
 
-         case PI_CMD_PROCP:
-            p[3] = myDoCommand(p, sizeof(buf)-1, buf+sizeof(int));
-            if (((int)p[3]) >= 0)
-            {
-               memcpy(buf, &p[3], 4);
-               p[3] = 4 + (4*PI_MAX_SCRIPT_PARAMS);
-            }
-            break;
+   cycleMicros = PULSE_PER_CYCLE * gpioCfg.clockMicros;
 
-         default:
-            p[3] = myDoCommand(p, sizeof(buf)-1, buf);
-      }
+   lapMicros = bufferCycles * cycleMicros;
 
-      if (sizeof(uintptr_t) == 8) // 64-bit system
-      {
-         for (i = 0; i < 4; i++)
-            response[i] = (uint32_t)p[i];
-         if (write(sock, response, 16) == -1) { /* ignore errors */ }
-      }
-      else // 32-bit system
-      {
-         if (write(sock, p, 16) == -1) { /* ignore errors */ }
-      }
+   /* an adaptive poll must not let the DMA lap the thread */
 
-      switch (p[0])
-      {
-         /* extensions */
+   pollMax = gpioCfg.alertPollMax;
 
-         case PI_CMD_BI2CZ:
-         case PI_CMD_BSCX:
-         case PI_CMD_CF2:
-         case PI_CMD_FL:
-         case PI_CMD_FR:
-         case PI_CMD_I2CPK:
-         case PI_CMD_I2CRD:
-         case PI_CMD_I2CRI:
-         case PI_CMD_I2CRK:
-         case PI_CMD_I2CZ:
-         case PI_CMD_PROCP:
-         case PI_CMD_SERR:
-         case PI_CMD_SLR:
-         case PI_CMD_SPIX:
-         case PI_CMD_SPIR:
-         case PI_CMD_BSPIX:
+   if (pollMax > (lapMicros / 4)) pollMax = lapMicros / 4;
 
-            if (((int)p[3]) > 0)
-            {
-               if (write(sock, buf, p[3]) == 1) { /* ignore errors */ }
-            }
-            break;
+   pollMin = gpioCfg.alertPollMin;
 
-         default:
-           break;
-      }
-   }
+   if (pollMin > pollMax) pollMin = pollMax;
 
-   closeOrphanedNotifications(-1, sock);
+   pollMicros = pollMin;
 
-   close(sock);
+   lastPassTick = systReg[SYST_CLO];
 
-   DBG(DBG_USER, "Socket %d closed", sock);
+   while (1)
+   {
+      passTick = systReg[SYST_CLO];
 
-   return 0;
-}
+      gpioStats.alertPasses++;
+      gpioStats.alertPassMicros += (passTick - lastPassTick);
 
-static int addrAllowed(struct sockaddr *saddr)
-{
-   int i;
-   uint32_t addr;
+      lastPassTick = passTick;
 
-   if (!numSockNetAddr) return 1;
+      /* Check that DMA is running okay */
 
-   // FIXME: add IPv6 whitelisting support
-   if (saddr->sa_family != AF_INET) return 0;
+      if (dmaIn[DMA_CONBLK_AD])
+      {
+         if (stopped)
+         {
+            DBG(DBG_STARTUP, "****** GOING ******");
+            stopped = 0;
+         }
+      }
+      else
+      {
+         stopped = 1;
 
-   addr = ((struct sockaddr_in *) saddr)->sin_addr.s_addr;
+         myGpioDelay(5000);
 
-   for (i=0; i<numSockNetAddr; i++)
-   {
-      if (addr == sockNetAddr[i]) return 1;
-   }
-   return 0;
-}
+         if (runState == PI_RUNNING)
+         {
+            /* should never be executed, leave code just in case */
 
-/* ----------------------------------------------------------------------- */
+            gpioCfg.internals |= PI_CFG_STATS;
 
-static void * pthSocketThread(void *x)
-{
-   int fdC=0, c, *sock;
-   struct sockaddr_storage client;
-   pthread_attr_t attr;
+            dmaInitCbs();
+            flushMemory();
+            //cast twice to suppress compiler warning, I belive this cast is ok
+            //because dmaIbus contains bus addresses, not user addresses. --plugwash
+            initDMAgo((uint32_t *)dmaIn, (uint32_t)(uintptr_t)dmaIBus[0]);
+            myGpioDelay(5000); /* let DMA run for a while */
+            oldSlot = dmaCurrentSlot(dmaNowAtICB());
+            gpioStats.DMARestarts++;
+         }
+      }
+
+      newSlot = dmaCurrentSlot(dmaNowAtICB());
 
-   if (pthread_attr_init(&attr))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_init failed (%m)");
+      newSlot = (newSlot / PULSE_PER_CYCLE) * PULSE_PER_CYCLE;
 
-   if (pthread_attr_setstacksize(&attr, STACK_SIZE))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_setstacksize failed (%m)");
+      /*
+      If the DMA is about to lap the oldest unread cycle those samples
+      are lost.  Skip forward to keep the most recent half buffer.
+      */
 
-   if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED))
-      SOFT_ERROR((void*)PI_INIT_FAILED,
-         "pthread_attr_setdetachstate failed (%m)");
+      if (stickInited &&
+         ((systReg[SYST_CLO] - sTick) >= (lapMicros - (2 * cycleMicros))))
+      {
+         cycle = (newSlot / PULSE_PER_CYCLE) + (bufferCycles / 2);
 
-   /* fdSock opened in gpioInitialise so that we can treat
-      failure to bind as fatal. */
+         if (cycle >= bufferCycles) cycle -= bufferCycles;
 
-   listen(fdSock, 100);
+         oldSlot = cycle * PULSE_PER_CYCLE;
 
-   c = sizeof(client);
+         pulse = 0;
 
-   /* don't start until DMA started */
+         expected = sTick;
 
-   spinWhileStarting();
+         sTick = myGetTick(cycle);
 
-   while (fdC >= 0)
-   {
-      pthread_t thr;
+         lost = ((sTick - expected) + (cycleMicros / 2)) / cycleMicros;
 
-      fdC = accept(fdSock, (struct sockaddr *)&client, (socklen_t*)&c);
+         gpioStats.dmaLaps++;
+         gpioStats.lostCycles += lost;
 
-      closeOrphanedNotifications(-1, fdC);
+         alertGapPending = 1;
+         alertGapTick = sTick;
 
-      if (addrAllowed((struct sockaddr *)&client))
+         DBG(DBG_STARTUP, "DMA lap, %u cycles lost", lost);
+      }
+
+      numSamples = 0;
+
+      /*
+      Extract samples from DMA ring buffer.
+      */
+
+      while ((oldSlot != newSlot) && (numSamples < MAX_SAMPLE))
       {
-         DBG(DBG_USER, "Connection accepted on socket %d", fdC);
+         level = myGetLevel(oldSlot++);
 
-         sock = malloc(sizeof(int));
+         sample[numSamples].tick  = sTick;
+         sample[numSamples].level = level;
 
-         *sock = fdC;
+         numSamples++;
 
-         /* Enable tcp_keepalive */
-         int optval = 1;
-         socklen_t optlen = sizeof(optval);
+         sTick += gpioCfg.clockMicros;
 
-         if (setsockopt(fdC, SOL_SOCKET, SO_KEEPALIVE, &optval, optlen) < 0)
+         if (++pulse >= PULSE_PER_CYCLE)
          {
-           DBG(DBG_ALWAYS, "setsockopt() fail, closing socket %d", fdC);
-           close(fdC);
-         }
+            pulse = 0;
 
-         DBG(DBG_USER, "SO_KEEPALIVE enabled on socket %d\n", fdC);
+            if (++cycle >= bufferCycles)
+            {
+               cycle = 0;
+               oldSlot = 0;
+            }
 
-         if (pthread_create
-            (&thr, &attr, pthSocketThreadHandler, (void*) sock) < 0)
-            SOFT_ERROR((void*)PI_INIT_FAILED,
-               "socket pthread_create failed (%m)");
-      }
-      else
-      {
-         DBG(DBG_ALWAYS, "Connection rejected, closing");
-         close(fdC);
-      }
-   }
+            expected = sTick;
 
-   if (fdC < 0)
-      SOFT_ERROR((void*)PI_INIT_FAILED, "accept failed (%m)");
+            sTick = myGetTick(cycle);
 
-   return 0;
-}
+            if (stickInited)
+            {
+               diff = sTick - expected;
 
-/* ======================================================================= */
+               if (diff <= -(int32_t)(lapMicros / 2))
+               {
+                  /* the DMA hasn't yet written this cycle's tick */
 
-static void initCheckLockFile(void)
-{
-   int fd;
-   int count;
-   int pid;
-   int err;
-   int delete;
-   char str[20];
+                  sTick = expected;
+                  diff = 0;
+               }
+               else if (diff >= (int32_t)(lapMicros / 2))
+               {
+                  /*
+                  The DMA lapped during extraction.  The cycle just
+                  extracted may hold samples from either lap, drop it
+                  and report the gap once the earlier samples are out.
+                  */
 
-   fd = open(PI_LOCKFILE, O_RDONLY);
+                  numSamples -= PULSE_PER_CYCLE;
 
-   if (fd != -1)
-   {
-      DBG(DBG_STARTUP, "lock file exists");
-      delete = 1;
+                  lost = (diff + (cycleMicros / 2)) / cycleMicros;
 
-      count = read(fd, str, sizeof(str)-1);
+                  gpioStats.dmaLaps++;
+                  gpioStats.lostCycles += lost + 1;
 
-      if (count)
-      {
-         pid = atoi(str);
-         err = kill(pid, 0);
-         if (!err) delete = 0; /* process still exists */
-         DBG(DBG_STARTUP, "lock file pid=%d err=%d", pid, err);
-      }
+                  lapped = 1;
+                  lapTick = sTick;
 
-      close(fd);
-      DBG(DBG_STARTUP, "lock file delete=%d", delete);
+                  DBG(DBG_STARTUP, "DMA lap, %u cycles lost", lost + 1);
 
-      if (delete) unlink(PI_LOCKFILE);
-   }
-}
+                  break;
+               }
 
-static int initGrabLockFile(void)
-{
-   int fd;
-   int lockResult;
-   char pidStr[20];
+               if (abs(diff) > minDiff)
+               {
+                  ft = sample[numSamples-PULSE_PER_CYCLE].tick;
 
-   initCheckLockFile();
+                  ticks = sTick - ft;
 
-   /* try to grab the lock file */
+                  for (i=1; i<PULSE_PER_CYCLE; i++)
+                  {
+                     sample[numSamples-PULSE_PER_CYCLE+i].tick =
+                        ((i*ticks)/PULSE_PER_CYCLE) + ft;
+                  }
+               }
 
-   fd = open(PI_LOCKFILE, O_WRONLY|O_CREAT|O_EXCL|O_TRUNC, 0644);
+               diff += (TICKSLOTS/2);
 
-   if (fd != -1)
-   {
-      lockResult = flock(fd, LOCK_EX|LOCK_NB);
+               if (diff < 0)
+               {
+                  gpioStats.diffTick[0]++;
+               }
 
-      if(lockResult == 0)
-      {
-         sprintf(pidStr, "%d\n", (int)getpid());
+               else if (diff >= TICKSLOTS)
+               {
+                  gpioStats.diffTick[TICKSLOTS-1]++;
+               }
 
-         if (write(fd, pidStr, strlen(pidStr)) == -1)
-         {
-            /* ignore errors */
+               else gpioStats.diffTick[diff]++;
+            }
+            else
+            {
+               stickInited = 1;
+               numSamples = 0;
+               if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
+               {
+                  pthAlertRunning = PI_THREAD_RUNNING;
+               }
+            }
          }
       }
-      else
-      {
-         close(fd);
-         return -1;
-      }
-   }
 
-   return fd;
-}
+      if (oldSlot == newSlot) moreToDo = 0; else moreToDo = 1;
 
-/* ----------------------------------------------------------------------- */
+      gpioStats.alertPassSamples += numSamples;
 
-static uint32_t * initMapMem(int fd, uint32_t addr, uint32_t len)
-{
-    return (uint32_t *) mmap(0, len,
-       PROT_READ|PROT_WRITE,
-       MAP_SHARED|MAP_LOCKED,
-       fd, addr);
-}
+      /* Apply glitch filter */
 
-/* ----------------------------------------------------------------------- */
+      if (numSamples && gFilterBits)
+         alertGlitchFilter(
+            gpioFilter, monitorBits & gFilterBits, sample, numSamples);
 
-static int initCheckPermitted(void)
-{
-   DBG(DBG_STARTUP, "");
+      /* Apply noise filter */
 
-   if (!pi_ispi)
-   {
-      DBG(DBG_ALWAYS,
-         "\n" \
-         "+---------------------------------------------------------+\n" \
-         "|Sorry, this system does not appear to be a raspberry pi. |\n" \
-         "|aborting.                                                |\n" \
-         "+---------------------------------------------------------+\n\n");
-      return -1;
-   }
+      if (numSamples && nFilterBits)
+         alertNoiseFilter(
+            gpioFilter, monitorBits & nFilterBits, sample, numSamples);
 
-   if ((fdMem = open("/dev/mem", O_RDWR | O_SYNC) ) < 0)
-   {
-      DBG(DBG_ALWAYS,
-         "\n" \
-         "+---------------------------------------------------------+\n" \
-         "|Sorry, you don't have permission to run this program.    |\n" \
-         "|Try running as root, e.g. precede the command with sudo. |\n" \
-         "+---------------------------------------------------------+\n\n");
-      return -1;
-   }
-   return 0;
-}
+      /* Compact samples */
 
-/* ----------------------------------------------------------------------- */
+      changedBits = 0;
+      oldLevel &= monitorBits;
+      reports = 0;
+      totalSamples = 0;
 
-static int initPeripherals(void)
-{
-   DBG(DBG_STARTUP, "");
+      for (rp=0; rp<numSamples; rp++)
+      {
+         newLevel = (sample[rp].level & monitorBits);
 
-   gpioReg = initMapMem(fdMem, GPIO_BASE, GPIO_LEN);
+         if (newLevel != oldLevel)
+         {
+            sample[reports].tick  = sample[rp].tick;
+            sample[reports].level = sample[rp].level;
+            changedBits |= (newLevel ^ oldLevel);
+            oldLevel = newLevel;
 
-   if (gpioReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap gpio failed (%m)");
+            reports++;
 
-   dmaReg = initMapMem(fdMem, DMA_BASE, DMA_LEN);
+            if (reports >= MAX_REPORT)
+            {
+               totalSamples += reports;
 
-   if (dmaReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma failed (%m)");
+               /* Rebase watchdog timeouts */
+               if (wdogBits)
+                  alertWdogCheck(
+                     gpioWdog, monitorBits & wdogBits, &wdogLevel, sample, reports);
 
-   /* we should know if we are running on a BCM2711 by now */
+               gpioStats.numSamples += reports;
 
-   if (gpioCfg.DMAprimaryChannel == PI_DEFAULT_DMA_NOT_SET)
-   {
-      if (pi_is_2711)
-         gpioCfg.DMAprimaryChannel = PI_DEFAULT_DMA_PRIMARY_CH_2711;
-      else
-         gpioCfg.DMAprimaryChannel = PI_DEFAULT_DMA_PRIMARY_CHANNEL;
-   }
-      
-   if (gpioCfg.DMAsecondaryChannel == PI_DEFAULT_DMA_NOT_SET)
-   {
-      if (pi_is_2711)
-         gpioCfg.DMAsecondaryChannel = PI_DEFAULT_DMA_SECONDARY_CH_2711;
-      else
-         gpioCfg.DMAsecondaryChannel = PI_DEFAULT_DMA_SECONDARY_CHANNEL;
-   }
-      
-   dmaIn =  dmaReg + (gpioCfg.DMAprimaryChannel   * 0x40);
-   dmaOut = dmaReg + (gpioCfg.DMAsecondaryChannel * 0x40);
+               alertEmit(sample, reports, changedBits, sample[rp].tick);
 
-   DBG(DBG_STARTUP, "DMA #%d @ %08"PRIXPTR,
-      gpioCfg.DMAprimaryChannel, (uintptr_t)dmaIn);
+               changedBits = 0;
+               reports = 0;
+            }
+         }
+      }
 
-   DBG(DBG_STARTUP, "debug reg is %08X", dmaIn[DMA_DEBUG]);
+      if (reports)
+      {
+         totalSamples += reports;
 
-   clkReg  = initMapMem(fdMem, CLK_BASE,  CLK_LEN);
+         /* Rebase watchdog timeouts */
+         if (wdogBits)
+            alertWdogCheck(
+               gpioWdog, monitorBits & wdogBits, &wdogLevel, sample, reports);
 
-   if (clkReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap clk failed (%m)");
+         gpioStats.numSamples += reports;
+      }
 
-   systReg  = initMapMem(fdMem, SYST_BASE,  SYST_LEN);
+      alertEmit(sample, reports, changedBits, sTick);
+      if (numSamples) reportedLevel = sample[numSamples -1].level;
 
-   if (systReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap syst failed (%m)");
+      if (lapped)
+      {
+         alertGapPending = 1;
+         alertGapTick = lapTick;
+         lapped = 0;
+      }
 
-   spiReg  = initMapMem(fdMem, SPI_BASE,  SPI_LEN);
+      if (totalSamples > gpioStats.maxSamples)
+         gpioStats.maxSamples = numSamples;
 
-   if (spiReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap spi failed (%m)");
+      req.tv_sec = 0;
 
-   pwmReg  = initMapMem(fdMem, PWM_BASE,  PWM_LEN);
+      if (pollMax)
+      {
+         /*
+         Poll quickly while GPIO are changing, back off when idle.
+         A playing wave stream is checked each pass, so it is never
+         idle.
+         */
 
-   if (pwmReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap pwm failed (%m)");
+         if (moreToDo || totalSamples || waveStream.running)
+            pollMicros = pollMin;
+         else
+         {
+            pollMicros *= 2;
 
-   pcmReg  = initMapMem(fdMem, PCM_BASE,  PCM_LEN);
+            if (pollMicros < pollMin) pollMicros = pollMin;
+            if (pollMicros > pollMax) pollMicros = pollMax;
+         }
 
-   if (pcmReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap pcm failed (%m)");
+         req.tv_nsec = pollMicros * 1000;
+      }
+      else
+      {
+         req.tv_nsec =
+            alert_delays[(gpioCfg.internals>>PI_CFG_ALERT_FREQ)&15];
+      }
 
-   auxReg  = initMapMem(fdMem, AUX_BASE,  AUX_LEN);
+      if (moreToDo)
+      {
+         gpioStats.moreToDo++;
+      }
+      else
+      {
+         gpioStats.alertTicks++;
 
-   if (auxReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap aux failed (%m)");
+         while (nanosleep(&req, &rem))
+         {
+            req.tv_sec  = rem.tv_sec;
+            req.tv_nsec = rem.tv_nsec;
+         }
+      }
+   }
 
-   padsReg  = initMapMem(fdMem, PADS_BASE,  PADS_LEN);
+   return 0;
+}
 
-   if (padsReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap pads failed (%m)");
+/* ======================================================================= */
 
-   bscsReg  = initMapMem(fdMem, BSCS_BASE,  BSCS_LEN);
+static int scrPop(gpioScript_t *s, int *SP, int *S)
+{
+   if ((*SP) > 0)
+   {
+      return S[--(*SP)];
+   }
+   else
+   {
+      s->run_state = PI_SCRIPT_FAILED;
+      DBG(DBG_ALWAYS, "script %d too many pops", s->id);
+      return 0;
+   }
+}
 
-   if (bscsReg == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap bscs failed (%m)");
+/* ----------------------------------------------------------------------- */
 
-   return 0;
+static void scrPush(gpioScript_t *s, int *SP, int *S, int val)
+{
+   if ((*SP) < PI_SCRIPT_STACK_SIZE)
+   {
+      S[(*SP)++] = val;
+   }
+   else
+   {
+      s->run_state = PI_SCRIPT_FAILED;
+      DBG(DBG_ALWAYS, "script %d too many pushes", s->id);
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int initZaps
-   (int  pmapFd, void *virtualBase, int  basePage, int  pages)
+static void scrSwap(int *v1, int *v2)
 {
-   int n;
-   uintptr_t index;
-   off_t offset;
-   ssize_t t;
-   uint32_t physical;
-   int status;
-   uintptr_t pageAdr;
-   unsigned long long pa;
+   int t;
 
-   DBG(DBG_STARTUP, "");
+   t=*v1; *v1=*v2; *v2= t;
+}
 
-   status = 0;
+/* ----------------------------------------------------------------------- */
 
-   pageAdr = (uintptr_t) dmaVirt[basePage];
+static int scrEvtWait(gpioScript_t *s, uint32_t bits)
+{
+   pthread_mutex_lock(&s->pthMutex);
 
-   index  = ((uintptr_t)virtualBase / PAGE_SIZE) * 8;
+   if (s->request == PI_SCRIPT_RUN)
+   {
+      s->run_state = PI_SCRIPT_WAITING;
+      s->eventBits = bits;
+      intScriptEventBits();
 
-   offset = lseek(pmapFd, index, SEEK_SET);
+      pthread_cond_wait(&s->pthCond, &s->pthMutex);
 
-   if (offset != index)
-      SOFT_ERROR(PI_INIT_FAILED, "lseek pagemap failed (%m)");
+      s->waitBits = 0;
+      intScriptEventBits();
+      s->run_state = PI_SCRIPT_RUNNING;
+   }
 
-   for (n=0; n<pages; n++)
-   {
-      t = read(pmapFd, &pa, sizeof(pa));
+   pthread_mutex_unlock(&s->pthMutex);
 
-      if (t != sizeof(pa))
-         SOFT_ERROR(PI_INIT_FAILED, "read pagemap failed (%m)");
+   return s->changedBits;
+}
 
-      DBG(DBG_STARTUP, "pf%d=%016llX", n, pa);
+/* ----------------------------------------------------------------------- */
 
-      physical = 0x3FFFFFFF & (PAGE_SIZE * (pa & 0xFFFFFFFF));
+static int scrWait(gpioScript_t *s, uint32_t bits)
+{
+   pthread_mutex_lock(&s->pthMutex);
 
-      if (physical)
-      {
-         //cast twice to suppress warning, I belive this is ok as these
-         //are bus addresses, not virtual addresses. --plugwash
-         dmaBus[basePage+n] = (dmaPage_t *)(uintptr_t) (physical | pi_dram_bus);
+   if (s->request == PI_SCRIPT_RUN)
+   {
+      s->run_state = PI_SCRIPT_WAITING;
+      s->waitBits = bits;
+      intScriptBits();
 
-         dmaVirt[basePage+n] = mmap
-         (
-            (void *)pageAdr,
-            PAGE_SIZE,
-            PROT_READ|PROT_WRITE,
-            MAP_SHARED|MAP_FIXED|MAP_LOCKED|MAP_NORESERVE,
-            fdMem,
-            physical
-         );
-      }
-      else status = 1;
+      pthread_cond_wait(&s->pthCond, &s->pthMutex);
 
-      pageAdr += PAGE_SIZE;
+      s->waitBits = 0;
+      intScriptBits();
+      s->run_state = PI_SCRIPT_RUNNING;
    }
 
-   return status;
+   pthread_mutex_unlock(&s->pthMutex);
+
+   return s->changedBits;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int initPagemapBlock(int block)
+static int scrSys(char *cmd, uint32_t p1, uint32_t p2)
 {
-   int trys, ok;
-   unsigned pageNum;
-
-   DBG(DBG_STARTUP, "block=%d", block);
+   char buf[1024];
+   int status;
 
-   dmaPMapBlk[block] = mmap(
-       0, (PAGES_PER_BLOCK*PAGE_SIZE),
-       PROT_READ|PROT_WRITE,
-       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
-       -1, 0);
+   if (!myScriptNameValid(cmd))
+      SOFT_ERROR(PI_BAD_SCRIPT_NAME, "bad script name (%s)", cmd);
 
-   if (dmaPMapBlk[block] == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
+   snprintf(buf, sizeof(buf), "/opt/pigpio/cgi/%s %u %u", cmd, p1, p2);
 
-   /* force allocation of physical memory */
+   DBG(DBG_USER, "%s", buf);
 
-   memset((void *)dmaPMapBlk[block], 0xAA, (PAGES_PER_BLOCK*PAGE_SIZE));
+   status = system(buf);
 
-   memset((void *)dmaPMapBlk[block], 0xFF, (PAGES_PER_BLOCK*PAGE_SIZE));
+   if (status < 0) status = PI_BAD_SHELL_STATUS;
 
-   memset((void *)dmaPMapBlk[block], 0, (PAGES_PER_BLOCK*PAGE_SIZE));
+   return status;
+}
 
-   pageNum = block * PAGES_PER_BLOCK;
+/* ----------------------------------------------------------------------- */
 
-   dmaVirt[pageNum] = mmap(
-       0, (PAGES_PER_BLOCK*PAGE_SIZE),
-       PROT_READ|PROT_WRITE,
-       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
-       -1, 0);
+static void *pthScript(void *x)
+{
+   gpioScript_t *s;
+   cmdInstr_t instr;
+   int p1, p2, p1o, p2o, p3o, *t1, *t2;
+   int PC, A, F, SP;
+   int S[PI_SCRIPT_STACK_SIZE];
+   char buf[CMD_MAX_EXTENSION];
 
-   if (dmaVirt[pageNum] == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
 
-   munmap(dmaVirt[pageNum], PAGES_PER_BLOCK*PAGE_SIZE);
+   S[0] = 0; /* to prevent compiler warning */
 
-   trys = 0;
-   ok = 0;
+   s = x;
 
-   while ((trys < 10) && !ok)
+   while ((volatile int)s->request != PI_SCRIPT_DELETE)
    {
-      if (initZaps(fdPmap,
-                    dmaPMapBlk[block],
-                    pageNum,
-                    PAGES_PER_BLOCK) == 0) ok = 1;
-      else myGpioDelay(50000);
-
-      ++trys;
-   }
+      pthread_mutex_lock(&s->pthMutex);
+      s->run_state = PI_SCRIPT_HALTED;
+      pthread_cond_wait(&s->pthCond, &s->pthMutex);
+      pthread_mutex_unlock(&s->pthMutex);
 
-   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "initZaps failed");
+      s->run_state = PI_SCRIPT_RUNNING;
 
-   return 0;
-}
+      A  = 0;
+      F  = 0;
+      PC = 0;
+      SP = 0;
 
-static int initMboxBlock(int block)
-{
-   int n, ok;
-   unsigned page;
-   uintptr_t virtualAdr;
-   uintptr_t busAdr;
+      while (((volatile int)s->request   == PI_SCRIPT_RUN    ) &&
+                           (s->run_state == PI_SCRIPT_RUNNING))
+      {
+         instr = s->script.instr[PC];
 
-   DBG(DBG_STARTUP, "block=%d", block);
+         p1o = instr.p[1];
+         p2o = instr.p[2];
 
-   ok = mbDMAAlloc
-      (&dmaMboxBlk[block], PAGES_PER_BLOCK * PAGE_SIZE, pi_mem_flag);
+         if      (instr.opt[1] == CMD_VAR) instr.p[1] = s->script.var[p1o];
+         else if (instr.opt[1] == CMD_PAR) instr.p[1] = s->script.par[p1o];
 
-   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "init mbox zaps failed");
+         if      (instr.opt[2] == CMD_VAR) instr.p[2] = s->script.var[p2o];
+         else if (instr.opt[2] == CMD_PAR) instr.p[2] = s->script.par[p2o];
+/*
+         fprintf(stderr, "PC=%d cmd=%d p1o=%d p1=%d p2o=%d p2=%d\n",
+            PC, instr.p[0], p1o, instr.p[1], p2o, instr.p[2]);
+         fflush(stderr);
+*/
+         if (instr.p[0] < PI_CMD_SCRIPT)
+         {
+            if (instr.p[3])
+            {
+               if ((instr.p[3] == sizeof(int)) && ((instr.opt[3] == CMD_VAR) || (instr.opt[3] == CMD_PAR)))
+               {
+                  /* Hack to allow register use in 3rd parameter */
+                  memcpy((char*)&p3o, (char *)instr.p[4], sizeof(int));
+                  if (instr.opt[3] == CMD_VAR) memcpy(buf, (char *)&(s->script.var[p3o]), sizeof(int));
+                  else                         memcpy(buf, (char *)&(s->script.par[p3o]), sizeof(int));
+               }
+               else
+               {
+                  memcpy(buf, (char *)instr.p[4], instr.p[3]);
+               }
+            }
 
-   page = block * PAGES_PER_BLOCK;
+            A = myDoCommand(instr.p, sizeof(buf)-1, buf);
 
-   virtualAdr = (uintptr_t) dmaMboxBlk[block].virtual_addr;
-   busAdr = dmaMboxBlk[block].bus_addr;
+            F = A;
 
-   for (n=0; n<PAGES_PER_BLOCK; n++)
-   {
-      dmaVirt[page+n] = (dmaPage_t *) virtualAdr;
-      dmaBus[page+n] = (dmaPage_t *) busAdr;
-      virtualAdr += PAGE_SIZE;
-      busAdr += PAGE_SIZE;
-   }
+            PC++;
+         }
+         else
+         {
+            p1 = instr.p[1];
+            p2 = instr.p[2];
 
-   return 0;
-}
+            switch (instr.p[0])
+            {
+               case PI_CMD_ADD:   A+=p1; F=A;                     PC++; break;
 
-/* ----------------------------------------------------------------------- */
+               case PI_CMD_AND:   A&=p1; F=A;                     PC++; break;
 
-static int initAllocDMAMem(void)
-{
-   int i, servoCycles, superCycles;
-   int status;
+               case PI_CMD_CALL:  scrPush(s, &SP, S, PC+1);    PC = p1; break;
 
-   DBG(DBG_STARTUP, "");
+               case PI_CMD_CMP:   F=A-p1;                         PC++; break;
 
-   /* Calculate the number of blocks needed for buffers.  The number
-      of blocks must be a multiple of the 20ms servo cycle.
-   */
+               case PI_CMD_DCR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {--s->script.par[p1o]; F=s->script.par[p1o];}
+                  else
+                     {--s->script.var[p1o]; F=s->script.var[p1o];}
+                  PC++;
+                  break;
 
-   servoCycles = gpioCfg.bufferMilliseconds / 20;
-   if           (gpioCfg.bufferMilliseconds % 20) servoCycles++;
+               case PI_CMD_DCRA:  --A; F=A;                       PC++; break;
 
-   bufferCycles = (SUPERCYCLE * servoCycles) / gpioCfg.clockMicros;
+               case PI_CMD_DIV:   A/=p1; F=A;                     PC++; break;
 
-   superCycles = bufferCycles / SUPERCYCLE;
-   if           (bufferCycles % SUPERCYCLE) superCycles++;
+               case PI_CMD_HALT:  s->run_state = PI_SCRIPT_HALTED;      break;
 
-   bufferCycles = SUPERCYCLE * superCycles;
+               case PI_CMD_EVTWT: A=scrEvtWait(s, p1); F=A;       PC++; break;
 
-   bufferBlocks = bufferCycles / CYCLES_PER_BLOCK;
+               case PI_CMD_INR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {++s->script.par[p1o]; F=s->script.par[p1o];}
+                  else
+                     {++s->script.var[p1o]; F=s->script.var[p1o];}
+                  PC++;
+                  break;
 
-   DBG(DBG_STARTUP, "bmillis=%d mics=%d bblk=%d bcyc=%d",
-      gpioCfg.bufferMilliseconds, gpioCfg.clockMicros,
-      bufferBlocks, bufferCycles);
+               case PI_CMD_INRA:  ++A; F=A;                       PC++; break;
 
-   /* allocate memory for pointers to virtual and bus memory pages */
+               case PI_CMD_JM:    if (F<0)  PC=p1; else PC++;           break;
 
-   dmaVirt = mmap(
-       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-       PROT_READ|PROT_WRITE,
-       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-       -1, 0);
+               case PI_CMD_JMP:   PC=p1;                                break;
 
-   if (dmaVirt == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma virtual failed (%m)");
+               case PI_CMD_JNZ:   if (F)    PC=p1; else PC++;           break;
 
-   dmaBus = mmap(
-       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-       PROT_READ|PROT_WRITE,
-       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-       -1, 0);
+               case PI_CMD_JP:    if (F>=0) PC=p1; else PC++;           break;
 
-   if (dmaBus == MAP_FAILED)
-      SOFT_ERROR(PI_INIT_FAILED, "mmap dma bus failed (%m)");
+               case PI_CMD_JZ:    if (!F)   PC=p1; else PC++;           break;
 
-   dmaIVirt = (dmaIPage_t **) dmaVirt;
-   dmaIBus  = (dmaIPage_t **) dmaBus;
+               case PI_CMD_LD:
+                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=p2;
+                  else                         s->script.var[p1o]=p2;
+                  PC++;
+                  break;
 
-   dmaOVirt = (dmaOPage_t **)(dmaVirt + (PAGES_PER_BLOCK*bufferBlocks));
-   dmaOBus  = (dmaOPage_t **)(dmaBus  + (PAGES_PER_BLOCK*bufferBlocks));
+               case PI_CMD_LDA:   A=p1;                           PC++; break;
 
-   if ((gpioCfg.memAllocMode == PI_MEM_ALLOC_PAGEMAP) ||
-       ((gpioCfg.memAllocMode == PI_MEM_ALLOC_AUTO) &&
-        (gpioCfg.bufferMilliseconds > PI_DEFAULT_BUFFER_MILLIS)))
-   {
-      /* pagemap allocation of DMA memory */
+               case PI_CMD_LDAB:
+                  if ((p1 >= 0) && (p1 < sizeof(buf))) A = buf[p1];
+                  PC++;
+                  break;
 
-      dmaPMapBlk = mmap(
-          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
-          PROT_READ|PROT_WRITE,
-          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-          -1, 0);
+               case PI_CMD_MLT:   A*=p1; F=A;                     PC++; break;
 
-      if (dmaPMapBlk == MAP_FAILED)
-         SOFT_ERROR(PI_INIT_FAILED, "pagemap mmap block failed (%m)");
+               case PI_CMD_MOD:   A%=p1; F=A;                     PC++; break;
 
-      fdPmap = open("/proc/self/pagemap", O_RDONLY);
+               case PI_CMD_OR:    A|=p1; F=A;                     PC++; break;
 
-      if (fdPmap < 0)
-         SOFT_ERROR(PI_INIT_FAILED, "pagemap open failed(%m)");
+               case PI_CMD_POP:
+                  if (instr.opt[1] == CMD_PAR)
+                     s->script.par[p1o]=scrPop(s, &SP, S);
+                  else
+                     s->script.var[p1o]=scrPop(s, &SP, S);
+                  PC++;
+                  break;
 
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         status = initPagemapBlock(i);
-         if (status < 0)
-         {
-            close(fdPmap);
-            return status;
-         }
-      }
+               case PI_CMD_POPA:  A=scrPop(s, &SP, S);            PC++; break;
 
-      close(fdPmap);
+               case PI_CMD_PUSH:
+                  if (instr.opt[1] == CMD_PAR)
+                     scrPush(s, &SP, S, s->script.par[p1o]);
+                  else
+                     scrPush(s, &SP, S, s->script.var[p1o]);
+                  PC++;
+                  break;
 
-      DBG(DBG_STARTUP, "dmaPMapBlk=%08"PRIXPTR" dmaIn=%08"PRIXPTR,
-         (uintptr_t)dmaPMapBlk, (uintptr_t)dmaIn);
-   }
-   else
-   {
-      /* mailbox allocation of DMA memory */
+               case PI_CMD_PUSHA: scrPush(s, &SP, S, A);          PC++; break;
 
-      dmaMboxBlk = mmap(
-          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t),
-          PROT_READ|PROT_WRITE,
-          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
-          -1, 0);
+               case PI_CMD_RET:   PC=scrPop(s, &SP, S);                 break;
 
-      if (dmaMboxBlk == MAP_FAILED)
-         SOFT_ERROR(PI_INIT_FAILED, "mmap mbox block failed (%m)");
+               case PI_CMD_RL:
+                  if (instr.opt[1] == CMD_PAR)
+                     {s->script.par[p1o]<<=p2; F=s->script.par[p1o];}
+                  else
+                     {s->script.var[p1o]<<=p2; F=s->script.var[p1o];}
+                  PC++;
+                  break;
 
-      fdMbox = mbOpen();
+               case PI_CMD_RLA:   A<<=p1; F=A;                    PC++; break;
 
-      if (fdMbox < 0)
-         SOFT_ERROR(PI_INIT_FAILED, "mbox open failed(%m)");
+               case PI_CMD_RR:
+                  if (instr.opt[1] == CMD_PAR)
+                     {s->script.par[p1o]>>=p2; F=s->script.par[p1o];}
+                  else
+                     {s->script.var[p1o]>>=p2; F=s->script.var[p1o];}
+                  PC++;
+                  break;
 
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         status = initMboxBlock(i);
-         if (status < 0)
-         {
-            mbClose(fdMbox);
-            return status;
-         }
-      }
+               case PI_CMD_RRA:   A>>=p1; F=A;                    PC++; break;
 
-      mbClose(fdMbox);
+               case PI_CMD_STA:
+                  if (instr.opt[1] == CMD_PAR) s->script.par[p1o]=A;
+                  else                         s->script.var[p1o]=A;
+                  PC++;
+                  break;
 
-      DBG(DBG_STARTUP, "dmaMboxBlk=%08"PRIXPTR" dmaIn=%08"PRIXPTR,
-         (uintptr_t)dmaMboxBlk, (uintptr_t)dmaIn);
-   }
+               case PI_CMD_STAB:
+                  if ((p1 >= 0) && (p1 < sizeof(buf))) buf[p1] = A;
+                  PC++;
+                  break;
 
-   DBG(DBG_STARTUP,
-      "gpioReg=%08"PRIXPTR" pwmReg=%08"PRIXPTR" pcmReg=%08"PRIXPTR" clkReg=%08"PRIXPTR" auxReg=%08"PRIXPTR,
-      (uintptr_t)gpioReg, (uintptr_t)pwmReg,
-      (uintptr_t)pcmReg,  (uintptr_t)clkReg, (uintptr_t)auxReg);
+               case PI_CMD_SUB:   A-=p1; F=A;                     PC++; break;
 
-   for (i=0; i<DMAI_PAGES; i++)
-      DBG(DBG_STARTUP, "dmaIBus[%d]=%08"PRIXPTR, i, (uintptr_t)dmaIBus[i]);
+               case PI_CMD_SYS:
+                  A=scrSys((char*)instr.p[4], A, *(gpioReg + GPLEV0));
+                  F=A;
+                  PC++;
+                  break;
+
+               case PI_CMD_WAIT:  A=scrWait(s, p1); F=A;          PC++; break;
+
+               case PI_CMD_X:
+                  if (instr.opt[1] == CMD_PAR) t1 = &s->script.par[p1o];
+                  else                         t1 = &s->script.var[p1o];
+
+                  if (instr.opt[2] == CMD_PAR) t2 = &s->script.par[p2o];
+                  else                         t2 = &s->script.var[p2o];
+
+                  scrSwap(t1, t2);
+                  PC++;
+                  break;
+
+               case PI_CMD_XA:
+                  if (instr.opt[1] == CMD_PAR)
+                     scrSwap(&s->script.par[p1o], &A);
+                  else
+                     scrSwap(&s->script.var[p1o], &A);
+                  PC++;
+                  break;
+
+               case PI_CMD_XOR:   A^=p1; F=A;                     PC++; break;
+
+            }
+         }
+
+         if (PC >= s->script.instrs) s->run_state = PI_SCRIPT_HALTED;
+
+      }
+
+      if ((volatile int)s->request == PI_SCRIPT_HALT)
+         s->run_state = PI_SCRIPT_HALTED;
 
-   if (gpioCfg.dbgLevel >= DBG_DMACBS)
-   {
-      fprintf(stderr, "*** INPUT DMA CONTROL BLOCKS ***\n");
-      for (i=0; i<NUM_CBS; i++) dmaCbPrint(i);
    }
 
    return 0;
@@ -7748,2961 +8561,6075 @@ static int initAllocDMAMem(void)
 
 /* ----------------------------------------------------------------------- */
 
-static void initPWM(unsigned bits)
+static uint64_t timerNanos(void)
 {
-   DBG(DBG_STARTUP, "bits=%d", bits);
+   struct timespec ts;
 
-   /* reset PWM */
+   clock_gettime(CLOCK_MONOTONIC, &ts);
 
-   pwmReg[PWM_CTL] = 0;
+   return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
 
-   myGpioDelay(10);
+static void timerRun(gpioTimer_t *t)
+{
+   callbk_t func;
+   unsigned ex;
+   void *userdata;
+   uint64_t start, end;
+   uint32_t jitter, duration;
 
-   pwmReg[PWM_STA] = -1;
+   /* called and returns with timerMutex held */
 
-   myGpioDelay(10);
+   func     = t->func;
+   ex       = t->ex;
+   userdata = t->userdata;
 
-   /* set number of bits to transmit */
+   /* the timer may have been cancelled since it was queued */
 
-   pwmReg[PWM_RNG1] = bits;
+   if (func)
+   {
+      t->running = 1;
+      t->runner  = pthread_self();
 
-   myGpioDelay(10);
+      pthread_mutex_unlock(&timerMutex);
 
-   dmaIVirt[0]->periphData = 1;
+      start = timerNanos();
 
-   /* enable PWM DMA, raise panic and dreq thresholds to 15 */
+      if (ex) (func)(userdata);
+      else    (func)();
 
-   pwmReg[PWM_DMAC] = PWM_DMAC_ENAB      |
-                      PWM_DMAC_PANIC(15) |
-                      PWM_DMAC_DREQ(15);
+      end = timerNanos();
 
-   myGpioDelay(10);
+      pthread_mutex_lock(&timerMutex);
 
-   /* clear PWM fifo */
+      t->running = 0;
 
-   pwmReg[PWM_CTL] = PWM_CTL_CLRF1;
+      jitter   = (start - t->queued) / 1000;
+      duration = (end - start) / 1000;
 
-   myGpioDelay(10);
+      t->stats.calls++;
+      t->totalJitter += start - t->queued;
+      t->stats.meanJitter = (t->totalJitter / 1000) / t->stats.calls;
 
-   /* enable PWM channel 1 and use fifo */
+      if (jitter   > t->stats.maxJitter)   t->stats.maxJitter   = jitter;
+      if (duration > t->stats.maxDuration) t->stats.maxDuration = duration;
 
-   pwmReg[PWM_CTL] = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
-}
+      pthread_cond_broadcast(&timerIdleCond);
+   }
 
-/* ----------------------------------------------------------------------- */
+   t->busy = 0;
+}
 
-static void initPCM(unsigned bits)
+static void * pthTimerThread(void *x)
 {
-   DBG(DBG_STARTUP, "bits=%d", bits);
-
-   /* disable PCM so we can modify the regs */
+   int i;
+   uint64_t now, next, period, skipped;
+   gpioTimer_t *t;
+   struct timespec ts;
 
-   pcmReg[PCM_CS] = 0;
+   /*
+   One thread times all the timers.  It sleeps until the earliest
+   absolute due time and each due time advances by whole periods,
+   so the callbacks do not drift by their own run time.
+   */
 
-   myGpioDelay(1000);
+   pthread_mutex_lock(&timerMutex);
 
-   pcmReg[PCM_FIFO]   = 0;
-   pcmReg[PCM_MODE]   = 0;
-   pcmReg[PCM_RXC]    = 0;
-   pcmReg[PCM_TXC]    = 0;
-   pcmReg[PCM_DREQ]   = 0;
-   pcmReg[PCM_INTEN]  = 0;
-   pcmReg[PCM_INTSTC] = 0;
-   pcmReg[PCM_GRAY]   = 0;
+   while (!timerStop)
+   {
+      now  = timerNanos();
+      next = 0;
 
-   myGpioDelay(1000);
+      for (i=0; i<=PI_MAX_TIMER; i++)
+      {
+         t = &gpioTimer[i];
 
-   pcmReg[PCM_MODE] = PCM_MODE_FLEN(bits-1); /* # bits in frame */
+         if (t->func == NULL) continue;
 
-   /* enable channel 1 with # bits width */
+         if (t->due <= now)
+         {
+            period = t->micros * 1000ULL;
 
-   pcmReg[PCM_TXC] = PCM_TXC_CH1EN | PCM_TXC_CH1WID(bits-8);
+            if (!t->busy) t->queued = t->due;
 
-   pcmReg[PCM_CS] |= PCM_CS_STBY; /* clear standby */
+            t->due += period;
 
-   myGpioDelay(1000);
+            if (t->due <= now)
+            {
+               /* fell a whole period or more behind */
 
-   pcmReg[PCM_CS] |= PCM_CS_TXCLR; /* clear TX FIFO */
+               skipped = ((now - t->due) / period) + 1;
+               t->due += skipped * period;
+               t->stats.missed += skipped;
+            }
 
-   pcmReg[PCM_CS] |= PCM_CS_DMAEN; /* enable DREQ */
+            if (t->busy) t->stats.missed++;
+            else
+            {
+               t->busy = 1;
 
-   pcmReg[PCM_DREQ] = PCM_DREQ_TX_PANIC(16) | PCM_DREQ_TX_REQ_L(30);
+               if (pthTimerWorkersRunning)
+               {
+                  timerQueue[(timerQueueHead + timerQueueLen) %
+                     (PI_MAX_TIMER+1)] = i;
+                  timerQueueLen++;
+                  pthread_cond_signal(&timerWorkCond);
+               }
+               else timerRun(t);
+            }
+         }
 
-   pcmReg[PCM_INTSTC] = 0b1111; /* clear status bits */
+         if (t->func && (!next || (t->due < next))) next = t->due;
+      }
 
-   /* enable PCM */
+      if (timerStop) break;
 
-   pcmReg[PCM_CS] |= PCM_CS_EN;
+      if (next)
+      {
+         ts.tv_sec  = next / 1000000000;
+         ts.tv_nsec = next % 1000000000;
 
-   /* enable tx */
+         pthread_cond_timedwait(&timerCond, &timerMutex, &ts);
+      }
+      else pthread_cond_wait(&timerCond, &timerMutex);
+   }
 
-   pcmReg[PCM_CS] |= PCM_CS_TXON;
+   pthread_mutex_unlock(&timerMutex);
 
-   dmaIVirt[0]->periphData = 0x0F;
+   return 0;
 }
 
-/* ----------------------------------------------------------------------- */
-
-static void initHWClk
-   (int clkCtl, int clkDiv, int clkSrc, int divI, int divF, int MASH)
+static void * pthTimerWorkerThread(void *x)
 {
-   DBG(DBG_INTERNAL, "ctl=%d div=%d src=%d /I=%d /f=%d M=%d",
-      clkCtl, clkDiv, clkSrc, divI, divF, MASH);
+   int id;
 
-   /* kill the clock if busy, anything else isn't reliable */
+   pthread_mutex_lock(&timerMutex);
 
-   if (clkReg[clkCtl] & CLK_CTL_BUSY)
+   while (1)
    {
-      do
-      {
-         clkReg[clkCtl] = BCM_PASSWD | CLK_CTL_KILL;
-      }
-      while (clkReg[clkCtl] & CLK_CTL_BUSY);
-   }
+      while (!timerQueueLen && !timerStop)
+         pthread_cond_wait(&timerWorkCond, &timerMutex);
 
-   clkReg[clkDiv] = (BCM_PASSWD | CLK_DIV_DIVI(divI) | CLK_DIV_DIVF(divF));
+      if (timerStop) break;
 
-   usleep(10);
+      id = timerQueue[timerQueueHead];
 
-   clkReg[clkCtl] = (BCM_PASSWD | CLK_CTL_MASH(MASH) | CLK_CTL_SRC(clkSrc));
+      timerQueueHead = (timerQueueHead + 1) % (PI_MAX_TIMER+1);
+      timerQueueLen--;
 
-   usleep(10);
+      timerRun(&gpioTimer[id]);
+   }
 
-   clkReg[clkCtl] |= (BCM_PASSWD | CLK_CTL_ENAB);
+   pthread_mutex_unlock(&timerMutex);
+
+   return 0;
 }
 
-static void initClock(int mainClock)
+static void timerAbandon(void)
 {
-   const unsigned BITS=10;
-   int clockPWM;
-   unsigned clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash, clkBits;
-   char *per;
-   unsigned micros;
+   int i;
 
-   DBG(DBG_STARTUP, "mainClock=%d", mainClock);
+   /*
+   Called with timerMutex held when timerStart fails part way.  Stop
+   and join the threads already started so the next timerStart
+   starts afresh.  None has run a timer yet.
+   */
 
-   if (mainClock) micros = gpioCfg.clockMicros;
-   else           micros = PI_WF_MICROS;
+   timerStop = 1;
 
-   clockPWM = mainClock ^ (gpioCfg.clockPeriph == PI_CLOCK_PCM);
+   pthread_cond_broadcast(&timerCond);
+   pthread_cond_broadcast(&timerWorkCond);
 
-   if (clockPWM)
-   {
-      clkCtl = CLK_PWMCTL;
-      clkDiv = CLK_PWMDIV;
-      per = "PWM";
-   }
-   else
-   {
-      clkCtl = CLK_PCMCTL;
-      clkDiv = CLK_PCMDIV;
-      per = "PCM";
-   }
+   pthread_mutex_unlock(&timerMutex);
 
-   clkSrc  = CLK_CTL_SRC_PLLD;
-   clkDivI = clk_plld_freq / (10000000 / micros); /* 10 MHz - 1 MHz */ 
-   clkBits = BITS;        /* 10/BITS MHz - 1/BITS MHz */
-   clkDivF = 0;
-   clkMash = 0;
+   pthread_join(pthTimer, NULL);
 
-   DBG(DBG_STARTUP, "%s PLLD divi=%d divf=%d mash=%d bits=%d",
-      per, clkDivI, clkDivF, clkMash, clkBits);
+   for (i=0; i<pthTimerWorkersRunning; i++)
+      pthread_join(pthTimerWorker[i], NULL);
 
-   initHWClk(clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash);
+   pthread_mutex_lock(&timerMutex);
 
-   if (clockPWM) initPWM(BITS);
-   else          initPCM(BITS);
+   pthread_cond_destroy(&timerCond);
 
-   myGpioDelay(2000);
+   pthTimerRunning = PI_THREAD_NONE;
+   pthTimerWorkersRunning = 0;
 }
 
-static void initKillDMA(volatile uint32_t *dmaAddr)
+static int timerCalledFromTimer(void)
 {
-   dmaAddr[DMA_CS] = DMA_CHANNEL_ABORT;
-   dmaAddr[DMA_CS] = 0;
-   dmaAddr[DMA_CS] = DMA_CHANNEL_RESET;
+   int i;
 
-   dmaAddr[DMA_CONBLK_AD] = 0;
-}
+   /* called with timerMutex held */
 
-/* ----------------------------------------------------------------------- */
+   for (i=0; i<=PI_MAX_TIMER; i++)
+   {
+      if (gpioTimer[i].running &&
+          pthread_equal(gpioTimer[i].runner, pthread_self())) return 1;
+   }
 
-static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr)
+   return 0;
+}
+
+static int timerStart(void)
 {
-   DBG(DBG_STARTUP, "");
+   pthread_attr_t pthAttr;
+   pthread_condattr_t condAttr;
 
-   initKillDMA(dmaAddr);
+   /* called with timerMutex held */
 
-   dmaAddr[DMA_CS] = DMA_INTERRUPT_STATUS | DMA_END_FLAG;
+   if (pthTimerRunning != PI_THREAD_NONE) return 0;
 
-   dmaAddr[DMA_CONBLK_AD] = cbAddr;
+   if (pthread_condattr_init(&condAttr) ||
+       pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC) ||
+       pthread_cond_init(&timerCond, &condAttr))
+      SOFT_ERROR(PI_TIMER_FAILED, "timer condition init failed (%m)");
 
-   /* clear READ/FIFO/READ_LAST_NOT_SET error bits */
+   pthread_condattr_destroy(&condAttr);
 
-   dmaAddr[DMA_DEBUG] = DMA_DEBUG_READ_ERR            |
-                        DMA_DEBUG_FIFO_ERR            |
-                        DMA_DEBUG_RD_LST_NOT_SET_ERR;
+   if (pthread_attr_init(&pthAttr))
+      SOFT_ERROR(PI_TIMER_FAILED, "pthread_attr_init failed (%m)");
 
+   if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
+      SOFT_ERROR(PI_TIMER_FAILED, "pthread_attr_setstacksize failed (%m)");
 
-   dmaAddr[DMA_CS] = DMA_WAIT_ON_WRITES    |
-                     DMA_PANIC_PRIORITY(8) |
-                     DMA_PRIORITY(8)       |
-                     DMA_ACTIVE;
-}
+   timerStop = 0;
+   timerQueueHead = 0;
+   timerQueueLen = 0;
 
-/* ----------------------------------------------------------------------- */
+   if (pthread_create(&pthTimer, &pthAttr, pthTimerThread, NULL))
+      SOFT_ERROR(PI_TIMER_FAILED, "pthread_create timer failed (%m)");
 
-static void initClearGlobals(void)
+   pthTimerRunning = PI_THREAD_STARTED;
+
+   while (pthTimerWorkersRunning < gpioCfg.timerWorkers)
+   {
+      if (pthread_create(&pthTimerWorker[pthTimerWorkersRunning], &pthAttr,
+                         pthTimerWorkerThread, NULL))
+      {
+         timerAbandon();
+
+         SOFT_ERROR(PI_TIMER_FAILED,
+            "pthread_create timer worker failed (%m)");
+      }
+
+      pthTimerWorkersRunning++;
+   }
+
+   return 0;
+}
+
+static void timerTerminate(void)
 {
    int i;
 
-   DBG(DBG_STARTUP, "");
+   if (pthTimerRunning == PI_THREAD_NONE) return;
 
-   alertBits   = 0;
-   monitorBits = 0;
-   notifyBits  = 0;
-   scriptBits  = 0;
-   gFilterBits = 0;
-   nFilterBits = 0;
-   wdogBits    = 0;
+   pthread_mutex_lock(&timerMutex);
 
-   pthAlertRunning  = PI_THREAD_NONE;
-   pthFifoRunning   = PI_THREAD_NONE;
-   pthSocketRunning = PI_THREAD_NONE;
+   timerStop = 1;
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   pthread_cond_broadcast(&timerCond);
+   pthread_cond_broadcast(&timerWorkCond);
 
-   wfcur=0;
+   pthread_mutex_unlock(&timerMutex);
 
-   wfStats.micros     = 0;
-   wfStats.highMicros = 0;
-   wfStats.maxMicros  = PI_WAVE_MAX_MICROS;
+   /* a timer callback may be terminating the library */
 
-   wfStats.pulses     = 0;
-   wfStats.highPulses = 0;
-   wfStats.maxPulses  = PI_WAVE_MAX_PULSES;
+   if (!pthread_equal(pthTimer, pthread_self()))
+      pthread_join(pthTimer, NULL);
 
-   wfStats.cbs        = 0;
-   wfStats.highCbs    = 0;
-   wfStats.maxCbs     = (PI_WAVE_BLOCKS * PAGES_PER_BLOCK * CBS_PER_OPAGE);
+   for (i=0; i<pthTimerWorkersRunning; i++)
+   {
+      if (!pthread_equal(pthTimerWorker[i], pthread_self()))
+         pthread_join(pthTimerWorker[i], NULL);
+   }
 
-   gpioGetSamples.func     = NULL;
-   gpioGetSamples.ex       = 0;
-   gpioGetSamples.userdata = NULL;
-   gpioGetSamples.bits     = 0;
+   pthread_cond_destroy(&timerCond);
 
-   for (i=0; i<=PI_MAX_USER_GPIO; i++)
+   pthTimerRunning = PI_THREAD_NONE;
+   pthTimerWorkersRunning = 0;
+
+   for (i=0; i<=PI_MAX_TIMER; i++)
    {
-      wfRx[i].mode      = PI_WFRX_NONE;
-      pthread_mutex_init(&wfRx[i].mutex, NULL);
-      gpioAlert[i].func = NULL;
+      gpioTimer[i].func = NULL;
+      gpioTimer[i].busy = 0;
+      gpioTimer[i].running = 0;
    }
+}
 
-   for (i=0; i<=PI_MAX_GPIO; i++)
-   {
-      gpioInfo [i].is      = GPIO_UNDEFINED;
-      gpioInfo [i].width   = 0;
-      gpioInfo [i].range   = PI_DEFAULT_DUTYCYCLE_RANGE;
-      gpioInfo [i].freqIdx = DEFAULT_PWM_IDX;
-   }
+/* ----------------------------------------------------------------------- */
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
-   {
-      gpioNotify[i].seqno = 0;
-      gpioNotify[i].state = PI_NOTIFY_CLOSED;
-   }
 
-   for (i=0; i<=PI_MAX_SIGNUM; i++)
-   {
-      gpioSignal[i].func     = NULL;
-      gpioSignal[i].ex       = 0;
-      gpioSignal[i].userdata = NULL;
-   }
+static void * pthFifoThread(void *x)
+{
+   char buf[CMD_MAX_EXTENSION];
+   int idx, flags, len, res, i;
+   uintptr_t p[CMD_P_ARR];
+   cmdCtlParse_t ctl;
+   uint32_t *param;
+   char v[CMD_MAX_EXTENSION];
 
-   for (i=0; i<=PI_MAX_TIMER; i++)
-   {
-      gpioTimer[i].running = 0;
-      gpioTimer[i].func    = NULL;
-   }
+   myCreatePipe(PI_INPFIFO, 0662);
 
-   for (i=0; i<=PI_MAX_EVENT; i++)
-   {
-      eventAlert[i].func      = NULL;
-      eventAlert[i].ignore    = 0;
-      eventAlert[i].fired     = 0;
-   }
+   if ((inpFifo = fopen(PI_INPFIFO, "r+")) == NULL)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed(%m)", PI_INPFIFO);
 
-   /* calculate the usable PWM frequencies */
+   myCreatePipe(PI_OUTFIFO, 0664);
 
-   for (i=0; i<PWM_FREQS; i++)
+   if ((outFifo = fopen(PI_OUTFIFO, "w+")) == NULL)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "fopen %s failed (%m)", PI_OUTFIFO);
+
+   /* set outFifo non-blocking */
+
+   flags = fcntl(fileno(outFifo), F_GETFL, 0);
+   fcntl(fileno(outFifo), F_SETFL, flags | O_NONBLOCK);
+
+   /* don't start until DMA started */
+
+   spinWhileStarting();
+
+   while (1)
    {
-      pwmFreq[i]=
-         (1000000.0/
-            ((float)PULSE_PER_CYCLE*gpioCfg.clockMicros*pwmCycles[i]))+0.5;
+      if (fgets(buf, sizeof(buf), inpFifo) == NULL)
+         SOFT_ERROR((void*)PI_INIT_FAILED, "fifo fgets failed (%m)");
 
-      DBG(DBG_STARTUP, "f%d is %d", i, pwmFreq[i]);
-   }
+      len = strlen(buf);
 
-   inpFifo = NULL;
-   outFifo = NULL;
+      if (len)
+      {
+        --len;
+        buf[len] = 0; /* replace terminating */
+      }
 
-   fdLock       = -1;
-   fdMem        = -1;
-   fdSock       = -1;
+      ctl.eaten = 0;
+      idx = 0;
 
-   dmaMboxBlk = MAP_FAILED;
-   dmaPMapBlk = MAP_FAILED;
-   dmaVirt = MAP_FAILED;
-   dmaBus  = MAP_FAILED;
+      while (((ctl.eaten)<len) && (idx >= 0))
+      {
+         if ((idx=cmdParse(buf, p, CMD_MAX_EXTENSION, v, &ctl)) >= 0)
+         {
+            /* make sure extensions are null terminated */
 
-   auxReg  = MAP_FAILED;
-   clkReg  = MAP_FAILED;
-   dmaReg  = MAP_FAILED;
-   gpioReg = MAP_FAILED;
-   pcmReg  = MAP_FAILED;
-   pwmReg  = MAP_FAILED;
-   systReg = MAP_FAILED;
-   spiReg  = MAP_FAILED;
-}
+            v[p[3]] = 0;
 
-/* ----------------------------------------------------------------------- */
+            res = myDoCommand(p, sizeof(v)-1, v);
 
-static void initReleaseResources(void)
-{
-   int i;
+            switch (cmdInfo[idx].rv)
+            {
+               case 0:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
 
-   DBG(DBG_STARTUP, "");
+               case 1:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
 
-   /* shut down running threads */
+               case 2:
+                  fprintf(outFifo, "%d\n", res);
+                  break;
 
-   for (i=0; i<=PI_MAX_GPIO; i++)
-   {
-      if (gpioISR[i].pth)
-      {
-         /* destroy thread, unexport GPIO */
+               case 3:
+                  fprintf(outFifo, "%08X\n", res);
+                  break;
 
-         gpioSetISRFunc(i, 0, 0, NULL);
-      }
-   }
+               case 4:
+                  fprintf(outFifo, "%u\n", res);
+                  break;
 
-   for (i=0; i<=PI_MAX_TIMER; i++)
-   {
-      if (gpioTimer[i].running)
-      {
-         /* destroy thread */
+               case 5:
+                  fprintf(outFifo, "%s", cmdUsage);
+                  break;
+
+               case 6:
+                  fprintf(outFifo, "%d", res);
+                  if (res > 0)
+                  {
+                     for (i=0; i<res; i++)
+                     {
+                        fprintf(outFifo, " %d", v[i]);
+                     }
+                  }
+                  fprintf(outFifo, "\n");
+                  break;
 
-         pthread_cancel(gpioTimer[i].pthId);
-         pthread_join(gpioTimer[i].pthId, NULL);
-         gpioTimer[i].running = 0;
+               case 7:
+                  if (res < 0) fprintf(outFifo, "%d\n", res);
+                  else
+                  {
+                     fprintf(outFifo, "%d", res);
+                     param = (uint32_t *)v;
+                     for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
+                     {
+                        fprintf(outFifo, " %d", param[i]);
+                     }
+                     fprintf(outFifo, "\n");
+                  }
+                  break;
+            }
+         }
+         else fprintf(outFifo, "%d\n", PI_BAD_FIFO_COMMAND);
       }
-   }
 
-   if (pthAlertRunning != PI_THREAD_NONE)
-   {
-      pthread_cancel(pthAlert);
-      pthread_join(pthAlert, NULL);
-      pthAlertRunning = PI_THREAD_NONE;
+      fflush(outFifo);
    }
 
-   if (pthFifoRunning != PI_THREAD_NONE)
-   {
-      pthread_cancel(pthFifo);
-      pthread_join(pthFifo, NULL);
-      pthFifoRunning = PI_THREAD_NONE;
-   }
+   return 0;
+}
 
-   if (pthSocketRunning != PI_THREAD_NONE)
-   {
-      pthread_cancel(pthSocket);
-      pthread_join(pthSocket, NULL);
-      pthSocketRunning = PI_THREAD_NONE;
-   }
+/* ----------------------------------------------------------------------- */
 
-   /* release mmap'd memory */
+static void ringMutex(int lock)
+{
+   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+   if (lock) pthread_mutex_lock(&mutex);
+   else      pthread_mutex_unlock(&mutex);
+}
 
-   if (auxReg  != MAP_FAILED) munmap((void *)auxReg,  AUX_LEN);
-   if (bscsReg != MAP_FAILED) munmap((void *)bscsReg, BSCS_LEN);
-   if (clkReg  != MAP_FAILED) munmap((void *)clkReg,  CLK_LEN);
-   if (dmaReg  != MAP_FAILED) munmap((void *)dmaReg,  DMA_LEN);
-   if (gpioReg != MAP_FAILED) munmap((void *)gpioReg, GPIO_LEN);
-   if (pcmReg  != MAP_FAILED) munmap((void *)pcmReg,  PCM_LEN);
-   if (pwmReg  != MAP_FAILED) munmap((void *)pwmReg,  PWM_LEN);
-   if (systReg != MAP_FAILED) munmap((void *)systReg, SYST_LEN);
-   if (spiReg  != MAP_FAILED) munmap((void *)spiReg,  SPI_LEN);
+/* ----------------------------------------------------------------------- */
 
-   auxReg  = MAP_FAILED;
-   bscsReg = MAP_FAILED;
-   clkReg  = MAP_FAILED;
-   dmaReg  = MAP_FAILED;
-   gpioReg = MAP_FAILED;
-   pcmReg  = MAP_FAILED;
-   pwmReg  = MAP_FAILED;
-   systReg = MAP_FAILED;
-   spiReg  = MAP_FAILED;
+static void ringWake(uint32_t *addr)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
 
-   if (dmaBus != MAP_FAILED)
-   {
-      munmap(dmaBus,
-         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
-   }
+/* ----------------------------------------------------------------------- */
 
-   dmaBus = MAP_FAILED;
+static void ringPark(uint32_t *addr, uint32_t val)
+{
+   struct timespec ts;
 
-   if (dmaVirt != MAP_FAILED)
-   {
-      for (i=0; i<PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         munmap(dmaVirt[i], PAGE_SIZE);
-      }
+   ts.tv_sec  = 0;
+   ts.tv_nsec = RING_PARK_NANOS;
 
-      munmap(dmaVirt,
-         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
-   }
+   syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
 
-   dmaVirt = MAP_FAILED;
+/* ----------------------------------------------------------------------- */
 
-   if (dmaPMapBlk != MAP_FAILED)
+static void *pthRingThread(void *x)
+{
+   gpioRing_t *r = x;
+   cmdRing_t *ring = r->ring;
+   cmdRingSlot_t *slot;
+   cmdCmd_t cmd;
+   uintptr_t p[10];
+   uint32_t head, tail, startTick;
+   int res;
+   char buf[CMD_RING_EXT_LEN+1];
+
+   tail = 0;
+
+   while (1)
    {
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      /* spin briefly for the next request, then park on head */
+
+      startTick = gpioTick();
+
+      while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
       {
-         munmap(dmaPMapBlk[i], PAGES_PER_BLOCK*PAGE_SIZE);
-      }
+         if (__atomic_load_n(&r->closing, __ATOMIC_ACQUIRE)) return NULL;
 
-      munmap(dmaPMapBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
-   }
+         if ((gpioTick() - startTick) > RING_SPIN_MICROS)
+         {
+            __atomic_store_n(&ring->headWaiting, 1, __ATOMIC_SEQ_CST);
 
-   dmaPMapBlk = MAP_FAILED;
+            if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+               ringPark(&ring->head, tail);
 
-   if (dmaMboxBlk != MAP_FAILED)
-   {
-      fdMbox = mbOpen();
+            __atomic_store_n(&ring->headWaiting, 0, __ATOMIC_SEQ_CST);
 
-      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
-      {
-         mbDMAFree(&dmaMboxBlk[bufferBlocks+PI_WAVE_BLOCKS-i-1]);
+            startTick = gpioTick();
+         }
       }
 
-      mbClose(fdMbox);
+      /* claim the request, the client claims it back if closing */
 
-      munmap(dmaMboxBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t));
-   }
+      head = tail;
 
-   dmaMboxBlk = MAP_FAILED;
+      if (!__atomic_compare_exchange_n(&ring->taken, &head, tail+1, 0,
+             __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return NULL;
 
-   if (inpFifo != NULL)
-   {
-      fclose(inpFifo);
-      unlink(PI_INPFIFO);
-      inpFifo = NULL;
-   }
+      /* copy the request, the client shares the slot */
 
-   if (outFifo != NULL)
-   {
-      fclose(outFifo);
-      unlink(PI_OUTFIFO);
-      outFifo = NULL;
-   }
+      slot = &ring->slot[tail % CMD_RING_SLOTS];
 
-   if (fdMem != -1)
-   {
-      close(fdMem);
-      fdMem = -1;
-   }
+      memcpy(&cmd, &slot->cmd, sizeof(cmd));
 
-   if (fdLock != -1)
-   {
-      close(fdLock);
-      unlink(PI_LOCKFILE);
-      fdLock = -1;
-   }
+      p[0] = cmd.cmd;
+      p[1] = cmd.p1;
+      p[2] = cmd.p2;
+      p[3] = cmd.ext_len;
 
-   if (fdSock != -1)
-   {
-      close(fdSock);
-      fdSock = -1;
-   }
+      /* the ring has no room for extensions in responses */
 
-   if (fdPmap != -1)
-   {
-      close(fdPmap);
-      fdPmap = -1;
-   }
+      if ((p[3] > CMD_RING_EXT_LEN) || cmdReturnsExt(p[0]))
+         res = PI_BAD_RING_CMD;
+      else
+      {
+         switch (p[0])
+         {
+            /* socket only commands */
+
+            case PI_CMD_NOIB:
+            case PI_CMD_NOIBF:
+            case PI_CMD_RINGC:
+            case PI_CMD_RINGO:
+            case PI_CMD_ENCO:
+               res = PI_BAD_RING_CMD;
+               break;
 
-   if (fdMbox != -1)
-   {
-      close(fdMbox);
-      fdMbox = -1;
-   }
+            default:
+               memcpy(buf, slot->ext, p[3]);
 
-   gpioStats.DMARestarts = 0;
-   gpioStats.dmaInitCbsCount = 0;
+               /* add null terminator in case it's a string */
 
-   numSockNetAddr = 0;
+               buf[p[3]] = 0;
+
+               res = myDoCommand(p, sizeof(buf)-1, buf);
+         }
+      }
+
+      slot->cmd.res = res;
+
+      tail++;
+
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+
+      if (__atomic_load_n(&ring->tailWaiting, __ATOMIC_SEQ_CST))
+         ringWake(&ring->tail);
+   }
+
+   return NULL;
 }
 
-int initInitialise(void)
+/* ----------------------------------------------------------------------- */
+
+static void ringStop(int handle)
 {
-   int i;
-   unsigned rev, model;
-   struct sockaddr_in server;
-   struct sockaddr_in6 server6;
-   char * portStr;
-   unsigned port;
-   struct sched_param param;
-   pthread_attr_t pthAttr;
+   gpioRing_t *r = &gpioRing[handle];
+   char name[32];
 
-   DBG(DBG_STARTUP, "");
+   DBG(DBG_USER, "handle=%d", handle);
 
-   waveClockInited = 0;
-   PWMClockInited = 0;
+   __atomic_store_n(&r->closing, 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&r->ring->closing, 1, __ATOMIC_SEQ_CST);
 
-   clock_gettime(CLOCK_REALTIME, &libStarted);
+   ringWake(&r->ring->head);
+   ringWake(&r->ring->tail);
 
-   rev = gpioHardwareRevision();
+   pthread_join(r->pthId, NULL);
 
-   initClearGlobals();
+   munmap(r->ring, sizeof(cmdRing_t));
 
-   if (initCheckPermitted() < 0) return PI_INIT_FAILED;
+   sprintf(name, CMD_RING_NAME, handle);
 
-   fdLock = initGrabLockFile();
+   shm_unlink(name);
 
-   if (fdLock < 0)
-      SOFT_ERROR(PI_INIT_FAILED, "Can't lock %s", PI_LOCKFILE);
+   r->state = PI_RING_CLOSED;
+}
 
-   if (!gpioMaskSet)
-   {
-      if      (rev ==  0) gpioMask = PI_DEFAULT_UPDATE_MASK_UNKNOWN;
-      else if (rev <   4) gpioMask = PI_DEFAULT_UPDATE_MASK_B1;
-      else if (rev <  16) gpioMask = PI_DEFAULT_UPDATE_MASK_A_B2;
-      else if (rev == 17) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
-      else if (rev  < 20) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
-      else if (rev == 20) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
-      else if (rev == 21) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
-      else
-      {
-         model = (rev >> 4) & 0xFF;
+/* ----------------------------------------------------------------------- */
 
-         /* model
-         0=A 1=B
-         2=A+ 3=B+
-         4=Pi2B
-         5=Alpha
-         6=Compute Module
-         7=Unknown
-         8=Pi3B
-         9=Zero
-         12=Zero W
-         13=Pi3B+
-         14=Pi3A+
-         17=Pi4B
-         */
-         if      (model <  2) gpioMask = PI_DEFAULT_UPDATE_MASK_A_B2;
-         else if (model <  4) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
-         else if (model == 4) gpioMask = PI_DEFAULT_UPDATE_MASK_PI2B;
+static int ringOpen(int sock)
+{
+   int i, slot, fd, local;
+   char name[32];
+   cmdRing_t *ring;
+   struct sockaddr_storage addr;
+   struct ucred cred;
+   socklen_t len;
+   pthread_attr_t pthAttr;
 
-         else if (model == 6
-               || model ==10
-               || model ==16) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
+   DBG(DBG_USER, "sock=%d", sock);
 
-         else if (model == 8
-               || model ==13
-               || model ==14) gpioMask = PI_DEFAULT_UPDATE_MASK_PI3B;
+   CHECK_INITED;
 
-         else if (model == 9
-               || model ==12) gpioMask = PI_DEFAULT_UPDATE_MASK_ZERO;
+   /* shared memory is only visible to clients on this host */
 
-         else if (model ==17) gpioMask = PI_DEFAULT_UPDATE_MASK_PI4B;
-         else                 gpioMask = PI_DEFAULT_UPDATE_MASK_UNKNOWN;
-      }
+   local = 0;
 
-      gpioMaskSet = 1;
-   }
+   len = sizeof(addr);
 
-#ifndef EMBEDDED_IN_VM
-   if (!(gpioCfg.internals & PI_CFG_NOSIGHANDLER))
-      sigSetHandler();
-#endif
+   if (getpeername(sock, (struct sockaddr *)&addr, &len) == 0)
+   {
+      if (addr.ss_family == AF_UNIX) local = 1;
 
-   if (initPeripherals() < 0) return PI_INIT_FAILED;
+      else if (addr.ss_family == AF_INET)
+         local = ((ntohl(((struct sockaddr_in *)&addr)->sin_addr.s_addr)
+            >> 24) == 127);
 
-   if (initAllocDMAMem() < 0) return PI_INIT_FAILED;
+      else if (addr.ss_family == AF_INET6)
+         local = IN6_IS_ADDR_LOOPBACK(
+            &((struct sockaddr_in6 *)&addr)->sin6_addr);
+   }
 
-   /* done with /dev/mem */
+   if (!local) SOFT_ERROR(PI_RING_FAILED, "client not local");
 
-   if (fdMem != -1)
+   slot = -1;
+
+   ringMutex(1);
+
+   for (i=0; i<MAX_RINGS; i++)
    {
-      close(fdMem);
-      fdMem = -1;
+      if (gpioRing[i].state == PI_RING_CLOSED)
+      {
+         slot = i;
+         gpioRing[slot].state = PI_RING_RESERVED;
+         break;
+      }
    }
 
-   param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+   ringMutex(0);
 
-   if (gpioCfg.internals & PI_CFG_RT_PRIORITY)
-      sched_setscheduler(0, SCHED_FIFO, &param);
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-   initClock(1); /* initialise main clock */
+   sprintf(name, CMD_RING_NAME, slot);
 
-   atexit(gpioTerminate);
+   /* remove any ring left behind by an earlier daemon */
 
-   if (pthread_attr_init(&pthAttr))
-      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_init failed (%m)");
+   shm_unlink(name);
 
-   if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
-      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_setstacksize failed (%m)");
+   fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
 
-   if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
+   if (fd < 0)
    {
-      if (pthread_create(&pthAlert, &pthAttr, pthAlertThread, &i))
-         SOFT_ERROR(PI_INIT_FAILED, "pthread_create alert failed (%m)");
-
-      pthAlertRunning = PI_THREAD_STARTED;
+      gpioRing[slot].state = PI_RING_CLOSED;
+      SOFT_ERROR(PI_RING_FAILED, "shm_open %s failed (%m)", name);
    }
 
-   if (!(gpioCfg.ifFlags & PI_DISABLE_FIFO_IF))
-   {
-      if (pthread_create(&pthFifo, &pthAttr, pthFifoThread, &i))
-         SOFT_ERROR(PI_INIT_FAILED, "pthread_create fifo failed (%m)");
-
-      pthFifoRunning = PI_THREAD_STARTED;
-   }
+   /*
+      A Unix domain client is known so the ring is made its own.
+      Any local user may already command a TCP connected daemon.
+   */
 
-   if (!(gpioCfg.ifFlags & PI_DISABLE_SOCK_IF))
+   if (addr.ss_family == AF_UNIX)
    {
-      portStr = getenv(PI_ENVPORT);
-      if (portStr) port = atoi(portStr); else port = gpioCfg.socketPort;
+      len = sizeof(cred);
 
-      // Accept connections on IPv6, unless we have an IPv4-only whitelist
-      if (!numSockNetAddr)
+      if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
       {
-         fdSock = socket(AF_INET6, SOCK_STREAM , 0);
-
-         if (fdSock != -1)
-         {
-            bzero((char *)&server6, sizeof(server6));
-            server6.sin6_family = AF_INET6;
-            if (gpioCfg.ifFlags & PI_LOCALHOST_SOCK_IF)
-            {
-               server6.sin6_addr = in6addr_loopback;
-            }
-            else
-            {
-               server6.sin6_addr = in6addr_any;
-            }
-            server6.sin6_port = htons(port);
-
-            int opt = 1;
-            setsockopt(fdSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-            if (bind(fdSock,(struct sockaddr *)&server6, sizeof(server6)) < 0)
-               SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
-         }
+         if (fchown(fd, cred.uid, cred.gid)) { /* ignore errors */ }
       }
+   }
+   else fchmod(fd, 0666);
 
-      if (numSockNetAddr || fdSock == -1)
-      {
-         fdSock = socket(AF_INET , SOCK_STREAM , 0);
-
-         if (fdSock == -1)
-            SOFT_ERROR(PI_INIT_FAILED, "socket failed (%m)");
-         else
-         {
-           int opt = 1;
-           setsockopt(fdSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-         }
-         server.sin_family = AF_INET;
-         if (gpioCfg.ifFlags & PI_LOCALHOST_SOCK_IF)
-         {
-            server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-         }
-         else
-         {
-            server.sin_addr.s_addr = htonl(INADDR_ANY);
-         }
-         server.sin_port = htons(port);
+   ring = MAP_FAILED;
 
-         if (bind(fdSock,(struct sockaddr *)&server , sizeof(server)) < 0)
-            SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
-      }
+   if (ftruncate(fd, sizeof(cmdRing_t)) == 0)
+   {
+      ring = mmap(
+         0, sizeof(cmdRing_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+   }
 
-      if (pthread_create(&pthSocket, &pthAttr, pthSocketThread, &i))
-         SOFT_ERROR(PI_INIT_FAILED, "pthread_create socket failed (%m)");
+   close(fd);
 
-      pthSocketRunning = PI_THREAD_STARTED;
+   if (ring == MAP_FAILED)
+   {
+      shm_unlink(name);
+      gpioRing[slot].state = PI_RING_CLOSED;
+      SOFT_ERROR(PI_RING_FAILED, "mmap %s failed (%m)", name);
    }
 
-   myGpioDelay(1000);
-
-   dmaInitCbs();
+   gpioRing[slot].sock    = sock;
+   gpioRing[slot].closing = 0;
+   gpioRing[slot].ring    = ring;
 
-   flushMemory();
+   __atomic_store_n(&ring->magic, CMD_RING_MAGIC, __ATOMIC_RELEASE);
 
-   //cast twice to suppress compiler warning, I belive this cast
-   //is ok because dmaIBus contains bus addresses, not virtual
-   //addresses.
-   initDMAgo((uint32_t *)dmaIn, (uint32_t)(uintptr_t)dmaIBus[0]);
+   if ((pthread_attr_init(&pthAttr) == 0) &&
+       (pthread_attr_setstacksize(&pthAttr, STACK_SIZE) == 0) &&
+       (pthread_create(
+          &gpioRing[slot].pthId, &pthAttr, pthRingThread, &gpioRing[slot])
+          == 0))
+   {
+      gpioRing[slot].state = PI_RING_OPENED;
+      return slot;
+   }
 
-   return PIGPIO_VERSION;
+   munmap(ring, sizeof(cmdRing_t));
+   shm_unlink(name);
+   gpioRing[slot].state = PI_RING_CLOSED;
+   SOFT_ERROR(PI_RING_FAILED, "ring thread create failed (%m)");
 }
 
+/* ----------------------------------------------------------------------- */
 
-/* ======================================================================= */
-
-int getBitInBytes(int bitPos, char *buf, int numBits)
+static int ringClose(int sock, unsigned handle)
 {
-   int bitp, bufp;
+   DBG(DBG_USER, "sock=%d handle=%d", sock, handle);
 
-   if (bitPos < numBits)
-   {
-      bufp =      bitPos / 8;
-      bitp = 7 - (bitPos % 8);
-      if (buf[bufp] & (1<<bitp)) return 1;
-   }
+   CHECK_INITED;
+
+   if ((handle >= MAX_RINGS) ||
+       (gpioRing[handle].state != PI_RING_OPENED) ||
+       (gpioRing[handle].sock != sock))
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+
+   ringStop(handle);
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-void putBitInBytes(int bitPos, char *buf, int bit)
+static void closeOrphanedRings(int sock)
 {
-   int bitp, bufp;
+   int i;
 
-   bufp =      bitPos / 8;
-   bitp = 7 - (bitPos % 8);
+   /* Close any rings opened on a socket which is closing. */
 
-   if (bit) buf[bufp] |=   (1<<bitp);
-   else     buf[bufp] &= (~(1<<bitp));
+   for (i=0; i<MAX_RINGS; i++)
+   {
+      if ((gpioRing[i].state == PI_RING_OPENED) && (gpioRing[i].sock == sock))
+      {
+         DBG(DBG_USER, "closed orphaned ring (handle=%d)", i);
+         ringStop(i);
+      }
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-uint32_t rawWaveGetOOL(int pos)
+static int sockReadCommand(sockConn_t *conn)
 {
-   int page, slot;
+   unsigned need;
+   ssize_t n;
+   char *dst;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   /*
+      Reads whatever part of the current command is available
+      without blocking.  Returns 1 once the header and extension
+      are complete, 0 if more data is needed, otherwise -1 if the
+      socket should be closed.
+   */
+
+   while (1)
    {
-      waveOOLPageSlot(pos, &page, &slot);
-      return (dmaOVirt[page]->OOL[slot]);
-   }
+      if (conn->got < 16)
+      {
+         dst  = (char *)conn->hdr + conn->got;
+         need = 16 - conn->got;
+      }
+      else
+      {
+         if (conn->hdr[3] >= CMD_MAX_EXTENSION)
+         {
+            /* Serious error.  No point continuing. */
+            DBG(DBG_ALWAYS, "ext too large %u(%u), sock=%d",
+               conn->hdr[3], CMD_MAX_EXTENSION, conn->sock);
 
-   return -1;
-}
+            return -1;
+         }
 
-/* ----------------------------------------------------------------------- */
+         if (conn->got == (16 + conn->hdr[3])) return 1;
 
-void rawWaveSetOOL(int pos, uint32_t value)
-{
-   int page, slot;
+         if (conn->ext == NULL)
+         {
+            conn->ext = malloc(CMD_MAX_EXTENSION);
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
-   {
-      waveOOLPageSlot(pos, &page, &slot);
-      dmaOVirt[page]->OOL[slot] = value;
-   }
-}
+            if (conn->ext == NULL)
+            {
+               DBG(DBG_ALWAYS, "malloc failed, sock=%d", conn->sock);
+               return -1;
+            }
+         }
 
+         dst  = conn->ext + (conn->got - 16);
+         need = 16 + conn->hdr[3] - conn->got;
+      }
 
-/* ----------------------------------------------------------------------- */
+      n = recv(conn->sock, dst, need, MSG_DONTWAIT);
 
-uint32_t rawWaveGetOut(int pos)
-{
-   int page, slot;
+      if (n > 0)
+      {
+         conn->got += n;
+         continue;
+      }
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
-   {
-      waveOOLPageSlot(pos, &page, &slot);
-      return (dmaOVirt[page]->OOL[slot]);
-   }
+      if (n == 0) return -1; /* peer closed */
 
-   return -1;
+      if (errno == EINTR) continue;
+
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+
+      return -1;
+   }
 }
 
 /* ----------------------------------------------------------------------- */
 
-void rawWaveSetOut(int pos, uint32_t value)
+static void sockHandleCommand(sockConn_t *conn, char *buf, unsigned bufSize)
 {
-   int page, slot;
+   uintptr_t p[10];
+   uint32_t response[4];
+   int sock = conn->sock;
+   int i;
+   int opt;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
-   {
-      waveOOLPageSlot(pos, &page, &slot);
-      dmaOVirt[page]->OOL[slot] = value;
-   }
-}
+   for (i=0; i<4; i++) p[i] = (uintptr_t)conn->hdr[i];
 
+   conn->got = 0;
 
-/* ----------------------------------------------------------------------- */
+   if (p[3]) memcpy(buf, conn->ext, p[3]);
 
-uint32_t rawWaveGetIn(int pos)
-{
-   int page, slot;
+   /* add null terminator in case it's a string */
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   buf[p[3]] = 0;
+
+   switch (p[0])
    {
-      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
-      return (dmaOVirt[page]->OOL[slot]);
-   }
+      case PI_CMD_NOIB:
+      case PI_CMD_NOIBF:
 
-   return -1;
-}
+         if (p[0] == PI_CMD_NOIB) p[3] = gpioNotifyOpenInBand(sock, 0);
+         else                     p[3] = gpioNotifyOpenInBand(sock, p[1]);
 
-/* ----------------------------------------------------------------------- */
+        /* Enable the Nagle algorithm. */
+         opt = 0;
+         setsockopt(
+            sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
 
-void rawWaveSetIn(int pos, uint32_t value)
-{
-   int page, slot;
+         break;
 
-   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+      case PI_CMD_RINGO:
+         p[3] = ringOpen(sock);
+         break;
+
+      case PI_CMD_RINGC:
+         p[3] = ringClose(sock, p[1]);
+         break;
+
+      case PI_CMD_ENCO:
+         memcpy(&p[4], buf, 4);
+         p[3] = intEncoderOpen(p[1], p[2], p[4], sock);
+         break;
+
+      case PI_CMD_PROCP:
+         p[3] = myDoCommand(p, bufSize-1, buf+sizeof(int));
+         if (((int)p[3]) >= 0)
+         {
+            memcpy(buf, &p[3], 4);
+            p[3] = 4 + (4*PI_MAX_SCRIPT_PARAMS);
+         }
+         break;
+
+      default:
+         p[3] = myDoCommand(p, bufSize-1, buf);
+   }
+
+   if (sizeof(uintptr_t) == 8) // 64-bit system
    {
-      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
-      dmaOVirt[page]->OOL[slot] = value;
+      for (i = 0; i < 4; i++)
+         response[i] = (uint32_t)p[i];
+      if (write(sock, response, 16) == -1) { /* ignore errors */ }
+   }
+   else // 32-bit system
+   {
+      if (write(sock, p, 16) == -1) { /* ignore errors */ }
+   }
+
+   if (cmdReturnsExt(p[0]) && (((int)p[3]) > 0))
+   {
+      if (write(sock, buf, p[3]) == 1) { /* ignore errors */ }
    }
 }
 
 /* ----------------------------------------------------------------------- */
 
-rawWaveInfo_t rawWaveInfo(int wave_id)
+static void sockClose(sockConn_t *conn)
 {
-   rawWaveInfo_t dummy = {0, 0, 0, 0, 0, 0, 0, 0};
+   int sock = conn->sock;
 
-   if ((wave_id >=0) && (wave_id < PI_MAX_WAVES)) return waveInfo[wave_id];
-   else                                           return dummy;
-}
+   epoll_ctl(fdEpoll, EPOLL_CTL_DEL, sock, NULL);
 
-/* ----------------------------------------------------------------------- */
+   closeOrphanedNotifications(-1, sock);
 
-double time_time(void)
-{
-   struct timeval tv;
-   double t;
+   closeOrphanedRings(sock);
 
-   gettimeofday(&tv, 0);
+   closeOrphanedEncoders(sock);
 
-   t = (double)tv.tv_sec + ((double)tv.tv_usec / 1E6);
+   close(sock);
 
-   return t;
+   free(conn->ext);
+   free(conn);
+
+   DBG(DBG_USER, "Socket %d closed", sock);
 }
 
 /* ----------------------------------------------------------------------- */
 
-void time_sleep(double seconds)
+static void *pthSocketWorkerThread(void *x)
 {
-   struct timespec ts, rem;
+   int status;
+   sockConn_t *conn;
+   struct epoll_event ev;
+   char buf[CMD_MAX_EXTENSION];
 
-   if (seconds > 0.0)
+   /*
+      Each connection is registered EPOLLONESHOT so only one worker
+      is ever servicing a given socket.  The worker reads what the
+      socket has without blocking into the connection's receive
+      state, executes the command once it is complete, and then
+      re-arms the socket.  This preserves the command order per
+      connection while a client which stalls part way through a
+      command never holds a worker.
+   */
+
+   while (1)
    {
-      ts.tv_sec = seconds;
-      ts.tv_nsec = (seconds-(double)ts.tv_sec) * 1E9;
+      if (epoll_wait(fdEpoll, &ev, 1, -1) != 1) continue;
 
-      while (clock_nanosleep(CLOCK_REALTIME, 0, &ts, &rem))
+      conn = ev.data.ptr;
+
+      status = sockReadCommand(conn);
+
+      if (status >= 0)
       {
-         /* copy remaining time to ts */
-         ts.tv_sec  = rem.tv_sec;
-         ts.tv_nsec = rem.tv_nsec;
+         if (status) sockHandleCommand(conn, buf, sizeof(buf));
+
+         ev.events = EPOLLIN | EPOLLONESHOT;
+
+         if (epoll_ctl(fdEpoll, EPOLL_CTL_MOD, conn->sock, &ev) == 0) continue;
+
+         DBG(DBG_ALWAYS, "epoll_ctl failed (%m), sock=%d", conn->sock);
       }
+
+      sockClose(conn);
    }
-}
 
-/* ----------------------------------------------------------------------- */
+   return 0;
+}
 
-void rawDumpWave(void)
+static int addrAllowed(struct sockaddr *saddr)
 {
    int i;
+   uint32_t addr;
 
-   unsigned numWaves, t;
+   if (!numSockNetAddr) return 1;
 
-   rawWave_t *waves;
+   /* Unix domain clients are local so are treated as localhost */
+   if (saddr->sa_family == AF_UNIX) addr = htonl(INADDR_LOOPBACK);
 
-   numWaves = wfc[wfcur];
-   waves    = wf [wfcur];
+   // FIXME: add IPv6 whitelisting support
+   else if (saddr->sa_family != AF_INET) return 0;
 
-   t = 0;
+   else addr = ((struct sockaddr_in *) saddr)->sin_addr.s_addr;
 
-   for (i=0; i<numWaves; i++)
+   for (i=0; i<numSockNetAddr; i++)
    {
-      fprintf(stderr, "%10u %08X %08X %08X %10u\n",
-         t, waves[i].gpioOn, waves[i].gpioOff,
-         waves[i].flags, waves[i].usDelay);
-      t += waves[i].usDelay;
+      if (addr == sockNetAddr[i]) return 1;
    }
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-void rawDumpScript(unsigned script_id)
+static void * pthSocketThread(void *x)
 {
-   int i;
+   int fdL = *(int *)x;
+   int fdC=0, c, opt;
+   struct sockaddr_storage client;
+   struct epoll_event ev;
+   sockConn_t *conn;
 
-   if (script_id >= PI_MAX_SCRIPTS) return;
+   /* fdSock and fdUnixSock opened in gpioInitialise so that
+      we can treat failure to bind as fatal. */
 
-   if (gpioScript[script_id].state == PI_SCRIPT_IN_USE)
-   {
+   listen(fdL, 100);
 
-      for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
-      {
-         fprintf(stderr, "p%d=%d ", i, gpioScript[script_id].script.par[i]);
-      }
+   /* don't start until DMA started */
 
-      fprintf(stderr, "\n");
+   spinWhileStarting();
 
-      for (i=0; i<PI_MAX_SCRIPT_VARS; i++)
+   while (fdC >= 0)
+   {
+      c = sizeof(client);
+
+      fdC = accept(fdL, (struct sockaddr *)&client, (socklen_t*)&c);
+
+      if (fdC < 0)
       {
-         fprintf(stderr, "v%d=%d ", i, gpioScript[script_id].script.var[i]);
+         if ((errno == EINTR) || (errno == ECONNABORTED))
+         {
+            fdC = 0;
+            continue;
+         }
+         break;
       }
 
-      fprintf(stderr, "\n");
+      closeOrphanedNotifications(-1, fdC);
 
-      for (i=0; i<gpioScript[script_id].script.instrs; i++)
+      if (addrAllowed((struct sockaddr *)&client))
       {
-         fprintf(stderr,
-            "c%d=[%"PRIdPTR", %"PRIdPTR"(%d), %"PRIdPTR"(%d), %"PRIdPTR", %"PRIdPTR"]\n",
-            i,
-            gpioScript[script_id].script.instr[i].p[0],
-            gpioScript[script_id].script.instr[i].p[1],
-            gpioScript[script_id].script.instr[i].opt[1],
-            gpioScript[script_id].script.instr[i].p[2],
-            gpioScript[script_id].script.instr[i].opt[2],
-            gpioScript[script_id].script.instr[i].p[3],
-            gpioScript[script_id].script.instr[i].p[4]);
-      }
-   }
-}
+         DBG(DBG_USER, "Connection accepted on socket %d", fdC);
 
-/* ======================================================================= */
+         if (client.ss_family != AF_UNIX)
+         {
+            /* Enable tcp_keepalive */
+            opt = 1;
 
-int gpioInitialise(void)
-{
-   int status;
+            if (setsockopt(fdC, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt)) < 0)
+            {
+              DBG(DBG_ALWAYS, "setsockopt() fail, closing socket %d", fdC);
+              close(fdC);
+              continue;
+            }
 
-   if (libInitialised) return PIGPIO_VERSION;
+            DBG(DBG_USER, "SO_KEEPALIVE enabled on socket %d\n", fdC);
 
-   DBG(DBG_STARTUP, "not initialised, initialising");
+            /* Disable the Nagle algorithm. */
+            opt = 1;
+            setsockopt(fdC, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+         }
 
-   runState = PI_STARTING;
+         /* hand the connection to the socket workers */
 
-   status = initInitialise();
+         conn = calloc(1, sizeof(sockConn_t));
 
-   if (status < 0)
-   {
-      runState = PI_ENDING;
-      initReleaseResources();
-   }
-   else
-   {
-      libInitialised = 1;
+         if (conn == NULL)
+         {
+            DBG(DBG_ALWAYS, "calloc failed, closing socket %d", fdC);
+            close(fdC);
+            continue;
+         }
 
-      runState = PI_RUNNING;
+         conn->sock = fdC;
 
-      if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
+         ev.events = EPOLLIN | EPOLLONESHOT;
+         ev.data.ptr = conn;
+
+         if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdC, &ev) < 0)
+         {
+            DBG(DBG_ALWAYS, "epoll_ctl failed (%m), closing socket %d", fdC);
+            close(fdC);
+            free(conn);
+         }
+      }
+      else
       {
-         while (pthAlertRunning != PI_THREAD_RUNNING) myGpioDelay(1000);
+         DBG(DBG_ALWAYS, "Connection rejected, closing");
+         close(fdC);
       }
-
    }
 
-   return status;
-}
+   if (fdC < 0)
+      SOFT_ERROR((void*)PI_INIT_FAILED, "accept failed (%m)");
 
+   return 0;
+}
 
-/* ----------------------------------------------------------------------- */
+/* ======================================================================= */
 
-void gpioTerminate(void)
+static void initCheckLockFile(void)
 {
-   int i;
-
-   DBG(DBG_USER, "");
+   int fd;
+   int count;
+   int pid;
+   int err;
+   int delete;
+   char str[20];
 
-   if (!libInitialised) return;
+   fd = open(PI_LOCKFILE, O_RDONLY);
 
-   DBG(DBG_STARTUP, "initialised, terminating");
+   if (fd != -1)
+   {
+      DBG(DBG_STARTUP, "lock file exists");
+      delete = 1;
 
-   runState = PI_ENDING;
+      count = read(fd, str, sizeof(str)-1);
 
-   gpioMaskSet = 0;
+      if (count)
+      {
+         pid = atoi(str);
+         err = kill(pid, 0);
+         if (!err) delete = 0; /* process still exists */
+         DBG(DBG_STARTUP, "lock file pid=%d err=%d", pid, err);
+      }
 
-   /* reset DMA */
+      close(fd);
+      DBG(DBG_STARTUP, "lock file delete=%d", delete);
 
-   if (dmaReg != MAP_FAILED)
-   {
-      initKillDMA(dmaIn);
-      initKillDMA(dmaOut);
+      if (delete) unlink(PI_LOCKFILE);
    }
+}
 
-#ifndef EMBEDDED_IN_VM
-   if ((gpioCfg.internals & PI_CFG_STATS) &&
-       (!(gpioCfg.internals & PI_CFG_NOSIGHANDLER)))
-   {
-      fprintf(stderr,
-         "\n#####################################################\n");
-      fprintf(stderr, "pigpio version=%d internals=%X\n",
-         PIGPIO_VERSION, gpioCfg.internals);
-
-      fprintf(stderr,
-         "micros=%d allocMode=%d dmaInitCbs=%d DMARestarts=%d\n",
-         gpioCfg.clockMicros, gpioCfg.memAllocMode,
-         gpioStats.dmaInitCbsCount, gpioStats.DMARestarts);
+static int initGrabLockFile(void)
+{
+   int fd;
+   int lockResult;
+   char pidStr[20];
 
-      fprintf(stderr,
-         "samples %u maxSamples %u maxEmit %u emitFrags %u\n",
-         gpioStats.numSamples, gpioStats.maxSamples,
-         gpioStats.maxEmit, gpioStats.emitFrags);
+   initCheckLockFile();
 
-      fprintf(stderr, "cbTicks %d, cbCalls %u\n",
-         gpioStats.cbTicks, gpioStats.cbCalls);
+   /* try to grab the lock file */
 
-      fprintf(stderr, "pipe: good %u, short %u, would block %u\n",
-         gpioStats.goodPipeWrite, gpioStats.shortPipeWrite,
-         gpioStats.wouldBlockPipeWrite);
+   fd = open(PI_LOCKFILE, O_WRONLY|O_CREAT|O_EXCL|O_TRUNC, 0644);
 
-      fprintf(stderr, "alertTicks %u, lateTicks %u, moreToDo %u\n",
-         gpioStats.alertTicks, gpioStats.lateTicks, gpioStats.moreToDo);
+   if (fd != -1)
+   {
+      lockResult = flock(fd, LOCK_EX|LOCK_NB);
 
-      for (i=0; i< TICKSLOTS; i++)
-         fprintf(stderr, "%9u ", gpioStats.diffTick[i]);
+      if(lockResult == 0)
+      {
+         sprintf(pidStr, "%d\n", (int)getpid());
 
-      fprintf(stderr,
-         "\n#####################################################\n\n\n");
+         if (write(fd, pidStr, strlen(pidStr)) == -1)
+         {
+            /* ignore errors */
+         }
+      }
+      else
+      {
+         close(fd);
+         return -1;
+      }
    }
 
-#endif
-   initReleaseResources();
-
-   fflush(NULL);
-
-   libInitialised = 0;
+   return fd;
 }
 
-static void switchFunctionOff(unsigned gpio)
-{
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_SERVO:
-         /* switch servo off */
-         myGpioSetServo(gpio, gpioInfo[gpio].width, 0);
-         gpioInfo[gpio].width = 0;
-         break;
-
-      case GPIO_PWM:
-         /* switch pwm off */
-         myGpioSetPwm(gpio, gpioInfo[gpio].width, 0);
-         gpioInfo[gpio].width = 0;
-         break;
-
-      case GPIO_HW_CLK:
-         /* No longer disable clock hardware, doing that was a bug. */
-         gpioInfo[gpio].width = 0;
-         break;
+/* ----------------------------------------------------------------------- */
 
-      case GPIO_HW_PWM:
-         /* No longer disable PWM hardware, doing that was a bug. */
-         gpioInfo[gpio].width = 0;
-         break;
-   }
+static uint32_t * initMapMem(int fd, uint32_t addr, uint32_t len)
+{
+    return (uint32_t *) mmap(0, len,
+       PROT_READ|PROT_WRITE,
+       MAP_SHARED|MAP_LOCKED,
+       fd, addr);
 }
 
-static void stopHardwarePWM(void)
+/* ----------------------------------------------------------------------- */
+
+static int initCheckPermitted(void)
 {
-   unsigned i, pwm;
+   DBG(DBG_STARTUP, "");
 
-   for (i=0; i<= PI_MAX_GPIO; i++)
+   if (!pi_ispi)
    {
-      if (gpioInfo[i].is == GPIO_HW_PWM)
-      {
-         pwm = (PWMDef[i] >> 4) & 3;
-
-         if (pwm == 0) pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN1);
-         else          pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN2);
+      DBG(DBG_ALWAYS,
+         "\n" \
+         "+---------------------------------------------------------+\n" \
+         "|Sorry, this system does not appear to be a raspberry pi. |\n" \
+         "|aborting.                                                |\n" \
+         "+---------------------------------------------------------+\n\n");
+      return -1;
+   }
 
-         gpioInfo[i].width = 0;
-         gpioInfo[i].is = GPIO_UNDEFINED;
-      }
+   if ((fdMem = open("/dev/mem", O_RDWR | O_SYNC) ) < 0)
+   {
+      DBG(DBG_ALWAYS,
+         "\n" \
+         "+---------------------------------------------------------+\n" \
+         "|Sorry, you don't have permission to run this program.    |\n" \
+         "|Try running as root, e.g. precede the command with sudo. |\n" \
+         "+---------------------------------------------------------+\n\n");
+      return -1;
    }
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetMode(unsigned gpio, unsigned mode)
+static int initPeripherals(void)
 {
-   int reg, shift, old_mode;
-
-   DBG(DBG_USER, "gpio=%d mode=%d", gpio, mode);
+   DBG(DBG_STARTUP, "");
 
-   CHECK_INITED;
+   gpioReg = initMapMem(fdMem, GPIO_BASE, GPIO_LEN);
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   if (gpioReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap gpio failed (%m)");
 
-   if (mode > PI_ALT3)
-      SOFT_ERROR(PI_BAD_MODE, "gpio %d, bad mode (%d)", gpio, mode);
+   dmaReg = initMapMem(fdMem, DMA_BASE, DMA_LEN);
 
-   reg   =  gpio/10;
-   shift = (gpio%10) * 3;
+   if (dmaReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma failed (%m)");
 
-   old_mode = (gpioReg[reg] >> shift) & 7;
+   /* we should know if we are running on a BCM2711 by now */
 
-   if (mode != old_mode)
+   if (gpioCfg.DMAprimaryChannel == PI_DEFAULT_DMA_NOT_SET)
    {
-      switchFunctionOff(gpio);
-
-      gpioInfo[gpio].is = GPIO_UNDEFINED;
+      if (pi_is_2711)
+         gpioCfg.DMAprimaryChannel = PI_DEFAULT_DMA_PRIMARY_CH_2711;
+      else
+         gpioCfg.DMAprimaryChannel = PI_DEFAULT_DMA_PRIMARY_CHANNEL;
+   }
+      
+   if (gpioCfg.DMAsecondaryChannel == PI_DEFAULT_DMA_NOT_SET)
+   {
+      if (pi_is_2711)
+         gpioCfg.DMAsecondaryChannel = PI_DEFAULT_DMA_SECONDARY_CH_2711;
+      else
+         gpioCfg.DMAsecondaryChannel = PI_DEFAULT_DMA_SECONDARY_CHANNEL;
    }
+      
+   dmaIn =  dmaReg + (gpioCfg.DMAprimaryChannel   * 0x40);
+   dmaOut = dmaReg + (gpioCfg.DMAsecondaryChannel * 0x40);
 
-   gpioReg[reg] = (gpioReg[reg] & ~(7<<shift)) | (mode<<shift);
+   DBG(DBG_STARTUP, "DMA #%d @ %08"PRIXPTR,
+      gpioCfg.DMAprimaryChannel, (uintptr_t)dmaIn);
 
-   return 0;
-}
+   DBG(DBG_STARTUP, "debug reg is %08X", dmaIn[DMA_DEBUG]);
 
+   clkReg  = initMapMem(fdMem, CLK_BASE,  CLK_LEN);
 
-/* ----------------------------------------------------------------------- */
+   if (clkReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap clk failed (%m)");
 
-int gpioGetMode(unsigned gpio)
-{
-   int reg, shift;
+   systReg  = initMapMem(fdMem, SYST_BASE,  SYST_LEN);
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+   if (systReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap syst failed (%m)");
 
-   CHECK_INITED;
+   spiReg  = initMapMem(fdMem, SPI_BASE,  SPI_LEN);
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   if (spiReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap spi failed (%m)");
 
-   reg   =  gpio/10;
-   shift = (gpio%10) * 3;
+   pwmReg  = initMapMem(fdMem, PWM_BASE,  PWM_LEN);
 
-   return (gpioReg[reg] >> shift) & 7;
-}
+   if (pwmReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap pwm failed (%m)");
 
+   pcmReg  = initMapMem(fdMem, PCM_BASE,  PCM_LEN);
 
-/* ----------------------------------------------------------------------- */
+   if (pcmReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap pcm failed (%m)");
 
-int gpioSetPullUpDown(unsigned gpio, unsigned pud)
-{
-   int shift = (gpio & 0xf) << 1;
-   uint32_t bits;
-   uint32_t pull;
+   auxReg  = initMapMem(fdMem, AUX_BASE,  AUX_LEN);
 
-   DBG(DBG_USER, "gpio=%d pud=%d", gpio, pud);
+   if (auxReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap aux failed (%m)");
 
-   CHECK_INITED;
+   padsReg  = initMapMem(fdMem, PADS_BASE,  PADS_LEN);
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   if (padsReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap pads failed (%m)");
 
-   if (pud > PI_PUD_UP)
-      SOFT_ERROR(PI_BAD_PUD, "gpio %d, bad pud (%d)", gpio, pud);
+   bscsReg  = initMapMem(fdMem, BSCS_BASE,  BSCS_LEN);
 
-   if (pi_is_2711)
-   {
-      switch (pud)
-      {
-         case PI_PUD_OFF:  pull = 0; break;
-         case PI_PUD_UP:   pull = 1; break;
-         case PI_PUD_DOWN: pull = 2; break;
-      }
-
-      bits = *(gpioReg + GPPUPPDN0 + (gpio>>4));
-      bits &= ~(3 << shift);
-      bits |= (pull << shift);
-      *(gpioReg + GPPUPPDN0 + (gpio>>4)) = bits;
-   }
-   else
-   {
-      *(gpioReg + GPPUD) = pud;
-
-      myGpioDelay(1);
-
-      *(gpioReg + GPPUDCLK0 + BANK) = BIT;
-
-      myGpioDelay(1);
-
-      *(gpioReg + GPPUD) = 0;
-
-      *(gpioReg + GPPUDCLK0 + BANK) = 0;
-   }
+   if (bscsReg == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap bscs failed (%m)");
 
    return 0;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioRead(unsigned gpio)
+static int initZaps
+   (int  pmapFd, void *virtualBase, int  basePage, int  pages)
 {
-   DBG(DBG_USER, "gpio=%d", gpio);
+   int n;
+   uintptr_t index;
+   off_t offset;
+   ssize_t t;
+   uint32_t physical;
+   int status;
+   uintptr_t pageAdr;
+   unsigned long long pa;
 
-   CHECK_INITED;
+   DBG(DBG_STARTUP, "");
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   status = 0;
 
-   if ((*(gpioReg + GPLEV0 + BANK) & BIT) != 0) return PI_ON;
-   else                                         return PI_OFF;
-}
+   pageAdr = (uintptr_t) dmaVirt[basePage];
 
+   index  = ((uintptr_t)virtualBase / PAGE_SIZE) * 8;
 
-/* ----------------------------------------------------------------------- */
+   offset = lseek(pmapFd, index, SEEK_SET);
 
-int gpioWrite(unsigned gpio, unsigned level)
-{
-   DBG(DBG_USER, "gpio=%d level=%d", gpio, level);
+   if (offset != index)
+      SOFT_ERROR(PI_INIT_FAILED, "lseek pagemap failed (%m)");
 
-   CHECK_INITED;
+   for (n=0; n<pages; n++)
+   {
+      t = read(pmapFd, &pa, sizeof(pa));
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+      if (t != sizeof(pa))
+         SOFT_ERROR(PI_INIT_FAILED, "read pagemap failed (%m)");
 
-   if (level > PI_ON)
-      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
+      DBG(DBG_STARTUP, "pf%d=%016llX", n, pa);
 
-   if (gpio <= PI_MAX_GPIO)
-   {
-      if (gpioInfo[gpio].is != GPIO_WRITE)
-      {
-         /* stop a glitch between setting mode then level */
-         if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-         else                 *(gpioReg + GPSET0 + BANK) = BIT;
+      physical = 0x3FFFFFFF & (PAGE_SIZE * (pa & 0xFFFFFFFF));
 
-         switchFunctionOff(gpio);
+      if (physical)
+      {
+         //cast twice to suppress warning, I belive this is ok as these
+         //are bus addresses, not virtual addresses. --plugwash
+         dmaBus[basePage+n] = (dmaPage_t *)(uintptr_t) (physical | pi_dram_bus);
 
-         gpioInfo[gpio].is = GPIO_WRITE;
+         dmaVirt[basePage+n] = mmap
+         (
+            (void *)pageAdr,
+            PAGE_SIZE,
+            PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_FIXED|MAP_LOCKED|MAP_NORESERVE,
+            fdMem,
+            physical
+         );
       }
-   }
-
-   myGpioSetMode(gpio, PI_OUTPUT);
+      else status = 1;
 
-   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+      pageAdr += PAGE_SIZE;
+   }
 
-   return 0;
+   return status;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioPWM(unsigned gpio, unsigned val)
+static int initPagemapBlock(int block)
 {
-   DBG(DBG_USER, "gpio=%d dutycycle=%d", gpio, val);
-
-   CHECK_INITED;
-
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   if (val > gpioInfo[gpio].range)
-      SOFT_ERROR(PI_BAD_DUTYCYCLE, "gpio %d, bad dutycycle (%d)", gpio, val);
+   int trys, ok;
+   unsigned pageNum;
 
-   if (gpioInfo[gpio].is != GPIO_PWM)
-   {
-      switchFunctionOff(gpio);
+   DBG(DBG_STARTUP, "block=%d", block);
 
-      gpioInfo[gpio].is = GPIO_PWM;
+   dmaPMapBlk[block] = mmap(
+       0, (PAGES_PER_BLOCK*PAGE_SIZE),
+       PROT_READ|PROT_WRITE,
+       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
+       -1, 0);
 
-      if (!val) myGpioWrite(gpio, 0);
-   }
+   if (dmaPMapBlk[block] == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
 
-   myGpioSetMode(gpio, PI_OUTPUT);
+   /* force allocation of physical memory */
 
-   myGpioSetPwm(gpio, gpioInfo[gpio].width, val);
+   memset((void *)dmaPMapBlk[block], 0xAA, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-   gpioInfo[gpio].width=val;
+   memset((void *)dmaPMapBlk[block], 0xFF, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-   return 0;
-}
+   memset((void *)dmaPMapBlk[block], 0, (PAGES_PER_BLOCK*PAGE_SIZE));
 
-/* ----------------------------------------------------------------------- */
+   pageNum = block * PAGES_PER_BLOCK;
 
-int gpioGetPWMdutycycle(unsigned gpio)
-{
-   unsigned pwm;
+   dmaVirt[pageNum] = mmap(
+       0, (PAGES_PER_BLOCK*PAGE_SIZE),
+       PROT_READ|PROT_WRITE,
+       MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
+       -1, 0);
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+   if (dmaVirt[pageNum] == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma block %d failed (%m)", block);
 
-   CHECK_INITED;
+   munmap(dmaVirt[pageNum], PAGES_PER_BLOCK*PAGE_SIZE);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   trys = 0;
+   ok = 0;
 
-   switch (gpioInfo[gpio].is)
+   while ((trys < 10) && !ok)
    {
-      case GPIO_PWM:
-         return gpioInfo[gpio].width;
-
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_duty[pwm];
-
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE/2;
+      if (initZaps(fdPmap,
+                    dmaPMapBlk[block],
+                    pageNum,
+                    PAGES_PER_BLOCK) == 0) ok = 1;
+      else myGpioDelay(50000);
 
-      default:
-         SOFT_ERROR(PI_NOT_PWM_GPIO, "not a PWM gpio (%d)", gpio);
+      ++trys;
    }
-}
 
+   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "initZaps failed");
 
-/* ----------------------------------------------------------------------- */
+   return 0;
+}
 
-int gpioSetPWMrange(unsigned gpio, unsigned range)
+static int initMboxBlock(int block)
 {
-   int oldWidth, newWidth;
+   int n, ok;
+   unsigned page;
+   uintptr_t virtualAdr;
+   uintptr_t busAdr;
 
-   DBG(DBG_USER, "gpio=%d range=%d", gpio, range);
+   DBG(DBG_STARTUP, "block=%d", block);
 
-   CHECK_INITED;
+   ok = mbDMAAlloc
+      (&dmaMboxBlk[block], PAGES_PER_BLOCK * PAGE_SIZE, pi_mem_flag);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (!ok) SOFT_ERROR(PI_INIT_FAILED, "init mbox zaps failed");
 
-   if ((range < PI_MIN_DUTYCYCLE_RANGE)  || (range > PI_MAX_DUTYCYCLE_RANGE))
-      SOFT_ERROR(PI_BAD_DUTYRANGE, "gpio %d, bad range (%d)", gpio, range);
+   page = block * PAGES_PER_BLOCK;
 
-   oldWidth = gpioInfo[gpio].width;
+   virtualAdr = (uintptr_t) dmaMboxBlk[block].virtual_addr;
+   busAdr = dmaMboxBlk[block].bus_addr;
 
-   if (oldWidth)
+   for (n=0; n<PAGES_PER_BLOCK; n++)
    {
-      if (gpioInfo[gpio].is == GPIO_PWM)
-      {
-         newWidth = (range * oldWidth) / gpioInfo[gpio].range;
-
-         myGpioSetPwm(gpio, oldWidth, 0);
-         gpioInfo[gpio].range = range;
-         gpioInfo[gpio].width = newWidth;
-         myGpioSetPwm(gpio, 0, newWidth);
-      }
+      dmaVirt[page+n] = (dmaPage_t *) virtualAdr;
+      dmaBus[page+n] = (dmaPage_t *) busAdr;
+      virtualAdr += PAGE_SIZE;
+      busAdr += PAGE_SIZE;
    }
 
-   gpioInfo[gpio].range = range;
-
-   /* return the actual range for the current gpio frequency */
-
-   return pwmRealRange[gpioInfo[gpio].freqIdx];
+   return 0;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioGetPWMrange(unsigned gpio)
+static int initAllocDMAMem(void)
 {
-   DBG(DBG_USER, "gpio=%d", gpio);
+   int i, servoCycles, superCycles;
+   int status;
 
-   CHECK_INITED;
+   DBG(DBG_STARTUP, "");
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   /* Calculate the number of blocks needed for buffers.  The number
+      of blocks must be a multiple of the 20ms servo cycle.
+   */
 
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_HW_PWM:
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE;
+   servoCycles = gpioCfg.bufferMilliseconds / 20;
+   if           (gpioCfg.bufferMilliseconds % 20) servoCycles++;
 
-      default:
-         return gpioInfo[gpio].range;
-   }
-}
+   bufferCycles = (SUPERCYCLE * servoCycles) / gpioCfg.clockMicros;
 
+   superCycles = bufferCycles / SUPERCYCLE;
+   if           (bufferCycles % SUPERCYCLE) superCycles++;
 
-/* ----------------------------------------------------------------------- */
+   bufferCycles = SUPERCYCLE * superCycles;
 
-int gpioGetPWMrealRange(unsigned gpio)
-{
-   unsigned pwm;
+   bufferBlocks = bufferCycles / CYCLES_PER_BLOCK;
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+   DBG(DBG_STARTUP, "bmillis=%d mics=%d bblk=%d bcyc=%d",
+      gpioCfg.bufferMilliseconds, gpioCfg.clockMicros,
+      bufferBlocks, bufferCycles);
 
-   CHECK_INITED;
+   /* allocate memory for pointers to virtual and bus memory pages */
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   dmaVirt = mmap(
+       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
+       PROT_READ|PROT_WRITE,
+       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+       -1, 0);
 
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_real_range[pwm];
+   if (dmaVirt == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma virtual failed (%m)");
 
-      case GPIO_HW_CLK:
-         return PI_HW_PWM_RANGE;
+   dmaBus = mmap(
+       0, PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
+       PROT_READ|PROT_WRITE,
+       MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+       -1, 0);
 
-      default:
-         return pwmRealRange[gpioInfo[gpio].freqIdx];
-   }
-}
+   if (dmaBus == MAP_FAILED)
+      SOFT_ERROR(PI_INIT_FAILED, "mmap dma bus failed (%m)");
 
+   dmaIVirt = (dmaIPage_t **) dmaVirt;
+   dmaIBus  = (dmaIPage_t **) dmaBus;
 
-/* ----------------------------------------------------------------------- */
+   dmaOVirt = (dmaOPage_t **)(dmaVirt + (PAGES_PER_BLOCK*bufferBlocks));
+   dmaOBus  = (dmaOPage_t **)(dmaBus  + (PAGES_PER_BLOCK*bufferBlocks));
 
-int gpioSetPWMfrequency(unsigned gpio, unsigned frequency)
-{
-   int i, width;
-   unsigned diff, best, idx;
+   if ((gpioCfg.memAllocMode == PI_MEM_ALLOC_PAGEMAP) ||
+       ((gpioCfg.memAllocMode == PI_MEM_ALLOC_AUTO) &&
+        (gpioCfg.bufferMilliseconds > PI_DEFAULT_BUFFER_MILLIS)))
+   {
+      /* pagemap allocation of DMA memory */
 
-   DBG(DBG_USER, "gpio=%d frequency=%d", gpio, frequency);
+      dmaPMapBlk = mmap(
+          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *),
+          PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+          -1, 0);
 
-   CHECK_INITED;
+      if (dmaPMapBlk == MAP_FAILED)
+         SOFT_ERROR(PI_INIT_FAILED, "pagemap mmap block failed (%m)");
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+      fdPmap = open("/proc/self/pagemap", O_RDONLY);
 
-   if      (frequency > pwmFreq[0])           idx = 0;
-   else if (frequency < pwmFreq[PWM_FREQS-1]) idx = PWM_FREQS-1;
-   else
-   {
-      best = 100000; /* impossibly high frequency difference */
-      idx = 0;
+      if (fdPmap < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "pagemap open failed(%m)");
 
-      for (i=0; i<PWM_FREQS; i++)
+      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
       {
-         if (frequency > pwmFreq[i]) diff = frequency - pwmFreq[i];
-         else                        diff = pwmFreq[i] - frequency;
-
-         if (diff < best)
+         status = initPagemapBlock(i);
+         if (status < 0)
          {
-            best = diff;
-            idx = i;
+            close(fdPmap);
+            return status;
          }
       }
-   }
 
-   width = gpioInfo[gpio].width;
+      close(fdPmap);
 
-   if (width)
-   {
-      if (gpioInfo[gpio].is == GPIO_PWM)
-      {
-         myGpioSetPwm(gpio, width, 0);
-         gpioInfo[gpio].freqIdx = idx;
-         myGpioSetPwm(gpio, 0, width);
-      }
+      DBG(DBG_STARTUP, "dmaPMapBlk=%08"PRIXPTR" dmaIn=%08"PRIXPTR,
+         (uintptr_t)dmaPMapBlk, (uintptr_t)dmaIn);
    }
+   else
+   {
+      /* mailbox allocation of DMA memory */
 
-   gpioInfo[gpio].freqIdx = idx;
-
-   return pwmFreq[idx];
-}
+      dmaMboxBlk = mmap(
+          0, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t),
+          PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_LOCKED,
+          -1, 0);
 
+      if (dmaMboxBlk == MAP_FAILED)
+         SOFT_ERROR(PI_INIT_FAILED, "mmap mbox block failed (%m)");
 
-/* ----------------------------------------------------------------------- */
+      fdMbox = mbOpen();
 
-int gpioGetPWMfrequency(unsigned gpio)
-{
-   unsigned pwm, clock;
+      if (fdMbox < 0)
+         SOFT_ERROR(PI_INIT_FAILED, "mbox open failed(%m)");
 
-   DBG(DBG_USER, "gpio=%d", gpio);
+      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      {
+         status = initMboxBlock(i);
+         if (status < 0)
+         {
+            mbClose(fdMbox);
+            return status;
+         }
+      }
 
-   CHECK_INITED;
+      mbClose(fdMbox);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+      DBG(DBG_STARTUP, "dmaMboxBlk=%08"PRIXPTR" dmaIn=%08"PRIXPTR,
+         (uintptr_t)dmaMboxBlk, (uintptr_t)dmaIn);
+   }
 
-   switch (gpioInfo[gpio].is)
-   {
-      case GPIO_HW_PWM:
-         pwm = (PWMDef[gpio] >> 4) & 3;
-         return hw_pwm_freq[pwm];
+   DBG(DBG_STARTUP,
+      "gpioReg=%08"PRIXPTR" pwmReg=%08"PRIXPTR" pcmReg=%08"PRIXPTR" clkReg=%08"PRIXPTR" auxReg=%08"PRIXPTR,
+      (uintptr_t)gpioReg, (uintptr_t)pwmReg,
+      (uintptr_t)pcmReg,  (uintptr_t)clkReg, (uintptr_t)auxReg);
 
-      case GPIO_HW_CLK:
-         clock = (clkDef[gpio] >> 4) & 3;
-         return hw_clk_freq[clock];
+   for (i=0; i<DMAI_PAGES; i++)
+      DBG(DBG_STARTUP, "dmaIBus[%d]=%08"PRIXPTR, i, (uintptr_t)dmaIBus[i]);
 
-      default:
-         return pwmFreq[gpioInfo[gpio].freqIdx];
+   if (gpioCfg.dbgLevel >= DBG_DMACBS)
+   {
+      fprintf(stderr, "*** INPUT DMA CONTROL BLOCKS ***\n");
+      for (i=0; i<NUM_CBS; i++) dmaCbPrint(i);
    }
-}
 
+   return 0;
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioServo(unsigned gpio, unsigned val)
+static void initPWM(unsigned bits)
 {
-   DBG(DBG_USER, "gpio=%d pulsewidth=%d", gpio, val);
-
-   CHECK_INITED;
+   DBG(DBG_STARTUP, "bits=%d", bits);
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   /* reset PWM */
 
-   if ((val!=PI_SERVO_OFF) && (val<PI_MIN_SERVO_PULSEWIDTH))
-      SOFT_ERROR(PI_BAD_PULSEWIDTH,
-         "gpio %d, bad pulsewidth (%d)", gpio, val);
+   pwmReg[PWM_CTL] = 0;
 
-   if (val>PI_MAX_SERVO_PULSEWIDTH)
-      SOFT_ERROR(PI_BAD_PULSEWIDTH,
-         "gpio %d, bad pulsewidth (%d)", gpio, val);
+   myGpioDelay(10);
 
-   if (gpioInfo[gpio].is != GPIO_SERVO)
-   {
-      switchFunctionOff(gpio);
+   pwmReg[PWM_STA] = -1;
 
-      gpioInfo[gpio].is = GPIO_SERVO;
+   myGpioDelay(10);
 
-      if (!val) myGpioWrite(gpio, 0);
-   }
+   /* set number of bits to transmit */
 
-   myGpioSetMode(gpio, PI_OUTPUT);
+   pwmReg[PWM_RNG1] = bits;
 
-   myGpioSetServo(gpio, gpioInfo[gpio].width, val);
+   myGpioDelay(10);
 
-   gpioInfo[gpio].width=val;
+   dmaIVirt[0]->periphData = 1;
 
-   return 0;
-}
+   /* enable PWM DMA, raise panic and dreq thresholds to 15 */
 
+   pwmReg[PWM_DMAC] = PWM_DMAC_ENAB      |
+                      PWM_DMAC_PANIC(15) |
+                      PWM_DMAC_DREQ(15);
 
-/* ----------------------------------------------------------------------- */
+   myGpioDelay(10);
 
-int gpioGetServoPulsewidth(unsigned gpio)
-{
-   DBG(DBG_USER, "gpio=%d", gpio);
+   /* clear PWM fifo */
 
-   CHECK_INITED;
+   pwmReg[PWM_CTL] = PWM_CTL_CLRF1;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   myGpioDelay(10);
 
-   if (gpioInfo[gpio].is != GPIO_SERVO)
-      SOFT_ERROR(PI_NOT_SERVO_GPIO, "not a servo gpio (%d)", gpio);
+   /* enable PWM channel 1 and use fifo */
 
-   return gpioInfo[gpio].width;
+   pwmReg[PWM_CTL] = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveClear(void)
+static void initPCM(unsigned bits)
 {
-   DBG(DBG_USER, "");
+   DBG(DBG_STARTUP, "bits=%d", bits);
 
-   CHECK_INITED;
+   /* disable PCM so we can modify the regs */
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   pcmReg[PCM_CS] = 0;
 
-   wfcur = 0;
+   myGpioDelay(1000);
 
-   wfStats.micros = 0;
-   wfStats.pulses = 0;
-   wfStats.cbs    = 0;
+   pcmReg[PCM_FIFO]   = 0;
+   pcmReg[PCM_MODE]   = 0;
+   pcmReg[PCM_RXC]    = 0;
+   pcmReg[PCM_TXC]    = 0;
+   pcmReg[PCM_DREQ]   = 0;
+   pcmReg[PCM_INTEN]  = 0;
+   pcmReg[PCM_INTSTC] = 0;
+   pcmReg[PCM_GRAY]   = 0;
 
-   waveOutBotCB  = PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE;
-   waveOutBotOOL = PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE;
-   waveOutTopOOL = NUM_WAVE_OOL;
+   myGpioDelay(1000);
 
-   waveOutCount = 0;
+   pcmReg[PCM_MODE] = PCM_MODE_FLEN(bits-1); /* # bits in frame */
 
-   waveEndPtr = NULL;
+   /* enable channel 1 with # bits width */
 
-   return 0;
-}
+   pcmReg[PCM_TXC] = PCM_TXC_CH1EN | PCM_TXC_CH1WID(bits-8);
 
-/* ----------------------------------------------------------------------- */
+   pcmReg[PCM_CS] |= PCM_CS_STBY; /* clear standby */
 
-int gpioWaveAddNew(void)
-{
-   DBG(DBG_USER, "");
+   myGpioDelay(1000);
 
-   CHECK_INITED;
+   pcmReg[PCM_CS] |= PCM_CS_TXCLR; /* clear TX FIFO */
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   pcmReg[PCM_CS] |= PCM_CS_DMAEN; /* enable DREQ */
 
-   wfcur = 0;
+   pcmReg[PCM_DREQ] = PCM_DREQ_TX_PANIC(16) | PCM_DREQ_TX_REQ_L(30);
 
-   wfStats.micros = 0;
-   wfStats.pulses = 0;
-   wfStats.cbs    = 0;
+   pcmReg[PCM_INTSTC] = 0b1111; /* clear status bits */
 
-   return 0;
-}
+   /* enable PCM */
 
-/* ----------------------------------------------------------------------- */
+   pcmReg[PCM_CS] |= PCM_CS_EN;
 
-int gpioWaveAddGeneric(unsigned numPulses, gpioPulse_t *pulses)
-{
-   int p;
-
-   DBG(DBG_USER, "numPulses=%u pulses=%08"PRIXPTR, numPulses, (uintptr_t)pulses);
-
-   CHECK_INITED;
-
-   if (numPulses > PI_WAVE_MAX_PULSES)
-      SOFT_ERROR(PI_TOO_MANY_PULSES, "bad number of pulses (%d)", numPulses);
-
-   if (!pulses) SOFT_ERROR(PI_BAD_POINTER, "bad (NULL) pulses pointer");
+   /* enable tx */
 
-   for (p=0; p<numPulses; p++)
-   {
-      wf[2][p].gpioOff = pulses[p].gpioOff;
-      wf[2][p].gpioOn  = pulses[p].gpioOn;
-      wf[2][p].usDelay = pulses[p].usDelay;
-      wf[2][p].flags   = 0;
-   }
+   pcmReg[PCM_CS] |= PCM_CS_TXON;
 
-   return rawWaveAddGeneric(numPulses, wf[2]);
+   dmaIVirt[0]->periphData = 0x0F;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveAddSerial
-   (unsigned gpio,
-    unsigned baud,
-    unsigned data_bits,
-    unsigned stop_bits,
-    unsigned offset,
-    unsigned numBytes,
-    char     *bstr)
+static void initHWClk
+   (int clkCtl, int clkDiv, int clkSrc, int divI, int divF, int MASH)
 {
-   int i, b, p, lev, c, v;
-
-   uint16_t *wstr = (uint16_t *)bstr;
-   uint32_t *lstr = (uint32_t *)bstr;
-
-   unsigned bitDelay[32];
-
-   DBG(DBG_USER,
-      "gpio=%d baud=%d bits=%d stops=%d offset=%d numBytes=%d str=[%s]",
-      gpio, baud, data_bits, stop_bits, offset,
-      numBytes, myBuf2Str(numBytes, (char *)bstr));
-
-   CHECK_INITED;
-
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   if ((baud < PI_WAVE_MIN_BAUD) || (baud > PI_WAVE_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_WAVE_BAUD, "bad baud rate (%d)", baud);
+   DBG(DBG_INTERNAL, "ctl=%d div=%d src=%d /I=%d /f=%d M=%d",
+      clkCtl, clkDiv, clkSrc, divI, divF, MASH);
 
-   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
-       (data_bits > PI_MAX_WAVE_DATABITS))
-      SOFT_ERROR(PI_BAD_DATABITS, "bad number of databits (%d)", data_bits);
+   /* kill the clock if busy, anything else isn't reliable */
 
-   if ((stop_bits < PI_MIN_WAVE_HALFSTOPBITS) ||
-       (stop_bits > PI_MAX_WAVE_HALFSTOPBITS))
-      SOFT_ERROR(PI_BAD_STOPBITS,
-         "bad number of (half) stop bits (%d)", stop_bits);
+   if (clkReg[clkCtl] & CLK_CTL_BUSY)
+   {
+      do
+      {
+         clkReg[clkCtl] = BCM_PASSWD | CLK_CTL_KILL;
+      }
+      while (clkReg[clkCtl] & CLK_CTL_BUSY);
+   }
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   clkReg[clkDiv] = (BCM_PASSWD | CLK_DIV_DIVI(divI) | CLK_DIV_DIVF(divF));
 
-   if (numBytes > PI_WAVE_MAX_CHARS)
-      SOFT_ERROR(PI_TOO_MANY_CHARS, "too many chars (%d)", numBytes);
+   usleep(10);
 
-   if (offset > PI_WAVE_MAX_MICROS)
-      SOFT_ERROR(PI_BAD_SER_OFFSET, "offset too large (%d)", offset);
+   clkReg[clkCtl] = (BCM_PASSWD | CLK_CTL_MASH(MASH) | CLK_CTL_SRC(clkSrc));
 
-   if (data_bits > 8) numBytes /= 2;
-   if (data_bits > 16) numBytes /= 2;
+   usleep(10);
 
-   if (!numBytes) return 0;
+   clkReg[clkCtl] |= (BCM_PASSWD | CLK_CTL_ENAB);
+}
 
-   waveBitDelay(baud, data_bits, stop_bits, bitDelay);
+static void initClock(int mainClock)
+{
+   const unsigned BITS=10;
+   int clockPWM;
+   unsigned clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash, clkBits;
+   char *per;
+   unsigned micros;
 
-   p = 0;
+   DBG(DBG_STARTUP, "mainClock=%d", mainClock);
 
-   wf[2][p].gpioOn  = (1<<gpio);
-   wf[2][p].gpioOff = 0;
-   wf[2][p].flags   = 0;
+   if (mainClock) micros = gpioCfg.clockMicros;
+   else           micros = PI_WF_MICROS;
 
-   if (offset > bitDelay[0]) wf[2][p].usDelay = offset;
-   else                      wf[2][p].usDelay = bitDelay[0];
+   clockPWM = mainClock ^ (gpioCfg.clockPeriph == PI_CLOCK_PCM);
 
-   for (i=0; i<numBytes; i++)
+   if (clockPWM)
    {
-      p++;
+      clkCtl = CLK_PWMCTL;
+      clkDiv = CLK_PWMDIV;
+      per = "PWM";
+   }
+   else
+   {
+      clkCtl = CLK_PCMCTL;
+      clkDiv = CLK_PCMDIV;
+      per = "PCM";
+   }
 
-      /* start bit */
+   clkSrc  = CLK_CTL_SRC_PLLD;
+   clkDivI = clk_plld_freq / (10000000 / micros); /* 10 MHz - 1 MHz */ 
+   clkBits = BITS;        /* 10/BITS MHz - 1/BITS MHz */
+   clkDivF = 0;
+   clkMash = 0;
 
-      wf[2][p].gpioOn = 0;
-      wf[2][p].gpioOff = (1<<gpio);
-      wf[2][p].usDelay = bitDelay[0];
-      wf[2][p].flags   = 0;
+   DBG(DBG_STARTUP, "%s PLLD divi=%d divf=%d mash=%d bits=%d",
+      per, clkDivI, clkDivF, clkMash, clkBits);
 
-      lev = 0;
+   initHWClk(clkCtl, clkDiv, clkSrc, clkDivI, clkDivF, clkMash);
 
-      if      (data_bits <  9) c = bstr[i];
-      else if (data_bits < 17) c = wstr[i];
-      else                  c = lstr[i];
+   if (clockPWM) initPWM(BITS);
+   else          initPCM(BITS);
 
-      for (b=0; b<data_bits; b++)
-      {
-         if (c & (1<<b)) v=1; else v=0;
+   myGpioDelay(2000);
+}
 
-         if (v == lev) wf[2][p].usDelay += bitDelay[b+1];
-         else
-         {
-            p++;
+static void initKillDMA(volatile uint32_t *dmaAddr)
+{
+   dmaAddr[DMA_CS] = DMA_CHANNEL_ABORT;
+   dmaAddr[DMA_CS] = 0;
+   dmaAddr[DMA_CS] = DMA_CHANNEL_RESET;
 
-            lev = v;
+   dmaAddr[DMA_CONBLK_AD] = 0;
+}
 
-            if (lev)
-            {
-               wf[2][p].gpioOn  = (1<<gpio);
-               wf[2][p].gpioOff = 0;
-               wf[2][p].flags   = 0;
-            }
-            else
-            {
-               wf[2][p].gpioOn  = 0;
-               wf[2][p].gpioOff = (1<<gpio);
-               wf[2][p].flags   = 0;
-            }
+/* ----------------------------------------------------------------------- */
 
-            wf[2][p].usDelay = bitDelay[b+1];
-         }
-      }
+static void initDMAgo(volatile uint32_t  *dmaAddr, uint32_t cbAddr)
+{
+   DBG(DBG_STARTUP, "");
 
-      /* stop bit */
+   initKillDMA(dmaAddr);
 
-      if (lev) wf[2][p].usDelay += bitDelay[data_bits+1];
-      else
-      {
-         p++;
+   dmaAddr[DMA_CS] = DMA_INTERRUPT_STATUS | DMA_END_FLAG;
 
-         wf[2][p].gpioOn  = (1<<gpio);
-         wf[2][p].gpioOff = 0;
-         wf[2][p].usDelay = bitDelay[data_bits+1];
-         wf[2][p].flags   = 0;
-      }
-   }
+   dmaAddr[DMA_CONBLK_AD] = cbAddr;
 
-   p++;
+   /* clear READ/FIFO/READ_LAST_NOT_SET error bits */
 
-   wf[2][p].gpioOn  = (1<<gpio);
-   wf[2][p].gpioOff = 0;
-   wf[2][p].usDelay = bitDelay[0];
-   wf[2][p].flags   = 0;
+   dmaAddr[DMA_DEBUG] = DMA_DEBUG_READ_ERR            |
+                        DMA_DEBUG_FIFO_ERR            |
+                        DMA_DEBUG_RD_LST_NOT_SET_ERR;
 
-   return rawWaveAddGeneric(p, wf[2]);
+
+   dmaAddr[DMA_CS] = DMA_WAIT_ON_WRITES    |
+                     DMA_PANIC_PRIORITY(8) |
+                     DMA_PRIORITY(8)       |
+                     DMA_ACTIVE;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int rawWaveAddSPI(
-   rawSPI_t *spi,
-   unsigned offset,
-   unsigned spiSS,
-   char *buf,
-   unsigned spiTxBits,
-   unsigned spiBitFirst,
-   unsigned spiBitLast,
-   unsigned spiBits)
+static void initClearGlobals(void)
 {
-   int p, bit, dbv, halfbit;
-   int rising_edge[2], read_cycle[2];
-   uint32_t on_bits, off_bits;
-   int tx_bit_pos;
+   int i;
 
-   DBG(DBG_USER,
-      "spi=%08"PRIXPTR" off=%d spiSS=%d tx=%08"PRIXPTR", num=%d fb=%d lb=%d spiBits=%d",
-      (uintptr_t)spi, offset, spiSS, (uintptr_t)buf, spiTxBits,
-      spiBitFirst, spiBitLast, spiBits);
+   DBG(DBG_STARTUP, "");
 
-   CHECK_INITED;
+   alertBits   = 0;
+   monitorBits = 0;
+   notifyBits  = 0;
+   scriptBits  = 0;
+   gFilterBits = 0;
+   nFilterBits = 0;
+   wdogBits    = 0;
+   wdogRescan  = 0;
+   wdogLevel   = 0;
+   meterBits   = 0;
+   encoderBits = 0;
+   sniffBits = 0;
+   serialBits  = 0;
+   captureBits = 0;
 
-   if (spiSS > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", spiSS);
+   pthAlertRunning  = PI_THREAD_NONE;
+   pthFifoRunning   = PI_THREAD_NONE;
+   pthSocketRunning = PI_THREAD_NONE;
+   pthUnixSocketRunning = PI_THREAD_NONE;
+   pthNotifyWriterRunning = PI_THREAD_NONE;
+   pthSocketWorkersRunning = 0;
+   pthCallbackWorkersRunning = 0;
 
-   /*
-   CPOL CPHA
-    0    0   read rising/write falling
-    0    1   read falling/write rising
-    1    0   read falling/write rising
-    1    1   read rising/write falling
-   */
+   waveBuildReset();
 
-   if (spi->clk_pol) {rising_edge[0] = 0; rising_edge[1] = 1;}
-   else              {rising_edge[0] = 1; rising_edge[1] = 0;}
+   waveSpaceReset();
 
-   if (spi->clk_pha) {read_cycle[0] = 0; read_cycle[1] = 1;}
-   else              {read_cycle[0] = 1; read_cycle[1] = 0;}
+   waveCacheHits = 0;
+   waveCacheMisses = 0;
 
-   p = 0;
+   wfStats.micros     = 0;
+   wfStats.highMicros = 0;
+   wfStats.maxMicros  = PI_WAVE_MAX_MICROS;
 
-   if (offset)
-   {
-      wf[2][p].gpioOn  = 0;
-      wf[2][p].gpioOff = 0;
-      wf[2][p].flags   = 0;
-      wf[2][p].usDelay = offset;
-      p++;
-   }
+   wfStats.pulses     = 0;
+   wfStats.highPulses = 0;
+   wfStats.maxPulses  = PI_WAVE_MAX_PULSES;
 
-   on_bits = 0;
-   off_bits = 0;
-
-   tx_bit_pos = 0;
+   wfStats.cbs        = 0;
+   wfStats.highCbs    = 0;
+   wfStats.maxCbs     = (PI_WAVE_BLOCKS * PAGES_PER_BLOCK * CBS_PER_OPAGE);
 
-   /* preset initial mosi bit */
+   gpioGetSamples.func     = NULL;
+   gpioGetSamples.ex       = 0;
+   gpioGetSamples.userdata = NULL;
+   gpioGetSamples.bits     = 0;
 
-   if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
+   for (i=0; i<=PI_MAX_USER_GPIO; i++)
    {
-      on_bits  |= (1<<(spi->mosi));
-      dbv = 1;
+      wfRx[i].mode      = PI_WFRX_NONE;
+      pthread_mutex_init(&wfRx[i].mutex, NULL);
+      gpioAlert[i].func = NULL;
    }
-   else
+
+   for (i=0; i<=PI_MAX_GPIO; i++)
    {
-      off_bits |= (1<<(spi->mosi));
-      dbv = 0;
+      gpioInfo [i].is      = GPIO_UNDEFINED;
+      gpioInfo [i].width   = 0;
+      gpioInfo [i].range   = PI_DEFAULT_DUTYCYCLE_RANGE;
+      gpioInfo [i].freqIdx = DEFAULT_PWM_IDX;
    }
 
-   if (!spi->clk_pha) tx_bit_pos ++;
-
-   if (spi->ss_pol) off_bits |= (1<<spiSS);
-   else             on_bits  |= (1<<spiSS);
-
-   if (spi->clk_pol) on_bits  |= (1<<(spi->clk));
-   else              off_bits |= (1<<(spi->clk));
-
-   wf[2][p].gpioOn  = on_bits;
-   wf[2][p].gpioOff = off_bits;
-   wf[2][p].flags   = 0;
-
-   if (spi->clk_us > spi->ss_us) wf[2][p].usDelay = spi->clk_us;
-   else                          wf[2][p].usDelay = spi->ss_us;
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      gpioNotify[i].seqno = 0;
+      gpioNotify[i].state = PI_NOTIFY_CLOSED;
+   }
 
-   p++;
+   for (i=0; i<MAX_RINGS; i++) gpioRing[i].state = PI_RING_CLOSED;
 
-   for (bit=1; bit<=spiBits; bit++)
+   for (i=0; i<=PI_MAX_SIGNUM; i++)
    {
-      for (halfbit=0; halfbit<2; halfbit++)
-      {
-         wf[2][p].usDelay = spi->clk_us;
-         wf[2][p].flags = 0;
-
-         on_bits = 0;
-         off_bits = 0;
+      gpioSignal[i].func     = NULL;
+      gpioSignal[i].ex       = 0;
+      gpioSignal[i].userdata = NULL;
+   }
 
-         if (read_cycle[halfbit])
-         {
-            if ((bit>=spiBitFirst) && (bit<=spiBitLast))
-               wf[2][p].flags = WAVE_FLAG_READ;
-         }
-         else
-         {
-            if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
-            {
-               if (!dbv) on_bits  |= (1<<(spi->mosi));
-               dbv = 1;
-            }
-            else
-            {
-               if (dbv) off_bits |= (1<<(spi->mosi));
-               dbv = 0;
-            }
+   for (i=0; i<=PI_MAX_TIMER; i++)
+   {
+      gpioTimer[i].busy    = 0;
+      gpioTimer[i].running = 0;
+      gpioTimer[i].func    = NULL;
+   }
 
-            ++tx_bit_pos;
-         }
+   for (i=0; i<=PI_MAX_EVENT; i++)
+   {
+      eventAlert[i].func      = NULL;
+      eventAlert[i].ignore    = 0;
+      eventAlert[i].fired     = 0;
+   }
 
-         if (rising_edge[halfbit]) on_bits  |= (1<<(spi->clk));
-         else                      off_bits |= (1<<(spi->clk));
+   /* calculate the usable PWM frequencies */
 
-         wf[2][p].gpioOn = on_bits;
-         wf[2][p].gpioOff = off_bits;
+   for (i=0; i<PWM_FREQS; i++)
+   {
+      pwmFreq[i]=
+         (1000000.0/
+            ((float)PULSE_PER_CYCLE*gpioCfg.clockMicros*pwmCycles[i]))+0.5;
 
-         p++;
-      }
+      DBG(DBG_STARTUP, "f%d is %d", i, pwmFreq[i]);
    }
 
-   on_bits = 0;
-   off_bits = 0;
-
-   if (spi->ss_pol) on_bits  |= (1<<spiSS);
-   else             off_bits |= (1<<spiSS);
+   inpFifo = NULL;
+   outFifo = NULL;
 
-   wf[2][p].gpioOn  = on_bits;
-   wf[2][p].gpioOff = off_bits;
-   wf[2][p].flags   = 0;
-   wf[2][p].usDelay = 0;
+   fdLock       = -1;
+   fdMem        = -1;
+   fdSock       = -1;
+   fdUnixSock   = -1;
+   fdEpoll      = -1;
+   fdNotifyWake = -1;
 
-   p++;
+   dmaMboxBlk = MAP_FAILED;
+   dmaPMapBlk = MAP_FAILED;
+   dmaVirt = MAP_FAILED;
+   dmaBus  = MAP_FAILED;
 
-   return rawWaveAddGeneric(p, wf[2]);
+   auxReg  = MAP_FAILED;
+   clkReg  = MAP_FAILED;
+   dmaReg  = MAP_FAILED;
+   gpioReg = MAP_FAILED;
+   pcmReg  = MAP_FAILED;
+   pwmReg  = MAP_FAILED;
+   systReg = MAP_FAILED;
+   spiReg  = MAP_FAILED;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioWaveCreate(void)
+static void initReleaseResources(void)
 {
-   int i, wid;
-   int numCB, numBOOL, numTOOL;
-   int CB, BOOL, TOOL;
-
-   DBG(DBG_USER, "");
+   int i;
 
-   CHECK_INITED;
+   DBG(DBG_STARTUP, "");
 
-   if (wfc[wfcur] == 0) return PI_EMPTY_WAVEFORM;
+   /* shut down running threads */
 
-   /* What resources are needed? */
+   for (i=0; i<=PI_MAX_GPIO; i++)
+   {
+      if (gpioISR[i].pth)
+      {
+         /* destroy thread, unexport GPIO */
 
-      waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
+         gpioSetISRFunc(i, 0, 0, NULL);
+      }
+   }
 
-   wid = -1;
+   timerTerminate();
 
-   /* Is there an exact fit with a deleted wave. */
+   if (pthAlertRunning != PI_THREAD_NONE)
+   {
+      pthread_cancel(pthAlert);
+      pthread_join(pthAlert, NULL);
+      pthAlertRunning = PI_THREAD_NONE;
+   }
 
-   for (i=0; i<waveOutCount; i++)
+   if (pthFifoRunning != PI_THREAD_NONE)
    {
-      if (waveInfo[i].deleted             &&
-         (waveInfo[i].numCB   == numCB)   &&
-         (waveInfo[i].numBOOL == numBOOL) &&
-         (waveInfo[i].numTOOL == numTOOL))
-      {
-         /* Reuse the deleted waves resources. */
-         wid = i;
-         break;
-      }
+      pthread_cancel(pthFifo);
+      pthread_join(pthFifo, NULL);
+      pthFifoRunning = PI_THREAD_NONE;
    }
 
-   if (wid == -1)
+   if (pthSocketRunning != PI_THREAD_NONE)
    {
-      /* Are there enough spare resources? */
+      pthread_cancel(pthSocket);
+      pthread_join(pthSocket, NULL);
+      pthSocketRunning = PI_THREAD_NONE;
+   }
 
-      if ((numCB+waveOutBotCB) > NUM_WAVE_CBS)
-         return PI_TOO_MANY_CBS;
+   if (pthUnixSocketRunning != PI_THREAD_NONE)
+   {
+      pthread_cancel(pthUnixSocket);
+      pthread_join(pthUnixSocket, NULL);
+      pthUnixSocketRunning = PI_THREAD_NONE;
+   }
 
-      if ((numBOOL+waveOutBotOOL) > (waveOutTopOOL-numTOOL))
-         return PI_TOO_MANY_OOL;
+   if (pthNotifyWriterRunning != PI_THREAD_NONE)
+   {
+      pthread_cancel(pthNotifyWriter);
+      pthread_join(pthNotifyWriter, NULL);
+      pthNotifyWriterRunning = PI_THREAD_NONE;
+   }
 
-      if (wid >= PI_MAX_WAVES)
-         return PI_NO_WAVEFORM_ID;
+   for (i=0; i<pthSocketWorkersRunning; i++)
+   {
+      pthread_cancel(pthSocketWorker[i]);
+      pthread_join(pthSocketWorker[i], NULL);
+   }
 
-      wid = waveOutCount++;
+   pthSocketWorkersRunning = 0;
 
-      waveInfo[wid].botCB  = waveOutBotCB;
-      waveInfo[wid].topCB  = waveOutBotCB + numCB -1;
-      waveInfo[wid].botOOL = waveOutBotOOL;
-      waveInfo[wid].topOOL = waveOutTopOOL;
-      waveInfo[wid].numCB = numCB;
-      waveInfo[wid].numBOOL = numBOOL;
-      waveInfo[wid].numTOOL = numTOOL;
+   for (i=0; i<pthCallbackWorkersRunning; i++)
+   {
+      pthread_cancel(pthCallbackWorker[i]);
+      pthread_join(pthCallbackWorker[i], NULL);
+   }
 
-      waveOutBotCB += numCB;
-      waveOutBotOOL += numBOOL;
-      waveOutTopOOL -= numTOOL;
+   if (cbQueue != NULL)
+   {
+      free(cbQueue);
+      cbQueue = NULL;
    }
 
-   /* Must be room if got this far. */
+   if (cbSamples != NULL)
+   {
+      free(cbSamples);
+      cbSamples = NULL;
+   }
 
-   CB   = waveInfo[wid].botCB;
-   BOOL = waveInfo[wid].botOOL;
-   TOOL = waveInfo[wid].topOOL;
+   cbSamplesHead = 0;
+   cbSamplesTail = 0;
 
-   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL, 0, 0, 0);
+   pthCallbackWorkersRunning = 0;
 
-   /* Sanity check. */
+   for (i=0; i<MAX_RINGS; i++)
+   {
+      if (gpioRing[i].state == PI_RING_OPENED) ringStop(i);
+   }
 
-   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
-        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
-        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
    {
-      DBG(DBG_ALWAYS, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
-         numCB,   CB-waveInfo[wid].botCB,
-         numBOOL, BOOL-waveInfo[wid].botOOL,
-         numTOOL, waveInfo[wid].topOOL-TOOL);
+      if ((gpioNotify[i].state >= PI_NOTIFY_CLOSING) && gpioNotify[i].ring)
+         notifyRingClose(i);
    }
 
-   DBG(DBG_USER, "Wave Stats: wid=%d CBs %d BOOL %d TOOL %d", wid,
-      numCB, numBOOL, numTOOL);
+   /* release mmap'd memory */
 
-   waveInfo[wid].deleted = 0;
+   if (auxReg  != MAP_FAILED) munmap((void *)auxReg,  AUX_LEN);
+   if (bscsReg != MAP_FAILED) munmap((void *)bscsReg, BSCS_LEN);
+   if (clkReg  != MAP_FAILED) munmap((void *)clkReg,  CLK_LEN);
+   if (dmaReg  != MAP_FAILED) munmap((void *)dmaReg,  DMA_LEN);
+   if (gpioReg != MAP_FAILED) munmap((void *)gpioReg, GPIO_LEN);
+   if (pcmReg  != MAP_FAILED) munmap((void *)pcmReg,  PCM_LEN);
+   if (pwmReg  != MAP_FAILED) munmap((void *)pwmReg,  PWM_LEN);
+   if (systReg != MAP_FAILED) munmap((void *)systReg, SYST_LEN);
+   if (spiReg  != MAP_FAILED) munmap((void *)spiReg,  SPI_LEN);
 
-   /* Consume waves. */
+   auxReg  = MAP_FAILED;
+   bscsReg = MAP_FAILED;
+   clkReg  = MAP_FAILED;
+   dmaReg  = MAP_FAILED;
+   gpioReg = MAP_FAILED;
+   pcmReg  = MAP_FAILED;
+   pwmReg  = MAP_FAILED;
+   systReg = MAP_FAILED;
+   spiReg  = MAP_FAILED;
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   if (dmaBus != MAP_FAILED)
+   {
+      munmap(dmaBus,
+         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
+   }
 
-   wfcur = 0;
+   dmaBus = MAP_FAILED;
 
-   return wid;
-}
+   if (dmaVirt != MAP_FAILED)
+   {
+      for (i=0; i<PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      {
+         munmap(dmaVirt[i], PAGE_SIZE);
+      }
 
-int gpioWaveCreatePad(int pctCB, int pctBOOL, int pctTOOL)
-{
-   int i, wid;
-   int numCB, numBOOL, numTOOL;
-   int CB, BOOL, TOOL;
+      munmap(dmaVirt,
+         PAGES_PER_BLOCK*(bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
+   }
 
-   DBG(DBG_USER, "%d, %d, %d", pctCB, pctBOOL, pctTOOL);
+   dmaVirt = MAP_FAILED;
 
-   CHECK_INITED;
+   if (dmaPMapBlk != MAP_FAILED)
+   {
+      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      {
+         munmap(dmaPMapBlk[i], PAGES_PER_BLOCK*PAGE_SIZE);
+      }
 
-   if (pctCB < 0 || pctCB > 100)
-      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctCB=(%d)", pctCB);
-   if (pctBOOL < 0 || pctBOOL > 100)
-      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctBOOL=(%d)", pctBOOL);
-   if (pctTOOL < 0 || pctTOOL > 100)
-      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctTOOL=(%d)", pctTOOL);
-
-   if (wfc[wfcur] == 0) return PI_EMPTY_WAVEFORM;
+      munmap(dmaPMapBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(dmaPage_t *));
+   }
 
-   /* What resources are needed? */
-   waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
+   dmaPMapBlk = MAP_FAILED;
 
-   /* Amount of pad required */
-   CB = (NUM_WAVE_CBS - PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE) * pctCB / 100;
-   BOOL = (NUM_WAVE_OOL - PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE) * pctBOOL /100;
-   TOOL = (NUM_WAVE_OOL - PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE) * pctTOOL /100;
+   if (dmaMboxBlk != MAP_FAILED)
+   {
+      fdMbox = mbOpen();
 
-   /* Reject if wave is too big */
-   if (numCB > CB) return PI_TOO_MANY_CBS;
-   if (numBOOL > BOOL) return PI_TOO_MANY_OOL;
-   if (numTOOL > TOOL) return PI_TOO_MANY_OOL;
+      for (i=0; i<(bufferBlocks+PI_WAVE_BLOCKS); i++)
+      {
+         mbDMAFree(&dmaMboxBlk[bufferBlocks+PI_WAVE_BLOCKS-i-1]);
+      }
 
-   /* Set the padding */
-   numCB = CB;
-   numBOOL = BOOL;
-   numTOOL = TOOL;
+      mbClose(fdMbox);
 
+      munmap(dmaMboxBlk, (bufferBlocks+PI_WAVE_BLOCKS)*sizeof(DMAMem_t));
+   }
 
-   wid = -1;
+   dmaMboxBlk = MAP_FAILED;
 
-   /* Is there an exact fit with a deleted wave. */
+   if (inpFifo != NULL)
+   {
+      fclose(inpFifo);
+      unlink(PI_INPFIFO);
+      inpFifo = NULL;
+   }
 
-   for (i=0; i<waveOutCount; i++)
+   if (outFifo != NULL)
    {
-      if (waveInfo[i].deleted             &&
-         (waveInfo[i].numCB   == numCB)   &&
-         (waveInfo[i].numBOOL == numBOOL) &&
-         (waveInfo[i].numTOOL == numTOOL))
-      {
-         /* Reuse the deleted waves resources. */
-         wid = i;
-         break;
-      }
+      fclose(outFifo);
+      unlink(PI_OUTFIFO);
+      outFifo = NULL;
    }
 
-   if (wid == -1)
+   if (fdMem != -1)
    {
-      /* Are there enough spare resources? */
+      close(fdMem);
+      fdMem = -1;
+   }
 
-      if ((numCB+waveOutBotCB) > NUM_WAVE_CBS)
-         return PI_TOO_MANY_CBS;
+   if (fdLock != -1)
+   {
+      close(fdLock);
+      unlink(PI_LOCKFILE);
+      fdLock = -1;
+   }
 
-      if ((numBOOL+waveOutBotOOL) > (waveOutTopOOL-numTOOL))
-         return PI_TOO_MANY_OOL;
+   if (fdSock != -1)
+   {
+      close(fdSock);
+      fdSock = -1;
+   }
 
-      if (wid >= PI_MAX_WAVES)
-         return PI_NO_WAVEFORM_ID;
+   if (fdUnixSock != -1)
+   {
+      close(fdUnixSock);
+      unlink(sockUnixPath);
+      fdUnixSock = -1;
+   }
 
-      wid = waveOutCount++;
+   if (fdEpoll != -1)
+   {
+      close(fdEpoll);
+      fdEpoll = -1;
+   }
 
-      waveInfo[wid].botCB  = waveOutBotCB;
-      waveInfo[wid].topCB  = waveOutBotCB + numCB -1;
-      waveInfo[wid].botOOL = waveOutBotOOL;
-      waveInfo[wid].topOOL = waveOutTopOOL;
-      waveInfo[wid].numCB = numCB;
-      waveInfo[wid].numBOOL = numBOOL;
-      waveInfo[wid].numTOOL = numTOOL;
+   if (fdNotifyWake != -1)
+   {
+      close(fdNotifyWake);
+      fdNotifyWake = -1;
+   }
 
-      waveOutBotCB += numCB;
-      waveOutBotOOL += numBOOL;
-      waveOutTopOOL -= numTOOL;
+   if (fdPmap != -1)
+   {
+      close(fdPmap);
+      fdPmap = -1;
    }
 
-   /* Must be room if got this far. */
+   if (fdMbox != -1)
+   {
+      close(fdMbox);
+      fdMbox = -1;
+   }
 
-   CB   = waveInfo[wid].botCB;
-   BOOL = waveInfo[wid].botOOL;
-   TOOL = waveInfo[wid].topOOL;
+   gpioStats.DMARestarts = 0;
+   gpioStats.dmaInitCbsCount = 0;
 
-   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL, numCB, numBOOL, numTOOL);
+   numSockNetAddr = 0;
+}
 
-   /* Sanity check. */
+int initInitialise(void)
+{
+   int i;
+   unsigned j;
+   unsigned rev, model;
+   struct sockaddr_in server;
+   struct sockaddr_in6 server6;
+   struct sockaddr_un serverUnix;
+   struct stat statBuf;
+   char * portStr;
+   unsigned port;
+   struct sched_param param;
+   pthread_attr_t pthAttr;
 
-   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
-        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
-        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
-   {
-      DBG(DBG_ALWAYS, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
-         numCB,   CB-waveInfo[wid].botCB,
-         numBOOL, BOOL-waveInfo[wid].botOOL,
-         numTOOL, waveInfo[wid].topOOL-TOOL);
-   }
+   DBG(DBG_STARTUP, "");
 
-   DBG(DBG_USER, "Wave padding: wid=%d CBs %d BOOL %d TOOL %d", wid,
-      numCB, numBOOL, numTOOL);
+   waveClockInited = 0;
+   PWMClockInited = 0;
 
-   waveInfo[wid].deleted = 0;
+   clock_gettime(CLOCK_REALTIME, &libStarted);
 
-   /* Consume waves. */
+   rev = gpioHardwareRevision();
 
-   wfc[0] = 0;
-   wfc[1] = 0;
-   wfc[2] = 0;
+   initClearGlobals();
 
-   wfcur = 0;
+   if (initCheckPermitted() < 0) return PI_INIT_FAILED;
 
-   return wid;
-}
-/* ----------------------------------------------------------------------- */
+   fdLock = initGrabLockFile();
 
-int gpioWaveDelete(unsigned wave_id)
-{
-   DBG(DBG_USER, "wave id=%d", wave_id);
+   if (fdLock < 0)
+      SOFT_ERROR(PI_INIT_FAILED, "Can't lock %s", PI_LOCKFILE);
 
-   CHECK_INITED;
+   if (!gpioMaskSet)
+   {
+      if      (rev ==  0) gpioMask = PI_DEFAULT_UPDATE_MASK_UNKNOWN;
+      else if (rev <   4) gpioMask = PI_DEFAULT_UPDATE_MASK_B1;
+      else if (rev <  16) gpioMask = PI_DEFAULT_UPDATE_MASK_A_B2;
+      else if (rev == 17) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
+      else if (rev  < 20) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
+      else if (rev == 20) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
+      else if (rev == 21) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
+      else
+      {
+         model = (rev >> 4) & 0xFF;
 
-   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
-      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
+         /* model
+         0=A 1=B
+         2=A+ 3=B+
+         4=Pi2B
+         5=Alpha
+         6=Compute Module
+         7=Unknown
+         8=Pi3B
+         9=Zero
+         12=Zero W
+         13=Pi3B+
+         14=Pi3A+
+         17=Pi4B
+         */
+         if      (model <  2) gpioMask = PI_DEFAULT_UPDATE_MASK_A_B2;
+         else if (model <  4) gpioMask = PI_DEFAULT_UPDATE_MASK_APLUS_BPLUS;
+         else if (model == 4) gpioMask = PI_DEFAULT_UPDATE_MASK_PI2B;
 
-   waveInfo[wave_id].deleted = 1;
+         else if (model == 6
+               || model ==10
+               || model ==16) gpioMask = PI_DEFAULT_UPDATE_MASK_COMPUTE;
 
-   if (wave_id == (waveOutCount-1))
-   {
-      /* top wave deleted, garbage collect any other deleted waves */
+         else if (model == 8
+               || model ==13
+               || model ==14) gpioMask = PI_DEFAULT_UPDATE_MASK_PI3B;
 
-      while ((wave_id > 0) && (waveInfo[wave_id-1].deleted)) --wave_id;
+         else if (model == 9
+               || model ==12) gpioMask = PI_DEFAULT_UPDATE_MASK_ZERO;
 
-      waveOutBotCB  = waveInfo[wave_id].botCB;
-      waveOutBotOOL = waveInfo[wave_id].botOOL;
-      waveOutTopOOL = waveInfo[wave_id].topOOL;
+         else if (model ==17) gpioMask = PI_DEFAULT_UPDATE_MASK_PI4B;
+         else                 gpioMask = PI_DEFAULT_UPDATE_MASK_UNKNOWN;
+      }
 
-      waveOutCount = wave_id;
+      gpioMaskSet = 1;
    }
 
-   return 0;
-}
+#ifndef EMBEDDED_IN_VM
+   if (!(gpioCfg.internals & PI_CFG_NOSIGHANDLER))
+      sigSetHandler();
+#endif
 
-/* ----------------------------------------------------------------------- */
+   if (initPeripherals() < 0) return PI_INIT_FAILED;
 
-int gpioWaveTxStart(unsigned wave_mode)
-{
-   /* This function is deprecated and has been removed. */
+   if (initAllocDMAMem() < 0) return PI_INIT_FAILED;
 
-   CHECK_INITED;
+   /* done with /dev/mem */
 
-   SOFT_ERROR(PI_DEPRECATED, "deprected function removed");
-}
+   if (fdMem != -1)
+   {
+      close(fdMem);
+      fdMem = -1;
+   }
 
-/* ----------------------------------------------------------------------- */
+   param.sched_priority = sched_get_priority_max(SCHED_FIFO);
 
-int gpioWaveTxSend(unsigned wave_id, unsigned wave_mode)
-{
-   rawCbs_t *p=NULL;
+   if (gpioCfg.internals & PI_CFG_RT_PRIORITY)
+      sched_setscheduler(0, SCHED_FIFO, &param);
 
-   DBG(DBG_USER, "wave_id=%d wave_mode=%d", wave_id, wave_mode);
+   initClock(1); /* initialise main clock */
 
-   CHECK_INITED;
+   atexit(gpioTerminate);
 
-   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
-      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
+   if (pthread_attr_init(&pthAttr))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_init failed (%m)");
 
-   if (wave_mode > PI_WAVE_MODE_REPEAT_SYNC)
-      SOFT_ERROR(PI_BAD_WAVE_MODE, "bad wave mode (%d)", wave_mode);
+   if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
+      SOFT_ERROR(PI_INIT_FAILED, "pthread_attr_setstacksize failed (%m)");
 
-   if (!waveClockInited)
+   if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
    {
-      stopHardwarePWM();
-      initClock(0); /* initialise secondary clock */
-      waveClockInited = 1;
-      PWMClockInited = 0;
-   }
+      fdNotifyWake = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
 
-   if (wave_mode < PI_WAVE_MODE_ONE_SHOT_SYNC) initKillDMA(dmaOut);
-
-   p = rawWaveCBAdr(waveInfo[wave_id].topCB);
+      if (fdNotifyWake == -1)
+         SOFT_ERROR(PI_INIT_FAILED, "eventfd failed (%m)");
 
-   if ((wave_mode & 1) == PI_WAVE_MODE_ONE_SHOT)
-      p->next = 0;
-   else
-      p->next = waveCbPOadr(waveInfo[wave_id].botCB+1);
+      if (pthread_create(&pthNotifyWriter, &pthAttr, pthNotifyWriterThread, &i))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create notify writer failed (%m)");
 
-   if (waveEndPtr && (wave_mode > PI_WAVE_MODE_REPEAT))
-   {
-      *waveEndPtr = waveCbPOadr(waveInfo[wave_id].botCB+1);
+      pthNotifyWriterRunning = PI_THREAD_STARTED;
 
-      if (!dmaOut[DMA_CONBLK_AD])
+      if (gpioCfg.callbackWorkers)
       {
-         initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
-      }
-   }
-   else
-   {
-      initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
-   }
+         cbQueue = calloc(gpioCfg.callbackWorkers, sizeof(cbQueue_t));
 
-   waveEndPtr = &p->next;
+         if (cbQueue == NULL)
+            SOFT_ERROR(PI_INIT_FAILED, "callback queue alloc failed (%m)");
 
-   /* for compatability with the deprecated gpioWaveTxStart return the
-      number of cbs
-   */
-   return (waveInfo[wave_id].topCB - waveInfo[wave_id].botCB) + 1;
-}
+         cbSamples =
+            malloc(CB_SAMPLE_SLOTS * MAX_REPORT * sizeof(gpioSample_t));
 
+         if (cbSamples == NULL)
+            SOFT_ERROR(PI_INIT_FAILED, "callback samples alloc failed (%m)");
 
-/* ----------------------------------------------------------------------- */
+         for (j=0; j<gpioCfg.callbackWorkers; j++)
+         {
+            if (pthread_create(&pthCallbackWorker[j], &pthAttr,
+                               pthCallbackWorkerThread, &cbQueue[j]))
+               SOFT_ERROR(PI_INIT_FAILED,
+                  "pthread_create callback worker failed (%m)");
 
-static int chainGetCB(int n)
-{
-   int block, index;
+            pthCallbackWorkersRunning++;
+         }
+      }
 
-   if (n < (WCB_CHAIN_CBS * PI_WAVE_COUNT_PAGES))
-   {
-      block = n / WCB_CHAIN_CBS;
-      index = n % WCB_CHAIN_CBS;
-      return (block*CBS_PER_OPAGE) + WCB_COUNTER_CBS + index;
-   }
-   return -1;
-}
-
-static void chainSetVal(int n, uint32_t val)
-{
-   int block, index;
-   uint32_t *p;
+      if (pthread_create(&pthAlert, &pthAttr, pthAlertThread, &i))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create alert failed (%m)");
 
-   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
-   {
-      block = n / WCB_CHAIN_OOL;
-      index = n % WCB_CHAIN_OOL;
-      p = (uint32_t *) dmaOVirt[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-      p[index] = val;
+      pthAlertRunning = PI_THREAD_STARTED;
    }
-}
-
-static uint32_t chainGetValPadr(int n)
-{
-   int block, index;
-   uint32_t *p;
 
-   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
+   if (!(gpioCfg.ifFlags & PI_DISABLE_FIFO_IF))
    {
-      block = n / WCB_CHAIN_OOL;
-      index = n % WCB_CHAIN_OOL;
-      p = (uint32_t *) dmaOBus[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-      //cast twice to suppress warning, I belive this is ok as dmaOBus
-      //contains bus addresses not virtual addresses.
-      return (uint32_t)(uintptr_t) (p + index);
-   }
-   return 0;
-}
-
-static uint32_t chainGetCntVal(int counter, int slot)
-{
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   return p[WCB_CHAIN_OOL+ offset + slot];
-}
-
-static void chainSetCntVal(int counter, int slot, uint32_t value)
-{
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   p[WCB_CHAIN_OOL + offset + slot] = value;
-}
+      if (pthread_create(&pthFifo, &pthAttr, pthFifoThread, &i))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create fifo failed (%m)");
 
-static uint32_t chainGetCntValPadr(int counter, int slot)
-{
-   uint32_t *p;
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
-   p = (uint32_t *) dmaOBus[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
-   //cast twice to suppress warning, I belive this is ok as dmaOBus
-   //contains bus addresses not virtual addresses. --plugwash
-   return (uint32_t)(uintptr_t)(p + WCB_CHAIN_OOL + offset + slot);
-}
+      pthFifoRunning = PI_THREAD_STARTED;
+   }
 
-static int chainGetCntCB(int counter)
-{
-   int page, offset;
-   page = counter / 2;
-   offset = (counter % 2 ? WCB_CNT_CBS : 0);
-   return ((page * CBS_PER_OPAGE) + offset);
-}
+   if (!(gpioCfg.ifFlags & PI_DISABLE_SOCK_IF))
+   {
+      portStr = getenv(PI_ENVPORT);
+      if (portStr) port = atoi(portStr); else port = gpioCfg.socketPort;
 
-static void chainMakeCounter(
-   unsigned counter,
-   unsigned blklen,
-   unsigned blocks,
-   unsigned count,
-   uint32_t repeat,
-   uint32_t next)
-{
-   rawCbs_t *p=NULL;
+      // Accept connections on IPv6, unless we have an IPv4-only whitelist
+      if (!numSockNetAddr)
+      {
+         fdSock = socket(AF_INET6, SOCK_STREAM , 0);
 
-   int b, baseCB, dig;
-   uint32_t nxt;
+         if (fdSock != -1)
+         {
+            bzero((char *)&server6, sizeof(server6));
+            server6.sin6_family = AF_INET6;
+            if (gpioCfg.ifFlags & PI_LOCALHOST_SOCK_IF)
+            {
+               server6.sin6_addr = in6addr_loopback;
+            }
+            else
+            {
+               server6.sin6_addr = in6addr_any;
+            }
+            server6.sin6_port = htons(port);
 
-   int botCB;
+            int opt = 1;
+            setsockopt(fdSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            if (bind(fdSock,(struct sockaddr *)&server6, sizeof(server6)) < 0)
+               SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
+         }
+      }
 
-   botCB  = chainGetCntCB(counter);
+      if (numSockNetAddr || fdSock == -1)
+      {
+         fdSock = socket(AF_INET , SOCK_STREAM , 0);
 
-   baseCB = botCB;
+         if (fdSock == -1)
+            SOFT_ERROR(PI_INIT_FAILED, "socket failed (%m)");
+         else
+         {
+           int opt = 1;
+           setsockopt(fdSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+         }
+         server.sin_family = AF_INET;
+         if (gpioCfg.ifFlags & PI_LOCALHOST_SOCK_IF)
+         {
+            server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+         }
+         else
+         {
+            server.sin_addr.s_addr = htonl(INADDR_ANY);
+         }
+         server.sin_port = htons(port);
 
-   /* set up all the OOLs */
-   for (b=0; b < (blocks*(blklen+1)); b++) chainSetCntVal(counter, b, repeat);
+         if (bind(fdSock,(struct sockaddr *)&server , sizeof(server)) < 0)
+            SOFT_ERROR(PI_INIT_FAILED, "bind to port %d failed (%m)", port);
+      }
 
-   for (b=0; b<blocks; b++)
-      chainSetCntVal(counter,
-         ((b*(blklen+1))+blklen),
-         waveCbPOadr(baseCB+((b*3)+3)));
+      fdEpoll = epoll_create1(EPOLL_CLOEXEC);
 
-   for (b=0; b<blocks; b++)
-   {
-      /* copy BOTTOM to NEXT */
+      if (fdEpoll == -1)
+         SOFT_ERROR(PI_INIT_FAILED, "epoll_create1 failed (%m)");
 
-      p = rawWaveCBAdr(botCB++);
+      for (j=0; j<gpioCfg.socketWorkers; j++)
+      {
+         if (pthread_create(&pthSocketWorker[j], &pthAttr,
+                            pthSocketWorkerThread, &i))
+            SOFT_ERROR(PI_INIT_FAILED,
+               "pthread_create socket worker failed (%m)");
 
-      p->info = NORMAL_DMA;
+         pthSocketWorkersRunning++;
+      }
 
-      p->src = chainGetCntValPadr(counter, b*(blklen+1));
-      p->dst = (waveCbPOadr(botCB+1) + 20);
+      if (sockUnixPath[0])
+      {
+         fdUnixSock = socket(AF_UNIX, SOCK_STREAM, 0);
 
-      p->length = 4;
-      p->next   = waveCbPOadr(botCB);
+         if (fdUnixSock == -1)
+            SOFT_ERROR(PI_INIT_FAILED, "unix socket failed (%m)");
 
-      /* copy BOTTOM to TOP */
+         /* remove a stale socket but never any other file */
 
-      p = rawWaveCBAdr(botCB++);
+         if (lstat(sockUnixPath, &statBuf) == 0)
+         {
+            if (!S_ISSOCK(statBuf.st_mode))
+               SOFT_ERROR(PI_INIT_FAILED,
+                  "%s exists and is not a socket", sockUnixPath);
 
-      p->info   = NORMAL_DMA;
+            unlink(sockUnixPath);
+         }
 
-      p->src = chainGetCntValPadr(counter, b*(blklen+1));
-      p->dst = chainGetCntValPadr(counter, (b*(blklen+1))+blklen);
+         bzero((char *)&serverUnix, sizeof(serverUnix));
+         serverUnix.sun_family = AF_UNIX;
+         strcpy(serverUnix.sun_path, sockUnixPath);
 
-      p->length = 4;
-      p->next   = waveCbPOadr(botCB);
+         if (bind(fdUnixSock,
+                  (struct sockaddr *)&serverUnix, sizeof(serverUnix)) < 0)
+            SOFT_ERROR(PI_INIT_FAILED,
+               "bind to %s failed (%m)", sockUnixPath);
 
-      /* shift all down one */
+         /* access is controlled as for the TCP socket, see addrAllowed */
+         chmod(sockUnixPath, 0666);
+      }
 
-      p = rawWaveCBAdr(botCB++);
+      if (pthread_create(&pthSocket, &pthAttr, pthSocketThread, &fdSock))
+         SOFT_ERROR(PI_INIT_FAILED, "pthread_create socket failed (%m)");
 
-      p->info   = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+      pthSocketRunning = PI_THREAD_STARTED;
 
-      p->src = chainGetCntValPadr(counter, ((b*(blklen+1))+1));
-      p->dst = chainGetCntValPadr(counter, ((b*(blklen+1))+0));
+      if (fdUnixSock != -1)
+      {
+         if (pthread_create(&pthUnixSocket, &pthAttr,
+                            pthSocketThread, &fdUnixSock))
+            SOFT_ERROR(PI_INIT_FAILED,
+               "pthread_create unix socket failed (%m)");
 
-      p->length = blklen*4;
-      p->next   = repeat;
+         pthUnixSocketRunning = PI_THREAD_STARTED;
+      }
    }
 
-   /* reset the counter */
-
-   p = rawWaveCBAdr(botCB);
+   myGpioDelay(1000);
 
-   p->info = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+   dmaInitCbs();
 
-   p->src = chainGetCntValPadr(counter, blocks*(blklen+1));
-   p->dst = chainGetCntValPadr(counter, 0);
+   flushMemory();
 
-   p->length = blocks*(blklen+1)*4;
-   p->next   = next;
+   //cast twice to suppress compiler warning, I belive this cast
+   //is ok because dmaIBus contains bus addresses, not virtual
+   //addresses.
+   initDMAgo((uint32_t *)dmaIn, (uint32_t)(uintptr_t)dmaIBus[0]);
 
-   b = 0;
+   return PIGPIO_VERSION;
+}
 
-   while (count && (b<blocks))
-   {
-      dig = count % blklen;
-      count /= blklen;
 
-      if (count) nxt = chainGetCntVal(counter, (b*(blklen+1))+blklen);
-      else       nxt = waveCbPOadr(botCB);
+/* ======================================================================= */
 
-      chainSetCntVal(counter, b*(blklen+1)+dig, nxt);
+int getBitInBytes(int bitPos, char *buf, int numBits)
+{
+   int bitp, bufp;
 
-      b++;
+   if (bitPos < numBits)
+   {
+      bufp =      bitPos / 8;
+      bitp = 7 - (bitPos % 8);
+      if (buf[bufp] & (1<<bitp)) return 1;
    }
 
-   /* copy all the OOLs */
-   for (b=0; b < (blocks*(blklen+1)); b++)
-      chainSetCntVal(
-         counter, b+(blocks*(blklen+1)), chainGetCntVal(counter, b));
+   return 0;
 }
 
+/* ----------------------------------------------------------------------- */
 
-int gpioWaveChain(char *buf, unsigned bufSize)
+void putBitInBytes(int bitPos, char *buf, int bit)
 {
-   unsigned blklen=16, blocks=4;
-   int cb, chaincb;
-   rawCbs_t *p;
-   int i, wid, cmd, loop, counters;
-   unsigned cycles, delayCBs, dcb, delayLeft;
-   uint32_t repeat, next, *endPtr;
-   int stk_pos[10], stk_lev=0;
+   int bitp, bufp;
 
-   cb = 0;
-   loop = -1;
+   bufp =      bitPos / 8;
+   bitp = 7 - (bitPos % 8);
 
-   DBG(DBG_USER, "bufSize=%d [%s]", bufSize, myBuf2Str(bufSize, buf));
+   if (bit) buf[bufp] |=   (1<<bitp);
+   else     buf[bufp] &= (~(1<<bitp));
+}
 
-   CHECK_INITED;
+/* ----------------------------------------------------------------------- */
 
-   if (!waveClockInited)
+uint32_t rawWaveGetOOL(int pos)
+{
+   int page, slot;
+
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
    {
-      stopHardwarePWM();
-      initClock(0); /* initialise secondary clock */
-      waveClockInited = 1;
-      PWMClockInited = 0;
+      waveOOLPageSlot(pos, &page, &slot);
+      return (dmaOVirt[page]->OOL[slot]);
    }
 
-   initKillDMA(dmaOut);
+   return -1;
+}
 
-   waveEndPtr = NULL;
-   endPtr = NULL;
+/* ----------------------------------------------------------------------- */
 
-   /* add delay cb at start of DMA */
+void rawWaveSetOOL(int pos, uint32_t value)
+{
+   int page, slot;
 
-   p = rawWaveCBAdr(chainGetCB(cb++));
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot(pos, &page, &slot);
+      dmaOVirt[page]->OOL[slot] = value;
+   }
+}
 
-   /* use the secondary clock */
 
-   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+/* ----------------------------------------------------------------------- */
+
+uint32_t rawWaveGetOut(int pos)
+{
+   int page, slot;
+
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
    {
-      p->info = NORMAL_DMA | TIMED_DMA(2);
-      p->dst  = PCM_TIMER;
+      waveOOLPageSlot(pos, &page, &slot);
+      return (dmaOVirt[page]->OOL[slot]);
    }
-   else
+
+   return -1;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void rawWaveSetOut(int pos, uint32_t value)
+{
+   int page, slot;
+
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
    {
-      p->info = NORMAL_DMA | TIMED_DMA(5);
-      p->dst  = PWM_TIMER;
+      waveOOLPageSlot(pos, &page, &slot);
+      dmaOVirt[page]->OOL[slot] = value;
    }
+}
 
-   //cast twice to suppress warning, I belive this is ok as dmaOBus
-   //contains bus addresses not virtual addresses. --plugwash
-   p->src    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-   p->length = BPD * 20 / PI_WF_MICROS; /* 20 micros delay */
-   p->next   = waveCbPOadr(chainGetCB(cb));
 
-   counters = 0;
-   wid = -1;
+/* ----------------------------------------------------------------------- */
 
-   i = 0;
+uint32_t rawWaveGetIn(int pos)
+{
+   int page, slot;
 
-   while (i<bufSize)
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
    {
-      wid = (unsigned)buf[i];
+      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
+      return (dmaOVirt[page]->OOL[slot]);
+   }
 
-      if (wid == 255) /* wave command */
-      {
-         if ((i+2) > bufSize)
-            SOFT_ERROR(PI_BAD_CHAIN_CMD,
-               "incomplete chain command (at %d)", i);
+   return -1;
+}
 
-         cmd = buf[i+1];
+/* ----------------------------------------------------------------------- */
 
-         if (cmd == 0) /* loop begin */
-         {
-            if (stk_lev >= (sizeof(stk_pos)/sizeof(int)))
-               SOFT_ERROR(PI_CHAIN_NESTING,
-                  "chain counters nested too deep (at %d)", i);
+void rawWaveSetIn(int pos, uint32_t value)
+{
+   int page, slot;
 
-            stk_pos[stk_lev++] = cb;
+   if ((pos >= 0) && (pos < NUM_WAVE_OOL))
+   {
+      waveOOLPageSlot((NUM_WAVE_OOL-1)-pos, &page, &slot);
+      dmaOVirt[page]->OOL[slot] = value;
+   }
+}
 
-            i += 2;
-         }
-         else if (cmd == 1) /* loop end */
-         {
-            if (counters >= WCB_COUNTERS)
-               SOFT_ERROR(PI_CHAIN_COUNTER,
-                  "too many chain counters (at %d)", i);
+/* ----------------------------------------------------------------------- */
 
-            if ((i+4) > bufSize)
-               SOFT_ERROR(PI_BAD_CHAIN_CMD,
-                  "incomplete chain command (at %d)", i);
+rawWaveInfo_t rawWaveInfo(int wave_id)
+{
+   rawWaveInfo_t dummy = {0, 0, 0, 0, 0, 0, 0, 0};
 
-            loop = 0;
-            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+   if ((wave_id >=0) && (wave_id < PI_MAX_WAVES)) return waveInfo[wave_id];
+   else                                           return dummy;
+}
 
-            if ((loop < 1) || (loop == cb))
-               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
-                  "empty chain loop (at %d)", i);
+/* ----------------------------------------------------------------------- */
 
-            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+double time_time(void)
+{
+   struct timeval tv;
+   double t;
 
-            i += 4;
+   gettimeofday(&tv, 0);
 
-            if (cycles > PI_MAX_WAVE_CYCLES)
-               SOFT_ERROR(PI_CHAIN_LOOP_CNT,
-                  "bad chain loop count (%d)", cycles);
+   t = (double)tv.tv_sec + ((double)tv.tv_usec / 1E6);
 
-            if (cycles == 0)
-            {
-               /* Skip the complete loop block.  Change
-                  the next pointing to the start of the
-                  loop block to the current cb.
-               */
-               p = rawWaveCBAdr(chainGetCB(loop));
-               p->next = waveCbPOadr(chainGetCB(cb));
-            }
-            else if (cycles == 1)
-            {
-               /* Nothing to do, no need for a counter. */
-            }
-            else
-            {
-               chaincb = chainGetCB(cb++);
-               if (chaincb < 0)
-                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   return t;
+}
 
-               p = rawWaveCBAdr(chaincb);
+/* ----------------------------------------------------------------------- */
 
-               repeat = waveCbPOadr(chainGetCB(loop));
+void time_sleep(double seconds)
+{
+   struct timespec ts, rem;
 
-                /* Need to check next cb as well. */
+   if (seconds > 0.0)
+   {
+      ts.tv_sec = seconds;
+      ts.tv_nsec = (seconds-(double)ts.tv_sec) * 1E9;
 
-               chaincb = chainGetCB(cb);
+      while (clock_nanosleep(CLOCK_REALTIME, 0, &ts, &rem))
+      {
+         /* copy remaining time to ts */
+         ts.tv_sec  = rem.tv_sec;
+         ts.tv_nsec = rem.tv_nsec;
+      }
+   }
+}
 
-               if (chaincb < 0)
-                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+/* ----------------------------------------------------------------------- */
 
-               next = waveCbPOadr(chainGetCB(cb));
+void rawDumpWave(void)
+{
+   int i;
 
-               /* dummy src and dest */
-               p->info = NORMAL_DMA;
-               //cast twice to suppress warning, I belive this is ok as dmaOBus
-               //contains bus addresses not virtual addresses. --plugwash
-               p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-               p->dst = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-               p->length = 4;
-               p->next = waveCbPOadr(chainGetCntCB(counters));
+   unsigned numWaves, t;
 
-               chainMakeCounter(counters, blklen, blocks,
-                            cycles-1, repeat, next);
+   rawWave_t *waves;
 
-               counters++;
-            }
-         }
-         else if (cmd == 2) /* delay us */
-         {
-            if ((i+4) > bufSize)
-               SOFT_ERROR(PI_BAD_CHAIN_CMD,
-                  "incomplete chain command (at %d)", i);
+   waveMergePending();
 
-            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+   numWaves = wfc[wfcur];
+   waves    = wf [wfcur];
 
-            i += 4;
+   t = 0;
 
-            if (cycles > PI_MAX_WAVE_DELAY)
-               SOFT_ERROR(PI_BAD_CHAIN_DELAY,
-                  "bad chain delay micros (%d)", cycles);
+   for (i=0; i<numWaves; i++)
+   {
+      fprintf(stderr, "%10u %08X %08X %08X %10u\n",
+         t, waves[i].gpioOn, waves[i].gpioOff,
+         waves[i].flags, waves[i].usDelay);
+      t += waves[i].usDelay;
+   }
+}
 
-            if (cycles)
-            {
-               delayLeft = cycles;
-               delayCBs = waveDelayCBs(delayLeft);
-               for (dcb=0; dcb<delayCBs; dcb++)
-               {
-                  chaincb = chainGetCB(cb++);
+/* ----------------------------------------------------------------------- */
 
-                  if (chaincb < 0)
-                     SOFT_ERROR(
-                        PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+void rawDumpScript(unsigned script_id)
+{
+   int i;
 
-                  p = rawWaveCBAdr(chaincb);
+   if (script_id >= PI_MAX_SCRIPTS) return;
+
+   if (gpioScript[script_id].state == PI_SCRIPT_IN_USE)
+   {
+
+      for (i=0; i<PI_MAX_SCRIPT_PARAMS; i++)
+      {
+         fprintf(stderr, "p%d=%d ", i, gpioScript[script_id].script.par[i]);
+      }
+
+      fprintf(stderr, "\n");
+
+      for (i=0; i<PI_MAX_SCRIPT_VARS; i++)
+      {
+         fprintf(stderr, "v%d=%d ", i, gpioScript[script_id].script.var[i]);
+      }
+
+      fprintf(stderr, "\n");
+
+      for (i=0; i<gpioScript[script_id].script.instrs; i++)
+      {
+         fprintf(stderr,
+            "c%d=[%"PRIdPTR", %"PRIdPTR"(%d), %"PRIdPTR"(%d), %"PRIdPTR", %"PRIdPTR"]\n",
+            i,
+            gpioScript[script_id].script.instr[i].p[0],
+            gpioScript[script_id].script.instr[i].p[1],
+            gpioScript[script_id].script.instr[i].opt[1],
+            gpioScript[script_id].script.instr[i].p[2],
+            gpioScript[script_id].script.instr[i].opt[2],
+            gpioScript[script_id].script.instr[i].p[3],
+            gpioScript[script_id].script.instr[i].p[4]);
+      }
+   }
+}
+
+/* ======================================================================= */
+
+int gpioInitialise(void)
+{
+   int status;
+
+   if (libInitialised) return PIGPIO_VERSION;
+
+   DBG(DBG_STARTUP, "not initialised, initialising");
+
+   runState = PI_STARTING;
+
+   status = initInitialise();
+
+   if (status < 0)
+   {
+      runState = PI_ENDING;
+      initReleaseResources();
+   }
+   else
+   {
+      libInitialised = 1;
+
+      runState = PI_RUNNING;
+
+      if (!(gpioCfg.ifFlags & PI_DISABLE_ALERT))
+      {
+         while (pthAlertRunning != PI_THREAD_RUNNING) myGpioDelay(1000);
+      }
+
+   }
+
+   return status;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+void gpioTerminate(void)
+{
+   int i;
+
+   DBG(DBG_USER, "");
+
+   if (!libInitialised) return;
+
+   DBG(DBG_STARTUP, "initialised, terminating");
+
+   runState = PI_ENDING;
+
+   gpioMaskSet = 0;
+
+   /* reset DMA */
+
+   if (dmaReg != MAP_FAILED)
+   {
+      initKillDMA(dmaIn);
+      initKillDMA(dmaOut);
+   }
+
+#ifndef EMBEDDED_IN_VM
+   if ((gpioCfg.internals & PI_CFG_STATS) &&
+       (!(gpioCfg.internals & PI_CFG_NOSIGHANDLER)))
+   {
+      fprintf(stderr,
+         "\n#####################################################\n");
+      fprintf(stderr, "pigpio version=%d internals=%X\n",
+         PIGPIO_VERSION, gpioCfg.internals);
+
+      fprintf(stderr,
+         "micros=%d allocMode=%d dmaInitCbs=%d DMARestarts=%d\n",
+         gpioCfg.clockMicros, gpioCfg.memAllocMode,
+         gpioStats.dmaInitCbsCount, gpioStats.DMARestarts);
+
+      fprintf(stderr,
+         "samples %u maxSamples %u maxEmit %u notifyDrops %u\n",
+         gpioStats.numSamples, gpioStats.maxSamples,
+         gpioStats.maxEmit, gpioStats.notifyDrops);
+
+      fprintf(stderr, "bufferCycles %u dmaLaps %u lostCycles %u\n",
+         bufferCycles, gpioStats.dmaLaps, gpioStats.lostCycles);
+
+      fprintf(stderr, "cbTicks %d, cbCalls %u\n",
+         gpioStats.cbTicks, gpioStats.cbCalls);
+
+      fprintf(stderr,
+         "callbacks %u dropped %u maxLatency %u maxDuration %u\n",
+         gpioStats.cbRun, gpioStats.cbDropped,
+         gpioStats.cbMaxLatency, gpioStats.cbMaxDuration);
+
+      fprintf(stderr, "pipe: good %u, short %u, would block %u\n",
+         gpioStats.goodPipeWrite, gpioStats.shortPipeWrite,
+         gpioStats.wouldBlockPipeWrite);
+
+      fprintf(stderr, "notify ring overruns %u\n", gpioStats.ringOverruns);
+
+      fprintf(stderr, "alertTicks %u, lateTicks %u, moreToDo %u\n",
+         gpioStats.alertTicks, gpioStats.lateTicks, gpioStats.moreToDo);
+
+      if (gpioStats.alertPasses)
+      {
+         fprintf(stderr,
+            "alert passes %u, mean interval %u us, mean samples %u\n",
+            gpioStats.alertPasses,
+            (unsigned)(gpioStats.alertPassMicros / gpioStats.alertPasses),
+            (unsigned)(gpioStats.alertPassSamples / gpioStats.alertPasses));
+      }
+
+      for (i=0; i< TICKSLOTS; i++)
+         fprintf(stderr, "%9u ", gpioStats.diffTick[i]);
+
+      fprintf(stderr,
+         "\n#####################################################\n\n\n");
+   }
+
+#endif
+   initReleaseResources();
+
+   fflush(NULL);
+
+   libInitialised = 0;
+}
+
+static void switchFunctionOff(unsigned gpio)
+{
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_SERVO:
+         /* switch servo off */
+         myGpioSetServo(gpio, gpioInfo[gpio].width, 0);
+         gpioInfo[gpio].width = 0;
+         break;
+
+      case GPIO_PWM:
+         /* switch pwm off */
+         myGpioSetPwm(gpio, gpioInfo[gpio].width, 0);
+         gpioInfo[gpio].width = 0;
+         break;
+
+      case GPIO_HW_CLK:
+         /* No longer disable clock hardware, doing that was a bug. */
+         gpioInfo[gpio].width = 0;
+         break;
+
+      case GPIO_HW_PWM:
+         /* No longer disable PWM hardware, doing that was a bug. */
+         gpioInfo[gpio].width = 0;
+         break;
+   }
+}
+
+static void stopHardwarePWM(void)
+{
+   unsigned i, pwm;
+
+   for (i=0; i<= PI_MAX_GPIO; i++)
+   {
+      if (gpioInfo[i].is == GPIO_HW_PWM)
+      {
+         pwm = (PWMDef[i] >> 4) & 3;
+
+         if (pwm == 0) pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN1);
+         else          pwmReg[PWM_CTL] &= (~PWM_CTL_PWEN2);
+
+         gpioInfo[i].width = 0;
+         gpioInfo[i].is = GPIO_UNDEFINED;
+      }
+   }
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetMode(unsigned gpio, unsigned mode)
+{
+   int reg, shift, old_mode;
+
+   DBG(DBG_USER, "gpio=%d mode=%d", gpio, mode);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   if (mode > PI_ALT3)
+      SOFT_ERROR(PI_BAD_MODE, "gpio %d, bad mode (%d)", gpio, mode);
+
+   reg   =  gpio/10;
+   shift = (gpio%10) * 3;
+
+   old_mode = (gpioReg[reg] >> shift) & 7;
+
+   if (mode != old_mode)
+   {
+      switchFunctionOff(gpio);
+
+      gpioInfo[gpio].is = GPIO_UNDEFINED;
+   }
+
+   gpioReg[reg] = (gpioReg[reg] & ~(7<<shift)) | (mode<<shift);
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetMode(unsigned gpio)
+{
+   int reg, shift;
+
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   reg   =  gpio/10;
+   shift = (gpio%10) * 3;
+
+   return (gpioReg[reg] >> shift) & 7;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetPullUpDown(unsigned gpio, unsigned pud)
+{
+   int shift = (gpio & 0xf) << 1;
+   uint32_t bits;
+   uint32_t pull;
+
+   DBG(DBG_USER, "gpio=%d pud=%d", gpio, pud);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   if (pud > PI_PUD_UP)
+      SOFT_ERROR(PI_BAD_PUD, "gpio %d, bad pud (%d)", gpio, pud);
+
+   if (pi_is_2711)
+   {
+      switch (pud)
+      {
+         case PI_PUD_OFF:  pull = 0; break;
+         case PI_PUD_UP:   pull = 1; break;
+         case PI_PUD_DOWN: pull = 2; break;
+      }
+
+      bits = *(gpioReg + GPPUPPDN0 + (gpio>>4));
+      bits &= ~(3 << shift);
+      bits |= (pull << shift);
+      *(gpioReg + GPPUPPDN0 + (gpio>>4)) = bits;
+   }
+   else
+   {
+      *(gpioReg + GPPUD) = pud;
+
+      myGpioDelay(1);
+
+      *(gpioReg + GPPUDCLK0 + BANK) = BIT;
+
+      myGpioDelay(1);
+
+      *(gpioReg + GPPUD) = 0;
+
+      *(gpioReg + GPPUDCLK0 + BANK) = 0;
+   }
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioRead(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   if ((*(gpioReg + GPLEV0 + BANK) & BIT) != 0) return PI_ON;
+   else                                         return PI_OFF;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWrite(unsigned gpio, unsigned level)
+{
+   DBG(DBG_USER, "gpio=%d level=%d", gpio, level);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+
+   if (level > PI_ON)
+      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
+
+   if (gpio <= PI_MAX_GPIO)
+   {
+      if (gpioInfo[gpio].is != GPIO_WRITE)
+      {
+         /* stop a glitch between setting mode then level */
+         if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
+         else                 *(gpioReg + GPSET0 + BANK) = BIT;
+
+         switchFunctionOff(gpio);
+
+         gpioInfo[gpio].is = GPIO_WRITE;
+      }
+   }
+
+   myGpioSetMode(gpio, PI_OUTPUT);
+
+   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
+   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioPWM(unsigned gpio, unsigned val)
+{
+   DBG(DBG_USER, "gpio=%d dutycycle=%d", gpio, val);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (val > gpioInfo[gpio].range)
+      SOFT_ERROR(PI_BAD_DUTYCYCLE, "gpio %d, bad dutycycle (%d)", gpio, val);
+
+   if (gpioInfo[gpio].is != GPIO_PWM)
+   {
+      switchFunctionOff(gpio);
+
+      gpioInfo[gpio].is = GPIO_PWM;
+
+      if (!val) myGpioWrite(gpio, 0);
+   }
+
+   myGpioSetMode(gpio, PI_OUTPUT);
+
+   myGpioSetPwm(gpio, gpioInfo[gpio].width, val);
+
+   gpioInfo[gpio].width=val;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetPWMdutycycle(unsigned gpio)
+{
+   unsigned pwm;
+
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_PWM:
+         return gpioInfo[gpio].width;
+
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_duty[pwm];
+
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE/2;
+
+      default:
+         SOFT_ERROR(PI_NOT_PWM_GPIO, "not a PWM gpio (%d)", gpio);
+   }
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetPWMrange(unsigned gpio, unsigned range)
+{
+   int oldWidth, newWidth;
+
+   DBG(DBG_USER, "gpio=%d range=%d", gpio, range);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if ((range < PI_MIN_DUTYCYCLE_RANGE)  || (range > PI_MAX_DUTYCYCLE_RANGE))
+      SOFT_ERROR(PI_BAD_DUTYRANGE, "gpio %d, bad range (%d)", gpio, range);
+
+   oldWidth = gpioInfo[gpio].width;
+
+   if (oldWidth)
+   {
+      if (gpioInfo[gpio].is == GPIO_PWM)
+      {
+         newWidth = (range * oldWidth) / gpioInfo[gpio].range;
+
+         myGpioSetPwm(gpio, oldWidth, 0);
+         gpioInfo[gpio].range = range;
+         gpioInfo[gpio].width = newWidth;
+         myGpioSetPwm(gpio, 0, newWidth);
+      }
+   }
+
+   gpioInfo[gpio].range = range;
+
+   /* return the actual range for the current gpio frequency */
+
+   return pwmRealRange[gpioInfo[gpio].freqIdx];
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetPWMrange(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE;
+
+      default:
+         return gpioInfo[gpio].range;
+   }
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetPWMrealRange(unsigned gpio)
+{
+   unsigned pwm;
+
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_real_range[pwm];
+
+      case GPIO_HW_CLK:
+         return PI_HW_PWM_RANGE;
+
+      default:
+         return pwmRealRange[gpioInfo[gpio].freqIdx];
+   }
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetPWMfrequency(unsigned gpio, unsigned frequency)
+{
+   int i, width;
+   unsigned diff, best, idx;
+
+   DBG(DBG_USER, "gpio=%d frequency=%d", gpio, frequency);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if      (frequency > pwmFreq[0])           idx = 0;
+   else if (frequency < pwmFreq[PWM_FREQS-1]) idx = PWM_FREQS-1;
+   else
+   {
+      best = 100000; /* impossibly high frequency difference */
+      idx = 0;
+
+      for (i=0; i<PWM_FREQS; i++)
+      {
+         if (frequency > pwmFreq[i]) diff = frequency - pwmFreq[i];
+         else                        diff = pwmFreq[i] - frequency;
+
+         if (diff < best)
+         {
+            best = diff;
+            idx = i;
+         }
+      }
+   }
+
+   width = gpioInfo[gpio].width;
+
+   if (width)
+   {
+      if (gpioInfo[gpio].is == GPIO_PWM)
+      {
+         myGpioSetPwm(gpio, width, 0);
+         gpioInfo[gpio].freqIdx = idx;
+         myGpioSetPwm(gpio, 0, width);
+      }
+   }
+
+   gpioInfo[gpio].freqIdx = idx;
+
+   return pwmFreq[idx];
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetPWMfrequency(unsigned gpio)
+{
+   unsigned pwm, clock;
+
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   switch (gpioInfo[gpio].is)
+   {
+      case GPIO_HW_PWM:
+         pwm = (PWMDef[gpio] >> 4) & 3;
+         return hw_pwm_freq[pwm];
+
+      case GPIO_HW_CLK:
+         clock = (clkDef[gpio] >> 4) & 3;
+         return hw_clk_freq[clock];
+
+      default:
+         return pwmFreq[gpioInfo[gpio].freqIdx];
+   }
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioServo(unsigned gpio, unsigned val)
+{
+   DBG(DBG_USER, "gpio=%d pulsewidth=%d", gpio, val);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if ((val!=PI_SERVO_OFF) && (val<PI_MIN_SERVO_PULSEWIDTH))
+      SOFT_ERROR(PI_BAD_PULSEWIDTH,
+         "gpio %d, bad pulsewidth (%d)", gpio, val);
+
+   if (val>PI_MAX_SERVO_PULSEWIDTH)
+      SOFT_ERROR(PI_BAD_PULSEWIDTH,
+         "gpio %d, bad pulsewidth (%d)", gpio, val);
+
+   if (gpioInfo[gpio].is != GPIO_SERVO)
+   {
+      switchFunctionOff(gpio);
+
+      gpioInfo[gpio].is = GPIO_SERVO;
+
+      if (!val) myGpioWrite(gpio, 0);
+   }
+
+   myGpioSetMode(gpio, PI_OUTPUT);
+
+   myGpioSetServo(gpio, gpioInfo[gpio].width, val);
+
+   gpioInfo[gpio].width=val;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetServoPulsewidth(unsigned gpio)
+{
+   DBG(DBG_USER, "gpio=%d", gpio);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (gpioInfo[gpio].is != GPIO_SERVO)
+      SOFT_ERROR(PI_NOT_SERVO_GPIO, "not a servo gpio (%d)", gpio);
+
+   return gpioInfo[gpio].width;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveClear(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   waveBuildReset();
+
+   wfStats.micros = 0;
+   wfStats.pulses = 0;
+   wfStats.cbs    = 0;
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   waveStreamFree();
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   waveSpaceReset();
+
+   waveEndPtr = NULL;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveAddNew(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   waveBuildReset();
+
+   wfStats.micros = 0;
+   wfStats.pulses = 0;
+   wfStats.cbs    = 0;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveAddGeneric(unsigned numPulses, gpioPulse_t *pulses)
+{
+   int p;
+
+   DBG(DBG_USER, "numPulses=%u pulses=%08"PRIXPTR, numPulses, (uintptr_t)pulses);
+
+   CHECK_INITED;
+
+   if (numPulses > PI_WAVE_MAX_PULSES)
+      SOFT_ERROR(PI_TOO_MANY_PULSES, "bad number of pulses (%d)", numPulses);
+
+   if (!pulses) SOFT_ERROR(PI_BAD_POINTER, "bad (NULL) pulses pointer");
+
+   for (p=0; p<numPulses; p++)
+   {
+      wf[2][p].gpioOff = pulses[p].gpioOff;
+      wf[2][p].gpioOn  = pulses[p].gpioOn;
+      wf[2][p].usDelay = pulses[p].usDelay;
+      wf[2][p].flags   = 0;
+   }
+
+   return rawWaveAddGeneric(numPulses, wf[2]);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveAddSerial
+   (unsigned gpio,
+    unsigned baud,
+    unsigned data_bits,
+    unsigned stop_bits,
+    unsigned offset,
+    unsigned numBytes,
+    char     *bstr)
+{
+   int i, b, p, lev, c, v;
+
+   uint16_t *wstr = (uint16_t *)bstr;
+   uint32_t *lstr = (uint32_t *)bstr;
+
+   unsigned bitDelay[32];
+
+   DBG(DBG_USER,
+      "gpio=%d baud=%d bits=%d stops=%d offset=%d numBytes=%d str=[%s]",
+      gpio, baud, data_bits, stop_bits, offset,
+      numBytes, myBuf2Str(numBytes, (char *)bstr));
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if ((baud < PI_WAVE_MIN_BAUD) || (baud > PI_WAVE_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_WAVE_BAUD, "bad baud rate (%d)", baud);
+
+   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
+       (data_bits > PI_MAX_WAVE_DATABITS))
+      SOFT_ERROR(PI_BAD_DATABITS, "bad number of databits (%d)", data_bits);
+
+   if ((stop_bits < PI_MIN_WAVE_HALFSTOPBITS) ||
+       (stop_bits > PI_MAX_WAVE_HALFSTOPBITS))
+      SOFT_ERROR(PI_BAD_STOPBITS,
+         "bad number of (half) stop bits (%d)", stop_bits);
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (numBytes > PI_WAVE_MAX_CHARS)
+      SOFT_ERROR(PI_TOO_MANY_CHARS, "too many chars (%d)", numBytes);
+
+   if (offset > PI_WAVE_MAX_MICROS)
+      SOFT_ERROR(PI_BAD_SER_OFFSET, "offset too large (%d)", offset);
+
+   if (data_bits > 8) numBytes /= 2;
+   if (data_bits > 16) numBytes /= 2;
+
+   if (!numBytes) return 0;
+
+   waveBitDelay(baud, data_bits, stop_bits, bitDelay);
+
+   p = 0;
+
+   wf[2][p].gpioOn  = (1<<gpio);
+   wf[2][p].gpioOff = 0;
+   wf[2][p].flags   = 0;
+
+   if (offset > bitDelay[0]) wf[2][p].usDelay = offset;
+   else                      wf[2][p].usDelay = bitDelay[0];
+
+   for (i=0; i<numBytes; i++)
+   {
+      p++;
+
+      /* start bit */
+
+      wf[2][p].gpioOn = 0;
+      wf[2][p].gpioOff = (1<<gpio);
+      wf[2][p].usDelay = bitDelay[0];
+      wf[2][p].flags   = 0;
+
+      lev = 0;
+
+      if      (data_bits <  9) c = bstr[i];
+      else if (data_bits < 17) c = wstr[i];
+      else                  c = lstr[i];
+
+      for (b=0; b<data_bits; b++)
+      {
+         if (c & (1<<b)) v=1; else v=0;
+
+         if (v == lev) wf[2][p].usDelay += bitDelay[b+1];
+         else
+         {
+            p++;
+
+            lev = v;
+
+            if (lev)
+            {
+               wf[2][p].gpioOn  = (1<<gpio);
+               wf[2][p].gpioOff = 0;
+               wf[2][p].flags   = 0;
+            }
+            else
+            {
+               wf[2][p].gpioOn  = 0;
+               wf[2][p].gpioOff = (1<<gpio);
+               wf[2][p].flags   = 0;
+            }
+
+            wf[2][p].usDelay = bitDelay[b+1];
+         }
+      }
+
+      /* stop bit */
+
+      if (lev) wf[2][p].usDelay += bitDelay[data_bits+1];
+      else
+      {
+         p++;
+
+         wf[2][p].gpioOn  = (1<<gpio);
+         wf[2][p].gpioOff = 0;
+         wf[2][p].usDelay = bitDelay[data_bits+1];
+         wf[2][p].flags   = 0;
+      }
+   }
+
+   p++;
+
+   wf[2][p].gpioOn  = (1<<gpio);
+   wf[2][p].gpioOff = 0;
+   wf[2][p].usDelay = bitDelay[0];
+   wf[2][p].flags   = 0;
+
+   return rawWaveAddGeneric(p, wf[2]);
+}
+
+/* ----------------------------------------------------------------------- */
+
+int rawWaveAddSPI(
+   rawSPI_t *spi,
+   unsigned offset,
+   unsigned spiSS,
+   char *buf,
+   unsigned spiTxBits,
+   unsigned spiBitFirst,
+   unsigned spiBitLast,
+   unsigned spiBits)
+{
+   int p, bit, dbv, halfbit;
+   int rising_edge[2], read_cycle[2];
+   uint32_t on_bits, off_bits;
+   int tx_bit_pos;
+
+   DBG(DBG_USER,
+      "spi=%08"PRIXPTR" off=%d spiSS=%d tx=%08"PRIXPTR", num=%d fb=%d lb=%d spiBits=%d",
+      (uintptr_t)spi, offset, spiSS, (uintptr_t)buf, spiTxBits,
+      spiBitFirst, spiBitLast, spiBits);
+
+   CHECK_INITED;
+
+   if (spiSS > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", spiSS);
+
+   /*
+   CPOL CPHA
+    0    0   read rising/write falling
+    0    1   read falling/write rising
+    1    0   read falling/write rising
+    1    1   read rising/write falling
+   */
+
+   if (spi->clk_pol) {rising_edge[0] = 0; rising_edge[1] = 1;}
+   else              {rising_edge[0] = 1; rising_edge[1] = 0;}
+
+   if (spi->clk_pha) {read_cycle[0] = 0; read_cycle[1] = 1;}
+   else              {read_cycle[0] = 1; read_cycle[1] = 0;}
+
+   p = 0;
+
+   if (offset)
+   {
+      wf[2][p].gpioOn  = 0;
+      wf[2][p].gpioOff = 0;
+      wf[2][p].flags   = 0;
+      wf[2][p].usDelay = offset;
+      p++;
+   }
+
+   on_bits = 0;
+   off_bits = 0;
+
+   tx_bit_pos = 0;
+
+   /* preset initial mosi bit */
+
+   if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
+   {
+      on_bits  |= (1<<(spi->mosi));
+      dbv = 1;
+   }
+   else
+   {
+      off_bits |= (1<<(spi->mosi));
+      dbv = 0;
+   }
+
+   if (!spi->clk_pha) tx_bit_pos ++;
+
+   if (spi->ss_pol) off_bits |= (1<<spiSS);
+   else             on_bits  |= (1<<spiSS);
+
+   if (spi->clk_pol) on_bits  |= (1<<(spi->clk));
+   else              off_bits |= (1<<(spi->clk));
+
+   wf[2][p].gpioOn  = on_bits;
+   wf[2][p].gpioOff = off_bits;
+   wf[2][p].flags   = 0;
+
+   if (spi->clk_us > spi->ss_us) wf[2][p].usDelay = spi->clk_us;
+   else                          wf[2][p].usDelay = spi->ss_us;
+
+   p++;
+
+   for (bit=1; bit<=spiBits; bit++)
+   {
+      for (halfbit=0; halfbit<2; halfbit++)
+      {
+         wf[2][p].usDelay = spi->clk_us;
+         wf[2][p].flags = 0;
+
+         on_bits = 0;
+         off_bits = 0;
+
+         if (read_cycle[halfbit])
+         {
+            if ((bit>=spiBitFirst) && (bit<=spiBitLast))
+               wf[2][p].flags = WAVE_FLAG_READ;
+         }
+         else
+         {
+            if (getBitInBytes(tx_bit_pos, buf, spiTxBits))
+            {
+               if (!dbv) on_bits  |= (1<<(spi->mosi));
+               dbv = 1;
+            }
+            else
+            {
+               if (dbv) off_bits |= (1<<(spi->mosi));
+               dbv = 0;
+            }
+
+            ++tx_bit_pos;
+         }
+
+         if (rising_edge[halfbit]) on_bits  |= (1<<(spi->clk));
+         else                      off_bits |= (1<<(spi->clk));
+
+         wf[2][p].gpioOn = on_bits;
+         wf[2][p].gpioOff = off_bits;
+
+         p++;
+      }
+   }
+
+   on_bits = 0;
+   off_bits = 0;
+
+   if (spi->ss_pol) on_bits  |= (1<<spiSS);
+   else             off_bits |= (1<<spiSS);
+
+   wf[2][p].gpioOn  = on_bits;
+   wf[2][p].gpioOff = off_bits;
+   wf[2][p].flags   = 0;
+   wf[2][p].usDelay = 0;
+
+   p++;
+
+   return rawWaveAddGeneric(p, wf[2]);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int waveCreate(int shared)
+{
+   int wid, cached;
+   int numCB, numBOOL, numTOOL;
+   int CB, BOOL, TOOL;
+   uint64_t hash;
+
+   if (wfc[wfcur] == 0) return PI_EMPTY_WAVEFORM;
+
+   waveMergePending();
+
+   /* Is there a shared wave made from the same pulses? */
+
+   cached = shared && waveCacheKey(&hash);
+
+   if (cached)
+   {
+      wid = waveCacheFind(hash);
+
+      if (wid >= 0)
+      {
+         waveCache[wid].refs++;
+         waveCacheHits++;
+
+         DBG(DBG_INTERNAL, "Wave cached: wid=%d refs %d", wid,
+            waveCache[wid].refs);
+
+         waveBuildReset();
+
+         return wid;
+      }
+
+      waveCacheMisses++;
+   }
+
+   /* What resources are needed? */
+
+      waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
+
+   /* Best fit from the free CB and OOL space. */
+
+   wid = waveAllocate(numCB, numBOOL, numTOOL);
+
+   if (wid < 0) return wid;
+
+   /* Must be room if got this far. */
+
+   CB   = waveInfo[wid].botCB;
+   BOOL = waveInfo[wid].botOOL;
+   TOOL = waveInfo[wid].topOOL;
+
+   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL, 0, 0, 0);
+
+   /* Sanity check. */
+
+   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
+        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
+        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
+   {
+      DBG(DBG_ALWAYS, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
+         numCB,   CB-waveInfo[wid].botCB,
+         numBOOL, BOOL-waveInfo[wid].botOOL,
+         numTOOL, waveInfo[wid].topOOL-TOOL);
+   }
+
+   DBG(DBG_USER, "Wave Stats: wid=%d CBs %d BOOL %d TOOL %d", wid,
+      numCB, numBOOL, numTOOL);
+
+   waveInfo[wid].deleted = 0;
+
+   if (cached) waveCacheAdd(wid, hash);
+
+   /* Consume waves. */
+
+   waveBuildReset();
+
+   return wid;
+}
+
+int gpioWaveCreate(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return waveCreate(0);
+}
+
+int gpioWaveCreateShared(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return waveCreate(1);
+}
+
+int gpioWaveCreatePad(int pctCB, int pctBOOL, int pctTOOL)
+{
+   int wid;
+   int numCB, numBOOL, numTOOL;
+   int CB, BOOL, TOOL;
+
+   DBG(DBG_USER, "%d, %d, %d", pctCB, pctBOOL, pctTOOL);
+
+   CHECK_INITED;
+
+   if (pctCB < 0 || pctCB > 100)
+      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctCB=(%d)", pctCB);
+   if (pctBOOL < 0 || pctBOOL > 100)
+      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctBOOL=(%d)", pctBOOL);
+   if (pctTOOL < 0 || pctTOOL > 100)
+      SOFT_ERROR(PI_BAD_PARAM, "bad wave param, pctTOOL=(%d)", pctTOOL);
+
+   if (wfc[wfcur] == 0) return PI_EMPTY_WAVEFORM;
+
+   waveMergePending();
+
+   /* What resources are needed? */
+   waveCBsOOLs(&numCB, &numBOOL, &numTOOL);
+
+   /* Amount of pad required */
+   CB = (NUM_WAVE_CBS - PI_WAVE_COUNT_PAGES*CBS_PER_OPAGE) * pctCB / 100;
+   BOOL = (NUM_WAVE_OOL - PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE) * pctBOOL /100;
+   TOOL = (NUM_WAVE_OOL - PI_WAVE_COUNT_PAGES*OOL_PER_OPAGE) * pctTOOL /100;
+
+   /* Reject if wave is too big */
+   if (numCB > CB) return PI_TOO_MANY_CBS;
+   if (numBOOL > BOOL) return PI_TOO_MANY_OOL;
+   if (numTOOL > TOOL) return PI_TOO_MANY_OOL;
+
+   /* Set the padding */
+   numCB = CB;
+   numBOOL = BOOL;
+   numTOOL = TOOL;
+
+
+   /* Best fit from the free CB and OOL space. */
+
+   wid = waveAllocate(numCB, numBOOL, numTOOL);
+
+   if (wid < 0) return wid;
+
+   /* Must be room if got this far. */
+
+   CB   = waveInfo[wid].botCB;
+   BOOL = waveInfo[wid].botOOL;
+   TOOL = waveInfo[wid].topOOL;
+
+   wave2Cbs(PI_WAVE_MODE_ONE_SHOT, &CB, &BOOL, &TOOL, numCB, numBOOL, numTOOL);
+
+   /* Sanity check. */
+
+   if ( (numCB   != (CB-waveInfo[wid].botCB))    ||
+        (numBOOL != (BOOL-waveInfo[wid].botOOL)) ||
+        (numTOOL != (waveInfo[wid].topOOL-TOOL)) )
+   {
+      DBG(DBG_ALWAYS, "ERROR wid=%d CBs %d=%d BOOL %d=%d TOOL %d=%d", wid,
+         numCB,   CB-waveInfo[wid].botCB,
+         numBOOL, BOOL-waveInfo[wid].botOOL,
+         numTOOL, waveInfo[wid].topOOL-TOOL);
+   }
+
+   DBG(DBG_USER, "Wave padding: wid=%d CBs %d BOOL %d TOOL %d", wid,
+      numCB, numBOOL, numTOOL);
+
+   waveInfo[wid].deleted = 0;
+
+   /* Consume waves. */
+
+   waveBuildReset();
+
+   return wid;
+}
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveDelete(unsigned wave_id)
+{
+   DBG(DBG_USER, "wave id=%d", wave_id);
+
+   CHECK_INITED;
+
+   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
+      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
+
+   /* a shared wave is kept until the delete matching its last create */
+
+   if (waveCache[wave_id].refs > 1)
+   {
+      waveCache[wave_id].refs--;
+      return 0;
+   }
+
+   free(waveCache[wave_id].pulses);
+
+   waveCache[wave_id].pulses = NULL;
+   waveCache[wave_id].refs = 0;
+
+   waveInfo[wave_id].deleted = 1;
+
+   /* return the wave's space, merging it with any free neighbours */
+
+   waveExtentFree(&waveFreeCB,
+      waveInfo[wave_id].botCB, waveInfo[wave_id].numCB);
+
+   waveExtentFree(&waveFreeOOL,
+      waveInfo[wave_id].botOOL, waveInfo[wave_id].numBOOL);
+
+   waveExtentFree(&waveFreeOOL,
+      waveInfo[wave_id].topOOL - waveInfo[wave_id].numTOOL,
+      waveInfo[wave_id].numTOOL);
+
+   /* drop any deleted waves at the top */
+
+   while ((waveOutCount > 0) && waveInfo[waveOutCount-1].deleted)
+      waveOutCount--;
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void waveFreeSummary(
+   waveFree_t *f, uint32_t *freeSlots, uint32_t *largest, uint32_t *holes)
+{
+   int i;
+
+   *freeSlots = 0;
+   *largest = 0;
+
+   for (i=0; i<f->num; i++)
+   {
+      *freeSlots += f->ext[i].count;
+
+      if (f->ext[i].count > *largest) *largest = f->ext[i].count;
+   }
+
+   *holes = f->num;
+}
+
+int gpioWaveFragmentation(gpioWaveFrag_t *frag)
+{
+   int i;
+
+   DBG(DBG_USER, "frag=%08"PRIXPTR, (uintptr_t)frag);
+
+   CHECK_INITED;
+
+   if (!frag)
+      SOFT_ERROR(PI_BAD_POINTER, "frag can't be NULL");
+
+   frag->waves = 0;
+
+   for (i=0; i<waveOutCount; i++) if (!waveInfo[i].deleted) frag->waves++;
+
+   frag->cbs = NUM_WAVE_CBS - waveFreeCB.base;
+   waveFreeSummary(
+      &waveFreeCB, &frag->freeCBs, &frag->largestCBs, &frag->holesCB);
+
+   frag->ools = NUM_WAVE_OOL - waveFreeOOL.base;
+   waveFreeSummary(
+      &waveFreeOOL, &frag->freeOOLs, &frag->largestOOLs, &frag->holesOOL);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetCacheStats(gpioWaveCacheStats_t *stats)
+{
+   int i;
+
+   DBG(DBG_USER, "stats=%08"PRIXPTR, (uintptr_t)stats);
+
+   CHECK_INITED;
+
+   if (!stats)
+      SOFT_ERROR(PI_BAD_POINTER, "stats can't be NULL");
+
+   stats->hits = waveCacheHits;
+   stats->misses = waveCacheMisses;
+   stats->waves = 0;
+   stats->refs = 0;
+
+   for (i=0; i<waveOutCount; i++)
+   {
+      if (!waveInfo[i].deleted && waveCache[i].pulses)
+      {
+         stats->waves++;
+         stats->refs += waveCache[i].refs;
+      }
+   }
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveStreamOpen(unsigned segments, unsigned segPulses)
+{
+   int CB, OOL, segCBs, segOOLs;
+   waveStream_t *s = &waveStream;
+
+   DBG(DBG_USER, "segments=%d segPulses=%d", segments, segPulses);
+
+   CHECK_INITED;
+
+   if ((segments < PI_MIN_STREAM_SEGS) || (segments > PI_MAX_STREAM_SEGS) ||
+       (segPulses < 1) || (segPulses > PI_WAVE_MAX_PULSES))
+      SOFT_ERROR(PI_BAD_WAVE_STREAM,
+         "bad segments (%d) or pulses (%d)", segments, segPulses);
+
+   /*
+   Each segment has a lead delay (only run when the output starts
+   there), a level and a delay CB per pulse, and a last CB which
+   copies the segment's count to the played count.
+   */
+
+   segCBs  = 2 + (2 * segPulses);
+   segOOLs = 1 + (2 * segPulses);
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   waveStreamFree();
+
+   CB = waveExtentAlloc(&waveFreeCB, segments * segCBs);
+
+   if (CB < 0)
+   {
+      pthread_mutex_unlock(&waveStreamMutex);
+      SOFT_ERROR(PI_TOO_MANY_CBS, "no space for the stream's CBs");
+   }
+
+   OOL = waveExtentAlloc(&waveFreeOOL, 1 + (segments * segOOLs));
+
+   if (OOL < 0)
+   {
+      waveExtentFree(&waveFreeCB, CB, segments * segCBs);
+      pthread_mutex_unlock(&waveStreamMutex);
+      SOFT_ERROR(PI_TOO_MANY_OOL, "no space for the stream's OOL");
+   }
+
+   if (!waveClockInited)
+   {
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
+      PWMClockInited = 0;
+   }
+
+   memset(s, 0, sizeof(waveStream_t));
+
+   s->segs      = segments;
+   s->segPulses = segPulses;
+   s->segCBs    = segCBs;
+   s->segOOLs   = segOOLs;
+   s->botCB     = CB;
+   s->botOOL    = OOL;
+   s->open      = 1;
+
+   waveSetOOL(OOL, 0);
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveStreamSetEvent(unsigned event, unsigned lowWater)
+{
+   int status = 0;
+
+   DBG(DBG_USER, "event=%d lowWater=%d", event, lowWater);
+
+   CHECK_INITED;
+
+   if (event > PI_MAX_EVENT)
+      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   if (!waveStream.open)
+      status = PI_NO_WAVE_STREAM;
+   else if (lowWater >= waveStream.segs)
+      status = PI_BAD_WAVE_STREAM;
+   else
+   {
+      waveStream.event    = event;
+      waveStream.lowWater = lowWater;
+      waveStream.eventOn  = 1;
+      waveStream.low      = 0;
+   }
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   if (status == PI_NO_WAVE_STREAM)
+      SOFT_ERROR(PI_NO_WAVE_STREAM, "no wave stream open");
+
+   if (status == PI_BAD_WAVE_STREAM)
+      SOFT_ERROR(PI_BAD_WAVE_STREAM, "bad low water (%d)", lowWater);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveStreamWrite(unsigned numPulses, gpioPulse_t *pulses)
+{
+   int i, CB, OOL, numCB, first;
+   uint32_t played;
+   rawCbs_t *p=NULL;
+   waveStream_t *s = &waveStream;
+
+   DBG(DBG_USER, "numPulses=%u pulses=%08"PRIXPTR, numPulses,
+      (uintptr_t)pulses);
+
+   CHECK_INITED;
+
+   if (!waveStream.open)
+      SOFT_ERROR(PI_NO_WAVE_STREAM, "no wave stream open");
+
+   if ((numPulses < 1) || (numPulses > waveStream.segPulses))
+      SOFT_ERROR(PI_TOO_MANY_PULSES, "bad number of pulses (%d)", numPulses);
+
+   if (!pulses) SOFT_ERROR(PI_BAD_POINTER, "pulses can't be NULL");
+
+   /* a long delay may need several CBs on a lite DMA channel */
+
+   numCB = 2;
+
+   for (i=0; i<numPulses; i++)
+   {
+      if (pulses[i].gpioOn || pulses[i].gpioOff) numCB++;
+      numCB += waveDelayCBs(pulses[i].usDelay);
+   }
+
+   if (numCB > waveStream.segCBs)
+      SOFT_ERROR(PI_TOO_MANY_CBS, "segment needs %d CBs", numCB);
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   if (!s->open || ((s->written - waveStreamPlayed()) >= s->segs))
+   {
+      i = s->open;
+      pthread_mutex_unlock(&waveStreamMutex);
+
+      if (!i) SOFT_ERROR(PI_NO_WAVE_STREAM, "no wave stream open");
+
+      SOFT_ERROR(PI_WAVE_STREAM_FULL, "no free stream segment");
+   }
+
+   /* the oldest segment, it has been played */
+
+   CB  = s->botCB + ((s->written % s->segs) * s->segCBs);
+   OOL = s->botOOL + 1 + ((s->written % s->segs) * s->segOOLs);
+
+   first = CB;
+
+   p = waveDelayCB(p, &CB, 20);
+
+   for (i=0; i<numPulses; i++)
+   {
+      p = waveLevelCB(p, &CB, &OOL, pulses[i].gpioOn, pulses[i].gpioOff);
+      p = waveDelayCB(p, &CB, pulses[i].usDelay);
+   }
+
+   /* the last CB counts the segment as played */
+
+   waveSetOOL(OOL, s->written + 1);
+
+   p = rawWaveCBAdr(CB);
+
+   p->info   = NORMAL_DMA;
+   p->src    = waveOOLPOadr(OOL);
+   p->dst    = waveOOLPOadr(s->botOOL);
+   p->length = 4;
+   p->next   = 0;
+
+   __sync_synchronize();
+
+   /* link the previous segment's end to this one, past its lead delay */
+
+   if (s->written)
+   {
+      rawWaveCBAdr(s->tailCB)->next = waveCbPOadr(first + 1);
+
+      __sync_synchronize();
+   }
+
+   s->tailCB = CB;
+   s->written++;
+
+   /*
+   Start the output if the stream isn't running.  If it is but the
+   output has stopped the segments not played are restarted after
+   a gap, an underrun.
+   */
+
+   if (!s->running)
+   {
+      waveStreamGo(waveStreamPlayed());
+   }
+   else if (!dmaOut[DMA_CONBLK_AD])
+   {
+      played = waveStreamPlayed();
+
+      if (played != s->written)
+      {
+         s->underruns++;
+         waveStreamGo(played);
+      }
+   }
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveStreamStatus(gpioWaveStream_t *status)
+{
+   int open;
+
+   DBG(DBG_USER, "status=%08"PRIXPTR, (uintptr_t)status);
+
+   CHECK_INITED;
+
+   if (!status)
+      SOFT_ERROR(PI_BAD_POINTER, "status can't be NULL");
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   open = waveStream.open;
+
+   if (open)
+   {
+      status->segments  = waveStream.segs;
+      status->segPulses = waveStream.segPulses;
+      status->written   = waveStream.written;
+      status->played    = waveStreamPlayed();
+      status->queued    = status->written - status->played;
+      status->underruns = waveStream.underruns;
+   }
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   if (!open) SOFT_ERROR(PI_NO_WAVE_STREAM, "no wave stream open");
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveStreamClose(void)
+{
+   int open;
+
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   open = waveStream.open;
+
+   waveStreamFree();
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   if (!open) SOFT_ERROR(PI_NO_WAVE_STREAM, "no wave stream open");
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveTxStart(unsigned wave_mode)
+{
+   /* This function is deprecated and has been removed. */
+
+   CHECK_INITED;
+
+   SOFT_ERROR(PI_DEPRECATED, "deprected function removed");
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveTxSend(unsigned wave_id, unsigned wave_mode)
+{
+   rawCbs_t *p=NULL;
+
+   DBG(DBG_USER, "wave_id=%d wave_mode=%d", wave_id, wave_mode);
+
+   CHECK_INITED;
+
+   if ((wave_id >= waveOutCount) || waveInfo[wave_id].deleted)
+      SOFT_ERROR(PI_BAD_WAVE_ID, "bad wave id (%d)", wave_id);
+
+   if (wave_mode > PI_WAVE_MODE_REPEAT_SYNC)
+      SOFT_ERROR(PI_BAD_WAVE_MODE, "bad wave mode (%d)", wave_mode);
+
+   if (!waveClockInited)
+   {
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
+      PWMClockInited = 0;
+   }
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   waveStreamHalt();
+
+   if (wave_mode < PI_WAVE_MODE_ONE_SHOT_SYNC) initKillDMA(dmaOut);
+
+   p = rawWaveCBAdr(waveInfo[wave_id].topCB);
+
+   if ((wave_mode & 1) == PI_WAVE_MODE_ONE_SHOT)
+      p->next = 0;
+   else
+      p->next = waveCbPOadr(waveInfo[wave_id].botCB+1);
+
+   if (waveEndPtr && (wave_mode > PI_WAVE_MODE_REPEAT))
+   {
+      *waveEndPtr = waveCbPOadr(waveInfo[wave_id].botCB+1);
+
+      if (!dmaOut[DMA_CONBLK_AD])
+      {
+         initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
+      }
+   }
+   else
+   {
+      initDMAgo((uint32_t *)dmaOut, waveCbPOadr(waveInfo[wave_id].botCB));
+   }
+
+   waveEndPtr = &p->next;
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   /* for compatability with the deprecated gpioWaveTxStart return the
+      number of cbs
+   */
+   return (waveInfo[wave_id].topCB - waveInfo[wave_id].botCB) + 1;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+static int chainGetCB(int n)
+{
+   int block, index;
+
+   if (n < (WCB_CHAIN_CBS * PI_WAVE_COUNT_PAGES))
+   {
+      block = n / WCB_CHAIN_CBS;
+      index = n % WCB_CHAIN_CBS;
+      return (block*CBS_PER_OPAGE) + WCB_COUNTER_CBS + index;
+   }
+   return -1;
+}
+
+static void chainSetVal(int n, uint32_t val)
+{
+   int block, index;
+   uint32_t *p;
+
+   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
+   {
+      block = n / WCB_CHAIN_OOL;
+      index = n % WCB_CHAIN_OOL;
+      p = (uint32_t *) dmaOVirt[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+      p[index] = val;
+   }
+}
+
+static uint32_t chainGetValPadr(int n)
+{
+   int block, index;
+   uint32_t *p;
+
+   if (n < (WCB_CHAIN_OOL * PI_WAVE_COUNT_PAGES))
+   {
+      block = n / WCB_CHAIN_OOL;
+      index = n % WCB_CHAIN_OOL;
+      p = (uint32_t *) dmaOBus[block] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+      //cast twice to suppress warning, I belive this is ok as dmaOBus
+      //contains bus addresses not virtual addresses.
+      return (uint32_t)(uintptr_t) (p + index);
+   }
+   return 0;
+}
+
+static uint32_t chainGetCntVal(int counter, int slot)
+{
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   return p[WCB_CHAIN_OOL+ offset + slot];
+}
+
+static void chainSetCntVal(int counter, int slot, uint32_t value)
+{
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOVirt[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   p[WCB_CHAIN_OOL + offset + slot] = value;
+}
+
+static uint32_t chainGetCntValPadr(int counter, int slot)
+{
+   uint32_t *p;
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_COUNTER_OOL : 0);
+   p = (uint32_t *) dmaOBus[page] + (WCB_COUNTER_CBS+WCB_CHAIN_CBS) * 8;
+   //cast twice to suppress warning, I belive this is ok as dmaOBus
+   //contains bus addresses not virtual addresses. --plugwash
+   return (uint32_t)(uintptr_t)(p + WCB_CHAIN_OOL + offset + slot);
+}
+
+static int chainGetCntCB(int counter)
+{
+   int page, offset;
+   page = counter / 2;
+   offset = (counter % 2 ? WCB_CNT_CBS : 0);
+   return ((page * CBS_PER_OPAGE) + offset);
+}
+
+static void chainMakeCounter(
+   unsigned counter,
+   unsigned blklen,
+   unsigned blocks,
+   unsigned count,
+   uint32_t repeat,
+   uint32_t next)
+{
+   rawCbs_t *p=NULL;
+
+   int b, baseCB, dig;
+   uint32_t nxt;
+
+   int botCB;
+
+   botCB  = chainGetCntCB(counter);
+
+   baseCB = botCB;
+
+   /* set up all the OOLs */
+   for (b=0; b < (blocks*(blklen+1)); b++) chainSetCntVal(counter, b, repeat);
+
+   for (b=0; b<blocks; b++)
+      chainSetCntVal(counter,
+         ((b*(blklen+1))+blklen),
+         waveCbPOadr(baseCB+((b*3)+3)));
+
+   for (b=0; b<blocks; b++)
+   {
+      /* copy BOTTOM to NEXT */
+
+      p = rawWaveCBAdr(botCB++);
+
+      p->info = NORMAL_DMA;
+
+      p->src = chainGetCntValPadr(counter, b*(blklen+1));
+      p->dst = (waveCbPOadr(botCB+1) + 20);
+
+      p->length = 4;
+      p->next   = waveCbPOadr(botCB);
+
+      /* copy BOTTOM to TOP */
+
+      p = rawWaveCBAdr(botCB++);
+
+      p->info   = NORMAL_DMA;
+
+      p->src = chainGetCntValPadr(counter, b*(blklen+1));
+      p->dst = chainGetCntValPadr(counter, (b*(blklen+1))+blklen);
+
+      p->length = 4;
+      p->next   = waveCbPOadr(botCB);
+
+      /* shift all down one */
+
+      p = rawWaveCBAdr(botCB++);
+
+      p->info   = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+
+      p->src = chainGetCntValPadr(counter, ((b*(blklen+1))+1));
+      p->dst = chainGetCntValPadr(counter, ((b*(blklen+1))+0));
+
+      p->length = blklen*4;
+      p->next   = repeat;
+   }
+
+   /* reset the counter */
+
+   p = rawWaveCBAdr(botCB);
+
+   p->info = NORMAL_DMA|DMA_SRC_INC|DMA_DEST_INC;
+
+   p->src = chainGetCntValPadr(counter, blocks*(blklen+1));
+   p->dst = chainGetCntValPadr(counter, 0);
+
+   p->length = blocks*(blklen+1)*4;
+   p->next   = next;
+
+   b = 0;
+
+   while (count && (b<blocks))
+   {
+      dig = count % blklen;
+      count /= blklen;
+
+      if (count) nxt = chainGetCntVal(counter, (b*(blklen+1))+blklen);
+      else       nxt = waveCbPOadr(botCB);
+
+      chainSetCntVal(counter, b*(blklen+1)+dig, nxt);
+
+      b++;
+   }
+
+   /* copy all the OOLs */
+   for (b=0; b < (blocks*(blklen+1)); b++)
+      chainSetCntVal(
+         counter, b+(blocks*(blklen+1)), chainGetCntVal(counter, b));
+}
+
+
+static int waveChainTx(char *buf, unsigned bufSize)
+{
+   unsigned blklen=16, blocks=4;
+   int cb, chaincb;
+   rawCbs_t *p;
+   int i, wid, cmd, loop, counters;
+   unsigned cycles, delayCBs, dcb, delayLeft;
+   uint32_t repeat, next, *endPtr;
+   int stk_pos[10], stk_lev=0;
+
+   cb = 0;
+   loop = -1;
+
+   if (!waveClockInited)
+   {
+      stopHardwarePWM();
+      initClock(0); /* initialise secondary clock */
+      waveClockInited = 1;
+      PWMClockInited = 0;
+   }
+
+   initKillDMA(dmaOut);
+
+   waveEndPtr = NULL;
+   endPtr = NULL;
+
+   /* add delay cb at start of DMA */
+
+   p = rawWaveCBAdr(chainGetCB(cb++));
+
+   /* use the secondary clock */
+
+   if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(2);
+      p->dst  = PCM_TIMER;
+   }
+   else
+   {
+      p->info = NORMAL_DMA | TIMED_DMA(5);
+      p->dst  = PWM_TIMER;
+   }
+
+   //cast twice to suppress warning, I belive this is ok as dmaOBus
+   //contains bus addresses not virtual addresses. --plugwash
+   p->src    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+   p->length = BPD * 20 / PI_WF_MICROS; /* 20 micros delay */
+   p->next   = waveCbPOadr(chainGetCB(cb));
+
+   counters = 0;
+   wid = -1;
+
+   i = 0;
+
+   while (i<bufSize)
+   {
+      wid = (unsigned)buf[i];
+
+      if (wid == 255) /* wave command */
+      {
+         if ((i+2) > bufSize)
+            SOFT_ERROR(PI_BAD_CHAIN_CMD,
+               "incomplete chain command (at %d)", i);
+
+         cmd = buf[i+1];
+
+         if (cmd == 0) /* loop begin */
+         {
+            if (stk_lev >= (sizeof(stk_pos)/sizeof(int)))
+               SOFT_ERROR(PI_CHAIN_NESTING,
+                  "chain counters nested too deep (at %d)", i);
+
+            stk_pos[stk_lev++] = cb;
+
+            i += 2;
+         }
+         else if (cmd == 1) /* loop end */
+         {
+            if (counters >= WCB_COUNTERS)
+               SOFT_ERROR(PI_CHAIN_COUNTER,
+                  "too many chain counters (at %d)", i);
+
+            if ((i+4) > bufSize)
+               SOFT_ERROR(PI_BAD_CHAIN_CMD,
+                  "incomplete chain command (at %d)", i);
+
+            loop = 0;
+            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+
+            if ((loop < 1) || (loop == cb))
+               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
+                  "empty chain loop (at %d)", i);
+
+            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+
+            i += 4;
+
+            if (cycles > PI_MAX_WAVE_CYCLES)
+               SOFT_ERROR(PI_CHAIN_LOOP_CNT,
+                  "bad chain loop count (%d)", cycles);
+
+            if (cycles == 0)
+            {
+               /* Skip the complete loop block.  Change
+                  the next pointing to the start of the
+                  loop block to the current cb.
+               */
+               p = rawWaveCBAdr(chainGetCB(loop));
+               p->next = waveCbPOadr(chainGetCB(cb));
+            }
+            else if (cycles == 1)
+            {
+               /* Nothing to do, no need for a counter. */
+            }
+            else
+            {
+               chaincb = chainGetCB(cb++);
+               if (chaincb < 0)
+                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+               p = rawWaveCBAdr(chaincb);
+
+               repeat = waveCbPOadr(chainGetCB(loop));
+
+                /* Need to check next cb as well. */
+
+               chaincb = chainGetCB(cb);
+
+               if (chaincb < 0)
+                  SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+               next = waveCbPOadr(chainGetCB(cb));
+
+               /* dummy src and dest */
+               p->info = NORMAL_DMA;
+               //cast twice to suppress warning, I belive this is ok as dmaOBus
+               //contains bus addresses not virtual addresses. --plugwash
+               p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+               p->dst = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+               p->length = 4;
+               p->next = waveCbPOadr(chainGetCntCB(counters));
+
+               chainMakeCounter(counters, blklen, blocks,
+                            cycles-1, repeat, next);
+
+               counters++;
+            }
+         }
+         else if (cmd == 2) /* delay us */
+         {
+            if ((i+4) > bufSize)
+               SOFT_ERROR(PI_BAD_CHAIN_CMD,
+                  "incomplete chain command (at %d)", i);
+
+            cycles = ((unsigned)buf[i+3] <<  8) + (unsigned)buf[i+2];
+
+            i += 4;
+
+            if (cycles > PI_MAX_WAVE_DELAY)
+               SOFT_ERROR(PI_BAD_CHAIN_DELAY,
+                  "bad chain delay micros (%d)", cycles);
+
+            if (cycles)
+            {
+               delayLeft = cycles;
+               delayCBs = waveDelayCBs(delayLeft);
+               for (dcb=0; dcb<delayCBs; dcb++)
+               {
+                  chaincb = chainGetCB(cb++);
+
+                  if (chaincb < 0)
+                     SOFT_ERROR(
+                        PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+                  p = rawWaveCBAdr(chaincb);
+
+                  /* use the secondary clock */
+
+                  if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
+                  {
+                     p->info = NORMAL_DMA | TIMED_DMA(2);
+                     p->dst  = PCM_TIMER;
+                  }
+                  else
+                  {
+                     p->info = NORMAL_DMA | TIMED_DMA(5);
+                     p->dst  = PWM_TIMER;
+                  }
+
+                  //cast twice to suppress warning, I belive this is ok as dmaOBus
+                  //contains bus addresses not virtual addresses. --plugwash
+                  p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+
+                  p->length = BPD * delayLeft / PI_WF_MICROS;
+
+                  if ((gpioCfg.DMAsecondaryChannel >= DMA_LITE_FIRST) &&
+                      (p->length > DMA_LITE_MAX))
+                  {
+                     p->length = DMA_LITE_MAX;
+                  }
+
+                  delayLeft -= (p->length / BPD);
+
+                  p->next = waveCbPOadr(chainGetCB(cb));
+               }
+            }
+         }
+         else if (cmd == 3) /* repeat loop forever */
+         {
+            i += 2;
+
+            loop = 0;
+            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+
+            if ((loop < 1) || (loop == cb))
+               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
+                  "empty chain loop (at %d)", i);
+
+            chaincb = chainGetCB(cb++);
+            if (chaincb < 0)
+               SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+            if (i < bufSize)
+               SOFT_ERROR(PI_BAD_FOREVER,
+                  "loop forever must be last command");
+
+            p = rawWaveCBAdr(chaincb);
+
+            /* dummy src and dest */
+            p->info = NORMAL_DMA;
+            //cast twice to suppress warning, I belive this is ok as dmaOBus
+            //contains bus addresses not virtual addresses. --plugwash
+            p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+            p->dst = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+            p->length = 4;
+            p->next = waveCbPOadr(chainGetCB(loop));
+            endPtr = &p->next;
+         }
+         else
+            SOFT_ERROR(PI_BAD_CHAIN_CMD,
+               "unknown chain command (255 %d)", cmd);
+      }
+      else if ((wid >= waveOutCount) || waveInfo[wid].deleted)
+         SOFT_ERROR(PI_BAD_WAVE_ID, "undefined wave (%d)", wid);
+      else
+      {
+         chaincb = chainGetCB(cb++);
+
+         if (chaincb < 0)
+            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+         p = rawWaveCBAdr(chaincb);
+
+         chaincb = chainGetCB(cb);
+
+         if (chaincb < 0)
+            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+         chainSetVal(cb-1, waveCbPOadr(chaincb));
+
+         /* patch next of wid topCB to next cb */
+
+         p->info   = NORMAL_DMA;
+         p->src    = chainGetValPadr(cb-1); /* this next */
+         p->dst    = waveCbPOadr(waveInfo[wid].topCB) + 20; /* wid next */
+         p->length = 4;
+         p->next   = waveCbPOadr(waveInfo[wid].botCB+1);
+
+         i += 1;
+      }
+   }
+
+   chaincb = chainGetCB(cb++);
+
+   if (chaincb < 0)
+      SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+
+   p = rawWaveCBAdr(chaincb);
+
+   p->info   = NORMAL_DMA;
+
+   //cast twice to suppress warning, I belive this is ok as dmaOBus
+   //contains bus addresses not virtual addresses. --plugwash
+   p->src    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+   p->dst    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+   p->length = 4;
+   p->next = 0;
+
+   if (!endPtr) endPtr = &p->next;
+
+   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(chainGetCB(0)));
+
+   waveEndPtr = endPtr;
+
+   return 0;
+}
+
+int gpioWaveChain(char *buf, unsigned bufSize)
+{
+   int status;
+
+   DBG(DBG_USER, "bufSize=%d [%s]", bufSize, myBuf2Str(bufSize, buf));
+
+   CHECK_INITED;
+
+   /* the DMA is killed even if the chain is bad so halt any stream */
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   waveStreamHalt();
+
+   status = waveChainTx(buf, bufSize);
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   return status;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int gpioWaveTxBusy(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   if (dmaOut[DMA_CONBLK_AD])
+      return 1;
+   else
+      return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int gpioWaveTxAt(void)
+{
+   int i, cb;
+
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   cb = dmaNowAtOCB();
+
+   if (cb < 0) return -cb;
+
+   for (i=0; i<PI_MAX_WAVES; i++)
+   {
+      if ( !waveInfo[i].deleted &&
+          (cb >= waveInfo[i].botCB) &&
+          (cb <= waveInfo[i].topCB) ) return i;
+   }
+
+   return PI_WAVE_NOT_FOUND;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveTxStop(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   pthread_mutex_lock(&waveStreamMutex);
+
+   waveStreamHalt();
+
+   initKillDMA(dmaOut);
+
+   waveEndPtr = NULL;
+
+   pthread_mutex_unlock(&waveStreamMutex);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetMicros(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.micros;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetHighMicros(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.highMicros;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetMaxMicros(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.maxMicros;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetPulses(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.pulses;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetHighPulses(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.highPulses;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetMaxPulses(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.maxPulses;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetCbs(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   /* only known once the pending adds are merged */
+
+   waveMergePending();
+
+   return wfStats.cbs;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetHighCbs(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   waveMergePending();
+
+   return wfStats.highCbs;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int gpioWaveGetMaxCbs(void)
+{
+   DBG(DBG_USER, "");
+
+   CHECK_INITED;
+
+   return wfStats.maxCbs;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int read_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_INPUT);
+   return myGpioRead(w->I.SDA);
+}
+
+static void set_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_INPUT);
+}
+
+static void clear_SDA(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SDA, PI_OUTPUT);
+   myGpioWrite(w->I.SDA, 0);
+}
+
+static void clear_SCL(wfRx_t *w)
+{
+   myGpioSetMode(w->I.SCL, PI_OUTPUT);
+   myGpioWrite(w->I.SCL, 0);
+}
+
+static void I2C_delay(wfRx_t *w)
+{
+   myGpioDelay(w->I.delay);
+}
+
+static void I2C_clock_stretch(wfRx_t *w)
+{
+   uint32_t now, max_stretch=100000;
+
+   myGpioSetMode(w->I.SCL, PI_INPUT);
+   now = gpioTick();
+   while ((myGpioRead(w->I.SCL) == 0) && ((gpioTick()-now) < max_stretch));
+}
+
+static void I2CStart(wfRx_t *w)
+{
+   if (w->I.started)
+   {
+      set_SDA(w);
+      I2C_delay(w);
+      I2C_clock_stretch(w);
+      I2C_delay(w);
+   }
+
+   clear_SDA(w);
+   I2C_delay(w);
+   clear_SCL(w);
+   I2C_delay(w);
+
+   w->I.started = 1;
+}
+
+static void I2CStop(wfRx_t *w)
+{
+   clear_SDA(w);
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   I2C_delay(w);
+   set_SDA(w);
+   I2C_delay(w);
+
+   w->I.started = 0;
+}
+
+static void I2CPutBit(wfRx_t *w, int bit)
+{
+   if (bit) set_SDA(w);
+   else     clear_SDA(w);
+
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   I2C_delay(w);
+   clear_SCL(w);
+}
+
+static int I2CGetBit(wfRx_t *w)
+{
+   int bit;
+
+   set_SDA(w); /* let SDA float */
+   I2C_delay(w);
+   I2C_clock_stretch(w);
+   bit = read_SDA(w);
+   I2C_delay(w);
+   clear_SCL(w);
+
+   return bit;
+}
+
+static int I2CPutByte(wfRx_t *w, int byte)
+{
+   int bit, nack;
+
+   for(bit=0; bit<8; bit++)
+   {
+      I2CPutBit(w, byte & 0x80);
+      byte <<= 1;
+   }
+
+   nack = I2CGetBit(w);
+
+   return nack;
+}
+
+static uint8_t I2CGetByte(wfRx_t *w, int nack)
+{
+   int bit, byte=0;
+
+   for (bit=0; bit<8; bit++)
+   {
+      byte = (byte << 1) | I2CGetBit(w);
+   }
+
+   I2CPutBit(w, nack);
+
+   return byte;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud)
+{
+   DBG(DBG_USER, "SDA=%d SCL=%d baud=%d", SDA, SCL, baud);
+
+   CHECK_INITED;
+
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SDA (%d)", SDA);
+
+   if (SCL > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCL (%d)", SCL);
+
+   if ((baud < PI_BB_I2C_MIN_BAUD) || (baud > PI_BB_I2C_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_I2C_BAUD,
+         "SDA %d, bad baud rate (%d)", SDA, baud);
+
+   if (wfRx[SDA].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SDA);
+
+   if ((wfRx[SCL].mode != PI_WFRX_NONE)  || (SCL == SDA))
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SCL);
+
+   wfRx[SDA].gpio = SDA;
+   wfRx[SDA].mode = PI_WFRX_I2C_SDA;
+   wfRx[SDA].baud = baud;
+
+   wfRx[SDA].I.started = 0;
+   wfRx[SDA].I.SDA = SDA;
+   wfRx[SDA].I.SCL = SCL;
+   wfRx[SDA].I.delay = 500000 / baud;
+   wfRx[SDA].I.SDAMode = gpioGetMode(SDA);
+   wfRx[SDA].I.SCLMode = gpioGetMode(SCL);
+
+   wfRx[SCL].gpio = SCL;
+   wfRx[SCL].mode = PI_WFRX_I2C_SCL;
+
+   myGpioSetMode(SDA, PI_INPUT);
+   myGpioSetMode(SCL, PI_INPUT);
+
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int bbI2CClose(unsigned SDA)
+{
+   DBG(DBG_USER, "SDA=%d", SDA);
+
+   CHECK_INITED;
+
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
+
+   switch(wfRx[SDA].mode)
+   {
+      case PI_WFRX_I2C_SDA:
+
+         myGpioSetMode(wfRx[SDA].I.SDA, wfRx[SDA].I.SDAMode);
+         myGpioSetMode(wfRx[SDA].I.SCL, wfRx[SDA].I.SCLMode);
+
+         wfRx[wfRx[SDA].I.SDA].mode = PI_WFRX_NONE;
+         wfRx[wfRx[SDA].I.SCL].mode = PI_WFRX_NONE;
+
+         break;
+
+      default:
+
+         SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+
+         break;
+
+   }
+
+   return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int bbI2CZip(
+   unsigned SDA,
+   char *inBuf,
+   unsigned inLen,
+   char *outBuf,
+   unsigned outLen)
+{
+   int i, ack, inPos, outPos, status, bytes;
+   int addr, flags, esc, setesc;
+   wfRx_t *w;
+
+   DBG(DBG_USER, "gpio=%d inBuf=%s outBuf=%08"PRIXPTR" len=%d",
+      SDA, myBuf2Str(inLen, (char *)inBuf), (uintptr_t)outBuf, outLen);
+
+   CHECK_INITED;
+
+   if (SDA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
+
+   if (wfRx[SDA].mode != PI_WFRX_I2C_SDA)
+      SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+
+   if (!inBuf || !inLen)
+      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
+
+   if (!outBuf && outLen)
+      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
+
+   w = &wfRx[SDA];
+
+   inPos = 0;
+   outPos = 0;
+   status = 0;
+
+   addr = 0;
+   flags = 0;
+   esc = 0;
+   setesc = 0;
+
+   wfRx_lock(SDA);
+
+   while (!status && (inPos < inLen))
+   {
+      DBG(DBG_INTERNAL, "status=%d inpos=%d inlen=%d cmd=%d addr=%d flags=%x",
+         status, inPos, inLen, inBuf[inPos], addr, flags);
+
+      switch (inBuf[inPos++])
+      {
+         case PI_I2C_END:
+            status = 1;
+            break;
+
+         case PI_I2C_START:
+            I2CStart(w);
+            break;
+
+         case PI_I2C_STOP:
+            I2CStop(w);
+            break;
+
+         case PI_I2C_ADDR:
+            addr = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+            if (addr < 0) status = PI_BAD_I2C_CMD;
+            break;
+
+         case PI_I2C_FLAGS:
+            /* cheat to force two byte flags */
+            esc = 1;
+            flags = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+            if (flags < 0) status = PI_BAD_I2C_CMD;
+            break;
+
+         case PI_I2C_ESC:
+            setesc = 1;
+            break;
+
+         case PI_I2C_READ:
+
+            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+
+            if (bytes >= 0) ack = I2CPutByte(w, (addr<<1)|1);
+
+            if (bytes > 0)
+            {
+               if (!ack)
+               {
+                  if ((bytes + outPos) <= outLen)
+                  {
+                     for (i=0; i<(bytes-1); i++)
+                     {
+                        outBuf[outPos++] = I2CGetByte(w, 0);
+                     }
+                     outBuf[outPos++] = I2CGetByte(w, 1);
+                  }
+                  else status = PI_BAD_I2C_RLEN;
+               }
+               else status = PI_I2C_READ_FAILED;
+            }
+            else status = PI_BAD_I2C_CMD;
+            break;
+
+         case PI_I2C_WRITE:
+
+            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+
+            if (bytes >= 0) ack = I2CPutByte(w, addr<<1);
+
+            if (bytes > 0)
+            {
+               if (!ack)
+               {
+                  if ((bytes + inPos) <= inLen)
+                  {
+                     for (i=0; i<(bytes-1); i++)
+                     {
+                        ack = I2CPutByte(w, inBuf[inPos++]);
+                        if (ack) status = PI_I2C_WRITE_FAILED;
+                     }
+                     ack = I2CPutByte(w, inBuf[inPos++]);
+                  }
+                  else status = PI_BAD_I2C_WLEN;
+               } else status = PI_I2C_WRITE_FAILED;
+            }
+            else status = PI_BAD_I2C_CMD;
+            break;
+
+         default:
+            status = PI_BAD_I2C_CMD;
+      }
+
+      if (setesc) esc = 1; else esc = 0;
+
+      setesc = 0;
+   }
+
+   wfRx_unlock(SDA);
+
+   if (status >= 0) status = outPos;
+
+   return status;
+}
+
+/* ----------------------------------------------------------------------- */
+
+void bscInit(int mode)
+{
+   int sda, scl, mosi, miso, ce;
+
+   bscsReg[BSC_CR]=0; /* clear device */
+   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
+   bscsReg[BSC_SLV]=0; /* clear I2C slave address */
+   bscsReg[BSC_IMSC]=0xf; /* mask off all interrupts */
+   bscsReg[BSC_ICR]=0x0f; /* clear all interrupts */
+
+   if (pi_is_2711)
+   {
+      sda = BSC_SDA_2711;
+      scl = BSC_SCL_SCLK_2711;
+      mosi = BSC_MOSI_2711;
+      miso = BSC_MISO_2711;
+      ce = BSC_CE_N_2711;
+   }
+   else
+   {
+      sda = BSC_SDA;
+      scl = BSC_SCL_SCLK;
+      mosi = BSC_MOSI;
+      miso = BSC_MISO;
+      ce = BSC_CE_N;
+   }
+
+
+   if (mode > 1) /* SPI uses all GPIO */
+   {
+      gpioSetMode(scl, PI_ALT3);
+      gpioSetMode(mosi, PI_ALT3);
+      gpioSetMode(miso, PI_ALT3);
+      gpioSetMode(ce, PI_ALT3);
+   }
+   else
+   {
+      gpioSetMode(scl, PI_ALT3);
+      gpioSetMode(sda, PI_ALT3);
+   }
+}
+
+void bscTerm(int mode)
+{
+   int sda, scl, mosi, miso, ce;
+
+   bscsReg[BSC_CR] = 0; /* clear device */
+   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
+   bscsReg[BSC_SLV]=0; /* clear I2C slave address */
+
+   if (pi_is_2711)
+   {
+      sda = BSC_SDA_2711;
+      scl = BSC_SCL_SCLK_2711;
+      mosi = BSC_MOSI_2711;
+      miso = BSC_MISO_2711;
+      ce = BSC_CE_N_2711;
+   }
+   else
+   {
+      sda = BSC_SDA;
+      scl = BSC_SCL_SCLK;
+      mosi = BSC_MOSI;
+      miso = BSC_MISO;
+      ce = BSC_CE_N;
+   }
+
+
+   if (mode > 1)
+   {
+      gpioSetMode(scl, PI_INPUT);
+      gpioSetMode(mosi, PI_INPUT);
+      gpioSetMode(miso, PI_INPUT);
+      gpioSetMode(ce, PI_INPUT);
+   }
+   else
+   {
+      gpioSetMode(sda, PI_INPUT);
+      gpioSetMode(scl, PI_INPUT);
+
+   }
+}
+
+int bscXfer(bsc_xfer_t *xfer)
+{
+   static int bscMode = 0;
+
+   int copied=0;
+   int active, mode;
+
+   DBG(DBG_USER, "control=0x%X (sa=0x%X, cr=0x%X) tx=%d [%s]",
+      xfer->control,
+      ((xfer->control)>>16) & 127,
+      (xfer->control) & 0x3fff,
+      xfer->txCnt,
+      myBuf2Str(xfer->txCnt, (char *)xfer->txBuf));
+
+   CHECK_INITED;
+
+   eventAlert[PI_EVENT_BSC].ignore = 1;
+
+   if (xfer->control)
+   {
+      /*
+         bscMode (0=None, 1=I2C, 2=SPI) tracks which GPIO have been
+         set to BSC mode
+      */
+      if (xfer->control & 2) mode = 2; /* SPI */
+      else                   mode = 1; /* assume I2C */
+
+      if (mode > bscMode)
+      {
+         bscInit(mode);
+         bscMode = mode;
+      }
+   }
+   else
+   {
+      if (bscMode) bscTerm(bscMode);
+      bscMode = 0;
+      return 0; /* leave ignore set */
+   }
+
+   xfer->rxCnt = 0;
+
+   bscsReg[BSC_SLV] = ((xfer->control)>>16) & 127;
+   bscsReg[BSC_CR] = (xfer->control) & 0x3fff;
+   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
+
+   active = 1;
+
+   while (active)
+   {
+      active = 0;
+
+      while ((copied < xfer->txCnt) &&
+             (!(bscsReg[BSC_FR] & BSC_FR_TXFF)))
+      {
+         bscsReg[BSC_DR] = xfer->txBuf[copied++];
+         active = 1;
+      }
+
+      while ((xfer->rxCnt < BSC_FIFO_SIZE) &&
+             (!(bscsReg[BSC_FR] & BSC_FR_RXFE)))
+      {
+         xfer->rxBuf[xfer->rxCnt++] = bscsReg[BSC_DR];
+         active = 1;
+      }
+
+      if (!active)
+      {
+         active = bscsReg[BSC_FR] & (BSC_FR_RXBUSY | BSC_FR_TXBUSY);
+      }
+
+      if (active) myGpioSleep(0, 20);
+   }
+
+   bscFR = bscsReg[BSC_FR] & 0xffff;
+
+   eventAlert[PI_EVENT_BSC].ignore = 0;
+
+   return (copied<<16) | bscFR;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void set_CS(wfRx_t *w)
+{
+   myGpioWrite(w->S.CS, PI_SPI_FLAGS_GET_CSPOL(w->S.spiFlags));
+}
+
+static void clear_CS(wfRx_t *w)
+{
+   myGpioWrite(w->S.CS, !PI_SPI_FLAGS_GET_CSPOL(w->S.spiFlags));
+}
+
+static void set_SCLK(wfRx_t *w)
+{
+   myGpioWrite(w->S.SCLK, !PI_SPI_FLAGS_GET_CPOL(w->S.spiFlags));
+}
+
+static void clear_SCLK(wfRx_t *w)
+{
+   myGpioWrite(w->S.SCLK, PI_SPI_FLAGS_GET_CPOL(w->S.spiFlags));
+}
+
+static void SPI_delay(wfRx_t *w)
+{
+   myGpioDelay(w->S.delay);
+}
+
+static void bbSPIStart(wfRx_t *w)
+{
+   clear_SCLK(w);
+
+   SPI_delay(w);
+
+   set_CS(w);
+
+   SPI_delay(w);
+}
+
+static void bbSPIStop(wfRx_t *w)
+{
+   SPI_delay(w);
+
+   clear_CS(w);
+
+   SPI_delay(w);
+
+   clear_SCLK(w);
+}
+
+static uint8_t bbSPIXferByte(wfRx_t *w, char txByte)
+{
+   uint8_t bit, rxByte=0;
+
+   if (PI_SPI_FLAGS_GET_CPHA(w->S.spiFlags))
+   {
+      /*
+      CPHA = 1
+      write on set clock
+      read on clear clock
+      */
+
+      for (bit=0; bit<8; bit++)
+      {
+         set_SCLK(w);
+
+         if (PI_SPI_FLAGS_GET_TX_LSB(w->S.spiFlags))
+         {
+            myGpioWrite(w->S.MOSI, txByte & 0x01);
+            txByte >>= 1;
+         }
+         else
+         {
+            myGpioWrite(w->S.MOSI, txByte & 0x80);
+            txByte <<= 1;
+         }
+
+         SPI_delay(w);
+
+         clear_SCLK(w);
+
+         if (PI_SPI_FLAGS_GET_RX_LSB(w->S.spiFlags))
+         {
+            rxByte = (rxByte >> 1) | myGpioRead(w->S.MISO) << 7;
+         }
+         else
+         {
+            rxByte = (rxByte << 1) | myGpioRead(w->S.MISO);
+         }
+
+         SPI_delay(w);
+      }
+   }
+   else
+   {
+      /*
+      CPHA = 0
+      read on set clock
+      write on clear clock
+      */
+
+      for (bit=0; bit<8; bit++)
+      {
+         if (PI_SPI_FLAGS_GET_TX_LSB(w->S.spiFlags))
+         {
+            myGpioWrite(w->S.MOSI, txByte & 0x01);
+            txByte >>= 1;
+         }
+         else
+         {
+            myGpioWrite(w->S.MOSI, txByte & 0x80);
+            txByte <<= 1;
+         }
+
+         SPI_delay(w);
+
+         set_SCLK(w);
+
+         if (PI_SPI_FLAGS_GET_RX_LSB(w->S.spiFlags))
+         {
+            rxByte = (rxByte >> 1) | myGpioRead(w->S.MISO) << 7;
+         }
+         else
+         {
+            rxByte = (rxByte << 1) | myGpioRead(w->S.MISO);
+         }
+
+         SPI_delay(w);
+
+         clear_SCLK(w);
+      }
+   }
+
+   return rxByte;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int bbSPIOpen(
+   unsigned CS, unsigned MISO, unsigned MOSI, unsigned SCLK,
+   unsigned baud, unsigned spiFlags)
+{
+   int valid;
+   uint32_t bits;
+
+   DBG(DBG_USER, "CS=%d MISO=%d MOSI=%d SCLK=%d baud=%d flags=%d",
+      CS, MISO, MOSI, SCLK, baud, spiFlags);
+
+   CHECK_INITED;
+
+   if (CS > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad CS (%d)", CS);
+
+   if (MISO > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad MISO (%d)", MISO);
+
+   if (MOSI > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad MOSI (%d)", MOSI);
+
+   if (SCLK > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCLK (%d)", SCLK);
+
+   if ((baud < PI_BB_SPI_MIN_BAUD) || (baud > PI_BB_SPI_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_SPI_BAUD, "CS %d, bad baud (%d)", CS, baud);
+
+   if (wfRx[CS].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE,
+         "CS %d is already being used, mode %d", CS, wfRx[CS].mode);
+
+   valid = 0;
+
+   /* check all GPIO unique */
+
+   bits = (1<<CS) | (1<<MISO) | (1<<MOSI) | (1<<SCLK);
+
+   if (__builtin_popcount(bits) == 4)
+   {
+      if ((wfRx[MISO].mode == PI_WFRX_NONE) &&
+          (wfRx[MOSI].mode == PI_WFRX_NONE) &&
+          (wfRx[SCLK].mode == PI_WFRX_NONE))
+      {
+         valid = 1; /* first time GPIO used for SPI */
+      }
+      else
+      {
+         if ((wfRx[MISO].mode == PI_WFRX_SPI_MISO) &&
+             (wfRx[MOSI].mode == PI_WFRX_SPI_MOSI) &&
+             (wfRx[SCLK].mode == PI_WFRX_SPI_SCLK))
+         {
+            valid = 2; /* new CS for existing SPI GPIO */
+         }
+      }
+   }
+
+   if (!valid)
+   {
+      SOFT_ERROR(PI_GPIO_IN_USE,
+         "GPIO already being used (%d=%d %d=%d, %d=%d %d=%d)",
+          CS,   wfRx[CS].mode,
+          MISO, wfRx[MISO].mode,
+          MOSI, wfRx[MOSI].mode,
+          SCLK, wfRx[SCLK].mode);
+   }
+
+   wfRx[CS].mode = PI_WFRX_SPI_CS;
+   wfRx[CS].baud = baud;
+
+   wfRx[CS].S.CS = CS;
+   wfRx[CS].S.SCLK = SCLK;
+
+   wfRx[CS].S.CSMode = gpioGetMode(CS);
+   wfRx[CS].S.delay = (500000 / baud) - 1;
+   wfRx[CS].S.spiFlags = spiFlags;
+
+   /* preset CS to off */
+
+   if (PI_SPI_FLAGS_GET_CSPOL(spiFlags))
+      gpioWrite(CS, 0); /* active high */
+   else
+      gpioWrite(CS, 1); /* active low */
+
+   /* The SCLK entry is used to store full information */
+
+   if (valid == 1) /* first time GPIO for SPI */
+   {
+      wfRx[SCLK].S.usage = 1;
+
+      wfRx[SCLK].S.SCLKMode = gpioGetMode(SCLK);
+      wfRx[SCLK].S.MISOMode = gpioGetMode(MISO);
+      wfRx[SCLK].S.MOSIMode = gpioGetMode(MOSI);
+
+      wfRx[SCLK].mode = PI_WFRX_SPI_SCLK;
+      wfRx[MISO].mode = PI_WFRX_SPI_MISO;
+      wfRx[MOSI].mode = PI_WFRX_SPI_MOSI;
+
+      wfRx[SCLK].S.SCLK = SCLK;
+      wfRx[SCLK].S.MISO = MISO;
+      wfRx[SCLK].S.MOSI = MOSI;
+
+      myGpioSetMode(MISO, PI_INPUT);
+      myGpioSetMode(SCLK, PI_OUTPUT);
+      gpioWrite(MOSI, 0); /* low output */
+   }
+   else
+   {
+      wfRx[SCLK].S.usage++;
+   }
+
+   return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+
+int bbSPIClose(unsigned CS)
+{
+   int SCLK;
 
-                  /* use the secondary clock */
+   DBG(DBG_USER, "CS=%d", CS);
 
-                  if (gpioCfg.clockPeriph != PI_CLOCK_PCM)
-                  {
-                     p->info = NORMAL_DMA | TIMED_DMA(2);
-                     p->dst  = PCM_TIMER;
-                  }
-                  else
-                  {
-                     p->info = NORMAL_DMA | TIMED_DMA(5);
-                     p->dst  = PWM_TIMER;
-                  }
+   CHECK_INITED;
 
-                  //cast twice to suppress warning, I belive this is ok as dmaOBus
-                  //contains bus addresses not virtual addresses. --plugwash
-                  p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
+   if (CS > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", CS);
 
-                  p->length = BPD * delayLeft / PI_WF_MICROS;
+   switch(wfRx[CS].mode)
+   {
+      case PI_WFRX_SPI_CS:
 
-                  if ((gpioCfg.DMAsecondaryChannel >= DMA_LITE_FIRST) &&
-                      (p->length > DMA_LITE_MAX))
-                  {
-                     p->length = DMA_LITE_MAX;
-                  }
+         myGpioSetMode(wfRx[CS].S.CS, wfRx[CS].S.CSMode);
+         wfRx[CS].mode = PI_WFRX_NONE;
 
-                  delayLeft -= (p->length / BPD);
+         SCLK = wfRx[CS].S.SCLK;
 
-                  p->next = waveCbPOadr(chainGetCB(cb));
-               }
-            }
-         }
-         else if (cmd == 3) /* repeat loop forever */
+         if (--wfRx[SCLK].S.usage <= 0)
          {
-            i += 2;
+            myGpioSetMode(wfRx[SCLK].S.MISO, wfRx[SCLK].S.MISOMode);
+            myGpioSetMode(wfRx[SCLK].S.MOSI, wfRx[SCLK].S.MOSIMode);
+            myGpioSetMode(wfRx[SCLK].S.SCLK, wfRx[SCLK].S.SCLKMode);
 
-            loop = 0;
-            if (--stk_lev >= 0) loop = stk_pos[stk_lev];
+            wfRx[wfRx[SCLK].S.MISO].mode = PI_WFRX_NONE;
+            wfRx[wfRx[SCLK].S.MOSI].mode = PI_WFRX_NONE;
+            wfRx[wfRx[SCLK].S.SCLK].mode = PI_WFRX_NONE;
+         }
 
-            if ((loop < 1) || (loop == cb))
-               SOFT_ERROR(PI_BAD_CHAIN_LOOP,
-                  "empty chain loop (at %d)", i);
+         break;
 
-            chaincb = chainGetCB(cb++);
-            if (chaincb < 0)
-               SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+      default:
 
-            if (i < bufSize)
-               SOFT_ERROR(PI_BAD_FOREVER,
-                  "loop forever must be last command");
+         SOFT_ERROR(PI_NOT_SPI_GPIO, "no SPI on gpio (%d)", CS);
 
-            p = rawWaveCBAdr(chaincb);
+         break;
 
-            /* dummy src and dest */
-            p->info = NORMAL_DMA;
-            //cast twice to suppress warning, I belive this is ok as dmaOBus
-            //contains bus addresses not virtual addresses. --plugwash
-            p->src = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-            p->dst = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-            p->length = 4;
-            p->next = waveCbPOadr(chainGetCB(loop));
-            endPtr = &p->next;
-         }
-         else
-            SOFT_ERROR(PI_BAD_CHAIN_CMD,
-               "unknown chain command (255 %d)", cmd);
-      }
-      else if ((wid >= waveOutCount) || waveInfo[wid].deleted)
-         SOFT_ERROR(PI_BAD_WAVE_ID, "undefined wave (%d)", wid);
-      else
-      {
-         chaincb = chainGetCB(cb++);
+   }
 
-         if (chaincb < 0)
-            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   return 0;
+}
 
-         p = rawWaveCBAdr(chaincb);
+/*-------------------------------------------------------------------------*/
 
-         chaincb = chainGetCB(cb);
+int bbSPIXfer(
+   unsigned CS,
+   char *inBuf,
+   char *outBuf,
+   unsigned count)
+{
+   int SCLK;
+   int pos;
+   wfRx_t *w;
 
-         if (chaincb < 0)
-            SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   DBG(DBG_USER, "CS=%d inBuf=%s outBuf=%08"PRIXPTR" count=%d",
+      CS, myBuf2Str(count, (char *)inBuf), (uintptr_t)outBuf, count);
 
-         chainSetVal(cb-1, waveCbPOadr(chaincb));
+   CHECK_INITED;
 
-         /* patch next of wid topCB to next cb */
+   if (CS > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", CS);
 
-         p->info   = NORMAL_DMA;
-         p->src    = chainGetValPadr(cb-1); /* this next */
-         p->dst    = waveCbPOadr(waveInfo[wid].topCB) + 20; /* wid next */
-         p->length = 4;
-         p->next   = waveCbPOadr(waveInfo[wid].botCB+1);
+   if (wfRx[CS].mode != PI_WFRX_SPI_CS)
+      SOFT_ERROR(PI_NOT_SPI_GPIO, "no SPI on gpio (%d)", CS);
 
-         i += 1;
-      }
-   }
+   if (!inBuf || !count)
+      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
 
-   chaincb = chainGetCB(cb++);
+   if (!outBuf && count)
+      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
 
-   if (chaincb < 0)
-      SOFT_ERROR(PI_CHAIN_TOO_BIG, "chain is too long (%d)", cb);
+   SCLK = wfRx[CS].S.SCLK;
 
-   p = rawWaveCBAdr(chaincb);
+   wfRx[SCLK].S.CS = CS;
+   wfRx[SCLK].baud = wfRx[CS].baud;
+   wfRx[SCLK].S.delay = wfRx[CS].S.delay;
+   wfRx[SCLK].S.spiFlags = wfRx[CS].S.spiFlags;
 
-   p->info   = NORMAL_DMA;
+   w = &wfRx[SCLK];
 
-   //cast twice to suppress warning, I belive this is ok as dmaOBus
-   //contains bus addresses not virtual addresses. --plugwash
-   p->src    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-   p->dst    = (uint32_t)(uintptr_t) (&dmaOBus[0]->periphData);
-   p->length = 4;
-   p->next = 0;
+   wfRx_lock(SCLK);
 
-   if (!endPtr) endPtr = &p->next;
+   bbSPIStart(w);
+     
+   for (pos=0; pos < count; pos++)
+   {
+      outBuf[pos] = bbSPIXferByte(w, inBuf[pos]);
+   }
 
-   initDMAgo((uint32_t *)dmaOut, waveCbPOadr(chainGetCB(0)));
+   bbSPIStop(w);
 
-   waveEndPtr = endPtr;
+   wfRx_unlock(SCLK);
 
-   return 0;
+   return count;
 }
 
 /*-------------------------------------------------------------------------*/
 
-int gpioWaveTxBusy(void)
+int gpioSerialReadOpen(unsigned gpio, unsigned baud, unsigned data_bits)
 {
-   DBG(DBG_USER, "");
+   int bitTime;
 
-   CHECK_INITED;
+   DBG(DBG_USER, "gpio=%d baud=%d data_bits=%d", gpio, baud, data_bits);
 
-   if (dmaOut[DMA_CONBLK_AD])
-      return 1;
-   else
-      return 0;
-}
+   CHECK_INITED;
 
-/*-------------------------------------------------------------------------*/
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-int gpioWaveTxAt(void)
-{
-   int i, cb;
+   if ((baud < PI_BB_SER_MIN_BAUD) || (baud > PI_BB_SER_MAX_BAUD))
+      SOFT_ERROR(PI_BAD_WAVE_BAUD,
+         "gpio %d, bad baud rate (%d)", gpio, baud);
 
-   DBG(DBG_USER, "");
+   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
+       (data_bits > PI_MAX_WAVE_DATABITS))
+      SOFT_ERROR(PI_BAD_DATABITS,
+         "gpio %d, bad data bits (%d)", gpio, data_bits);
 
-   CHECK_INITED;
+   if (wfRx[gpio].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpio);
 
-   cb = dmaNowAtOCB();
+   bitTime = (1000 * MILLION) / baud; /* nanos */
 
-   if (cb < 0) return -cb;
+   pthread_mutex_lock(&serialMutex);
 
-   for (i=0; i<PI_MAX_WAVES; i++)
-   {
-      if ( !waveInfo[i].deleted &&
-          (cb >= waveInfo[i].botCB) &&
-          (cb <= waveInfo[i].topCB) ) return i;
-   }
+   wfRx[gpio].gpio = gpio;
+   wfRx[gpio].mode = PI_WFRX_SERIAL;
+   wfRx[gpio].baud = baud;
 
-   return PI_WAVE_NOT_FOUND;
-}
+   wfRx[gpio].s.buf      = malloc(SRX_BUF_SIZE);
+   wfRx[gpio].s.bufSize  = SRX_BUF_SIZE;
+   wfRx[gpio].s.fullBit  = bitTime;         /* nanos */
+   wfRx[gpio].s.halfBit  = (bitTime/2)+500; /* nanos (500 for rounding) */
+   wfRx[gpio].s.readPos  = 0;
+   wfRx[gpio].s.writePos = 0;
+   wfRx[gpio].s.bit      = -1;
+   wfRx[gpio].s.dataBits = data_bits;
+   wfRx[gpio].s.invert   = PI_BB_SER_NORMAL;
+   wfRx[gpio].s.errors   = 0;
 
-/* ----------------------------------------------------------------------- */
+   if      (data_bits <  9) wfRx[gpio].s.bytes = 1;
+   else if (data_bits < 17) wfRx[gpio].s.bytes = 2;
+   else                  wfRx[gpio].s.bytes = 4;
 
-int gpioWaveTxStop(void)
-{
-   DBG(DBG_USER, "");
+   serialLevel = (serialLevel & ~(1<<gpio)) |
+                 (gpioRead_Bits_0_31() & (1<<gpio));
 
-   CHECK_INITED;
+   serialBits |= (1<<gpio);
 
-   initKillDMA(dmaOut);
+   alertUpdateMonitorBits();
 
-   waveEndPtr = NULL;
+   pthread_mutex_unlock(&serialMutex);
 
    return 0;
 }
 
-/* ----------------------------------------------------------------------- */
+/*-------------------------------------------------------------------------*/
 
-int gpioWaveGetMicros(void)
+int gpioSerialReadInvert(unsigned gpio, unsigned invert)
 {
-   DBG(DBG_USER, "");
+   DBG(DBG_USER, "gpio=%d invert=%d", gpio, invert);
 
    CHECK_INITED;
 
-   return wfStats.micros;
-}
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-/* ----------------------------------------------------------------------- */
+   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
+      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
 
-int gpioWaveGetHighMicros(void)
-{
-   DBG(DBG_USER, "");
+   if ((invert < PI_BB_SER_NORMAL) ||
+       (invert > PI_BB_SER_INVERT))
+      SOFT_ERROR(PI_BAD_SER_INVERT,
+         "bad invert level for gpio %d (%d)", gpio, invert);
 
-   CHECK_INITED;
+   pthread_mutex_lock(&serialMutex);
 
-   return wfStats.highMicros;
+   wfRx[gpio].s.invert = invert;
+   wfRx[gpio].s.bit    = -1;
+
+   pthread_mutex_unlock(&serialMutex);
+
+   return 0;
 }
 
-/* ----------------------------------------------------------------------- */
+/*-------------------------------------------------------------------------*/
 
-int gpioWaveGetMaxMicros(void)
+int gpioSerialRead(unsigned gpio, void *buf, size_t bufSize)
 {
-   DBG(DBG_USER, "");
+   unsigned bytes=0, wpos;
+   volatile wfRx_t *w;
+
+   DBG(DBG_USER, "gpio=%d buf=%08"PRIXPTR" bufSize=%zd", gpio, (uintptr_t)buf, bufSize);
+
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (bufSize == 0)
+      SOFT_ERROR(PI_BAD_SERIAL_COUNT, "buffer size can't be zero");
 
-   CHECK_INITED;
+   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
+      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
 
-   return wfStats.maxMicros;
-}
+   w = &wfRx[gpio];
 
-/* ----------------------------------------------------------------------- */
+   if (w->s.readPos != w->s.writePos)
+   {
+      wpos = w->s.writePos;
 
-int gpioWaveGetPulses(void)
-{
-   DBG(DBG_USER, "");
+      if (wpos > w->s.readPos) bytes = wpos - w->s.readPos;
+      else                     bytes = w->s.bufSize - w->s.readPos;
 
-   CHECK_INITED;
+      if (bytes > bufSize) bytes = bufSize;
 
-   return wfStats.pulses;
-}
+      /* copy in multiples of the data size in bytes */
 
-/* ----------------------------------------------------------------------- */
+      bytes = (bytes / w->s.bytes) * w->s.bytes;
 
-int gpioWaveGetHighPulses(void)
-{
-   DBG(DBG_USER, "");
+      if (buf) memcpy(buf, w->s.buf+w->s.readPos, bytes);
 
-   CHECK_INITED;
+      w->s.readPos += bytes;
 
-   return wfStats.highPulses;
+      if (w->s.readPos >= w->s.bufSize) w->s.readPos = 0;
+   }
+   return bytes;
 }
 
-/* ----------------------------------------------------------------------- */
 
-int gpioWaveGetMaxPulses(void)
+/*-------------------------------------------------------------------------*/
+
+int gpioSerialReadErrors(unsigned gpio)
 {
-   DBG(DBG_USER, "");
+   DBG(DBG_USER, "gpio=%d", gpio);
 
    CHECK_INITED;
 
-   return wfStats.maxPulses;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
+      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+
+   return wfRx[gpio].s.errors & 0x7FFFFFFF;
 }
 
-/* ----------------------------------------------------------------------- */
 
-int gpioWaveGetCbs(void)
+/*-------------------------------------------------------------------------*/
+
+int gpioSerialReadClose(unsigned gpio)
 {
-   DBG(DBG_USER, "");
+   DBG(DBG_USER, "gpio=%d", gpio);
 
    CHECK_INITED;
 
-   return wfStats.cbs;
-}
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-/* ----------------------------------------------------------------------- */
+   switch(wfRx[gpio].mode)
+   {
+      case PI_WFRX_NONE:
 
-int gpioWaveGetHighCbs(void)
-{
-   DBG(DBG_USER, "");
+         SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
 
-   CHECK_INITED;
+         break;
 
-   return wfStats.highCbs;
-}
+      case PI_WFRX_SERIAL:
 
-/* ----------------------------------------------------------------------- */
+         pthread_mutex_lock(&serialMutex);
 
-int gpioWaveGetMaxCbs(void)
-{
-   DBG(DBG_USER, "");
+         serialBits &= ~(1<<gpio);
 
-   CHECK_INITED;
+         alertUpdateMonitorBits();
 
-   return wfStats.maxCbs;
-}
+         free(wfRx[gpio].s.buf);
 
-/* ----------------------------------------------------------------------- */
+         wfRx[gpio].mode = PI_WFRX_NONE;
 
-static int read_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_INPUT);
-   return myGpioRead(w->I.SDA);
-}
+         pthread_mutex_unlock(&serialMutex);
 
-static void set_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_INPUT);
-}
+         break;
+   }
 
-static void clear_SDA(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SDA, PI_OUTPUT);
-   myGpioWrite(w->I.SDA, 0);
+   return 0;
 }
 
-static void clear_SCL(wfRx_t *w)
-{
-   myGpioSetMode(w->I.SCL, PI_OUTPUT);
-   myGpioWrite(w->I.SCL, 0);
-}
+/*-------------------------------------------------------------------------*/
 
-static void I2C_delay(wfRx_t *w)
+static void intDecodeOpen(unsigned gpio, unsigned mode, unsigned protocol)
 {
-   myGpioDelay(w->I.delay);
-}
+   wfRx[gpio].gpio = gpio;
+   wfRx[gpio].baud = 0;
 
-static void I2C_clock_stretch(wfRx_t *w)
-{
-   uint32_t now, max_stretch=100000;
+   wfRx[gpio].D.buf       = calloc(DRX_BUF_FRAMES, sizeof(gpioFrame_t));
+   wfRx[gpio].D.bufSize   = DRX_BUF_FRAMES;
+   wfRx[gpio].D.readPos   = 0;
+   wfRx[gpio].D.writePos  = 0;
+   wfRx[gpio].D.protocol  = protocol;
+   wfRx[gpio].D.state     = DRX_IDLE;
+   wfRx[gpio].D.bits      = 0;
+   wfRx[gpio].D.edgeTick  = systReg[SYST_CLO];
+   wfRx[gpio].D.lastValid = 0;
 
-   myGpioSetMode(w->I.SCL, PI_INPUT);
-   now = gpioTick();
-   while ((myGpioRead(w->I.SCL) == 0) && ((gpioTick()-now) < max_stretch));
+   wfRx[gpio].mode = mode;
 }
 
-static void I2CStart(wfRx_t *w)
+/*-------------------------------------------------------------------------*/
+
+int gpioWiegandReadOpen(unsigned gpioD0, unsigned gpioD1)
 {
-   if (w->I.started)
-   {
-      set_SDA(w);
-      I2C_delay(w);
-      I2C_clock_stretch(w);
-      I2C_delay(w);
-   }
+   DBG(DBG_USER, "gpioD0=%d gpioD1=%d", gpioD0, gpioD1);
 
-   clear_SDA(w);
-   I2C_delay(w);
-   clear_SCL(w);
-   I2C_delay(w);
+   CHECK_INITED;
 
-   w->I.started = 1;
-}
+   if (gpioD0 > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad D0 (%d)", gpioD0);
 
-static void I2CStop(wfRx_t *w)
-{
-   clear_SDA(w);
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   I2C_delay(w);
-   set_SDA(w);
-   I2C_delay(w);
+   if (gpioD1 > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad D1 (%d)", gpioD1);
 
-   w->I.started = 0;
-}
+   if (wfRx[gpioD0].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpioD0);
 
-static void I2CPutBit(wfRx_t *w, int bit)
-{
-   if (bit) set_SDA(w);
-   else     clear_SDA(w);
+   if ((wfRx[gpioD1].mode != PI_WFRX_NONE) || (gpioD1 == gpioD0))
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpioD1);
 
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   I2C_delay(w);
-   clear_SCL(w);
-}
+   intDecodeOpen(gpioD0, PI_WFRX_WIEGAND_D0, PI_DECODE_WIEGAND);
+   wfRx[gpioD0].D.other = gpioD1;
 
-static int I2CGetBit(wfRx_t *w)
-{
-   int bit;
+   /* D1 only forwards its bits to the D0 decoder */
 
-   set_SDA(w); /* let SDA float */
-   I2C_delay(w);
-   I2C_clock_stretch(w);
-   bit = read_SDA(w);
-   I2C_delay(w);
-   clear_SCL(w);
+   wfRx[gpioD1].gpio    = gpioD1;
+   wfRx[gpioD1].D.other = gpioD0;
+   wfRx[gpioD1].mode    = PI_WFRX_WIEGAND_D1;
 
-   return bit;
+   gpioSetAlertFunc(gpioD0, waveRxBit);
+   gpioSetAlertFunc(gpioD1, waveRxBit);
+
+   return 0;
 }
 
-static int I2CPutByte(wfRx_t *w, int byte)
+/*-------------------------------------------------------------------------*/
+
+int gpioIRReadOpen(unsigned user_gpio, unsigned protocol)
 {
-   int bit, nack;
+   DBG(DBG_USER, "gpio=%d protocol=%d", user_gpio, protocol);
 
-   for(bit=0; bit<8; bit++)
-   {
-      I2CPutBit(w, byte & 0x80);
-      byte <<= 1;
-   }
+   CHECK_INITED;
 
-   nack = I2CGetBit(w);
+   if (user_gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", user_gpio);
 
-   return nack;
-}
+   if ((protocol != PI_DECODE_NEC) && (protocol != PI_DECODE_RC5))
+      SOFT_ERROR(PI_BAD_IR_PROTOCOL,
+         "gpio %d, bad protocol (%d)", user_gpio, protocol);
 
-static uint8_t I2CGetByte(wfRx_t *w, int nack)
-{
-   int bit, byte=0;
+   if (wfRx[user_gpio].mode != PI_WFRX_NONE)
+      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", user_gpio);
 
-   for (bit=0; bit<8; bit++)
-   {
-      byte = (byte << 1) | I2CGetBit(w);
-   }
+   intDecodeOpen(user_gpio, PI_WFRX_IR, protocol);
 
-   I2CPutBit(w, nack);
+   gpioSetAlertFunc(user_gpio, waveRxBit);
 
-   return byte;
+   return 0;
 }
 
 /*-------------------------------------------------------------------------*/
 
-int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud)
+int gpioI2CSniffOpen(unsigned SDA, unsigned SCL)
 {
-   DBG(DBG_USER, "SDA=%d SCL=%d baud=%d", SDA, SCL, baud);
+   uint32_t level;
+
+   DBG(DBG_USER, "SDA=%d SCL=%d", SDA, SCL);
 
    CHECK_INITED;
 
@@ -10712,940 +14639,866 @@ int bbI2COpen(unsigned SDA, unsigned SCL, unsigned baud)
    if (SCL > PI_MAX_USER_GPIO)
       SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCL (%d)", SCL);
 
-   if ((baud < PI_BB_I2C_MIN_BAUD) || (baud > PI_BB_I2C_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_I2C_BAUD,
-         "SDA %d, bad baud rate (%d)", SDA, baud);
-
    if (wfRx[SDA].mode != PI_WFRX_NONE)
       SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SDA);
 
-   if ((wfRx[SCL].mode != PI_WFRX_NONE)  || (SCL == SDA))
+   if ((wfRx[SCL].mode != PI_WFRX_NONE) || (SCL == SDA))
       SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", SCL);
 
-   wfRx[SDA].gpio = SDA;
-   wfRx[SDA].mode = PI_WFRX_I2C_SDA;
-   wfRx[SDA].baud = baud;
+   pthread_mutex_lock(&sniffMutex);
 
-   wfRx[SDA].I.started = 0;
-   wfRx[SDA].I.SDA = SDA;
-   wfRx[SDA].I.SCL = SCL;
-   wfRx[SDA].I.delay = 500000 / baud;
-   wfRx[SDA].I.SDAMode = gpioGetMode(SDA);
-   wfRx[SDA].I.SCLMode = gpioGetMode(SCL);
+   intDecodeOpen(SDA, PI_WFRX_I2C_SNIFF_SDA, PI_DECODE_I2C);
 
-   wfRx[SCL].gpio = SCL;
-   wfRx[SCL].mode = PI_WFRX_I2C_SCL;
+   level = gpioRead_Bits_0_31();
 
-   myGpioSetMode(SDA, PI_INPUT);
-   myGpioSetMode(SCL, PI_INPUT);
+   wfRx[SDA].D.other  = SCL;
+   wfRx[SDA].D.levels = (((level >> SCL) & 1) << 1) | ((level >> SDA) & 1);
+
+   wfRx[SCL].gpio    = SCL;
+   wfRx[SCL].D.other = SDA;
+   wfRx[SCL].mode    = PI_WFRX_I2C_SNIFF_SCL;
+
+   sniffBits |= (1<<SDA) | (1<<SCL);
+
+   alertUpdateMonitorBits();
+
+   pthread_mutex_unlock(&sniffMutex);
 
    return 0;
 }
 
-/* ----------------------------------------------------------------------- */
+/*-------------------------------------------------------------------------*/
 
-int bbI2CClose(unsigned SDA)
+int gpioDecodeRead(unsigned user_gpio, gpioFrame_t *frames, unsigned maxFrames)
 {
-   DBG(DBG_USER, "SDA=%d", SDA);
+   unsigned count=0, wpos;
+   volatile wfRx_t *w;
+
+   DBG(DBG_USER, "gpio=%d frames=%08"PRIXPTR" maxFrames=%d",
+      user_gpio, (uintptr_t)frames, maxFrames);
 
    CHECK_INITED;
 
-   if (SDA > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
+   if (user_gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", user_gpio);
 
-   switch(wfRx[SDA].mode)
-   {
-      case PI_WFRX_I2C_SDA:
+   if ((wfRx[user_gpio].mode != PI_WFRX_WIEGAND_D0) &&
+       (wfRx[user_gpio].mode != PI_WFRX_IR) &&
+       (wfRx[user_gpio].mode != PI_WFRX_I2C_SNIFF_SDA))
+      SOFT_ERROR(PI_NOT_DECODE_GPIO, "no decoder on gpio (%d)", user_gpio);
 
-         myGpioSetMode(wfRx[SDA].I.SDA, wfRx[SDA].I.SDAMode);
-         myGpioSetMode(wfRx[SDA].I.SCL, wfRx[SDA].I.SCLMode);
+   w = &wfRx[user_gpio];
 
-         wfRx[wfRx[SDA].I.SDA].mode = PI_WFRX_NONE;
-         wfRx[wfRx[SDA].I.SCL].mode = PI_WFRX_NONE;
+   if (w->D.readPos != w->D.writePos)
+   {
+      wpos = w->D.writePos;
 
-         break;
+      if (wpos > w->D.readPos) count = wpos - w->D.readPos;
+      else                     count = w->D.bufSize - w->D.readPos;
 
-      default:
+      if (count > maxFrames) count = maxFrames;
 
-         SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+      if (frames)
+         memcpy(frames, w->D.buf+w->D.readPos, count*sizeof(gpioFrame_t));
 
-         break;
+      w->D.readPos += count;
 
+      if (w->D.readPos >= w->D.bufSize) w->D.readPos = 0;
    }
-
-   return 0;
+   return count;
 }
 
 /*-------------------------------------------------------------------------*/
 
-int bbI2CZip(
-   unsigned SDA,
-   char *inBuf,
-   unsigned inLen,
-   char *outBuf,
-   unsigned outLen)
+int gpioDecodeReadClose(unsigned user_gpio)
 {
-   int i, ack, inPos, outPos, status, bytes;
-   int addr, flags, esc, setesc;
-   wfRx_t *w;
+   int other;
 
-   DBG(DBG_USER, "gpio=%d inBuf=%s outBuf=%08"PRIXPTR" len=%d",
-      SDA, myBuf2Str(inLen, (char *)inBuf), (uintptr_t)outBuf, outLen);
+   DBG(DBG_USER, "gpio=%d", user_gpio);
 
    CHECK_INITED;
 
-   if (SDA > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", SDA);
+   if (user_gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", user_gpio);
 
-   if (wfRx[SDA].mode != PI_WFRX_I2C_SDA)
-      SOFT_ERROR(PI_NOT_I2C_GPIO, "no I2C on gpio (%d)", SDA);
+   switch(wfRx[user_gpio].mode)
+   {
+      case PI_WFRX_I2C_SNIFF_SDA:
+
+         other = wfRx[user_gpio].D.other;
+
+         pthread_mutex_lock(&sniffMutex);
+
+         sniffBits &= ~((1<<user_gpio) | (1<<other));
+
+         alertUpdateMonitorBits();
+
+         free(wfRx[user_gpio].D.buf);
+
+         wfRx[other].mode = PI_WFRX_NONE;
+         wfRx[user_gpio].mode = PI_WFRX_NONE;
+
+         pthread_mutex_unlock(&sniffMutex);
+
+         break;
 
-   if (!inBuf || !inLen)
-      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
+      case PI_WFRX_WIEGAND_D0:
 
-   if (!outBuf && outLen)
-      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
+         other = wfRx[user_gpio].D.other;
 
-   w = &wfRx[SDA];
+         gpioSetAlertFunc(other, NULL);
 
-   inPos = 0;
-   outPos = 0;
-   status = 0;
+         wfRx[other].mode = PI_WFRX_NONE;
 
-   addr = 0;
-   flags = 0;
-   esc = 0;
-   setesc = 0;
+         /* fall through */
 
-   wfRx_lock(SDA);
+      case PI_WFRX_IR:
 
-   while (!status && (inPos < inLen))
-   {
-      DBG(DBG_INTERNAL, "status=%d inpos=%d inlen=%d cmd=%d addr=%d flags=%x",
-         status, inPos, inLen, inBuf[inPos], addr, flags);
+         gpioSetWatchdog(user_gpio, 0); /* switch off timeouts */
 
-      switch (inBuf[inPos++])
-      {
-         case PI_I2C_END:
-            status = 1;
-            break;
+         gpioSetAlertFunc(user_gpio, NULL); /* cancel alert */
 
-         case PI_I2C_START:
-            I2CStart(w);
-            break;
+         free(wfRx[user_gpio].D.buf);
 
-         case PI_I2C_STOP:
-            I2CStop(w);
-            break;
+         wfRx[user_gpio].mode = PI_WFRX_NONE;
 
-         case PI_I2C_ADDR:
-            addr = myI2CGetPar(inBuf, &inPos, inLen, &esc);
-            if (addr < 0) status = PI_BAD_I2C_CMD;
-            break;
+         break;
 
-         case PI_I2C_FLAGS:
-            /* cheat to force two byte flags */
-            esc = 1;
-            flags = myI2CGetPar(inBuf, &inPos, inLen, &esc);
-            if (flags < 0) status = PI_BAD_I2C_CMD;
-            break;
+      default:
 
-         case PI_I2C_ESC:
-            setesc = 1;
-            break;
+         SOFT_ERROR(PI_NOT_DECODE_GPIO, "no decoder on gpio (%d)", user_gpio);
+   }
 
-         case PI_I2C_READ:
+   return 0;
+}
 
-            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
 
-            if (bytes >= 0) ack = I2CPutByte(w, (addr<<1)|1);
+/* ----------------------------------------------------------------------- */
 
-            if (bytes > 0)
-            {
-               if (!ack)
-               {
-                  if ((bytes + outPos) <= outLen)
-                  {
-                     for (i=0; i<(bytes-1); i++)
-                     {
-                        outBuf[outPos++] = I2CGetByte(w, 0);
-                     }
-                     outBuf[outPos++] = I2CGetByte(w, 1);
-                  }
-                  else status = PI_BAD_I2C_RLEN;
-               }
-               else status = PI_I2C_READ_FAILED;
-            }
-            else status = PI_BAD_I2C_CMD;
-            break;
+static int intEventSetFunc(
+   unsigned event,
+   void *   f,
+   int      user,
+   void *   userdata)
+{
+   DBG(DBG_INTERNAL, "event=%d function=%08"PRIXPTR", user=%d, userdata=%08"PRIXPTR,
+      event, (uintptr_t)f, user, (uintptr_t)userdata);
 
-         case PI_I2C_WRITE:
+   eventAlert[event].ex = user;
+   eventAlert[event].userdata = userdata;
 
-            bytes = myI2CGetPar(inBuf, &inPos, inLen, &esc);
+   eventAlert[event].func = f;
 
-            if (bytes >= 0) ack = I2CPutByte(w, addr<<1);
+   return 0;
+}
 
-            if (bytes > 0)
-            {
-               if (!ack)
-               {
-                  if ((bytes + inPos) <= inLen)
-                  {
-                     for (i=0; i<(bytes-1); i++)
-                     {
-                        ack = I2CPutByte(w, inBuf[inPos++]);
-                        if (ack) status = PI_I2C_WRITE_FAILED;
-                     }
-                     ack = I2CPutByte(w, inBuf[inPos++]);
-                  }
-                  else status = PI_BAD_I2C_WLEN;
-               } else status = PI_I2C_WRITE_FAILED;
-            }
-            else status = PI_BAD_I2C_CMD;
-            break;
 
-         default:
-            status = PI_BAD_I2C_CMD;
-      }
+/* ----------------------------------------------------------------------- */
 
-      if (setesc) esc = 1; else esc = 0;
+int eventSetFunc(unsigned event, eventFunc_t f)
+{
+   DBG(DBG_USER, "event=%d function=%08"PRIXPTR, event, (uintptr_t)f);
 
-      setesc = 0;
-   }
+   CHECK_INITED;
 
-   wfRx_unlock(SDA);
+   if (event > PI_MAX_EVENT)
+      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
 
-   if (status >= 0) status = outPos;
+   intEventSetFunc(event, f, 0, NULL);
 
-   return status;
+   return 0;
 }
 
+
 /* ----------------------------------------------------------------------- */
 
-void bscInit(int mode)
+int eventSetFuncEx(unsigned event, eventFuncEx_t f, void *userdata)
 {
-   int sda, scl, mosi, miso, ce;
+   DBG(DBG_USER, "event=%d function=%08"PRIxPTR" userdata=%08"PRIxPTR,
+      event, (uintptr_t)f, (uintptr_t)userdata);
 
-   bscsReg[BSC_CR]=0; /* clear device */
-   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
-   bscsReg[BSC_SLV]=0; /* clear I2C slave address */
-   bscsReg[BSC_IMSC]=0xf; /* mask off all interrupts */
-   bscsReg[BSC_ICR]=0x0f; /* clear all interrupts */
+   CHECK_INITED;
 
-   if (pi_is_2711)
-   {
-      sda = BSC_SDA_2711;
-      scl = BSC_SCL_SCLK_2711;
-      mosi = BSC_MOSI_2711;
-      miso = BSC_MISO_2711;
-      ce = BSC_CE_N_2711;
-   }
-   else
-   {
-      sda = BSC_SDA;
-      scl = BSC_SCL_SCLK;
-      mosi = BSC_MOSI;
-      miso = BSC_MISO;
-      ce = BSC_CE_N;
-   }
+   if (event > PI_MAX_EVENT)
+      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
 
+   intEventSetFunc(event, f, 1, userdata);
 
-   if (mode > 1) /* SPI uses all GPIO */
-   {
-      gpioSetMode(scl, PI_ALT3);
-      gpioSetMode(mosi, PI_ALT3);
-      gpioSetMode(miso, PI_ALT3);
-      gpioSetMode(ce, PI_ALT3);
-   }
-   else
-   {
-      gpioSetMode(scl, PI_ALT3);
-      gpioSetMode(sda, PI_ALT3);
-   }
+   return 0;
 }
 
-void bscTerm(int mode)
+
+/* ----------------------------------------------------------------------- */
+
+int eventMonitor(unsigned handle, uint32_t bits)
 {
-   int sda, scl, mosi, miso, ce;
+   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
 
-   bscsReg[BSC_CR] = 0; /* clear device */
-   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
-   bscsReg[BSC_SLV]=0; /* clear I2C slave address */
+   CHECK_INITED;
 
-   if (pi_is_2711)
-   {
-      sda = BSC_SDA_2711;
-      scl = BSC_SCL_SCLK_2711;
-      mosi = BSC_MOSI_2711;
-      miso = BSC_MISO_2711;
-      ce = BSC_CE_N_2711;
-   }
-   else
-   {
-      sda = BSC_SDA;
-      scl = BSC_SCL_SCLK;
-      mosi = BSC_MOSI;
-      miso = BSC_MISO;
-      ce = BSC_CE_N;
-   }
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (mode > 1)
-   {
-      gpioSetMode(scl, PI_INPUT);
-      gpioSetMode(mosi, PI_INPUT);
-      gpioSetMode(miso, PI_INPUT);
-      gpioSetMode(ce, PI_INPUT);
-   }
-   else
-   {
-      gpioSetMode(sda, PI_INPUT);
-      gpioSetMode(scl, PI_INPUT);
+   gpioNotify[handle].eventBits  = bits;
 
-   }
+   return 0;
 }
 
-int bscXfer(bsc_xfer_t *xfer)
-{
-   static int bscMode = 0;
 
-   int copied=0;
-   int active, mode;
+/* ----------------------------------------------------------------------- */
 
-   DBG(DBG_USER, "control=0x%X (sa=0x%X, cr=0x%X) tx=%d [%s]",
-      xfer->control,
-      ((xfer->control)>>16) & 127,
-      (xfer->control) & 0x3fff,
-      xfer->txCnt,
-      myBuf2Str(xfer->txCnt, (char *)xfer->txBuf));
+int eventTrigger(unsigned event)
+{
+   DBG(DBG_USER, "event=%d", event);
 
    CHECK_INITED;
 
-   eventAlert[PI_EVENT_BSC].ignore = 1;
-
-   if (xfer->control)
-   {
-      /*
-         bscMode (0=None, 1=I2C, 2=SPI) tracks which GPIO have been
-         set to BSC mode
-      */
-      if (xfer->control & 2) mode = 2; /* SPI */
-      else                   mode = 1; /* assume I2C */
-
-      if (mode > bscMode)
-      {
-         bscInit(mode);
-         bscMode = mode;
-      }
-   }
-   else
-   {
-      if (bscMode) bscTerm(bscMode);
-      bscMode = 0;
-      return 0; /* leave ignore set */
-   }
+   if (event > PI_MAX_EVENT)
+      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
 
-   xfer->rxCnt = 0;
+   eventAlert[event].fired = 1;
 
-   bscsReg[BSC_SLV] = ((xfer->control)>>16) & 127;
-   bscsReg[BSC_CR] = (xfer->control) & 0x3fff;
-   bscsReg[BSC_RSR]=0; /* clear underrun and overrun errors */
+   return 0;
+}
 
-   active = 1;
 
-   while (active)
-   {
-      active = 0;
+/* ----------------------------------------------------------------------- */
 
-      while ((copied < xfer->txCnt) &&
-             (!(bscsReg[BSC_FR] & BSC_FR_TXFF)))
-      {
-         bscsReg[BSC_DR] = xfer->txBuf[copied++];
-         active = 1;
-      }
+static int intGpioSetAlertFunc(
+   unsigned gpio,
+   void *   f,
+   int      user,
+   void *   userdata)
+{
+   DBG(DBG_INTERNAL, "gpio=%d function=%08"PRIXPTR", user=%d, userdata=%08"PRIXPTR,
+      gpio, (uintptr_t)f, user, (uintptr_t)userdata);
 
-      while ((xfer->rxCnt < BSC_FIFO_SIZE) &&
-             (!(bscsReg[BSC_FR] & BSC_FR_RXFE)))
-      {
-         xfer->rxBuf[xfer->rxCnt++] = bscsReg[BSC_DR];
-         active = 1;
-      }
+   gpioAlert[gpio].ex = user;
+   gpioAlert[gpio].userdata = userdata;
 
-      if (!active)
-      {
-         active = bscsReg[BSC_FR] & (BSC_FR_RXBUSY | BSC_FR_TXBUSY);
-      }
+   gpioAlert[gpio].func = f;
 
-      if (active) myGpioSleep(0, 20);
+   if (f)
+   {
+      alertBits |= BIT;
+   }
+   else
+   {
+      alertBits &= ~BIT;
    }
 
-   bscFR = bscsReg[BSC_FR] & 0xffff;
-
-   eventAlert[PI_EVENT_BSC].ignore = 0;
+   alertUpdateMonitorBits();
 
-   return (copied<<16) | bscFR;
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static void set_CS(wfRx_t *w)
+int gpioSetAlertFunc(unsigned gpio, gpioAlertFunc_t f)
 {
-   myGpioWrite(w->S.CS, PI_SPI_FLAGS_GET_CSPOL(w->S.spiFlags));
-}
+   DBG(DBG_USER, "gpio=%d function=%08"PRIXPTR, gpio, (uintptr_t)f);
 
-static void clear_CS(wfRx_t *w)
-{
-   myGpioWrite(w->S.CS, !PI_SPI_FLAGS_GET_CSPOL(w->S.spiFlags));
-}
+   CHECK_INITED;
 
-static void set_SCLK(wfRx_t *w)
-{
-   myGpioWrite(w->S.SCLK, !PI_SPI_FLAGS_GET_CPOL(w->S.spiFlags));
-}
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-static void clear_SCLK(wfRx_t *w)
-{
-   myGpioWrite(w->S.SCLK, PI_SPI_FLAGS_GET_CPOL(w->S.spiFlags));
-}
+   intGpioSetAlertFunc(gpio, f, 0, NULL);
 
-static void SPI_delay(wfRx_t *w)
-{
-   myGpioDelay(w->S.delay);
+   return 0;
 }
 
-static void bbSPIStart(wfRx_t *w)
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata)
 {
-   clear_SCLK(w);
+   DBG(DBG_USER, "gpio=%d function=%08"PRIXPTR" userdata=%08"PRIXPTR,
+      gpio, (uintptr_t)f, (uintptr_t)userdata);
 
-   SPI_delay(w);
+   CHECK_INITED;
 
-   set_CS(w);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   SPI_delay(w);
+   intGpioSetAlertFunc(gpio, f, 1, userdata);
+
+   return 0;
 }
 
-static void bbSPIStop(wfRx_t *w)
+static void *pthISRThread(void *x)
 {
-   SPI_delay(w);
-
-   clear_CS(w);
+   gpioISR_t *isr = x;
+   int fd;
+   int retval;
+   uint32_t tick;
+   int level;
+   uint32_t levels;
+   struct pollfd pfd;
+   char buf[64];
 
-   SPI_delay(w);
+   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d f=%"PRIxPTR" u=%d data=%"PRIxPTR,
+      isr->gpio, isr->edge, isr->timeout, (uintptr_t)isr->func,
+      isr->ex, (uintptr_t)isr->userdata);
 
-   clear_SCLK(w);
-}
+   sprintf(buf, "/sys/class/gpio/gpio%d/value", isr->gpio);
 
-static uint8_t bbSPIXferByte(wfRx_t *w, char txByte)
-{
-   uint8_t bit, rxByte=0;
+   isr->fd = -1; /* no fd assigned */
 
-   if (PI_SPI_FLAGS_GET_CPHA(w->S.spiFlags))
+   if ((fd = open(buf, O_RDONLY)) < 0)
    {
-      /*
-      CPHA = 1
-      write on set clock
-      read on clear clock
-      */
-
-      for (bit=0; bit<8; bit++)
-      {
-         set_SCLK(w);
+      DBG(DBG_ALWAYS, "gpio %d not exported", isr->gpio);
+      return NULL;
+   }
 
-         if (PI_SPI_FLAGS_GET_TX_LSB(w->S.spiFlags))
-         {
-            myGpioWrite(w->S.MOSI, txByte & 0x01);
-            txByte >>= 1;
-         }
-         else
-         {
-            myGpioWrite(w->S.MOSI, txByte & 0x80);
-            txByte <<= 1;
-         }
+   isr->fd = fd; /* store fd so it can be closed */
 
-         SPI_delay(w);
+   pfd.fd = fd;
 
-         clear_SCLK(w);
+   pfd.events = POLLPRI;
 
-         if (PI_SPI_FLAGS_GET_RX_LSB(w->S.spiFlags))
-         {
-            rxByte = (rxByte >> 1) | myGpioRead(w->S.MISO) << 7;
-         }
-         else
-         {
-            rxByte = (rxByte << 1) | myGpioRead(w->S.MISO);
-         }
+   lseek(fd, 0, SEEK_SET);    /* consume any prior interrupt */
+   if (read(fd, buf, sizeof buf) == -1) { /* ignore errors */ }
 
-         SPI_delay(w);
-      }
-   }
-   else
+   while (1)
    {
-      /*
-      CPHA = 0
-      read on set clock
-      write on clear clock
-      */
+      retval = poll(&pfd, 1, isr->timeout); /* wait for interrupt */
 
-      for (bit=0; bit<8; bit++)
-      {
-         if (PI_SPI_FLAGS_GET_TX_LSB(w->S.spiFlags))
-         {
-            myGpioWrite(w->S.MOSI, txByte & 0x01);
-            txByte >>= 1;
-         }
-         else
-         {
-            myGpioWrite(w->S.MOSI, txByte & 0x80);
-            txByte <<= 1;
-         }
+      tick = systReg[SYST_CLO];
 
-         SPI_delay(w);
+      levels = *(gpioReg + GPLEV0);
 
-         set_SCLK(w);
+      if (retval >= 0)
+      {
+         lseek(fd, 0, SEEK_SET);    /* consume interrupt */
+         if (read(fd, buf, sizeof buf) == -1) { /* ignore errors */ }
 
-         if (PI_SPI_FLAGS_GET_RX_LSB(w->S.spiFlags))
-         {
-            rxByte = (rxByte >> 1) | myGpioRead(w->S.MISO) << 7;
-         }
-         else
+         if (retval)
          {
-            rxByte = (rxByte << 1) | myGpioRead(w->S.MISO);
+            if (levels & (1<<isr->gpio)) level = PI_ON; else level = PI_OFF;
          }
+         else level = PI_TIMEOUT;
 
-         SPI_delay(w);
-
-         clear_SCLK(w);
+         if (isr->ex) (isr->func)(isr->gpio, level, tick, isr->userdata);
+         else         (isr->func)(isr->gpio, level, tick);
       }
    }
 
-   return rxByte;
+   return NULL;
 }
 
-/*-------------------------------------------------------------------------*/
 
-int bbSPIOpen(
-   unsigned CS, unsigned MISO, unsigned MOSI, unsigned SCLK,
-   unsigned baud, unsigned spiFlags)
+/* ----------------------------------------------------------------------- */
+
+static int intGpioSetISRFunc(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   void *f,
+   int user,
+   void *userdata)
 {
-   int valid;
-   uint32_t bits;
+   char buf[64];
 
-   DBG(DBG_USER, "CS=%d MISO=%d MOSI=%d SCLK=%d baud=%d flags=%d",
-      CS, MISO, MOSI, SCLK, baud, spiFlags);
+   char *edge_str[]={"rising\n", "falling\n", "both\n"};
+   int fd;
+   int err;
 
-   CHECK_INITED;
+   DBG(DBG_INTERNAL,
+      "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR" user=%d userdata=%08"PRIXPTR,
+      gpio, edge, timeout, (uintptr_t)f, user, (uintptr_t)userdata);
 
-   if (CS > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad CS (%d)", CS);
+   if (f)
+   {
+      if (!gpioISR[gpio].inited) /* export gpio if unexported */
+      {
+         fd = open("/sys/class/gpio/export", O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
 
-   if (MISO > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad MISO (%d)", MISO);
+         /* ignore write fail if already exported */
+         sprintf(buf, "%d\n", gpio);
+         err = write(fd, buf, strlen(buf));
+         close(fd);
 
-   if (MOSI > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad MOSI (%d)", MOSI);
+         sprintf(buf, "/sys/class/gpio/gpio%d/direction", gpio);
+         fd = open(buf, O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
+
+         err = write(fd, "in\n", 3);
+         close(fd);
+         if (err != 3) return PI_BAD_ISR_INIT;
+
+         gpioISR[gpio].gpio = gpio;
+         gpioISR[gpio].edge = -1;
+         gpioISR[gpio].timeout = -1;
+
+         gpioISR[gpio].inited = 1;
+      }
+
+      if (gpioISR[gpio].edge != edge)
+      {
+         sprintf(buf, "/sys/class/gpio/gpio%d/edge", gpio);
+         fd = open(buf, O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
 
-   if (SCLK > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad SCLK (%d)", SCLK);
+         err = write(fd, edge_str[edge], strlen(edge_str[edge]));
+         close(fd);
+         if (err != strlen(edge_str[edge])) return PI_BAD_ISR_INIT;
 
-   if ((baud < PI_BB_SPI_MIN_BAUD) || (baud > PI_BB_SPI_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_SPI_BAUD, "CS %d, bad baud (%d)", CS, baud);
+         gpioISR[gpio].edge = edge;
 
-   if (wfRx[CS].mode != PI_WFRX_NONE)
-      SOFT_ERROR(PI_GPIO_IN_USE,
-         "CS %d is already being used, mode %d", CS, wfRx[CS].mode);
+         if (gpioISR[gpio].pth != NULL)
+            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
+      }
 
-   valid = 0;
+      if (timeout <= 0) timeout = -1;
+      if (gpioISR[gpio].timeout != timeout)
+      {
+         gpioISR[gpio].timeout = timeout;
 
-   /* check all GPIO unique */
+         if (gpioISR[gpio].pth != NULL)
+            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
+      }
 
-   bits = (1<<CS) | (1<<MISO) | (1<<MOSI) | (1<<SCLK);
+      gpioISR[gpio].func = f;
+      gpioISR[gpio].ex = user;
+      gpioISR[gpio].userdata = userdata;
 
-   if (__builtin_popcount(bits) == 4)
+      if (gpioISR[gpio].pth == NULL)
+         gpioISR[gpio].pth = gpioStartThread(pthISRThread, &gpioISR[gpio]);
+   }
+   else /* null function, delete ISR, unexport gpio */
    {
-      if ((wfRx[MISO].mode == PI_WFRX_NONE) &&
-          (wfRx[MOSI].mode == PI_WFRX_NONE) &&
-          (wfRx[SCLK].mode == PI_WFRX_NONE))
-      {
-         valid = 1; /* first time GPIO used for SPI */
-      }
-      else
+      if (gpioISR[gpio].pth) /* delete any existing ISR */
       {
-         if ((wfRx[MISO].mode == PI_WFRX_SPI_MISO) &&
-             (wfRx[MOSI].mode == PI_WFRX_SPI_MOSI) &&
-             (wfRx[SCLK].mode == PI_WFRX_SPI_SCLK))
+         gpioStopThread(gpioISR[gpio].pth);
+
+         if (gpioISR[gpio].fd >= 0)
          {
-            valid = 2; /* new CS for existing SPI GPIO */
+            close(gpioISR[gpio].fd);
+            gpioISR[gpio].fd = -1;
          }
+
+         gpioISR[gpio].func = NULL;
+         gpioISR[gpio].pth = NULL;
       }
-   }
 
-   if (!valid)
-   {
-      SOFT_ERROR(PI_GPIO_IN_USE,
-         "GPIO already being used (%d=%d %d=%d, %d=%d %d=%d)",
-          CS,   wfRx[CS].mode,
-          MISO, wfRx[MISO].mode,
-          MOSI, wfRx[MOSI].mode,
-          SCLK, wfRx[SCLK].mode);
+      if (gpioISR[gpio].inited) /* unexport the gpio */
+      {
+         fd = open("/sys/class/gpio/unexport", O_WRONLY);
+         if (fd < 0) return PI_BAD_ISR_INIT;
+         sprintf(buf, "%d\n", gpio);
+         err = write(fd, buf, strlen(buf));
+         close(fd);
+         if (err != strlen(buf)) return PI_BAD_ISR_INIT;
+         gpioISR[gpio].inited = 0;
+      }
    }
 
-   wfRx[CS].mode = PI_WFRX_SPI_CS;
-   wfRx[CS].baud = baud;
+   return 0;
+}
 
-   wfRx[CS].S.CS = CS;
-   wfRx[CS].S.SCLK = SCLK;
+/* ----------------------------------------------------------------------- */
 
-   wfRx[CS].S.CSMode = gpioGetMode(CS);
-   wfRx[CS].S.delay = (500000 / baud) - 1;
-   wfRx[CS].S.spiFlags = spiFlags;
+int gpioSetISRFunc(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   gpioISRFunc_t f)
+{
+   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR,
+      gpio, edge, timeout, (uintptr_t)f);
 
-   /* preset CS to off */
+   CHECK_INITED;
 
-   if (PI_SPI_FLAGS_GET_CSPOL(spiFlags))
-      gpioWrite(CS, 0); /* active high */
-   else
-      gpioWrite(CS, 1); /* active low */
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-   /* The SCLK entry is used to store full information */
+   if (edge > EITHER_EDGE)
+      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
 
-   if (valid == 1) /* first time GPIO for SPI */
-   {
-      wfRx[SCLK].S.usage = 1;
+   return intGpioSetISRFunc(gpio, edge, timeout, f, 0, NULL);
+}
 
-      wfRx[SCLK].S.SCLKMode = gpioGetMode(SCLK);
-      wfRx[SCLK].S.MISOMode = gpioGetMode(MISO);
-      wfRx[SCLK].S.MOSIMode = gpioGetMode(MOSI);
 
-      wfRx[SCLK].mode = PI_WFRX_SPI_SCLK;
-      wfRx[MISO].mode = PI_WFRX_SPI_MISO;
-      wfRx[MOSI].mode = PI_WFRX_SPI_MOSI;
+/* ----------------------------------------------------------------------- */
 
-      wfRx[SCLK].S.SCLK = SCLK;
-      wfRx[SCLK].S.MISO = MISO;
-      wfRx[SCLK].S.MOSI = MOSI;
+int gpioSetISRFuncEx(
+   unsigned gpio,
+   unsigned edge,
+   int timeout,
+   gpioAlertFuncEx_t f,
+   void *userdata)
+{
+   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR" userdata=%08"PRIXPTR,
+      gpio, edge, timeout, (uintptr_t)f, (uintptr_t)userdata);
 
-      myGpioSetMode(MISO, PI_INPUT);
-      myGpioSetMode(SCLK, PI_OUTPUT);
-      gpioWrite(MOSI, 0); /* low output */
-   }
-   else
-   {
-      wfRx[SCLK].S.usage++;
-   }
+   CHECK_INITED;
 
-   return 0;
-}
+   if (gpio > PI_MAX_GPIO)
+      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
 
-/*-------------------------------------------------------------------------*/
+   if (edge > EITHER_EDGE)
+      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
 
-int bbSPIClose(unsigned CS)
-{
-   int SCLK;
+   return intGpioSetISRFunc(gpio, edge, timeout, f, 1, userdata);
+}
 
-   DBG(DBG_USER, "CS=%d", CS);
+static void closeOrphanedNotifications(int slot, int fd)
+{
+   int i;
 
-   CHECK_INITED;
+   /* Check for and close any orphaned notifications. */
 
-   if (CS > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", CS);
+   notifyWriterMutex(1);
 
-   switch(wfRx[CS].mode)
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
    {
-      case PI_WFRX_SPI_CS:
+      if ((i != slot) &&
+          (gpioNotify[i].state >= PI_NOTIFY_OPENED) &&
+          (gpioNotify[i].fd == fd))
+      {
+         DBG(DBG_USER, "closed orphaned fd=%d (handle=%d)", fd, i);
+         gpioNotify[i].state = PI_NOTIFY_CLOSED;
+         intNotifyBits();
+      }
+   }
 
-         myGpioSetMode(wfRx[CS].S.CS, wfRx[CS].S.CSMode);
-         wfRx[CS].mode = PI_WFRX_NONE;
+   notifyWriterMutex(0);
+}
 
-         SCLK = wfRx[CS].S.SCLK;
+/* ----------------------------------------------------------------------- */
 
-         if (--wfRx[SCLK].S.usage <= 0)
-         {
-            myGpioSetMode(wfRx[SCLK].S.MISO, wfRx[SCLK].S.MISOMode);
-            myGpioSetMode(wfRx[SCLK].S.MOSI, wfRx[SCLK].S.MOSIMode);
-            myGpioSetMode(wfRx[SCLK].S.SCLK, wfRx[SCLK].S.SCLKMode);
+static void notifyMutex(int lock)
+{
+   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+   if (lock) pthread_mutex_lock(&mutex);
+   else      pthread_mutex_unlock(&mutex);
+}
 
-            wfRx[wfRx[SCLK].S.MISO].mode = PI_WFRX_NONE;
-            wfRx[wfRx[SCLK].S.MOSI].mode = PI_WFRX_NONE;
-            wfRx[wfRx[SCLK].S.SCLK].mode = PI_WFRX_NONE;
-         }
+/* ----------------------------------------------------------------------- */
 
-         break;
+static int notifyOpenPipe(int bufSize, unsigned format)
+{
+   int i, slot, fd;
+   char name[32];
 
-      default:
+   slot = -1;
 
-         SOFT_ERROR(PI_NOT_SPI_GPIO, "no SPI on gpio (%d)", CS);
+   notifyMutex(1);
 
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      {
+         slot = i;
+         gpioNotify[slot].state = PI_NOTIFY_RESERVED;
          break;
-
+      }
    }
 
-   return 0;
-}
+   notifyMutex(0);
 
-/*-------------------------------------------------------------------------*/
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-int bbSPIXfer(
-   unsigned CS,
-   char *inBuf,
-   char *outBuf,
-   unsigned count)
-{
-   int SCLK;
-   int pos;
-   wfRx_t *w;
+   sprintf(name, "/dev/pigpio%d", slot);
 
-   DBG(DBG_USER, "CS=%d inBuf=%s outBuf=%08"PRIXPTR" count=%d",
-      CS, myBuf2Str(count, (char *)inBuf), (uintptr_t)outBuf, count);
+   myCreatePipe(name, 0664);
 
-   CHECK_INITED;
+   fd = open(name, O_RDWR|O_NONBLOCK);
 
-   if (CS > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", CS);
+   if (fd < 0)
+   {
+      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+      SOFT_ERROR(PI_BAD_PATHNAME, "open %s failed (%m)", name);
+   }
 
-   if (wfRx[CS].mode != PI_WFRX_SPI_CS)
-      SOFT_ERROR(PI_NOT_SPI_GPIO, "no SPI on gpio (%d)", CS);
+   if (bufSize != 0)
+   {
+      i = fcntl(fd, F_SETPIPE_SZ, bufSize);
+      if (i != bufSize)
+      {
+         gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+         SOFT_ERROR(PI_BAD_PATHNAME,
+            "fcntl %s size %d failed (%m)", name, bufSize);
+      }
+   }
 
-   if (!inBuf || !count)
-      SOFT_ERROR(PI_BAD_POINTER, "input buffer can't be NULL");
+   gpioNotify[slot].seqno = 0;
+   gpioNotify[slot].bits  = 0;
+   gpioNotify[slot].fd    = fd;
+   gpioNotify[slot].pipe  = 1;
+   gpioNotify[slot].ring  = NULL;
+   gpioNotify[slot].failed = 0;
+   gpioNotify[slot].qHead  = 0;
+   gpioNotify[slot].qTail  = 0;
+   gpioNotify[slot].qOffset = 0;
+   gpioNotify[slot].qDrops = 0;
+   gpioNotify[slot].format = format;
+   gpioNotify[slot].v2Len  = 0;
+   gpioNotify[slot].v2Offset = 0;
+   memset(&gpioNotify[slot].codec, 0, sizeof(cmdNotifyCodec_t));
+   gpioNotify[slot].lastReportTick = gpioTick();
+   gpioNotify[slot].gapPending = 0;
+   gpioNotify[i].state = PI_NOTIFY_OPENED;
 
-   if (!outBuf && count)
-      SOFT_ERROR(PI_BAD_POINTER, "output buffer can't be NULL");
+   closeOrphanedNotifications(slot, fd);
+
+   return slot;
+}
 
-   SCLK = wfRx[CS].S.SCLK;
+int gpioNotifyOpenWithSize(int bufSize)
+{
+   DBG(DBG_USER, "bufSize=%d", bufSize);
 
-   wfRx[SCLK].S.CS = CS;
-   wfRx[SCLK].baud = wfRx[CS].baud;
-   wfRx[SCLK].S.delay = wfRx[CS].S.delay;
-   wfRx[SCLK].S.spiFlags = wfRx[CS].S.spiFlags;
+   CHECK_INITED;
 
-   w = &wfRx[SCLK];
+   return notifyOpenPipe(bufSize, PI_NOTIFY_FORMAT_V1);
+}
 
-   wfRx_lock(SCLK);
+int gpioNotifyOpenWithFormat(unsigned format)
+{
+   DBG(DBG_USER, "format=%d", format);
 
-   bbSPIStart(w);
-     
-   for (pos=0; pos < count; pos++)
-   {
-      outBuf[pos] = bbSPIXferByte(w, inBuf[pos]);
-   }
+   CHECK_INITED;
 
-   bbSPIStop(w);
+   if (format > PI_NOTIFY_FORMAT_V2)
+      SOFT_ERROR(PI_BAD_NOTIFY_FORMAT, "bad format (%d)", format);
 
-   wfRx_unlock(SCLK);
+   return notifyOpenPipe(0, format);
+}
 
-   return count;
+int gpioNotifyOpen(void)
+{
+   return gpioNotifyOpenWithSize(0);
 }
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int gpioSerialReadOpen(unsigned gpio, unsigned baud, unsigned data_bits)
+int gpioNotifyOpenShared(unsigned reports)
 {
-   int bitTime, timeout;
+   int i, slot, fd;
+   char name[32];
+   gpioNotifyRing_t *ring;
 
-   DBG(DBG_USER, "gpio=%d baud=%d data_bits=%d", gpio, baud, data_bits);
+   DBG(DBG_USER, "reports=%d", reports);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if ((reports < PI_MIN_NOTIFY_RING) || (reports > PI_MAX_NOTIFY_RING) ||
+       (reports & (reports - 1)))
+      SOFT_ERROR(PI_BAD_NOTIFY_RING, "bad reports (%d)", reports);
 
-   if ((baud < PI_BB_SER_MIN_BAUD) || (baud > PI_BB_SER_MAX_BAUD))
-      SOFT_ERROR(PI_BAD_WAVE_BAUD,
-         "gpio %d, bad baud rate (%d)", gpio, baud);
+   slot = -1;
 
-   if ((data_bits < PI_MIN_WAVE_DATABITS) ||
-       (data_bits > PI_MAX_WAVE_DATABITS))
-      SOFT_ERROR(PI_BAD_DATABITS,
-         "gpio %d, bad data bits (%d)", gpio, data_bits);
+   notifyMutex(1);
 
-   if (wfRx[gpio].mode != PI_WFRX_NONE)
-      SOFT_ERROR(PI_GPIO_IN_USE, "gpio %d is already being used", gpio);
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      {
+         slot = i;
+         gpioNotify[slot].state = PI_NOTIFY_RESERVED;
+         break;
+      }
+   }
 
-   bitTime = (1000 * MILLION) / baud; /* nanos */
+   notifyMutex(0);
 
-   timeout  = ((data_bits+2) * bitTime)/MILLION; /* millis */
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-   if (timeout < 1) timeout = 1;
+   sprintf(name, PI_NOTIFY_RING_NAME, slot);
 
-   wfRx[gpio].gpio = gpio;
-   wfRx[gpio].mode = PI_WFRX_SERIAL;
-   wfRx[gpio].baud = baud;
+   /* remove any ring left behind by an earlier daemon */
 
-   wfRx[gpio].s.buf      = malloc(SRX_BUF_SIZE);
-   wfRx[gpio].s.bufSize  = SRX_BUF_SIZE;
-   wfRx[gpio].s.timeout  = timeout;
-   wfRx[gpio].s.fullBit  = bitTime;         /* nanos */
-   wfRx[gpio].s.halfBit  = (bitTime/2)+500; /* nanos (500 for rounding) */
-   wfRx[gpio].s.readPos  = 0;
-   wfRx[gpio].s.writePos = 0;
-   wfRx[gpio].s.bit      = -1;
-   wfRx[gpio].s.dataBits = data_bits;
-   wfRx[gpio].s.invert   = PI_BB_SER_NORMAL;
+   shm_unlink(name);
 
-   if      (data_bits <  9) wfRx[gpio].s.bytes = 1;
-   else if (data_bits < 17) wfRx[gpio].s.bytes = 2;
-   else                  wfRx[gpio].s.bytes = 4;
+   fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0666);
 
-   gpioSetAlertFunc(gpio, waveRxBit);
+   ring = MAP_FAILED;
 
-   return 0;
-}
+   if (fd >= 0)
+   {
+      /* the reader advances tail so needs write access */
 
-/*-------------------------------------------------------------------------*/
+      fchmod(fd, 0666);
 
-int gpioSerialReadInvert(unsigned gpio, unsigned invert)
-{
-   DBG(DBG_USER, "gpio=%d invert=%d", gpio, invert);
+      if (ftruncate(fd, PI_NOTIFY_RING_BYTES(reports)) == 0)
+      {
+         ring = mmap(0, PI_NOTIFY_RING_BYTES(reports),
+            PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+      }
 
-   CHECK_INITED;
+      close(fd);
+   }
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (ring == MAP_FAILED)
+   {
+      shm_unlink(name);
+      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
+      SOFT_ERROR(PI_BAD_PATHNAME, "open %s failed (%m)", name);
+   }
 
-   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
-      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+   ring->size = reports;
 
-   if ((invert < PI_BB_SER_NORMAL) ||
-       (invert > PI_BB_SER_INVERT))
-      SOFT_ERROR(PI_BAD_SER_INVERT,
-         "bad invert level for gpio %d (%d)", gpio, invert);
+   __atomic_store_n(&ring->magic, PI_NOTIFY_RING_MAGIC, __ATOMIC_RELEASE);
 
-   wfRx[gpio].s.invert = invert;
+   gpioNotify[slot].seqno = 0;
+   gpioNotify[slot].bits  = 0;
+   gpioNotify[slot].fd    = -1;
+   gpioNotify[slot].pipe  = 0;
+   gpioNotify[slot].ring  = ring;
+   gpioNotify[slot].ringSize  = reports;
+   gpioNotify[slot].format = PI_NOTIFY_FORMAT_V1;
+   gpioNotify[slot].failed = 0;
+   gpioNotify[slot].qDrops = 0;
+   gpioNotify[slot].lastReportTick = gpioTick();
+   gpioNotify[slot].gapPending = 0;
+   gpioNotify[slot].state = PI_NOTIFY_OPENED;
 
-   return 0;
+   return slot;
 }
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int gpioSerialRead(unsigned gpio, void *buf, size_t bufSize)
+static int gpioNotifyOpenInBand(int fd, unsigned format)
 {
-   unsigned bytes=0, wpos;
-   volatile wfRx_t *w;
+   int i, slot;
 
-   DBG(DBG_USER, "gpio=%d buf=%08"PRIXPTR" bufSize=%zd", gpio, (uintptr_t)buf, bufSize);
+   DBG(DBG_USER, "fd=%d format=%d", fd, format);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   if (bufSize == 0)
-      SOFT_ERROR(PI_BAD_SERIAL_COUNT, "buffer size can't be zero");
+   if (format > PI_NOTIFY_FORMAT_V2)
+      SOFT_ERROR(PI_BAD_NOTIFY_FORMAT, "bad format (%d)", format);
 
-   if (wfRx[gpio].mode != PI_WFRX_SERIAL)
-      SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
+   slot = -1;
 
-   w = &wfRx[gpio];
+   notifyMutex(1);
 
-   if (w->s.readPos != w->s.writePos)
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
    {
-      wpos = w->s.writePos;
-
-      if (wpos > w->s.readPos) bytes = wpos - w->s.readPos;
-      else                     bytes = w->s.bufSize - w->s.readPos;
-
-      if (bytes > bufSize) bytes = bufSize;
+      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      {
+         slot = i;
+         gpioNotify[slot].state = PI_NOTIFY_RESERVED;
+         break;
+      }
+   }
 
-      /* copy in multiples of the data size in bytes */
+   notifyMutex(0);
 
-      bytes = (bytes / w->s.bytes) * w->s.bytes;
+   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
 
-      if (buf) memcpy(buf, w->s.buf+w->s.readPos, bytes);
+   gpioNotify[slot].seqno = 0;
+   gpioNotify[slot].bits  = 0;
+   gpioNotify[slot].fd    = fd;
+   gpioNotify[slot].pipe  = 0;
+   gpioNotify[slot].ring  = NULL;
+   gpioNotify[slot].failed = 0;
+   gpioNotify[slot].qHead  = 0;
+   gpioNotify[slot].qTail  = 0;
+   gpioNotify[slot].qOffset = 0;
+   gpioNotify[slot].qDrops = 0;
+   gpioNotify[slot].format = format;
+   gpioNotify[slot].v2Len  = 0;
+   gpioNotify[slot].v2Offset = 0;
+   memset(&gpioNotify[slot].codec, 0, sizeof(cmdNotifyCodec_t));
+   gpioNotify[slot].lastReportTick = gpioTick();
+   gpioNotify[slot].gapPending = 0;
+   gpioNotify[slot].state = PI_NOTIFY_OPENED;
 
-      w->s.readPos += bytes;
+   closeOrphanedNotifications(slot, fd);
 
-      if (w->s.readPos >= w->s.bufSize) w->s.readPos = 0;
-   }
-   return bytes;
+   return slot;
 }
 
 
-/*-------------------------------------------------------------------------*/
+/* ----------------------------------------------------------------------- */
 
-int gpioSerialReadClose(unsigned gpio)
+static void intScriptBits(void)
 {
-   DBG(DBG_USER, "gpio=%d", gpio);
-
-   CHECK_INITED;
+   int i;
+   uint32_t bits;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   bits = 0;
 
-   switch(wfRx[gpio].mode)
+   for (i=0; i<PI_MAX_SCRIPTS; i++)
    {
-      case PI_WFRX_NONE:
-
-         SOFT_ERROR(PI_NOT_SERIAL_GPIO, "no serial read on gpio (%d)", gpio);
-
-         break;
+      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
+      {
+         bits |= gpioScript[i].waitBits;
+      }
+   }
 
-      case PI_WFRX_SERIAL:
+   scriptBits = bits;
 
-         free(wfRx[gpio].s.buf);
+   alertUpdateMonitorBits();
+}
 
-         gpioSetWatchdog(gpio, 0); /* switch off timeouts */
 
-         gpioSetAlertFunc(gpio, NULL); /* cancel alert */
+static void intScriptEventBits(void)
+{
+   int i;
+   uint32_t bits;
 
-         wfRx[gpio].mode = PI_WFRX_NONE;
+   bits = 0;
 
-         break;
+   for (i=0; i<PI_MAX_SCRIPTS; i++)
+   {
+      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
+      {
+         bits |= gpioScript[i].eventBits;
+      }
    }
 
-   return 0;
+   scriptEventBits = bits;
 }
 
 
-/* ----------------------------------------------------------------------- */
-
-static int intEventSetFunc(
-   unsigned event,
-   void *   f,
-   int      user,
-   void *   userdata)
+static void intNotifyBits(void)
 {
-   DBG(DBG_INTERNAL, "event=%d function=%08"PRIXPTR", user=%d, userdata=%08"PRIXPTR,
-      event, (uintptr_t)f, user, (uintptr_t)userdata);
+   int i;
+   uint32_t bits;
 
-   eventAlert[event].ex = user;
-   eventAlert[event].userdata = userdata;
+   bits = 0;
 
-   eventAlert[event].func = f;
+   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   {
+      if (gpioNotify[i].state == PI_NOTIFY_RUNNING)
+      {
+         bits |= gpioNotify[i].bits;
+      }
+   }
 
-   return 0;
+   notifyBits = bits;
+
+   alertUpdateMonitorBits();
 }
 
 
 /* ----------------------------------------------------------------------- */
 
-int eventSetFunc(unsigned event, eventFunc_t f)
+int gpioNotifyBegin(unsigned handle, uint32_t bits)
 {
-   DBG(DBG_USER, "event=%d function=%08"PRIXPTR, event, (uintptr_t)f);
+   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
 
    CHECK_INITED;
 
-   if (event > PI_MAX_EVENT)
-      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
-
-   intEventSetFunc(event, f, 0, NULL);
-
-   return 0;
-}
-
-
-/* ----------------------------------------------------------------------- */
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-int eventSetFuncEx(unsigned event, eventFuncEx_t f, void *userdata)
-{
-   DBG(DBG_USER, "event=%d function=%08"PRIxPTR" userdata=%08"PRIxPTR,
-      event, (uintptr_t)f, (uintptr_t)userdata);
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   CHECK_INITED;
+   gpioNotify[handle].bits  = bits;
 
-   if (event > PI_MAX_EVENT)
-      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
+   gpioNotify[handle].state = PI_NOTIFY_RUNNING;
 
-   intEventSetFunc(event, f, 1, userdata);
+   intNotifyBits();
 
    return 0;
 }
@@ -11653,9 +15506,9 @@ int eventSetFuncEx(unsigned event, eventFuncEx_t f, void *userdata)
 
 /* ----------------------------------------------------------------------- */
 
-int eventMonitor(unsigned handle, uint32_t bits)
+int gpioNotifyPause (unsigned handle)
 {
-   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
+   DBG(DBG_USER, "handle=%d", handle);
 
    CHECK_INITED;
 
@@ -11665,7 +15518,11 @@ int eventMonitor(unsigned handle, uint32_t bits)
    if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   gpioNotify[handle].eventBits  = bits;
+   gpioNotify[handle].bits  = 0;
+
+   gpioNotify[handle].state = PI_NOTIFY_PAUSED;
+
+   intNotifyBits();
 
    return 0;
 }
@@ -11673,706 +15530,740 @@ int eventMonitor(unsigned handle, uint32_t bits)
 
 /* ----------------------------------------------------------------------- */
 
-int eventTrigger(unsigned event)
+int gpioNotifyClose(unsigned handle)
 {
-   DBG(DBG_USER, "event=%d", event);
+   char fifo[32];
+
+   DBG(DBG_USER, "handle=%d", handle);
 
    CHECK_INITED;
 
-   if (event > PI_MAX_EVENT)
-      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   eventAlert[event].fired = 1;
+   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   return 0;
-}
+   gpioNotify[handle].bits  = 0;
 
+   gpioNotify[handle].state = PI_NOTIFY_CLOSING;
 
-/* ----------------------------------------------------------------------- */
+   intNotifyBits();
 
-static int intGpioSetAlertFunc(
-   unsigned gpio,
-   void *   f,
-   int      user,
-   void *   userdata)
-{
-   DBG(DBG_INTERNAL, "gpio=%d function=%08"PRIXPTR", user=%d, userdata=%08"PRIXPTR,
-      gpio, (uintptr_t)f, user, (uintptr_t)userdata);
+   if (gpioCfg.ifFlags & PI_DISABLE_ALERT)
+   {
+      if (gpioNotify[handle].pipe)
+      {
+         DBG(DBG_INTERNAL, "close notify pipe %d", gpioNotify[handle].fd);
+         close(gpioNotify[handle].fd);
 
-   gpioAlert[gpio].ex = user;
-   gpioAlert[gpio].userdata = userdata;
+         sprintf(fifo, "/dev/pigpio%d", handle);
 
-   gpioAlert[gpio].func = f;
+         unlink(fifo);
+      }
+      else if (gpioNotify[handle].ring) notifyRingClose(handle);
 
-   if (f)
-   {
-      alertBits |= BIT;
+      gpioNotify[handle].state = PI_NOTIFY_CLOSED;
    }
    else
    {
-      alertBits &= ~BIT;
+      /* actual close done in alert thread */
    }
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
-
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetAlertFunc(unsigned gpio, gpioAlertFunc_t f)
+int gpioNotifyGetQueued(unsigned handle)
 {
-   DBG(DBG_USER, "gpio=%d function=%08"PRIXPTR, gpio, (uintptr_t)f);
-
-   CHECK_INITED;
-
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   intGpioSetAlertFunc(gpio, f, 0, NULL);
-
-   return 0;
-}
-
-
-/* ----------------------------------------------------------------------- */
+   gpioNotify_t *h;
 
-int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata)
-{
-   DBG(DBG_USER, "gpio=%d function=%08"PRIXPTR" userdata=%08"PRIXPTR,
-      gpio, (uintptr_t)f, (uintptr_t)userdata);
+   DBG(DBG_USER, "handle=%d", handle);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   intGpioSetAlertFunc(gpio, f, 1, userdata);
-
-   return 0;
-}
-
-static void *pthISRThread(void *x)
-{
-   gpioISR_t *isr = x;
-   int fd;
-   int retval;
-   uint32_t tick;
-   int level;
-   uint32_t levels;
-   struct pollfd pfd;
-   char buf[64];
-
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d f=%"PRIxPTR" u=%d data=%"PRIxPTR,
-      isr->gpio, isr->edge, isr->timeout, (uintptr_t)isr->func,
-      isr->ex, (uintptr_t)isr->userdata);
-
-   sprintf(buf, "/sys/class/gpio/gpio%d/value", isr->gpio);
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   isr->fd = -1; /* no fd assigned */
+   h = &gpioNotify[handle];
 
-   if ((fd = open(buf, O_RDONLY)) < 0)
-   {
-      DBG(DBG_ALWAYS, "gpio %d not exported", isr->gpio);
-      return NULL;
-   }
+   if (h->state < PI_NOTIFY_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   isr->fd = fd; /* store fd so it can be closed */
+   if (h->ring)
+      return (h->ring->head - h->ring->tail) & 0x7FFFFFFF;
 
-   pfd.fd = fd;
+   return __atomic_load_n(&h->qHead, __ATOMIC_ACQUIRE) -
+          __atomic_load_n(&h->qTail, __ATOMIC_ACQUIRE);
+}
 
-   pfd.events = POLLPRI;
+/* ----------------------------------------------------------------------- */
 
-   lseek(fd, 0, SEEK_SET);    /* consume any prior interrupt */
-   if (read(fd, buf, sizeof buf) == -1) { /* ignore errors */ }
+int gpioNotifyGetDropped(unsigned handle)
+{
+   gpioNotify_t *h;
 
-   while (1)
-   {
-      retval = poll(&pfd, 1, isr->timeout); /* wait for interrupt */
+   DBG(DBG_USER, "handle=%d", handle);
 
-      tick = systReg[SYST_CLO];
+   CHECK_INITED;
 
-      levels = *(gpioReg + GPLEV0);
+   if (handle >= PI_NOTIFY_SLOTS)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-      if (retval >= 0)
-      {
-         lseek(fd, 0, SEEK_SET);    /* consume interrupt */
-         if (read(fd, buf, sizeof buf) == -1) { /* ignore errors */ }
+   h = &gpioNotify[handle];
 
-         if (retval)
-         {
-            if (levels & (1<<isr->gpio)) level = PI_ON; else level = PI_OFF;
-         }
-         else level = PI_TIMEOUT;
+   if (h->state < PI_NOTIFY_OPENED)
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-         if (isr->ex) (isr->func)(isr->gpio, level, tick, isr->userdata);
-         else         (isr->func)(isr->gpio, level, tick);
-      }
-   }
+   if (h->ring) return h->ring->overruns & 0x7FFFFFFF;
 
-   return NULL;
+   return h->qDrops & 0x7FFFFFFF;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-static int intGpioSetISRFunc(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   void *f,
-   int user,
-   void *userdata)
+int gpioTrigger(unsigned gpio, unsigned pulseLen, unsigned level)
 {
-   char buf[64];
-
-   char *edge_str[]={"rising\n", "falling\n", "both\n"};
-   int fd;
-   int err;
-
-   DBG(DBG_INTERNAL,
-      "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR" user=%d userdata=%08"PRIXPTR,
-      gpio, edge, timeout, (uintptr_t)f, user, (uintptr_t)userdata);
-
-   if (f)
-   {
-      if (!gpioISR[gpio].inited) /* export gpio if unexported */
-      {
-         fd = open("/sys/class/gpio/export", O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
-
-         /* ignore write fail if already exported */
-         sprintf(buf, "%d\n", gpio);
-         err = write(fd, buf, strlen(buf));
-         close(fd);
-
-         sprintf(buf, "/sys/class/gpio/gpio%d/direction", gpio);
-         fd = open(buf, O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
+   DBG(DBG_USER, "gpio=%d pulseLen=%d level=%d", gpio, pulseLen, level);
 
-         err = write(fd, "in\n", 3);
-         close(fd);
-         if (err != 3) return PI_BAD_ISR_INIT;
+   CHECK_INITED;
 
-         gpioISR[gpio].gpio = gpio;
-         gpioISR[gpio].edge = -1;
-         gpioISR[gpio].timeout = -1;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-         gpioISR[gpio].inited = 1;
-      }
+   if (level > PI_ON)
+      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
 
-      if (gpioISR[gpio].edge != edge)
-      {
-         sprintf(buf, "/sys/class/gpio/gpio%d/edge", gpio);
-         fd = open(buf, O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
+   if ((pulseLen > PI_MAX_BUSY_DELAY) || (!pulseLen))
+      SOFT_ERROR(PI_BAD_PULSELEN,
+         "gpio %d, bad pulseLen (%d)", gpio, pulseLen);
 
-         err = write(fd, edge_str[edge], strlen(edge_str[edge]));
-         close(fd);
-         if (err != strlen(edge_str[edge])) return PI_BAD_ISR_INIT;
+   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
+   else                 *(gpioReg + GPSET0 + BANK) = BIT;
 
-         gpioISR[gpio].edge = edge;
+   myGpioDelay(pulseLen);
 
-         if (gpioISR[gpio].pth != NULL)
-            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
-      }
+   if (level != PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
+   else                 *(gpioReg + GPSET0 + BANK) = BIT;
 
-      if (timeout <= 0) timeout = -1;
-      if (gpioISR[gpio].timeout != timeout)
-      {
-         gpioISR[gpio].timeout = timeout;
+   return 0;
+}
 
-         if (gpioISR[gpio].pth != NULL)
-            pthread_kill(*gpioISR[gpio].pth, SIGCHLD);
-      }
 
-      gpioISR[gpio].func = f;
-      gpioISR[gpio].ex = user;
-      gpioISR[gpio].userdata = userdata;
+/* ----------------------------------------------------------------------- */
 
-      if (gpioISR[gpio].pth == NULL)
-         gpioISR[gpio].pth = gpioStartThread(pthISRThread, &gpioISR[gpio]);
-   }
-   else /* null function, delete ISR, unexport gpio */
-   {
-      if (gpioISR[gpio].pth) /* delete any existing ISR */
-      {
-         gpioStopThread(gpioISR[gpio].pth);
+int gpioSetWatchdog(unsigned gpio, unsigned timeout)
+{
+   DBG(DBG_USER, "gpio=%d timeout=%d", gpio, timeout);
 
-         if (gpioISR[gpio].fd >= 0)
-         {
-            close(gpioISR[gpio].fd);
-            gpioISR[gpio].fd = -1;
-         }
+   CHECK_INITED;
 
-         gpioISR[gpio].func = NULL;
-         gpioISR[gpio].pth = NULL;
-      }
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-      if (gpioISR[gpio].inited) /* unexport the gpio */
-      {
-         fd = open("/sys/class/gpio/unexport", O_WRONLY);
-         if (fd < 0) return PI_BAD_ISR_INIT;
-         sprintf(buf, "%d\n", gpio);
-         err = write(fd, buf, strlen(buf));
-         close(fd);
-         if (err != strlen(buf)) return PI_BAD_ISR_INIT;
-         gpioISR[gpio].inited = 0;
-      }
-   }
+   if (timeout > PI_MAX_WDOG_TIMEOUT)
+      SOFT_ERROR(PI_BAD_WDOG_TIMEOUT,
+         "gpio %d, bad timeout (%d)", gpio, timeout);
+
+   gpioWdog[gpio].wdTick   = systReg[SYST_CLO];
+   gpioWdog[gpio].wdSteadyUs = timeout*1000;
+
+   if (timeout) wdogBits |= (1<<gpio);
+   else         wdogBits &= (~(1<<gpio));
+
+   /* the alert thread rechecks its earliest deadline */
+
+   __atomic_store_n(&wdogRescan, 1, __ATOMIC_RELEASE);
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetISRFunc(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   gpioISRFunc_t f)
+int gpioNoiseFilter(unsigned gpio, unsigned steady, unsigned active)
 {
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR,
-      gpio, edge, timeout, (uintptr_t)f);
+   DBG(DBG_USER, "gpio=%d steady=%d active=%d", gpio, steady, active);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   if (edge > EITHER_EDGE)
-      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
+   if (steady > PI_MAX_STEADY)
+      SOFT_ERROR(PI_BAD_FILTER, "bad steady (%d)", steady);
 
-   return intGpioSetISRFunc(gpio, edge, timeout, f, 0, NULL);
+   if (active > PI_MAX_ACTIVE)
+      SOFT_ERROR(PI_BAD_FILTER, "bad active (%d)", active);
+
+   gpioFilter[gpio].nfTick1  = systReg[SYST_CLO];
+   gpioFilter[gpio].nfTick2  = gpioFilter[gpio].nfTick1;
+   gpioFilter[gpio].nfSteadyUs = steady;
+   gpioFilter[gpio].nfActiveUs = active;
+   gpioFilter[gpio].nfActive   = 0;
+
+   if (steady) nFilterBits |= (1<<gpio);
+   else        nFilterBits &= (~(1<<gpio));
+
+   return 0;
 }
 
 
 /* ----------------------------------------------------------------------- */
 
-int gpioSetISRFuncEx(
-   unsigned gpio,
-   unsigned edge,
-   int timeout,
-   gpioAlertFuncEx_t f,
-   void *userdata)
+int gpioGlitchFilter(unsigned gpio, unsigned steady)
 {
-   DBG(DBG_USER, "gpio=%d edge=%d timeout=%d function=%08"PRIXPTR" userdata=%08"PRIXPTR,
-      gpio, edge, timeout, (uintptr_t)f, (uintptr_t)userdata);
+   DBG(DBG_USER, "gpio=%d steady=%d", gpio, steady);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_GPIO)
-      SOFT_ERROR(PI_BAD_GPIO, "bad gpio (%d)", gpio);
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   if (edge > EITHER_EDGE)
-      SOFT_ERROR(PI_BAD_EDGE, "bad ISR edge (%d)", edge);
+   if (steady > PI_MAX_STEADY)
+      SOFT_ERROR(PI_BAD_FILTER, "bad steady (%d)", steady);
 
-   return intGpioSetISRFunc(gpio, edge, timeout, f, 1, userdata);
+   if (steady)
+   {
+      /* Initialise values next time we process alerts */
+      gpioFilter[gpio].gfInitialised = 0;
+   }
+
+   gpioFilter[gpio].gfSteadyUs = steady;
+
+   if (steady) gFilterBits |= (1<<gpio);
+   else        gFilterBits &= (~(1<<gpio));
+
+   return 0;
 }
 
-static void closeOrphanedNotifications(int slot, int fd)
+/* ----------------------------------------------------------------------- */
+
+int gpioSetMeter(unsigned gpio, unsigned windowMillis)
 {
-   int i;
+   meterInfo_t *m;
 
-   /* Check for and close any orphaned notifications. */
+   DBG(DBG_USER, "gpio=%d windowMillis=%d", gpio, windowMillis);
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   CHECK_INITED;
+
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+
+   if (windowMillis &&
+      ((windowMillis < PI_MIN_METER_WINDOW) ||
+       (windowMillis > PI_MAX_METER_WINDOW)))
+      SOFT_ERROR(PI_BAD_METER_WINDOW,
+         "gpio %d, bad window (%d)", gpio, windowMillis);
+
+   pthread_mutex_lock(&meterMutex);
+
+   m = &meterInfo[gpio];
+
+   memset(m, 0, sizeof(meterInfo_t));
+
+   if (windowMillis)
    {
-      if ((i != slot) &&
-          (gpioNotify[i].state >= PI_NOTIFY_OPENED) &&
-          (gpioNotify[i].fd == fd))
-      {
-         DBG(DBG_USER, "closed orphaned fd=%d (handle=%d)", fd, i);
-         gpioNotify[i].state = PI_NOTIFY_CLOSED;
-         intNotifyBits();
-      }
+      m->window   = windowMillis * 1000;
+      m->start    = systReg[SYST_CLO];
+      m->edgeTick = m->start;
+      m->level    = gpioRead(gpio);
+
+      meterBits |= (1<<gpio);
    }
-}
+   else meterBits &= (~(1<<gpio));
 
-/* ----------------------------------------------------------------------- */
+   alertUpdateMonitorBits();
 
-static void notifyMutex(int lock)
-{
-   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-   if (lock) pthread_mutex_lock(&mutex);
-   else      pthread_mutex_unlock(&mutex);
+   pthread_mutex_unlock(&meterMutex);
+
+   return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyOpenWithSize(int bufSize)
+int gpioGetMeter(unsigned gpio, gpioMeter_t *meter)
 {
-   int i, slot, fd;
-   char name[32];
-
-   DBG(DBG_USER, "bufSize=%d", bufSize);
+   DBG(DBG_USER, "gpio=%d meter=%08"PRIXPTR, gpio, (uintptr_t)meter);
 
    CHECK_INITED;
 
-   slot = -1;
+   if (gpio > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
 
-   notifyMutex(1);
+   if (!meter)
+      SOFT_ERROR(PI_BAD_POINTER, "meter can't be NULL");
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
-   {
-      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
-      {
-         slot = i;
-         gpioNotify[slot].state = PI_NOTIFY_RESERVED;
-         break;
-      }
-   }
+   if (!(meterBits & (1<<gpio)))
+      SOFT_ERROR(PI_NOT_METERED, "gpio %d, no meter", gpio);
 
-   notifyMutex(0);
+   pthread_mutex_lock(&meterMutex);
 
-   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
+   *meter = meterInfo[gpio].result;
 
-   sprintf(name, "/dev/pigpio%d", slot);
+   pthread_mutex_unlock(&meterMutex);
 
-   myCreatePipe(name, 0664);
+   return 0;
+}
 
-   fd = open(name, O_RDWR|O_NONBLOCK);
+/* ----------------------------------------------------------------------- */
 
-   if (fd < 0)
-   {
-      gpioNotify[slot].state = PI_NOTIFY_CLOSED;
-      SOFT_ERROR(PI_BAD_PATHNAME, "open %s failed (%m)", name);
-   }
+static void intEncoderBits(void)
+{
+   int h;
+   uint32_t bits = 0;
 
-   if (bufSize != 0)
+   for (h=0; h<PI_MAX_ENCODERS; h++)
    {
-      i = fcntl(fd, F_SETPIPE_SZ, bufSize);
-      if (i != bufSize)
+      if (encoderInfo[h].state == PI_ENCODER_OPENED)
       {
-         gpioNotify[slot].state = PI_NOTIFY_CLOSED;
-         SOFT_ERROR(PI_BAD_PATHNAME,
-            "fcntl %s size %d failed (%m)", name, bufSize);
+         bits |= (1<<encoderInfo[h].gpioA) | (1<<encoderInfo[h].gpioB);
+
+         if (encoderInfo[h].gpioI != PI_ENCODER_NO_INDEX)
+            bits |= (1<<encoderInfo[h].gpioI);
       }
    }
 
-   gpioNotify[slot].seqno = 0;
-   gpioNotify[slot].bits  = 0;
-   gpioNotify[slot].fd    = fd;
-   gpioNotify[slot].pipe  = 1;
-   gpioNotify[slot].max_emits  = MAX_EMITS;
-   gpioNotify[slot].lastReportTick = gpioTick();
-   gpioNotify[i].state = PI_NOTIFY_OPENED;
-
-   closeOrphanedNotifications(slot, fd);
+   encoderBits = bits;
 
-   return slot;
+   alertUpdateMonitorBits();
 }
 
-int gpioNotifyOpen(void)
+static int intEncoderOpen(
+   unsigned gpioA, unsigned gpioB, unsigned gpioIndex, int sock)
 {
-   return gpioNotifyOpenWithSize(0);
-}
+   int h, slot;
+   uint32_t bits;
+   encoderInfo_t *e;
 
-/* ----------------------------------------------------------------------- */
+   DBG(DBG_USER, "gpioA=%d gpioB=%d gpioIndex=%d", gpioA, gpioB, gpioIndex);
 
-static int gpioNotifyOpenInBand(int fd)
-{
-   int i, slot;
+   CHECK_INITED;
 
-   DBG(DBG_USER, "fd=%d", fd);
+   if (gpioA > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpioA (%d)", gpioA);
 
-   CHECK_INITED;
+   if (gpioB > PI_MAX_USER_GPIO)
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpioB (%d)", gpioB);
 
-   slot = -1;
+   if ((gpioIndex > PI_MAX_USER_GPIO) && (gpioIndex != PI_ENCODER_NO_INDEX))
+      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpioIndex (%d)", gpioIndex);
 
-   notifyMutex(1);
+   bits = (1<<gpioA) | (1<<gpioB);
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
+   if (gpioIndex != PI_ENCODER_NO_INDEX) bits |= (1<<gpioIndex);
+
+   if ((gpioA == gpioB) || (gpioA == gpioIndex) || (gpioB == gpioIndex))
+      SOFT_ERROR(PI_GPIO_IN_USE, "encoder GPIO must differ");
+
+   pthread_mutex_lock(&encoderMutex);
+
+   slot = -1;
+
+   for (h=0; h<PI_MAX_ENCODERS; h++)
    {
-      if (gpioNotify[i].state == PI_NOTIFY_CLOSED)
+      if (encoderInfo[h].state == PI_ENCODER_CLOSED)
       {
-         slot = i;
-         gpioNotify[slot].state = PI_NOTIFY_RESERVED;
+         slot = h;
          break;
       }
    }
 
-   notifyMutex(0);
+   if (encoderBits & bits)
+   {
+      pthread_mutex_unlock(&encoderMutex);
+      SOFT_ERROR(PI_GPIO_IN_USE, "GPIO already used by an encoder");
+   }
 
-   if (slot < 0) SOFT_ERROR(PI_NO_HANDLE, "no handle");
+   if (slot < 0)
+   {
+      pthread_mutex_unlock(&encoderMutex);
+      SOFT_ERROR(PI_NO_HANDLE, "no encoder handles");
+   }
 
-   gpioNotify[slot].seqno = 0;
-   gpioNotify[slot].bits  = 0;
-   gpioNotify[slot].fd    = fd;
-   gpioNotify[slot].pipe  = 0;
-   gpioNotify[slot].max_emits  = MAX_EMITS;
-   gpioNotify[slot].lastReportTick = gpioTick();
-   gpioNotify[slot].state = PI_NOTIFY_OPENED;
+   e = &encoderInfo[slot];
 
-   closeOrphanedNotifications(slot, fd);
+   memset(e, 0, sizeof(encoderInfo_t));
+
+   e->gpioA  = gpioA;
+   e->gpioB  = gpioB;
+   e->gpioI  = gpioIndex;
+   e->levels = (gpioRead(gpioA) << 1) | gpioRead(gpioB);
+
+   if (gpioIndex != PI_ENCODER_NO_INDEX) e->levelI = gpioRead(gpioIndex);
+
+   e->sock    = sock;
+   e->start   = systReg[SYST_CLO];
+   e->velTick = e->start;
+
+   e->state = PI_ENCODER_OPENED;
+
+   intEncoderBits();
+
+   pthread_mutex_unlock(&encoderMutex);
 
    return slot;
 }
 
+int gpioEncoderOpen(unsigned gpioA, unsigned gpioB, unsigned gpioIndex)
+{
+   return intEncoderOpen(gpioA, gpioB, gpioIndex, -1);
+}
 
 /* ----------------------------------------------------------------------- */
 
-static void intScriptBits(void)
+static void closeOrphanedEncoders(int sock)
 {
-   int i;
-   uint32_t bits;
+   int h;
 
-   bits = 0;
+   /* Close any encoders opened on a socket which is closing. */
 
-   for (i=0; i<PI_MAX_SCRIPTS; i++)
+   pthread_mutex_lock(&encoderMutex);
+
+   for (h=0; h<PI_MAX_ENCODERS; h++)
    {
-      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
+      if ((encoderInfo[h].state == PI_ENCODER_OPENED) &&
+          (encoderInfo[h].sock == sock))
       {
-         bits |= gpioScript[i].waitBits;
+         DBG(DBG_USER, "closed orphaned encoder (handle=%d)", h);
+         encoderInfo[h].state = PI_ENCODER_CLOSED;
       }
    }
 
-   scriptBits = bits;
+   intEncoderBits();
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   pthread_mutex_unlock(&encoderMutex);
 }
 
+/* ----------------------------------------------------------------------- */
 
-static void intScriptEventBits(void)
+int gpioEncoderClose(unsigned handle)
 {
-   int i;
-   uint32_t bits;
+   DBG(DBG_USER, "handle=%d", handle);
 
-   bits = 0;
+   CHECK_INITED;
 
-   for (i=0; i<PI_MAX_SCRIPTS; i++)
-   {
-      if (gpioScript[i].state == PI_SCRIPT_IN_USE)
-      {
-         bits |= gpioScript[i].eventBits;
-      }
-   }
+   if ((handle >= PI_MAX_ENCODERS) ||
+       (encoderInfo[handle].state != PI_ENCODER_OPENED))
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   scriptEventBits = bits;
+   pthread_mutex_lock(&encoderMutex);
+
+   encoderInfo[handle].state = PI_ENCODER_CLOSED;
+
+   intEncoderBits();
+
+   pthread_mutex_unlock(&encoderMutex);
+
+   return 0;
 }
 
+/* ----------------------------------------------------------------------- */
 
-static void intNotifyBits(void)
+int gpioEncoderGet(unsigned handle, gpioEncoder_t *encoder)
 {
-   int i;
-   uint32_t bits;
+   DBG(DBG_USER, "handle=%d encoder=%08"PRIXPTR, handle, (uintptr_t)encoder);
 
-   bits = 0;
+   CHECK_INITED;
 
-   for (i=0; i<PI_NOTIFY_SLOTS; i++)
-   {
-      if (gpioNotify[i].state == PI_NOTIFY_RUNNING)
-      {
-         bits |= gpioNotify[i].bits;
-      }
-   }
+   if ((handle >= PI_MAX_ENCODERS) ||
+       (encoderInfo[handle].state != PI_ENCODER_OPENED))
+      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   notifyBits = bits;
+   if (!encoder)
+      SOFT_ERROR(PI_BAD_POINTER, "encoder can't be NULL");
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
-}
+   pthread_mutex_lock(&encoderMutex);
+
+   *encoder = encoderInfo[handle].enc;
 
+   pthread_mutex_unlock(&encoderMutex);
+
+   return 0;
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyBegin(unsigned handle, uint32_t bits)
+int gpioEncoderSetEvent(unsigned handle, unsigned event, unsigned millis)
 {
-   DBG(DBG_USER, "handle=%d bits=%08X", handle, bits);
+   encoderInfo_t *e;
+
+   DBG(DBG_USER, "handle=%d event=%d millis=%d", handle, event, millis);
 
    CHECK_INITED;
 
-   if (handle >= PI_NOTIFY_SLOTS)
+   if ((handle >= PI_MAX_ENCODERS) ||
+       (encoderInfo[handle].state != PI_ENCODER_OPENED))
       SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
 
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if (event > PI_MAX_EVENT)
+      SOFT_ERROR(PI_BAD_EVENT_ID, "bad event (%d)", event);
 
-   gpioNotify[handle].bits  = bits;
+   if (millis > PI_MAX_ENCODER_EVENT)
+      SOFT_ERROR(PI_BAD_ENCODER_EVENT, "bad millis (%d)", millis);
 
-   gpioNotify[handle].state = PI_NOTIFY_RUNNING;
+   pthread_mutex_lock(&encoderMutex);
 
-   intNotifyBits();
+   e = &encoderInfo[handle];
+
+   e->event         = event;
+   e->eventMicros   = millis * 1000;
+   e->eventTick     = systReg[SYST_CLO] - e->eventMicros;
+   e->eventPosition = e->enc.position;
+
+   pthread_mutex_unlock(&encoderMutex);
 
    return 0;
 }
 
-
 /* ----------------------------------------------------------------------- */
 
-int gpioNotifyPause (unsigned handle)
+int gpioCaptureStart(
+   uint32_t bits, unsigned trigMode, uint32_t trigBits, uint32_t trigLevels,
+   unsigned preSamples, unsigned postSamples)
 {
-   DBG(DBG_USER, "handle=%d", handle);
+   gpioSample_t *buf;
+   uint32_t level;
+   captureInfo_t *c = &captureInfo;
 
-   CHECK_INITED;
+   DBG(DBG_USER, "bits=%08X mode=%d trigBits=%08X trigLevels=%08X "
+      "pre=%d post=%d",
+      bits, trigMode, trigBits, trigLevels, preSamples, postSamples);
 
-   if (handle >= PI_NOTIFY_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   CHECK_INITED;
 
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   if ((bits == 0) || (trigMode > PI_CAPTURE_CHANGE) ||
+       ((trigMode != PI_CAPTURE_NOW) && (trigBits == 0)))
+      SOFT_ERROR(PI_BAD_CAPTURE_TRIG,
+         "bad capture bits (%08X) or trigger (%d %08X)",
+         bits, trigMode, trigBits);
 
-   gpioNotify[handle].bits  = 0;
+   if ((preSamples > PI_MAX_CAPTURE_SAMPLES) ||
+       (postSamples > (PI_MAX_CAPTURE_SAMPLES - preSamples)))
+      SOFT_ERROR(PI_BAD_CAPTURE_DEPTH,
+         "bad capture samples (%d+%d)", preSamples, postSamples);
 
-   gpioNotify[handle].state = PI_NOTIFY_PAUSED;
+   /* the pre ring, then the trigger sample and post samples */
 
-   intNotifyBits();
+   buf = malloc((preSamples + 1 + postSamples) * sizeof(gpioSample_t));
 
-   return 0;
-}
+   if (buf == NULL)
+      SOFT_ERROR(PI_NO_MEMORY, "can't allocate capture samples");
 
+   if (trigMode == PI_CAPTURE_NOW) trigBits = 0;
 
-/* ----------------------------------------------------------------------- */
+   pthread_mutex_lock(&captureMutex);
 
-int gpioNotifyClose(unsigned handle)
-{
-   char fifo[32];
+   free(c->buf);
 
-   DBG(DBG_USER, "handle=%d", handle);
+   memset(c, 0, sizeof(captureInfo_t));
 
-   CHECK_INITED;
+   c->buf        = buf;
+   c->pre        = preSamples;
+   c->post       = postSamples;
+   c->mode       = trigMode;
+   c->bits       = bits;
+   c->trigBits   = trigBits;
+   c->trigLevels = trigLevels;
+   c->start      = systReg[SYST_CLO];
+   c->laps       = gpioStats.dmaLaps;
 
-   if (handle >= PI_NOTIFY_SLOTS)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   c->status.state = PI_CAPTURE_ARMED;
 
-   if (gpioNotify[handle].state <= PI_NOTIFY_CLOSING)
-      SOFT_ERROR(PI_BAD_HANDLE, "bad handle (%d)", handle);
+   /* the levels at the start are the first sample */
 
-   gpioNotify[handle].bits  = 0;
+   level = gpioRead_Bits_0_31() & (bits | trigBits);
 
-   gpioNotify[handle].state = PI_NOTIFY_CLOSING;
+   c->level = level;
 
-   intNotifyBits();
+   /* only a level trigger (or none) can be met without a change */
 
-   if (gpioCfg.ifFlags & PI_DISABLE_ALERT)
+   if (alertCaptureTrigger(c, level))
    {
-      if (gpioNotify[handle].pipe)
-      {
-         DBG(DBG_INTERNAL, "close notify pipe %d", gpioNotify[handle].fd);
-         close(gpioNotify[handle].fd);
+      c->status.state   = PI_CAPTURE_TRIGGERED;
+      c->status.trigger = 0;
+      c->status.tick    = c->start;
+   }
 
-         sprintf(fifo, "/dev/pigpio%d", handle);
+   alertCaptureKeep(c, c->start, level);
 
-         unlink(fifo);
-      }
+   if (c->status.state == PI_CAPTURE_DONE) captureBits = 0;
+   else                                    captureBits = bits | trigBits;
 
-      gpioNotify[handle].state = PI_NOTIFY_CLOSED;
-   }
-   else
-   {
-      /* actual close done in alert thread */
-   }
+   alertUpdateMonitorBits();
+
+   pthread_mutex_unlock(&captureMutex);
 
    return 0;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioTrigger(unsigned gpio, unsigned pulseLen, unsigned level)
+int gpioCaptureStatus(gpioCapture_t *capture)
 {
-   DBG(DBG_USER, "gpio=%d pulseLen=%d level=%d", gpio, pulseLen, level);
+   DBG(DBG_USER, "capture=%08"PRIXPTR, (uintptr_t)capture);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (!capture)
+      SOFT_ERROR(PI_BAD_POINTER, "capture can't be NULL");
 
-   if (level > PI_ON)
-      SOFT_ERROR(PI_BAD_LEVEL, "gpio %d, bad level (%d)", gpio, level);
+   pthread_mutex_lock(&captureMutex);
 
-   if ((pulseLen > PI_MAX_BUSY_DELAY) || (!pulseLen))
-      SOFT_ERROR(PI_BAD_PULSELEN,
-         "gpio %d, bad pulseLen (%d)", gpio, pulseLen);
+   if (captureInfo.buf == NULL)
+   {
+      pthread_mutex_unlock(&captureMutex);
+      SOFT_ERROR(PI_NO_CAPTURE, "no capture started");
+   }
 
-   if (level == PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   *capture = captureInfo.status;
 
-   myGpioDelay(pulseLen);
+   pthread_mutex_unlock(&captureMutex);
 
-   if (level != PI_OFF) *(gpioReg + GPCLR0 + BANK) = BIT;
-   else                 *(gpioReg + GPSET0 + BANK) = BIT;
+   return 0;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int intCaptureCheck(void)
+{
+   if (captureInfo.buf == NULL)
+      SOFT_ERROR(PI_NO_CAPTURE, "no capture started");
+
+   if (captureInfo.status.state != PI_CAPTURE_DONE)
+      SOFT_ERROR(PI_CAPTURE_NOT_DONE, "capture not complete");
 
    return 0;
 }
 
+static gpioSample_t *intCaptureSample(captureInfo_t *c, unsigned index)
+{
+   /* the oldest pre sample is the one the ring would overwrite next */
 
-/* ----------------------------------------------------------------------- */
+   if (index < c->preCount)
+      return &c->buf[(c->preHead + c->pre - c->preCount + index) % c->pre];
+   else
+      return &c->buf[c->pre + index - c->preCount];
+}
 
-int gpioSetWatchdog(unsigned gpio, unsigned timeout)
+int gpioCaptureRead(unsigned first, gpioSample_t *samples, unsigned maxSamples)
 {
-   DBG(DBG_USER, "gpio=%d timeout=%d", gpio, timeout);
+   unsigned count=0;
+   int status;
+
+   DBG(DBG_USER, "first=%d samples=%08"PRIXPTR" maxSamples=%d",
+      first, (uintptr_t)samples, maxSamples);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   if (!samples)
+      SOFT_ERROR(PI_BAD_POINTER, "samples can't be NULL");
 
-   if (timeout > PI_MAX_WDOG_TIMEOUT)
-      SOFT_ERROR(PI_BAD_WDOG_TIMEOUT,
-         "gpio %d, bad timeout (%d)", gpio, timeout);
+   pthread_mutex_lock(&captureMutex);
 
-   gpioAlert[gpio].wdTick   = systReg[SYST_CLO];
-   gpioAlert[gpio].wdSteadyUs = timeout*1000;
+   status = intCaptureCheck();
 
-   if (timeout) wdogBits |= (1<<gpio);
-   else         wdogBits &= (~(1<<gpio));
+   if (status == 0)
+   {
+      while (((first + count) < captureInfo.status.samples) &&
+             (count < maxSamples))
+      {
+         samples[count] = *intCaptureSample(&captureInfo, first + count);
+         count++;
+      }
+   }
 
-   return 0;
+   pthread_mutex_unlock(&captureMutex);
+
+   if (status < 0) return status;
+
+   return count;
 }
 
 /* ----------------------------------------------------------------------- */
 
-int gpioNoiseFilter(unsigned gpio, unsigned steady, unsigned active)
+int gpioCaptureSave(char *file)
 {
-   DBG(DBG_USER, "gpio=%d steady=%d active=%d", gpio, steady, active);
+   gpioReport_t report[256];
+   gpioSample_t *s;
+   unsigned i, n, count;
+   int handle, status;
+
+   DBG(DBG_USER, "file=%s", file);
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
+   pthread_mutex_lock(&captureMutex);
 
-   if (steady > PI_MAX_STEADY)
-      SOFT_ERROR(PI_BAD_FILTER, "bad steady (%d)", steady);
+   status = intCaptureCheck();
 
-   if (active > PI_MAX_ACTIVE)
-      SOFT_ERROR(PI_BAD_FILTER, "bad active (%d)", active);
+   if (status == 0)
+   {
+      handle = fileOpen(file, PI_FILE_WRITE|PI_FILE_CREATE|PI_FILE_TRUNC);
 
-   gpioAlert[gpio].nfTick1  = systReg[SYST_CLO];
-   gpioAlert[gpio].nfTick2  = gpioAlert[gpio].nfTick1;
-   gpioAlert[gpio].nfSteadyUs = steady;
-   gpioAlert[gpio].nfActiveUs = active;
-   gpioAlert[gpio].nfActive   = 0;
+      if (handle < 0) status = handle;
+   }
 
-   if (steady) nFilterBits |= (1<<gpio);
-   else        nFilterBits &= (~(1<<gpio));
+   count = captureInfo.status.samples;
 
-   return 0;
-}
+   if (status == 0)
+   {
+      n = 0;
+
+      for (i=0; i<count; i++)
+      {
+         s = intCaptureSample(&captureInfo, i);
+
+         report[n].seqno = i;
+         report[n].flags = 0;
+         report[n].tick  = s->tick;
+         report[n].level = s->level;
+
+         if ((++n == 256) || ((i+1) == count))
+         {
+            status = fileWrite(handle, (char *)report, n*sizeof(gpioReport_t));
+
+            if (status < 0) break;
+
+            n = 0;
+         }
+      }
+
+      fileClose(handle);
+   }
+
+   pthread_mutex_unlock(&captureMutex);
+
+   if (status < 0) return status;
 
+   return count;
+}
 
 /* ----------------------------------------------------------------------- */
 
-int gpioGlitchFilter(unsigned gpio, unsigned steady)
+int gpioCaptureStop(void)
 {
-   DBG(DBG_USER, "gpio=%d steady=%d", gpio, steady);
+   DBG(DBG_USER, "");
 
    CHECK_INITED;
 
-   if (gpio > PI_MAX_USER_GPIO)
-      SOFT_ERROR(PI_BAD_USER_GPIO, "bad gpio (%d)", gpio);
-
-   if (steady > PI_MAX_STEADY)
-      SOFT_ERROR(PI_BAD_FILTER, "bad steady (%d)", steady);
+   pthread_mutex_lock(&captureMutex);
 
-   if (steady)
+   if (captureInfo.buf == NULL)
    {
-      /* Initialise values next time we process alerts */
-      gpioAlert[gpio].gfInitialised = 0;
+      pthread_mutex_unlock(&captureMutex);
+      SOFT_ERROR(PI_NO_CAPTURE, "no capture started");
    }
 
-   gpioAlert[gpio].gfSteadyUs = steady;
+   captureBits = 0;
 
-   if (steady) gFilterBits |= (1<<gpio);
-   else        gFilterBits &= (~(1<<gpio));
+   alertUpdateMonitorBits();
+
+   free(captureInfo.buf);
+
+   memset(&captureInfo, 0, sizeof(captureInfo_t));
+
+   pthread_mutex_unlock(&captureMutex);
 
    return 0;
 }
@@ -12392,7 +16283,7 @@ int gpioSetGetSamplesFunc(gpioGetSamplesFunc_t f, uint32_t bits)
    if (f) gpioGetSamples.bits = bits;
    else   gpioGetSamples.bits = 0;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   alertUpdateMonitorBits();
 
    return 0;
 }
@@ -12415,7 +16306,34 @@ int gpioSetGetSamplesFuncEx(gpioGetSamplesFuncEx_t f,
    if (f) gpioGetSamples.bits = bits;
    else   gpioGetSamples.bits = 0;
 
-   monitorBits = alertBits | notifyBits | scriptBits | gpioGetSamples.bits;
+   alertUpdateMonitorBits();
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetCallbackStats(gpioCallbackStats_t *stats)
+{
+   uint32_t calls;
+   uint64_t total;
+
+   DBG(DBG_USER, "stats=%08"PRIXPTR, (uintptr_t)stats);
+
+   CHECK_INITED;
+
+   if (!stats)
+      SOFT_ERROR(PI_BAD_POINTER, "stats can't be NULL");
+
+   calls = __atomic_load_n(&gpioStats.cbRun, __ATOMIC_RELAXED);
+   total = __atomic_load_n(&gpioStats.cbTotalLatency, __ATOMIC_RELAXED);
+
+   stats->calls       = calls;
+   stats->dropped     = __atomic_load_n(&gpioStats.cbDropped, __ATOMIC_RELAXED);
+   stats->maxLatency  = gpioStats.cbMaxLatency;
+   stats->meanLatency = calls ? (uint32_t)(total / calls) : 0;
+   stats->maxDuration = gpioStats.cbMaxDuration;
 
    return 0;
 }
@@ -12424,70 +16342,60 @@ int gpioSetGetSamplesFuncEx(gpioGetSamplesFuncEx_t f,
 /* ----------------------------------------------------------------------- */
 
 static int intGpioSetTimerFunc(unsigned id,
-                               unsigned millis,
+                               unsigned micros,
                                void *f,
                                int user,
                                void *userdata)
 {
-   pthread_attr_t pthAttr;
+   int status;
+   gpioTimer_t *t = &gpioTimer[id];
+
+   DBG(DBG_INTERNAL, "id=%d micros=%d function=%08"PRIXPTR" user=%d userdata=%08"PRIXPTR,
+      id, micros, (uintptr_t)f, user, (uintptr_t)userdata);
 
-   DBG(DBG_INTERNAL, "id=%d millis=%d function=%08"PRIXPTR" user=%d userdata=%08"PRIXPTR,
-      id, millis, (uintptr_t)f, user, (uintptr_t)userdata);
+   pthread_mutex_lock(&timerMutex);
 
-   gpioTimer[id].id   = id;
+   t->id = id;
 
    if (f)
    {
-      gpioTimer[id].func     = f;
-      gpioTimer[id].ex       = user;
-      gpioTimer[id].userdata = userdata;
-      gpioTimer[id].millis   = millis;
+      status = timerStart();
 
-      if (!gpioTimer[id].running)
+      if (status)
       {
-         if (pthread_attr_init(&pthAttr))
-            SOFT_ERROR(PI_TIMER_FAILED,
-               "pthread_attr_init failed (%m)");
+         pthread_mutex_unlock(&timerMutex);
+         return status;
+      }
 
-         if (pthread_attr_setstacksize(&pthAttr, STACK_SIZE))
-            SOFT_ERROR(PI_TIMER_FAILED,
-               "pthread_attr_setstacksize failed (%m)");
+      t->func     = f;
+      t->ex       = user;
+      t->userdata = userdata;
+      t->micros   = micros;
+      t->due      = timerNanos() + (micros * 1000ULL);
 
-         if (pthread_create(
-            &gpioTimer[id].pthId, &pthAttr, pthTimerTick, &gpioTimer[id]))
-               SOFT_ERROR(PI_TIMER_FAILED,
-                  "timer %d, create failed (%m)", id);
+      t->totalJitter = 0;
+      memset(&t->stats, 0, sizeof(t->stats));
 
-         gpioTimer[id].running = 1;
-      }
+      pthread_cond_signal(&timerCond);
    }
    else
    {
-      if (gpioTimer[id].running)
-      {
-
-         /* destroy thread */
-
-         if (pthread_self() == gpioTimer[id].pthId)
-         {
-            gpioTimer[id].running = 0;
-            gpioTimer[id].func    = 0;
-            pthread_exit(NULL);
-         }
-         else
-         {
-            if (pthread_cancel(gpioTimer[id].pthId))
-               SOFT_ERROR(PI_TIMER_FAILED, "timer %d, cancel failed (%m)", id);
+      t->func = NULL;
 
-            if (pthread_join(gpioTimer[id].pthId, NULL))
-               SOFT_ERROR(PI_TIMER_FAILED, "timer %d, join failed (%m)", id);
+      /*
+      Wait for a running call.  Not from a timer function, it may be
+      cancelling itself, or a timer which is cancelling it.
+      */
 
-            gpioTimer[id].running = 0;
-            gpioTimer[id].func    = 0;
-         }
+      if (!timerCalledFromTimer())
+      {
+         while (t->running)
+            pthread_cond_wait(&timerIdleCond, &timerMutex);
       }
    }
 
+   pthread_mutex_unlock(&timerMutex);
+
    return 0;
 }
 
@@ -12509,9 +16417,7 @@ int gpioSetTimerFunc(unsigned id, unsigned millis, gpioTimerFunc_t f)
          SOFT_ERROR(PI_BAD_MS, "timer %d, bad millis (%d)", id, millis);
    }
 
-   intGpioSetTimerFunc(id, millis, f, 0, NULL);
-
-   return 0;
+   return intGpioSetTimerFunc(id, millis * THOUSAND, f, 0, NULL);
 }
 
 
@@ -12531,7 +16437,53 @@ int gpioSetTimerFuncEx(unsigned id, unsigned millis, gpioTimerFuncEx_t f,
    if ((millis < PI_MIN_MS) || (millis > PI_MAX_MS))
       SOFT_ERROR(PI_BAD_MS, "timer %d, bad millis (%d)", id, millis);
 
-   intGpioSetTimerFunc(id, millis, f, 1, userdata);
+   return intGpioSetTimerFunc(id, millis * THOUSAND, f, 1, userdata);
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioSetTimerFuncMicros(unsigned id, unsigned micros, gpioTimerFuncEx_t f,
+                           void * userdata)
+{
+   DBG(DBG_USER, "id=%d micros=%d function=%08"PRIXPTR", userdata=%08"PRIXPTR,
+      id, micros, (uintptr_t)f, (uintptr_t)userdata);
+
+   CHECK_INITED;
+
+   if (id > PI_MAX_TIMER)
+      SOFT_ERROR(PI_BAD_TIMER, "bad timer id (%d)", id);
+
+   if (f)
+   {
+      if ((micros < PI_MIN_TIMER_MICROS) || (micros > PI_MAX_TIMER_MICROS))
+         SOFT_ERROR(PI_BAD_TIMER_MICROS,
+            "timer %d, bad micros (%d)", id, micros);
+   }
+
+   return intGpioSetTimerFunc(id, micros, f, 1, userdata);
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioGetTimerStats(unsigned id, gpioTimerStats_t *stats)
+{
+   DBG(DBG_USER, "id=%d stats=%08"PRIXPTR, id, (uintptr_t)stats);
+
+   CHECK_INITED;
+
+   if (id > PI_MAX_TIMER)
+      SOFT_ERROR(PI_BAD_TIMER, "bad timer id (%d)", id);
+
+   if (stats == NULL)
+      SOFT_ERROR(PI_BAD_POINTER, "NULL stats");
+
+   pthread_mutex_lock(&timerMutex);
+
+   *stats = gpioTimer[id].stats;
+
+   pthread_mutex_unlock(&timerMutex);
 
    return 0;
 }
@@ -13972,6 +17924,100 @@ int gpioCfgSocketPort(unsigned port)
 }
 
 
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgSocketWorkers(unsigned workers)
+{
+   DBG(DBG_USER, "workers=%d", workers);
+
+   CHECK_NOT_INITED;
+
+   if ((workers < PI_MIN_SOCKET_WORKERS) || (workers > PI_MAX_SOCKET_WORKERS))
+      SOFT_ERROR(PI_BAD_SOCK_WORKERS, "bad socket workers (%d)", workers);
+
+   gpioCfg.socketWorkers = workers;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgCallbackWorkers(unsigned workers)
+{
+   DBG(DBG_USER, "workers=%d", workers);
+
+   CHECK_NOT_INITED;
+
+   if (workers > PI_MAX_CALLBACK_WORKERS)
+      SOFT_ERROR(PI_BAD_CB_WORKERS, "bad callback workers (%d)", workers);
+
+   gpioCfg.callbackWorkers = workers;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgTimerWorkers(unsigned workers)
+{
+   DBG(DBG_USER, "workers=%d", workers);
+
+   CHECK_NOT_INITED;
+
+   if (workers > PI_MAX_TIMER_WORKERS)
+      SOFT_ERROR(PI_BAD_TIMER_WORKERS, "bad timer workers (%d)", workers);
+
+   gpioCfg.timerWorkers = workers;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgAlertPoll(unsigned minMicros, unsigned maxMicros)
+{
+   DBG(DBG_USER, "minMicros=%d maxMicros=%d", minMicros, maxMicros);
+
+   CHECK_NOT_INITED;
+
+   if (minMicros || maxMicros)
+   {
+      if ((minMicros < PI_MIN_ALERT_POLL) ||
+          (maxMicros > PI_MAX_ALERT_POLL) ||
+          (minMicros > maxMicros))
+         SOFT_ERROR(PI_BAD_ALERT_POLL, "bad alert poll (%d-%d)",
+            minMicros, maxMicros);
+   }
+
+   gpioCfg.alertPollMin = minMicros;
+   gpioCfg.alertPollMax = maxMicros;
+
+   return 0;
+}
+
+
+/* ----------------------------------------------------------------------- */
+
+int gpioCfgSocketPath(const char *path)
+{
+   DBG(DBG_USER, "path=%s", path ? path : "");
+
+   CHECK_NOT_INITED;
+
+   if (path == NULL) path = "";
+
+   if (strlen(path) >= sizeof(sockUnixPath))
+      SOFT_ERROR(PI_BAD_SOCKET_PATH, "bad socket path (%s)", path);
+
+   strcpy(sockUnixPath, path);
+
+   return 0;
+}
+
+
 /* ----------------------------------------------------------------------- */
 
 int gpioCfgMemAlloc(unsigned memAllocMode)
@@ -174,6 +174,8 @@ gpioSetAlertFuncEx         Request a GPIO change callback, extended
 
 gpioSetTimerFunc           Request a regular timed callback
 gpioSetTimerFuncEx         Request a regular timed callback, extended
+gpioSetTimerFuncMicros     Request a timed callback, microsecond period
+gpioGetTimerStats          Get the jitter statistics of a timer
 
 gpioStartThread            Start a new thread
 gpioStopThread             Stop a previously started thread
@@ -183,6 +185,10 @@ ADVANCED
 gpioNotifyOpen             Request a notification handle
 gpioNotifyClose            Close a notification
 gpioNotifyOpenWithSize     Request a notification with sized pipe
+gpioNotifyOpenWithFormat   Request a notification with compact reports
+gpioNotifyOpenShared       Request a notification via shared memory
+gpioNotifyGetQueued        Reports waiting to be sent for a notification
+gpioNotifyGetDropped       Reports dropped for a notification
 gpioNotifyBegin            Start notifications for selected GPIO
 gpioNotifyPause            Pause notifications
 
@@ -193,6 +199,20 @@ gpioHardwarePWM            Start hardware PWM on supported GPIO
 gpioGlitchFilter           Set a glitch filter on a GPIO
 gpioNoiseFilter            Set a noise filter on a GPIO
 
+gpioSetMeter               Start or stop an edge meter on a GPIO
+gpioGetMeter               Get the edge counts and frequency of a GPIO
+
+gpioEncoderOpen            Start decoding a quadrature encoder
+gpioEncoderClose           Stop decoding a quadrature encoder
+gpioEncoderGet             Get the position and velocity of an encoder
+gpioEncoderSetEvent        Trigger an event when an encoder moves
+
+gpioCaptureStart           Start a triggered capture of GPIO samples
+gpioCaptureStatus          Get the state of a capture
+gpioCaptureRead            Read the samples of a capture
+gpioCaptureSave            Save the samples of a capture to a file
+gpioCaptureStop            Stop a capture and free its samples
+
 gpioSetPad                 Sets a pads drive strength
 gpioGetPad                 Gets a pads drive strength
 
@@ -207,6 +227,8 @@ gpioSetSignalFuncEx        Request a signal callback, extended
 gpioSetGetSamplesFunc      Requests a GPIO samples callback
 gpioSetGetSamplesFuncEx    Requests a GPIO samples callback, extended
 
+gpioGetCallbackStats       Get callback latency statistics
+
 Custom
 
 gpioCustom1                User custom function 1
@@ -295,6 +317,13 @@ gpioSerialReadClose        Closes a GPIO for bit bang serial reads
 gpioSerialReadInvert       Configures normal/inverted for serial reads
 
 gpioSerialRead             Reads bit bang serial data from a GPIO
+gpioSerialReadErrors       Returns the framing errors of serial reads
+
+gpioWiegandReadOpen        Opens two GPIO for Wiegand reads
+gpioIRReadOpen             Opens a GPIO for IR remote reads
+gpioI2CSniffOpen           Opens two GPIO to sniff an I2C bus
+gpioDecodeRead             Reads decoded Wiegand, IR, or I2C frames
+gpioDecodeReadClose        Closes a GPIO for Wiegand, IR, or I2C reads
 
 SPI
 
@@ -334,7 +363,16 @@ gpioWaveAddSerial          Adds serial data to the waveform
 
 gpioWaveCreate             Creates a waveform from added data
 gpioWaveCreatePad          Creates a waveform of fixed size from added data
+gpioWaveCreateShared       Creates a waveform which may be shared
 gpioWaveDelete             Deletes a waveform
+gpioWaveFragmentation      Reports the free wave CB and OOL space
+gpioWaveGetCacheStats      Gets the wave cache hits and misses
+
+gpioWaveStreamOpen         Opens a ring of segments for streaming pulses
+gpioWaveStreamSetEvent     Triggers an event when few segments are queued
+gpioWaveStreamWrite        Queues a segment of pulses on the stream
+gpioWaveStreamStatus       Gets the state of the stream
+gpioWaveStreamClose        Stops the stream and frees its segments
 
 gpioWaveTxSend             Transmits a waveform
 
@@ -385,6 +423,11 @@ gpioCfgDMAchannels         Configure the DMA channels
 gpioCfgPermissions         Configure the GPIO access permissions
 gpioCfgInterfaces          Configure user interfaces
 gpioCfgSocketPort          Configure socket port
+gpioCfgSocketWorkers       Configure socket worker threads
+gpioCfgCallbackWorkers     Configure callback worker threads
+gpioCfgTimerWorkers        Configure timer callback worker threads
+gpioCfgAlertPoll           Configure adaptive alert polling
+gpioCfgSocketPath          Configure Unix domain socket path
 gpioCfgMemAlloc            Configure DMA memory allocation mode
 gpioCfgNetAddr             Configure allowed network addresses
 
@@ -416,6 +459,8 @@ OVERVIEW*/
 #define PI_ENVPORT "PIGPIO_PORT"
 #define PI_ENVADDR "PIGPIO_ADDR"
 
+#define PI_UNIX_ADDR_PREFIX "unix:"
+
 #define PI_LOCKFILE "/var/run/pigpio.pid"
 
 #define PI_I2C_COMBINED "/sys/module/i2c_bcm2708/parameters/combined"
@@ -451,6 +496,109 @@ typedef struct
    uint32_t level;
 } gpioReport_t;
 
+typedef struct
+{
+   uint32_t magic;    // PI_NOTIFY_RING_MAGIC once initialised
+   uint32_t size;     // reports in the ring, a power of 2
+   uint32_t closed;   // set when the notification is closed
+   uint32_t pad0[13];
+   uint32_t head;     // reports written, by the daemon
+   uint32_t overruns; // reports dropped as the ring was full
+   uint32_t waiting;  // set by a reader parked on head
+   uint32_t pad1[13];
+   uint32_t tail;     // reports read, by the reader
+   uint32_t pad2[15];
+} gpioNotifyRing_t;
+
+typedef struct
+{
+   uint32_t calls;       // callbacks run
+   uint32_t dropped;     // callbacks dropped as a queue was full
+   uint32_t maxLatency;  // longest queue to start, microseconds
+   uint32_t meanLatency; // mean queue to start, microseconds
+   uint32_t maxDuration; // longest callback, microseconds
+} gpioCallbackStats_t;
+
+typedef struct
+{
+   uint32_t calls;       // callbacks run
+   uint32_t missed;      // periods skipped, the callback overran
+   uint32_t maxJitter;   // latest start after the due time, microseconds
+   uint32_t meanJitter;  // mean start after the due time, microseconds
+   uint32_t maxDuration; // longest callback, microseconds
+} gpioTimerStats_t;
+
+typedef struct
+{
+   uint32_t rising;    // rising edges since the meter was started
+   uint32_t falling;   // falling edges since the meter was started
+   uint32_t window;    // length of the last window, microseconds
+   uint32_t edges;     // rising edges in the last window
+   uint32_t frequency; // millihertz
+   uint32_t period;    // mean period, nanoseconds
+   uint32_t pulse;     // mean high pulse, nanoseconds
+   uint32_t duty;      // time high, parts per million
+} gpioMeter_t;
+
+typedef struct
+{
+   int32_t  position;      // counts, four per cycle
+   int32_t  velocity;      // counts per second
+   uint32_t errors;        // steps missed (A and B changed together)
+   uint32_t indexes;       // rising edges of the index GPIO
+   int32_t  indexPosition; // position at the last index
+   uint32_t tick;          // tick of the last position change
+} gpioEncoder_t;
+
+typedef struct
+{
+   uint32_t tick;     // tick of the first edge of the frame
+   uint32_t code;     // the decoded value
+   uint16_t bits;     // bits in the frame
+   uint8_t  protocol; // PI_DECODE_WIEGAND, _NEC, _RC5, or _I2C
+   uint8_t  flags;    // PI_DECODE_REPEAT, _TOGGLE, _BAD_CHECK, _START, ...
+} gpioFrame_t;
+
+typedef struct
+{
+   uint32_t state;   // PI_CAPTURE_ARMED, _TRIGGERED, or _DONE
+   uint32_t samples; // samples held
+   uint32_t trigger; // index of the trigger sample
+   uint32_t tick;    // tick of the trigger sample
+   uint32_t gaps;    // times samples were lost during the capture
+} gpioCapture_t;
+
+typedef struct
+{
+   uint32_t waves;       // waves in use
+   uint32_t cbs;         // CBs available to waves
+   uint32_t freeCBs;     // CBs free
+   uint32_t largestCBs;  // CBs in the largest free range
+   uint32_t holesCB;     // free CB ranges
+   uint32_t ools;        // OOL available to waves
+   uint32_t freeOOLs;    // OOL free
+   uint32_t largestOOLs; // OOL in the largest free range
+   uint32_t holesOOL;    // free OOL ranges
+} gpioWaveFrag_t;
+
+typedef struct
+{
+   uint32_t hits;   // creates which returned an existing wave
+   uint32_t misses; // creates which made a new wave which may be shared
+   uint32_t waves;  // waves which may be shared
+   uint32_t refs;   // creates of those waves not yet deleted
+} gpioWaveCacheStats_t;
+
+typedef struct
+{
+   uint32_t segments;  // segments in the ring
+   uint32_t segPulses; // most pulses per segment
+   uint32_t queued;    // segments written but not yet played
+   uint32_t written;   // segments written since the stream was opened
+   uint32_t played;    // segments played (or dropped by a stop)
+   uint32_t underruns; // gaps, the output ran out of segments
+} gpioWaveStream_t;
+
 typedef struct
 {
    uint32_t gpioOn;
@@ -656,6 +804,7 @@ typedef void *(gpioThreadFunc_t) (void *);
 
 #define PI_NOTIFY_SLOTS  32
 
+#define PI_NTFY_FLAGS_GAP      (1 <<8)
 #define PI_NTFY_FLAGS_EVENT    (1 <<7)
 #define PI_NTFY_FLAGS_ALIVE    (1 <<6)
 #define PI_NTFY_FLAGS_WDOG     (1 <<5)
@@ -672,11 +821,40 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_BB_SPI_MAX_BAUD 250000
 
 #define PI_BB_SER_MIN_BAUD     50
-#define PI_BB_SER_MAX_BAUD 250000
+#define PI_BB_SER_MAX_BAUD 333333
 
 #define PI_BB_SER_NORMAL 0
 #define PI_BB_SER_INVERT 1
 
+/* gpioFrame_t protocol */
+
+#define PI_DECODE_WIEGAND 0
+#define PI_DECODE_NEC     1
+#define PI_DECODE_RC5     2
+#define PI_DECODE_I2C     3
+
+/* gpioFrame_t flags */
+
+#define PI_DECODE_REPEAT    1
+#define PI_DECODE_TOGGLE    2
+#define PI_DECODE_BAD_CHECK 4
+#define PI_DECODE_START     8
+#define PI_DECODE_NACK     16
+#define PI_DECODE_STOP     32
+
+/* capture */
+
+#define PI_MAX_CAPTURE_SAMPLES 1000000
+
+#define PI_CAPTURE_NOW    0
+#define PI_CAPTURE_LEVEL  1
+#define PI_CAPTURE_EDGE   2
+#define PI_CAPTURE_CHANGE 3
+
+#define PI_CAPTURE_ARMED     1
+#define PI_CAPTURE_TRIGGERED 2
+#define PI_CAPTURE_DONE      3
+
 #define PI_WAVE_MIN_BAUD      50
 #define PI_WAVE_MAX_BAUD 1000000
 
@@ -693,6 +871,11 @@ typedef void *(gpioThreadFunc_t) (void *);
 
 #define PI_MAX_WAVES 250
 
+/* wave stream */
+
+#define PI_MIN_STREAM_SEGS 2
+#define PI_MAX_STREAM_SEGS 64
+
 #define PI_MAX_WAVE_CYCLES 65535
 #define PI_MAX_WAVE_DELAY  65535
 
@@ -824,6 +1007,19 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_MIN_WDOG_TIMEOUT 0
 #define PI_MAX_WDOG_TIMEOUT 60000
 
+/* windowMillis: 0, 10-60000 */
+
+#define PI_MIN_METER_WINDOW 10
+#define PI_MAX_METER_WINDOW 60000
+
+/* encoders */
+
+#define PI_MAX_ENCODERS 8
+
+#define PI_ENCODER_NO_INDEX 32
+
+#define PI_MAX_ENCODER_EVENT 60000
+
 /* timer: 0-9 */
 
 #define PI_MIN_TIMER 0
@@ -834,6 +1030,11 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_MIN_MS 10
 #define PI_MAX_MS 60000
 
+/* timer micros: 100-60000000 */
+
+#define PI_MIN_TIMER_MICROS 100
+#define PI_MAX_TIMER_MICROS 60000000
+
 #define PI_MAX_SCRIPTS       32
 
 #define PI_MAX_SCRIPT_TAGS   50
@@ -883,6 +1084,57 @@ typedef void *(gpioThreadFunc_t) (void *);
 #define PI_MIN_SOCKET_PORT 1024
 #define PI_MAX_SOCKET_PORT 32000
 
+/* socket workers */
+
+#define PI_MIN_SOCKET_WORKERS 1
+#define PI_MAX_SOCKET_WORKERS 64
+
+/* callback workers */
+
+#define PI_MAX_CALLBACK_WORKERS 16
+
+/* timer workers */
+
+#define PI_MAX_TIMER_WORKERS 10
+
+/* alert poll: microseconds */
+
+#define PI_MIN_ALERT_POLL 50
+#define PI_MAX_ALERT_POLL 50000
+
+/* batch: bytes of commands in a PI_CMD_BATCH extension */
+
+#define PI_MAX_BATCH_LEN 8192
+
+/* reports: shared memory notification ring entries, a power of 2 */
+
+#define PI_MIN_NOTIFY_RING 16
+#define PI_MAX_NOTIFY_RING 65536
+
+#define PI_NOTIFY_RING_NAME  "/pigpio-notify%d"
+#define PI_NOTIFY_RING_MAGIC 0x4e524750 /* "PGRN" */
+
+#define PI_NOTIFY_RING_BYTES(reports) \
+   (sizeof(gpioNotifyRing_t) + ((reports) * sizeof(gpioReport_t)))
+
+#define PI_NOTIFY_RING_REPORTS(ring) ((gpioReport_t *)((ring) + 1))
+
+/* format: notification stream format */
+
+#define PI_NOTIFY_FORMAT_V1 0
+#define PI_NOTIFY_FORMAT_V2 1
+
+#define PI_NOTIFY_V2_MAGIC 0x324e4750 /* "PGN2" */
+
+/* v2 record head kind bits, the tick delta is held above them */
+
+#define PI_NOTIFY_V2_SEQNO 1
+#define PI_NOTIFY_V2_FLAGS 2
+#define PI_NOTIFY_V2_BIT   4
+#define PI_NOTIFY_V2_SHIFT 3
+
+#define PI_NOTIFY_V2_MAX_RECORD 16
+
 
 /* ifFlags: */
 
@@ -1654,6 +1906,10 @@ from /dev/pigpio15.
 Socket notifications are returned to the socket which requested the
 handle.
 
+The reports are queued for delivery by a writer thread.  If a
+consumer falls too far behind reports are dropped rather than
+delaying other consumers, see [*gpioNotifyGetDropped*].
+
 ...
 h = gpioNotifyOpen();
 
@@ -1692,6 +1948,96 @@ See [*gpioNotifyOpen*] for further details.
 D*/
 
 
+/*F*/
+int gpioNotifyOpenWithFormat(unsigned format);
+/*D
+This function requests a free notification handle whose pipe
+carries reports in the given format.
+
+. .
+format: PI_NOTIFY_FORMAT_V1 or PI_NOTIFY_FORMAT_V2
+. .
+
+Returns a handle greater than or equal to zero if OK,
+otherwise PI_BAD_NOTIFY_FORMAT, PI_NO_HANDLE, or PI_BAD_PATHNAME.
+
+PI_NOTIFY_FORMAT_V1 is the gpioReport_t stream written by
+[*gpioNotifyOpen*].
+
+PI_NOTIFY_FORMAT_V2 is a compact stream, typically 2 or 3 bytes
+per level change rather than 12.  It starts with the 4 bytes of
+PI_NOTIFY_V2_MAGIC (little endian) followed by one record per report.
+
+. .
+head   varint: tick delta << PI_NOTIFY_V2_SHIFT | kind bits
+seqno  varint, present if kind & PI_NOTIFY_V2_SEQNO
+flags  varint, present if kind & PI_NOTIFY_V2_FLAGS
+level  one byte GPIO number if kind & PI_NOTIFY_V2_BIT,
+       otherwise varint XOR with the previous level
+. .
+
+Varints are little endian base 128 with the top bit of each byte
+set if another byte follows.  The tick delta and level XOR are
+relative to the previous report (zero before the first).  The
+seqno is only present if it is not one more than the previous
+seqno, i.e. after reports have been dropped.
+
+See [*gpioNotifyOpen*] for further details.
+D*/
+
+
+/*F*/
+int gpioNotifyOpenShared(unsigned reports);
+/*D
+This function requests a free notification handle whose reports
+are written to shared memory rather than to a pipe.
+
+. .
+reports: 16-65536, a power of 2
+. .
+
+Returns a handle greater than or equal to zero if OK,
+otherwise PI_BAD_NOTIFY_RING, PI_NO_HANDLE, or PI_BAD_PATHNAME.
+
+The reports for handle x are written to a ring in the POSIX shared
+memory object named /pigpio-notifyx (see PI_NOTIFY_RING_NAME).
+The object holds a [*gpioNotifyRing_t*] header followed by
+[*reports*] gpioReport_t entries (see [*gpioNotifyBegin*]).
+
+Report n is held at entry n % size.  The alert thread writes
+the reports and then advances head.  The reader consumes the
+reports from tail to head and then advances tail.  Neither side
+makes a system call.
+
+The alert thread never waits for the reader.  If the ring is full
+new reports are dropped and counted in overruns.  The report seqno
+also skips the dropped reports.
+
+A reader may sleep until new reports arrive by setting waiting
+and then, if head is unchanged, waiting on a futex at head.
+
+closed is set when the handle is closed.
+
+...
+h = gpioNotifyOpenShared(4096);
+
+if (h >= 0)
+{
+   sprintf(str, PI_NOTIFY_RING_NAME, h);
+
+   fd = shm_open(str, O_RDWR, 0);
+
+   ring = mmap(0, PI_NOTIFY_RING_BYTES(4096),
+      PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+   report = PI_NOTIFY_RING_REPORTS(ring);
+
+   gpioNotifyBegin(h, 1<<4);
+}
+...
+D*/
+
+
 /*F*/
 int gpioNotifyBegin(unsigned handle, uint32_t bits);
 /*D
@@ -1723,8 +2069,8 @@ typedef struct
 seqno: starts at 0 each time the handle is opened and then increments
 by one for each report.
 
-flags: three flags are defined, PI_NTFY_FLAGS_WDOG,
-PI_NTFY_FLAGS_ALIVE, and PI_NTFY_FLAGS_EVENT.
+flags: four flags are defined, PI_NTFY_FLAGS_WDOG,
+PI_NTFY_FLAGS_ALIVE, PI_NTFY_FLAGS_EVENT, and PI_NTFY_FLAGS_GAP.
 
 If bit 5 is set (PI_NTFY_FLAGS_WDOG) then bits 0-4 of the flags
 indicate a GPIO which has had a watchdog timeout.
@@ -1736,6 +2082,13 @@ of other notification activity.
 If bit 7 is set (PI_NTFY_FLAGS_EVENT) then bits 0-4 of the flags
 indicate an event which has been triggered.
 
+If bit 8 is set (PI_NTFY_FLAGS_GAP) then samples were lost because
+the DMA sample buffer was overwritten before it was read.  Sampling
+resumed at tick.  The level is the last level reported before the
+gap, any change during the gap is reported at or after tick.  A gap
+while the notification is paused is reported when it resumes.  See
+[*gpioCfgBufferSize*].
+
 tick: the number of microseconds since system boot.  It wraps around
 after 1h12m.
 
@@ -1792,6 +2145,44 @@ gpioNotifyClose(h);
 D*/
 
 
+/*F*/
+int gpioNotifyGetQueued(unsigned handle);
+/*D
+This function returns the number of reports waiting to be
+delivered on a previously opened handle.
+
+. .
+handle: >=0, as returned by [*gpioNotifyOpen*]
+. .
+
+Returns the number of reports if OK, otherwise PI_BAD_HANDLE.
+
+Pipe and socket reports are queued by the alert thread and
+written by a separate writer thread, so a slow consumer never
+delays the alert thread.  Each handle queues at most 2048 reports.
+
+For a [*gpioNotifyOpenShared*] handle the reports in the ring
+not yet read are returned.
+D*/
+
+
+/*F*/
+int gpioNotifyGetDropped(unsigned handle);
+/*D
+This function returns the number of reports dropped on a
+previously opened handle because its consumer fell behind.
+
+. .
+handle: >=0, as returned by [*gpioNotifyOpen*]
+. .
+
+Returns the number of reports if OK, otherwise PI_BAD_HANDLE.
+
+Reports are dropped when the handle's queue (or shared memory
+ring) is full.  The report seqno skips the dropped reports.
+D*/
+
+
 /*F*/
 int gpioWaveClear(void);
 /*D
@@ -1841,6 +2232,10 @@ The pulses are interleaved in time order within the existing waveform
 Merging allows the waveform to be built in parts, that is the settings
 for GPIO#1 can be added, and then GPIO#2 etc.
 
+The adds are held apart and merged once, when the waveform is
+created, so the cost of an add depends on its own pulses rather
+than on the size of the waveform so far.
+
 If the added waveform is intended to start after or within the existing
 waveform then the first pulse should consist of a delay.
 
@@ -1959,6 +2354,9 @@ function.
 As many waveforms may be created as there is space available.  The
 wave id is passed to [*gpioWaveTxSend*] to specify the waveform to transmit.
 
+Each call makes a new wave.  See [*gpioWaveCreateShared*] to reuse
+an existing wave made from the same pulses.
+
 Normal usage would be
 
 Step 1. [*gpioWaveClear*] to clear all waveforms and added data.
@@ -2000,6 +2398,40 @@ PI_NO_WAVEFORM_ID, PI_TOO_MANY_CBS, or PI_TOO_MANY_OOL.
 D*/
 
 
+/*F*/
+int gpioWaveCreateShared(void);
+/*D
+This function creates a waveform like [*gpioWaveCreate*] but, if a
+wave made from the same pulses by an earlier call of this function
+still exists, returns its id and makes no new wave.
+
+Returns the waveform id if OK, otherwise PI_EMPTY_WAVEFORM,
+PI_NO_WAVEFORM_ID, PI_TOO_MANY_CBS, or PI_TOO_MANY_OOL.
+
+The wave is reference counted.  Each call which returns it must be
+matched by a [*gpioWaveDelete*].  Until the last of those deletes
+the wave id stays valid, its CBs and OOL are not freed, and it may
+still be sent, so a caller must not rely on a delete to stop
+another user of the same wave.
+
+Only waves made by this function are shared.  Waves made by
+[*gpioWaveCreate*] or [*gpioWaveCreatePad*], and waves which read
+GPIO such as those of [*rawWaveAddSPI*], are never shared.  See
+[*gpioWaveGetCacheStats*].
+
+...
+gpioWaveAddGeneric(2, pulses);
+a = gpioWaveCreateShared();
+
+gpioWaveAddGeneric(2, pulses);
+b = gpioWaveCreateShared(); // b == a, no new wave
+
+gpioWaveDelete(a); // b is still valid
+gpioWaveDelete(b); // the wave is freed
+...
+D*/
+
+
 /*F*/
 int gpioWaveCreatePad(int pctCB, int pctBOOL, int pctTOOL);
 /*D
@@ -2048,14 +2480,14 @@ int gpioWaveDelete(unsigned wave_id);
 /*D
 This function deletes the waveform with id wave_id.
 
-The wave is flagged for deletion.  The resources used by the wave
-will only be reused when either of the following apply.
+The CBs and OOL used by the wave are freed and merged with any
+free space either side.  A new wave is placed in the smallest free
+range which will hold it, so waves of different sizes may be
+created and deleted without calling [*gpioWaveClear*].
 
-- all waves with higher numbered wave ids have been deleted or have
-been flagged for deletion.
-
-- a new wave is created which uses exactly the same resources as
-the current wave (see the C source for gpioWaveCreate for details).
+A wave returned by more than one [*gpioWaveCreateShared*] is only
+freed by the last of the matching deletes.  The earlier deletes
+return 0 but leave the wave id valid and the wave in place.
 
 . .
 wave_id: >=0, as returned by [*gpioWaveCreate*]
@@ -2066,6 +2498,171 @@ Wave ids are allocated in order, 0, 1, 2, etc.
 Returns 0 if OK, otherwise PI_BAD_WAVE_ID.
 D*/
 
+/*F*/
+int gpioWaveFragmentation(gpioWaveFrag_t *frag);
+/*D
+This function reports how the CB and OOL space used by waves is
+split into free ranges.
+
+. .
+frag: a pointer to a [*gpioWaveFrag_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_POINTER.
+
+A wave needing more CBs than largestCBs, or more OOL than
+largestOOLs, can not be created until other waves are deleted,
+even if freeCBs or freeOOLs is large enough.
+
+...
+gpioWaveFrag_t frag;
+
+gpioWaveFragmentation(&frag);
+
+printf("%d waves, largest free CB range %d of %d free\n",
+   frag.waves, frag.largestCBs, frag.freeCBs);
+...
+D*/
+
+/*F*/
+int gpioWaveGetCacheStats(gpioWaveCacheStats_t *stats);
+/*D
+This function gets the statistics of the wave cache, which lets
+[*gpioWaveCreateShared*] return an existing wave made from the same
+pulses.
+
+. .
+stats: a pointer to a [*gpioWaveCacheStats_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_POINTER.
+
+The hits and misses are counted from [*gpioInitialise*].
+D*/
+
+
+/*F*/
+int gpioWaveStreamOpen(unsigned segments, unsigned segPulses);
+/*D
+This function opens a wave stream, a ring of segments which are
+played one after the other while the earlier ones are refilled.
+There is no limit to the length of the pulse train.
+
+. .
+ segments: 2-64, the segments in the ring
+segPulses: 1-12000, the most pulses in a segment
+. .
+
+Returns 0 if OK, otherwise PI_BAD_WAVE_STREAM, PI_TOO_MANY_CBS, or
+PI_TOO_MANY_OOL.
+
+The segments are taken from the same CB and OOL space as waves
+and are returned by [*gpioWaveStreamClose*] or [*gpioWaveClear*].
+Opening a stream closes any earlier stream.
+
+Each segment is queued by [*gpioWaveStreamWrite*].  The output
+starts with the first write and goes from the end of one segment
+to the start of the next without a gap.  The DMA marks each
+segment as played when it reaches its end, so the segment may then
+be written again.
+
+If the output reaches the end of the last segment written it stops.
+The next write restarts it after the gap and counts an underrun,
+see [*gpioWaveStreamStatus*].
+
+While a stream is open [*gpioWaveTxSend*], [*gpioWaveChain*], and
+[*gpioWaveTxStop*] stop its output and drop the queued segments.
+The next write starts the output again.
+
+...
+gpioWaveStreamOpen(4, 1000); // 4 segments of up to 1000 pulses
+...
+D*/
+
+
+/*F*/
+int gpioWaveStreamSetEvent(unsigned event, unsigned lowWater);
+/*D
+This function triggers an event when the segments queued on the
+stream fall to lowWater, so the consumer knows to write more.
+
+. .
+   event: 0-31
+lowWater: 0 to one less than the segments in the ring
+. .
+
+Returns 0 if OK, otherwise PI_BAD_EVENT_ID, PI_NO_WAVE_STREAM, or
+PI_BAD_WAVE_STREAM.
+
+The event is triggered once each time the queued segments fall to
+lowWater or below.  It is delivered like one from [*eventTrigger*],
+to [*eventSetFunc*] callbacks and notifications which monitor it.
+The queue is checked by the thread which reads the GPIO samples,
+about once a millisecond.
+D*/
+
+
+/*F*/
+int gpioWaveStreamWrite(unsigned numPulses, gpioPulse_t *pulses);
+/*D
+This function queues a segment of pulses to be played after those
+already queued on the stream.
+
+. .
+numPulses: 1 to the segPulses given to [*gpioWaveStreamOpen*]
+  *pulses: an array of pulses
+. .
+
+Returns 0 if OK, otherwise PI_NO_WAVE_STREAM, PI_TOO_MANY_PULSES,
+PI_BAD_POINTER, PI_TOO_MANY_CBS, or PI_WAVE_STREAM_FULL.
+
+Each pulse sets the gpioOn GPIO, clears the gpioOff GPIO, then
+waits usDelay microseconds, as for [*gpioWaveAddGeneric*].  Unlike
+a wave the pulses are not merged with others, the segment is one
+timeline which follows on from the previous segment.
+
+PI_WAVE_STREAM_FULL is returned if every segment is queued.  Wait
+for the low water event, see [*gpioWaveStreamSetEvent*], or check
+[*gpioWaveStreamStatus*], then write again.
+
+...
+gpioPulse_t pulse[1000];
+int n;
+
+while ((n = nextPulses(pulse, 1000)) > 0)
+{
+   while (gpioWaveStreamWrite(n, pulse) == PI_WAVE_STREAM_FULL)
+      gpioDelay(1000);
+}
+...
+D*/
+
+
+/*F*/
+int gpioWaveStreamStatus(gpioWaveStream_t *status);
+/*D
+This function gets the state of the stream.
+
+. .
+status: a pointer to a [*gpioWaveStream_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_POINTER or PI_NO_WAVE_STREAM.
+
+underruns counts the times the output ran out of queued segments
+and was restarted by a later write, a gap in the pulse train.
+D*/
+
+
+/*F*/
+int gpioWaveStreamClose(void);
+/*D
+This function stops the output of the stream, if it is running, and
+frees its segments.
+
+Returns 0 if OK, otherwise PI_NO_WAVE_STREAM.
+D*/
+
 
 /*F*/
 int gpioWaveTxSend(unsigned wave_id, unsigned wave_mode);
@@ -2300,7 +2897,7 @@ This function opens a GPIO for bit bang reading of serial data.
 
 . .
 user_gpio: 0-31
-     baud: 50-250000
+     baud: 50-333333
 data_bits: 1-32
 . .
 
@@ -2312,6 +2909,15 @@ The serial data is returned in a cyclic buffer and is read using
 
 It is the caller's responsibility to read data from the cyclic buffer
 in a timely fashion.
+
+All the GPIO opened for serial reads are decoded together from the
+sampled levels.  A character is added to the buffer at the middle of
+its stop bit.
+
+Each bit should span at least three samples.  Baud rates above 66666
+need a faster sample rate than the default 5 microseconds, and the
+highest rate needs a 1 microsecond sample rate.  See [*gpioCfgClock*]
+and [*gpioSerialReadErrors*].
 D*/
 
 /*F*/
@@ -2359,6 +2965,25 @@ For [*data_bits*] 17-32 there will be four bytes per character.
 D*/
 
 
+/*F*/
+int gpioSerialReadErrors(unsigned user_gpio);
+/*D
+This function returns the number of framing errors seen by a bit
+bang serial read.
+
+. .
+user_gpio: 0-31, previously opened with [*gpioSerialReadOpen*]
+. .
+
+Returns the number of framing errors since the GPIO was opened if OK,
+otherwise PI_BAD_USER_GPIO or PI_NOT_SERIAL_GPIO.
+
+A framing error is a start bit which is not low or a stop bit which
+is not high at the middle of the bit.  A character with a bad stop
+bit is still added to the buffer, one with a bad start bit is not.
+D*/
+
+
 /*F*/
 int gpioSerialReadClose(unsigned user_gpio);
 /*D
@@ -2371,6 +2996,136 @@ user_gpio: 0-31, previously opened with [*gpioSerialReadOpen*]
 Returns 0 if OK, otherwise PI_BAD_USER_GPIO, or PI_NOT_SERIAL_GPIO.
 D*/
 
+
+/*F*/
+int gpioWiegandReadOpen(unsigned gpioD0, unsigned gpioD1);
+/*D
+This function opens two GPIO for reading Wiegand frames.
+
+. .
+gpioD0: 0-31, the D0 (data 0) line
+gpioD1: 0-31, the D1 (data 1) line
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+The frames are decoded from the GPIO samples and returned in a
+cyclic buffer which is read using [*gpioDecodeRead*] on gpioD0.
+
+A low pulse on D0 is a 0 bit and a low pulse on D1 is a 1 bit.  A
+frame ends when no bit has arrived for 25 milliseconds.
+
+For 26 and 34 bit frames the parity bits are checked and removed,
+leaving a 24 or 32 bit code.  The code of other frames is their
+last 32 bits.
+D*/
+
+
+/*F*/
+int gpioIRReadOpen(unsigned user_gpio, unsigned protocol);
+/*D
+This function opens a GPIO for reading IR remote frames.
+
+. .
+user_gpio: 0-31
+ protocol: PI_DECODE_NEC or PI_DECODE_RC5
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, PI_BAD_IR_PROTOCOL,
+or PI_GPIO_IN_USE.
+
+The GPIO should be connected to an IR receiver module whose output
+is low while it sees the carrier.
+
+The frames are decoded from the GPIO samples and returned in a
+cyclic buffer which is read using [*gpioDecodeRead*].
+
+An NEC code is the 32 bits of the frame, the first bit received in
+bit 0.  So bits 0-7 are the address and bits 16-23 the command.
+A repeat frame returns the previous code with PI_DECODE_REPEAT set.
+
+An RC5 code has the 5 bit address in bits 8-12 and the 7 bit
+command in bits 0-6.  PI_DECODE_TOGGLE is set if the toggle bit was.
+D*/
+
+
+/*F*/
+int gpioI2CSniffOpen(unsigned SDA, unsigned SCL);
+/*D
+This function opens two GPIO to passively sniff an I2C bus.
+
+. .
+SDA: 0-31
+SCL: 0-31
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+The GPIO are only read.  The bus is decoded from the GPIO samples
+and each byte, with its ACK, is returned in a cyclic buffer which is
+read using [*gpioDecodeRead*] on SDA.
+
+Each byte is a frame of 8 bits.  The first byte after a START or
+repeated START (the address and R/W bit) has PI_DECODE_START set.
+PI_DECODE_NACK is set if the byte was not acknowledged.  A STOP is
+a frame of 0 bits with PI_DECODE_STOP set.  The tick of a frame is
+that of its START, first bit, or STOP.
+
+Each SCL high and low period must last at least one sample, see
+[*gpioCfgClock*].  A 100kHz bus needs a 1 or 2 microsecond sample
+rate.
+D*/
+
+
+/*F*/
+int gpioDecodeRead(unsigned user_gpio, gpioFrame_t *frames, unsigned maxFrames);
+/*D
+This function copies up to maxFrames decoded frames from the
+Wiegand, IR, or I2C sniffer cyclic buffer to frames.
+
+. .
+user_gpio: 0-31, previously opened with [*gpioWiegandReadOpen*]
+           (D0), [*gpioIRReadOpen*], or [*gpioI2CSniffOpen*] (SDA)
+   frames: an array to receive the frames
+maxFrames: >=0
+. .
+
+Returns the number of frames copied if OK, otherwise
+PI_BAD_USER_GPIO or PI_NOT_DECODE_GPIO.
+
+PI_DECODE_BAD_CHECK is set in the flags of a frame whose parity
+(Wiegand) or complement (NEC) check failed.
+
+The buffer holds 255 frames.  Newer frames are discarded if it is
+full, so it is the caller's responsibility to read in a timely
+fashion.
+
+. .
+typedef struct
+{
+   uint32_t tick;     // tick of the first edge of the frame
+   uint32_t code;     // the decoded value
+   uint16_t bits;     // bits in the frame
+   uint8_t  protocol; // PI_DECODE_WIEGAND, _NEC, _RC5, or _I2C
+   uint8_t  flags;    // PI_DECODE_REPEAT, _TOGGLE, _BAD_CHECK, _START, ...
+} gpioFrame_t;
+. .
+D*/
+
+
+/*F*/
+int gpioDecodeReadClose(unsigned user_gpio);
+/*D
+This function closes a GPIO for Wiegand, IR, or I2C sniffer reads.
+
+. .
+user_gpio: 0-31, previously opened with [*gpioWiegandReadOpen*]
+           (D0), [*gpioIRReadOpen*], or [*gpioI2CSniffOpen*] (SDA)
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, or PI_NOT_DECODE_GPIO.
+D*/
+
 /*F*/
 int i2cOpen(unsigned i2cBus, unsigned i2cAddr, unsigned i2cFlags);
 /*D
@@ -3642,22 +4397,290 @@ level is then reported.  Level changes of less than [*steady*]
 microseconds are ignored.
 
 . .
-user_gpio: 0-31
-   steady: 0-300000
+user_gpio: 0-31
+   steady: 0-300000
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, or PI_BAD_FILTER.
+
+This filter affects the GPIO samples returned to callbacks set up
+with [*gpioSetAlertFunc*], [*gpioSetAlertFuncEx*], [*gpioSetGetSamplesFunc*],
+and [*gpioSetGetSamplesFuncEx*].
+
+It does not affect interrupts set up with [*gpioSetISRFunc*],
+[*gpioSetISRFuncEx*], or levels read by [*gpioRead*],
+[*gpioRead_Bits_0_31*], or [*gpioRead_Bits_32_53*].
+
+Each (stable) edge will be timestamped [*steady*] microseconds
+after it was first detected.
+D*/
+
+
+/*F*/
+int gpioSetMeter(unsigned user_gpio, unsigned windowMillis);
+/*D
+Starts (or stops) an edge meter on a GPIO.
+
+. .
+   user_gpio: 0-31
+windowMillis: 0 (to stop), or 10-60000
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_BAD_METER_WINDOW.
+
+The meter counts the rising and falling edges of the GPIO and the
+time it is high.  Every windowMillis milliseconds the frequency,
+period, pulse width, and duty cycle over the window are calculated.
+The results may be read with [*gpioGetMeter*].
+
+The meter uses the GPIO samples so no callback or notification is
+needed.  Edges closer together than the sample rate are not seen,
+and any glitch or noise filter on the GPIO applies.
+
+Starting a meter clears its counts.
+D*/
+
+
+/*F*/
+int gpioGetMeter(unsigned user_gpio, gpioMeter_t *meter);
+/*D
+Gets the results of the edge meter on a GPIO.
+
+. .
+user_gpio: 0-31
+    meter: a pointer to a [*gpioMeter_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, PI_BAD_POINTER, or
+PI_NOT_METERED.
+
+The edge counts are updated as the samples are read.  The other
+values are from the last complete window and are zero until the
+first window ends.
+
+frequency and period are measured between the first and last rising
+edges in the window.  pulse is the mean time high per falling edge.
+
+...
+gpioMeter_t m;
+
+gpioSetMeter(4, 1000);
+
+time_sleep(2);
+
+if (gpioGetMeter(4, &m) == 0)
+   printf("%.3f Hz, duty %.2f%%\n", m.frequency/1000.0, m.duty/10000.0);
+...
+D*/
+
+
+/*F*/
+int gpioEncoderOpen(unsigned gpioA, unsigned gpioB, unsigned gpioIndex);
+/*D
+Starts decoding a quadrature encoder.
+
+. .
+    gpioA: 0-31
+    gpioB: 0-31
+gpioIndex: 0-31, or PI_ENCODER_NO_INDEX
+. .
+
+Returns a handle (>=0) if OK, otherwise PI_BAD_USER_GPIO,
+PI_GPIO_IN_USE, or PI_NO_HANDLE.
+
+The encoder is decoded from the GPIO samples by the thread which
+reads them, so no callback is needed.  Every change of A or B
+counts one step (four per cycle).  The position counts up when A
+leads B.
+
+If A and B both change between samples a step has been missed and
+the error count is incremented.  Use a faster sample rate, see
+[*gpioCfgClock*], if this happens.
+
+The velocity is updated every 100 milliseconds.
+
+If an index GPIO is given each rising edge is counted and the
+position at the time is recorded.
+
+A GPIO may only be used by one encoder.  Up to 8 encoders may be
+open at once.
+
+Any glitch or noise filter on the GPIO applies.
+D*/
+
+
+/*F*/
+int gpioEncoderClose(unsigned handle);
+/*D
+Stops decoding a quadrature encoder.
+
+. .
+handle: >=0, as returned by [*gpioEncoderOpen*]
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
+
+/*F*/
+int gpioEncoderGet(unsigned handle, gpioEncoder_t *encoder);
+/*D
+Gets the position, velocity, and error counts of an encoder.
+
+. .
+ handle: >=0, as returned by [*gpioEncoderOpen*]
+encoder: a pointer to a [*gpioEncoder_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE or PI_BAD_POINTER.
+D*/
+
+
+/*F*/
+int gpioEncoderSetEvent(unsigned handle, unsigned event, unsigned millis);
+/*D
+Triggers an event when the position of an encoder changes.
+
+. .
+handle: >=0, as returned by [*gpioEncoderOpen*]
+ event: 0-31
+millis: 0-60000
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE, PI_BAD_EVENT_ID, or
+PI_BAD_ENCODER_EVENT.
+
+The event is triggered at most once every millis milliseconds, and
+only if the position has changed since it was last triggered.  A
+millis of 0 stops the events.
+
+The event is delivered like one from [*eventTrigger*], to
+[*eventSetFunc*] callbacks and notifications which monitor it.
+The consumer can then read the position with [*gpioEncoderGet*].
+D*/
+
+
+/*F*/
+int gpioCaptureStart(
+   uint32_t bits, unsigned trigMode, uint32_t trigBits, uint32_t trigLevels,
+   unsigned preSamples, unsigned postSamples);
+/*D
+Starts a triggered capture of GPIO samples, like a logic analyser.
+
+. .
+       bits: the GPIO to capture
+   trigMode: PI_CAPTURE_NOW, _LEVEL, _EDGE, or _CHANGE
+   trigBits: the GPIO which trigger the capture
+ trigLevels: the trigger levels of those GPIO
+ preSamples: samples to keep from before the trigger
+postSamples: samples to keep from after the trigger
+. .
+
+Returns 0 if OK, otherwise PI_BAD_CAPTURE_TRIG or
+PI_BAD_CAPTURE_DEPTH.
+
+The capture is taken from the GPIO samples by the thread which
+reads them, so no client has to keep up with the changes.  A sample
+is kept each time one of the captured GPIO changes level.  Each
+sample holds the tick and the levels of all the captured GPIO.
+
+Until the trigger the latest preSamples samples are kept in a ring.
+The sample which meets the trigger is kept, then the next
+postSamples samples.  The capture is then complete.  The memory for
+all the samples is allocated when the capture is started.
+
+. .
+PI_CAPTURE_NOW    0 trigger at once
+PI_CAPTURE_LEVEL  1 trigBits GPIO are at trigLevels (a level or pattern)
+PI_CAPTURE_EDGE   2 a trigBits GPIO changes to its level in trigLevels
+PI_CAPTURE_CHANGE 3 a trigBits GPIO changes
+. .
+
+The trigger GPIO need not be captured.  trigBits and trigLevels are
+ignored for PI_CAPTURE_NOW.  preSamples plus postSamples may be at
+most 1000000.
+
+Starting a capture discards any earlier capture.  Any glitch or
+noise filter on the GPIO applies.
+
+...
+// capture GPIO 2-5 around the first falling edge of GPIO 4
+
+gpioCaptureStart(0x3C, PI_CAPTURE_EDGE, 1<<4, 0, 1000, 9000);
+...
+D*/
+
+
+/*F*/
+int gpioCaptureStatus(gpioCapture_t *capture);
+/*D
+Gets the state of a capture.
+
+. .
+capture: a pointer to a [*gpioCapture_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_NO_CAPTURE or PI_BAD_POINTER.
+
+The state is PI_CAPTURE_ARMED (waiting for the trigger),
+PI_CAPTURE_TRIGGERED (keeping the samples after the trigger), or
+PI_CAPTURE_DONE.
+
+gaps counts the times the sampling thread fell behind and samples
+were lost while the capture was running.
+D*/
+
+
+/*F*/
+int gpioCaptureRead(unsigned first, gpioSample_t *samples, unsigned maxSamples);
+/*D
+Reads the samples of a complete capture.
+
+. .
+     first: the index of the first sample to read
+  *samples: an array of [*gpioSample_t*] to receive the samples
+maxSamples: the most samples to read
+. .
+
+Returns the number of samples copied if OK, otherwise
+PI_BAD_POINTER, PI_NO_CAPTURE, or PI_CAPTURE_NOT_DONE.
+
+The samples are in time order.  The trigger sample is at index
+trigger, see [*gpioCaptureStatus*].  Only the captured GPIO are
+set in the levels.
+D*/
+
+
+/*F*/
+int gpioCaptureSave(char *file);
+/*D
+Saves the samples of a complete capture to a file.
+
+. .
+*file: the file to write
 . .
 
-Returns 0 if OK, otherwise PI_BAD_USER_GPIO, or PI_BAD_FILTER.
+Returns the number of samples saved if OK, otherwise PI_NO_CAPTURE,
+PI_CAPTURE_NOT_DONE, or one of the errors of [*fileOpen*].
 
-This filter affects the GPIO samples returned to callbacks set up
-with [*gpioSetAlertFunc*], [*gpioSetAlertFuncEx*], [*gpioSetGetSamplesFunc*],
-and [*gpioSetGetSamplesFuncEx*].
+The file is created, or truncated if it exists.  It must be
+writable as for [*fileOpen*].
 
-It does not affect interrupts set up with [*gpioSetISRFunc*],
-[*gpioSetISRFuncEx*], or levels read by [*gpioRead*],
-[*gpioRead_Bits_0_31*], or [*gpioRead_Bits_32_53*].
+The samples are written as [*gpioReport_t*], the format read from
+a notification pipe, so the file may be converted to VCD by pig2vcd.
 
-Each (stable) edge will be timestamped [*steady*] microseconds
-after it was first detected.
+...
+gpioCaptureSave("/tmp/capture.bin");
+...
+D*/
+
+
+/*F*/
+int gpioCaptureStop(void);
+/*D
+Stops a capture, complete or not, and frees its samples.
+
+Returns 0 if OK, otherwise PI_NO_CAPTURE.
 D*/
 
 
@@ -3715,6 +4738,27 @@ See [*gpioSetGetSamplesFunc*] for further details.
 D*/
 
 
+/*F*/
+int gpioGetCallbackStats(gpioCallbackStats_t *stats);
+/*D
+Gets the statistics of the alert, event, and samples callbacks.
+
+. .
+stats: a pointer to a [*gpioCallbackStats_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_NOT_INITIALISED or PI_BAD_POINTER.
+
+Latency is the time from the alert thread queueing a callback to
+a callback worker starting it, see [*gpioCfgCallbackWorkers*].
+Duration is the time spent in the callback function.
+
+If no callback workers are configured the callbacks run on the alert
+thread and the latency is zero.  A long duration then delays the
+sampling of the GPIO.
+D*/
+
+
 /*F*/
 int gpioSetTimerFunc(unsigned timer, unsigned millis, gpioTimerFunc_t f);
 /*D
@@ -3732,7 +4776,17 @@ Returns 0 if OK, otherwise PI_BAD_TIMER, PI_BAD_MS, or PI_TIMER_FAILED.
 
 One function may be registered per timer.
 
-The timer may be cancelled by passing NULL as the function.
+The timer may be cancelled by passing NULL as the function.  Once
+cancelled the function is not running, unless the cancel was made
+from a timer function (the timer's own or another's), which does not
+wait.
+
+All the timers are served by one thread which sleeps until the
+next absolute due time, so the period does not drift by the time
+the function takes.  The functions are run by a small pool of
+workers, see [*gpioCfgTimerWorkers*].  If a function is still
+running when it is next due that period is skipped, see
+[*gpioGetTimerStats*].
 
 ...
 void bFunction(void)
@@ -3770,6 +4824,62 @@ See [*gpioSetTimerFunc*] for further details.
 D*/
 
 
+/*F*/
+int gpioSetTimerFuncMicros(
+   unsigned timer, unsigned micros, gpioTimerFuncEx_t f, void *userdata);
+/*D
+Registers a function to be called (a callback) every micros
+microseconds.
+
+. .
+   timer: 0-9.
+  micros: 100-60000000
+       f: the function to call
+userdata: a pointer to arbitrary user data
+. .
+
+Returns 0 if OK, otherwise PI_BAD_TIMER, PI_BAD_TIMER_MICROS, or
+PI_TIMER_FAILED.
+
+This is [*gpioSetTimerFuncEx*] with a period in microseconds.  The
+start of each call is subject to the scheduling jitter of the
+system, typically tens of microseconds, see [*gpioGetTimerStats*].
+
+...
+void pulse(void *userdata)
+{
+   gpioTrigger(4, 10, 1);
+}
+
+// call pulse every 500 microseconds
+gpioSetTimerFuncMicros(1, 500, pulse, NULL);
+...
+D*/
+
+
+/*F*/
+int gpioGetTimerStats(unsigned timer, gpioTimerStats_t *stats);
+/*D
+Gets the statistics of a timer.
+
+. .
+timer: 0-9.
+stats: a pointer to a [*gpioTimerStats_t*] to be filled
+. .
+
+Returns 0 if OK, otherwise PI_NOT_INITIALISED, PI_BAD_TIMER, or
+PI_BAD_POINTER.
+
+Jitter is the time from when a call was due to when it started.
+A period is missed if the function was still running from an
+earlier period when it fell due, or if the timer fell a whole
+period behind.
+
+The statistics are reset each time a function is registered for
+the timer.
+D*/
+
+
 /*F*/
 pthread_t *gpioStartThread(gpioThreadFunc_t f, void *userdata);
 /*D
@@ -4774,6 +5884,11 @@ other processes hogging cpu time.
 
 I haven't seen a process locked out for more than 100 milliseconds.
 
+If the buffer is overwritten before it is read the lost samples are
+reported to notifications with PI_NTFY_FLAGS_GAP.  The number of
+overruns (dmaLaps) and lost cycles are printed on termination if
+PI_CFG_STATS is configured.
+
 Making the buffer bigger uses a LOT of memory at the more frequent
 sampling rates as shown in the following table in MBs.
 
@@ -4919,6 +6034,144 @@ The default setting is to use port 8888.
 D*/
 
 
+/*F*/
+int gpioCfgSocketWorkers(unsigned workers);
+/*D
+Configures the number of threads which service socket commands.
+
+This function is only effective if called before [*gpioInitialise*].
+
+. .
+workers: 1-64
+. .
+
+Connections are multiplexed with epoll and each ready connection is
+handed to one of the workers.  A worker reads whatever the connection
+has without blocking and runs the command once all of it has arrived.
+It then returns the connection to the pool, so commands from one
+connection are always executed in order and a client which stalls part
+way through sending a command does not hold a worker.
+
+Commands which block (e.g. delays or slow I2C transfers) occupy a
+worker for their duration.  The worker count limits how many such
+commands may be in progress at the same time.
+
+The default setting is to use 8 workers.
+D*/
+
+
+/*F*/
+int gpioCfgCallbackWorkers(unsigned workers);
+/*D
+Configures the number of threads which run the alert, event, and
+samples callbacks.
+
+This function is only effective if called before [*gpioInitialise*].
+
+. .
+workers: 0-16
+. .
+
+Returns 0 if OK, otherwise PI_BAD_CB_WORKERS.
+
+With no workers the callbacks are called directly by the thread
+which samples the GPIO.  A callback which takes longer than a
+millisecond or so then causes samples to be lost.
+
+With workers the sampling thread only queues each callback.  The
+callbacks for a given GPIO (or event) are always run by the same
+worker, so they are called in order.  Each worker has a queue of
+4096 callbacks; if it fills further callbacks are dropped and
+counted, see [*gpioGetCallbackStats*].
+
+The samples passed to a [*gpioSetGetSamplesFunc*] callback are
+copied when the callback is queued.
+
+The default setting is to use 0 workers.
+D*/
+
+
+/*F*/
+int gpioCfgTimerWorkers(unsigned workers);
+/*D
+Configures the number of threads which run the timer callbacks.
+
+This function is only effective if called before [*gpioInitialise*].
+
+. .
+workers: 0-10
+. .
+
+Returns 0 if OK, otherwise PI_BAD_TIMER_WORKERS.
+
+With no workers the callbacks are called directly by the thread
+which times them.  A long callback then delays the other timers.
+
+With workers the timing thread hands each due callback to the
+next free worker.
+
+The default setting is to use 2 workers.
+D*/
+
+
+/*F*/
+int gpioCfgAlertPoll(unsigned minMicros, unsigned maxMicros);
+/*D
+Configures the thread which reads the GPIO samples to poll adaptively.
+
+This function is only effective if called before [*gpioInitialise*].
+
+. .
+minMicros: 0 or 50-50000
+maxMicros: 0 or 50-50000, not less than minMicros
+. .
+
+Returns 0 if OK, otherwise PI_BAD_ALERT_POLL.
+
+After reading the samples the thread sleeps for minMicros if any
+monitored GPIO changed or a wave stream is playing, otherwise it
+doubles its previous sleep up to maxMicros.  A low minMicros reduces the latency of callbacks and
+notifications while GPIO are busy, a high maxMicros reduces the CPU
+used while they are idle.  maxMicros also bounds the latency of the
+first change after an idle period and of watchdog timeouts.
+
+maxMicros is limited to a quarter of the sample buffer, see
+[*gpioCfgBufferSize*].
+
+The mean interval between passes and the mean samples read per pass
+are printed on termination if PI_CFG_STATS is configured.
+
+The default setting (0, 0) is a fixed sleep set by the alert
+frequency bits of [*gpioCfgSetInternals*].
+D*/
+
+
+/*F*/
+int gpioCfgSocketPath(const char *path);
+/*D
+Configures pigpio to also accept socket commands on a Unix domain
+socket bound to path.
+
+This function is only effective if called before [*gpioInitialise*].
+
+. .
+path: the socket file path, NULL or "" to disable.
+. .
+
+The Unix domain socket uses the same wire protocol as the TCP
+socket but avoids the TCP loopback overhead for local clients.
+Clients connect by using an address of the form unix:path.
+
+Any existing socket at path is replaced.  Initialisation fails
+if path exists and is not a socket.
+
+Unix domain clients are treated as connecting from 127.0.0.1 by
+the address checks set with [*gpioCfgNetAddr*].
+
+The default setting is no Unix domain socket.
+D*/
+
+
 /*F*/
 int gpioCfgInterfaces(unsigned ifFlags);
 /*D
@@ -5359,6 +6612,9 @@ bVal::0-255 (Hex 0x0-0xFF, Octal 0-0377)
 
 An 8-bit byte value.
 
+*capture::
+A pointer to a [*gpioCapture_t*] object.
+
 cbNum::
 
 A number identifying a DMA contol block.
@@ -5452,6 +6708,9 @@ FALLING_EDGE 1
 EITHER_EDGE 2
 . .
 
+*encoder::
+A pointer to a [*gpioEncoder_t*] object.
+
 event::0-31
 An event is a signal used to inform one or more consumers
 to start an action.
@@ -5475,10 +6734,28 @@ A function.
 A full file path.  To be accessible the path must match an entry in
 /opt/pigpio/access.
 
+first::
+The index of the first item to read.
+
 *fpat::
 A file path which may contain wildcards.  To be accessible the path
 must match an entry in /opt/pigpio/access.
 
+format::
+The format of the reports on a notification pipe or socket,
+PI_NOTIFY_FORMAT_V1 (gpioReport_t) or PI_NOTIFY_FORMAT_V2 (compact).
+
+. .
+PI_NOTIFY_FORMAT_V1 0
+PI_NOTIFY_FORMAT_V2 1
+. .
+
+*frag::
+A pointer to a [*gpioWaveFrag_t*] object.
+
+*frames::
+An array of [*gpioFrame_t*] to receive decoded frames.
+
 frequency::>=0
 
 The number of times a GPIO is swiched on and off per second.  This
@@ -5516,6 +6793,9 @@ Type 2    -  X  X  -  -  -  X  X  X  X  -  X  X  X  X  X
 Type 3    X  X  X  X  X  X  X  X  X  X  X  X  -  -  -  -
 . .
 
+gpioA:: 0-31
+The GPIO connected to the A output of a quadrature encoder.
+
 gpioAlertFunc_t::
 . .
 typedef void (*gpioAlertFunc_t) (int gpio, int level, uint32_t tick);
@@ -5527,6 +6807,20 @@ typedef void (*eventFuncEx_t)
    (int event, int level, uint32_t tick, void *userdata);
 . .
 
+gpioCapture_t::
+. .
+typedef struct
+{
+   uint32_t state;   // PI_CAPTURE_ARMED, _TRIGGERED, or _DONE
+   uint32_t samples; // samples held
+   uint32_t trigger; // index of the trigger sample
+   uint32_t tick;    // tick of the trigger sample
+   uint32_t gaps;    // times samples were lost during the capture
+} gpioCapture_t;
+. .
+
+The state of a capture, see [*gpioCaptureStatus*].
+
 gpioCfg*::
 
 These functions are only effective if called before [*gpioInitialise*].
@@ -5540,6 +6834,58 @@ These functions are only effective if called before [*gpioInitialise*].
 [*gpioCfgSocketPort*] 
 [*gpioCfgMemAlloc*]
 
+gpioB:: 0-31
+The GPIO connected to the B output of a quadrature encoder.
+
+gpioCallbackStats_t::
+. .
+typedef struct
+{
+   uint32_t calls;       // callbacks run
+   uint32_t dropped;     // callbacks dropped as a queue was full
+   uint32_t maxLatency;  // longest queue to start, microseconds
+   uint32_t meanLatency; // mean queue to start, microseconds
+   uint32_t maxDuration; // longest callback, microseconds
+} gpioCallbackStats_t;
+. .
+
+The callback statistics, see [*gpioGetCallbackStats*].
+
+gpioD0:: 0-31
+The GPIO connected to the D0 (data 0) line of a Wiegand device.
+
+gpioD1:: 0-31
+The GPIO connected to the D1 (data 1) line of a Wiegand device.
+
+gpioEncoder_t::
+. .
+typedef struct
+{
+   int32_t  position;      // counts, four per cycle
+   int32_t  velocity;      // counts per second
+   uint32_t errors;        // steps missed (A and B changed together)
+   uint32_t indexes;       // rising edges of the index GPIO
+   int32_t  indexPosition; // position at the last index
+   uint32_t tick;          // tick of the last position change
+} gpioEncoder_t;
+. .
+
+The state of a quadrature encoder, see [*gpioEncoderGet*].
+
+gpioFrame_t::
+. .
+typedef struct
+{
+   uint32_t tick;     // tick of the first edge of the frame
+   uint32_t code;     // the decoded value
+   uint16_t bits;     // bits in the frame
+   uint8_t  protocol; // PI_DECODE_WIEGAND, _NEC, _RC5, or _I2C
+   uint8_t  flags;    // PI_DECODE_REPEAT, _TOGGLE, _BAD_CHECK, _START, ...
+} gpioFrame_t;
+. .
+
+A decoded Wiegand, IR, or I2C frame, see [*gpioDecodeRead*].
+
 gpioGetSamplesFunc_t::
 . .
 typedef void (*gpioGetSamplesFunc_t)
@@ -5552,6 +6898,10 @@ typedef void (*gpioGetSamplesFuncEx_t)
    (const gpioSample_t *samples, int numSamples, void *userdata);
 . .
 
+gpioIndex:: 0-31, PI_ENCODER_NO_INDEX
+The GPIO connected to the index output of a quadrature encoder,
+or PI_ENCODER_NO_INDEX (32) if there is none.
+
 gpioISRFunc_t::
 . .
 typedef void (*gpioISRFunc_t)
@@ -5564,6 +6914,43 @@ typedef void (*gpioISRFuncEx_t)
    (int gpio, int level, uint32_t tick, void *userdata);
 . .
 
+gpioMeter_t::
+. .
+typedef struct
+{
+   uint32_t rising;    // rising edges since the meter was started
+   uint32_t falling;   // falling edges since the meter was started
+   uint32_t window;    // length of the last window, microseconds
+   uint32_t edges;     // rising edges in the last window
+   uint32_t frequency; // millihertz
+   uint32_t period;    // mean period, nanoseconds
+   uint32_t pulse;     // mean high pulse, nanoseconds
+   uint32_t duty;      // time high, parts per million
+} gpioMeter_t;
+. .
+
+The results of an edge meter, see [*gpioGetMeter*].
+
+gpioNotifyRing_t::
+. .
+typedef struct
+{
+   uint32_t magic;    // PI_NOTIFY_RING_MAGIC once initialised
+   uint32_t size;     // reports in the ring, a power of 2
+   uint32_t closed;   // set when the notification is closed
+   uint32_t pad0[13];
+   uint32_t head;     // reports written, by the daemon
+   uint32_t overruns; // reports dropped as the ring was full
+   uint32_t waiting;  // set by a reader parked on head
+   uint32_t pad1[13];
+   uint32_t tail;     // reports read, by the reader
+   uint32_t pad2[15];
+} gpioNotifyRing_t;
+. .
+
+The header of a shared memory notification ring, see
+[*gpioNotifyOpenShared*].
+
 gpioPulse_t::
 . .
 typedef struct
@@ -5608,6 +6995,66 @@ gpioTimerFuncEx_t::
 typedef void (*gpioTimerFuncEx_t) (void *userdata);
 . .
 
+gpioTimerStats_t::
+. .
+typedef struct
+{
+   uint32_t calls;       // callbacks run
+   uint32_t missed;      // periods skipped, the callback overran
+   uint32_t maxJitter;   // latest start after the due time, microseconds
+   uint32_t meanJitter;  // mean start after the due time, microseconds
+   uint32_t maxDuration; // longest callback, microseconds
+} gpioTimerStats_t;
+. .
+
+The timer statistics, see [*gpioGetTimerStats*].
+
+gpioWaveCacheStats_t::
+. .
+typedef struct
+{
+   uint32_t hits;   // creates which returned an existing wave
+   uint32_t misses; // creates which made a new wave which may be shared
+   uint32_t waves;  // waves which may be shared
+   uint32_t refs;   // creates of those waves not yet deleted
+} gpioWaveCacheStats_t;
+. .
+
+The wave cache statistics, see [*gpioWaveGetCacheStats*].
+
+gpioWaveFrag_t::
+. .
+typedef struct
+{
+   uint32_t waves;       // waves in use
+   uint32_t cbs;         // CBs available to waves
+   uint32_t freeCBs;     // CBs free
+   uint32_t largestCBs;  // CBs in the largest free range
+   uint32_t holesCB;     // free CB ranges
+   uint32_t ools;        // OOL available to waves
+   uint32_t freeOOLs;    // OOL free
+   uint32_t largestOOLs; // OOL in the largest free range
+   uint32_t holesOOL;    // free OOL ranges
+} gpioWaveFrag_t;
+. .
+
+The use of the wave CB and OOL space, see [*gpioWaveFragmentation*].
+
+gpioWaveStream_t::
+. .
+typedef struct
+{
+   uint32_t segments;  // segments in the ring
+   uint32_t segPulses; // most pulses per segment
+   uint32_t queued;    // segments written but not yet played
+   uint32_t written;   // segments written since the stream was opened
+   uint32_t played;    // segments played (or dropped by a stop)
+   uint32_t underruns; // gaps, the output ran out of segments
+} gpioWaveStream_t;
+. .
+
+The state of a wave stream, see [*gpioWaveStreamStatus*].
+
 gpioWaveAdd*::
 
 One of
@@ -5621,6 +7068,7 @@ handle::>=0
 A number referencing an object opened by one of
 
 [*fileOpen*] 
+[*gpioEncoderOpen*] 
 [*gpioNotifyOpen*] 
 [*i2cOpen*] 
 [*serOpen*] 
@@ -5684,6 +7132,10 @@ PI_TIMEOUT 2
 . .
 
 
+lowWater::
+The number of queued wave stream segments at or below which an
+event is triggered, see [*gpioWaveStreamSetEvent*].
+
 lVal::0-4294967295 (Hex 0x0-0xFFFFFFFF, Octal 0-37777777777)
 
 A 32-bit word value.
@@ -5698,6 +7150,19 @@ PI_MEM_ALLOC_PAGEMAP 1
 PI_MEM_ALLOC_MAILBOX 2
 . .
 
+*meter::
+A pointer to a [*gpioMeter_t*] object.
+
+maxFrames::
+The maximum number of frames to return.
+
+maxMicros:: 0 or 50-50000
+The longest sleep between alert thread passes, see
+[*gpioCfgAlertPoll*].
+
+maxSamples::
+The maximum number of samples to return.
+
 *micros::
 
 A value representing microseconds.
@@ -5706,10 +7171,16 @@ micros::
 
 A value representing microseconds.
 
+For [*gpioSetTimerFuncMicros*] 100-60000000.
+
 millis::
 
 A value representing milliseconds.
 
+minMicros:: 0 or 50-50000
+The shortest sleep between alert thread passes, see
+[*gpioCfgAlertPoll*].
+
 MISO::
 The GPIO used for the MISO signal when bit banging SPI.
 
@@ -5760,7 +7231,8 @@ numPar:: 0-10
 The number of parameters passed to a script.
 
 numPulses::
-The number of pulses to be added to a waveform.
+The number of pulses to be added to a waveform, or written to a
+wave stream.
 
 numSegs::
 The number of segments in a combined I2C transaction.
@@ -5792,6 +7264,9 @@ padStrength:: 1-16
 The mA which may be drawn from each GPIO whilst still guaranteeing the
 high and low levels.
 
+*path::
+The file path of a Unix domain socket.
+
 *param::
 An array of script parameters.
 
@@ -5821,10 +7296,24 @@ The port used to bind to the pigpio socket.  Defaults to 8888.
 pos::
 The position of an item.
 
+postSamples::
+The number of samples a capture keeps after the trigger sample.
+
+preSamples::
+The number of samples a capture keeps from before the trigger sample.
+
 primaryChannel:: 0-15
 The DMA channel used to time the sampling of GPIO and to time servo and
 PWM pulses.
 
+protocol::
+The IR protocol to decode.
+
+. .
+PI_DECODE_NEC 1
+PI_DECODE_RC5 2
+. .
+
 *pth::
 
 A thread identifier, returned by [*gpioStartThread*].
@@ -5850,7 +7339,8 @@ pulseLen::
 
 *pulses::
 
-An array of pulses to be added to a waveform.
+An array of pulses to be added to a waveform, or written to a wave
+stream.
 
 pulsewidth::0, 500-2500
 . .
@@ -5936,6 +7426,11 @@ typedef struct
 } rawWaveInfo_t;
 . .
 
+reports::16-65536
+
+The number of reports a shared memory notification ring holds.
+It must be a power of 2.
+
 *retBuf::
 
 A buffer to hold a number of bytes returned to a used customised function,
@@ -5948,8 +7443,11 @@ The maximum number of bytes a user customised function should return.
 
 A pointer to a buffer to receive data.
 
+*samples::
+An array of [*gpioSample_t*] to receive samples.
+
 SCL::
-The user GPIO to use for the clock when bit banging I2C.
+The user GPIO to use for the clock when bit banging or sniffing I2C.
 
 SCLK::
 The GPIO used for the SCLK signal when bit banging SPI.
@@ -5968,7 +7466,7 @@ The name of a [*shell*] script to be executed.  The script must be present in
 The string to be passed to a [*shell*] script to be executed.
 
 SDA::
-The user GPIO to use for data when bit banging I2C.
+The user GPIO to use for data when bit banging or sniffing I2C.
 
 secondaryChannel:: 0-6
 
@@ -5994,6 +7492,12 @@ seekOffset::
 The number of bytes to move forward (positive) or backwards (negative)
 from the seek position (start, current, or end of file).
 
+segments::2-64
+The number of segments in a wave stream.
+
+segPulses::1-12000
+The most pulses in a segment of a wave stream.
+
 *segs::
 An array of segments which make up a combined I2C transaction.
 
@@ -6062,6 +7566,13 @@ PI_MIN_WAVE_HALFSTOPBITS 2
 PI_MAX_WAVE_HALFSTOPBITS 8
 . .
 
+*stats::
+A pointer to a [*gpioCallbackStats_t*], [*gpioTimerStats_t*], or
+[*gpioWaveCacheStats_t*] object.
+
+*status::
+A pointer to a [*gpioWaveStream_t*] object.
+
 *str::
 An array of characters.
 
@@ -6092,6 +7603,23 @@ PI_TIME_RELATIVE 0
 PI_TIME_ABSOLUTE 1
 . .
 
+trigBits::
+The GPIO which trigger a capture, see [*gpioCaptureStart*].  If bit n
+is set GPIO n is used.
+
+trigLevels::
+The levels the trigger GPIO are matched against, bit n for GPIO n.
+
+trigMode::
+How a capture is triggered.
+
+. .
+PI_CAPTURE_NOW    0
+PI_CAPTURE_LEVEL  1
+PI_CAPTURE_EDGE   2
+PI_CAPTURE_CHANGE 3
+. .
+
 *txBuf::
 
 An array of bytes to transmit.
@@ -6168,6 +7696,19 @@ PI_WAVE_MODE_ONE_SHOT_SYNC 2
 PI_WAVE_MODE_REPEAT_SYNC   3
 . .
 
+windowMillis:: 0, 10-60000
+The length in milliseconds of the window over which an edge meter
+calculates frequency and duty cycle, or 0 to stop the meter.
+
+workers:: 1-64
+The number of threads used to service socket commands.
+
+For [*gpioCfgCallbackWorkers*] 0-16, the number of threads used to
+run callbacks.
+
+For [*gpioCfgTimerWorkers*] 0-10, the number of threads used to run
+timer callbacks.
+
 wVal::0-65535 (Hex 0x0-0xFFFF, Octal 0-0177777)
 
 A 16-bit word value.
@@ -6317,6 +7858,52 @@ PARAMS*/
 #define PI_CMD_PROCU 117
 #define PI_CMD_WVCAP 118
 
+#define PI_CMD_BATCH 119
+
+#define PI_CMD_RINGO 120
+#define PI_CMD_RINGC 121
+
+#define PI_CMD_NOR   122
+#define PI_CMD_NQL   123
+#define PI_CMD_NQD   124
+
+#define PI_CMD_NOF   125
+#define PI_CMD_NOIBF 126
+
+#define PI_CMD_MTRS  127
+#define PI_CMD_MTRG  128
+
+#define PI_CMD_ENCO  129
+#define PI_CMD_ENCC  130
+#define PI_CMD_ENCG  131
+#define PI_CMD_ENCE  132
+
+#define PI_CMD_WGRO  133
+#define PI_CMD_IRRO  134
+#define PI_CMD_DCDR  135
+#define PI_CMD_DCDC  136
+
+#define PI_CMD_SNIFF 137
+
+#define PI_CMD_SLRE  138
+
+#define PI_CMD_CAPS  139
+#define PI_CMD_CAPG  140
+#define PI_CMD_CAPR  141
+#define PI_CMD_CAPW  142
+#define PI_CMD_CAPC  143
+
+#define PI_CMD_WVFRG 144
+#define PI_CMD_WVCST 145
+
+#define PI_CMD_WVSOP 146
+#define PI_CMD_WVSEV 147
+#define PI_CMD_WVSWR 148
+#define PI_CMD_WVSST 149
+#define PI_CMD_WVSCL 150
+
+#define PI_CMD_WVCRS 151
+
 /*DEF_E*/
 
 /*
@@ -6327,6 +7914,29 @@ that handle will be sent to the socket (rather than a
 
 The socket should be dedicated to receiving notifications
 after this command is issued.
+
+PI CMD_NOIBF is PI CMD_NOIB with the stream format in p1
+(PI_NOTIFY_FORMAT_V1 or PI_NOTIFY_FORMAT_V2).  Daemons which
+predate it return PI_UNKNOWN_COMMAND, in which case the client
+should fall back to PI CMD_NOIB and v1 reports.
+
+PI CMD_BATCH only works on the socket interface.
+The extension holds up to PI_MAX_BATCH_LEN bytes of commands.
+Each command is a cmdCmd_t (cmd, p1, p2, ext_len) followed by
+ext_len bytes of extension.  The commands are executed in order
+and one 32-bit result per command is returned as the extension.
+Commands which return an extension may not be batched.
+
+PI CMD_RINGO and PI CMD_RINGC only work on the socket interface
+and only for clients on the same host as the daemon.
+PI CMD_RINGO returns a command ring handle.  The ring is the
+shared memory object named by CMD_RING_NAME with the handle
+(see command.h).  Commands submitted on the ring are executed
+by a dedicated daemon thread.  Commands which return an extension,
+or whose extension exceeds CMD_RING_EXT_LEN bytes, are refused
+with PI_BAD_RING_CMD and should be sent on the socket.
+PI CMD_RINGC (p1 handle) closes the ring.  Rings are also closed
+when the socket which opened them is closed.
 */
 
 /* pseudo commands */
@@ -6415,7 +8025,7 @@ after this command is issued.
 #define PI_INITIALISED      -32 // function called after gpioInitialise
 #define PI_BAD_WAVE_MODE    -33 // waveform mode not 0-3
 #define PI_BAD_CFG_INTERNAL -34 // bad parameter in gpioCfgInternals call
-#define PI_BAD_WAVE_BAUD    -35 // baud rate not 50-250K(RX)/50-1M(TX)
+#define PI_BAD_WAVE_BAUD    -35 // baud rate not 50-333333(RX)/50-1M(TX)
 #define PI_TOO_MANY_PULSES  -36 // waveform has too many pulses
 #define PI_TOO_MANY_CHARS   -37 // waveform has too many chars
 #define PI_NOT_SERIAL_GPIO  -38 // no bit bang serial read on GPIO
@@ -6528,6 +8138,30 @@ after this command is issued.
 #define PI_CMD_INTERRUPTED -144 // Used by Python
 #define PI_NOT_ON_BCM2711  -145 // not available on BCM2711
 #define PI_ONLY_ON_BCM2711 -146 // only available on BCM2711
+#define PI_BAD_SOCK_WORKERS -147 // socket workers not 1-64
+#define PI_BAD_BATCH_LEN   -148 // batch truncated or too long
+#define PI_BAD_BATCH_CMD   -149 // command not allowed in batch
+#define PI_BAD_SOCKET_PATH -150 // socket path too long
+#define PI_BAD_RING_CMD    -151 // command not allowed on a ring
+#define PI_RING_FAILED     -152 // can't create command ring
+#define PI_BAD_NOTIFY_RING -153 // notify ring not power of 2 16-65536
+#define PI_BAD_NOTIFY_FORMAT -154 // unknown notification format
+#define PI_BAD_CB_WORKERS  -155 // callback workers not 0-16
+#define PI_BAD_ALERT_POLL  -156 // alert poll not 0 or 50-50000
+#define PI_BAD_METER_WINDOW -157 // meter window not 0 or 10-60000
+#define PI_NOT_METERED     -158 // GPIO has no meter
+#define PI_BAD_ENCODER_EVENT -159 // encoder event millis not 0-60000
+#define PI_BAD_IR_PROTOCOL -160 // IR protocol not NEC or RC5
+#define PI_NOT_DECODE_GPIO -161 // no Wiegand or IR read on GPIO
+#define PI_BAD_CAPTURE_DEPTH -162 // capture pre plus post samples > 1000000
+#define PI_BAD_CAPTURE_TRIG -163 // bad capture GPIO or trigger
+#define PI_NO_CAPTURE       -164 // no capture started
+#define PI_CAPTURE_NOT_DONE -165 // capture not complete
+#define PI_BAD_TIMER_MICROS -166 // timer micros not 100-60000000
+#define PI_BAD_TIMER_WORKERS -167 // timer workers not 0-10
+#define PI_BAD_WAVE_STREAM  -168 // stream segments not 2-64, or bad pulses or low water
+#define PI_NO_WAVE_STREAM   -169 // no wave stream open
+#define PI_WAVE_STREAM_FULL -170 // no free wave stream segment
 
 #define PI_PIGIF_ERR_0    -2000
 #define PI_PIGIF_ERR_99   -2099
@@ -6553,6 +8187,9 @@ after this command is issued.
 #define PI_DEFAULT_SOCKET_PORT             8888
 #define PI_DEFAULT_SOCKET_PORT_STR         "8888"
 #define PI_DEFAULT_SOCKET_ADDR_STR         "localhost"
+#define PI_DEFAULT_SOCKET_WORKERS          8
+#define PI_DEFAULT_CALLBACK_WORKERS        0
+#define PI_DEFAULT_TIMER_WORKERS           2
 #define PI_DEFAULT_UPDATE_MASK_UNKNOWN     0x0000000FFFFFFCLL
 #define PI_DEFAULT_UPDATE_MASK_B1          0x03E7CF93
 #define PI_DEFAULT_UPDATE_MASK_A_B2        0xFBC7CF9C
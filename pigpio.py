@@ -161,6 +161,20 @@ hardware_PWM              Start hardware PWM on supported GPIO
 set_glitch_filter         Set a glitch filter on a GPIO
 set_noise_filter          Set a noise filter on a GPIO
 
+set_meter                 Start or stop an edge meter on a GPIO
+get_meter                 Get the edge counts and frequency of a GPIO
+
+encoder_open              Start decoding a quadrature encoder
+encoder_close             Stop decoding a quadrature encoder
+encoder_get               Get the position and velocity of an encoder
+encoder_set_event         Trigger an event when an encoder moves
+
+capture_start             Start a triggered capture of GPIO samples
+capture_status            Get the state of a capture
+capture_read              Read the samples of a capture
+capture_save              Save the samples of a capture to a file
+capture_stop              Stop a capture and free its samples
+
 set_pad_strength          Sets a pads drive strength
 get_pad_strength          Gets a pads drive strength
 
@@ -251,6 +265,13 @@ bb_serial_read_close      Close a GPIO for bit bang serial reads
 bb_serial_invert          Invert serial logic (1 invert, 0 normal)
 
 bb_serial_read            Read bit bang serial data from  a GPIO
+bb_serial_read_errors     Get the framing errors of serial reads
+
+wiegand_read_open         Open two GPIO for Wiegand reads
+ir_read_open              Open a GPIO for IR remote reads
+i2c_sniff_open            Open two GPIO to sniff an I2C bus
+decode_read               Read decoded Wiegand, IR, or I2C frames
+decode_read_close         Close a GPIO for Wiegand, IR, or I2C reads
 
 SPI
 
@@ -289,7 +310,16 @@ wave_add_serial           Adds serial data to the waveform
 
 wave_create               Creates a waveform from added data
 wave_create_and_pad       Creates a waveform of fixed size from added data
+wave_create_shared        Creates a waveform which may be shared
 wave_delete               Deletes a waveform
+wave_get_fragmentation    Reports the free wave CB and OOL space
+wave_get_cache_stats      Gets the wave cache hits and misses
+
+wave_stream_open          Opens a ring of segments for streaming pulses
+wave_stream_set_event     Triggers an event when few segments are queued
+wave_stream_write         Queues a segment of pulses on the stream
+wave_stream_status        Gets the state of the stream
+wave_stream_close         Stops the stream and frees its segments
 
 wave_send_once            Transmits a waveform once
 wave_send_repeat          Transmits a waveform repeatedly
@@ -380,11 +410,21 @@ PI_SCRIPT_FAILED =4
 
 # notification flags
 
+NTFY_FLAGS_GAP   = (1 << 8)
 NTFY_FLAGS_EVENT = (1 << 7)
 NTFY_FLAGS_ALIVE = (1 << 6)
 NTFY_FLAGS_WDOG  = (1 << 5)
 NTFY_FLAGS_GPIO  = 31
 
+NOTIFY_FORMAT_V1 = 0
+NOTIFY_FORMAT_V2 = 1
+
+_NOTIFY_V2_MAGIC = 0x324e4750
+_NOTIFY_V2_SEQNO = 1
+_NOTIFY_V2_FLAGS = 2
+_NOTIFY_V2_BIT   = 4
+_NOTIFY_V2_SHIFT = 3
+
 # wave modes
 
 WAVE_MODE_ONE_SHOT     =0
@@ -422,6 +462,27 @@ SPI_RX_LSBFIRST = 1 << 15
 
 EVENT_BSC = 31
 
+DECODE_WIEGAND = 0
+DECODE_NEC     = 1
+DECODE_RC5     = 2
+DECODE_I2C     = 3
+
+DECODE_REPEAT    = 1
+DECODE_TOGGLE    = 2
+DECODE_BAD_CHECK = 4
+DECODE_START     = 8
+DECODE_NACK      = 16
+DECODE_STOP      = 32
+
+CAPTURE_NOW    = 0
+CAPTURE_LEVEL  = 1
+CAPTURE_EDGE   = 2
+CAPTURE_CHANGE = 3
+
+CAPTURE_ARMED     = 1
+CAPTURE_TRIGGERED = 2
+CAPTURE_DONE      = 3
+
 _SOCK_CMD_LEN = 16
 
 # pigpio command numbers
@@ -574,6 +635,43 @@ _PI_CMD_EVT  =116
 _PI_CMD_PROCU=117
 _PI_CMD_WVCAP=118
 
+_PI_CMD_NOF  =125
+_PI_CMD_NOIBF=126
+
+_PI_CMD_MTRS =127
+_PI_CMD_MTRG =128
+
+_PI_CMD_ENCO =129
+_PI_CMD_ENCC =130
+_PI_CMD_ENCG =131
+_PI_CMD_ENCE =132
+
+_PI_CMD_WGRO =133
+_PI_CMD_IRRO =134
+_PI_CMD_DCDR =135
+_PI_CMD_DCDC =136
+
+_PI_CMD_SNIFF=137
+
+_PI_CMD_SLRE =138
+
+_PI_CMD_CAPS =139
+_PI_CMD_CAPG =140
+_PI_CMD_CAPR =141
+_PI_CMD_CAPW =142
+_PI_CMD_CAPC =143
+
+_PI_CMD_WVFRG=144
+_PI_CMD_WVCST=145
+
+_PI_CMD_WVSOP=146
+_PI_CMD_WVSEV=147
+_PI_CMD_WVSWR=148
+_PI_CMD_WVSST=149
+_PI_CMD_WVSCL=150
+
+_PI_CMD_WVCRS=151
+
 # pigpio error numbers
 
 _PI_INIT_FAILED     =-1
@@ -723,6 +821,30 @@ PI_BAD_EVENT_ID     =-143
 PI_CMD_INTERRUPTED  =-144
 PI_NOT_ON_BCM2711   =-145
 PI_ONLY_ON_BCM2711  =-146
+PI_BAD_SOCK_WORKERS =-147
+PI_BAD_BATCH_LEN    =-148
+PI_BAD_BATCH_CMD    =-149
+PI_BAD_SOCKET_PATH  =-150
+PI_BAD_RING_CMD     =-151
+PI_RING_FAILED      =-152
+PI_BAD_NOTIFY_RING  =-153
+PI_BAD_NOTIFY_FORMAT=-154
+PI_BAD_CB_WORKERS=-155
+PI_BAD_ALERT_POLL=-156
+PI_BAD_METER_WINDOW=-157
+PI_NOT_METERED=-158
+PI_BAD_ENCODER_EVENT=-159
+PI_BAD_IR_PROTOCOL=-160
+PI_NOT_DECODE_GPIO=-161
+PI_BAD_CAPTURE_DEPTH=-162
+PI_BAD_CAPTURE_TRIG=-163
+PI_NO_CAPTURE=-164
+PI_CAPTURE_NOT_DONE=-165
+PI_BAD_TIMER_MICROS=-166
+PI_BAD_TIMER_WORKERS=-167
+PI_BAD_WAVE_STREAM=-168
+PI_NO_WAVE_STREAM=-169
+PI_WAVE_STREAM_FULL=-170
 
 # pigpio error text
 
@@ -761,7 +883,7 @@ _errors=[
    [_PI_INITIALISED      , "function called after gpioInitialise"],
    [_PI_BAD_WAVE_MODE    , "waveform mode not 0-1"],
    [_PI_BAD_CFG_INTERNAL , "bad parameter in gpioCfgInternals call"],
-   [PI_BAD_WAVE_BAUD     , "baud rate not 50-250000(RX)/1000000(TX)"],
+   [PI_BAD_WAVE_BAUD     , "baud rate not 50-333333(RX)/1000000(TX)"],
    [PI_TOO_MANY_PULSES   , "waveform has too many pulses"],
    [PI_TOO_MANY_CHARS    , "waveform has too many chars"],
    [PI_NOT_SERIAL_GPIO   , "no bit bang serial read in progress on GPIO"],
@@ -871,6 +993,30 @@ _errors=[
    [PI_CMD_INTERRUPTED   , "pigpio command interrupted"],
    [PI_NOT_ON_BCM2711    , "not available on BCM2711"],
    [PI_ONLY_ON_BCM2711   , "only available on BCM2711"],
+   [PI_BAD_SOCK_WORKERS  , "socket workers not 1-64"],
+   [PI_BAD_BATCH_LEN     , "batch truncated or too long"],
+   [PI_BAD_BATCH_CMD     , "command not allowed in batch"],
+   [PI_BAD_SOCKET_PATH   , "socket path too long"],
+   [PI_BAD_RING_CMD      , "command not allowed on a ring"],
+   [PI_RING_FAILED       , "can't create command ring"],
+   [PI_BAD_NOTIFY_RING   , "notify ring not power of 2 16-65536"],
+   [PI_BAD_NOTIFY_FORMAT , "unknown notification format"],
+   [PI_BAD_CB_WORKERS    , "callback workers not 0-16"],
+   [PI_BAD_ALERT_POLL    , "alert poll not 0 or 50-50000"],
+   [PI_BAD_METER_WINDOW  , "meter window not 0 or 10-60000"],
+   [PI_NOT_METERED       , "GPIO has no meter"],
+   [PI_BAD_ENCODER_EVENT , "encoder event millis not 0-60000"],
+   [PI_BAD_IR_PROTOCOL   , "IR protocol not NEC or RC5"],
+   [PI_NOT_DECODE_GPIO   , "no Wiegand or IR read on GPIO"],
+   [PI_BAD_CAPTURE_DEPTH , "capture pre plus post samples > 1000000"],
+   [PI_BAD_CAPTURE_TRIG  , "bad capture GPIO or trigger"],
+   [PI_NO_CAPTURE        , "no capture started"],
+   [PI_CAPTURE_NOT_DONE  , "capture not complete"],
+   [PI_BAD_TIMER_MICROS  , "timer micros not 100-60000000"],
+   [PI_BAD_TIMER_WORKERS , "timer workers not 0-10"],
+   [PI_BAD_WAVE_STREAM   , "stream segments not 2-64, or bad pulses or low water"],
+   [PI_NO_WAVE_STREAM    , "no wave stream open"],
+   [PI_WAVE_STREAM_FULL  , "no free wave stream segment"],
 ]
 
 _except_a = "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n{}"
@@ -1011,6 +1157,37 @@ def _u2i(uint32):
          raise error(error_text(v))
    return v
 
+def _varint(b, pos):
+   """
+   Returns the position after and value of the varint at b[pos],
+   or None, None if it is incomplete.
+   """
+   v = 0
+   shift = 0
+   while pos < len(b):
+      v |= (b[pos] & 0x7f) << shift
+      pos += 1
+      if not (b[pos-1] & 0x80):
+         return pos, v
+      shift += 7
+   return None, None
+
+def _pigpio_connect(host, port):
+   """
+   Connects to the pigpio daemon.  A host of the form unix:path
+   connects to the daemon's Unix domain socket at path.
+   """
+   if host.startswith("unix:"):
+      s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+      try:
+         s.connect(host[5:])
+      except socket.error:
+         s.close()
+         raise
+   else:
+      s = socket.create_connection((host, port), None)
+   return s
+
 def _pigpio_command(sl, cmd, p1, p2):
    """
    Runs a pigpio socket command.
@@ -1130,9 +1307,16 @@ class _callback_thread(threading.Thread):
       self.event_bits = 0
       self.callbacks = []
       self.events = []
-      self.sl.s = socket.create_connection((host, port), None)
+      self.sl.s = _pigpio_connect(host, port)
       self.lastLevel = _pigpio_command(self.sl,  _PI_CMD_BR1, 0, 0)
-      self.handle = _u2i(_pigpio_command(self.sl, _PI_CMD_NOIB, 0, 0))
+      # ask for compact reports, older daemons only know NOIB
+      self.format = NOTIFY_FORMAT_V2
+      self.v2 = None
+      res = _pigpio_command(self.sl, _PI_CMD_NOIBF, NOTIFY_FORMAT_V2, 0)
+      if u2i(res) == PI_UNKNOWN_COMMAND:
+         self.format = NOTIFY_FORMAT_V1
+         res = _pigpio_command(self.sl, _PI_CMD_NOIB, 0, 0)
+      self.handle = _u2i(res)
       self.go = True
       self.start()
 
@@ -1182,6 +1366,52 @@ class _callback_thread(threading.Thread):
             _pigpio_command(
                self.control, _PI_CMD_EVM, self.handle, self.event_bits)
 
+   def _decode_v2(self, buf):
+      """
+      Decodes the complete NOTIFY_FORMAT_V2 records in buf.
+      Returns the reports and the number of bytes used.
+      """
+      reports = []
+      pos = 0
+      if self.v2 is None:
+         if len(buf) < 4:
+            return reports, 0
+         if struct.unpack('I', buf[:4])[0] != _NOTIFY_V2_MAGIC:
+            raise error("bad notification stream")
+         self.v2 = [0, 0, 0] # tick, level, next seqno
+         pos = 4
+      b = bytearray(buf)
+      tick, level, seq = self.v2
+      while True:
+         p, head = _varint(b, pos)
+         if p is None:
+            break
+         if head & _NOTIFY_V2_SEQNO:
+            p, seq = _varint(b, p)
+            if p is None:
+               break
+         flags = 0
+         if head & _NOTIFY_V2_FLAGS:
+            p, flags = _varint(b, p)
+            if p is None:
+               break
+         if head & _NOTIFY_V2_BIT:
+            if p >= len(b):
+               break
+            diff = 1 << b[p]
+            p += 1
+         else:
+            p, diff = _varint(b, p)
+            if p is None:
+               break
+         tick = (tick + (head >> _NOTIFY_V2_SHIFT)) & 0xffffffff
+         level ^= diff
+         reports.append((seq, flags, tick, level))
+         seq = (seq + 1) & 0xffff
+         pos = p
+         self.v2 = [tick, level, seq]
+      return reports, pos
+
    def run(self):
       """Runs the notification thread."""
 
@@ -1194,12 +1424,20 @@ class _callback_thread(threading.Thread):
       while self.go:
 
          buf += self.sl.s.recv(RECV_SIZ)
-         offset = 0
 
-         while self.go and (len(buf) - offset) >= MSG_SIZ:
-            msgbuf = buf[offset:offset + MSG_SIZ]
-            offset += MSG_SIZ
-            seq, flags, tick, level = (struct.unpack('HHII', msgbuf))
+         if self.format == NOTIFY_FORMAT_V2:
+            reports, offset = self._decode_v2(buf)
+         else:
+            reports = []
+            offset = 0
+            while (len(buf) - offset) >= MSG_SIZ:
+               reports.append(
+                  struct.unpack('HHII', buf[offset:offset + MSG_SIZ]))
+               offset += MSG_SIZ
+
+         for seq, flags, tick, level in reports:
+            if not self.go:
+               break
 
             if flags == 0:
                changed = level ^ lastLevel
@@ -1728,8 +1966,9 @@ class pi():
       seqno: starts at 0 each time the handle is opened and then
       increments by one for each report.
 
-      flags: three flags are defined, PI_NTFY_FLAGS_WDOG,
-      PI_NTFY_FLAGS_ALIVE, and PI_NTFY_FLAGS_EVENT.
+      flags: four flags are defined, PI_NTFY_FLAGS_WDOG,
+      PI_NTFY_FLAGS_ALIVE, PI_NTFY_FLAGS_EVENT, and
+      PI_NTFY_FLAGS_GAP.
 
       If bit 5 is set (PI_NTFY_FLAGS_WDOG) then bits 0-4 of the
       flags indicate a GPIO which has had a watchdog timeout.
@@ -1741,6 +1980,12 @@ class pi():
       If bit 7 is set (PI_NTFY_FLAGS_EVENT) then bits 0-4 of the
       flags indicate an event which has been triggered.
 
+      If bit 8 is set (PI_NTFY_FLAGS_GAP) then samples were lost
+      because the daemon's DMA sample buffer was overwritten before
+      it was read.  Sampling resumed at tick.  The level is the
+      last level reported before the gap.  A gap while the
+      notification is paused is reported when it resumes.
+
 
       tick: the number of microseconds since system boot.  It wraps
       around after 1h12m.
@@ -2274,6 +2519,9 @@ class pi():
       The wave id is passed to [*wave_send_**] to specify the waveform
       to transmit.
 
+      Each call makes a new wave.  See [*wave_create_shared*] to
+      reuse an existing wave made from the same pulses.
+
       Normal usage would be
 
       Step 1. [*wave_clear*] to clear all waveforms and added data.
@@ -2306,6 +2554,29 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_WVCRE, 0, 0))
 
+   def wave_create_shared(self):
+      """
+      Creates a waveform like [*wave_create*] but, if a wave made
+      from the same pulses by an earlier call of this function still
+      exists, returns its id and makes no new wave.
+
+      Returns a wave id (>=0) if OK,  otherwise PI_EMPTY_WAVEFORM,
+      PI_TOO_MANY_CBS, PI_TOO_MANY_OOL, or PI_NO_WAVEFORM_ID.
+
+      The wave is reference counted.  Each call which returns it
+      must be matched by a [*wave_delete*].  Until the last of those
+      deletes the wave id stays valid, its CBs and OOL are not
+      freed, and it may still be sent.
+
+      Only waves made by this function are shared.  See
+      [*wave_get_cache_stats*].
+
+      ...
+      wid = pi.wave_create_shared()
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_WVCRS, 0, 0))
+
    def wave_create_and_pad(self, percent):
       """
       This function creates a waveform like [*wave_create*] but pads the consumed
@@ -2359,14 +2630,15 @@ class pi():
 
       Wave ids are allocated in order, 0, 1, 2, etc.
 
-      The wave is flagged for deletion.  The resources used by the wave
-      will only be reused when either of the following apply.
+      The CBs and OOL used by the wave are freed and merged with any
+      free space either side.  A new wave is placed in the smallest free
+      range which will hold it, so waves of different sizes may be
+      created and deleted without calling [*wave_clear*].
 
-      - all waves with higher numbered wave ids have been deleted or have
-      been flagged for deletion.
-
-      - a new wave is created which uses exactly the same resources as
-      the current wave (see the C source for gpioWaveCreate for details).
+      A wave returned by more than one [*wave_create_shared*] is
+      only freed by the last of the matching deletes.  The earlier
+      deletes return 0 but leave the wave id valid and the wave in
+      place.
 
       ...
       pi.wave_delete(6) # delete waveform with id 6
@@ -2376,6 +2648,173 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_WVDEL, wave_id, 0))
 
+   def wave_get_fragmentation(self):
+      """
+      Reports how the CB and OOL space used by waves is split into
+      free ranges.
+
+      Returns a tuple of the waves in use, then for the CBs and
+      then the OOL the space available to waves, the space free,
+      the size of the largest free range, and the number of free
+      ranges.
+
+      A wave needing more than the largest free range can not be
+      created until other waves are deleted.
+
+      ...
+      (waves, cbs, free_cbs, largest_cbs, holes_cb,
+         ools, free_ools, largest_ools, holes_ool) = (
+         pi.wave_get_fragmentation())
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_WVFRG, 0, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('IIIIIIIII', _str(data))
+      return bytes
+
+   def wave_get_cache_stats(self):
+      """
+      Gets the statistics of the wave cache, which lets
+      [*wave_create_shared*] return an existing wave made from the
+      same pulses.
+
+      Returns a tuple of the creates which returned an existing
+      wave, the creates which made a new wave which may be shared,
+      the waves which may be shared, and the creates of those waves
+      not yet deleted.
+
+      ...
+      (hits, misses, waves, refs) = pi.wave_get_cache_stats()
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_WVCST, 0, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('IIII', _str(data))
+      return bytes
+
+   def wave_stream_open(self, segments, seg_pulses):
+      """
+      Opens a wave stream, a ring of segments which are played one
+      after the other while the earlier ones are refilled.  There
+      is no limit to the length of the pulse train.
+
+        segments:= 2-64, the segments in the ring.
+      seg_pulses:= 1-12000, the most pulses in a segment.
+
+      The segments are taken from the same space as waves and are
+      returned by [*wave_stream_close*] or [*wave_clear*].  Opening
+      a stream closes any earlier stream.
+
+      The output starts with the first [*wave_stream_write*] and
+      goes from the end of one segment to the start of the next
+      without a gap.  If it reaches the end of the last segment
+      written it stops, and the next write restarts it after the
+      gap and counts an underrun.
+
+      While a stream is open the wave transmits, [*wave_chain*],
+      and [*wave_tx_stop*] stop its output and drop the queued
+      segments.
+
+      ...
+      pi.wave_stream_open(4, 1000)
+      ...
+      """
+      return _u2i(_pigpio_command(
+         self.sl, _PI_CMD_WVSOP, segments, seg_pulses))
+
+   def wave_stream_set_event(self, event, low_water):
+      """
+      Triggers an event when the segments queued on the stream
+      fall to low_water, so the consumer knows to write more.
+
+          event:= 0-31.
+      low_water:= 0 to one less than the segments in the ring.
+
+      The event is triggered once each time the queued segments
+      fall to low_water or below.  Use [*event_callback*] to be
+      told of the event.
+
+      ...
+      pi.wave_stream_set_event(5, 1)
+      ...
+      """
+      return _u2i(_pigpio_command(
+         self.sl, _PI_CMD_WVSEV, event, low_water))
+
+   def wave_stream_write(self, pulses):
+      """
+      Queues a segment of pulses to be played after those already
+      queued on the stream.
+
+      pulses:= list of pulses, at most the seg_pulses given to
+               [*wave_stream_open*].
+
+      Each pulse is as for [*wave_add_generic*].  The segment
+      follows on from the previous segment.
+
+      PI_WAVE_STREAM_FULL is returned if every segment is queued.
+      Wait for the low water event, see [*wave_stream_set_event*],
+      then write again.
+
+      ...
+      pi.wave_stream_write([pigpio.pulse(1<<4, 0, 100),
+                            pigpio.pulse(0, 1<<4, 100)])
+      ...
+      """
+      # pigpio message format
+
+      # I p1 0
+      # I p2 0
+      # I p3 pulses * 12
+      ## extension ##
+      # III on/off/delay * pulses
+      ext = bytearray()
+      for p in pulses:
+         ext.extend(struct.pack("III", p.gpio_on, p.gpio_off, p.delay))
+      extents = [ext]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_WVSWR, 0, 0, len(pulses)*12, extents))
+
+   def wave_stream_status(self):
+      """
+      Gets the state of the stream.
+
+      Returns a tuple of the segments in the ring, the most pulses
+      per segment, the segments queued (written but not yet
+      played), written, and played, and the underruns (the times
+      the output ran out of segments and was restarted by a later
+      write).
+
+      ...
+      (segments, seg_pulses, queued, written, played, underruns) = (
+         pi.wave_stream_status())
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_WVSST, 0, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('IIIIII', _str(data))
+      return bytes
+
+   def wave_stream_close(self):
+      """
+      Stops the output of the stream, if it is running, and frees
+      its segments.
+
+      ...
+      pi.wave_stream_close()
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_WVSCL, 0, 0))
+
    def wave_tx_start(self): # DEPRECATED
       """
       This function is deprecated and has been removed.
@@ -4320,6 +4759,307 @@ class pi():
       return _u2i(_pigpio_command_ext(
          self.sl, _PI_CMD_FN, user_gpio, steady, 4, extents))
 
+   def set_meter(self, user_gpio, window_ms):
+      """
+      Starts (or stops) an edge meter on a GPIO.
+
+      user_gpio:= 0-31
+      window_ms:= 0 (to stop), or 10-60000
+
+      Returns 0 if OK, otherwise PI_BAD_USER_GPIO or
+      PI_BAD_METER_WINDOW.
+
+      The daemon counts the rising and falling edges of the GPIO
+      and the time it is high.  Every window_ms milliseconds it
+      calculates the frequency, period, pulse width, and duty
+      cycle over the window.  The results may be read with
+      [*get_meter*].  No edges are sent over the network.
+
+      ...
+      pi.set_meter(4, 1000)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_MTRS, user_gpio, window_ms))
+
+   def get_meter(self, user_gpio):
+      """
+      Gets the results of the edge meter on a GPIO.
+
+      user_gpio:= 0-31
+
+      Returns a tuple of rising edges and falling edges since the
+      meter was started, the length of the last window in
+      microseconds, rising edges in the last window, frequency in
+      millihertz, mean period in nanoseconds, mean high pulse in
+      nanoseconds, and the time high in parts per million.
+
+      The edge counts are current.  The other values are from
+      the last complete window and are zero until the first
+      window ends.
+
+      ...
+      (r, f, w, e, freq, period, pulse, duty) = pi.get_meter(4)
+      print("{:.3f} Hz".format(freq/1000.0))
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_MTRG, user_gpio, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('8I', _str(data))
+      return bytes
+
+   def encoder_open(self, gpio_a, gpio_b, gpio_index=32):
+      """
+      Starts decoding a quadrature encoder.
+
+          gpio_a:= 0-31
+          gpio_b:= 0-31
+      gpio_index:= 0-31, or 32 (the default) for no index
+
+      Returns a handle (>=0) if OK, otherwise PI_BAD_USER_GPIO,
+      PI_GPIO_IN_USE, or PI_NO_HANDLE.
+
+      The daemon decodes the encoder from its GPIO samples.  No
+      edges are sent over the network.  Every change of A or B
+      counts one step (four per cycle).  The position counts up
+      when A leads B.
+
+      If A and B both change between samples a step has been
+      missed and the error count is incremented.
+
+      The velocity is updated every 100 milliseconds.
+
+      If an index GPIO is given each rising edge is counted and
+      the position at the time is recorded.
+
+      The encoder is closed automatically when the connection
+      to the daemon is closed.
+
+      ...
+      h = pi.encoder_open(17, 18)
+      ...
+      """
+      # I p1 gpio_a
+      # I p2 gpio_b
+      # I p3 4
+      ## extension ##
+      # I gpio_index
+      extents = [struct.pack("I", gpio_index)]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_ENCO, gpio_a, gpio_b, 4, extents))
+
+   def encoder_close(self, handle):
+      """
+      Stops decoding a quadrature encoder.
+
+      handle:= >=0 (as returned by [*encoder_open*]).
+
+      Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+      ...
+      pi.encoder_close(h)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_ENCC, handle, 0))
+
+   def encoder_get(self, handle):
+      """
+      Gets the position, velocity, and error counts of an encoder.
+
+      handle:= >=0 (as returned by [*encoder_open*]).
+
+      Returns a tuple of the position in counts, the velocity in
+      counts per second, the number of missed steps, the number
+      of index edges, the position at the last index, and the
+      tick of the last position change.
+
+      ...
+      (pos, vel, err, idx, ipos, tick) = pi.encoder_get(h)
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_ENCG, handle, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('iiIIiI', _str(data))
+      return bytes
+
+   def encoder_set_event(self, handle, event, millis):
+      """
+      Triggers an event when the position of an encoder changes.
+
+      handle:= >=0 (as returned by [*encoder_open*]).
+       event:= 0-31
+      millis:= 0-60000
+
+      Returns 0 if OK, otherwise PI_BAD_HANDLE, PI_BAD_EVENT_ID,
+      or PI_BAD_ENCODER_EVENT.
+
+      The event is triggered at most once every millis
+      milliseconds, and only if the position has changed since it
+      was last triggered.  A millis of 0 stops the events.
+
+      Use [*event_callback*] to be told of the event and
+      [*encoder_get*] to read the position.
+
+      ...
+      pi.encoder_set_event(h, 3, 20)
+      ...
+      """
+      # I p1 handle
+      # I p2 event
+      # I p3 4
+      ## extension ##
+      # I millis
+      extents = [struct.pack("I", millis)]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_ENCE, handle, event, 4, extents))
+
+   def capture_start(self, bits, trig_mode, trig_bits, trig_levels,
+                     pre_samples, post_samples):
+      """
+      Starts a triggered capture of GPIO samples, like a logic
+      analyser.
+
+              bits:= the GPIO to capture
+         trig_mode:= CAPTURE_NOW, CAPTURE_LEVEL, CAPTURE_EDGE, or
+                     CAPTURE_CHANGE
+         trig_bits:= the GPIO which trigger the capture
+       trig_levels:= the trigger levels of those GPIO
+       pre_samples:= samples to keep from before the trigger
+      post_samples:= samples to keep from after the trigger
+
+      Returns 0 if OK, otherwise PI_BAD_CAPTURE_TRIG or
+      PI_BAD_CAPTURE_DEPTH.
+
+      The capture is taken by the daemon as it reads the GPIO
+      samples.  A sample is kept each time one of the captured
+      GPIO changes level.
+
+      Until the trigger the latest pre_samples samples are kept.
+      The sample which meets the trigger is kept, then the next
+      post_samples samples.  The capture is then complete.
+
+      pre_samples plus post_samples may be at most 1000000.
+
+      ...
+      # capture GPIO 2-5 around the first falling edge of GPIO 4
+      pi.capture_start(0x3C, pigpio.CAPTURE_EDGE, 1<<4, 0, 1000, 9000)
+      ...
+      """
+      # I p1 bits
+      # I p2 trig_mode
+      # I p3 16
+      ## extension ##
+      # I trig_bits
+      # I trig_levels
+      # I pre_samples
+      # I post_samples
+      extents = [struct.pack("IIII",
+         trig_bits, trig_levels, pre_samples, post_samples)]
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_CAPS, bits, trig_mode, 16, extents))
+
+   def capture_status(self):
+      """
+      Gets the state of a capture.
+
+      Returns a tuple of the state, the number of samples held,
+      the index of the trigger sample, the tick of the trigger
+      sample, and the number of times samples were lost.
+
+      The state is CAPTURE_ARMED, CAPTURE_TRIGGERED, or
+      CAPTURE_DONE.
+
+      ...
+      (state, samples, trigger, tick, gaps) = pi.capture_status()
+      ...
+      """
+      with self.sl.l:
+         bytes = u2i(
+            _pigpio_command_nolock(self.sl, _PI_CMD_CAPG, 0, 0))
+         if bytes > 0:
+            data = self._rxbuf(bytes)
+            return struct.unpack('IIIII', _str(data))
+      return bytes
+
+   def capture_read(self, max_samples=1000000):
+      """
+      Reads the samples of a complete capture.
+
+      max_samples:= the most samples to read, default 1000000.
+
+      The returned value is a tuple of the number of samples read
+      and a list of samples.  Each sample is a tuple of its tick
+      and the levels of the captured GPIO.
+
+      The samples are read from the daemon in blocks and are in
+      time order.
+
+      ...
+      (count, samples) = pi.capture_read()
+      for (tick, levels) in samples:
+         print("{} {:08X}".format(tick, levels))
+      ...
+      """
+      samples = []
+      while len(samples) < max_samples:
+         chunk = min(max_samples - len(samples), 8192)
+         with self.sl.l:
+            bytes = u2i(_pigpio_command_nolock(
+               self.sl, _PI_CMD_CAPR, len(samples), chunk))
+            if bytes > 0:
+               data = _str(self._rxbuf(bytes))
+         if bytes < 0:
+            return bytes, samples
+         if bytes == 0:
+            break
+         for i in range(0, bytes - 7, 8):
+            samples.append(struct.unpack('II', data[i:i+8]))
+      return len(samples), samples
+
+   def capture_save(self, file_name):
+      """
+      Saves the samples of a complete capture to a file on the
+      daemon's host.
+
+      file_name:= the file to write.
+
+      Returns the number of samples saved if OK, otherwise
+      PI_NO_CAPTURE, PI_CAPTURE_NOT_DONE, or one of the errors of
+      [*file_open*].
+
+      The file must be writable as for [*file_open*].  It is
+      written in the notification format so may be converted to
+      VCD by pig2vcd.
+
+      ...
+      pi.capture_save("/tmp/capture.bin")
+      ...
+      """
+      # I p1 0
+      # I p2 0
+      # I p3 len
+      ## extension ##
+      # s len data bytes
+      return _u2i(_pigpio_command_ext(
+         self.sl, _PI_CMD_CAPW, 0, 0, len(file_name), [file_name]))
+
+   def capture_stop(self):
+      """
+      Stops a capture, complete or not, and frees its samples.
+
+      Returns 0 if OK, otherwise PI_NO_CAPTURE.
+
+      ...
+      pi.capture_stop()
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_CAPC, 0, 0))
+
    def store_script(self, script):
       """
       Store a script for later execution.
@@ -4479,7 +5219,7 @@ class pi():
       Opens a GPIO for bit bang reading of serial data.
 
       user_gpio:= 0-31, the GPIO to use.
-           baud:= 50-250000, the baud rate.
+           baud:= 50-333333, the baud rate.
         bb_bits:= 1-32, the number of bits per word, default 8.
 
       The serial data is held in a cyclic buffer and is read using
@@ -4488,6 +5228,11 @@ class pi():
       It is the caller's responsibility to read data from the cyclic
       buffer in a timely fashion.
 
+      Each bit should span at least three of the daemon's samples.
+      Baud rates above 66666 need a faster sample rate than the
+      default 5 microseconds (pigpiod -s), and the highest rate
+      needs a 1 microsecond sample rate.
+
       ...
       status = pi.bb_serial_read_open(4, 19200)
       status = pi.bb_serial_read_open(17, 9600)
@@ -4562,6 +5307,155 @@ class pi():
       """
       return _u2i(_pigpio_command(self.sl, _PI_CMD_SLRI, user_gpio, invert))
 
+   def bb_serial_read_errors(self, user_gpio):
+      """
+      Returns the number of framing errors seen by a bit bang serial
+      read since the GPIO was opened.
+
+      user_gpio:= 0-31 (opened in a prior call to [*bb_serial_read_open*])
+
+      A framing error is a start bit which is not low or a stop bit
+      which is not high at the middle of the bit.  A character with
+      a bad stop bit is still added to the buffer, one with a bad
+      start bit is not.
+
+      ...
+      errors = pi.bb_serial_read_errors(17)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_SLRE, user_gpio, 0))
+
+   def wiegand_read_open(self, gpio_d0, gpio_d1):
+      """
+      Opens two GPIO for reading Wiegand frames.
+
+      gpio_d0:= 0-31, the D0 (data 0) line.
+      gpio_d1:= 0-31, the D1 (data 1) line.
+
+      Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+      The daemon decodes the frames from its GPIO samples and
+      returns them in a cyclic buffer which is read using
+      [*decode_read*] on gpio_d0.  No edges are sent over the
+      network.
+
+      A frame ends when no bit has arrived for 25 milliseconds.
+      For 26 and 34 bit frames the parity bits are checked and
+      removed, leaving a 24 or 32 bit code.
+
+      ...
+      status = pi.wiegand_read_open(14, 15)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_WGRO, gpio_d0, gpio_d1))
+
+   def ir_read_open(self, user_gpio, protocol):
+      """
+      Opens a GPIO for reading IR remote frames.
+
+      user_gpio:= 0-31.
+       protocol:= DECODE_NEC or DECODE_RC5.
+
+      Returns 0 if OK, otherwise PI_BAD_USER_GPIO,
+      PI_BAD_IR_PROTOCOL, or PI_GPIO_IN_USE.
+
+      The GPIO should be connected to an IR receiver module whose
+      output is low while it sees the carrier.  The daemon decodes
+      the frames from its GPIO samples and returns them in a cyclic
+      buffer which is read using [*decode_read*].
+
+      An NEC code is the 32 bits of the frame, the first bit
+      received in bit 0.  A repeat frame returns the previous code
+      with DECODE_REPEAT set.
+
+      An RC5 code has the 5 bit address in bits 8-12 and the 7 bit
+      command in bits 0-6.  DECODE_TOGGLE is set if the toggle bit
+      was.
+
+      ...
+      status = pi.ir_read_open(18, pigpio.DECODE_NEC)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_IRRO, user_gpio, protocol))
+
+   def i2c_sniff_open(self, SDA, SCL):
+      """
+      Opens two GPIO to passively sniff an I2C bus.
+
+      SDA:= 0-31.
+      SCL:= 0-31.
+
+      Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+      The daemon decodes the bus from its GPIO samples and returns
+      each byte, with its ACK, in a cyclic buffer which is read
+      using [*decode_read*] on SDA.  No edges are sent over the
+      network.
+
+      Each byte is a frame of 8 bits.  The first byte after a START
+      or repeated START has DECODE_START set.  DECODE_NACK is set if
+      the byte was not acknowledged.  A STOP is a frame of 0 bits
+      with DECODE_STOP set.
+
+      Each SCL high and low period must last at least one sample.
+      A 100kHz bus needs the daemon to use a 1 or 2 microsecond
+      sample rate.
+
+      ...
+      status = pi.i2c_sniff_open(2, 3)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_SNIFF, SDA, SCL))
+
+   def decode_read(self, user_gpio, max_frames=256):
+      """
+      Returns decoded Wiegand, IR, or I2C frames from the cyclic
+      buffer.
+
+       user_gpio:= 0-31 (opened in a prior call to
+                   [*wiegand_read_open*] (D0), [*ir_read_open*],
+                   or [*i2c_sniff_open*] (SDA)).
+      max_frames:= the most frames to return, default 256.
+
+      The returned value is a tuple of the number of frames read
+      and a list of frames.  Each frame is a tuple of the tick of
+      its first edge, the code, the number of bits, the protocol,
+      and the flags.
+
+      DECODE_BAD_CHECK is set in the flags of a frame whose parity
+      (Wiegand) or complement (NEC) check failed.
+
+      ...
+      (count, frames) = pi.decode_read(18)
+      for (tick, code, bits, protocol, flags) in frames:
+         print("{:08X}".format(code))
+      ...
+      """
+      frames = []
+      with self.sl.l:
+         bytes = u2i(_pigpio_command_nolock(
+            self.sl, _PI_CMD_DCDR, user_gpio, max_frames))
+         if bytes > 0:
+            data = _str(self._rxbuf(bytes))
+            for i in range(0, bytes - 11, 12):
+               frames.append(struct.unpack('IIHBB', data[i:i+12]))
+            return len(frames), frames
+      return bytes, frames
+
+   def decode_read_close(self, user_gpio):
+      """
+      Closes a GPIO for Wiegand, IR, or I2C sniffer reads.
+
+      user_gpio:= 0-31 (opened in a prior call to
+                  [*wiegand_read_open*] (D0), [*ir_read_open*],
+                  or [*i2c_sniff_open*] (SDA)).
+
+      ...
+      status = pi.decode_read_close(18)
+      ...
+      """
+      return _u2i(_pigpio_command(self.sl, _PI_CMD_DCDC, user_gpio, 0))
+
 
    def custom_1(self, arg1=0, arg2=0, argx=[]):
       """
@@ -5183,7 +6077,9 @@ class pi():
 
       host:= the host name of the Pi on which the pigpio daemon is
              running.  The default is localhost unless overridden by
-             the PIGPIO_ADDR environment variable.
+             the PIGPIO_ADDR environment variable.  A host of the
+             form unix:path connects to a local daemon's Unix
+             domain socket (see pigpiod -u).
 
       port:= the port number on which the pigpio daemon is listening.
              The default is 8888 unless overridden by the PIGPIO_PORT
@@ -5201,6 +6097,7 @@ class pi():
       pi = pigio.pi()              # use defaults
       pi = pigpio.pi('mypi')       # specify host, default port
       pi = pigpio.pi('mypi', 7777) # specify host and port
+      pi = pigpio.pi('unix:/var/run/pigpio.sock') # local daemon
 
       pi = pigpio.pi()             # exit script if no connection
       if not pi.connected:
@@ -5221,10 +6118,11 @@ class pi():
       self._port = port
 
       try:
-         self.sl.s = socket.create_connection((host, port), None)
+         self.sl.s = _pigpio_connect(host, port)
 
-         # Disable the Nagle algorithm.
-         self.sl.s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+         if self.sl.s.family != socket.AF_UNIX:
+            # Disable the Nagle algorithm.
+            self.sl.s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
 
          self._notify = _callback_thread(self.sl, host, port)
 
@@ -5501,6 +6399,30 @@ def xref():
    PI_CMD_INTERRUPTED = -144
    PI_NOT_ON_BCM2711   = -145
    PI_ONLY_ON_BCM2711  = -146
+   PI_BAD_SOCK_WORKERS = -147
+   PI_BAD_BATCH_LEN = -148
+   PI_BAD_BATCH_CMD = -149
+   PI_BAD_SOCKET_PATH = -150
+   PI_BAD_RING_CMD = -151
+   PI_RING_FAILED = -152
+   PI_BAD_NOTIFY_RING = -153
+   PI_BAD_NOTIFY_FORMAT = -154
+   PI_BAD_CB_WORKERS = -155
+   PI_BAD_ALERT_POLL = -156
+   PI_BAD_METER_WINDOW = -157
+   PI_NOT_METERED = -158
+   PI_BAD_ENCODER_EVENT = -159
+   PI_BAD_IR_PROTOCOL = -160
+   PI_NOT_DECODE_GPIO = -161
+   PI_BAD_CAPTURE_DEPTH = -162
+   PI_BAD_CAPTURE_TRIG = -163
+   PI_NO_CAPTURE = -164
+   PI_CAPTURE_NOT_DONE = -165
+   PI_BAD_TIMER_MICROS = -166
+   PI_BAD_TIMER_WORKERS = -167
+   PI_BAD_WAVE_STREAM = -168
+   PI_NO_WAVE_STREAM = -169
+   PI_WAVE_STREAM_FULL = -170
    . .
 
    event:0-31
@@ -5568,6 +6490,22 @@ def xref():
    Type 3    X  X  X  X  X  X  X  X  X  X  X  X  -  -  -  -
    . .
 
+   gpio_a: 0-31
+   The GPIO connected to the A output of a quadrature encoder.
+
+   gpio_b: 0-31
+   The GPIO connected to the B output of a quadrature encoder.
+
+   gpio_d0: 0-31
+   The GPIO connected to the D0 (data 0) line of a Wiegand device.
+
+   gpio_d1: 0-31
+   The GPIO connected to the D1 (data 1) line of a Wiegand device.
+
+   gpio_index: 0-32
+   The GPIO connected to the index output of a quadrature encoder,
+   or 32 if there is none.
+
    gpio_off:
    A mask used to select GPIO to be operated on.  See [*bits*].
 
@@ -5583,6 +6521,7 @@ def xref():
    handle: >=0
    A number referencing an object opened by one of the following
 
+   [*encoder_open*]
    [*file_open*]
    [*i2c_open*]
    [*notify_open*]
@@ -5617,6 +6556,19 @@ def xref():
    TIMEOUT = 2 # only returned for a watchdog timeout
    . .
 
+   low_water:
+   The number of queued wave stream segments at or below which an
+   event is triggered.
+
+   max_frames: >=0
+   The maximum number of decoded frames to return.
+
+   max_samples: >=0
+   The most capture samples to return.
+
+   millis: 0-60000
+   The minimum interval between encoder events in milliseconds.
+
    MISO:
    The GPIO used for the MISO signal when bit banging SPI.
 
@@ -5673,6 +6625,20 @@ def xref():
    port:
    The port used by the pigpio daemon, defaults to 8888.
 
+   post_samples: >=0
+   The samples to keep from after the trigger of a capture.
+
+   pre_samples: >=0
+   The samples to keep from before the trigger of a capture.
+
+   protocol: 1-2
+   The IR protocol to decode.
+
+   . .
+   DECODE_NEC = 1
+   DECODE_RC5 = 2
+   . .
+
    pstring:
    The string to be passed to a [*shell*] script to be executed.
 
@@ -5688,7 +6654,7 @@ def xref():
 
    pulses:
    A list of class pulse objects defining the characteristics of a
-   waveform.
+   waveform or of a wave stream segment.
 
    pulsewidth:
    The servo pulsewidth in microseconds.  0 switches pulses off.
@@ -5740,6 +6706,12 @@ def xref():
    The number of bytes to move forward (positive) or backwards
    (negative) from the seek position (start, current, or end of file).
 
+   seg_pulses: 1-12000
+   The most pulses in a segment of a wave stream.
+
+   segments: 2-64
+   The number of segments in a wave stream.
+
    ser_flags: 32 bit
    No serial flags are currently defined.
 
@@ -5774,6 +6746,22 @@ def xref():
    t2:
    A tick (later).
 
+   trig_bits: 32 bit number
+   A mask of the GPIO which trigger a capture.
+
+   trig_levels: 32 bit number
+   The levels of the trig_bits GPIO which trigger a capture.
+
+   trig_mode: 0-3
+   How a capture is triggered.
+
+   . .
+   CAPTURE_NOW = 0
+   CAPTURE_LEVEL = 1
+   CAPTURE_EDGE = 2
+   CAPTURE_CHANGE = 3
+   . .
+
    tty:
    A Pi serial tty device, e.g. /dev/ttyAMA0, /dev/ttyUSB0
 
@@ -0,0 +1,969 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+*/
+
+/*
+This version is for pigpio version 70+
+*/
+
+/*
+The inner loops of the alert thread and of the wave build.  They
+are here, rather than in pigpio.c, so that the benchmarks in
+EXAMPLES/C check and time the code pigpio.c runs and not a copy.
+
+The functions work on the state they are passed.  The wave build
+keeps its state in this file and is only compiled if the includer
+first defines NUM_WAVE_OOL, the OOL a wave may use, and later
+defines waveDelayCBs(), the CBs a delay needs.
+
+Not installed.  Include it in one file of a program.
+*/
+
+#ifndef PIGPIO_KERNELS_H
+#define PIGPIO_KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+
+#include "pigpio.h"
+
+/* alert thread ---------------------------------------------------------- */
+
+typedef struct
+{
+   int      nfSteadyUs;
+   int      nfActiveUs;
+   int      nfActive;
+   uint32_t nfTick1;
+   uint32_t nfTick2;
+   uint32_t nfLBitV;
+   uint32_t nfRBitV;
+
+   uint32_t gfSteadyUs;
+   uint8_t  gfInitialised;
+   uint32_t gfTick;
+   uint32_t gfLBitV;
+   uint32_t gfRBitV;
+
+} alertFilter_t;
+
+typedef struct
+{
+   int      wdSteadyUs;
+   uint32_t wdTick;
+} alertWdog_t;
+
+typedef struct
+{
+   char    *buf;
+   uint32_t bufSize;
+   int      readPos;
+   int      writePos;
+   uint32_t fullBit; /* nanoseconds */
+   uint32_t halfBit; /* nanoseconds */
+   uint32_t startBitTick; /* microseconds */
+   uint32_t nextBitDiff; /* nanoseconds */
+   int      bit; /* -1 idle, 0 start, 1-dataBits data, then stop */
+   uint32_t data;
+   int      bytes; /* 1, 2, 4 */
+   int      dataBits; /* 1-32 */
+   int      invert; /* 0, 1 */
+   uint32_t errors; /* framing errors */
+} wfRxSerial_t;
+
+/*
+   The glitch and noise filters work on all the filtered bank 1 GPIO
+   of a sample at once, one bit per GPIO.  Per GPIO work (timer
+   starts and expiries) is only done for the GPIO which changed, or
+   once the earliest pending timer is due.  f is indexed by GPIO and
+   bits are the GPIO to filter.
+*/
+
+static inline void alertGlitchFilter(
+   alertFilter_t *f, uint32_t bits, gpioSample_t *sample, int numSamples)
+{
+   int i, j, recheck;
+   uint32_t changed, pending, b, bit, bitV;
+   uint32_t RBits, LBits, tick, checkTick, diff, remain, minRemain;
+   uint32_t steadyUs[PI_MAX_USER_GPIO+1];
+   uint32_t changedTick[PI_MAX_USER_GPIO+1];
+
+   RBits = 0;
+   LBits = 0;
+
+   for (b=bits; b; b&=(b-1))
+   {
+      i = __builtin_ctz(b);
+      bit = (1<<i);
+
+      if (!f[i].gfInitialised && numSamples > 0)
+      {
+        /* Initialise filter with first sample */
+        bitV = sample[0].level & bit;
+        f[i].gfRBitV = bitV;
+        f[i].gfLBitV = bitV;
+        f[i].gfTick = sample[0].tick;
+        f[i].gfInitialised = 1;
+      }
+
+      steadyUs[i]    = f[i].gfSteadyUs;
+      changedTick[i] = f[i].gfTick;
+      RBits         |= f[i].gfRBitV;
+      LBits         |= f[i].gfLBitV;
+   }
+
+   recheck   = 1;
+   checkTick = 0;
+
+   for (j=0; j<numSamples; j++)
+   {
+      tick = sample[j].tick;
+
+      /* Difference between level and last level.
+         Restart steady timers. */
+
+      changed = (sample[j].level ^ LBits) & bits;
+
+      if (changed)
+      {
+         LBits ^= changed;
+
+         for (b=changed; b; b&=(b-1)) changedTick[__builtin_ctz(b)] = tick;
+
+         recheck = 1;
+      }
+
+      /* Difference between level and reported level. */
+
+      pending = (sample[j].level ^ RBits) & bits;
+
+      if (pending)
+      {
+         /* Until a level changes or the earliest steady period ends
+            the pending GPIO stay pending. */
+
+         if (recheck || ((int32_t)(tick - checkTick) >= 0))
+         {
+            minRemain = UINT32_MAX;
+
+            for (b=pending; b; b&=(b-1))
+            {
+               i = __builtin_ctz(b);
+
+               diff = tick - changedTick[i];
+
+               /* Level stable for steady period. */
+
+               if (diff >= steadyUs[i]) RBits ^= (1<<i);
+               else
+               {
+                  remain = steadyUs[i] - diff;
+                  if (remain < minRemain) minRemain = remain;
+               }
+            }
+
+            checkTick = tick + minRemain;
+            recheck = 0;
+
+            pending = (sample[j].level ^ RBits) & bits;
+         }
+
+         /* Keep reporting old levels. */
+
+         sample[j].level ^= pending;
+      }
+   }
+
+   for (b=bits; b; b&=(b-1))
+   {
+      i = __builtin_ctz(b);
+      bit = (1<<i);
+
+      f[i].gfRBitV = RBits & bit;
+      f[i].gfLBitV = LBits & bit;
+      f[i].gfTick  = changedTick[i];
+   }
+}
+
+static inline void alertNoiseFilter(
+   alertFilter_t *f, uint32_t bits, gpioSample_t *sample, int numSamples)
+{
+   int i, j, diff, minWait, recheck;
+   uint32_t ABits, RBits, LBits, stopped, changed, b, bit;
+   uint32_t level, nowTick, nextStop;
+
+   ABits = 0;
+   RBits = 0;
+   LBits = 0;
+
+   for (b=bits; b; b&=(b-1))
+   {
+      i = __builtin_ctz(b);
+      bit = (1<<i);
+
+      if (f[i].nfActive) ABits |= bit;
+      RBits |= f[i].nfRBitV & bit;
+      LBits |= f[i].nfLBitV & bit;
+   }
+
+   recheck  = 1;
+   nextStop = 0;
+
+   for (j=0; j<numSamples; j++)
+   {
+      level   = sample[j].level;
+      nowTick = sample[j].tick;
+
+      stopped = 0;
+
+      /* reporting events, stop when the active period ends */
+
+      if (ABits && (recheck || ((int32_t)(nowTick - nextStop) >= 0)))
+      {
+         minWait = INT_MAX;
+
+         for (b=ABits; b; b&=(b-1))
+         {
+            i = __builtin_ctz(b);
+
+            diff = nowTick - f[i].nfTick2;
+
+            if (diff >= 0)
+            {
+               /* Stop reporting gpio changes */
+
+               stopped |= (1<<i);
+               f[i].nfTick1 = nowTick;
+            }
+            else if (-diff < minWait) minWait = -diff;
+         }
+
+         ABits &= ~stopped;
+         nextStop = nowTick + minWait;
+         recheck = 0;
+      }
+
+      /* waiting for steady us */
+
+      changed = (level ^ LBits) & bits & ~(ABits | stopped);
+
+      for (b=changed; b; b&=(b-1))
+      {
+         i = __builtin_ctz(b);
+         bit = (1<<i);
+
+         diff = nowTick - f[i].nfTick1;
+         f[i].nfTick1 = nowTick;
+
+         if (diff >= f[i].nfSteadyUs)
+         {
+            /* Start reporting gpio changes */
+
+            RBits = (RBits & ~bit) | (LBits & bit);
+            ABits |= bit;
+            f[i].nfTick2 = nowTick + f[i].nfActiveUs;
+            recheck = 1;
+         }
+      }
+
+      sample[j].level ^= (level ^ RBits) & bits & ~ABits;
+
+      LBits = level & bits;
+   }
+
+   for (b=bits; b; b&=(b-1))
+   {
+      i = __builtin_ctz(b);
+      bit = (1<<i);
+
+      f[i].nfActive = (ABits & bit) ? 1 : 0;
+      f[i].nfRBitV  = RBits & bit;
+      f[i].nfLBitV  = LBits & bit;
+   }
+}
+
+static inline void alertSerialBits(wfRxSerial_t *s, int level, uint32_t tick)
+{
+   /*
+   Give level to each bit of the frame whose centre is before tick.
+   The centres are walked by adding the bit time so no division is
+   needed.  The frame ends at the centre of the stop bit, a start bit
+   which isn't low or a stop bit which isn't high is a framing error.
+   */
+
+   uint32_t micros, nanos;
+   int newWritePos;
+
+   micros = tick - s->startBitTick;
+
+   /* nanos would wrap after 4.29 seconds, far longer than any frame */
+
+   if (micros < 4000000) nanos = micros * 1000;
+   else                  nanos = 0xFFFFFFFF;
+
+   while (nanos > s->nextBitDiff)
+   {
+      if (s->bit == 0)
+      {
+         if (level)
+         {
+            s->errors++;
+            s->bit = -1;
+            return;
+         }
+      }
+      else if (s->bit <= s->dataBits)
+      {
+         if (level) s->data |= (1<<(s->bit-1));
+      }
+      else
+      {
+         if (!level) s->errors++;
+
+         memcpy(s->buf + s->writePos, &s->data, s->bytes);
+
+         /* don't let writePos catch readPos */
+
+         newWritePos = (s->writePos + s->bytes) % (s->bufSize);
+
+         if (newWritePos != s->readPos) s->writePos = newWritePos;
+
+         s->bit = -1;
+         return;
+      }
+
+      s->bit++;
+      s->nextBitDiff += s->fullBit;
+   }
+}
+
+static inline void alertSerialDecode(
+   wfRxSerial_t *rx, size_t stride, uint32_t bits, uint32_t *lastLevels,
+   gpioSample_t *sample, int numSamples, uint32_t eTick)
+{
+   /*
+   Decode all the bit bang serial reads in one pass over the samples.
+   Only the serial GPIO which changed in a sample are visited.  Frames
+   whose stop bit centre has passed by eTick are completed at the end
+   so no watchdog is needed to end the last frame of a burst.
+
+   The decoder of GPIO b is stride * b bytes after rx.
+   */
+
+   int b, d, level;
+   uint32_t changed, levels;
+   wfRxSerial_t *s;
+
+   levels = *lastLevels;
+
+   for (d=0; d<numSamples; d++)
+   {
+      changed = (sample[d].level ^ levels) & bits;
+
+      if (!changed) continue;
+
+      levels ^= changed;
+
+      for (; changed; changed&=(changed-1))
+      {
+         b = __builtin_ctz(changed);
+
+         s = (wfRxSerial_t *)((char *)rx + (stride * b));
+
+         level = ((levels >> b) & 1) ^ s->invert;
+
+         /* the level before the edge is complete */
+
+         if (s->bit >= 0) alertSerialBits(s, !level, sample[d].tick);
+
+         /* start bit if high->low */
+
+         if ((s->bit < 0) && (level == 0))
+         {
+            s->bit          = 0;
+            s->data         = 0;
+            s->startBitTick = sample[d].tick;
+            s->nextBitDiff  = s->halfBit;
+         }
+      }
+   }
+
+   *lastLevels = levels;
+
+   for (; bits; bits&=(bits-1))
+   {
+      b = __builtin_ctz(bits);
+
+      s = (wfRxSerial_t *)((char *)rx + (stride * b));
+
+      if (s->bit >= 0)
+         alertSerialBits(s, ((levels >> b) & 1) ^ s->invert, eTick);
+   }
+}
+
+static inline void alertWdogCheck(
+   alertWdog_t *w, uint32_t bits, uint32_t *lastLevels,
+   gpioSample_t *sample, int numSamples)
+{
+   /*
+   Go through and set the last time each GPIO with a watchdog changed state.
+   */
+
+   int b, j;
+   uint32_t level, changed;
+
+   level = *lastLevels;
+
+   for (j=0; j<numSamples; j++)
+   {
+      changed = (sample[j].level ^ level) & bits;
+
+      if (changed)
+      {
+         level ^= changed;
+
+         while (changed)
+         {
+            b = __builtin_ctz(changed);
+
+            changed &= (changed - 1);
+
+            w[b].wdTick = sample[j].tick;
+         }
+      }
+   }
+
+   *lastLevels = (*lastLevels & ~bits) | (level & bits);
+}
+
+static inline uint32_t alertWdogTimeouts(
+   alertWdog_t *w, uint32_t bits, volatile uint32_t *rescan,
+   uint32_t *nextTick, uint32_t eTick)
+{
+   /*
+   Return the watchdogs which have timed out.
+
+   An edge only moves a deadline later so *nextTick, the earliest
+   deadline when last checked, is a lower bound.  The watchdogs are
+   only checked once it is reached or *rescan says one was changed.
+   */
+
+   int b;
+   int32_t diff, left, next;
+   uint32_t timeoutBits;
+
+   timeoutBits = 0;
+
+   if (bits &&
+       (__atomic_exchange_n(rescan, 0, __ATOMIC_ACQ_REL) ||
+        ((int32_t)(eTick - *nextTick) >= 0)))
+   {
+      next = PI_MAX_WDOG_TIMEOUT * 1000;
+
+      while (bits)
+      {
+         b = __builtin_ctz(bits);
+
+         bits &= (bits - 1);
+
+         if (w[b].wdSteadyUs)
+         {
+            diff = eTick - w[b].wdTick;
+
+            if (diff >= w[b].wdSteadyUs)
+            {
+               timeoutBits |= (1<<b);
+
+               w[b].wdTick = eTick;
+
+               diff = 0;
+            }
+
+            left = w[b].wdSteadyUs - diff;
+
+            if (left < next) next = left;
+         }
+      }
+
+      *nextTick = eTick + next;
+   }
+
+   return timeoutBits;
+}
+
+/* wave build ------------------------------------------------------------ */
+
+#ifdef NUM_WAVE_OOL
+
+#define WAVE_MAX_RUNS 1024
+
+#define WAVE_TIME_BITS  15
+#define WAVE_TIME_SLOTS (1<<WAVE_TIME_BITS)
+
+typedef struct
+{
+   uint32_t micros;
+   uint32_t highMicros;
+   uint32_t maxMicros;
+   uint32_t pulses;
+   uint32_t highPulses;
+   uint32_t maxPulses;
+   uint32_t cbs;
+   uint32_t highCbs;
+   uint32_t maxCbs;
+} wfStats_t;
+
+typedef struct
+{
+   uint32_t micros; /* start of a group of pulses */
+   uint16_t count;  /* most pulses starting then in any one add */
+   uint16_t gen;
+} waveTime_t;
+
+typedef struct
+{
+   rawWave_t *pulse;
+   int        pos;
+   int        num;
+   uint32_t   tNext;
+} waveSource_t;
+
+static int waveDelayCBs(uint32_t delay);
+
+static rawWave_t wf[3][PI_WAVE_MAX_PULSES];
+
+static int wfc[3]={0, 0, 0};
+
+static int wfcur=0;
+
+/* the adds since the last merge are sorted runs in wf[wfcur] */
+
+static int wfRuns = 0;
+static int wfRunStart[WAVE_MAX_RUNS];
+static int wfPulses = 0; /* pulses once the runs are merged */
+static uint32_t wfMicros = 0;
+static int wfTools  = 0; /* at most this many TOOL once merged */
+static int wfStale  = 0; /* runs added since the last merge */
+static int wfUntimed = 0; /* the only run isn't in waveTime */
+
+static waveTime_t waveTime[WAVE_TIME_SLOTS];
+static uint16_t   waveTimeGen = 1;
+
+static wfStats_t wfStats;
+
+static inline void waveBuildReset(void)
+{
+   wfc[0] = 0;
+   wfc[1] = 0;
+   wfc[2] = 0;
+
+   wfcur = 0;
+
+   wfRuns   = 0;
+   wfPulses = 0;
+   wfMicros = 0;
+   wfTools  = 0;
+   wfStale  = 0;
+   wfUntimed = 0;
+
+   /* forget the pulse times without clearing the table */
+
+   if (++waveTimeGen == 0)
+   {
+      memset(waveTime, 0, sizeof(waveTime));
+      waveTimeGen = 1;
+   }
+}
+
+static inline waveTime_t *waveTimeFind(uint32_t micros)
+{
+   unsigned slot;
+
+   slot = (micros * 2654435761U) >> (32 - WAVE_TIME_BITS);
+
+   while ((waveTime[slot].gen == waveTimeGen) &&
+          (waveTime[slot].micros != micros))
+   {
+      slot = (slot + 1) & (WAVE_TIME_SLOTS - 1);
+   }
+
+   return &waveTime[slot];
+}
+
+static inline int waveRunScan(unsigned numIn, rawWave_t *in, int update)
+{
+   unsigned i, j;
+   int pulses;
+   uint32_t tNow, tStart;
+   waveTime_t *t;
+
+   /*
+   Merging ORs the nth pulse starting at a time in each add into
+   the nth merged pulse starting then.  So the merged waveform has,
+   for each time, the most pulses any one add starts at that time.
+   Return the pulses this add puts in the merged waveform and, if
+   update is set, record this add's pulse times.
+   */
+
+   pulses = 0;
+
+   tNow = 0;
+
+   for (i=0; i<numIn; i=j)
+   {
+      tStart = tNow;
+
+      for (j=i; j<numIn; )
+      {
+         tNow += in[j++].usDelay;
+         if (tNow != tStart) break;
+      }
+
+      t = waveTimeFind(tStart);
+
+      if (t->gen != waveTimeGen)
+      {
+         pulses += (j - i);
+
+         if (update)
+         {
+            t->micros = tStart;
+            t->count  = j - i;
+            t->gen    = waveTimeGen;
+         }
+      }
+      else if ((j - i) > t->count)
+      {
+         pulses += (j - i) - t->count;
+
+         if (update) t->count = j - i;
+      }
+   }
+
+   return pulses;
+}
+
+static inline void waveSourceDown(waveSource_t *src, int *heap, int num, int i)
+{
+   int c, s;
+
+   s = heap[i];
+
+   while ((c = (2 * i) + 1) < num)
+   {
+      if (((c + 1) < num) &&
+          (src[heap[c+1]].tNext < src[heap[c]].tNext)) c++;
+
+      if (src[s].tNext <= src[heap[c]].tNext) break;
+
+      heap[i] = heap[c];
+      i = c;
+   }
+
+   heap[i] = s;
+}
+
+static inline void waveSourceUp(waveSource_t *src, int *heap, int i)
+{
+   int p, s;
+
+   s = heap[i];
+
+   while (i > 0)
+   {
+      p = (i - 1) / 2;
+
+      if (src[heap[p]].tNext <= src[s].tNext) break;
+
+      heap[i] = heap[p];
+      i = p;
+   }
+
+   heap[i] = s;
+}
+
+static inline int waveMergeRuns(unsigned numIn, rawWave_t *in)
+{
+   static waveSource_t src[WAVE_MAX_RUNS+1];
+   static int heap[WAVE_MAX_RUNS+1], due[WAVE_MAX_RUNS+1];
+
+   int i, s, numSrc, numHeap, numDue, outPos, tools;
+   unsigned cbs;
+   uint32_t tNow, tLast, tMax;
+   rawWave_t *out;
+
+   outPos = 0;
+   tools = 0;
+   tMax = 0;
+
+   if (!numIn && (wfRuns == 1))
+   {
+      /* a single run is already merged */
+
+      out = wf[wfcur];
+      outPos = wfc[wfcur];
+
+      for (i=0; i<outPos; i++)
+      {
+         if (out[i].flags & WAVE_FLAG_READ) tools++;
+         if (out[i].flags & WAVE_FLAG_TICK) tools++;
+
+         tMax += out[i].usDelay;
+      }
+   }
+   else
+   {
+      /* one k-way merge of the pending runs and in into wf[1-wfcur] */
+
+      numSrc = 0;
+
+      for (i=0; i<wfRuns; i++)
+      {
+         src[numSrc].pulse = wf[wfcur] + wfRunStart[i];
+         src[numSrc].num = ((i+1) < wfRuns) ?
+            (wfRunStart[i+1] - wfRunStart[i]) : (wfc[wfcur] - wfRunStart[i]);
+         numSrc++;
+      }
+
+      if (numIn)
+      {
+         src[numSrc].pulse = in;
+         src[numSrc].num = numIn;
+         numSrc++;
+      }
+
+      for (i=0; i<numSrc; i++)
+      {
+         src[i].pos = 0;
+         src[i].tNext = 0;
+         heap[i] = i;
+      }
+
+      numHeap = numSrc;
+
+      out = wf[1-wfcur];
+
+      tLast = 0;
+
+      while (numHeap)
+      {
+         if (outPos >= PI_WAVE_MAX_PULSES) return PI_TOO_MANY_PULSES;
+
+         tNow = src[heap[0]].tNext;
+
+         /* the previous pulse lasts until this one */
+
+         if (outPos) out[outPos-1].usDelay = tNow - tLast;
+
+         out[outPos].gpioOn  = 0;
+         out[outPos].gpioOff = 0;
+         out[outPos].flags   = 0;
+         out[outPos].usDelay = 0;
+
+         /* one pulse from each run due now */
+
+         numDue = 0;
+
+         while (numHeap && (src[heap[0]].tNext == tNow))
+         {
+            s = heap[0];
+
+            out[outPos].gpioOn  |= src[s].pulse[src[s].pos].gpioOn;
+            out[outPos].gpioOff |= src[s].pulse[src[s].pos].gpioOff;
+            out[outPos].flags   |= src[s].pulse[src[s].pos].flags;
+
+            src[s].tNext = tNow + src[s].pulse[src[s].pos].usDelay;
+            if (tMax < src[s].tNext) tMax = src[s].tNext;
+
+            if (++src[s].pos >= src[s].num)
+            {
+               heap[0] = heap[--numHeap];
+            }
+            else if (src[s].tNext == tNow)
+            {
+               /* due again after a zero delay, but for the next pulse */
+
+               due[numDue++] = s;
+               heap[0] = heap[--numHeap];
+            }
+
+            waveSourceDown(src, heap, numHeap, 0);
+         }
+
+         for (i=0; i<numDue; i++)
+         {
+            heap[numHeap] = due[i];
+            waveSourceUp(src, heap, numHeap++);
+         }
+
+         if (out[outPos].flags & WAVE_FLAG_READ) tools++;
+         if (out[outPos].flags & WAVE_FLAG_TICK) tools++;
+
+         tLast = tNow;
+         outPos++;
+      }
+
+      if (outPos) out[outPos-1].usDelay = tMax - tLast;
+   }
+
+   if ((outPos >= PI_WAVE_MAX_PULSES) || ((outPos+tools) >= NUM_WAVE_OOL))
+      return PI_TOO_MANY_PULSES;
+
+   cbs = 0;
+
+   for (i=0; i<outPos; i++)
+   {
+      cbs += waveDelayCBs(out[i].usDelay);
+
+      if (out[i].gpioOn || out[i].gpioOff) cbs++;
+
+      if (out[i].flags & WAVE_FLAG_READ) cbs++; /* one cb if read */
+
+      if (out[i].flags & WAVE_FLAG_TICK) cbs++; /* one cb if tick */
+   }
+
+   if (out != wf[wfcur])
+   {
+      wfc[1-wfcur] = outPos;
+      wfcur = 1 - wfcur;
+   }
+
+   wfRuns = 0;
+
+   if (outPos) wfRunStart[wfRuns++] = 0;
+
+   wfPulses = outPos;
+   wfMicros = tMax;
+   wfTools  = tools;
+   wfStale  = 0;
+
+   wfStats.micros = tMax;
+
+   if (tMax > wfStats.highMicros) wfStats.highMicros = tMax;
+
+   wfStats.pulses = outPos;
+
+   if (outPos > wfStats.highPulses) wfStats.highPulses = outPos;
+
+   wfStats.cbs    = cbs;
+
+   if (cbs > wfStats.highCbs) wfStats.highCbs = cbs;
+
+   return outPos;
+}
+
+static inline void waveMergePending(void)
+{
+   /* the waveform and its CB count are needed */
+
+   if (wfStale) waveMergeRuns(0, NULL);
+}
+
+static inline int waveAddGeneric(unsigned numIn1, rawWave_t *in1)
+{
+   int i, pulses, tools, first;
+
+   uint32_t micros;
+
+   /*
+   The add is kept as a sorted run.  The runs are merged once, when
+   the wave is created or the run space is used up, rather than the
+   whole pending waveform being merged again for every add.
+   */
+
+   first = (wfPulses == 0);
+
+   if (wfUntimed && numIn1)
+   {
+      /* the first run's pulse times are only needed once there's another */
+
+      waveRunScan(wfc[wfcur], wf[wfcur], 1);
+
+      wfUntimed = 0;
+   }
+
+   if (first) pulses = numIn1;
+   else       pulses = wfPulses + waveRunScan(numIn1, in1, 0);
+
+   if (pulses >= PI_WAVE_MAX_PULSES) return PI_TOO_MANY_PULSES;
+
+   tools  = 0;
+   micros = 0;
+
+   for (i=0; i<numIn1; i++)
+   {
+      if (in1[i].flags & WAVE_FLAG_READ) tools++;
+      if (in1[i].flags & WAVE_FLAG_TICK) tools++;
+
+      micros += in1[i].usDelay;
+   }
+
+   if (((pulses + wfTools + tools) < NUM_WAVE_OOL) &&
+       ((wfc[wfcur] + numIn1) <= PI_WAVE_MAX_PULSES) &&
+       (wfRuns < WAVE_MAX_RUNS))
+   {
+      if (numIn1)
+      {
+         memcpy(wf[wfcur] + wfc[wfcur], in1, numIn1 * sizeof(rawWave_t));
+
+         wfRunStart[wfRuns++] = wfc[wfcur];
+
+         wfc[wfcur] += numIn1;
+
+         wfStale = 1;
+      }
+
+      wfPulses = pulses;
+      wfTools += tools;
+
+      if (micros > wfMicros) wfMicros = micros;
+
+      wfStats.micros = wfMicros;
+
+      if (wfMicros > wfStats.highMicros) wfStats.highMicros = wfMicros;
+
+      wfStats.pulses = pulses;
+
+      if (pulses > wfStats.highPulses) wfStats.highPulses = pulses;
+   }
+   else
+   {
+      /* merge now, this also settles whether the TOOL fit */
+
+      if (waveMergeRuns(numIn1, in1) < 0) return PI_TOO_MANY_PULSES;
+   }
+
+   if (first) wfUntimed = (numIn1 != 0);
+   else       waveRunScan(numIn1, in1, 1);
+
+   return pulses;
+}
+
+#endif /* NUM_WAVE_OOL */
+
+#endif
@@ -43,6 +43,7 @@ This version is for pigpio version 69+
 #include <signal.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 
 #include "pigpio.h"
@@ -59,6 +60,10 @@ static int      foreground             = PI_DEFAULT_FOREGROUND;
 static unsigned DMAprimaryChannel      = PI_DEFAULT_DMA_NOT_SET;
 static unsigned DMAsecondaryChannel    = PI_DEFAULT_DMA_NOT_SET;
 static unsigned socketPort             = PI_DEFAULT_SOCKET_PORT;
+static unsigned socketWorkers          = PI_DEFAULT_SOCKET_WORKERS;
+static char    *socketPath             = NULL;
+static unsigned alertPollMin           = 0;
+static unsigned alertPollMax           = 0;
 static unsigned memAllocMode           = PI_DEFAULT_MEM_ALLOC_MODE;
 static uint64_t updateMask             = -1;
 
@@ -100,6 +105,7 @@ void usage()
       "   -e value,   secondary DMA channel, 0-14,       default 6\n" \
       "   -f,         disable fifo interface,            default enabled\n" \
       "   -g,         run in foreground (do not fork),   default disabled\n" \
+      "   -i min,max, adaptive alert poll, 50-50000 us,  default disabled\n" \
       "   -k,         disable socket interface,          default enabled\n" \
       "   -l,         localhost socket only              default local+remote\n" \
       "   -m,         disable alerts                     default enabled\n" \
@@ -107,7 +113,9 @@ void usage()
       "   -p value,   socket port, 1024-32000,           default 8888\n" \
       "   -s value,   sample rate, 1, 2, 4, 5, 8, or 10, default 5\n" \
       "   -t value,   clock peripheral, 0=PWM 1=PCM,     default PCM\n" \
+      "   -u path,    also listen on unix socket path,   default none\n" \
       "   -v, -V,     display pigpio version and exit\n" \
+      "   -w value,   socket worker threads, 1-64,       default 8\n" \
       "   -x mask,    GPIO which may be updated,         default board GPIO\n" \
       "EXAMPLE\n" \
       "sudo pigpiod -s 2 -b 200 -f\n" \
@@ -163,7 +171,7 @@ static void initOpts(int argc, char *argv[])
    uint32_t addr;
    int64_t mask;
 
-   while ((opt = getopt(argc, argv, "a:b:c:d:e:fgkln:mp:s:t:x:vV")) != -1)
+   while ((opt = getopt(argc, argv, "a:b:c:d:e:fgi:kln:mp:s:t:u:vVw:x:")) != -1)
    {
       switch (opt)
       {
@@ -210,6 +218,14 @@ static void initOpts(int argc, char *argv[])
             foreground = 1;
             break;
 
+         case 'i':
+            if ((sscanf(optarg, "%u,%u", &alertPollMin, &alertPollMax) != 2) ||
+                (alertPollMin < PI_MIN_ALERT_POLL) ||
+                (alertPollMax > PI_MAX_ALERT_POLL) ||
+                (alertPollMin > alertPollMax))
+               fatal("invalid -i option (%s)", optarg);
+            break;
+
          case 'k':
             ifFlags |= PI_DISABLE_SOCK_IF;
             break; 
@@ -263,12 +279,25 @@ static void initOpts(int argc, char *argv[])
             else fatal("invalid -t option (%d)", i);
             break;
 
+         case 'u':
+            if (strlen(optarg) < sizeof(((struct sockaddr_un *)0)->sun_path))
+               socketPath = optarg;
+            else fatal("invalid -u option (%s)", optarg);
+            break;
+
          case 'v':
          case 'V':
             printf("%d\n", PIGPIO_VERSION);
             exit(EXIT_SUCCESS);
             break;
 
+         case 'w':
+            i = getNum(optarg, &err);
+            if ((i >= PI_MIN_SOCKET_WORKERS) && (i <= PI_MAX_SOCKET_WORKERS))
+               socketWorkers = i;
+            else fatal("invalid -w option (%d)", i);
+            break;
+
          case 'x':
             mask = getNum(optarg, &err);
             if (!err)
@@ -358,6 +387,12 @@ int main(int argc, char **argv)
 
    gpioCfgSocketPort(socketPort);
 
+   gpioCfgSocketWorkers(socketWorkers);
+
+   gpioCfgAlertPoll(alertPollMin, alertPollMax);
+
+   gpioCfgSocketPath(socketPath);
+
    gpioCfgMemAlloc(memAllocMode);
 
    if (updateMaskSet) gpioCfgPermissions(updateMask);
@@ -34,6 +34,7 @@ For more information, please refer to <http://unlicense.org/>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
 #include <netdb.h>
 #include <pthread.h>
@@ -41,8 +42,12 @@ For more information, please refer to <http://unlicense.org/>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/tcp.h>
+#include <linux/futex.h>
 #include <sys/select.h>
 
 #include <arpa/inet.h>
@@ -58,6 +63,11 @@ For more information, please refer to <http://unlicense.org/>
 
 #define MAX_PI 32
 
+/* how long to spin for a ring response before parking */
+#define RING_SPIN_SECS 0.0002
+
+#define RING_PARK_NANOS 100000000
+
 typedef void (*CBF_t) ();
 
 struct callback_s
@@ -87,6 +97,31 @@ struct evtCallback_s
    evtCallback_t *next;
 };
 
+typedef struct
+{
+   asyncCBFunc_t f;
+   void *userdata;
+   unsigned cmd;
+   int result;
+} asyncReq_t;
+
+typedef struct
+{
+   int pi;
+   int sock;
+   int broken;
+   int closing; /* set by asyncClose, waiters give up */
+   int users;   /* threads inside async_command/wait/flush */
+   pthread_t *pth;
+   pthread_mutex_t mutex;
+   pthread_mutex_t sendMutex; /* keeps the sends in queue order */
+   pthread_cond_t cond;
+   unsigned submitted; /* commands sent */
+   unsigned completed; /* responses received */
+   asyncReq_t req[PIGIF_ASYNC_PENDING];
+   char ext[CMD_MAX_EXTENSION];
+} asyncInfo_t;
+
 /* GLOBALS ---------------------------------------------------------------- */
 
 static int             gPiInUse     [MAX_PI];
@@ -94,6 +129,7 @@ static int             gPiInUse     [MAX_PI];
 static int             gPigCommand  [MAX_PI];
 static int             gPigHandle   [MAX_PI];
 static int             gPigNotify   [MAX_PI];
+static int             gNotifyFormat[MAX_PI];
 
 static uint32_t        gEventBits   [MAX_PI];
 static uint32_t        gNotifyBits  [MAX_PI];
@@ -101,6 +137,11 @@ static uint32_t        gLastLevel   [MAX_PI];
 
 static pthread_t       *gPthNotify  [MAX_PI];
 
+static asyncInfo_t     *gAsync      [MAX_PI];
+
+static cmdRing_t       *gRing       [MAX_PI];
+static int             gRingHandle  [MAX_PI];
+
 static pthread_mutex_t gCmdMutex    [MAX_PI];
 static int             gCancelState [MAX_PI];
 
@@ -130,8 +171,107 @@ static void _pmu(int pi)
    pthread_setcancelstate(cancelState, NULL);
 }
 
+static void pigpio_ring_drop(int pi)
+{
+   /* the daemon closed the ring, later commands use the socket */
+
+   munmap(gRing[pi], sizeof(cmdRing_t));
+
+   gRing[pi] = NULL;
+}
+
+static int pigpio_ring_command
+   (int pi, cmdCmd_t *cmd, int extents, gpioExtent_t *ext)
+{
+   cmdRing_t *ring = gRing[pi];
+   cmdRingSlot_t *slot;
+   uint32_t head, tail, taken;
+   struct timespec ts;
+   double start;
+   int i, pos, res, closing;
+
+   /*
+   Called with the command mutex held, so one request at a time.
+   Returns PI_BAD_RING_CMD if the request should be sent on the
+   socket instead.
+   */
+
+   head = ring->head;
+
+   slot = &ring->slot[head % CMD_RING_SLOTS];
+
+   memcpy(&slot->cmd, cmd, sizeof(cmdCmd_t));
+
+   pos = 0;
+
+   for (i=0; i<extents; i++)
+   {
+      memcpy(slot->ext+pos, ext[i].ptr, ext[i].size);
+      pos += ext[i].size;
+   }
+
+   head++;
+
+   __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&ring->headWaiting, __ATOMIC_SEQ_CST))
+      syscall(SYS_futex, &ring->head, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+   /* spin briefly for the response, then park on tail */
+
+   start = time_time();
+
+   closing = 0;
+
+   while ((tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) != head)
+   {
+      if (!closing && __atomic_load_n(&ring->closing, __ATOMIC_ACQUIRE))
+      {
+         closing = 1;
+
+         /*
+         If the daemon has not taken the request claim it back and
+         resend it on the socket.  Otherwise the daemon completes it
+         before its ring thread ends.
+         */
+
+         taken = head - 1;
+
+         if (__atomic_compare_exchange_n(&ring->taken, &taken, head, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+         {
+            pigpio_ring_drop(pi);
+            return PI_BAD_RING_CMD;
+         }
+      }
+
+      if ((time_time() - start) > RING_SPIN_SECS)
+      {
+         __atomic_store_n(&ring->tailWaiting, 1, __ATOMIC_SEQ_CST);
+
+         if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail)
+         {
+            ts.tv_sec  = 0;
+            ts.tv_nsec = RING_PARK_NANOS;
+
+            syscall(SYS_futex, &ring->tail, FUTEX_WAIT, tail, &ts, NULL, 0);
+         }
+
+         __atomic_store_n(&ring->tailWaiting, 0, __ATOMIC_SEQ_CST);
+      }
+   }
+
+   res = slot->cmd.res;
+
+   if (closing || __atomic_load_n(&ring->closing, __ATOMIC_ACQUIRE))
+      pigpio_ring_drop(pi);
+
+   return res;
+}
+
 static int pigpio_command(int pi, int command, int p1, int p2, int rl)
 {
+   int res;
    cmdCmd_t cmd;
 
    if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
@@ -144,6 +284,19 @@ static int pigpio_command(int pi, int command, int p1, int p2, int rl)
 
    _pml(pi);
 
+   /* commands refused by the ring are sent on the socket */
+
+   if (rl && gRing[pi])
+   {
+      res = pigpio_ring_command(pi, &cmd, 0, NULL);
+
+      if (res != PI_BAD_RING_CMD)
+      {
+         _pmu(pi);
+         return res;
+      }
+   }
+
    if (send(gPigCommand[pi], &cmd, sizeof(cmd), 0) != sizeof(cmd))
    {
       _pmu(pi);
@@ -168,23 +321,40 @@ static int pigpio_notify(int pi)
    if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
       return pigif_unconnected_pi;
 
-   cmd.cmd = PI_CMD_NOIB;
-   cmd.p1  = 0;
+   /* ask for compact reports, older daemons only know NOIB */
+
+   cmd.cmd = PI_CMD_NOIBF;
+   cmd.p1  = PI_NOTIFY_FORMAT_V2;
    cmd.p2  = 0;
    cmd.res = 0;
 
+   gNotifyFormat[pi] = PI_NOTIFY_FORMAT_V2;
+
    _pml(pi);
 
-   if (send(gPigNotify[pi], &cmd, sizeof(cmd), 0) != sizeof(cmd))
+   while (1)
    {
-      _pmu(pi);
-      return pigif_bad_send;
-   }
+      if (send(gPigNotify[pi], &cmd, sizeof(cmd), 0) != sizeof(cmd))
+      {
+         _pmu(pi);
+         return pigif_bad_send;
+      }
 
-   if (recv(gPigNotify[pi], &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
-   {
-      _pmu(pi);
-      return pigif_bad_recv;
+      if (recv(gPigNotify[pi], &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+      {
+         _pmu(pi);
+         return pigif_bad_recv;
+      }
+
+      if ((cmd.cmd != PI_CMD_NOIBF) || ((int)cmd.res != PI_UNKNOWN_COMMAND))
+         break;
+
+      cmd.cmd = PI_CMD_NOIB;
+      cmd.p1  = 0;
+      cmd.p2  = 0;
+      cmd.res = 0;
+
+      gNotifyFormat[pi] = PI_NOTIFY_FORMAT_V1;
    }
 
    _pmu(pi);
@@ -196,7 +366,7 @@ static int pigpio_command_ext
    (int pi, int command, int p1, int p2, int p3,
     int extents, gpioExtent_t *ext, int rl)
 {
-   int i;
+   int i, res;
    cmdCmd_t cmd;
 
    if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
@@ -209,6 +379,19 @@ static int pigpio_command_ext
 
    _pml(pi);
 
+   /* commands refused by the ring are sent on the socket */
+
+   if (rl && gRing[pi] && (p3 <= CMD_RING_EXT_LEN))
+   {
+      res = pigpio_ring_command(pi, &cmd, extents, ext);
+
+      if (res != PI_BAD_RING_CMD)
+      {
+         _pmu(pi);
+         return res;
+      }
+   }
+
    if (send(gPigCommand[pi], &cmd, sizeof(cmd), 0) != sizeof(cmd))
    {
       _pmu(pi);
@@ -234,11 +417,41 @@ static int pigpio_command_ext
    return cmd.res;
 }
 
+static int pigpioOpenUnixSocket(const char *path)
+{
+   int sock;
+   struct sockaddr_un addr;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) return pigif_bad_getaddrinfo;
+
+   memset(&addr, 0, sizeof(addr));
+
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (sock == -1) return pigif_bad_socket;
+
+   if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+   {
+      close(sock);
+      return pigif_bad_connect;
+   }
+
+   return sock;
+}
+
 static int pigpioOpenSocket(const char *addrStr, const char *portStr)
 {
    int sock, err, opt;
    struct addrinfo hints, *res, *rp;
 
+   /* an address of unix:path selects a Unix domain socket */
+
+   if (!strncmp(addrStr, PI_UNIX_ADDR_PREFIX, strlen(PI_UNIX_ADDR_PREFIX)))
+      return pigpioOpenUnixSocket(addrStr + strlen(PI_UNIX_ADDR_PREFIX));
+
    memset (&hints, 0, sizeof (hints));
 
    hints.ai_family   = PF_UNSPEC;
@@ -340,6 +553,43 @@ static void dispatch_notification(int pi, gpioReport_t *r)
    }
 }
 
+static int notify_read_v2(int pi)
+{
+   cmdNotifyCodec_t codec;
+   char buf[PI_MAX_REPORTS_PER_READ * sizeof(gpioReport_t)];
+   gpioReport_t report[PI_MAX_REPORTS_PER_READ];
+   int got, bytes, used, n, r;
+
+   memset(&codec, 0, sizeof(codec));
+
+   got = 0;
+
+   while (1)
+   {
+      bytes = read(gPigNotify[pi], buf+got, sizeof(buf)-got);
+
+      if (bytes > 0) got += bytes;
+      else return bytes;
+
+      do
+      {
+         n = cmdNotifyDecode(
+            &codec, buf, got, report, PI_MAX_REPORTS_PER_READ, &used);
+
+         if (n < 0) return pigif_bad_recv;
+
+         for (r=0; r<n; r++) dispatch_notification(pi, &report[r]);
+
+         /* keep any partial record for the next read */
+
+         got -= used;
+
+         memmove(buf, buf+used, got);
+      }
+      while (n == PI_MAX_REPORTS_PER_READ);
+   }
+}
+
 static void *pthNotifyThread(void *x)
 {
    static int got = 0;
@@ -350,7 +600,8 @@ static void *pthNotifyThread(void *x)
    pi = *((int*)x);
    free(x); /* memory allocated in pigpio_start */
 
-   while (1)
+   if (gNotifyFormat[pi] == PI_NOTIFY_FORMAT_V2) bytes = notify_read_v2(pi);
+   else while (1)
    {
       bytes = read(gPigNotify[pi], (char*)&report+got, sizeof(report)-got);
 
@@ -630,6 +881,14 @@ char *pigpio_error(int errnum)
             return "not connected to Pi";
          case pigif_too_many_pis:
             return "too many connected Pis";
+         case pigif_batch_full:
+            return "no room in batch";
+         case pigif_async_expired:
+            return "async result no longer available";
+         case pigif_bad_ring:
+            return "failed to map command ring";
+         case pigif_ring_closed:
+            return "command ring closed";
 
          default:
             return "unknown error";
@@ -685,6 +944,236 @@ void stop_thread(pthread_t *pth)
    }
 }
 
+static void *pthAsyncThread(void *x)
+{
+   int pi;
+   int res;
+   unsigned slot;
+   asyncInfo_t *a;
+   asyncReq_t *r;
+   cmdCmd_t cmd;
+
+   a = x;
+   pi = a->pi;
+
+   /* the daemon answers the commands on a socket in order */
+
+   while (1)
+   {
+      if (recv(a->sock, &cmd, sizeof(cmd), MSG_WAITALL) != sizeof(cmd))
+         break;
+
+      res = cmd.res;
+
+      slot = a->completed % PIGIF_ASYNC_PENDING;
+
+      r = &a->req[slot];
+
+      if (cmdReturnsExt(r->cmd) && (res > 0))
+      {
+         if (recv(a->sock, a->ext, res, MSG_WAITALL) != res) break;
+      }
+
+      if (r->f) (r->f)(pi, a->completed & INT32_MAX, res, a->ext, r->userdata);
+
+      pthread_mutex_lock(&a->mutex);
+      r->result = res;
+      a->completed++;
+      pthread_cond_broadcast(&a->cond);
+      pthread_mutex_unlock(&a->mutex);
+   }
+
+   /* fail any commands still awaiting a response */
+
+   pthread_mutex_lock(&a->mutex);
+   a->broken = 1;
+   while (a->completed != a->submitted)
+   {
+      a->req[a->completed % PIGIF_ASYNC_PENDING].result = pigif_bad_recv;
+      a->completed++;
+   }
+   pthread_cond_broadcast(&a->cond);
+   pthread_mutex_unlock(&a->mutex);
+
+   return NULL;
+}
+
+static void asyncFree(asyncInfo_t *a)
+{
+   /* wake any waiters, they return pigif_bad_recv */
+
+   pthread_mutex_lock(&a->mutex);
+   a->closing = 1;
+   pthread_cond_broadcast(&a->cond);
+   pthread_mutex_unlock(&a->mutex);
+
+   /* unblock the reader so it ends without being cancelled mid update */
+
+   shutdown(a->sock, SHUT_RDWR);
+
+   if (a->pth) stop_thread(a->pth);
+
+   /* only free once no thread can still be using the connection */
+
+   pthread_mutex_lock(&a->mutex);
+   while (a->users) pthread_cond_wait(&a->cond, &a->mutex);
+   pthread_mutex_unlock(&a->mutex);
+
+   close(a->sock);
+
+   pthread_mutex_destroy(&a->mutex);
+   pthread_mutex_destroy(&a->sendMutex);
+   pthread_cond_destroy(&a->cond);
+
+   free(a);
+}
+
+static asyncInfo_t *asyncOpen(int pi)
+{
+   int i, opt;
+   asyncInfo_t *a, *old;
+   struct sockaddr_storage addr;
+   socklen_t len;
+
+   /*
+   The asynchronous commands use their own connection so that
+   they never interleave with the synchronous commands.  It is
+   made to the same daemon as the command socket.
+
+   A broken connection is replaced.  Its commands have all failed,
+   so the new connection carries on the token numbering with their
+   results preset to pigif_bad_recv.
+
+   The caller is counted as a user of the connection and must
+   call asyncRelease when done with it.
+   */
+
+   _pml(pi);
+
+   a = gAsync[pi];
+   old = NULL;
+
+   if ((a != NULL) && a->broken)
+   {
+      old = a;
+      gAsync[pi] = NULL;
+      a = NULL;
+   }
+
+   if (a == NULL)
+   {
+      a = calloc(1, sizeof(asyncInfo_t));
+
+      if (a == NULL) {_pmu(pi); return NULL;}
+
+      len = sizeof(addr);
+
+      if (getpeername(gPigCommand[pi], (struct sockaddr *)&addr, &len) ||
+          ((a->sock = socket(addr.ss_family, SOCK_STREAM, 0)) < 0))
+      {
+         free(a);
+         _pmu(pi);
+         if (old) asyncFree(old);
+         return NULL;
+      }
+
+      if (addr.ss_family != AF_UNIX)
+      {
+         /* Disable the Nagle algorithm. */
+         opt = 1;
+         setsockopt(a->sock, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(int));
+      }
+
+      if (connect(a->sock, (struct sockaddr *)&addr, len))
+      {
+         close(a->sock);
+         free(a);
+         _pmu(pi);
+         if (old) asyncFree(old);
+         return NULL;
+      }
+
+      a->pi = pi;
+
+      if (old)
+      {
+         pthread_mutex_lock(&old->mutex);
+         a->submitted = old->submitted;
+         a->completed = old->submitted;
+         pthread_mutex_unlock(&old->mutex);
+
+         for (i=0; i<PIGIF_ASYNC_PENDING; i++)
+            a->req[i].result = pigif_bad_recv;
+      }
+
+      pthread_mutex_init(&a->mutex, NULL);
+      pthread_mutex_init(&a->sendMutex, NULL);
+      pthread_cond_init(&a->cond, NULL);
+
+      gAsync[pi] = a;
+
+      a->pth = start_thread(pthAsyncThread, a);
+
+      if (a->pth == NULL) a->broken = 1;
+   }
+
+   pthread_mutex_lock(&a->mutex);
+   a->users++;
+   pthread_mutex_unlock(&a->mutex);
+
+   _pmu(pi);
+
+   /* freed outside the command mutex, its callbacks may need it */
+
+   if (old) asyncFree(old);
+
+   return a;
+}
+
+static asyncInfo_t *asyncAcquire(int pi)
+{
+   asyncInfo_t *a;
+
+   /* as asyncOpen but never creates the connection */
+
+   _pml(pi);
+
+   a = gAsync[pi];
+
+   if (a != NULL)
+   {
+      pthread_mutex_lock(&a->mutex);
+      a->users++;
+      pthread_mutex_unlock(&a->mutex);
+   }
+
+   _pmu(pi);
+
+   return a;
+}
+
+static void asyncRelease(asyncInfo_t *a)
+{
+   pthread_mutex_lock(&a->mutex);
+   a->users--;
+   if (a->closing) pthread_cond_broadcast(&a->cond);
+   pthread_mutex_unlock(&a->mutex);
+}
+
+static void asyncClose(int pi)
+{
+   asyncInfo_t *a;
+
+   _pml(pi);
+   a = gAsync[pi];
+   gAsync[pi] = NULL;
+   _pmu(pi);
+
+   if (a == NULL) return;
+
+   asyncFree(a);
+}
+
 int pigpio_start(const char *addrStr, const char *portStr)
 {
    int pi;
@@ -762,6 +1251,10 @@ void pigpio_stop(int pi)
       gPthNotify[pi] = 0;
    }
 
+   asyncClose(pi);
+
+   ring_close(pi);
+
    if (gPigCommand[pi] >= 0)
    {
       if (gPigHandle[pi] >= 0)
@@ -837,6 +1330,86 @@ int notify_pause(int pi, unsigned handle)
 int notify_close(int pi, unsigned handle)
    {return pigpio_command(pi, PI_CMD_NC, handle, 0, 1);}
 
+int notify_open_with_format(int pi, unsigned format)
+   {return pigpio_command(pi, PI_CMD_NOF, format, 0, 1);}
+
+int notify_get_queued(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_NQL, handle, 0, 1);}
+
+int notify_get_dropped(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_NQD, handle, 0, 1);}
+
+int notify_open_shared(int pi, unsigned reports)
+   {return pigpio_command(pi, PI_CMD_NOR, reports, 0, 1);}
+
+gpioNotifyRing_t *notify_ring_map(unsigned handle)
+{
+   int fd;
+   char name[32];
+   struct stat st;
+   gpioNotifyRing_t *ring;
+
+   sprintf(name, PI_NOTIFY_RING_NAME, handle);
+
+   fd = shm_open(name, O_RDWR, 0);
+
+   if (fd < 0) return NULL;
+
+   ring = MAP_FAILED;
+
+   if (fstat(fd, &st) == 0)
+   {
+      ring = mmap(0, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+      if ((ring != MAP_FAILED) &&
+          ((__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) !=
+              PI_NOTIFY_RING_MAGIC) ||
+           (PI_NOTIFY_RING_BYTES(ring->size) != st.st_size)))
+      {
+         munmap(ring, st.st_size);
+         ring = MAP_FAILED;
+      }
+   }
+
+   close(fd);
+
+   if (ring == MAP_FAILED) return NULL;
+
+   return ring;
+}
+
+int notify_ring_read(
+   gpioNotifyRing_t *ring, gpioReport_t *reports, unsigned maxReports)
+{
+   gpioReport_t *entry = PI_NOTIFY_RING_REPORTS(ring);
+   uint32_t head, tail, n, i;
+
+   head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+   tail = ring->tail;
+
+   n = head - tail;
+
+   if (n == 0)
+   {
+      if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+         return pigif_ring_closed;
+      return 0;
+   }
+
+   if (n > maxReports) n = maxReports;
+
+   for (i=0; i<n; i++) reports[i] = entry[(tail+i) & (ring->size-1)];
+
+   __atomic_store_n(&ring->tail, tail+n, __ATOMIC_RELEASE);
+
+   return n;
+}
+
+void notify_ring_unmap(gpioNotifyRing_t *ring)
+{
+   munmap(ring, PI_NOTIFY_RING_BYTES(ring->size));
+}
+
 int set_watchdog(int pi, unsigned user_gpio, unsigned timeout)
    {return pigpio_command(pi, PI_CMD_WDOG, user_gpio, timeout, 1);}
 
@@ -953,12 +1526,100 @@ int wave_add_serial(
 int wave_create(int pi)
    {return pigpio_command(pi, PI_CMD_WVCRE, 0, 0, 1);}
 
+int wave_create_shared(int pi)
+   {return pigpio_command(pi, PI_CMD_WVCRS, 0, 0, 1);}
+
 int wave_create_and_pad(int pi, int percent)
    {return pigpio_command(pi, PI_CMD_WVCAP, percent, 0, 1);}
 
 int wave_delete(int pi, unsigned wave_id)
    {return pigpio_command(pi, PI_CMD_WVDEL, wave_id, 0, 1);}
 
+int wave_get_fragmentation(int pi, gpioWaveFrag_t *frag)
+{
+   int bytes;
+   gpioWaveFrag_t f;
+
+   bytes = pigpio_command(pi, PI_CMD_WVFRG, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &f, sizeof(f), bytes);
+      if (frag) *frag = f;
+      bytes = 0;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int wave_get_cache_stats(int pi, gpioWaveCacheStats_t *stats)
+{
+   int bytes;
+   gpioWaveCacheStats_t s;
+
+   bytes = pigpio_command(pi, PI_CMD_WVCST, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &s, sizeof(s), bytes);
+      if (stats) *stats = s;
+      bytes = 0;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int wave_stream_open(int pi, unsigned segments, unsigned seg_pulses)
+   {return pigpio_command(pi, PI_CMD_WVSOP, segments, seg_pulses, 1);}
+
+int wave_stream_set_event(int pi, unsigned event, unsigned low_water)
+   {return pigpio_command(pi, PI_CMD_WVSEV, event, low_water, 1);}
+
+int wave_stream_write(int pi, unsigned numPulses, gpioPulse_t *pulses)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=0
+   p2=0
+   p3=pulses*sizeof(gpioPulse_t)
+   ## extension ##
+   gpioPulse_t[] pulses
+   */
+
+   ext[0].size = numPulses * sizeof(gpioPulse_t);
+   ext[0].ptr = pulses;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_WVSWR, 0, 0, ext[0].size, 1, ext, 1);
+}
+
+int wave_stream_status(int pi, gpioWaveStream_t *status)
+{
+   int bytes;
+   gpioWaveStream_t s;
+
+   bytes = pigpio_command(pi, PI_CMD_WVSST, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &s, sizeof(s), bytes);
+      if (status) *status = s;
+      bytes = 0;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int wave_stream_close(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSCL, 0, 0, 1);}
+
 int wave_tx_start(int pi) /* DEPRECATED */
    {return pigpio_command(pi, PI_CMD_WVGO, 0, 0, 1);}
 
@@ -986,90 +1647,283 @@ int wave_chain(int pi, char *buf, unsigned bufSize)
    char buf[bufSize]
    */
 
-   ext[0].size = bufSize;
-   ext[0].ptr = buf;
+   ext[0].size = bufSize;
+   ext[0].ptr = buf;
+
+   return pigpio_command_ext
+      (pi, PI_CMD_WVCHA, 0, 0, bufSize, 1, ext, 1);
+}
+
+int wave_tx_at(int pi)
+   {return pigpio_command(pi, PI_CMD_WVTAT, 0, 0, 1);}
+
+int wave_tx_busy(int pi)
+   {return pigpio_command(pi, PI_CMD_WVBSY, 0, 0, 1);}
+
+int wave_tx_stop(int pi)
+   {return pigpio_command(pi, PI_CMD_WVHLT, 0, 0, 1);}
+
+int wave_get_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 0, 0, 1);}
+
+int wave_get_high_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 1, 0, 1);}
+
+int wave_get_max_micros(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSM, 2, 0, 1);}
+
+int wave_get_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 0, 0, 1);}
+
+int wave_get_high_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 1, 0, 1);}
+
+int wave_get_max_pulses(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSP, 2, 0, 1);}
+
+int wave_get_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 0, 0, 1);}
+
+int wave_get_high_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 1, 0, 1);}
+
+int wave_get_max_cbs(int pi)
+   {return pigpio_command(pi, PI_CMD_WVSC, 2, 0, 1);}
+
+int gpio_trigger(int pi, unsigned user_gpio, unsigned pulseLen, uint32_t level)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=user_gpio
+   p2=pulseLen 
+   p3=4
+   ## extension ##
+   unsigned level
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &level;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_TRIG, user_gpio, pulseLen, 4, 1, ext, 1);
+}
+
+int set_glitch_filter(int pi, unsigned user_gpio, unsigned steady)
+   {return pigpio_command(pi, PI_CMD_FG, user_gpio, steady, 1);}
+
+int set_noise_filter(int pi, unsigned user_gpio, unsigned steady, unsigned active)
+{
+   gpioExtent_t ext[1];
+   
+   /*
+   p1=user_gpio
+   p2=steady
+   p3=4
+   ## extension ##
+   unsigned active
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &active;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_FN, user_gpio, steady, 4, 1, ext, 1);
+}
+
+int set_meter(int pi, unsigned user_gpio, unsigned window_ms)
+   {return pigpio_command(pi, PI_CMD_MTRS, user_gpio, window_ms, 1);}
+
+int get_meter(int pi, unsigned user_gpio, gpioMeter_t *meter)
+{
+   int bytes;
+   gpioMeter_t m;
+
+   bytes = pigpio_command(pi, PI_CMD_MTRG, user_gpio, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &m, sizeof(m), bytes);
+      if (meter) *meter = m;
+      bytes = 0;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int encoder_open(
+   int pi, unsigned gpio_a, unsigned gpio_b, unsigned gpio_index)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=gpio_a
+   p2=gpio_b
+   p3=4
+   ## extension ##
+   unsigned gpio_index
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &gpio_index;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_ENCO, gpio_a, gpio_b, 4, 1, ext, 1);
+}
+
+int encoder_close(int pi, unsigned handle)
+   {return pigpio_command(pi, PI_CMD_ENCC, handle, 0, 1);}
+
+int encoder_get(int pi, unsigned handle, gpioEncoder_t *encoder)
+{
+   int bytes;
+   gpioEncoder_t e;
+
+   bytes = pigpio_command(pi, PI_CMD_ENCG, handle, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &e, sizeof(e), bytes);
+      if (encoder) *encoder = e;
+      bytes = 0;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int encoder_set_event(int pi, unsigned handle, unsigned event, unsigned millis)
+{
+   gpioExtent_t ext[1];
+
+   /*
+   p1=handle
+   p2=event
+   p3=4
+   ## extension ##
+   unsigned millis
+   */
+
+   ext[0].size = sizeof(uint32_t);
+   ext[0].ptr = &millis;
+
+   return pigpio_command_ext(
+      pi, PI_CMD_ENCE, handle, event, 4, 1, ext, 1);
+}
+
+int capture_start(
+   int pi, uint32_t bits, unsigned trig_mode, uint32_t trig_bits,
+   uint32_t trig_levels, unsigned pre_samples, unsigned post_samples)
+{
+   uint8_t buf[16];
+   gpioExtent_t ext[1];
+
+   /*
+   p1=bits
+   p2=trig_mode
+   p3=16
+   ## extension ##
+   uint32_t trig_bits
+   uint32_t trig_levels
+   uint32_t pre_samples
+   uint32_t post_samples
+   */
+
+   ext[0].size = 16;
+   ext[0].ptr = &buf;
+
+   memcpy(buf +  0, &trig_bits, 4);
+   memcpy(buf +  4, &trig_levels, 4);
+   memcpy(buf +  8, &pre_samples, 4);
+   memcpy(buf + 12, &post_samples, 4);
+
+   return pigpio_command_ext
+      (pi, PI_CMD_CAPS, bits, trig_mode, 16, 1, ext, 1);
+}
+
+int capture_status(int pi, gpioCapture_t *status)
+{
+   int bytes;
+   gpioCapture_t c;
+
+   bytes = pigpio_command(pi, PI_CMD_CAPG, 0, 0, 0);
+
+   if (bytes > 0)
+   {
+      recvMax(pi, &c, sizeof(c), bytes);
+      if (status) *status = c;
+      bytes = 0;
+   }
+
+   _pmu(pi);
 
-   return pigpio_command_ext
-      (pi, PI_CMD_WVCHA, 0, 0, bufSize, 1, ext, 1);
+   return bytes;
 }
 
-int wave_tx_at(int pi)
-   {return pigpio_command(pi, PI_CMD_WVTAT, 0, 0, 1);}
+int capture_read(int pi, gpioSample_t *samples, unsigned max_samples)
+{
+   int bytes;
+   unsigned count, chunk;
 
-int wave_tx_busy(int pi)
-   {return pigpio_command(pi, PI_CMD_WVBSY, 0, 0, 1);}
+   /* the daemon returns at most a command buffer of samples at a time */
 
-int wave_tx_stop(int pi)
-   {return pigpio_command(pi, PI_CMD_WVHLT, 0, 0, 1);}
+   count = 0;
 
-int wave_get_micros(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSM, 0, 0, 1);}
+   while (count < max_samples)
+   {
+      chunk = max_samples - count;
 
-int wave_get_high_micros(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSM, 1, 0, 1);}
+      if (chunk > (CMD_MAX_EXTENSION / sizeof(gpioSample_t)))
+         chunk = CMD_MAX_EXTENSION / sizeof(gpioSample_t);
 
-int wave_get_max_micros(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSM, 2, 0, 1);}
+      bytes = pigpio_command(pi, PI_CMD_CAPR, count, chunk, 0);
 
-int wave_get_pulses(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSP, 0, 0, 1);}
+      if (bytes > 0)
+      {
+         bytes = recvMax(
+            pi, samples + count, chunk * sizeof(gpioSample_t), bytes);
 
-int wave_get_high_pulses(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSP, 1, 0, 1);}
+         count += bytes / sizeof(gpioSample_t);
+      }
 
-int wave_get_max_pulses(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSP, 2, 0, 1);}
+      _pmu(pi);
 
-int wave_get_cbs(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSC, 0, 0, 1);}
+      if (bytes < 0) return bytes;
 
-int wave_get_high_cbs(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSC, 1, 0, 1);}
+      if (bytes == 0) break;
+   }
 
-int wave_get_max_cbs(int pi)
-   {return pigpio_command(pi, PI_CMD_WVSC, 2, 0, 1);}
+   return count;
+}
 
-int gpio_trigger(int pi, unsigned user_gpio, unsigned pulseLen, uint32_t level)
+int capture_save(int pi, char *file)
 {
+   int len;
    gpioExtent_t ext[1];
-   
-   /*
-   p1=user_gpio
-   p2=pulseLen 
-   p3=4
-   ## extension ##
-   unsigned level
-   */
-
-   ext[0].size = sizeof(uint32_t);
-   ext[0].ptr = &level;
-
-   return pigpio_command_ext(
-      pi, PI_CMD_TRIG, user_gpio, pulseLen, 4, 1, ext, 1);
-}
 
-int set_glitch_filter(int pi, unsigned user_gpio, unsigned steady)
-   {return pigpio_command(pi, PI_CMD_FG, user_gpio, steady, 1);}
+   len = strlen(file);
 
-int set_noise_filter(int pi, unsigned user_gpio, unsigned steady, unsigned active)
-{
-   gpioExtent_t ext[1];
-   
    /*
-   p1=user_gpio
-   p2=steady
-   p3=4
+   p1=0
+   p2=0
+   p3=len
    ## extension ##
-   unsigned active
+   char file[len]
    */
 
-   ext[0].size = sizeof(uint32_t);
-   ext[0].ptr = &active;
+   ext[0].size = len;
+   ext[0].ptr = file;
 
-   return pigpio_command_ext(
-      pi, PI_CMD_FN, user_gpio, steady, 4, 1, ext, 1);
+   return pigpio_command_ext
+      (pi, PI_CMD_CAPW, 0, 0, len, 1, ext, 1);
 }
 
+int capture_stop(int pi)
+   {return pigpio_command(pi, PI_CMD_CAPC, 0, 0, 1);}
+
 int store_script(int pi, char *script)
 {
    unsigned len;
@@ -1197,6 +2051,40 @@ int bb_serial_read_close(int pi, unsigned user_gpio)
 int bb_serial_invert(int pi, unsigned user_gpio, unsigned invert)
    {return pigpio_command(pi, PI_CMD_SLRI, user_gpio, invert, 1);}
 
+int bb_serial_read_errors(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_SLRE, user_gpio, 0, 1);}
+
+int wiegand_read_open(int pi, unsigned gpio_d0, unsigned gpio_d1)
+   {return pigpio_command(pi, PI_CMD_WGRO, gpio_d0, gpio_d1, 1);}
+
+int ir_read_open(int pi, unsigned user_gpio, unsigned protocol)
+   {return pigpio_command(pi, PI_CMD_IRRO, user_gpio, protocol, 1);}
+
+int i2c_sniff_open(int pi, unsigned SDA, unsigned SCL)
+   {return pigpio_command(pi, PI_CMD_SNIFF, SDA, SCL, 1);}
+
+int decode_read(
+   int pi, unsigned user_gpio, gpioFrame_t *frames, unsigned max_frames)
+{
+   int bytes;
+
+   bytes = pigpio_command(pi, PI_CMD_DCDR, user_gpio, max_frames, 0);
+
+   if (bytes > 0)
+   {
+      bytes = recvMax(pi, frames, max_frames * sizeof(gpioFrame_t), bytes);
+
+      bytes /= sizeof(gpioFrame_t);
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int decode_read_close(int pi, unsigned user_gpio)
+   {return pigpio_command(pi, PI_CMD_DCDC, user_gpio, 0, 1);}
+
 int i2c_open(int pi, unsigned i2c_bus, unsigned i2c_addr, uint32_t i2c_flags)
 {
    gpioExtent_t ext[1];
@@ -2124,3 +3012,292 @@ int wait_for_event(int pi, unsigned event, double timeout)
 int event_trigger(int pi, unsigned event)
    {return pigpio_command(pi, PI_CMD_EVT, event, 0, 1);}
 
+int batch_begin(batch_t *batch)
+{
+   batch->count = 0;
+   batch->size = 0;
+
+   return 0;
+}
+
+int batch_add(
+   batch_t *batch, unsigned command, uint32_t p1, uint32_t p2,
+   unsigned extLen, char *ext)
+{
+   cmdCmd_t cmd;
+
+   if ((batch->size + sizeof(cmd) + extLen) > sizeof(batch->buf))
+      return pigif_batch_full;
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.ext_len = extLen;
+
+   memcpy(batch->buf + batch->size, &cmd, sizeof(cmd));
+   batch->size += sizeof(cmd);
+
+   if (extLen)
+   {
+      memcpy(batch->buf + batch->size, ext, extLen);
+      batch->size += extLen;
+   }
+
+   return batch->count++;
+}
+
+int batch_commit(int pi, batch_t *batch, int *results)
+{
+   int bytes;
+   gpioExtent_t ext[1];
+
+   /*
+   p1=0
+   p2=0
+   p3=size
+   ## extension ##
+   char buf[size]
+   */
+
+   if (!batch->count) return 0;
+
+   ext[0].size = batch->size;
+   ext[0].ptr = batch->buf;
+
+   bytes = pigpio_command_ext
+      (pi, PI_CMD_BATCH, 0, 0, batch->size, 1, ext, 0);
+
+   if (bytes > 0)
+   {
+      if (results)
+         bytes = recvMax(pi, results, 4 * batch->count, bytes);
+      else
+         recvMax(pi, NULL, 0, bytes);
+
+      bytes /= 4;
+   }
+
+   _pmu(pi);
+
+   return bytes;
+}
+
+int async_command(
+   int pi, unsigned command, uint32_t p1, uint32_t p2,
+   unsigned extLen, char *ext, asyncCBFunc_t f, void *userdata)
+{
+   int token;
+   asyncInfo_t *a;
+   asyncReq_t *r;
+   cmdCmd_t cmd;
+
+   if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
+      return pigif_unconnected_pi;
+
+   a = asyncOpen(pi);
+
+   if (a == NULL) return pigif_bad_connect;
+
+   /*
+   The send mutex keeps the sends in the order the slots are queued.
+   The reader never takes it, so it drains responses while a send
+   is blocked on a full socket.
+   */
+
+   pthread_mutex_lock(&a->sendMutex);
+
+   pthread_mutex_lock(&a->mutex);
+
+   /* wait for room in the queue of commands awaiting a response */
+
+   while (!a->broken && !a->closing &&
+          ((a->submitted - a->completed) >= PIGIF_ASYNC_PENDING))
+      pthread_cond_wait(&a->cond, &a->mutex);
+
+   if (a->broken || a->closing)
+   {
+      pthread_mutex_unlock(&a->mutex);
+      pthread_mutex_unlock(&a->sendMutex);
+      asyncRelease(a);
+      return pigif_bad_send;
+   }
+
+   r = &a->req[a->submitted % PIGIF_ASYNC_PENDING];
+
+   r->f = f;
+   r->userdata = userdata;
+   r->cmd = command;
+   r->result = 0;
+
+   token = a->submitted & INT32_MAX;
+
+   a->submitted++;
+
+   pthread_mutex_unlock(&a->mutex);
+
+   cmd.cmd = command;
+   cmd.p1  = p1;
+   cmd.p2  = p2;
+   cmd.p3  = extLen;
+
+   if ((send(a->sock, &cmd, sizeof(cmd), 0) != sizeof(cmd)) ||
+       (extLen && (send(a->sock, ext, extLen, 0) != extLen)))
+   {
+      /* the reader fails the queued commands, the next call reconnects */
+
+      pthread_mutex_lock(&a->mutex);
+      a->broken = 1;
+      pthread_mutex_unlock(&a->mutex);
+
+      shutdown(a->sock, SHUT_RDWR);
+
+      token = pigif_bad_send;
+   }
+
+   pthread_mutex_unlock(&a->sendMutex);
+
+   asyncRelease(a);
+
+   return token;
+}
+
+int async_wait(int pi, int token)
+{
+   int result;
+   unsigned age;
+   asyncInfo_t *a;
+
+   if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
+      return pigif_unconnected_pi;
+
+   if (token < 0) return pigif_async_expired;
+
+   a = asyncAcquire(pi);
+
+   if (a == NULL) return pigif_async_expired;
+
+   pthread_mutex_lock(&a->mutex);
+
+   /* age is the number of commands submitted after token */
+
+   while (!a->closing)
+   {
+      age = (a->submitted - 1 - token) & INT32_MAX;
+
+      if (age >= (a->submitted - a->completed)) break;
+
+      pthread_cond_wait(&a->cond, &a->mutex);
+   }
+
+   if (a->closing)
+      result = pigif_bad_recv;
+   else if (age < PIGIF_ASYNC_PENDING)
+      result = a->req[token % PIGIF_ASYNC_PENDING].result;
+   else
+      result = pigif_async_expired;
+
+   pthread_mutex_unlock(&a->mutex);
+
+   asyncRelease(a);
+
+   return result;
+}
+
+int async_flush(int pi)
+{
+   int status;
+   asyncInfo_t *a;
+
+   if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
+      return pigif_unconnected_pi;
+
+   a = asyncAcquire(pi);
+
+   if (a == NULL) return 0;
+
+   pthread_mutex_lock(&a->mutex);
+
+   while (!a->closing && (a->completed != a->submitted))
+      pthread_cond_wait(&a->cond, &a->mutex);
+
+   if (a->broken || a->closing) status = pigif_bad_recv; else status = 0;
+
+   pthread_mutex_unlock(&a->mutex);
+
+   asyncRelease(a);
+
+   return status;
+}
+
+int ring_open(int pi)
+{
+   int handle, fd;
+   char name[32];
+   cmdRing_t *ring;
+
+   if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
+      return pigif_unconnected_pi;
+
+   if (gRing[pi]) return 0;
+
+   handle = pigpio_command(pi, PI_CMD_RINGO, 0, 0, 1);
+
+   if (handle < 0) return handle;
+
+   sprintf(name, CMD_RING_NAME, handle);
+
+   ring = MAP_FAILED;
+
+   fd = shm_open(name, O_RDWR, 0);
+
+   if (fd >= 0)
+   {
+      ring = mmap(
+         0, sizeof(cmdRing_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+
+      close(fd);
+   }
+
+   if ((ring != MAP_FAILED) &&
+       (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != CMD_RING_MAGIC))
+   {
+      munmap(ring, sizeof(cmdRing_t));
+      ring = MAP_FAILED;
+   }
+
+   if (ring == MAP_FAILED)
+   {
+      pigpio_command(pi, PI_CMD_RINGC, handle, 0, 1);
+      return pigif_bad_ring;
+   }
+
+   _pml(pi);
+
+   gRing[pi] = ring;
+   gRingHandle[pi] = handle;
+
+   _pmu(pi);
+
+   return 0;
+}
+
+int ring_close(int pi)
+{
+   cmdRing_t *ring;
+
+   if ((pi < 0) || (pi >= MAX_PI) || !gPiInUse[pi])
+      return pigif_unconnected_pi;
+
+   _pml(pi);
+
+   ring = gRing[pi];
+   gRing[pi] = NULL;
+
+   _pmu(pi);
+
+   if (ring == NULL) return 0;
+
+   munmap(ring, sizeof(cmdRing_t));
+
+   return pigpio_command(pi, PI_CMD_RINGC, gRingHandle[pi], 0, 1);
+}
@@ -32,6 +32,8 @@ For more information, please refer to <http://unlicense.org/>
 
 #define PIGPIOD_IF2_VERSION 17
 
+#define PIGIF_ASYNC_PENDING 256
+
 /*TEXT
 
 pigpiod_if2 is a C library for the Raspberry which allows control
@@ -160,9 +162,17 @@ stop_thread                Stop a previously started thread
 ADVANCED
 
 notify_open                Request a notification handle
+notify_open_with_format    Request a notification handle with compact reports
 notify_begin               Start notifications for selected GPIO
 notify_pause               Pause notifications
 notify_close               Close a notification
+notify_get_queued          Get the reports queued for a handle
+notify_get_dropped         Get the reports dropped for a handle
+
+notify_open_shared         Request a shared memory notification handle
+notify_ring_map            Map a shared memory notification ring
+notify_ring_read           Read reports from a notification ring
+notify_ring_unmap          Unmap a shared memory notification ring
 
 hardware_clock             Start hardware clock on supported GPIO
 
@@ -171,6 +181,20 @@ hardware_PWM               Start hardware PWM on supported GPIO
 set_glitch_filter          Set a glitch filter on a GPIO
 set_noise_filter           Set a noise filter on a GPIO
 
+set_meter                  Start or stop an edge meter on a GPIO
+get_meter                  Get the edge counts and frequency of a GPIO
+
+encoder_open               Start decoding a quadrature encoder
+encoder_close              Stop decoding a quadrature encoder
+encoder_get                Get the position and velocity of an encoder
+encoder_set_event          Trigger an event when an encoder moves
+
+capture_start              Start a triggered capture of GPIO samples
+capture_status             Get the state of a capture
+capture_read               Read the samples of a capture
+capture_save               Save the samples of a capture to a file
+capture_stop               Stop a capture and free its samples
+
 set_pad_strength           Sets a pads drive strength
 get_pad_strength           Gets a pads drive strength
 
@@ -264,6 +288,13 @@ bb_serial_read_close       Closes a GPIO for bit bang serial reads
 bb_serial_invert           Invert serial logic (1 invert, 0 normal)
 
 bb_serial_read             Reads bit bang serial data from a GPIO
+bb_serial_read_errors      Returns the framing errors of serial reads
+
+wiegand_read_open          Opens two GPIO for Wiegand reads
+ir_read_open               Opens a GPIO for IR remote reads
+i2c_sniff_open             Opens two GPIO to sniff an I2C bus
+decode_read                Reads decoded Wiegand, IR, or I2C frames
+decode_read_close          Closes a GPIO for Wiegand, IR, or I2C reads
 
 SPI
 
@@ -303,7 +334,16 @@ wave_add_serial            Adds serial data to the waveform
 
 wave_create                Creates a waveform from added data
 wave_create_and_pad        Creates a waveform of fixed size from added data
+wave_create_shared         Creates a waveform which may be shared
 wave_delete                Deletes one or more waveforms
+wave_get_fragmentation     Reports the free wave CB and OOL space
+wave_get_cache_stats       Gets the wave cache hits and misses
+
+wave_stream_open           Opens a ring of segments for streaming pulses
+wave_stream_set_event      Triggers an event when few segments are queued
+wave_stream_write          Queues a segment of pulses on the stream
+wave_stream_status         Gets the state of the stream
+wave_stream_close          Stops the stream and frees its segments
 
 wave_send_once             Transmits a waveform once
 wave_send_repeat           Transmits a waveform repeatedly
@@ -329,6 +369,23 @@ wave_get_pulses            Length in pulses of the current waveform
 wave_get_high_pulses       Length of longest waveform so far
 wave_get_max_pulses        Absolute maximum allowed pulses
 
+BATCHES
+
+batch_begin                Starts a new batch of commands
+batch_add                  Adds a command to a batch
+batch_commit               Executes a batch in one round trip
+
+ASYNCHRONOUS
+
+async_command              Sends a command without waiting for the result
+async_wait                 Waits for the result of an asynchronous command
+async_flush                Waits for all asynchronous commands to complete
+
+COMMAND RINGS
+
+ring_open                  Sends commands via shared memory
+ring_close                 Sends commands via the socket
+
 UTILITIES
 
 get_current_tick           Get current tick (microseconds)
@@ -364,6 +421,16 @@ typedef void (*evtCBFuncEx_t)
 
 typedef struct evtCallback_s evtCallback_t;
 
+typedef struct
+{
+   unsigned count;             // number of commands added
+   unsigned size;              // bytes of buf in use
+   char buf[PI_MAX_BATCH_LEN]; // the packed commands
+} batch_t;
+
+typedef void (*asyncCBFunc_t)
+   (int pi, int token, int result, char *ext, void *userdata);
+
 /*F*/
 double time_time(void);
 /*D
@@ -438,7 +505,8 @@ notification streams.
 addrStr: specifies the host or IP address of the Pi running the
          pigpio daemon.  It may be NULL in which case localhost
          is used unless overridden by the PIGPIO_ADDR environment
-         variable.
+         variable.  An address of unix:path connects to the
+         daemon's Unix domain socket at path.
 
 portStr: specifies the port address used by the Pi running the
          pigpio daemon.  It may be NULL in which case "8888"
@@ -812,6 +880,30 @@ E.g. if the function returns 15 then the notifications must be
 read from /dev/pigpio15.
 D*/
 
+/*F*/
+int notify_open_with_format(int pi, unsigned format);
+/*D
+Get a free notification handle whose pipe carries reports in
+the given format.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+format: PI_NOTIFY_FORMAT_V1 or PI_NOTIFY_FORMAT_V2.
+. .
+
+Returns a handle greater than or equal to zero if OK,
+otherwise PI_BAD_NOTIFY_FORMAT or PI_NO_HANDLE.
+
+PI_NOTIFY_FORMAT_V2 reports are varint delta encoded, typically
+2 or 3 bytes per level change rather than 12.  The layout is
+described under gpioNotifyOpenWithFormat in pigpio.h.
+
+The in-built (socket) notifications provided by [*callback*]
+use PI_NOTIFY_FORMAT_V2 when the daemon supports it.
+
+See [*notify_open*] for further details.
+D*/
+
 /*F*/
 int notify_begin(int pi, unsigned handle, uint32_t bits);
 /*D
@@ -843,8 +935,8 @@ typedef struct
 seqno: starts at 0 each time the handle is opened and then increments
 by one for each report.
 
-flags: three flags are defined, PI_NTFY_FLAGS_WDOG,
-PI_NTFY_FLAGS_ALIVE, and PI_NTFY_FLAGS_EVENT.
+flags: four flags are defined, PI_NTFY_FLAGS_WDOG,
+PI_NTFY_FLAGS_ALIVE, PI_NTFY_FLAGS_EVENT, and PI_NTFY_FLAGS_GAP.
 
 If bit 5 is set (PI_NTFY_FLAGS_WDOG) then bits 0-4 of the flags
 indicate a GPIO which has had a watchdog timeout.
@@ -856,6 +948,12 @@ of other notification activity.
 If bit 7 is set (PI_NTFY_FLAGS_EVENT) then bits 0-4 of the flags
 indicate an event which has been triggered.
 
+If bit 8 is set (PI_NTFY_FLAGS_GAP) then samples were lost because
+the daemon's DMA sample buffer was overwritten before it was read.
+Sampling resumed at tick.  The level is the last level reported
+before the gap.  A gap while the notification is paused is reported
+when it resumes.
+
 tick: the number of microseconds since system boot.  It wraps around
 after 1h12m.
 
@@ -893,6 +991,118 @@ handle: 0-31 (as returned by [*notify_open*])
 Returns 0 if OK, otherwise PI_BAD_HANDLE.
 D*/
 
+/*F*/
+int notify_get_queued(int pi, unsigned handle);
+/*D
+Returns the number of reports waiting to be written for a
+previously opened handle.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+handle: >=0 (as returned by [*notify_open*])
+. .
+
+Returns the count if OK, otherwise PI_BAD_HANDLE.
+
+For a shared memory handle the count is the number of reports
+in the ring not yet consumed by the reader.
+D*/
+
+/*F*/
+int notify_get_dropped(int pi, unsigned handle);
+/*D
+Returns the number of reports dropped for a previously opened
+handle because its queue (or shared memory ring) was full.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+handle: >=0 (as returned by [*notify_open*])
+. .
+
+Returns the count if OK, otherwise PI_BAD_HANDLE.
+
+A non-zero count means the reader is not keeping up with the
+rate of GPIO level changes.
+D*/
+
+/*F*/
+int notify_open_shared(int pi, unsigned reports);
+/*D
+Get a free notification handle whose reports are written to
+a shared memory ring rather than a pipe.
+
+. .
+     pi: >=0 (as returned by [*pigpio_start*]).
+reports: 16-65536, a power of 2.
+. .
+
+Returns a handle greater than or equal to zero if OK,
+otherwise PI_BAD_NOTIFY_RING, PI_NO_HANDLE, or PI_BAD_PATHNAME.
+
+The ring is only accessible from the local machine.  Map it with
+[*notify_ring_map*] and then start it with [*notify_begin*].
+
+The daemon never waits for the reader.  Reports which do not fit
+in the ring are dropped and counted in the ring's overruns field.
+D*/
+
+/*F*/
+gpioNotifyRing_t *notify_ring_map(unsigned handle);
+/*D
+Map the shared memory ring of a notification handle.
+
+. .
+handle: >=0 (as returned by [*notify_open_shared*]).
+. .
+
+Returns a pointer to the ring if OK, otherwise NULL.
+D*/
+
+/*F*/
+int notify_ring_read(
+   gpioNotifyRing_t *ring, gpioReport_t *reports, unsigned maxReports);
+/*D
+Read the reports waiting in a shared memory notification ring.
+
+. .
+      ring: as returned by [*notify_ring_map*].
+  *reports: an array to receive the reports.
+maxReports: the size of the array.
+. .
+
+Returns the number of reports read (0 if none are waiting),
+otherwise pigif_ring_closed if the handle has been closed and
+all its reports have been read.
+
+No system calls are made.  See [*notify_begin*] for the report
+format.
+
+...
+gpioReport_t r[256];
+
+h = notify_open_shared(pi, 4096);
+ring = notify_ring_map(h);
+notify_begin(pi, h, 1<<4);
+
+while ((n = notify_ring_read(ring, r, 256)) >= 0)
+{
+   // process n reports, ring->overruns counts any lost
+}
+...
+D*/
+
+/*F*/
+void notify_ring_unmap(gpioNotifyRing_t *ring);
+/*D
+Unmap a ring mapped by [*notify_ring_map*].
+
+. .
+ring: as returned by [*notify_ring_map*].
+. .
+
+The handle should be closed with [*notify_close*].
+D*/
+
 /*F*/
 int set_watchdog(int pi, unsigned user_gpio, unsigned timeout);
 /*D
@@ -978,6 +1188,268 @@ be reported.  Your software must be designed to cope with
 such reports.
 D*/
 
+/*F*/
+int set_meter(int pi, unsigned user_gpio, unsigned window_ms);
+/*D
+Starts (or stops) an edge meter on a GPIO.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+user_gpio: 0-31
+window_ms: 0 (to stop), or 10-60000
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_BAD_METER_WINDOW.
+
+The daemon counts the rising and falling edges of the GPIO and the
+time it is high.  Every window_ms milliseconds it calculates the
+frequency, period, pulse width, and duty cycle over the window.
+The results may be read with [*get_meter*].  No edges are sent to
+the client.
+
+Edges closer together than the sample rate are not seen, and any
+glitch or noise filter on the GPIO applies.
+
+Starting a meter clears its counts.
+D*/
+
+/*F*/
+int get_meter(int pi, unsigned user_gpio, gpioMeter_t *meter);
+/*D
+Gets the results of the edge meter on a GPIO.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+user_gpio: 0-31
+    meter: a pointer to a gpioMeter_t to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_NOT_METERED.
+
+. .
+typedef struct
+{
+   uint32_t rising;    // rising edges since the meter was started
+   uint32_t falling;   // falling edges since the meter was started
+   uint32_t window;    // length of the last window, microseconds
+   uint32_t edges;     // rising edges in the last window
+   uint32_t frequency; // millihertz
+   uint32_t period;    // mean period, nanoseconds
+   uint32_t pulse;     // mean high pulse, nanoseconds
+   uint32_t duty;      // time high, parts per million
+} gpioMeter_t;
+. .
+
+The edge counts are current.  The other values are from the last
+complete window and are zero until the first window ends.
+D*/
+
+/*F*/
+int encoder_open(
+   int pi, unsigned gpio_a, unsigned gpio_b, unsigned gpio_index);
+/*D
+Starts decoding a quadrature encoder.
+
+. .
+        pi: >=0 (as returned by [*pigpio_start*]).
+    gpio_a: 0-31
+    gpio_b: 0-31
+gpio_index: 0-31, or PI_ENCODER_NO_INDEX
+. .
+
+Returns a handle (>=0) if OK, otherwise PI_BAD_USER_GPIO,
+PI_GPIO_IN_USE, or PI_NO_HANDLE.
+
+The daemon decodes the encoder from its GPIO samples.  No edges are
+sent to the client.  Every change of A or B counts one step (four
+per cycle).  The position counts up when A leads B.
+
+If A and B both change between samples a step has been missed and
+the error count is incremented.
+
+The velocity is updated every 100 milliseconds.
+
+If an index GPIO is given each rising edge is counted and the
+position at the time is recorded.
+
+The encoder is closed automatically when the connection to the
+daemon is closed.
+D*/
+
+/*F*/
+int encoder_close(int pi, unsigned handle);
+/*D
+Stops decoding a quadrature encoder.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+handle: >=0 (as returned by [*encoder_open*]).
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+D*/
+
+/*F*/
+int encoder_get(int pi, unsigned handle, gpioEncoder_t *encoder);
+/*D
+Gets the position, velocity, and error counts of an encoder.
+
+. .
+     pi: >=0 (as returned by [*pigpio_start*]).
+ handle: >=0 (as returned by [*encoder_open*]).
+encoder: a pointer to a gpioEncoder_t to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE.
+
+. .
+typedef struct
+{
+   int32_t  position;      // counts, four per cycle
+   int32_t  velocity;      // counts per second
+   uint32_t errors;        // steps missed (A and B changed together)
+   uint32_t indexes;       // rising edges of the index GPIO
+   int32_t  indexPosition; // position at the last index
+   uint32_t tick;          // tick of the last position change
+} gpioEncoder_t;
+. .
+D*/
+
+/*F*/
+int encoder_set_event(int pi, unsigned handle, unsigned event, unsigned millis);
+/*D
+Triggers an event when the position of an encoder changes.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+handle: >=0 (as returned by [*encoder_open*]).
+ event: 0-31
+millis: 0-60000
+. .
+
+Returns 0 if OK, otherwise PI_BAD_HANDLE, PI_BAD_EVENT_ID, or
+PI_BAD_ENCODER_EVENT.
+
+The event is triggered at most once every millis milliseconds, and
+only if the position has changed since it was last triggered.  A
+millis of 0 stops the events.
+
+Use [*event_callback*] to be told of the event and [*encoder_get*]
+to read the position.
+D*/
+
+/*F*/
+int capture_start(
+   int pi, uint32_t bits, unsigned trig_mode, uint32_t trig_bits,
+   uint32_t trig_levels, unsigned pre_samples, unsigned post_samples);
+/*D
+Starts a triggered capture of GPIO samples, like a logic analyser.
+
+. .
+          pi: >=0 (as returned by [*pigpio_start*]).
+        bits: the GPIO to capture
+   trig_mode: PI_CAPTURE_NOW, _LEVEL, _EDGE, or _CHANGE
+   trig_bits: the GPIO which trigger the capture
+ trig_levels: the trigger levels of those GPIO
+ pre_samples: samples to keep from before the trigger
+post_samples: samples to keep from after the trigger
+. .
+
+Returns 0 if OK, otherwise PI_BAD_CAPTURE_TRIG or
+PI_BAD_CAPTURE_DEPTH.
+
+The capture is taken by the daemon as it reads the GPIO samples.
+A sample is kept each time one of the captured GPIO changes level.
+
+Until the trigger the latest pre_samples samples are kept.  The
+sample which meets the trigger is kept, then the next post_samples
+samples.  The capture is then complete.
+
+. .
+PI_CAPTURE_NOW    0 trigger at once
+PI_CAPTURE_LEVEL  1 trig_bits GPIO are at trig_levels (a level or pattern)
+PI_CAPTURE_EDGE   2 a trig_bits GPIO changes to its level in trig_levels
+PI_CAPTURE_CHANGE 3 a trig_bits GPIO changes
+. .
+
+pre_samples plus post_samples may be at most 1000000.  Starting a
+capture discards any earlier capture.
+D*/
+
+/*F*/
+int capture_status(int pi, gpioCapture_t *status);
+/*D
+Gets the state of a capture.
+
+. .
+    pi: >=0 (as returned by [*pigpio_start*]).
+status: a pointer to a gpioCapture_t to be filled
+. .
+
+Returns 0 if OK, otherwise PI_NO_CAPTURE.
+
+. .
+typedef struct
+{
+   uint32_t state;   // PI_CAPTURE_ARMED, _TRIGGERED, or _DONE
+   uint32_t samples; // samples held
+   uint32_t trigger; // index of the trigger sample
+   uint32_t tick;    // tick of the trigger sample
+   uint32_t gaps;    // times samples were lost during the capture
+} gpioCapture_t;
+. .
+D*/
+
+/*F*/
+int capture_read(int pi, gpioSample_t *samples, unsigned max_samples);
+/*D
+Reads the samples of a complete capture.
+
+. .
+         pi: >=0 (as returned by [*pigpio_start*]).
+   *samples: an array of gpioSample_t to receive the samples
+max_samples: the most samples to read
+. .
+
+Returns the number of samples read if OK, otherwise PI_NO_CAPTURE
+or PI_CAPTURE_NOT_DONE.
+
+The samples are read from the daemon in blocks until max_samples
+have been read or the capture is exhausted.  They are in time
+order, the trigger sample is at index trigger, see
+[*capture_status*].
+D*/
+
+/*F*/
+int capture_save(int pi, char *file);
+/*D
+Saves the samples of a complete capture to a file on the daemon's
+host.
+
+. .
+  pi: >=0 (as returned by [*pigpio_start*]).
+file: the file to write
+. .
+
+Returns the number of samples saved if OK, otherwise PI_NO_CAPTURE,
+PI_CAPTURE_NOT_DONE, or one of the errors of [*file_open*].
+
+The file must be writable as for [*file_open*].  It is written in
+the notification format so may be converted to VCD by pig2vcd.
+D*/
+
+/*F*/
+int capture_stop(int pi);
+/*D
+Stops a capture, complete or not, and frees its samples.
+
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
+
+Returns 0 if OK, otherwise PI_NO_CAPTURE.
+D*/
+
 /*F*/
 uint32_t read_bank_1(int pi);
 /*D
@@ -1333,6 +1805,9 @@ function.
 As many waveforms may be created as there is space available.  The
 wave id is passed to [*wave_send_**] to specify the waveform to transmit.
 
+Each call makes a new wave.  See [*wave_create_shared*] to reuse
+an existing wave made from the same pulses.
+
 Normal usage would be
 
 Step 1. [*wave_clear*] to clear all waveforms and added data.
@@ -1374,6 +1849,29 @@ PI_NO_WAVEFORM_ID, PI_TOO_MANY_CBS, or PI_TOO_MANY_OOL.
 D*/
 
 
+/*F*/
+int wave_create_shared(int pi);
+/*D
+This function creates a waveform like [*wave_create*] but, if a
+wave made from the same pulses by an earlier call of this function
+still exists, returns its id and makes no new wave.
+
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
+
+Returns the waveform id if OK, otherwise PI_EMPTY_WAVEFORM,
+PI_NO_WAVEFORM_ID, PI_TOO_MANY_CBS, or PI_TOO_MANY_OOL.
+
+The wave is reference counted.  Each call which returns it must be
+matched by a [*wave_delete*].  Until the last of those deletes the
+wave id stays valid, its CBs and OOL are not freed, and it may still
+be sent.
+
+Only waves made by this function are shared.  See
+[*wave_get_cache_stats*].
+D*/
+
 /*F*/
 int wave_create_and_pad(int pi, int percent);
 /*D
@@ -1418,27 +1916,200 @@ D*/
 
 
 /*F*/
-int wave_delete(int pi, unsigned wave_id);
+int wave_delete(int pi, unsigned wave_id);
+/*D
+This function deletes the waveform with id wave_id.
+
+. .
+     pi: >=0 (as returned by [*pigpio_start*]).
+wave_id: >=0, as returned by [*wave_create*].
+. .
+
+Wave ids are allocated in order, 0, 1, 2, etc.
+
+The CBs and OOL used by the wave are freed and merged with any
+free space either side.  A new wave is placed in the smallest free
+range which will hold it, so waves of different sizes may be
+created and deleted without calling [*wave_clear*].
+
+A wave returned by more than one [*wave_create_shared*] is only
+freed by the last of the matching deletes.  The earlier deletes
+return 0 but leave the wave id valid and the wave in place.
+
+Returns 0 if OK, otherwise PI_BAD_WAVE_ID.
+D*/
+
+/*F*/
+int wave_get_fragmentation(int pi, gpioWaveFrag_t *frag);
+/*D
+This function reports how the CB and OOL space used by waves is
+split into free ranges.
+
+. .
+  pi: >=0 (as returned by [*pigpio_start*]).
+frag: a pointer to a gpioWaveFrag_t to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_POINTER.
+
+. .
+typedef struct
+{
+   uint32_t waves;       // waves in use
+   uint32_t cbs;         // CBs available to waves
+   uint32_t freeCBs;     // CBs free
+   uint32_t largestCBs;  // CBs in the largest free range
+   uint32_t holesCB;     // free CB ranges
+   uint32_t ools;        // OOL available to waves
+   uint32_t freeOOLs;    // OOL free
+   uint32_t largestOOLs; // OOL in the largest free range
+   uint32_t holesOOL;    // free OOL ranges
+} gpioWaveFrag_t;
+. .
+
+A wave needing more CBs than largestCBs, or more OOL than
+largestOOLs, can not be created until other waves are deleted.
+D*/
+
+/*F*/
+int wave_get_cache_stats(int pi, gpioWaveCacheStats_t *stats);
+/*D
+This function gets the statistics of the wave cache, which lets
+[*wave_create_shared*] return an existing wave made from the same
+pulses.
+
+. .
+   pi: >=0 (as returned by [*pigpio_start*]).
+stats: a pointer to a gpioWaveCacheStats_t to be filled
+. .
+
+Returns 0 if OK, otherwise PI_BAD_POINTER.
+
+. .
+typedef struct
+{
+   uint32_t hits;   // creates which returned an existing wave
+   uint32_t misses; // creates which made a new wave which may be shared
+   uint32_t waves;  // waves which may be shared
+   uint32_t refs;   // creates of those waves not yet deleted
+} gpioWaveCacheStats_t;
+. .
+
+The hits and misses are counted from the daemon's start.
+D*/
+
+/*F*/
+int wave_stream_open(int pi, unsigned segments, unsigned seg_pulses);
+/*D
+This function opens a wave stream, a ring of segments which are
+played one after the other while the earlier ones are refilled.
+There is no limit to the length of the pulse train.
+
+. .
+        pi: >=0 (as returned by [*pigpio_start*]).
+  segments: 2-64, the segments in the ring
+seg_pulses: 1-12000, the most pulses in a segment
+. .
+
+Returns 0 if OK, otherwise PI_BAD_WAVE_STREAM, PI_TOO_MANY_CBS, or
+PI_TOO_MANY_OOL.
+
+The segments are taken from the same CB and OOL space as waves
+and are returned by [*wave_stream_close*] or [*wave_clear*].
+Opening a stream closes any earlier stream.
+
+Each segment is queued by [*wave_stream_write*].  The output
+starts with the first write and goes from the end of one segment
+to the start of the next without a gap.
+
+If the output reaches the end of the last segment written it stops.
+The next write restarts it after the gap and counts an underrun,
+see [*wave_stream_status*].
+
+While a stream is open [*wave_send_once*] and the other wave
+transmits, [*wave_chain*], and [*wave_tx_stop*] stop its output and
+drop the queued segments.  The next write starts the output again.
+D*/
+
+/*F*/
+int wave_stream_set_event(int pi, unsigned event, unsigned low_water);
+/*D
+This function triggers an event when the segments queued on the
+stream fall to low_water, so the consumer knows to write more.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+    event: 0-31
+low_water: 0 to one less than the segments in the ring
+. .
+
+Returns 0 if OK, otherwise PI_BAD_EVENT_ID, PI_NO_WAVE_STREAM, or
+PI_BAD_WAVE_STREAM.
+
+The event is triggered once each time the queued segments fall to
+low_water or below.  Use [*event_callback*] to be told of the event.
+D*/
+
+/*F*/
+int wave_stream_write(int pi, unsigned numPulses, gpioPulse_t *pulses);
+/*D
+This function queues a segment of pulses to be played after those
+already queued on the stream.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+numPulses: 1 to the seg_pulses given to [*wave_stream_open*]
+   pulses: an array of pulses
+. .
+
+Returns 0 if OK, otherwise PI_NO_WAVE_STREAM, PI_TOO_MANY_PULSES,
+PI_TOO_MANY_CBS, PI_WAVE_STREAM_FULL, or PI_SOME_PERMITTED.
+
+Each pulse sets the gpioOn GPIO, clears the gpioOff GPIO, then
+waits usDelay microseconds, as for [*wave_add_generic*].  The
+segment follows on from the previous segment.
+
+PI_WAVE_STREAM_FULL is returned if every segment is queued.  Wait
+for the low water event, see [*wave_stream_set_event*], then write
+again.
+D*/
+
+/*F*/
+int wave_stream_status(int pi, gpioWaveStream_t *status);
 /*D
-This function deletes the waveform with id wave_id.
+This function gets the state of the stream.
 
 . .
-     pi: >=0 (as returned by [*pigpio_start*]).
-wave_id: >=0, as returned by [*wave_create*].
+    pi: >=0 (as returned by [*pigpio_start*]).
+status: a pointer to a gpioWaveStream_t to be filled
 . .
 
-Wave ids are allocated in order, 0, 1, 2, etc.
+Returns 0 if OK, otherwise PI_BAD_POINTER or PI_NO_WAVE_STREAM.
 
-The wave is flagged for deletion.  The resources used by the wave
-will only be reused when either of the following apply.
+. .
+typedef struct
+{
+   uint32_t segments;  // segments in the ring
+   uint32_t segPulses; // most pulses per segment
+   uint32_t queued;    // segments written but not yet played
+   uint32_t written;   // segments written since the stream was opened
+   uint32_t played;    // segments played (or dropped by a stop)
+   uint32_t underruns; // gaps, the output ran out of segments
+} gpioWaveStream_t;
+. .
+D*/
 
-- all waves with higher numbered wave ids have been deleted or have
-been flagged for deletion.
+/*F*/
+int wave_stream_close(int pi);
+/*D
+This function stops the output of the stream, if it is running, and
+frees its segments.
 
-- a new wave is created which uses exactly the same resources as
-the current wave (see the C source for gpioWaveCreate for details).
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
 
-Returns 0 if OK, otherwise PI_BAD_WAVE_ID.
+Returns 0 if OK, otherwise PI_NO_WAVE_STREAM.
 D*/
 
 
@@ -1881,7 +2552,7 @@ This function opens a GPIO for bit bang reading of serial data.
 . .
        pi: >=0 (as returned by [*pigpio_start*]).
 user_gpio: 0-31.
-     baud: 50-250000
+     baud: 50-333333
 data_bits: 1-32
 . .
 
@@ -1893,6 +2564,11 @@ bb_serial_read.
 
 It is the caller's responsibility to read data from the cyclic buffer
 in a timely fashion.
+
+Each bit should span at least three of the daemon's samples.  Baud
+rates above 66666 need a faster sample rate than the default 5
+microseconds (pigpiod -s), and the highest rate needs a 1
+microsecond sample rate.
 D*/
 
 /*F*/
@@ -1946,6 +2622,148 @@ user_gpio: 0-31, previously opened with [*bb_serial_read_open*].
 Returns 0 if OK, otherwise PI_NOT_SERIAL_GPIO or PI_BAD_SER_INVERT.
 D*/
 
+/*F*/
+int bb_serial_read_errors(int pi, unsigned user_gpio);
+/*D
+This function returns the number of framing errors seen by a bit
+bang serial read.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+user_gpio: 0-31, previously opened with [*bb_serial_read_open*].
+. .
+
+Returns the number of framing errors since the GPIO was opened if OK,
+otherwise PI_BAD_USER_GPIO or PI_NOT_SERIAL_GPIO.
+
+A framing error is a start bit which is not low or a stop bit which
+is not high at the middle of the bit.  A character with a bad stop
+bit is still added to the buffer, one with a bad start bit is not.
+D*/
+
+/*F*/
+int wiegand_read_open(int pi, unsigned gpio_d0, unsigned gpio_d1);
+/*D
+This function opens two GPIO for reading Wiegand frames.
+
+. .
+     pi: >=0 (as returned by [*pigpio_start*]).
+gpio_d0: 0-31, the D0 (data 0) line.
+gpio_d1: 0-31, the D1 (data 1) line.
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+The daemon decodes the frames from its GPIO samples and returns
+them in a cyclic buffer which is read using [*decode_read*] on
+gpio_d0.  No edges are sent to the client.
+
+A frame ends when no bit has arrived for 25 milliseconds.  For 26
+and 34 bit frames the parity bits are checked and removed, leaving
+a 24 or 32 bit code.  The code of other frames is their last 32
+bits.
+D*/
+
+/*F*/
+int ir_read_open(int pi, unsigned user_gpio, unsigned protocol);
+/*D
+This function opens a GPIO for reading IR remote frames.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+user_gpio: 0-31.
+ protocol: PI_DECODE_NEC or PI_DECODE_RC5.
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, PI_BAD_IR_PROTOCOL,
+or PI_GPIO_IN_USE.
+
+The GPIO should be connected to an IR receiver module whose output
+is low while it sees the carrier.  The daemon decodes the frames
+from its GPIO samples and returns them in a cyclic buffer which is
+read using [*decode_read*].
+
+An NEC code is the 32 bits of the frame, the first bit received in
+bit 0.  A repeat frame returns the previous code with
+PI_DECODE_REPEAT set.
+
+An RC5 code has the 5 bit address in bits 8-12 and the 7 bit
+command in bits 0-6.  PI_DECODE_TOGGLE is set if the toggle bit was.
+D*/
+
+/*F*/
+int i2c_sniff_open(int pi, unsigned SDA, unsigned SCL);
+/*D
+This function opens two GPIO to passively sniff an I2C bus.
+
+. .
+ pi: >=0 (as returned by [*pigpio_start*]).
+SDA: 0-31.
+SCL: 0-31.
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO or PI_GPIO_IN_USE.
+
+The daemon decodes the bus from its GPIO samples and returns each
+byte, with its ACK, in a cyclic buffer which is read using
+[*decode_read*] on SDA.  No edges are sent to the client.
+
+Each byte is a frame of 8 bits.  The first byte after a START or
+repeated START has PI_DECODE_START set.  PI_DECODE_NACK is set if
+the byte was not acknowledged.  A STOP is a frame of 0 bits with
+PI_DECODE_STOP set.
+
+Each SCL high and low period must last at least one sample.  A
+100kHz bus needs the daemon to use a 1 or 2 microsecond sample rate.
+D*/
+
+/*F*/
+int decode_read(
+   int pi, unsigned user_gpio, gpioFrame_t *frames, unsigned max_frames);
+/*D
+This function copies up to max_frames decoded frames from the
+Wiegand, IR, or I2C sniffer cyclic buffer to frames.
+
+. .
+        pi: >=0 (as returned by [*pigpio_start*]).
+ user_gpio: 0-31, previously opened with [*wiegand_read_open*] (D0),
+            [*ir_read_open*], or [*i2c_sniff_open*] (SDA).
+    frames: an array to receive the frames.
+max_frames: >=0.
+. .
+
+Returns the number of frames copied if OK, otherwise
+PI_BAD_USER_GPIO or PI_NOT_DECODE_GPIO.
+
+PI_DECODE_BAD_CHECK is set in the flags of a frame whose parity
+(Wiegand) or complement (NEC) check failed.
+
+. .
+typedef struct
+{
+   uint32_t tick;     // tick of the first edge of the frame
+   uint32_t code;     // the decoded value
+   uint16_t bits;     // bits in the frame
+   uint8_t  protocol; // PI_DECODE_WIEGAND, _NEC, _RC5, or _I2C
+   uint8_t  flags;    // PI_DECODE_REPEAT, _TOGGLE, _BAD_CHECK, _START, ...
+} gpioFrame_t;
+. .
+D*/
+
+/*F*/
+int decode_read_close(int pi, unsigned user_gpio);
+/*D
+This function closes a GPIO for Wiegand, IR, or I2C sniffer reads.
+
+. .
+       pi: >=0 (as returned by [*pigpio_start*]).
+user_gpio: 0-31, previously opened with [*wiegand_read_open*] (D0),
+           [*ir_read_open*], or [*i2c_sniff_open*] (SDA).
+. .
+
+Returns 0 if OK, otherwise PI_BAD_USER_GPIO, or PI_NOT_DECODE_GPIO.
+D*/
+
 /*F*/
 int i2c_open(int pi, unsigned i2c_bus, unsigned i2c_addr, unsigned i2c_flags);
 /*D
@@ -3782,6 +4600,215 @@ Note that other than its id and its tick there is no data associated
 with an event.
 D*/
 
+/*F*/
+int batch_begin(batch_t *batch);
+/*D
+This function empties a batch ready for commands to be added.
+
+. .
+batch: the batch to be emptied.
+. .
+
+Returns 0.
+
+A batch collects commands which are then sent to the daemon in
+a single round trip by [*batch_commit*].
+
+...
+batch_t b;
+
+batch_begin(&b);
+batch_add(&b, PI_CMD_WRITE, 4, 1, 0, NULL);
+batch_add(&b, PI_CMD_WRITE, 17, 0, 0, NULL);
+batch_add(&b, PI_CMD_PWM, 18, 128, 0, NULL);
+batch_commit(pi, &b, NULL);
+...
+D*/
+
+/*F*/
+int batch_add(
+   batch_t *batch, unsigned command, uint32_t p1, uint32_t p2,
+   unsigned extLen, char *ext);
+/*D
+This function adds a socket command to a batch.
+
+. .
+  batch: a batch started by [*batch_begin*].
+command: a PI_CMD_x socket command code.
+     p1: the command's first parameter.
+     p2: the command's second parameter.
+ extLen: the number of bytes in ext.
+    ext: the command's extension (if any).
+. .
+
+Returns the position of the command in the batch (>=0) if OK,
+otherwise pigif_batch_full.
+
+The parameters and extension are those which would be sent for
+the command on its own.  Commands which return an extension
+(e.g. I2CRD, SPIX, FR) may not be batched.  Their result will be
+PI_BAD_BATCH_CMD.
+D*/
+
+/*F*/
+int batch_commit(int pi, batch_t *batch, int *results);
+/*D
+This function sends a batch to the daemon which executes the
+commands in the order they were added.
+
+. .
+     pi: >=0 (as returned by [*pigpio_start*]).
+  batch: a batch started by [*batch_begin*].
+results: an array of at least batch->count ints to receive
+         the result of each command, or NULL.
+. .
+
+Returns the number of commands executed if OK, otherwise
+PI_BAD_BATCH_LEN.
+
+All the commands are executed even if one fails.  The result
+of command n is stored in results[n].
+
+The batch is not emptied so it may be committed again.
+D*/
+
+/*F*/
+int async_command(
+   int pi, unsigned command, uint32_t p1, uint32_t p2,
+   unsigned extLen, char *ext, asyncCBFunc_t f, void *userdata);
+/*D
+This function sends a socket command to the daemon and returns
+without waiting for the result.
+
+. .
+      pi: >=0 (as returned by [*pigpio_start*]).
+ command: a PI_CMD_x socket command code.
+      p1: the command's first parameter.
+      p2: the command's second parameter.
+  extLen: the number of bytes in ext.
+     ext: the command's extension (if any).
+       f: the function to call with the result, or NULL.
+userdata: a pointer to arbitrary user data.
+. .
+
+Returns a token (>=0) identifying the command if OK, otherwise
+pigif_unconnected_pi, pigif_bad_connect, or pigif_bad_send.
+
+Up to PIGIF_ASYNC_PENDING commands may be awaiting a response.
+Further calls block until a response arrives.
+
+Asynchronous commands are sent on a connection of their own which
+is opened on first use.  They are executed in the order they were
+sent but are not ordered with respect to the synchronous functions.
+
+If the connection fails the commands awaiting a response complete
+with pigif_bad_recv and the next call opens a new connection.
+
+A thread reads the responses in order.  If f is not NULL it is
+called with the token, the result, and any data returned by the
+command (ext is only valid during the call).
+
+The result of a command may also be fetched with [*async_wait*].
+
+...
+void done(int pi, int token, int result, char *ext, void *userdata)
+{
+   printf("command %d returned %d\n", token, result);
+}
+
+for (i=0; i<100; i++)
+   async_command(pi, PI_CMD_WRITE, 4, i&1, 0, NULL, done, NULL);
+
+async_flush(pi);
+...
+D*/
+
+/*F*/
+int async_wait(int pi, int token);
+/*D
+This function waits for an asynchronous command to complete.
+
+. .
+   pi: >=0 (as returned by [*pigpio_start*]).
+token: as returned by [*async_command*].
+. .
+
+Returns the result of the command, otherwise pigif_unconnected_pi,
+pigif_async_expired, or pigif_bad_recv if the connection is closed
+by [*pigpio_stop*] while waiting.
+
+The result is only retained until a further PIGIF_ASYNC_PENDING
+commands have been sent.
+D*/
+
+/*F*/
+int async_flush(int pi);
+/*D
+This function waits until all the asynchronous commands sent
+have completed.
+
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
+
+Returns 0 if OK, otherwise pigif_unconnected_pi or pigif_bad_recv
+if the connection failed.
+D*/
+
+/*F*/
+int ring_open(int pi);
+/*D
+This function opens a shared memory command ring to the daemon.
+
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
+
+Returns 0 if OK, otherwise pigif_unconnected_pi, PI_NO_HANDLE,
+PI_RING_FAILED, or pigif_bad_ring.
+
+The daemon must be on the same host, connected via localhost or
+a Unix domain socket.
+
+While the ring is open commands are exchanged through shared
+memory with a dedicated daemon thread rather than via the socket,
+avoiding the system calls and context switches of a socket round
+trip.  Both sides spin briefly for the other before sleeping.
+
+Commands which return data other than the status, or which send
+more than CMD_RING_EXT_LEN bytes, are still sent on the socket.
+
+If the daemon closes the ring the library unmaps it and sends later
+commands on the socket.  A command the daemon had not yet taken
+from the ring is resent on the socket.
+
+...
+ring_open(pi);
+
+for (i=0; i<1000; i++)
+{
+   gpio_write(pi, 4, 1);
+   gpio_write(pi, 4, 0);
+}
+
+ring_close(pi);
+...
+D*/
+
+/*F*/
+int ring_close(int pi);
+/*D
+This function closes the command ring opened by [*ring_open*].
+
+. .
+pi: >=0 (as returned by [*pigpio_start*]).
+. .
+
+Returns 0 if OK, otherwise pigif_unconnected_pi or PI_BAD_HANDLE.
+
+The ring is closed automatically by [*pigpio_stop*].
+D*/
+
 /*PARAMS
 
 active :: 0-1000000
@@ -3796,6 +4823,9 @@ the pigpio daemon.  It may be NULL in which case localhost
 is used unless overridden by the PIGPIO_ADDR environment
 variable.
 
+A string of the form unix:path specifies the Unix domain
+socket of a local daemon started with the -u option.
+
 arg1::
 An unsigned argument passed to a user customised function.  Its
 meaning is defined by the customiser.
@@ -3826,6 +4856,24 @@ A convenient way to set bit n is to or in (1<<n).
 
 e.g. to select bits 5, 9, 23 you could use (1<<5) | (1<<9) | (1<<23).
 
+batch::
+A pointer to a [*batch_t*] object used to collect commands.
+
+. .
+typedef struct
+{
+   unsigned count;             // number of commands added
+   unsigned size;              // bytes of buf in use
+   char buf[PI_MAX_BATCH_LEN]; // the packed commands
+} batch_t;
+. .
+
+asyncCBFunc_t::
+. .
+typedef void (*asyncCBFunc_t)
+   (int pi, int token, int result, char *ext, void *userdata);
+. .
+
 bsc_xfer_t::
 
 . .
@@ -3881,6 +4929,9 @@ A single character, an 8 bit quantity able to store 0-255.
 clkfreq::4689-250M (13184-375M for the BCM2711)
 The hardware clock frequency.
 
+command::
+A PI_CMD_x socket command code (see pigpio.h).
+
 count::
 The number of bytes to be transferred in a file, I2C, SPI, or serial
 command.
@@ -3915,6 +4966,9 @@ FALLING_EDGE 1
 EITHER_EDGE. 2
 . .
 
+*encoder::
+A pointer to a gpioEncoder_t object, see [*encoder_get*].
+
 errnum::
 A negative number indicating a function call failed and the nature
 of the error.
@@ -3937,6 +4991,12 @@ typedef void (*evtCBFuncEx_t)
    (int pi, unsigned event, uint32_t tick, void *userdata);
 . .
 
+*ext::
+The extension bytes sent with a command.
+
+extLen::
+The number of extension bytes sent with a command.
+
 f::
 A function.
 
@@ -3948,6 +5008,21 @@ A full file path.  To be accessible the path must match an entry in
 A file path which may contain wildcards.  To be accessible the path
 must match an entry in /opt/pigpio/access.
 
+format::
+The format of the reports on a notification pipe.
+
+. .
+PI_NOTIFY_FORMAT_V1 0 // gpioReport_t
+PI_NOTIFY_FORMAT_V2 1 // compact
+. .
+
+*frag::
+A pointer to a gpioWaveFrag_t object, see [*wave_get_fragmentation*].
+
+*frames::
+An array of gpioFrame_t to receive decoded frames, see
+[*decode_read*].
+
 frequency::>=0
 The number of times a GPIO is swiched on and off per second.  This
 can be set per GPIO and may be as little as 5Hz or as much as
@@ -3983,6 +5058,25 @@ Type 2    -  X  X  -  -  -  X  X  X  X  -  X  X  X  X  X
 Type 3    X  X  X  X  X  X  X  X  X  X  X  X  -  -  -  -
 . .
 
+gpio_a:: 0-31
+The GPIO connected to the A output of a quadrature encoder.
+
+gpio_b:: 0-31
+The GPIO connected to the B output of a quadrature encoder.
+
+gpio_d0:: 0-31
+The GPIO connected to the D0 (data 0) line of a Wiegand device.
+
+gpio_d1:: 0-31
+The GPIO connected to the D1 (data 1) line of a Wiegand device.
+
+gpio_index:: 0-31, PI_ENCODER_NO_INDEX
+The GPIO connected to the index output of a quadrature encoder,
+or PI_ENCODER_NO_INDEX (32) if there is none.
+
+gpioCapture_t::
+A structure holding the state of a capture, see [*capture_status*].
+
 gpioPulse_t::
 . .
 typedef struct
@@ -3998,9 +5092,19 @@ gpioThreadFunc_t::
 typedef void *(gpioThreadFunc_t) (void *);
 . .
 
+gpioWaveCacheStats_t::
+The wave cache statistics, see [*wave_get_cache_stats*].
+
+gpioWaveFrag_t::
+The use of the wave CB and OOL space, see [*wave_get_fragmentation*].
+
+gpioWaveStream_t::
+The state of a wave stream, see [*wave_stream_status*].
+
 handle::>=0
 A number referencing an object opened by one of
 
+[*encoder_open*] 
 [*file_open*] 
 [*i2c_open*] 
 [*notify_open*] 
@@ -4055,6 +5159,26 @@ reported as PI_TIMEOUT.  See [*set_watchdog*].
 PI_TIMEOUT 2
 . .
 
+low_water::
+The number of queued wave stream segments at or below which an
+event is triggered, see [*wave_stream_set_event*].
+
+max_frames::
+The maximum number of frames to return.
+
+max_samples::
+The most samples to read.
+
+maxReports::
+The maximum number of reports to return.
+
+*meter::
+A pointer to a gpioMeter_t object, see [*get_meter*].
+
+millis:: 0-60000
+The minimum interval between encoder events in milliseconds.
+0 stops the events.
+
 MISO::
 The GPIO used for the MISO signal when bit banging SPI.
 
@@ -4109,7 +5233,8 @@ numPar:: 0-10
 The number of parameters passed to a script.
 
 numPulses::
-The number of pulses to be added to a waveform.
+The number of pulses to be added to a waveform, or written to a
+wave stream.
 
 offset::
 The associated data starts this number of microseconds from the start of
@@ -4121,6 +5246,12 @@ A buffer used to return data from a function.
 outLen::
 The size in bytes of an output buffer.
 
+p1::
+The first parameter of a socket command.
+
+p2::
+The second parameter of a socket command.
+
 pad:: 0-2
 A set of GPIO which share common drivers.
 
@@ -4149,6 +5280,20 @@ the pigpio daemon.  It may be NULL in which case "8888"
 is used unless overridden by the PIGPIO_PORT environment
 variable.
 
+post_samples::
+The samples to keep from after the trigger of a capture.
+
+pre_samples::
+The samples to keep from before the trigger of a capture.
+
+protocol::
+The IR protocol to decode.
+
+. .
+PI_DECODE_NEC 1
+PI_DECODE_RC5 2
+. .
+
 *pth::
 A thread identifier, returned by [*start_thread*].
 
@@ -4169,7 +5314,8 @@ pulseLen::
 1-100, the length of a trigger pulse in microseconds.
 
 *pulses::
-An array of pulses to be added to a waveform.
+An array of pulses to be added to a waveform, or written to a wave
+stream.
 
 pulsewidth::0, 500-2500
 . .
@@ -4202,16 +5348,32 @@ PI_MIN_DUTYCYCLE_RANGE 25
 PI_MAX_DUTYCYCLE_RANGE 40000
 . .
 
+reports::16-65536
+The number of reports a shared memory notification ring holds.
+It must be a power of 2.
+
+*reports::
+An array to receive notification reports.
+
+*results::
+An array to receive one result per batched command.
+
 *retBuf::
 A buffer to hold a number of bytes returned to a used customised function,
 
 retMax::
 The maximum number of bytes a user customised function should return.
 
+*ring::
+A shared memory notification ring (as returned by [*notify_ring_map*]).
+
 
 *rxBuf::
 A pointer to a buffer to receive data.
 
+*samples::
+An array of gpioSample_t to receive capture samples.
+
 SCL::
 The user GPIO to use for the clock when bit banging I2C.
 
@@ -4249,6 +5411,12 @@ seekOffset::
 The number of bytes to move forward (positive) or backwards (negative)
 from the seek position (start, current, or end of file).
 
+seg_pulses::1-12000
+The most pulses in a segment of a wave stream.
+
+segments::2-64
+The number of segments in a wave stream.
+
 ser_flags::
 Flags which modify a serial open command.  None are currently defined.
 
@@ -4270,6 +5438,13 @@ The number of microseconds level changes must be stable for
 before reporting the level changed ([*set_glitch_filter*]) or triggering
 the active part of a noise filter ([*set_noise_filter*]).
 
+*stats::
+A pointer to a gpioWaveCacheStats_t object, see [*wave_get_cache_stats*].
+
+*status::
+A pointer to a gpioCapture_t object, see [*capture_status*], or a
+gpioWaveStream_t object, see [*wave_stream_status*].
+
 stop_bits::2-8
 The number of (half) stop bits to be used when adding serial data
 to a waveform.
@@ -4294,6 +5469,25 @@ PI_MIN_WDOG_TIMEOUT 0
 PI_MAX_WDOG_TIMEOUT 60000
 . .
 
+token::
+A number identifying a command sent by [*async_command*].
+
+trig_bits::
+A mask of the GPIO which trigger a capture.
+
+trig_levels::
+The levels of the trig_bits GPIO which trigger a capture.
+
+trig_mode::0-3
+How a capture is triggered.
+
+. .
+PI_CAPTURE_NOW    0
+PI_CAPTURE_LEVEL  1
+PI_CAPTURE_EDGE   2
+PI_CAPTURE_CHANGE 3
+. .
+
 *txBuf::
 An array of bytes to transmit.
 
@@ -4354,6 +5548,10 @@ One of
 [*wave_send_once*] 
 [*wave_send_repeat*]
 
+window_ms:: 0, 10-60000
+The length in milliseconds of the window over which an edge meter
+calculates frequency and duty cycle, or 0 to stop the meter.
+
 wVal::0-65535 (Hex 0x0-0xFFFF, Octal 0-0177777)
 A 16-bit word value.
 
@@ -4376,6 +5574,10 @@ typedef enum
    pigif_callback_not_found = -2010,
    pigif_unconnected_pi     = -2011,
    pigif_too_many_pis       = -2012,
+   pigif_batch_full         = -2013,
+   pigif_async_expired      = -2014,
+   pigif_bad_ring           = -2015,
+   pigif_ring_closed        = -2016,
 } pigifError_t;
 
 /*DEF_E*/
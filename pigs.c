@@ -36,6 +36,7 @@ This version is for pigpio version 69+
 #include <ctype.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/types.h>
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -52,6 +53,11 @@ the commands available from pigpio.
 char command_buf[CMD_MAX_EXTENSION];
 char response_buf[CMD_MAX_EXTENSION];
 
+char batch_buf[PI_MAX_BATCH_LEN];
+int  batch_rv[PI_MAX_BATCH_LEN/sizeof(cmdCmd_t)];
+int  batch_size = 0;
+int  batch_count = 0;
+
 int printFlags = 0;
 
 int status = PIGS_OK;
@@ -61,6 +67,8 @@ int status = PIGS_OK;
 #define PRINT_HEX 1
 #define PRINT_ASCII 2
 
+int batchMode = 0;
+
 void report(int err, char *fmt, ...)
 {
    char buf[128];
@@ -85,10 +93,15 @@ static int initOpts(int argc, char *argv[])
 
    args = 1;
 
-   while ((opt = getopt(argc, argv, "ax")) != -1)
+   while ((opt = getopt(argc, argv, "abx")) != -1)
    {
       switch (opt)
       {
+         case 'b':
+            batchMode = 1;
+            args++;
+            break;
+
          case 'a':
             printFlags |= PRINT_ASCII;
             args++;
@@ -107,6 +120,31 @@ static int initOpts(int argc, char *argv[])
    return args;
 }
 
+static int openUnixSocket(const char *path)
+{
+   int sock;
+   struct sockaddr_un addr;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) return SOCKET_OPEN_FAILED;
+
+   memset(&addr, 0, sizeof(addr));
+
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (sock == -1) return SOCKET_OPEN_FAILED;
+
+   if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+   {
+      close(sock);
+      return SOCKET_OPEN_FAILED;
+   }
+
+   return sock;
+}
+
 static int openSocket(void)
 {
    int sock, err;
@@ -121,6 +159,11 @@ static int openSocket(void)
 
    if (!addrStr) addrStr = PI_DEFAULT_SOCKET_ADDR_STR;
 
+   /* an address of unix:path selects a Unix domain socket */
+
+   if (!strncmp(addrStr, PI_UNIX_ADDR_PREFIX, strlen(PI_UNIX_ADDR_PREFIX)))
+      return openUnixSocket(addrStr + strlen(PI_UNIX_ADDR_PREFIX));
+
    memset (&hints, 0, sizeof (hints));
 
    hints.ai_family   = PF_UNSPEC;
@@ -151,6 +194,8 @@ void print_result(int sock, int rv, cmdCmd_t cmd)
 {
    int i, r, ch;
    uint32_t *p;
+   gpioFrame_t *f;
+   gpioSample_t *smp;
 
    r = cmd.res;
 
@@ -263,36 +308,157 @@ void print_result(int sock, int rv, cmdCmd_t cmd)
          printf("\n");
          break;
 
+      case 9: /* MTRG */
+         if (r < 0)
+         {
+            printf("%d\n", r);
+            report(PIGS_SCRIPT_ERR, "ERROR: %s", cmdErrStr(r));
+            break;
+         }
+
+         p = (uint32_t *)response_buf;
+
+         for (i=0; i<(r/4); i++) printf("%s%u", i ? " " : "", p[i]);
+
+         printf("\n");
+         break;
+
+      case 10: /* ENCG */
+         if (r < 0)
+         {
+            printf("%d\n", r);
+            report(PIGS_SCRIPT_ERR, "ERROR: %s", cmdErrStr(r));
+            break;
+         }
+
+         p = (uint32_t *)response_buf;
+
+         for (i=0; i<(r/4); i++) printf("%s%d", i ? " " : "", (int32_t)p[i]);
+
+         printf("\n");
+         break;
+
+      case 11: /* DCDR */
+         if (r < 0)
+         {
+            printf("%d\n", r);
+            report(PIGS_SCRIPT_ERR, "ERROR: %s", cmdErrStr(r));
+            break;
+         }
+
+         f = (gpioFrame_t *)response_buf;
+
+         for (i=0; i<(r/(int)sizeof(gpioFrame_t)); i++)
+            printf("%u 0x%X %d %d %d\n",
+               f[i].tick, f[i].code, f[i].bits, f[i].protocol, f[i].flags);
+         break;
+
+      case 12: /* CAPR */
+         if (r < 0)
+         {
+            printf("%d\n", r);
+            report(PIGS_SCRIPT_ERR, "ERROR: %s", cmdErrStr(r));
+            break;
+         }
+
+         smp = (gpioSample_t *)response_buf;
+
+         for (i=0; i<(r/(int)sizeof(gpioSample_t)); i++)
+            printf("%u %08X\n", smp[i].tick, smp[i].level);
+         break;
+
    }
 }
 
 void get_extensions(int sock, int command, int res)
 {
-   switch (command)
+   if (cmdReturnsExt(command) && (res > 0))
    {
-      case PI_CMD_BI2CZ:
-      case PI_CMD_BSCX:
-      case PI_CMD_BSPIX:
-      case PI_CMD_CF2:
-      case PI_CMD_FL:
-      case PI_CMD_FR:
-      case PI_CMD_I2CPK:
-      case PI_CMD_I2CRD:
-      case PI_CMD_I2CRI:
-      case PI_CMD_I2CRK:
-      case PI_CMD_I2CZ:
-      case PI_CMD_PROCP:
-      case PI_CMD_SERR:
-      case PI_CMD_SLR:
-      case PI_CMD_SPIX:
-      case PI_CMD_SPIR:
-
-         if (res > 0)
-         {
-            recv(sock, response_buf, res, MSG_WAITALL);
-            response_buf[res] = 0;
-         }
-         break;
+      recv(sock, response_buf, res, MSG_WAITALL);
+      response_buf[res] = 0;
+   }
+}
+
+void batch_add(int idx, cmdCmd_t cmd, char *ext)
+{
+   int rv = cmdInfo[idx].rv;
+
+   switch (rv)
+   {
+      case 5:
+      case 6:
+      case 7:
+      case 8:
+      case 9:
+      case 10:
+      case 11:
+      case 12:
+         report(PIGS_SCRIPT_ERR,
+            "%s may not be batched", cmdInfo[idx].name);
+         return;
+   }
+
+   if ((batch_size + sizeof(cmdCmd_t) + cmd.ext_len) > sizeof(batch_buf))
+   {
+      report(PIGS_SCRIPT_ERR, "too many commands to batch");
+      return;
+   }
+
+   memcpy(batch_buf + batch_size, &cmd, sizeof(cmdCmd_t));
+   batch_size += sizeof(cmdCmd_t);
+
+   memcpy(batch_buf + batch_size, ext, cmd.ext_len);
+   batch_size += cmd.ext_len;
+
+   batch_rv[batch_count++] = rv;
+}
+
+void batch_send(int sock)
+{
+   int i, count;
+   int32_t res;
+   cmdCmd_t cmd;
+
+   cmd.cmd = PI_CMD_BATCH;
+   cmd.p1 = 0;
+   cmd.p2 = 0;
+   cmd.p3 = batch_size;
+
+   if (sock == SOCKET_OPEN_FAILED)
+   {
+      report(PIGS_CONNECT_ERR, "socket connect failed");
+      return;
+   }
+
+   if ((send(sock, &cmd, sizeof(cmdCmd_t), 0) != sizeof(cmdCmd_t)) ||
+       (send(sock, batch_buf, batch_size, 0) != batch_size))
+   {
+      report(PIGS_CONNECT_ERR, "socket send failed");
+      return;
+   }
+
+   if (recv(sock, &cmd, sizeof(cmdCmd_t), MSG_WAITALL) != sizeof(cmdCmd_t))
+   {
+      report(PIGS_CONNECT_ERR, "socket receive failed");
+      return;
+   }
+
+   get_extensions(sock, PI_CMD_BATCH, cmd.res);
+
+   if ((int)cmd.res < 0)
+   {
+      printf("%d\n", cmd.res);
+      report(PIGS_SCRIPT_ERR, "ERROR: %s", cmdErrStr(cmd.res));
+      return;
+   }
+
+   count = cmd.res / 4;
+
+   for (i=0; i<count; i++)
+   {
+      memcpy(&res, response_buf + (4*i), 4);
+      cmd.res = res;
+      print_result(sock, batch_rv[i], cmd);
    }
 }
 
@@ -345,6 +511,15 @@ int main(int argc , char *argv[])
                cmdParseScript(v, &s, 1);
                if (s.par) free (s.par);
             }
+            else if (batchMode)
+            {
+               cmd.cmd = command;
+               cmd.p1 = p[1];
+               cmd.p2 = p[2];
+               cmd.p3 = p[3];
+
+               batch_add(idx, cmd, v);
+            }
             else
             {
                cmd.cmd = command;
@@ -387,6 +562,8 @@ int main(int argc , char *argv[])
       }
    }
 
+   if (batch_count) batch_send(sock);
+
    if (sock >= 0) close(sock);
 
    return status;
@@ -22,6 +22,7 @@ sudo ./x_pigpio
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "pigpio.h"
 
@@ -493,7 +494,17 @@ To the lascivious pleasing of a lute.\n\
             {0, 1<<GPIO, 100000}
          });
    c = gpioWaveCreate();
-   CHECK(5, 25, c, -67, 0, "No more CBs using wave create");
+   CHECK(5, 25, c, 0, 0, "wave create in deleted wave space, wid==");
+   gpioWaveDelete(c);
+
+   e = gpioWaveAddGeneric(6, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  10000},
+            {0, 1<<GPIO,  30000},
+            {1<<GPIO, 0,  60000},
+            {0, 1<<GPIO, 100000},
+            {1<<GPIO, 0,  60000},
+            {0, 1<<GPIO, 100000}
+         });
    wid = gpioWaveCreatePad(50, 50, 0);
    CHECK(5, 26, wid, 0, 0, "wave create pad, count==3, wid==");
 
@@ -900,6 +911,249 @@ void tc()
    CHECK(12, 99, e, 0, 0, "spiClose");
 }
 
+int td_count;
+
+void tdtimer(void *userdata)
+{
+   td_count++;
+}
+
+int td_cancels;
+
+void tdcancel(void *userdata)
+{
+   /* overlap with the other timer's call, then cancel it and this */
+
+   time_sleep(0.05);
+   gpioSetTimerFunc((intptr_t)userdata, 10, NULL);
+   gpioSetTimerFunc(3 - (intptr_t)userdata, 10, NULL);
+   td_cancels++;
+}
+
+void td()
+{
+   int e, c;
+   gpioTimerStats_t stats;
+
+   printf("Timer tests.\n");
+
+   td_count = 0;
+   e = gpioSetTimerFuncMicros(0, 1000, tdtimer, NULL);
+   CHECK(13, 1, e, 0, 0, "set timer func micros");
+
+   time_sleep(1.0);
+   gpioSetTimerFunc(0, 10, NULL);
+   c = td_count;
+   CHECK(13, 2, c, 1000, 5, "timer micros count");
+
+   e = gpioGetTimerStats(0, &stats);
+   CHECK(13, 3, e, 0, 0, "get timer stats");
+   CHECK(13, 4, stats.calls, c, 0, "timer stats calls");
+
+   e = gpioSetTimerFuncMicros(0, 99, tdtimer, NULL);
+   CHECK(13, 5, e, PI_BAD_TIMER_MICROS, 0, "set timer func micros, bad micros");
+
+   /* two timers which cancel each other mustn't wait on each other */
+
+   td_cancels = 0;
+   e  = gpioSetTimerFuncEx(1, 10, tdcancel, (void *)2);
+   e |= gpioSetTimerFuncEx(2, 10, tdcancel, (void *)1);
+   CHECK(13, 6, e, 0, 0, "set timer funcs which cancel each other");
+
+   time_sleep(0.5);
+   c = td_cancels;
+   CHECK(13, 7, (c >= 1) && (c <= 2), 1, 0, "timers cancelled each other");
+
+   time_sleep(0.2);
+   CHECK(13, 8, td_cancels, c, 0, "cancelled timers stopped");
+}
+
+#define TE_EDGES 200
+
+pthread_t te_alert_thread, te_samples_thread;
+int te_count, te_level, te_order_ok, te_thread_ok;
+int te_samples, te_samples_ok;
+uint32_t te_tick, te_samples_tick;
+
+void tecbf(int gpio, int level, uint32_t tick)
+{
+   if (level == PI_TIMEOUT) return;
+
+   if (te_count == 0) te_alert_thread = pthread_self();
+   else
+   {
+      /* each edge, in order, on the same thread */
+
+      if ((level == te_level) || ((int32_t)(tick - te_tick) <= 0))
+         te_order_ok = 0;
+
+      if (!pthread_equal(te_alert_thread, pthread_self())) te_thread_ok = 0;
+   }
+
+   te_level = level;
+   te_tick = tick;
+   te_count++;
+}
+
+void tesamples(const gpioSample_t *samples, int numSamples)
+{
+   int i;
+
+   if (te_samples == 0) te_samples_thread = pthread_self();
+
+   for (i=0; i<numSamples; i++)
+   {
+      if (te_samples && ((int32_t)(samples[i].tick - te_samples_tick) <= 0))
+         te_samples_ok = 0;
+
+      te_samples_tick = samples[i].tick;
+      te_samples++;
+   }
+}
+
+void te()
+{
+   int i, e;
+   gpioCallbackStats_t stats;
+
+   printf("Callback worker tests.\n");
+
+   /* restart with 2 workers, GPIO 25 uses worker 1, samples worker 0 */
+
+   gpioTerminate();
+   gpioCfgCallbackWorkers(2);
+
+   if (gpioInitialise() < 0)
+   {
+      fprintf(stderr, "pigpio initialisation failed.\n");
+      return;
+   }
+
+   gpioSetMode(GPIO, PI_OUTPUT);
+   gpioWrite(GPIO, 0);
+   time_sleep(0.1);
+
+   te_count = 0;
+   te_order_ok = 1;
+   te_thread_ok = 1;
+   te_samples = 0;
+   te_samples_ok = 1;
+
+   e = gpioSetAlertFunc(GPIO, tecbf);
+   CHECK(14, 1, e, 0, 0, "set alert func");
+
+   e = gpioSetGetSamplesFunc(tesamples, 1<<GPIO);
+   CHECK(14, 2, e, 0, 0, "set get samples func");
+
+   for (i=0; i<TE_EDGES; i++)
+   {
+      gpioWrite(GPIO, (i & 1) ? 0 : 1);
+      gpioDelay(1000);
+   }
+
+   time_sleep(0.2);
+
+   gpioSetAlertFunc(GPIO, NULL);
+   gpioSetGetSamplesFunc(NULL, 0);
+
+   CHECK(14, 3, te_count, TE_EDGES, 0, "alert callbacks");
+   CHECK(14, 4, te_order_ok, 1, 0, "alert callbacks in order");
+   CHECK(14, 5, te_thread_ok, 1, 0, "alert callbacks on one thread");
+
+   CHECK(14, 6, te_samples >= TE_EDGES, 1, 0, "samples callbacks");
+   CHECK(14, 7, te_samples_ok, 1, 0, "samples in order");
+
+   /* on the alert thread the two would share a thread */
+
+   CHECK(14, 8, pthread_equal(te_alert_thread, te_samples_thread), 0, 0,
+      "alert and samples callbacks on different workers");
+
+   e = gpioGetCallbackStats(&stats);
+   CHECK(14, 9, e, 0, 0, "get callback stats");
+   CHECK(14, 10, stats.dropped, 0, 0, "callbacks dropped");
+
+   /* the other tests run their callbacks on the alert thread */
+
+   gpioTerminate();
+   gpioCfgCallbackWorkers(0);
+   gpioInitialise();
+}
+
+int tf_stall;
+
+void tfsamples(const gpioSample_t *samples, int numSamples)
+{
+   /* hold up the alert thread so the DMA sample buffer laps */
+
+   if (tf_stall)
+   {
+      tf_stall = 0;
+      time_sleep(0.5);
+   }
+}
+
+void tf()
+{
+   int h, e, f, b, n, gap;
+   gpioReport_t r;
+   char p[32];
+
+   printf("Notification gap tests.\n");
+
+   gpioSetMode(GPIO, PI_OUTPUT);
+   gpioWrite(GPIO, 0);
+
+   h = gpioNotifyOpen();
+
+   sprintf(p, "/dev/pigpio%d", h);
+   f = open(p, O_RDONLY | O_NONBLOCK);
+
+   e = gpioNotifyBegin(h, (1<<GPIO));
+   CHECK(15, 1, e, 0, 0, "notify open/begin");
+
+   e = gpioNotifyPause(h);
+   CHECK(15, 2, e, 0, 0, "notify pause");
+
+   time_sleep(0.1);
+
+   while (read(f, &r, 12) == 12); /* reports from before the pause */
+
+   /* samples are lost while the notification is paused */
+
+   tf_stall = 1;
+   gpioSetGetSamplesFunc(tfsamples, 1<<GPIO);
+   gpioWrite(GPIO, 1);
+   time_sleep(1.0);
+   gpioSetGetSamplesFunc(NULL, 0);
+
+   e = gpioNotifyBegin(h, (1<<GPIO));
+   CHECK(15, 3, e, 0, 0, "notify resume");
+
+   gpioWrite(GPIO, 0);
+   time_sleep(0.1);
+
+   n = 0;
+   gap = 0;
+
+   while (1)
+   {
+      b = read(f, &r, 12);
+
+      if (b != 12) break;
+
+      if ((n == 0) && (r.flags & PI_NTFY_FLAGS_GAP)) gap = 1;
+
+      n++;
+   }
+
+   CHECK(15, 4, gap, 1, 0, "gap reported on resume");
+
+   e = gpioNotifyClose(h);
+   CHECK(15, 5, e, 0, 0, "notify close");
+
+   close(f);
+}
+
 int main(int argc, char *argv[])
 {
    int i, t, c, status;
@@ -921,7 +1175,7 @@ int main(int argc, char *argv[])
          }
       }
    }
-   else strcat(test, "0123456789");
+   else strcat(test, "0123456789def");
 
    status = gpioInitialise();
 
@@ -944,6 +1198,9 @@ int main(int argc, char *argv[])
    if (strchr(test, 'a')) ta();
    if (strchr(test, 'b')) tb();
    if (strchr(test, 'c')) tc();
+   if (strchr(test, 'd')) td();
+   if (strchr(test, 'e')) te();
+   if (strchr(test, 'f')) tf();
 
    gpioTerminate();
 
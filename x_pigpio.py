@@ -508,10 +508,16 @@ To the lascivious pleasing of a lute.
                         pigpio.pulse(0, 1<<GPIO, 100000),
                         pigpio.pulse(1<<GPIO, 0,  60000),
                         pigpio.pulse(0, 1<<GPIO, 100000)])
-   pigpio.exceptions = False
    c = pi.wave_create()
-   CHECK(5, 37, c, -67, 0, "No more CBs using wave create")
-   pigpio.exceptions = True
+   CHECK(5, 37, c, 0, 0, "wave create in deleted wave space, wid==")
+   pi.wave_delete(c)
+
+   pi.wave_add_generic([pigpio.pulse(1<<GPIO, 0,  10000),
+                        pigpio.pulse(0, 1<<GPIO,  30000),
+                        pigpio.pulse(1<<GPIO, 0,  60000),
+                        pigpio.pulse(0, 1<<GPIO, 100000),
+                        pigpio.pulse(1<<GPIO, 0,  60000),
+                        pigpio.pulse(0, 1<<GPIO, 100000)])
 
    wid = pi.wave_create_and_pad(50)
    CHECK(5, 38, wid, 0, 0, "wave create pad, count==3, wid==")
@@ -52,6 +52,8 @@ void t0(int pi)
 void t1(int pi)
 {
    int v;
+   int res[4];
+   batch_t b;
 
    printf("Mode/PUD/read/write tests.\n");
 
@@ -81,6 +83,28 @@ void t1(int pi)
    v = pigpio_start(PI_DEFAULT_SOCKET_ADDR_STR, PI_DEFAULT_SOCKET_PORT_STR);
    CHECK(1, 7, v, 31, 100, "pigpio_start with non-default arguments");
    pigpio_stop(v);
+
+   batch_begin(&b);
+   batch_add(&b, PI_CMD_WRITE, GPIO, PI_LOW, 0, NULL);
+   batch_add(&b, PI_CMD_READ, GPIO, 0, 0, NULL);
+   batch_add(&b, PI_CMD_WRITE, GPIO, PI_HIGH, 0, NULL);
+   batch_add(&b, PI_CMD_READ, GPIO, 0, 0, NULL);
+   v = batch_commit(pi, &b, res);
+   CHECK(1, 8, v, 4, 0, "batch commit");
+   CHECK(1, 9, (res[1]*10)+res[3], 1, 0, "batch write, read");
+
+   async_command(pi, PI_CMD_WRITE, GPIO, PI_LOW, 0, NULL, NULL, NULL);
+   v = async_command(pi, PI_CMD_READ, GPIO, 0, 0, NULL, NULL, NULL);
+   v = async_wait(pi, v);
+   CHECK(1, 10, v, 0, 0, "async write, read");
+
+   v = ring_open(pi);
+   CHECK(1, 11, v, 0, 0, "ring open");
+
+   gpio_write(pi, GPIO, PI_HIGH);
+   v = gpio_read(pi, GPIO);
+   ring_close(pi);
+   CHECK(1, 12, v, 1, 0, "ring write, read");
 }
 
 int t2_count=0;
@@ -191,13 +215,43 @@ void t3cbf(int pi, unsigned gpio, unsigned level, uint32_t tick)
    t3_tick = tick;
 }
 
+void t3_encoder_wave(int pi, int cycles, int forwards)
+{
+   gpioPulse_t p[4*5];
+   unsigned a=1<<GPIO, b=1<<(GPIO-1);
+   unsigned first, second;
+   int c, wid;
+
+   if (forwards) {first = a; second = b;}
+   else          {first = b; second = a;}
+
+   for (c=0; c<cycles; c++)
+   {
+      p[4*c+0] = (gpioPulse_t){first, 0, 1000};
+      p[4*c+1] = (gpioPulse_t){second, 0, 1000};
+      p[4*c+2] = (gpioPulse_t){0, first, 1000};
+      p[4*c+3] = (gpioPulse_t){0, second, 1000};
+   }
+
+   wave_clear(pi);
+   wave_add_generic(pi, 4*cycles, p);
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.05);
+   time_sleep(0.1);
+   wave_delete(pi, wid);
+}
+
 void t3(int pi)
 {
    int pw[3]={500, 1500, 2500};
    int dc[4]={20, 40, 60, 80};
 
-   int f, rr, v;
+   int f, rr, v, h;
    float on, off;
+   gpioMeter_t m;
+   gpioCapture_t cap;
+   gpioEncoder_t enc;
 
    int t, id;
 
@@ -243,8 +297,73 @@ void t3(int pi)
          "set PWM dutycycle");
    }
 
+   set_meter(pi, GPIO, 1000);
+   time_sleep(2.5);
+   get_meter(pi, GPIO, &m);
+   CHECK(3, 17, m.frequency, 1000000, 1, "meter frequency");
+   CHECK(3, 18, m.duty, 800000, 1, "meter duty cycle");
+   set_meter(pi, GPIO, 0);
+
+   v = encoder_open(pi, GPIO, GPIO, PI_ENCODER_NO_INDEX);
+   CHECK(3, 19, v, PI_GPIO_IN_USE, 0, "encoder open same GPIO");
+
+   capture_start(pi, 1<<GPIO, PI_CAPTURE_NOW, 0, 0, 0, 10);
+   time_sleep(0.5);
+   capture_status(pi, &cap);
+   CHECK(3, 20, cap.state, PI_CAPTURE_DONE, 0, "capture state");
+   CHECK(3, 21, cap.samples, 11, 0, "capture samples");
+   capture_stop(pi);
+
    set_PWM_dutycycle(pi, GPIO, 0);
 
+   set_mode(pi, GPIO, PI_OUTPUT);
+   set_mode(pi, GPIO-1, PI_OUTPUT);
+   gpio_write(pi, GPIO, 0);
+   gpio_write(pi, GPIO-1, 0);
+
+   /* the GPIO are now steady so the encoder does not move */
+
+   h = encoder_open(pi, GPIO, GPIO-1, PI_ENCODER_NO_INDEX);
+   CHECK(3, 22, h, 0, 0, "encoder open");
+
+   v = encoder_get(pi, h, &enc);
+   CHECK(3, 23, v, 0, 0, "encoder get");
+   CHECK(3, 24, enc.position, 0, 0, "encoder position");
+   CHECK(3, 25, enc.velocity, 0, 0, "encoder velocity");
+   CHECK(3, 26, enc.errors, 0, 0, "encoder errors");
+
+   v = encoder_set_event(pi, h, 0, PI_MAX_ENCODER_EVENT+1);
+   CHECK(3, 27, v, PI_BAD_ENCODER_EVENT, 0, "encoder set event bad millis");
+
+   /* A leads B for 5 cycles, each edge is one step */
+
+   t3_encoder_wave(pi, 5, 1);
+   encoder_get(pi, h, &enc);
+   CHECK(3, 29, enc.position, 20, 0, "encoder position forwards");
+
+   /* B leads A for 2 cycles */
+
+   t3_encoder_wave(pi, 2, 0);
+   encoder_get(pi, h, &enc);
+   CHECK(3, 30, enc.position, 12, 0, "encoder position backwards");
+   CHECK(3, 31, enc.errors, 0, 0, "encoder errors after waves");
+
+   v = encoder_close(pi, h);
+   CHECK(3, 28, v, 0, 0, "encoder close");
+
+   /* an encoder left open is closed with its connection */
+
+   v = pigpio_start(0, 0);
+   h = encoder_open(v, GPIO, GPIO-1, PI_ENCODER_NO_INDEX);
+   pigpio_stop(v);
+   time_sleep(0.1);
+
+   h = encoder_open(pi, GPIO, GPIO-1, PI_ENCODER_NO_INDEX);
+   CHECK(3, 32, h, 0, 0, "encoder closed with its connection");
+   encoder_close(pi, h);
+
+   set_mode(pi, GPIO-1, PI_INPUT);
+
    callback_cancel(id);
 }
 
@@ -252,6 +371,7 @@ void t4(int pi)
 {
    int h, e, f, n, s, b, l, seq_ok, toggle_ok;
    gpioReport_t r;
+   gpioNotifyRing_t *ring;
    char p[32];
 
    printf("Pipe notification tests.\n");
@@ -275,6 +395,12 @@ void t4(int pi)
    e = notify_pause(pi, h);
    CHECK(4, 2, e, 0, 0, "notify pause");
 
+   e = notify_get_dropped(pi, h);
+   CHECK(4, 10, e, 0, 0, "notify reports dropped");
+
+   e = notify_open_with_format(pi, 7);
+   CHECK(4, 11, e, PI_BAD_NOTIFY_FORMAT, 0, "notify bad format");
+
    e = notify_close(pi, h);
    CHECK(4, 3, e, 0, 0, "notify close");
 
@@ -310,15 +436,139 @@ void t4(int pi)
    CHECK(4, 5, toggle_ok, 1, 0, "gpio toggled ok");
 
    CHECK(4, 6, n, 80, 10, "number of notifications");
+
+   h = notify_open_shared(pi, 1024);
+   ring = notify_ring_map(h);
+
+   e = notify_begin(pi, h, (1<<GPIO));
+   CHECK(4, 7, (ring != NULL) && (e == 0), 1, 0, "shared notify open/begin");
+
+   set_PWM_dutycycle(pi, GPIO, 50);
+   time_sleep(4);
+   set_PWM_dutycycle(pi, GPIO, 0);
+
+   notify_close(pi, h);
+
+   n = 0;
+   s = 0;
+   seq_ok = 1;
+
+   while (ring && (notify_ring_read(ring, &r, 1) == 1))
+   {
+      if (s != r.seqno) seq_ok = 0;
+      s++;
+      n++;
+   }
+
+   if (ring) notify_ring_unmap(ring);
+
+   CHECK(4, 8, seq_ok, 1, 0, "shared sequence numbers ok");
+
+   CHECK(4, 9, n, 80, 10, "number of shared notifications");
 }
 
 int t5_count = 0;
+int t5_event_count = 0;
 
 void t5cbf(int pi, unsigned gpio, unsigned level, uint32_t tick)
 {
    t5_count++;
 }
 
+void t5evt(int pi, unsigned event, uint32_t tick)
+{
+   t5_event_count++;
+}
+
+int t5_rc5_frame(gpioPulse_t *p, uint32_t frame)
+{
+   int b, h, n, level, halves[28];
+
+   /* 14 Manchester bits MSB first, a 1 is a space (high) then a mark */
+
+   for (b=0; b<14; b++)
+   {
+      level = (frame >> (13-b)) & 1;
+      halves[2*b]   = level;
+      halves[2*b+1] = !level;
+   }
+
+   /* the line idles high, join the halves of equal level */
+
+   n = 0;
+   level = 1;
+   p[n] = (gpioPulse_t){1<<GPIO, 0, 0};
+
+   for (h=0; h<28; h++)
+   {
+      if (halves[h] != level)
+      {
+         level = halves[h];
+         n++;
+         if (level) p[n] = (gpioPulse_t){1<<GPIO, 0, 0};
+         else       p[n] = (gpioPulse_t){0, 1<<GPIO, 0};
+      }
+      p[n].usDelay += 889;
+   }
+
+   if (!level) p[++n] = (gpioPulse_t){1<<GPIO, 0, 0};
+
+   p[n].usDelay += 10000;
+
+   return n+1;
+}
+
+int t5_wiegand_frame(gpioPulse_t *p, int n, uint32_t frame, int bits)
+{
+   int b;
+   unsigned line;
+
+   /* a 0 is a low pulse on D0 (GPIO), a 1 one on D1 (GPIO-1) */
+
+   for (b=bits-1; b>=0; b--)
+   {
+      line = ((frame >> b) & 1) ? 1<<(GPIO-1) : 1<<GPIO;
+
+      p[n++] = (gpioPulse_t){0, line, 100};
+      p[n++] = (gpioPulse_t){line, 0, 1000};
+   }
+
+   /* longer than the 25 ms frame timeout */
+
+   p[n-1].usDelay = 50000;
+
+   return n;
+}
+
+int t5_i2c_level(gpioPulse_t *p, int n, int sda, int scl)
+{
+   /* SDA is GPIO, SCL is GPIO-1, each level lasts 50 micros */
+
+   p[n].gpioOn  = (sda ? 1<<GPIO : 0) | (scl ? 1<<(GPIO-1) : 0);
+   p[n].gpioOff = (sda ? 0 : 1<<GPIO) | (scl ? 0 : 1<<(GPIO-1));
+   p[n].usDelay = 50;
+
+   return n+1;
+}
+
+int t5_i2c_byte(gpioPulse_t *p, int n, int byte)
+{
+   int b, sda;
+
+   /* eight data bits MSB first then an ACK, SDA only changes with SCL low */
+
+   for (b=7; b>=-1; b--)
+   {
+      sda = (b >= 0) ? ((byte >> b) & 1) : 0;
+
+      n = t5_i2c_level(p, n, sda, 0);
+      n = t5_i2c_level(p, n, sda, 1);
+      n = t5_i2c_level(p, n, sda, 0);
+   }
+
+   return n;
+}
+
 void t5(int pi)
 {
    int BAUD=4800;
@@ -348,7 +598,18 @@ To the lascivious pleasing of a lute.\n\
       {0, 1<<GPIO, 100000},
    };
 
-   int e, oc, c, wid, id;
+   int e, oc, c, wid, id, eid, b, np;
+
+   /* address 0x04, command 0x08, each followed by its complement */
+   uint32_t NEC=0xF708FB04;
+   gpioPulse_t nec[70];
+   gpioFrame_t frame;
+   gpioPulse_t pulses[120];
+   gpioFrame_t sniffed[4];
+   gpioWaveFrag_t frag;
+   gpioWaveCacheStats_t stats;
+   gpioWaveStream_t stream;
+   uint32_t hits;
 
    char text[2048];
 
@@ -404,6 +665,9 @@ To the lascivious pleasing of a lute.\n\
    if (c > 0) text[c] = 0; /* null terminate string */
    CHECK(5, 11, strcmp(TEXT, text), 0, 0, "wave tx busy, serial read");
 
+   e = bb_serial_read_errors(pi, GPIO);
+   CHECK(5, 34, e, 0, 0, "serial read errors");
+
    e = bb_serial_read_close(pi, GPIO);
    CHECK(5, 12, e, 0, 0, "serial read close");
 
@@ -439,6 +703,44 @@ To the lascivious pleasing of a lute.\n\
 
    callback_cancel(id);
 
+   /* two 'K' frames, the second with its stop bit held low */
+   e = bb_serial_read_open(pi, GPIO, BAUD, 8);
+   wave_clear(pi);
+   wave_add_generic(pi, 17, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  2000},
+            {0, 1<<GPIO,  208},
+            {1<<GPIO, 0,  416},
+            {0, 1<<GPIO,  208},
+            {1<<GPIO, 0,  208},
+            {0, 1<<GPIO,  416},
+            {1<<GPIO, 0,  208},
+            {0, 1<<GPIO,  208},
+            {1<<GPIO, 0,  416},
+            {0, 1<<GPIO,  208},
+            {1<<GPIO, 0,  416},
+            {0, 1<<GPIO,  208},
+            {1<<GPIO, 0,  208},
+            {0, 1<<GPIO,  416},
+            {1<<GPIO, 0,  208},
+            {0, 1<<GPIO,  416},
+            {1<<GPIO, 0,  2000}
+         });
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.1);
+   time_sleep(0.1);
+   wave_delete(pi, wid);
+
+   c = bb_serial_read(pi, GPIO, text, sizeof(text)-1);
+   CHECK(5, 50, c, 2, 0, "serial read framing, bytes");
+   CHECK(5, 51, (c == 2) && (text[0] == 'K') && (text[1] == 'K'),
+      1, 0, "serial read framing, data");
+
+   e = bb_serial_read_errors(pi, GPIO);
+   CHECK(5, 52, e, 1, 0, "serial read framing errors");
+
+   bb_serial_read_close(pi, GPIO);
+
    /* wave create and pad tests */
    id = callback(pi, GPIO, FALLING_EDGE, t5cbf);
    e = wave_clear(pi);
@@ -471,10 +773,107 @@ To the lascivious pleasing of a lute.\n\
             {0, 1<<GPIO, 100000}
          });
    c = wave_create(pi);
-   CHECK(5, 25, c, -67, 0, "No more CBs using wave create");
+   CHECK(5, 25, c, 0, 0, "wave create in deleted wave space, wid==");
+   wave_delete(pi, c);
+
+   e = wave_add_generic(pi, 6, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  10000},
+            {0, 1<<GPIO,  30000},
+            {1<<GPIO, 0,  60000},
+            {0, 1<<GPIO, 100000},
+            {1<<GPIO, 0,  60000},
+            {0, 1<<GPIO, 100000}
+         });
    wid = wave_create_and_pad(pi, 50);
    CHECK(5, 26, wid, 0, 0, "wave create pad, count==3, wid==");
 
+   wave_get_fragmentation(pi, &frag);
+   CHECK(5, 35, frag.waves, 2, 0, "wave get fragmentation");
+
+   wave_get_cache_stats(pi, &stats);
+   hits = stats.hits;
+
+   wave_add_generic(pi, 2, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  5000},
+            {0, 1<<GPIO,  5000}
+         });
+   c = wave_create_shared(pi);
+
+   wave_add_generic(pi, 2, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  5000},
+            {0, 1<<GPIO,  5000}
+         });
+   e = wave_create_shared(pi);
+   CHECK(5, 36, e, c, 0, "wave create shared same pulses, wid==");
+
+   wave_get_cache_stats(pi, &stats);
+   CHECK(5, 37, stats.hits - hits, 1, 0, "wave cache hits");
+
+   /* sharing is opt-in, a plain create always makes a new wave */
+
+   wave_add_generic(pi, 2, (gpioPulse_t[])
+         {  {1<<GPIO, 0,  5000},
+            {0, 1<<GPIO,  5000}
+         });
+   wid = wave_create(pi);
+   CHECK(5, 48, wid != c, 1, 0, "wave create same pulses, new wid");
+   wave_delete(pi, wid);
+
+   /* the first delete leaves the shared id valid for the second */
+
+   wave_delete(pi, e);
+   e = wave_delete(pi, c);
+   CHECK(5, 49, e, 0, 0, "wave delete shared, last reference");
+
+   /* two 200 ms segments fill a stream of two, a third must wait */
+
+   wave_stream_open(pi, 2, 2);
+
+   for (c=0; c<3; c++)
+   {
+      e = wave_stream_write(pi, 2, (gpioPulse_t[])
+            {  {0, 0, 100000},
+               {0, 0, 100000}
+            });
+   }
+   CHECK(5, 38, e, PI_WAVE_STREAM_FULL, 0, "wave stream write full");
+
+   wave_stream_status(pi, &stream);
+   CHECK(5, 39, stream.written, 2, 0, "wave stream status");
+
+   time_sleep(0.6);
+   wave_stream_status(pi, &stream);
+   CHECK(5, 43, stream.played, 2, 0, "wave stream segments played");
+
+   /*
+   The output ran dry, the next write restarts it as an underrun.
+   The segment pulses GPIO once and the queue then falls to the
+   low water mark.
+   */
+
+   t5_count = 0;
+   t5_event_count = 0;
+   eid = event_callback(pi, 20, t5evt);
+
+   wave_stream_write(pi, 2, (gpioPulse_t[])
+      {  {1<<GPIO, 0, 100000},
+         {0, 1<<GPIO, 100000}
+      });
+
+   /* set once a segment is queued so only the fall triggers it */
+   wave_stream_set_event(pi, 20, 0);
+
+   time_sleep(0.6);
+   wave_stream_status(pi, &stream);
+   CHECK(5, 44, stream.played, 3, 0, "wave stream restart played");
+   CHECK(5, 45, stream.underruns, 1, 0, "wave stream underruns");
+   CHECK(5, 46, t5_count, 1, 0, "wave stream callback count==");
+   CHECK(5, 47, t5_event_count, 1, 0, "wave stream low water event");
+
+   event_callback_cancel(eid);
+
+   wave_stream_close(pi);
+
    t5_count = 0;
    e = wave_chain(pi, (char[]) {1,0}, 2);
    CHECK(5, 27, e,  0, 0, "wave chain [1,0]");
@@ -482,6 +881,150 @@ To the lascivious pleasing of a lute.\n\
    CHECK(5, 28, t5_count, 5, 1, "callback count==");
 
    callback_cancel(id);
+
+   /* an NEC IR frame (low is a mark) sent as a wave and decoded */
+
+   e = ir_read_open(pi, GPIO, PI_DECODE_NEC);
+   CHECK(5, 29, e, 0, 0, "IR read open");
+
+   np = 0;
+   nec[np++] = (gpioPulse_t){0, 1<<GPIO, 9000};
+   nec[np++] = (gpioPulse_t){1<<GPIO, 0, 4500};
+
+   for (b=0; b<32; b++)
+   {
+      nec[np++] = (gpioPulse_t){0, 1<<GPIO, 560};
+      nec[np++] = (gpioPulse_t){1<<GPIO, 0, ((NEC>>b) & 1) ? 1690 : 560};
+   }
+
+   nec[np++] = (gpioPulse_t){0, 1<<GPIO, 560};
+   nec[np++] = (gpioPulse_t){1<<GPIO, 0, 1000};
+
+   wave_clear(pi);
+   wave_add_generic(pi, np, nec);
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.1);
+   time_sleep(0.1);
+
+   c = decode_read(pi, GPIO, &frame, 1);
+   CHECK(5, 30, c, 1, 0, "IR decode read");
+   CHECK(5, 31, (frame.code>>16) & 0xFF, 0x08, 0, "IR decode command");
+
+   e = decode_read_close(pi, GPIO);
+   CHECK(5, 32, e, 0, 0, "IR read close");
+
+   /* RC5 address 5, command 0x35, toggle set */
+
+   e = ir_read_open(pi, GPIO, PI_DECODE_RC5);
+   CHECK(5, 59, e, 0, 0, "IR read open RC5");
+
+   gpio_write(pi, GPIO, 1);
+   time_sleep(0.1);
+
+   np = t5_rc5_frame(pulses, 0x3975);
+
+   wave_clear(pi);
+   wave_add_generic(pi, np, pulses);
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.1);
+   time_sleep(0.1);
+   wave_delete(pi, wid);
+
+   c = decode_read(pi, GPIO, &frame, 1);
+   CHECK(5, 60, c, 1, 0, "RC5 decode read");
+   CHECK(5, 61, frame.code, 0x535, 0, "RC5 address and command");
+   CHECK(5, 62, frame.flags, PI_DECODE_TOGGLE, 0, "RC5 toggle");
+
+   e = decode_read_close(pi, GPIO);
+   CHECK(5, 63, e, 0, 0, "IR read close RC5");
+
+   /*
+   Two 26 bit Wiegand frames of code 0x123456.  Both parity bits
+   are 0 in the first, the second has a bad trailing parity bit.
+   */
+
+   set_mode(pi, GPIO-1, PI_OUTPUT);
+   gpio_write(pi, GPIO-1, 1);
+
+   e = wiegand_read_open(pi, GPIO, GPIO-1);
+   CHECK(5, 64, e, 0, 0, "Wiegand read open");
+
+   np = t5_wiegand_frame(pulses, 0, 0x2468AC, 26);
+   np = t5_wiegand_frame(pulses, np, 0x2468AD, 26);
+
+   wave_clear(pi);
+   wave_add_generic(pi, np, pulses);
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.1);
+   time_sleep(0.1);
+   wave_delete(pi, wid);
+
+   c = decode_read(pi, GPIO, sniffed, 4);
+   CHECK(5, 65, c, 2, 0, "Wiegand decode read");
+   CHECK(5, 66, sniffed[0].code, 0x123456, 0, "Wiegand code");
+   CHECK(5, 67, sniffed[0].bits, 26, 0, "Wiegand bits");
+   CHECK(5, 68, sniffed[0].flags, 0, 0, "Wiegand parity good");
+   CHECK(5, 69, sniffed[1].code, 0x123456, 0, "Wiegand bad parity code");
+   CHECK(5, 70, sniffed[1].flags, PI_DECODE_BAD_CHECK, 0,
+      "Wiegand parity failure");
+
+   e = decode_read_close(pi, GPIO);
+   CHECK(5, 71, e, 0, 0, "Wiegand read close");
+
+   set_mode(pi, GPIO-1, PI_INPUT);
+
+   e = i2c_sniff_open(pi, GPIO, GPIO);
+   CHECK(5, 33, e, PI_GPIO_IN_USE, 0, "I2C sniff open same GPIO");
+
+   /* the bus idles high, nothing is decoded until it is driven */
+
+   set_mode(pi, GPIO-1, PI_OUTPUT);
+   gpio_write(pi, GPIO, 1);
+   gpio_write(pi, GPIO-1, 1);
+
+   e = i2c_sniff_open(pi, GPIO, GPIO-1);
+   CHECK(5, 40, e, 0, 0, "I2C sniff open");
+
+   time_sleep(0.1);
+
+   c = decode_read(pi, GPIO, &frame, 1);
+   CHECK(5, 41, c, 0, 0, "I2C sniff decode read, idle bus");
+
+   /* START, write to address 0x50, data 0x3C, STOP */
+
+   np = 0;
+   np = t5_i2c_level(pulses, np, 0, 1);
+   np = t5_i2c_level(pulses, np, 0, 0);
+   np = t5_i2c_byte(pulses, np, 0x50<<1);
+   np = t5_i2c_byte(pulses, np, 0x3C);
+   np = t5_i2c_level(pulses, np, 0, 1);
+   np = t5_i2c_level(pulses, np, 1, 1);
+
+   wave_clear(pi);
+   wave_add_generic(pi, np, pulses);
+   wid = wave_create(pi);
+   wave_send_once(pi, wid);
+   while (wave_tx_busy(pi)) time_sleep(0.1);
+   time_sleep(0.1);
+   wave_delete(pi, wid);
+
+   c = decode_read(pi, GPIO, sniffed, 4);
+   CHECK(5, 53, c, 3, 0, "I2C sniff decode read, frames");
+   CHECK(5, 54, sniffed[0].code, 0xA0, 0, "I2C sniff address byte");
+   CHECK(5, 55, sniffed[0].flags, PI_DECODE_START, 0, "I2C sniff START");
+   CHECK(5, 56, sniffed[1].code, 0x3C, 0, "I2C sniff data byte");
+   CHECK(5, 57, sniffed[1].flags, 0, 0, "I2C sniff data ACK");
+   CHECK(5, 58, sniffed[2].flags, PI_DECODE_STOP, 0, "I2C sniff STOP");
+
+   e = decode_read_close(pi, GPIO);
+   CHECK(5, 42, e, 0, 0, "I2C sniff close");
+
+   set_mode(pi, GPIO-1, PI_INPUT);
+
+   wave_clear(pi);
 }
 
 int t6_count=0;